@@ -1,4 +1,4 @@
-gcc bin2elf.c -o bin2elf
+cmake -S ../../src/host -B build && cmake --build build --target bin2elf fwsym-cli
 dd if=wlanbt_robin_img_ax.skprx.elf  of=8787.bin bs=304 skip=1
-./bin2elf 8787.bin > 8787.elf
-
+./build/bin2elf -f 8787.bin -o 8787.elf
+./build/fwsym -o 8787.elf -m 8787.map 8787.elf
@@ -0,0 +1,81 @@
+#include <string.h>
+
+#include <vitasdk.h>
+
+#include "uwifimon.h"
+#include "kwifimon_export.h"
+
+#include "cmdtrace.h"
+
+static struct wifimon_cmdtrace_t trace;
+
+int cmdtrace_start(void)
+{
+	trace.cursor = 0;
+
+	return uwifimon_cmdtrace_enable(1);
+}
+
+int cmdtrace_stop(void)
+{
+	int ret = cmdtrace_drain();
+	int off = uwifimon_cmdtrace_enable(0);
+
+	return (ret < 0) ? ret : off;
+}
+
+int cmdtrace_drain(void)
+{
+	int ret, n = 0;
+	SceUID fd;
+
+	fd = sceIoOpen("ux0:data/cmd.wct", SCE_O_WRONLY | SCE_O_CREAT | SCE_O_APPEND, 0777);
+	if (fd < 0) {
+		return -1;
+	}
+
+	if (sceIoLseek(fd, 0, SCE_SEEK_END) == 0) {
+		struct wifimon_cmdtrace_hdr_t h;
+
+		memset(&h, 0, sizeof(h));
+		h.magic = WIFIMON_CMDTRACE_MAGIC;
+		h.version = 1;
+		h.rec_size = sizeof(struct wifimon_cmdtrace_rec_t);
+		h.unit_ns = 1000;
+		if (sceIoWrite(fd, &h, sizeof(h)) != sizeof(h)) {
+			sceIoClose(fd);
+			return -1;
+		}
+	}
+
+	// a short read means the ring is empty for now
+	do {
+		ret = uwifimon_cmdtrace_read(&trace);
+		if (ret < 0) {
+			break;
+		}
+
+		if (trace.lost) {
+			struct wifimon_cmdtrace_rec_t lost;
+
+			memset(&lost, 0, sizeof(lost));
+			lost.kind = WIFIMON_CMDTRACE_LOST;
+			lost.result = trace.lost;
+			if (sceIoWrite(fd, &lost, sizeof(lost)) != sizeof(lost)) {
+				ret = -1;
+				break;
+			}
+		}
+
+		int len = trace.n * sizeof(struct wifimon_cmdtrace_rec_t);
+		if (len && sceIoWrite(fd, trace.rec, len) != len) {
+			ret = -1;
+			break;
+		}
+		n += trace.n;
+	} while (trace.n == WIFIMON_CMDTRACE_READ);
+
+	sceIoClose(fd);
+
+	return (ret < 0) ? ret : n;
+}
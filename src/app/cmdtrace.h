@@ -0,0 +1,14 @@
+#ifndef CMDTRACE_h_
+#define CMDTRACE_h_
+
+// host command trace of the kernel module, drained into ux0:data/cmd.wct
+// after a wifimon_cmdtrace_hdr_t, decoded on linux by host/cmdtrace
+
+// empties the module's ring and turns the trace on
+int cmdtrace_start(void);
+// what is left drained, then off
+int cmdtrace_stop(void);
+// records read so far appended, returns how many or < 0
+int cmdtrace_drain(void);
+
+#endif
@@ -5,62 +5,185 @@
 #include <vitasdk.h>
 
 #include "util.h"
+#include "dump.h"
+#include "fwdump.h"
+#include "fwsnap.h"
 
+#define SEG_SKIP 0x0001
 
 struct seg_t {
 	uint32_t base;
 	uint32_t size;
 	char *name;
+	uint32_t flags;
 } segs[] = {
-	{ 0x00000000, 0x00060000, "00seg" },// code ram (tcim)
-	{ 0x04000000, 0x00010000, "04seg" },// data ram (tcdm)
-	{ 0xc0000000, 0x00040000, "c0seg" },// ram
-	{ 0x03f00000, 0x00050000, "03seg" },// code rom
-	{ 0x80000000, 0x00010000, "80seg" },// peripherals
-	{ 0x90000000, 0x00001000, "90seg" },// this one is not dumpable somehow
+	{ 0x00000000, 0x00060000, "00seg", 0 },// code ram (tcim)
+	{ 0x04000000, 0x00010000, "04seg", 0 },// data ram (tcdm)
+	{ 0xc0000000, 0x00040000, "c0seg", 0 },// ram
+	{ 0x03f00000, 0x00050000, "03seg", 0 },// code rom
+	{ 0x80000000, 0x00010000, "80seg", 0 },// peripherals
+	{ 0x90000000, 0x00001000, "90seg", SEG_SKIP },// this one is not dumpable somehow
 };
 
+struct dump_file_t {
+	SceUID fd;
+	const struct seg_t *seg;
+	dump_progress_t progress;
+};
+
+static int dump_read(void *ctx, uint32_t addr, uint32_t *buf, uint32_t words)
+{
+	int ret = mem_read_bulk(addr, buf, words);
+
+	// give the card a moment before the retry
+	if (ret <= 0) {
+		sceKernelDelayThread(1000);
+	}
+
+	return ret;
+}
+
+static int dump_pread(void *ctx, void *buf, uint32_t len, uint32_t off)
+{
+	struct dump_file_t *f = ctx;
+
+	return sceIoPread(f->fd, buf, len, off);
+}
 
-int dump(int i)
+static int dump_pwrite(void *ctx, const void *buf, uint32_t len, uint32_t off)
 {
-	int ret = 0;
-	uint32_t addr = segs[i].base;
-	uint32_t addrmax = segs[i].base + segs[i].size;
+	struct dump_file_t *f = ctx;
+
+	return sceIoPwrite(f->fd, buf, len, off);
+}
 
+static void dump_progress(void *ctx, uint32_t base, uint32_t done, uint32_t size)
+{
+	struct dump_file_t *f = ctx;
 
-	uint8_t *seg = malloc(segs[i].size);
-	if (seg == NULL) {
+	if (f->progress) {
+		f->progress(f->seg->name, done, size);
+	}
+}
+
+static const struct fwdump_ops_t dump_ops = {
+	.read = dump_read,
+	.pread = dump_pread,
+	.pwrite = dump_pwrite,
+	.progress = dump_progress,
+};
+
+// state is 12K, too much for the stack
+static struct fwdump_t dump_state;
+
+int dump(int i, dump_progress_t progress)
+{
+	struct dump_file_t f;
+	char name[200];
+	int ret;
+
+	// the file is not truncated, an earlier dump cut short is resumed, a
+	// complete one is dumped again over it
+	sprintf(name, "ux0:data/dump-%08x-%08x.fwd", (unsigned int)segs[i].base, (unsigned int)segs[i].size);
+	f.fd = sceIoOpen(name, SCE_O_RDWR | SCE_O_CREAT, 0777);
+	if (f.fd < 0) {
 		return -1;
 	}
-	memset(seg, 0, segs[i].size);
+	f.seg = &segs[i];
+	f.progress = progress;
 
-	uint8_t *segp = seg;
-	uint32_t size = 0;
+	dump_state.ops = &dump_ops;
+	dump_state.ctx = &f;
+	ret = fwdump_segment(&dump_state, segs[i].base, segs[i].size, sceKernelGetProcessTimeLow());
 
-	while (addr < addrmax) {
-		int ret = mem_read(addr, (uint32_t *)segp);
-		if (ret < 0) {
-			ret = -2;
-			break;
+	sceIoClose(f.fd);
+
+	return ret;
+}
+
+int dump_all(dump_progress_t progress)
+{
+	int failed = 0;
+
+	for (uint32_t i = 0; i < sizeof(segs) / sizeof(segs[0]); i++) {
+		if (segs[i].flags & SEG_SKIP) {
+			continue;
 		}
+		if (dump(i, progress) < 0) {
+			failed++;
+		}
+	}
+
+	return failed;
+}
+
+// incremental snapshots of ram and tcm, appended to one file
+
+#define SNAP_PAGE       256
+#define SNAP_FULL_EVERY 32
 
-		segp += 4;
-		addr += 4;
-		size += 4;
+static const int snap_segs[] = { 2, 1 };
+
+static struct fwsnap_t snap_state[2];
+static int snap_ready;
+
+static int snap_delta(void *ctx, struct wifimon_mem_delta_t *req, uint32_t len)
+{
+	int ret = mem_delta(req, len);
+
+	// give the card a moment before the retry
+	if (ret <= 0) {
+		sceKernelDelayThread(1000);
 	}
 
-	char name[200];
+	return ret;
+}
+
+static int snap_write(void *ctx, const void *buf, uint32_t len)
+{
+	return sceIoWrite(*(SceUID *)ctx, buf, len);
+}
+
+static const struct fwsnap_ops_t snap_ops = {
+	.delta = snap_delta,
+	.write = snap_write,
+};
+
+int snap_take(void)
+{
+	uint32_t now = sceKernelGetProcessTimeWide() / 1000;
+	int ret, pages = 0;
 	SceUID fd;
 
-	sprintf(name, "ux0:data/dump-%08x-%08x.bin", (unsigned int)segs[i].base, (unsigned int)size);
+	if (!snap_ready) {
+		for (uint32_t i = 0; i < 2; i++) {
+			const struct seg_t *seg = &segs[snap_segs[i]];
 
-	if ((fd = sceIoOpen(name, SCE_O_WRONLY|SCE_O_CREAT|SCE_O_TRUNC, 0777)) >= 0) {
-		if (sceIoWrite(fd, seg, size) >= 0) {
-			sceIoClose(fd);
+			if (fwsnap_init(&snap_state[i], seg->base, seg->size, SNAP_PAGE, now) < 0) {
+				return -1;
+			}
+			snap_state[i].ops = &snap_ops;
+			snap_state[i].full_every = SNAP_FULL_EVERY;
 		}
+		snap_ready = 1;
 	}
 
-	free(seg);
+	fd = sceIoOpen("ux0:data/snap.fws", SCE_O_WRONLY | SCE_O_CREAT | SCE_O_APPEND, 0777);
+	if (fd < 0) {
+		return -1;
+	}
 
-	return ret;
+	for (uint32_t i = 0; i < 2; i++) {
+		snap_state[i].ctx = &fd;
+		ret = fwsnap_take(&snap_state[i], now);
+		if (ret < 0) {
+			pages = ret;
+			break;
+		}
+		pages += ret;
+	}
+
+	sceIoClose(fd);
+
+	return pages;
 }
@@ -0,0 +1,18 @@
+#ifndef DUMP_h_
+#define DUMP_h_
+
+#include <stdint.h>
+
+typedef void (*dump_progress_t)(const char *name, uint32_t done, uint32_t size);
+
+// one segment into ux0:data/dump-<base>-<size>.fwd, resuming an earlier
+// dump of it, 0 when complete, -1 file error, -2 memory not readable
+int dump(int i, dump_progress_t progress);
+// every dumpable segment, returns how many did not complete
+int dump_all(dump_progress_t progress);
+
+// appends a snapshot of ram and tcm to ux0:data/snap.fws, full the first
+// time, afterwards the pages that changed, returns how many or < 0
+int snap_take(void);
+
+#endif
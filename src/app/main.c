@@ -10,6 +10,8 @@
 
 #include "ui.h"
 #include "patch.h"
+#include "dump.h"
+#include "cmdtrace.h"
 
 
 int wlan_idx = -1;
@@ -17,6 +19,22 @@ int wlan_idx = -1;
 int sceNetSyscallGetIfList(struct iface_t *, int c);
 int sceNetSyscallControl(int dev, int req, void *buf, int buf_len);
 
+#define SNAP_INTERVAL_US 5000000
+// the module's ring holds WIFIMON_CMDTRACE_SLOTS records, far more than
+// the firmware answers in this long
+#define TRACE_INTERVAL_US 250000
+
+static int dump_y;
+
+static void dump_progress(const char *name, uint32_t done, uint32_t size)
+{
+	vita2d_start_drawing();
+	vita2d_draw_rectangle(20, dump_y - 10, 400, 12, ui_color.bg);
+	vita2d_font_draw_textf(ui_font, 20, dump_y, ui_color.text, 10, "dump %s: %u/%u KiB", name, done / 1024, size / 1024);
+	vita2d_end_drawing();
+	vita2d_swap_buffers();
+}
+
 void find_wlan_idx(void)
 {
 	struct iface_t *iface_list = NULL;
@@ -47,6 +65,11 @@ void main(void)
 {
 	int x=20,y=0;
 	int ret;
+	int lat_on = 0;
+	int snap_on = 0;
+	SceUInt64 snap_last = 0;
+	int trace_on = 0;
+	SceUInt64 trace_last = 0;
 	SceUID kmod, umod;
 
 	ui_init();
@@ -83,36 +106,6 @@ void main(void)
 
 
 
-#if 0
-	{
-
-		vita2d_font_draw_textf(ui_font, 20, y, ui_color.text, 10, "dump: %d", dump(0));
-		y+=10;
-	}
-	{
-
-		vita2d_font_draw_textf(ui_font, 20, y, ui_color.text, 10, "dump: %d", dump(1));
-		y+=10;
-	}
-	{
-		vita2d_font_draw_textf(ui_font, 20, y, ui_color.text, 10, "dump: %d", dump(2));
-		y+=10;
-	}
-	{
-		vita2d_font_draw_textf(ui_font, 20, y, ui_color.text, 10, "dump: %d", dump(3));
-		y+=10;
-	}
-	{
-		vita2d_font_draw_textf(ui_font, 20, y, ui_color.text, 10, "dump: %d", dump(4));
-		y+=10;
-	}
-/*
-	{
-		vita2d_font_draw_textf(ui_font, 20, y, ui_color.text, 10, "dump: %d", dump(5));
-		y+=10;
-	}
-	*/
-#endif
 
 	{
 		vita2d_font_draw_textf(ui_font, 20, y, ui_color.text, 10, "Disconnect %d", uwifimon_mod_state());
@@ -137,6 +130,93 @@ void main(void)
 			vita2d_swap_buffers();
 			y+=10;
 		}
+		if (in & SCE_CTRL_UP) {
+			static struct wifimon_lat_t l;
+			if (!lat_on) {
+				ret = uwifimon_lat_enable(1);
+				lat_on = 1;
+				vita2d_start_drawing();
+				vita2d_font_draw_textf(ui_font, 20, y, ui_color.text, 10, "latency on: 0x%x", ret);
+			} else {
+				ret = uwifimon_mod_lat(&l, 1);
+				vita2d_start_drawing();
+				vita2d_font_draw_textf(ui_font, 20, y, ui_color.text, 10, "lat ret: 0x%x hook n:%d p99:%dus max:%dus ioctl n:%d p99:%dus max:%dus", ret,
+					l.stage[LAT_STAGE_HOOK].cnt, l.stage[LAT_STAGE_HOOK].p99, l.stage[LAT_STAGE_HOOK].max,
+					l.stage[LAT_STAGE_IOCTL].cnt, l.stage[LAT_STAGE_IOCTL].p99, l.stage[LAT_STAGE_IOCTL].max);
+			}
+			vita2d_end_drawing();
+			vita2d_swap_buffers();
+			y+=10;
+		}
+		if (in & SCE_CTRL_DOWN) {
+			static int rpcap_on = 0;
+			vita2d_start_drawing();
+			if (!rpcap_on) {
+				ret = uwifimon_rpcap_start(KWIFIMON_RPCAP_PORT);
+				rpcap_on = (ret == 0);
+				vita2d_font_draw_textf(ui_font, 20, y, ui_color.text, 10, "rpcap server on port %d: 0x%x", KWIFIMON_RPCAP_PORT, ret);
+			} else {
+				ret = uwifimon_rpcap_stop();
+				rpcap_on = 0;
+				vita2d_font_draw_textf(ui_font, 20, y, ui_color.text, 10, "rpcap server stopped: 0x%x", ret);
+			}
+			vita2d_end_drawing();
+			vita2d_swap_buffers();
+			y+=10;
+		}
+		if (in & SCE_CTRL_SELECT) {
+			dump_y = y;
+			y += 10;
+			ret = dump_all(dump_progress);
+			vita2d_start_drawing();
+			vita2d_font_draw_textf(ui_font, 20, y, ui_color.text, 10, "dump done, %d segments failed", ret);
+			vita2d_end_drawing();
+			vita2d_swap_buffers();
+			y+=10;
+		}
+		if (in & SCE_CTRL_START) {
+			snap_on = !snap_on;
+			snap_last = 0;
+			vita2d_start_drawing();
+			vita2d_font_draw_textf(ui_font, 20, y, ui_color.text, 10, "snapshots every %ds: %s", SNAP_INTERVAL_US / 1000000, snap_on ? "on" : "off");
+			vita2d_end_drawing();
+			vita2d_swap_buffers();
+			y+=10;
+		}
+		if (snap_on && sceKernelGetProcessTimeWide() - snap_last >= SNAP_INTERVAL_US) {
+			snap_last = sceKernelGetProcessTimeWide();
+			ret = snap_take();
+			if (ret < 0) {
+				snap_on = 0;
+				vita2d_start_drawing();
+				vita2d_font_draw_textf(ui_font, 20, y, ui_color.text, 10, "snapshot failed: %d", ret);
+				vita2d_end_drawing();
+				vita2d_swap_buffers();
+				y+=10;
+			}
+		}
+		if (in & SCE_CTRL_LTRIGGER) {
+			ret = trace_on ? cmdtrace_stop() : cmdtrace_start();
+			trace_on = !trace_on && ret >= 0;
+			vita2d_start_drawing();
+			vita2d_font_draw_textf(ui_font, 20, y, ui_color.text, 10, "command trace %s: 0x%x", trace_on ? "on" : "off", ret);
+			vita2d_end_drawing();
+			vita2d_swap_buffers();
+			y+=10;
+		}
+		if (trace_on && sceKernelGetProcessTimeWide() - trace_last >= TRACE_INTERVAL_US) {
+			trace_last = sceKernelGetProcessTimeWide();
+			ret = cmdtrace_drain();
+			if (ret < 0) {
+				trace_on = 0;
+				uwifimon_cmdtrace_enable(0);
+				vita2d_start_drawing();
+				vita2d_font_draw_textf(ui_font, 20, y, ui_color.text, 10, "command trace failed: %d", ret);
+				vita2d_end_drawing();
+				vita2d_swap_buffers();
+				y+=10;
+			}
+		}
 		if (in & SCE_CTRL_SQUARE) {
 			vita2d_start_drawing();
 			vita2d_font_draw_textf(ui_font, 20, y, ui_color.text, 10, "Patching %08x", patch_do());
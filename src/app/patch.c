@@ -6,117 +6,103 @@
 #include <vitasdk.h>
 
 #include "util.h"
+#include "fwpatch.h"
+#include "fwhook.h"
+#include "rxfwd_hook.h"
 
 #define ARRAY_SIZE(x) (sizeof(x)/sizeof(x[0]))
 
-uint8_t p1_patch[] = {
-	0xb1, 0x68, 0x31, 0x44, 0x70, 0x69, 0x00, 0x28, 0x00, 0xD1, 0x05, 0x48, 0xA0, 0xF7, 0x75, 0xFD, 0x00, 0x25, 0x02, 0xAA,
-	0x03, 0xA9, 0x04, 0xA8, 0xAB, 0xF7, 0xB6, 0xFD, 0xAB, 0xF7, 0xDA, 0xFD, 0x00, 0xFF, 0x05, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-};
+// the rx forwarding hook, rxfwd.hook linked by patch_init for the build
+// firmware runs
+static struct fwhook_link_t rxfwd;
 
-uint8_t p2_orig[] = {
-	0x00, 0x25, 0x02, 0xaa,
+struct fwpatch_t patches[] = {
+	{ 0 },   // rxfwd payload
+	{ 0 },   // bl into it
 };
 
-/* bl 0x5fedc */
-uint8_t p2_patch[] = {
-	0x54, 0xf0, 0x1a, 0xfa,
-};
+static int patch_read(void *ctx, uint32_t addr, uint32_t *buf, uint32_t words)
+{
+	return mem_read_bulk(addr, buf, words);
+}
 
+static int patch_commit(void *ctx, struct wifimon_mem_patch_t *req, uint32_t len)
+{
+	return mem_patch(req, len);
+}
 
-uint8_t p3_orig[] = {
-	0x20, 0x20, 0x20, 0x81,
+static const struct fwpatch_ops_t patch_ops = {
+	.read = patch_read,
+	.patch = patch_commit,
 };
 
-uint8_t p3_patch[] = {
-	0x20, 0x20, 0x20, 0x20,
-};
+static struct fwpatch_set_t patch_set;
+static int patch_ready;
 
+// the build whose site holds what the bl replaces, or the bl when the hook
+// is in already, returns -2 when firmware cannot be read, -3 none of them
+static int patch_link(const struct fwhook_t *h, struct fwhook_link_t *l)
+{
+	for (uint32_t i = 0; i < h->nbuild; i++) {
+		uint32_t word;
 
-uint8_t p4_orig[] = {
-	0x00, 0x19, 0xC1, 0x78,
-};
+		if (fwhook_link(h, i, l) < 0 || fwhook_verify(h, i, l) < 0) {
+			continue;
+		}
+		if (mem_read_bulk(l->site, &word, 1) < 0) {
+			return -2;
+		}
+		if (memcmp(&word, h->orig, FWHOOK_TRAMP_LEN) == 0 || memcmp(&word, l->tramp, FWHOOK_TRAMP_LEN) == 0) {
+			return i;
+		}
+	}
 
-uint8_t p4_patch[] = {
-	0x00, 0xf0, 0x12, 0xf8,
-};
+	return -3;
+}
 
-struct patch_t {
-	uint32_t addr;
-	uint32_t size;
-	uint8_t *orig;
-	uint8_t *patch;
-} patches[] = {
-	{ 0x0005fedc, sizeof(p1_patch), NULL, p1_patch},
-//	{ 0x00000a3c, sizeof(p3_orig), p3_orig, p3_patch},
-//	{ 0x000001f0, sizeof(p4_orig), p4_orig, p4_patch},
-	{ 0x0000baa4, sizeof(p2_orig), p2_orig, p2_patch},
-};
+// once per app start, what is in firmware already counts as applied, the
+// app does not know what it replaced and cannot take it out
+static int patch_init(void)
+{
+	uint32_t in, orig;
+	int ret;
+
+	if (!patch_ready) {
+		if ((ret = patch_link(&rxfwd_hook, &rxfwd)) < 0) {
+			return ret;
+		}
+		fwhook_patches(&rxfwd_hook, &rxfwd, &patches[0], 0);
+		if (fwpatch_init(&patch_set, patches, ARRAY_SIZE(patches)) < 0) {
+			return -1;
+		}
+		patch_set.ops = &patch_ops;
+		if ((ret = fwpatch_scan(&patch_set, &in, &orig)) < 0) {
+			return ret;
+		}
+		patch_ready = 1;
+	}
+
+	return 0;
+}
 
 int patch_do(void)
 {
-	int cnt = 0;
-
-	for (uint32_t i = 0; i < ARRAY_SIZE(patches); i++) {
-		struct patch_t *p = &patches[i];
-
-		for (uint32_t j = 0; j < (p->size+3)/4; j++) {
-			uint32_t tmp, in;
-
-			memcpy(&tmp, &p->patch[4*j], 4);
-			int ret = mem_write(p->addr + 4*j, tmp);
-			if (ret < 0) {
-				// we broke wifi, sorry about that
-				return -1;
-			}
-
-			ret = mem_read(p->addr + 4*j, &in);
-			if (ret < 0) {
-				// we broke wifi, sorry about that
-				return -2;
-			}
-
-			if (tmp != in) {
-				return -3;
-			}
-			cnt++;
-		}
+	int ret;
+
+	if ((ret = patch_init()) < 0) {
+		return ret;
 	}
 
-	return cnt;
+	return fwpatch_apply(&patch_set, (1 << ARRAY_SIZE(patches)) - 1);
 }
 
 int patch_undo(void)
 {
-	for (uint32_t i = ARRAY_SIZE(patches)-1; i ; i--) {
-		struct patch_t *p = &patches[i];
-
-		if (p->orig == NULL) {
-			continue;
-		}
+	int ret;
 
-		for (uint32_t j = 0; j < p->size/4; j++) {
-			uint32_t tmp, in;
-
-			memcpy(&tmp, &p->orig[4*j], 4);
-			int ret = mem_write(p->addr + 4*j, tmp);
-			if (ret < 0) {
-				// we broke wifi, sorry about that
-				return -1;
-			}
-
-			ret = mem_read(p->addr + 4*j, &in);
-			if (ret < 0) {
-				// we broke wifi, sorry about that
-				return -2;
-			}
-
-			if (tmp != in) {
-				return -3;
-			}
-		}
+	if ((ret = patch_init()) < 0) {
+		return ret;
 	}
 
-	return 0;
+	return fwpatch_undo(&patch_set, (1 << ARRAY_SIZE(patches)) - 1);
 }
@@ -1,8 +1,12 @@
 #ifndef PATCH_h_
 #define PATCH_h_
 
-
+// the patches go in as one transaction, all of them or none, the hooks
+// linked for the firmware build first, -3 also when no hook knows it
+// returns words written or < 0 as fwpatch_apply
 int patch_do(void);
+// back to what they replaced, -1 for patches found in firmware at app
+// start, what they replaced is not known
 int patch_undo(void);
 
 #endif
@@ -0,0 +1,47 @@
+// rxfwd.hook assembled by fwhook, do not edit
+
+static const char *const rxfwd_sym[] = {
+	"rx_site",
+	"hook_space",
+	"rx_forward",
+	"rx_call",
+};
+
+// what the bl replaces
+static const uint8_t rxfwd_orig[] = {
+	0x00, 0x25, 0x02, 0xaa,
+};
+
+static const uint8_t rxfwd_payload[] = {
+	0xb1, 0x68, 0x31, 0x44, 0x70, 0x69, 0x00, 0x28, 0x00, 0xd1, 0x05, 0x48,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x25, 0x02, 0xaa, 0x03, 0xa9, 0x04, 0xa8,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00,
+};
+
+static const struct fwhook_rel_t rxfwd_rel[] = {
+	{ 0x000c, FWHOOK_BL, 2, 0 },   // rx_forward
+	{ 0x0018, FWHOOK_BL, 3, 0 },   // rx_call
+	{ 0x001c, FWHOOK_BL, 0, 12 },   // rx_site
+	{ 0x0020, FWHOOK_ABS32, FWHOOK_SELF, 36 },   // buf
+};
+
+static const struct fwhook_build_t rxfwd_build[] = {
+	{ "robin_ax", { 0x0000baa4, 0x0005fedc, 0x000009d6, 0x0000ba64 } },
+};
+
+static const struct fwhook_t rxfwd_hook = {
+	.version = FWHOOK_VERSION,
+	.name = "rxfwd",
+	.sym = rxfwd_sym,
+	.nsym = 4,
+	.orig = rxfwd_orig,
+	.payload = rxfwd_payload,
+	.len = 52,
+	.entry = 0,
+	.rel = rxfwd_rel,
+	.nrel = 4,
+	.build = rxfwd_build,
+	.nbuild = 1,
+};
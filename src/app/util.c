@@ -26,6 +26,41 @@ int mem_read(uint32_t addr, uint32_t *data)
 	return ret;
 }
 
+// up to WIFIMON_MEM_BULK_MAX words in one ioctl, returns words read or < 0
+int mem_read_bulk(uint32_t addr, uint32_t *data, uint32_t words)
+{
+	static uint8_t request[sizeof(struct wifimon_mem_bulk_t) + 4 * WIFIMON_MEM_BULK_MAX];
+	struct wifimon_mem_bulk_t b;
+
+	if (words > WIFIMON_MEM_BULK_MAX) {
+		words = WIFIMON_MEM_BULK_MAX;
+	}
+
+	b.addr = addr;
+	b.words = words;
+	memcpy(request, &b, sizeof(b));
+
+	int ret = sceNetSyscallControl(wlan_idx, WLAN_IOCTL_MEM_BULK, request, sizeof(b) + 4 * words);
+
+	if (ret > 0) {
+		memcpy(data, &request[sizeof(b)], 4 * ((uint32_t)ret < words ? (uint32_t)ret : words));
+	}
+
+	return ret;
+}
+
+// req is followed by the page hashes and room for the pages, returns pages done or < 0
+int mem_delta(struct wifimon_mem_delta_t *req, uint32_t len)
+{
+	return sceNetSyscallControl(wlan_idx, WLAN_IOCTL_MEM_DELTA, req, len);
+}
+
+// entries written under one lock, all or none, returns words written or < 0
+int mem_patch(struct wifimon_mem_patch_t *req, uint32_t len)
+{
+	return sceNetSyscallControl(wlan_idx, WLAN_IOCTL_MEM_PATCH, req, len);
+}
+
 int mem_write(uint32_t addr, uint32_t data)
 {
 	uint8_t request[9];
@@ -3,7 +3,12 @@
 
 #include <stdint.h>
 
+#include "kwifimon_export.h"
+
 int mem_read(uint32_t addr, uint32_t *datA);
+int mem_read_bulk(uint32_t addr, uint32_t *data, uint32_t words);
+int mem_delta(struct wifimon_mem_delta_t *req, uint32_t len);
+int mem_patch(struct wifimon_mem_patch_t *req, uint32_t len);
 int mem_write(uint32_t addr, uint32_t datA);
 int wlan_cmd_func_shutdown(void);
 int wlan_cmd_init(void);
@@ -0,0 +1,163 @@
+#include "airtime.h"
+
+struct airtime_rate_t airtime_rates[AIRTIME_RATES];
+
+// legacy rates in 500 kbps, in index order
+static const uint8_t airtime_legacy_rate[12] = { 2, 4, 11, 22, 12, 18, 24, 36, 48, 72, 96, 108 };
+
+static const uint8_t airtime_legacy_idx[256] = {
+	[2] = 1, [4] = 2, [11] = 3, [22] = 4, [12] = 5, [18] = 6,
+	[24] = 7, [36] = 8, [48] = 9, [72] = 10, [96] = 11, [108] = 12,
+};
+
+// rxpd legacy rate index, 4 is unused
+static const uint8_t airtime_rxpd_legacy[13] = { 1, 2, 3, 4, 0, 5, 6, 7, 8, 9, 10, 11, 12 };
+
+// coded bits per subcarrier and coding rate per mcs, ht repeats 0..7 per stream
+static const uint8_t airtime_mod[10][3] = {
+	{ 1, 1, 2 }, { 2, 1, 2 }, { 2, 3, 4 }, { 4, 1, 2 }, { 4, 3, 4 },
+	{ 6, 2, 3 }, { 6, 3, 4 }, { 6, 5, 6 }, { 8, 3, 4 }, { 8, 5, 6 },
+};
+
+// data subcarriers at 20, 40, 80 and 160 MHz
+static const uint16_t airtime_nsd[4] = { 52, 108, 234, 468 };
+
+// long training fields per number of streams
+static const uint8_t airtime_ht_nltf[5] = { 0, 1, 2, 4, 4 };
+static const uint8_t airtime_vht_nltf[9] = { 0, 1, 2, 4, 4, 6, 6, 8, 8 };
+
+static void airtime_set(struct airtime_rate_t *r, uint32_t kind, uint32_t div, uint32_t pre_us, uint32_t sgi, uint32_t extra)
+{
+	r->kind = kind;
+	r->div = div;
+	r->pre_us = pre_us;
+	r->sgi = sgi;
+	r->shift = (kind == AIRTIME_DSSS) ? 4 : 3;
+	r->extra = extra;
+	r->recip = ((1ull << AIRTIME_SHIFT) + div - 1) / div;
+}
+
+// ht and vht data bits per symbol, 0 where the coding leaves a fraction
+static uint32_t airtime_dbps(uint32_t mcs, uint32_t nss, uint32_t bw)
+{
+	uint32_t cbps = airtime_nsd[bw] * airtime_mod[mcs][0] * nss;
+
+	if (cbps * airtime_mod[mcs][1] % airtime_mod[mcs][2]) {
+		return 0;
+	}
+
+	return cbps * airtime_mod[mcs][1] / airtime_mod[mcs][2];
+}
+
+// service bits and 6 tail bits per bcc encoder, ht has one per 300 Mbps
+// and vht one per 600 Mbps at the short gi rate, vht picks them per rate
+// in a way that can differ, which moves the result by a symbol at most
+static uint32_t airtime_extra(uint32_t dbps, uint32_t per_es)
+{
+	return 16 + 6 * ((dbps + per_es - 1) / per_es);
+}
+
+void airtime_init(void)
+{
+	struct airtime_rate_t *r;
+	uint32_t i, mcs, nss, bw, sgi, dbps;
+
+	for (i = 0; i < AIRTIME_RATES; i++) {
+		airtime_rates[i] = (struct airtime_rate_t){ 0 };
+	}
+
+	for (i = 0; i < 12; i++) {
+		uint32_t rate = airtime_legacy_rate[i];
+
+		if (i < 4) {
+			airtime_set(&airtime_rates[AIRTIME_LEGACY + i], AIRTIME_DSSS, rate, 192, 0, 0);
+		} else {
+			airtime_set(&airtime_rates[AIRTIME_LEGACY + i], AIRTIME_OFDM, 2 * rate, 20, 0, 22);
+		}
+	}
+
+	for (mcs = 0; mcs <= 32; mcs++) {
+		for (bw = 0; bw < 2; bw++) {
+			for (sgi = 0; sgi < 2; sgi++) {
+				r = &airtime_rates[airtime_ht(mcs, bw, sgi)];
+				nss = (mcs == 32) ? 1 : mcs / 8 + 1;
+				// mcs 32 is 6 Mbps duplicated over both 20 MHz halves
+				dbps = (mcs == 32) ? (bw ? 24 : 0) : airtime_dbps(mcs & 7, nss, bw);
+				if (dbps) {
+					airtime_set(r, AIRTIME_HT, dbps, 32 + 4 * airtime_ht_nltf[nss], sgi, airtime_extra(dbps, 1080));
+				}
+			}
+		}
+	}
+
+	for (mcs = 0; mcs < 10; mcs++) {
+		for (nss = 1; nss <= 8; nss++) {
+			for (bw = 0; bw < 4; bw++) {
+				dbps = airtime_dbps(mcs, nss, bw);
+				// excluded by the standard although the coding works out
+				if ((bw == 2 && mcs == 6 && (nss == 3 || nss == 7)) || (bw == 2 && mcs == 9 && nss == 6) ||
+				    (bw == 3 && mcs == 9 && nss == 3)) {
+					dbps = 0;
+				}
+				for (sgi = 0; dbps && sgi < 2; sgi++) {
+					r = &airtime_rates[airtime_vht(mcs, nss, bw, sgi)];
+					airtime_set(r, AIRTIME_VHT, dbps, 36 + 4 * airtime_vht_nltf[nss], sgi, airtime_extra(dbps, 2160));
+				}
+			}
+		}
+	}
+}
+
+uint32_t airtime_legacy(uint32_t rate)
+{
+	return (rate < 256) ? airtime_legacy_idx[rate] : AIRTIME_NONE;
+}
+
+uint32_t airtime_ht(uint32_t mcs, uint32_t bw40, uint32_t sgi)
+{
+	if (mcs > 32) {
+		return AIRTIME_NONE;
+	}
+
+	return AIRTIME_HT_BASE + (mcs * 2 + (bw40 != 0)) * 2 + (sgi != 0);
+}
+
+uint32_t airtime_vht(uint32_t mcs, uint32_t nss, uint32_t bw, uint32_t sgi)
+{
+	if (mcs > 9 || nss < 1 || nss > 8 || bw > 3) {
+		return AIRTIME_NONE;
+	}
+
+	return AIRTIME_VHT_BASE + (((mcs * 8 + nss - 1) * 4 + bw) * 2 + (sgi != 0));
+}
+
+uint32_t airtime_rxpd(uint8_t rx_rate, uint8_t ht_info)
+{
+	if (ht_info & 1) {
+		return airtime_ht(rx_rate, ht_info & 2, ht_info & 4);
+	}
+
+	return (rx_rate < 13) ? airtime_rxpd_legacy[rx_rate] : AIRTIME_NONE;
+}
+
+uint32_t airtime_ampdu(struct airtime_ampdu_t *a, uint32_t ref, uint32_t rate, uint32_t len, uint32_t flags)
+{
+	uint32_t us, d;
+
+	if (a->rate != rate || a->ref != ref || a->flags != flags) {
+		a->ref = ref;
+		a->rate = rate;
+		a->flags = flags;
+		a->len = 0;
+		a->us = 0;
+	} else {
+		a->len = (a->len + 3) & ~3u;
+	}
+
+	a->len += 4 + len;
+	us = airtime_us(rate, a->len, flags);
+	d = us - a->us;
+	a->us = us;
+
+	return d;
+}
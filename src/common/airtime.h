@@ -0,0 +1,99 @@
+#ifndef AIRTIME_h_
+#define AIRTIME_h_
+
+#include <stdint.h>
+
+// on air duration of a ppdu from its rate and psdu length, dsss/cck, ofdm,
+// ht mixed and greenfield, vht, as 802.11-2016 clauses 16-21 give them
+// each rate has its parameters in a table built once, bits per symbol with
+// their reciprocal so a frame costs a multiply and a shift and no division,
+// there is no hardware divider on the vita
+// durations are whole microseconds, short gi ones are rounded up to 4 us
+// symbols as the standard does
+
+#define AIRTIME_DSSS 0
+#define AIRTIME_OFDM 1
+#define AIRTIME_HT   2
+#define AIRTIME_VHT  3
+
+// rate index layout, 0 is no known rate and has no duration
+#define AIRTIME_NONE      0
+#define AIRTIME_LEGACY    1      // 1 2 5.5 11 6 9 12 18 24 36 48 54 Mbps
+#define AIRTIME_HT_BASE   13     // mcs 0..32, 40 MHz, short gi
+#define AIRTIME_VHT_BASE  (AIRTIME_HT_BASE + 33 * 4)   // mcs 0..9, nss 1..8, 20/40/80/160 MHz, short gi
+#define AIRTIME_RATES     (AIRTIME_VHT_BASE + 10 * 8 * 4 * 2)
+
+#define AIRTIME_SHIFT     40     // exact for psdus up to 1 MiB
+
+// per frame flags
+#define AIRTIME_F_SHORTPRE 0x01  // dsss short preamble, 1 Mbps always has the long one
+#define AIRTIME_F_GF       0x02  // ht greenfield
+#define AIRTIME_F_2GHZ     0x04  // ofdm and ht in 2.4 GHz end with a 6 us signal extension
+
+struct airtime_rate_t {
+	uint64_t recip;          // 2^AIRTIME_SHIFT / div, rounded up
+	uint16_t div;            // data bits per symbol, for dsss bits per 2 us
+	uint16_t pre_us;         // preamble and headers, greenfield and signal extension aside
+	uint8_t kind;
+	uint8_t sgi;
+	uint8_t shift;           // bits per psdu byte as a shift, 3, or 4 for dsss
+	uint8_t extra;           // service and tail bits
+};
+
+// mpdus of one a-mpdu share a preamble and are padded to 4 bytes after a
+// 4 byte delimiter, each one is charged what it adds to the ppdu so the
+// charges add up to the duration of the whole ppdu
+struct airtime_ampdu_t {
+	uint32_t ref;            // a-mpdu reference as the source numbers them
+	uint16_t rate;           // AIRTIME_NONE while none is open
+	uint8_t flags;
+	uint8_t reserved;
+	uint32_t len;            // psdu so far, delimiters and padding
+	uint32_t us;             // charged so far
+};
+
+extern struct airtime_rate_t airtime_rates[AIRTIME_RATES];
+
+void airtime_init(void);
+
+// rate index, AIRTIME_NONE for rates that do not exist
+uint32_t airtime_legacy(uint32_t rate);        // 500 kbps
+uint32_t airtime_ht(uint32_t mcs, uint32_t bw40, uint32_t sgi);
+uint32_t airtime_vht(uint32_t mcs, uint32_t nss, uint32_t bw, uint32_t sgi);   // bw 0..3, 20 to 160 MHz
+// from the rxpd of a non-ac card, the rate index and ht_info there
+uint32_t airtime_rxpd(uint8_t rx_rate, uint8_t ht_info);
+
+// duration of a ppdu with a psdu of len bytes, fcs included
+static inline uint32_t airtime_us(uint32_t rate, uint32_t len, uint32_t flags)
+{
+	const struct airtime_rate_t *r = &airtime_rates[rate];
+	uint32_t sym = ((((uint64_t)len << r->shift) + r->extra + r->div - 1) * r->recip) >> AIRTIME_SHIFT;
+	uint32_t us;
+
+	if (r->kind == AIRTIME_DSSS) {
+		return r->pre_us + sym - ((flags & AIRTIME_F_SHORTPRE) && r->div > 2 ? 96 : 0);
+	}
+
+	if (r->sgi) {
+		sym = (sym * 9 + 9) / 10;
+	}
+	us = r->pre_us + 4 * sym;
+	if ((flags & AIRTIME_F_2GHZ) && r->kind != AIRTIME_VHT) {
+		us += 6;
+	}
+	if ((flags & AIRTIME_F_GF) && r->kind == AIRTIME_HT) {
+		us -= 12;
+	}
+
+	return us;
+}
+
+static inline void airtime_ampdu_end(struct airtime_ampdu_t *a)
+{
+	a->rate = AIRTIME_NONE;
+}
+
+// charge for the next mpdu, a different reference or rate starts a new ppdu
+uint32_t airtime_ampdu(struct airtime_ampdu_t *a, uint32_t ref, uint32_t rate, uint32_t len, uint32_t flags);
+
+#endif
@@ -0,0 +1,261 @@
+#include <stdint.h>
+
+#include "bpf.h"
+
+#define LD_W(p) (((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | ((uint32_t)(p)[2] << 8) | (p)[3])
+#define LD_H(p) (((uint32_t)(p)[0] << 8) | (p)[1])
+
+int bpf_validate(const struct bpf_insn_t *prog, uint32_t len)
+{
+	uint32_t i;
+
+	if (len == 0 || len > BPF_MAXINSNS) {
+		return -1;
+	}
+
+	for (i = 0; i < len; i++) {
+		const struct bpf_insn_t *p = &prog[i];
+		uint32_t left = len - i - 1;
+
+		switch (BPF_CLASS(p->code)) {
+		case BPF_LD:
+		case BPF_LDX:
+			switch (BPF_MODE(p->code)) {
+			case BPF_IMM:
+			case BPF_LEN:
+				break;
+			case BPF_ABS:
+			case BPF_IND:
+			case BPF_MSH:
+				// width and msh/ldx combinations are checked at run time
+				break;
+			case BPF_MEM:
+				if (p->k >= BPF_MEMWORDS) {
+					return -2;
+				}
+				break;
+			default:
+				return -3;
+			}
+			break;
+
+		case BPF_ST:
+		case BPF_STX:
+			if (p->k >= BPF_MEMWORDS) {
+				return -2;
+			}
+			break;
+
+		case BPF_ALU:
+			switch (BPF_OP(p->code)) {
+			case BPF_ADD: case BPF_SUB: case BPF_MUL: case BPF_OR: case BPF_AND:
+			case BPF_LSH: case BPF_RSH: case BPF_NEG: case BPF_XOR:
+				break;
+			case BPF_DIV:
+			case BPF_MOD:
+				if (BPF_SRC(p->code) == BPF_K && p->k == 0) {
+					return -4;
+				}
+				break;
+			default:
+				return -3;
+			}
+			break;
+
+		case BPF_JMP:
+			// forward only, so every program terminates
+			if (BPF_OP(p->code) == BPF_JA) {
+				if (p->k >= left) {
+					return -5;
+				}
+			} else {
+				switch (BPF_OP(p->code)) {
+				case BPF_JEQ: case BPF_JGT: case BPF_JGE: case BPF_JSET:
+					break;
+				default:
+					return -3;
+				}
+				if (p->jt >= left || p->jf >= left) {
+					return -5;
+				}
+			}
+			break;
+
+		case BPF_RET:
+		case BPF_MISC:
+			break;
+		}
+	}
+
+	if (BPF_CLASS(prog[len - 1].code) != BPF_RET) {
+		return -6;
+	}
+
+	return 0;
+}
+
+uint32_t bpf_run(const struct bpf_insn_t *prog, const uint8_t *pkt, uint32_t wirelen, uint32_t buflen)
+{
+	uint32_t a = 0, x = 0, k;
+	uint32_t mem[BPF_MEMWORDS] = { 0 };
+	const struct bpf_insn_t *p = prog;
+
+	for (;; p++) {
+		switch (p->code) {
+		case BPF_RET | BPF_K:
+			return p->k;
+		case BPF_RET | BPF_A:
+			return a;
+
+		case BPF_LD | BPF_W | BPF_ABS:
+			k = p->k;
+			if (k > buflen || buflen - k < 4) {
+				return 0;
+			}
+			a = LD_W(pkt + k);
+			continue;
+		case BPF_LD | BPF_H | BPF_ABS:
+			k = p->k;
+			if (k > buflen || buflen - k < 2) {
+				return 0;
+			}
+			a = LD_H(pkt + k);
+			continue;
+		case BPF_LD | BPF_B | BPF_ABS:
+			k = p->k;
+			if (k >= buflen) {
+				return 0;
+			}
+			a = pkt[k];
+			continue;
+
+		case BPF_LD | BPF_W | BPF_IND:
+			k = x + p->k;
+			if (k < x || k > buflen || buflen - k < 4) {
+				return 0;
+			}
+			a = LD_W(pkt + k);
+			continue;
+		case BPF_LD | BPF_H | BPF_IND:
+			k = x + p->k;
+			if (k < x || k > buflen || buflen - k < 2) {
+				return 0;
+			}
+			a = LD_H(pkt + k);
+			continue;
+		case BPF_LD | BPF_B | BPF_IND:
+			k = x + p->k;
+			if (k < x || k >= buflen) {
+				return 0;
+			}
+			a = pkt[k];
+			continue;
+
+		case BPF_LD | BPF_W | BPF_LEN:
+			a = wirelen;
+			continue;
+		case BPF_LDX | BPF_W | BPF_LEN:
+			x = wirelen;
+			continue;
+
+		case BPF_LDX | BPF_B | BPF_MSH:
+			k = p->k;
+			if (k >= buflen) {
+				return 0;
+			}
+			x = (pkt[k] & 0xf) << 2;
+			continue;
+
+		case BPF_LD | BPF_IMM:
+			a = p->k;
+			continue;
+		case BPF_LDX | BPF_IMM:
+			x = p->k;
+			continue;
+		case BPF_LD | BPF_MEM:
+			a = mem[p->k];
+			continue;
+		case BPF_LDX | BPF_MEM:
+			x = mem[p->k];
+			continue;
+		case BPF_ST:
+			mem[p->k] = a;
+			continue;
+		case BPF_STX:
+			mem[p->k] = x;
+			continue;
+
+		case BPF_JMP | BPF_JA:
+			p += p->k;
+			continue;
+		case BPF_JMP | BPF_JGT | BPF_K:
+			p += (a > p->k) ? p->jt : p->jf;
+			continue;
+		case BPF_JMP | BPF_JGE | BPF_K:
+			p += (a >= p->k) ? p->jt : p->jf;
+			continue;
+		case BPF_JMP | BPF_JEQ | BPF_K:
+			p += (a == p->k) ? p->jt : p->jf;
+			continue;
+		case BPF_JMP | BPF_JSET | BPF_K:
+			p += (a & p->k) ? p->jt : p->jf;
+			continue;
+		case BPF_JMP | BPF_JGT | BPF_X:
+			p += (a > x) ? p->jt : p->jf;
+			continue;
+		case BPF_JMP | BPF_JGE | BPF_X:
+			p += (a >= x) ? p->jt : p->jf;
+			continue;
+		case BPF_JMP | BPF_JEQ | BPF_X:
+			p += (a == x) ? p->jt : p->jf;
+			continue;
+		case BPF_JMP | BPF_JSET | BPF_X:
+			p += (a & x) ? p->jt : p->jf;
+			continue;
+
+		case BPF_ALU | BPF_ADD | BPF_X: a += x; continue;
+		case BPF_ALU | BPF_SUB | BPF_X: a -= x; continue;
+		case BPF_ALU | BPF_MUL | BPF_X: a *= x; continue;
+		case BPF_ALU | BPF_DIV | BPF_X:
+			if (x == 0) {
+				return 0;
+			}
+			a /= x;
+			continue;
+		case BPF_ALU | BPF_MOD | BPF_X:
+			if (x == 0) {
+				return 0;
+			}
+			a %= x;
+			continue;
+		case BPF_ALU | BPF_AND | BPF_X: a &= x; continue;
+		case BPF_ALU | BPF_OR | BPF_X:  a |= x; continue;
+		case BPF_ALU | BPF_XOR | BPF_X: a ^= x; continue;
+		case BPF_ALU | BPF_LSH | BPF_X: a = (x < 32) ? a << x : 0; continue;
+		case BPF_ALU | BPF_RSH | BPF_X: a = (x < 32) ? a >> x : 0; continue;
+
+		case BPF_ALU | BPF_ADD | BPF_K: a += p->k; continue;
+		case BPF_ALU | BPF_SUB | BPF_K: a -= p->k; continue;
+		case BPF_ALU | BPF_MUL | BPF_K: a *= p->k; continue;
+		case BPF_ALU | BPF_DIV | BPF_K: a /= p->k; continue;
+		case BPF_ALU | BPF_MOD | BPF_K: a %= p->k; continue;
+		case BPF_ALU | BPF_AND | BPF_K: a &= p->k; continue;
+		case BPF_ALU | BPF_OR | BPF_K:  a |= p->k; continue;
+		case BPF_ALU | BPF_XOR | BPF_K: a ^= p->k; continue;
+		case BPF_ALU | BPF_LSH | BPF_K: a = (p->k < 32) ? a << p->k : 0; continue;
+		case BPF_ALU | BPF_RSH | BPF_K: a = (p->k < 32) ? a >> p->k : 0; continue;
+		case BPF_ALU | BPF_NEG:         a = -a; continue;
+
+		case BPF_MISC | BPF_TAX:
+			x = a;
+			continue;
+		case BPF_MISC | BPF_TXA:
+			a = x;
+			continue;
+
+		default:
+			// validate lets through some encodings we do not run, reject the packet
+			return 0;
+		}
+	}
+}
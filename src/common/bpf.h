@@ -0,0 +1,84 @@
+#ifndef BPF_h_
+#define BPF_h_
+
+#include <stdint.h>
+
+// classic bpf, same instruction layout as rpcap and libpcap use
+// kept small on purpose, the kernel runs it for every captured frame
+#define BPF_MAXINSNS 512
+#define BPF_MEMWORDS 16
+
+struct bpf_insn_t {
+	uint16_t code;
+	uint8_t jt;
+	uint8_t jf;
+	uint32_t k;
+} __attribute__ ((packed));
+
+// instruction classes
+#define BPF_CLASS(c)  ((c) & 0x07)
+#define BPF_LD        0x00
+#define BPF_LDX       0x01
+#define BPF_ST        0x02
+#define BPF_STX       0x03
+#define BPF_ALU       0x04
+#define BPF_JMP       0x05
+#define BPF_RET       0x06
+#define BPF_MISC      0x07
+
+// ld/ldx fields
+#define BPF_SIZE(c)   ((c) & 0x18)
+#define BPF_W         0x00
+#define BPF_H         0x08
+#define BPF_B         0x10
+#define BPF_MODE(c)   ((c) & 0xe0)
+#define BPF_IMM       0x00
+#define BPF_ABS       0x20
+#define BPF_IND       0x40
+#define BPF_MEM       0x60
+#define BPF_LEN       0x80
+#define BPF_MSH       0xa0
+
+// alu/jmp fields
+#define BPF_OP(c)     ((c) & 0xf0)
+#define BPF_ADD       0x00
+#define BPF_SUB       0x10
+#define BPF_MUL       0x20
+#define BPF_DIV       0x30
+#define BPF_OR        0x40
+#define BPF_AND       0x50
+#define BPF_LSH       0x60
+#define BPF_RSH       0x70
+#define BPF_NEG       0x80
+#define BPF_MOD       0x90
+#define BPF_XOR       0xa0
+
+#define BPF_JA        0x00
+#define BPF_JEQ       0x10
+#define BPF_JGT       0x20
+#define BPF_JGE       0x30
+#define BPF_JSET      0x40
+
+#define BPF_SRC(c)    ((c) & 0x08)
+#define BPF_K         0x00
+#define BPF_X         0x08
+
+// ret fields
+#define BPF_RVAL(c)   ((c) & 0x18)
+#define BPF_A         0x10
+
+// misc fields
+#define BPF_MISCOP(c) ((c) & 0xf8)
+#define BPF_TAX       0x00
+#define BPF_TXA       0x80
+
+#define BPF_STMT(code, k)         { (uint16_t)(code), 0, 0, k }
+#define BPF_JUMP(code, k, jt, jf) { (uint16_t)(code), jt, jf, k }
+
+// 0 if program is safe to run: known opcodes, forward jumps in range, ends in ret
+int bpf_validate(const struct bpf_insn_t *prog, uint32_t len);
+
+// bytes of the packet to keep, 0 is reject, out of bounds loads reject
+uint32_t bpf_run(const struct bpf_insn_t *prog, const uint8_t *pkt, uint32_t wirelen, uint32_t buflen);
+
+#endif
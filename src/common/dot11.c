@@ -0,0 +1,357 @@
+#include <string.h>
+
+#include "dot11.h"
+
+#define SKIP_VENDOR 0xff
+#define SKIP_EXT    0xfe
+
+// fixed fields ahead of the elements per management subtype, -1 has none
+static const int8_t dot11_mgmt_fixed[16] = {
+	[DOT11_ASSOC_REQ] = 4,
+	[DOT11_ASSOC_RESP] = 6,
+	[DOT11_REASSOC_REQ] = 10,
+	[DOT11_REASSOC_RESP] = 6,
+	[DOT11_PROBE_REQ] = 0,
+	[DOT11_PROBE_RESP] = 12,
+	[0x6] = 12,              // timing advertisement
+	[0x7] = -1,
+	[DOT11_BEACON] = 12,
+	[0x9] = -1,              // atim
+	[DOT11_DISASSOC] = 2,
+	[DOT11_AUTH] = 6,
+	[DOT11_DEAUTH] = 2,
+	[DOT11_ACTION] = -1,
+	[0xe] = -1,
+	[0xf] = -1,
+};
+
+static inline uint16_t rd16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t rd32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint32_t rd_suite(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+int dot11_hdr_parse(const uint8_t *f, uint32_t len, struct dot11_hdr_t *h)
+{
+	uint32_t n, fc;
+
+	h->hdr_len = 0;
+
+	if (len < 10) {
+		return -1;
+	}
+
+	fc = rd16(f);
+	h->fc = fc;
+	h->duration = rd16(f + 2);
+	h->a1 = f + 4;
+	h->a2 = NULL;
+	h->a3 = NULL;
+	h->a4 = NULL;
+	h->ta = NULL;
+	h->bssid = NULL;
+	h->seq_ctl = 0;
+	h->qos = 0;
+	h->flags = 0;
+
+	switch (DOT11_FC_TYPE(fc)) {
+	case DOT11_TYPE_MGMT:
+		n = 24;
+		if (fc & DOT11_FC_ORDER) {
+			n = 28;
+			h->flags = DOT11_HDR_HTC;
+		}
+		if (len < n) {
+			return -1;
+		}
+		h->a2 = h->ta = f + 10;
+		h->a3 = h->bssid = f + 16;
+		h->seq_ctl = rd16(f + 22);
+		break;
+
+	case DOT11_TYPE_CTRL:
+		// cts and ack carry the receiver only
+		if (DOT11_FC_SUBTYPE(fc) == 0xc || DOT11_FC_SUBTYPE(fc) == 0xd) {
+			n = 10;
+		} else {
+			n = 16;
+			if (len < n) {
+				return -1;
+			}
+			h->a2 = h->ta = f + 10;
+		}
+		break;
+
+	case DOT11_TYPE_DATA:
+		n = 24;
+		if (DOT11_FC_DS(fc) == 3) {
+			n = 30;
+			h->flags = DOT11_HDR_A4;
+		}
+		if (DOT11_FC_SUBTYPE(fc) & 0x8) {
+			n += 2;
+			h->flags |= DOT11_HDR_QOS;
+			if (fc & DOT11_FC_ORDER) {
+				n += 4;
+				h->flags |= DOT11_HDR_HTC;
+			}
+		}
+		if (len < n) {
+			return -1;
+		}
+
+		h->a2 = h->ta = f + 10;
+		h->a3 = f + 16;
+		h->seq_ctl = rd16(f + 22);
+		if (h->flags & DOT11_HDR_A4) {
+			h->a4 = f + 24;
+		}
+		if (h->flags & DOT11_HDR_QOS) {
+			h->qos = rd16(f + ((h->flags & DOT11_HDR_A4) ? 30 : 24));
+		}
+
+		switch (DOT11_FC_DS(fc)) {
+		case 0: h->bssid = f + 16; break;   // ibss
+		case 1: h->bssid = f + 4; break;    // to ap
+		case 2: h->bssid = f + 10; break;   // from ap
+		default: break;                     // wds has no bssid
+		}
+		break;
+
+	default:
+		return -1;
+	}
+
+	h->hdr_len = n;
+	h->body = f + n;
+	h->body_len = len - n;
+
+	return n;
+}
+
+int dot11_mgmt_ies(const struct dot11_hdr_t *h, const uint8_t **ies, uint32_t *len)
+{
+	int fixed;
+
+	if (h->hdr_len == 0 || DOT11_FC_TYPE(h->fc) != DOT11_TYPE_MGMT) {
+		return -1;
+	}
+
+	fixed = dot11_mgmt_fixed[DOT11_FC_SUBTYPE(h->fc)];
+	if (fixed < 0 || h->body_len < (uint32_t)fixed) {
+		return -1;
+	}
+
+	*ies = h->body + fixed;
+	*len = h->body_len - fixed;
+
+	return 0;
+}
+
+int dot11_ie_set_init(struct dot11_ie_set_t *s, const uint64_t *want, uint32_t n)
+{
+	uint32_t i;
+
+	if (n > DOT11_IE_SLOTS) {
+		return -1;
+	}
+
+	memset(s, 0, sizeof(*s));
+	s->nslot = n;
+
+	for (i = 0; i < n; i++) {
+		uint32_t kind = want[i] >> 32;
+
+		if (kind == 1) {
+			s->vendor[s->nvendor] = (uint32_t)want[i];
+			s->vendor_slot[s->nvendor++] = i;
+			s->skip[DOT11_IE_VENDOR] = SKIP_VENDOR;
+		} else if (kind == 2 && want[i] <= DOT11_WANT_EXT(0xff)) {
+			s->ext[s->next] = want[i] & 0xff;
+			s->ext_slot[s->next++] = i;
+			s->skip[DOT11_IE_EXT] = SKIP_EXT;
+		} else if (want[i] < 256 && want[i] != DOT11_IE_VENDOR && want[i] != DOT11_IE_EXT && !s->skip[want[i]]) {
+			s->skip[want[i]] = i + 1;
+		} else {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static inline void dot11_ie_put(struct dot11_ie_t *ie, const uint8_t *p, uint8_t len)
+{
+	if (ie->n++ == 0) {
+		ie->p = p;
+		ie->len = len;
+	}
+}
+
+// the rare elements that need a second look
+static void dot11_ie_sub(const struct dot11_ie_set_t *s, uint8_t kind, const uint8_t *p, uint8_t len, struct dot11_ie_t *out)
+{
+	uint32_t i;
+
+	if (kind == SKIP_VENDOR) {
+		if (len < 4) {
+			return;
+		}
+		uint32_t key = ((uint32_t)p[0] << 16 | p[1] << 8 | p[2]) << 8 | p[3];
+		for (i = 0; i < s->nvendor; i++) {
+			if (s->vendor[i] == key) {
+				dot11_ie_put(&out[s->vendor_slot[i]], p, len);
+			}
+		}
+	} else {
+		if (len < 1) {
+			return;
+		}
+		for (i = 0; i < s->next; i++) {
+			if (s->ext[i] == p[0]) {
+				dot11_ie_put(&out[s->ext_slot[i]], p, len);
+			}
+		}
+	}
+}
+
+int dot11_ie_parse(const struct dot11_ie_set_t *s, const uint8_t *p, uint32_t len, struct dot11_ie_t *out)
+{
+	const uint8_t *end = p + len;
+	int walked = 0;
+	uint32_t i;
+
+	// a few slots, cheaper than a memset call of variable size
+	for (i = 0; i < s->nslot; i++) {
+		out[i].p = NULL;
+		out[i].len = 0;
+		out[i].n = 0;
+	}
+
+	while (end - p >= 2) {
+		uint8_t k = s->skip[p[0]];
+		uint8_t l = p[1];
+
+		if (l > end - p - 2) {
+			return -1;
+		}
+
+		if (k) {
+			if (k >= SKIP_EXT) {
+				dot11_ie_sub(s, k, p + 2, l, out);
+			} else {
+				dot11_ie_put(&out[k - 1], p + 2, l);
+			}
+		}
+
+		p += 2 + l;
+		walked++;
+	}
+
+	// a single trailing byte is garbage as well
+	return (p == end) ? walked : -1;
+}
+
+int dot11_ie_ds_channel(const struct dot11_ie_t *ie)
+{
+	if (ie->p == NULL || ie->len != 1) {
+		return -1;
+	}
+
+	return ie->p[0];
+}
+
+int dot11_ie_rsn(const struct dot11_ie_t *ie, struct dot11_rsn_t *rsn)
+{
+	const uint8_t *p = ie->p, *end = ie->p + ie->len;
+	uint32_t i, n;
+
+	memset(rsn, 0, sizeof(*rsn));
+
+	if (p == NULL || ie->len < 2) {
+		return -1;
+	}
+
+	// everything after the version is optional, but only from the end
+	rsn->version = rd16(p);
+	p += 2;
+	if (end - p < 4) {
+		return (p == end) ? 0 : -1;
+	}
+	rsn->group = rd_suite(p);
+	p += 4;
+
+	if (end - p < 2) {
+		return (p == end) ? 0 : -1;
+	}
+	n = rd16(p);
+	p += 2;
+	if ((uint32_t)(end - p) / 4 < n) {
+		return -1;
+	}
+	rsn->npairwise = n > 255 ? 255 : n;
+	for (i = 0; i < n; i++, p += 4) {
+		if (i < DOT11_RSN_MAX) {
+			rsn->pairwise[i] = rd_suite(p);
+		}
+	}
+
+	if (end - p < 2) {
+		return (p == end) ? 0 : -1;
+	}
+	n = rd16(p);
+	p += 2;
+	if ((uint32_t)(end - p) / 4 < n) {
+		return -1;
+	}
+	rsn->nakm = n > 255 ? 255 : n;
+	for (i = 0; i < n; i++, p += 4) {
+		if (i < DOT11_RSN_MAX) {
+			rsn->akm[i] = rd_suite(p);
+		}
+	}
+
+	// pmkid list and group management cipher are not decoded
+	if (end - p >= 2) {
+		rsn->caps = rd16(p);
+	} else if (p != end) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int dot11_ie_ht(const struct dot11_ie_t *ie, struct dot11_ht_t *ht)
+{
+	if (ie->p == NULL || ie->len < 26) {
+		return -1;
+	}
+
+	ht->cap = rd16(ie->p);
+	ht->ampdu = ie->p[2];
+	memcpy(ht->mcs, ie->p + 3, sizeof(ht->mcs));
+
+	return 0;
+}
+
+int dot11_ie_vht(const struct dot11_ie_t *ie, struct dot11_vht_t *vht)
+{
+	if (ie->p == NULL || ie->len < 12) {
+		return -1;
+	}
+
+	vht->cap = rd32(ie->p);
+	vht->rx_mcs = rd16(ie->p + 4);
+	vht->tx_mcs = rd16(ie->p + 8);
+
+	return 0;
+}
@@ -0,0 +1,149 @@
+#ifndef DOT11_h_
+#define DOT11_h_
+
+#include <stdint.h>
+
+// 802.11 mac header and information element parsing, bounds checked and
+// allocation free, shared by the kernel plugin and the host tools
+// elements are pulled out in one pass over the TLV stream: a 256 entry skip
+// table maps the element id to the slot of a wanted element, everything
+// else is stepped over with one load
+
+#define DOT11_TYPE_MGMT      0
+#define DOT11_TYPE_CTRL      1
+#define DOT11_TYPE_DATA      2
+
+#define DOT11_FC_TYPE(fc)    (((fc) >> 2) & 3)
+#define DOT11_FC_SUBTYPE(fc) (((fc) >> 4) & 0xf)
+#define DOT11_FC_DS(fc)      (((fc) >> 8) & 3)
+
+#define DOT11_FC_PROTECTED   0x4000
+#define DOT11_FC_ORDER       0x8000
+
+// management subtypes
+#define DOT11_ASSOC_REQ      0x0
+#define DOT11_ASSOC_RESP     0x1
+#define DOT11_REASSOC_REQ    0x2
+#define DOT11_REASSOC_RESP   0x3
+#define DOT11_PROBE_REQ      0x4
+#define DOT11_PROBE_RESP     0x5
+#define DOT11_BEACON         0x8
+#define DOT11_DISASSOC       0xa
+#define DOT11_AUTH           0xb
+#define DOT11_DEAUTH         0xc
+#define DOT11_ACTION         0xd
+
+// element ids
+#define DOT11_IE_SSID        0
+#define DOT11_IE_RATES       1
+#define DOT11_IE_DS_PARAMS   3
+#define DOT11_IE_TIM         5
+#define DOT11_IE_COUNTRY     7
+#define DOT11_IE_HT_CAP      45
+#define DOT11_IE_RSN         48
+#define DOT11_IE_EXT_RATES   50
+#define DOT11_IE_HT_OP       61
+#define DOT11_IE_VHT_CAP     191
+#define DOT11_IE_VHT_OP      192
+#define DOT11_IE_VENDOR      221
+#define DOT11_IE_EXT         255
+
+// wanted elements beyond the plain id: vendor elements by oui and type,
+// extension elements by extension id
+#define DOT11_WANT_VENDOR(oui, type) ((1ull << 32) | ((uint32_t)(oui) << 8) | (type))
+#define DOT11_WANT_EXT(ext)          ((2ull << 32) | (ext))
+
+#define DOT11_WANT_WPA       DOT11_WANT_VENDOR(0x0050f2, 1)
+#define DOT11_WANT_WMM       DOT11_WANT_VENDOR(0x0050f2, 2)
+#define DOT11_WANT_WPS       DOT11_WANT_VENDOR(0x0050f2, 4)
+#define DOT11_WANT_HE_CAP    DOT11_WANT_EXT(35)
+
+#define DOT11_IE_SLOTS       16
+
+// header flags
+#define DOT11_HDR_QOS        0x01
+#define DOT11_HDR_HTC        0x02
+#define DOT11_HDR_A4         0x04
+
+struct dot11_hdr_t {
+	uint16_t fc;
+	uint16_t duration;
+	const uint8_t *a1;       // addresses are NULL when the frame has none
+	const uint8_t *a2;
+	const uint8_t *a3;
+	const uint8_t *a4;
+	const uint8_t *ta;       // transmitter and bssid, what the capture index keeps
+	const uint8_t *bssid;
+	uint16_t seq_ctl;
+	uint16_t qos;
+	uint32_t flags;
+	uint32_t hdr_len;
+	const uint8_t *body;
+	uint32_t body_len;
+};
+
+// element data and length, p is NULL when the element was not seen
+// n counts occurrences, the first one is kept
+struct dot11_ie_t {
+	const uint8_t *p;
+	uint8_t len;
+	uint8_t n;
+};
+
+struct dot11_ie_set_t {
+	uint8_t skip[256];       // slot + 1, 0 skips the element
+	uint8_t nslot;
+	uint8_t nvendor;
+	uint8_t next;
+	uint32_t vendor[DOT11_IE_SLOTS];
+	uint8_t vendor_slot[DOT11_IE_SLOTS];
+	uint8_t ext[DOT11_IE_SLOTS];
+	uint8_t ext_slot[DOT11_IE_SLOTS];
+};
+
+#define DOT11_RSN_MAX 4
+
+struct dot11_rsn_t {
+	uint16_t version;
+	uint32_t group;          // suites as oui << 8 | type
+	uint8_t npairwise;       // counts as in the element, at most DOT11_RSN_MAX stored
+	uint8_t nakm;
+	uint32_t pairwise[DOT11_RSN_MAX];
+	uint32_t akm[DOT11_RSN_MAX];
+	uint16_t caps;
+};
+
+struct dot11_ht_t {
+	uint16_t cap;
+	uint8_t ampdu;
+	uint8_t mcs[16];
+};
+
+struct dot11_vht_t {
+	uint32_t cap;
+	uint16_t rx_mcs;
+	uint16_t tx_mcs;
+};
+
+// fills h, returns the header length or -1 when the frame is too short
+int dot11_hdr_parse(const uint8_t *f, uint32_t len, struct dot11_hdr_t *h);
+
+// start of the elements in a management frame body, -1 for frames without
+int dot11_mgmt_ies(const struct dot11_hdr_t *h, const uint8_t **ies, uint32_t *len);
+
+// builds the skip table, slot i of the parse output belongs to want[i]
+// returns -1 for more than DOT11_IE_SLOTS wants or a plain id wanted twice
+int dot11_ie_set_init(struct dot11_ie_set_t *s, const uint64_t *want, uint32_t n);
+
+// one pass over the elements, out has a slot per want
+// returns the number of elements walked, or -1 when the stream ended in a
+// truncated element, the slots filled up to there are still valid
+int dot11_ie_parse(const struct dot11_ie_set_t *s, const uint8_t *p, uint32_t len, struct dot11_ie_t *out);
+
+// decoders for single elements, -1 when the element is malformed
+int dot11_ie_ds_channel(const struct dot11_ie_t *ie);
+int dot11_ie_rsn(const struct dot11_ie_t *ie, struct dot11_rsn_t *rsn);
+int dot11_ie_ht(const struct dot11_ie_t *ie, struct dot11_ht_t *ht);
+int dot11_ie_vht(const struct dot11_ie_t *ie, struct dot11_vht_t *vht);
+
+#endif
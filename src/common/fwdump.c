@@ -0,0 +1,223 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "fwdump.h"
+#include "kcap.h"
+
+static void fwdump_hdr_seal(struct fwdump_hdr_t *h)
+{
+	h->hsum = kcap_sum(1, (const uint8_t *)h, offsetof(struct fwdump_hdr_t, hsum));
+}
+
+static void fwdump_chk_seal(struct fwdump_chk_t *c)
+{
+	c->hsum = kcap_sum(1, (const uint8_t *)c, offsetof(struct fwdump_chk_t, hsum));
+}
+
+int fwdump_open(struct fwdump_t *d)
+{
+	struct fwdump_hdr_t *h = &d->hdr;
+
+	if (d->ops->pread(d->ctx, h, sizeof(*h), 0) != sizeof(*h)) {
+		return -1;
+	}
+
+	if (memcmp(h->magic, FWDUMP_MAGIC, 8) != 0 || h->version != FWDUMP_VERSION ||
+	    h->hsum != kcap_sum(1, (const uint8_t *)h, offsetof(struct fwdump_hdr_t, hsum))) {
+		return -1;
+	}
+
+	if (h->chunk == 0 || h->chunk > FWDUMP_CHUNK || (h->chunk & 3) || (h->size & 3)) {
+		return -1;
+	}
+
+	d->off = sizeof(*h);
+	d->addr = h->base;
+	d->sum = 1;
+
+	return 0;
+}
+
+int fwdump_next(struct fwdump_t *d, struct fwdump_chk_t *c)
+{
+	uint32_t done = d->addr - d->hdr.base;
+	uint32_t want = d->hdr.size - done;
+	uint8_t *payload = d->zbuf + sizeof(*c);
+
+	if (want > d->hdr.chunk) {
+		want = d->hdr.chunk;
+	}
+
+	if (d->ops->pread(d->ctx, c, sizeof(*c), d->off) != sizeof(*c)) {
+		return -1;
+	}
+
+	if (c->hsum != kcap_sum(1, (const uint8_t *)c, offsetof(struct fwdump_chk_t, hsum)) ||
+	    c->id != d->hdr.id || c->addr != d->addr) {
+		return -1;
+	}
+
+	if (c->magic == FWDUMP_END_MAGIC) {
+		if (want != 0 || c->len != 0 || c->sum != d->sum) {
+			return -1;
+		}
+		d->off += sizeof(*c);
+		return 0;
+	}
+
+	// chunks come in address order, full sized up to the last one
+	if (c->magic != FWDUMP_CHK_MAGIC || want == 0 || c->raw_len != want) {
+		return -1;
+	}
+
+	if ((c->flags & FWDUMP_CHK_STORED) ? c->len != c->raw_len : c->len > LZ4BLK_BOUND(c->raw_len)) {
+		return -1;
+	}
+
+	if (d->ops->pread(d->ctx, payload, c->len, d->off + sizeof(*c)) != (int)c->len) {
+		return -1;
+	}
+
+	if (c->flags & FWDUMP_CHK_STORED) {
+		memcpy(d->raw, payload, c->len);
+	} else if (lz4blk_decompress(payload, c->len, (uint8_t *)d->raw, c->raw_len) != (int)c->raw_len) {
+		return -1;
+	}
+
+	if (kcap_sum(1, (const uint8_t *)d->raw, c->raw_len) != c->sum) {
+		return -1;
+	}
+
+	d->off += sizeof(*c) + c->len;
+	d->addr += c->raw_len;
+	d->sum = kcap_sum(d->sum, (const uint8_t *)d->raw, c->raw_len);
+
+	return c->raw_len;
+}
+
+// fills raw with words from addr, a partial read carries on where it
+// stopped, only reads failing outright in a row give up
+static int fwdump_fill(struct fwdump_t *d, uint32_t addr, uint32_t words)
+{
+	uint32_t got = 0, fails = 0;
+
+	while (got < words) {
+		int n = d->ops->read(d->ctx, addr + 4 * got, &d->raw[got], words - got);
+
+		if (n > 0) {
+			got += ((uint32_t)n < words - got) ? (uint32_t)n : words - got;
+			fails = 0;
+		} else if (++fails > FWDUMP_RETRIES) {
+			return -1;
+		}
+
+		if (got < words) {
+			d->retries++;
+		}
+	}
+
+	return 0;
+}
+
+static int fwdump_put(struct fwdump_t *d, struct fwdump_chk_t *c)
+{
+	uint32_t len = sizeof(*c) + c->len;
+
+	fwdump_chk_seal(c);
+	memcpy(d->zbuf, c, sizeof(*c));
+
+	if (d->ops->pwrite(d->ctx, d->zbuf, len, d->off) != (int)len) {
+		return -1;
+	}
+
+	d->off += len;
+	d->out += len;
+
+	return 0;
+}
+
+int fwdump_segment(struct fwdump_t *d, uint32_t base, uint32_t size, uint32_t id)
+{
+	struct fwdump_chk_t c;
+	uint8_t *payload = d->zbuf + sizeof(c);
+	int ret;
+
+	size &= ~3u;
+	d->resumed = 0;
+	d->chunks = 0;
+	d->retries = 0;
+	d->out = 0;
+
+	// a dump cut short is picked up, a complete one is memory as it was then
+	// and is taken again
+	if (fwdump_open(d) == 0 && d->hdr.base == base && d->hdr.size == size && d->hdr.chunk == FWDUMP_CHUNK) {
+		while ((ret = fwdump_next(d, &c)) > 0) {
+		}
+		d->resumed = (ret < 0) ? d->addr - base : 0;
+	}
+
+	if (d->resumed == 0) {
+		memset(&d->hdr, 0, sizeof(d->hdr));
+		memcpy(d->hdr.magic, FWDUMP_MAGIC, 8);
+		d->hdr.version = FWDUMP_VERSION;
+		d->hdr.id = id;
+		d->hdr.base = base;
+		d->hdr.size = size;
+		d->hdr.chunk = FWDUMP_CHUNK;
+		fwdump_hdr_seal(&d->hdr);
+		if (d->ops->pwrite(d->ctx, &d->hdr, sizeof(d->hdr), 0) != sizeof(d->hdr)) {
+			return -1;
+		}
+		d->off = sizeof(d->hdr);
+		d->addr = base;
+		d->sum = 1;
+	}
+
+	while (d->addr - base < size) {
+		uint32_t len = size - (d->addr - base);
+
+		if (len > FWDUMP_CHUNK) {
+			len = FWDUMP_CHUNK;
+		}
+
+		if (fwdump_fill(d, d->addr, len / 4) < 0) {
+			return -2;
+		}
+
+		memset(&c, 0, sizeof(c));
+		c.magic = FWDUMP_CHK_MAGIC;
+		c.id = d->hdr.id;
+		c.addr = d->addr;
+		c.raw_len = len;
+		c.sum = kcap_sum(1, (const uint8_t *)d->raw, len);
+
+		ret = lz4blk_compress((const uint8_t *)d->raw, len, payload, LZ4BLK_BOUND(len), d->tab);
+		if (ret < 0 || (uint32_t)ret >= len) {
+			memcpy(payload, d->raw, len);
+			c.flags = FWDUMP_CHK_STORED;
+			c.len = len;
+		} else {
+			c.len = ret;
+		}
+
+		if (fwdump_put(d, &c) < 0) {
+			return -1;
+		}
+
+		d->addr += len;
+		d->sum = kcap_sum(d->sum, (const uint8_t *)d->raw, len);
+		d->chunks++;
+
+		if (d->ops->progress) {
+			d->ops->progress(d->ctx, base, d->addr - base, size);
+		}
+	}
+
+	memset(&c, 0, sizeof(c));
+	c.magic = FWDUMP_END_MAGIC;
+	c.id = d->hdr.id;
+	c.addr = d->addr;
+	c.sum = d->sum;
+
+	return fwdump_put(d, &c);
+}
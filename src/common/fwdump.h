@@ -0,0 +1,88 @@
+#ifndef FWDUMP_h_
+#define FWDUMP_h_
+
+#include <stdint.h>
+
+#include "lz4blk.h"
+
+// streaming dump of firmware memory (.fwd)
+// a segment is read in fixed size chunks, each chunk gets an adler32,
+// is lz4 compressed when that helps and is appended to the file as soon as
+// it has been read, an end record closes a complete segment
+// a dump that stopped part way is picked up after its last good chunk,
+// a complete one, a file holding some other segment or a damaged header
+// starts over under the new id, records of the old one after the new end
+// do not carry its id and are not read
+
+#define FWDUMP_MAGIC      "KWMDMP\r\n"
+#define FWDUMP_VERSION    1
+#define FWDUMP_CHK_MAGIC  0x4b43574b    // "KWCK"
+#define FWDUMP_END_MAGIC  0x4b45574b    // "KWEK"
+
+#define FWDUMP_CHUNK      4096          // one bulk read ioctl
+#define FWDUMP_RETRIES    4             // failed reads in a row before giving up
+
+#define FWDUMP_CHK_STORED 0x0001        // payload is the raw words
+
+struct fwdump_hdr_t {
+	char magic[8];
+	uint32_t version;
+	uint32_t id;             // set when the file is created, kept by resumes
+	uint32_t base;
+	uint32_t size;
+	uint32_t chunk;
+	uint32_t hsum;           // adler32 of the fields above
+} __attribute__ ((packed));
+
+// chunk record, an end record has no payload and sum covers the segment
+struct fwdump_chk_t {
+	uint32_t magic;
+	uint16_t flags;
+	uint16_t reserved;
+	uint32_t id;
+	uint32_t addr;
+	uint32_t raw_len;
+	uint32_t len;            // payload length following this header
+	uint32_t sum;            // adler32 of the raw bytes
+	uint32_t hsum;           // adler32 of the header fields above
+} __attribute__ ((packed));
+
+struct fwdump_ops_t {
+	// words read at addr, fewer when a read failed part way, or < 0
+	int (*read)(void *ctx, uint32_t addr, uint32_t *buf, uint32_t words);
+	// file access at an offset, bytes done or < 0
+	int (*pread)(void *ctx, void *buf, uint32_t len, uint32_t off);
+	int (*pwrite)(void *ctx, const void *buf, uint32_t len, uint32_t off);
+	// after every chunk, may be NULL
+	void (*progress)(void *ctx, uint32_t base, uint32_t done, uint32_t size);
+};
+
+struct fwdump_t {
+	const struct fwdump_ops_t *ops;
+	void *ctx;
+	struct fwdump_hdr_t hdr;
+	uint32_t off;            // file offset after the last good record
+	uint32_t addr;           // next address
+	uint32_t sum;            // adler32 of the segment up to addr
+	// counters of the last fwdump_segment call
+	uint32_t resumed;        // bytes kept from an earlier run
+	uint32_t chunks;         // chunks written
+	uint32_t retries;        // failed reads that were retried
+	uint32_t out;            // bytes written to the file
+	uint32_t raw[FWDUMP_CHUNK / 4];
+	uint8_t zbuf[sizeof(struct fwdump_chk_t) + LZ4BLK_BOUND(FWDUMP_CHUNK)];
+	uint16_t tab[LZ4BLK_HASH_SIZE];
+};
+
+// dumps [base, base + size), id goes into a file started over
+// returns 0 once the whole segment is in the file, -1 on a file error,
+// -2 when the memory could not be read, what was read so far is kept
+int fwdump_segment(struct fwdump_t *d, uint32_t base, uint32_t size, uint32_t id);
+
+// reading back, fwdump_open checks the header and rewinds to the first chunk
+int fwdump_open(struct fwdump_t *d);
+// next chunk into raw, returns its length, 0 after the end record and
+// -1 at a damaged or missing record, the end of a dump cut short
+int fwdump_next(struct fwdump_t *d, struct fwdump_chk_t *c);
+
+#endif
@@ -0,0 +1,201 @@
+#include <string.h>
+
+#include "fwhook.h"
+#include "kcap.h"
+
+int fwhook_bl_encode(uint32_t site, uint32_t target, int blx, uint8_t out[4])
+{
+	int32_t off;
+	uint16_t hw1, hw2;
+
+	if (site & 1) {
+		return -1;
+	}
+	if (blx) {
+		// from the word aligned pc, h is 0
+		if (target & 3) {
+			return -1;
+		}
+		off = (int32_t)(target - ((site + 4) & ~3u));
+	} else {
+		if (target & 1) {
+			return -1;
+		}
+		off = (int32_t)(target - (site + 4));
+	}
+	if (off < -FWHOOK_BL_REACH || off >= FWHOOK_BL_REACH) {
+		return -1;
+	}
+
+	hw1 = 0xf000 | ((off >> 12) & 0x7ff);
+	hw2 = (blx ? 0xe800 : 0xf800) | ((off >> 1) & 0x7ff);
+	out[0] = hw1;
+	out[1] = hw1 >> 8;
+	out[2] = hw2;
+	out[3] = hw2 >> 8;
+
+	return 0;
+}
+
+int fwhook_bl_decode(const uint8_t p[4], uint32_t site, uint32_t *target)
+{
+	uint16_t hw1 = p[0] | (p[1] << 8), hw2 = p[2] | (p[3] << 8);
+	int32_t off;
+
+	if ((hw1 & 0xf800) != 0xf000) {
+		return -1;
+	}
+	off = ((int32_t)((uint32_t)(hw1 & 0x7ff) << 21) >> 9) | ((hw2 & 0x7ff) << 1);
+	if ((hw2 & 0xf800) == 0xf800) {
+		*target = site + 4 + off;
+		return FWHOOK_BL;
+	}
+	if ((hw2 & 0xf801) == 0xe800) {
+		*target = (site + 4 + off) & ~3u;
+		return FWHOOK_BLX;
+	}
+
+	return -1;
+}
+
+int fwhook_build(const struct fwhook_t *h, const char *name)
+{
+	for (uint32_t i = 0; i < h->nbuild; i++) {
+		if (strcmp(h->build[i].name, name) == 0) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+static int fwhook_check(const struct fwhook_t *h, uint32_t build)
+{
+	if (h->version != FWHOOK_VERSION || build >= h->nbuild || h->nsym < 2 || h->nsym > FWHOOK_SYMS_MAX ||
+		h->len == 0 || h->len > FWHOOK_PAYLOAD_MAX || (h->len & 3) || h->entry >= h->len || (h->entry & 1) ||
+		h->nrel > FWHOOK_RELS_MAX) {
+		return -1;
+	}
+	// where fwpatch can write
+	if ((h->build[build].addr[FWHOOK_SYM_SITE] & 3) || (h->build[build].addr[FWHOOK_SYM_AT] & 3)) {
+		return -1;
+	}
+	for (uint32_t i = 0; i < h->nrel; i++) {
+		const struct fwhook_rel_t *r = &h->rel[i];
+
+		if (r->off + 4u > h->len || r->type > FWHOOK_ABS32 || (r->type != FWHOOK_ABS32 && (r->off & 1)) ||
+			(r->sym != FWHOOK_SELF && r->sym >= h->nsym)) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static uint32_t fwhook_target(const struct fwhook_t *h, uint32_t build, uint32_t at, const struct fwhook_rel_t *r)
+{
+	return ((r->sym == FWHOOK_SELF) ? at : h->build[build].addr[r->sym]) + r->addend;
+}
+
+int fwhook_link(const struct fwhook_t *h, uint32_t build, struct fwhook_link_t *l)
+{
+	uint32_t at;
+
+	l->failed = 0;
+	if (fwhook_check(h, build) < 0) {
+		return -1;
+	}
+	at = h->build[build].addr[FWHOOK_SYM_AT];
+	l->site = h->build[build].addr[FWHOOK_SYM_SITE];
+	l->at = at;
+	memcpy(l->payload, h->payload, h->len);
+
+	for (uint32_t i = 0; i < h->nrel; i++) {
+		const struct fwhook_rel_t *r = &h->rel[i];
+		uint32_t to = fwhook_target(h, build, at, r);
+		uint8_t *p = l->payload + r->off;
+
+		if (r->type == FWHOOK_ABS32) {
+			p[0] = to;
+			p[1] = to >> 8;
+			p[2] = to >> 16;
+			p[3] = to >> 24;
+		} else if (fwhook_bl_encode(at + r->off, to, r->type == FWHOOK_BLX, p) < 0) {
+			l->failed = i;
+			return -2;
+		}
+	}
+	if (fwhook_bl_encode(l->site, at + h->entry, 0, l->tramp) < 0) {
+		l->failed = h->nrel;
+		return -2;
+	}
+
+	return 0;
+}
+
+int fwhook_verify(const struct fwhook_t *h, uint32_t build, struct fwhook_link_t *l)
+{
+	uint8_t mine[FWHOOK_PAYLOAD_MAX];
+	uint32_t at, to;
+
+	l->failed = 0;
+	if (fwhook_check(h, build) < 0) {
+		return -1;
+	}
+	at = h->build[build].addr[FWHOOK_SYM_AT];
+	if (l->site != h->build[build].addr[FWHOOK_SYM_SITE] || l->at != at) {
+		l->failed = h->nrel;
+		return -3;
+	}
+
+	memset(mine, 0, h->len);
+	for (uint32_t i = 0; i < h->nrel; i++) {
+		const struct fwhook_rel_t *r = &h->rel[i];
+		const uint8_t *p = l->payload + r->off;
+		uint32_t want = fwhook_target(h, build, at, r);
+
+		if (r->type == FWHOOK_ABS32) {
+			to = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+		} else if (fwhook_bl_decode(p, at + r->off, &to) != r->type) {
+			l->failed = i;
+			return -3;
+		}
+		if (to != ((r->type == FWHOOK_BLX) ? want & ~3u : want)) {
+			l->failed = i;
+			return -3;
+		}
+		memset(mine + r->off, 1, 4);
+	}
+	if (fwhook_bl_decode(l->tramp, l->site, &to) != FWHOOK_BL || to != at + h->entry) {
+		l->failed = h->nrel;
+		return -3;
+	}
+	for (uint32_t i = 0; i < h->len; i++) {
+		if (!mine[i] && l->payload[i] != h->payload[i]) {
+			l->failed = h->nrel + 1;
+			return -3;
+		}
+	}
+
+	return 0;
+}
+
+void fwhook_patches(const struct fwhook_t *h, const struct fwhook_link_t *l, struct fwpatch_t p[2], uint32_t base)
+{
+	// whatever was at the free place goes back on undo
+	p[0].name = h->name;
+	p[0].addr = l->at;
+	p[0].len = h->len;
+	p[0].data = l->payload;
+	p[0].orig_sum = 0;
+	p[0].flags = FWPATCH_ANY_ORIG;
+	p[0].deps = 0;
+
+	p[1].name = "call";
+	p[1].addr = l->site;
+	p[1].len = FWHOOK_TRAMP_LEN;
+	p[1].data = l->tramp;
+	p[1].orig_sum = kcap_sum(1, h->orig, FWHOOK_TRAMP_LEN);
+	p[1].flags = 0;
+	p[1].deps = 1 << base;
+}
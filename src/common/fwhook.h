@@ -0,0 +1,96 @@
+#ifndef FWHOOK_h_
+#define FWHOOK_h_
+
+#include <stdint.h>
+
+#include "fwpatch.h"
+
+// firmware hooks as descriptors instead of hand encoded thumb
+// a hook is a payload of thumb code put at a free place and a bl put at a
+// site in place of the instructions it expects there, the payload is built
+// once with holes where it calls into firmware or points at itself, and the
+// relocations fill them for each firmware build the hook knows the
+// addresses of
+// symbols are per hook, the first one is the site, the second where the
+// payload goes, the rest what it calls, every build gives an address for
+// each of them
+// fwhook_link makes the bytes, fwhook_verify decodes them back and checks
+// every branch lands where it should, fwhook_patches turns them into the
+// pair of patches fwpatch puts in, the payload first and the bl after it
+// host/fwhookcli.c assembles descriptors out of .hook files
+
+#define FWHOOK_VERSION     1
+#define FWHOOK_SYMS_MAX    16
+#define FWHOOK_RELS_MAX    32
+#define FWHOOK_PAYLOAD_MAX 256
+#define FWHOOK_TRAMP_LEN   4          // a thumb bl
+#define FWHOOK_BL_REACH    0x400000   // either way from the bl plus 4
+
+#define FWHOOK_SYM_SITE    0
+#define FWHOOK_SYM_AT      1
+#define FWHOOK_SELF        0xff       // relocation against the payload itself
+
+enum {
+	FWHOOK_BL,               // thumb bl to thumb code
+	FWHOOK_BLX,              // thumb blx to arm code
+	FWHOOK_ABS32,            // address word, a literal pool entry
+};
+
+struct fwhook_rel_t {
+	uint16_t off;            // in the payload
+	uint8_t type;
+	uint8_t sym;             // of the hook or FWHOOK_SELF
+	int32_t addend;
+};
+
+// addresses of the hook's symbols in one firmware build
+struct fwhook_build_t {
+	const char *name;
+	uint32_t addr[FWHOOK_SYMS_MAX];
+};
+
+struct fwhook_t {
+	uint32_t version;        // FWHOOK_VERSION
+	const char *name;
+	const char *const *sym;
+	uint32_t nsym;
+	const uint8_t *orig;     // FWHOOK_TRAMP_LEN bytes at the site the bl replaces
+	const uint8_t *payload;  // zero where relocations go
+	uint32_t len;            // bytes, word multiple
+	uint32_t entry;          // where in the payload the bl goes
+	const struct fwhook_rel_t *rel;
+	uint32_t nrel;
+	const struct fwhook_build_t *build;
+	uint32_t nbuild;
+};
+
+struct fwhook_link_t {
+	uint32_t site;
+	uint32_t at;
+	uint8_t payload[FWHOOK_PAYLOAD_MAX];
+	uint8_t tramp[FWHOOK_TRAMP_LEN];
+	uint32_t failed;         // relocation at fault, nrel the bl, nrel + 1 the rest
+};
+
+// thumb bl or blx at site to target, returns 0 or -1 out of reach or
+// target not aligned for it
+int fwhook_bl_encode(uint32_t site, uint32_t target, int blx, uint8_t out[4]);
+// the bl or blx at site, returns FWHOOK_BL, FWHOOK_BLX or -1 not one
+int fwhook_bl_decode(const uint8_t p[4], uint32_t site, uint32_t *target);
+
+// index of the build called name, -1 if the hook has none
+int fwhook_build(const struct fwhook_t *h, const char *name);
+
+// payload and bl for a build, returns 0, -1 bad descriptor or build, -2 a
+// branch out of reach or misaligned, failed says which
+int fwhook_link(const struct fwhook_t *h, uint32_t build, struct fwhook_link_t *l);
+// every relocation and the bl decoded back against the build's addresses,
+// the bytes between relocations against the descriptor, returns 0 or -3
+// with failed what does not match
+int fwhook_verify(const struct fwhook_t *h, uint32_t build, struct fwhook_link_t *l);
+
+// the payload at p[0] and the bl at p[1], which depends on it, base is
+// the index of p[0] in the patch set
+void fwhook_patches(const struct fwhook_t *h, const struct fwhook_link_t *l, struct fwpatch_t p[2], uint32_t base);
+
+#endif
@@ -0,0 +1,330 @@
+#include <string.h>
+
+#include "kcap.h"
+
+#include "fwpatch.h"
+
+#define FWPATCH_RETRIES 4
+
+int fwpatch_init(struct fwpatch_set_t *s, const struct fwpatch_t *p, uint32_t n)
+{
+	uint32_t i, j, words = 0, placed = 0;
+
+	memset(s, 0, sizeof(*s));
+	s->p = p;
+	s->n = n;
+	s->failed = n;
+
+	if (n > FWPATCH_MAX) {
+		return -1;
+	}
+
+	for (i = 0; i < n; i++) {
+		if ((p[i].addr & 3) || (p[i].len & 3) || p[i].len == 0 || p[i].data == NULL
+			|| (p[i].deps >> i) & 1 || (n < 32 && (p[i].deps >> n))
+			|| words + p[i].len / 4 > FWPATCH_WORDS_MAX) {
+			s->failed = i;
+			return -1;
+		}
+		for (j = 0; j < i; j++) {
+			if (p[i].addr < p[j].addr + p[j].len && p[j].addr < p[i].addr + p[i].len) {
+				s->failed = i;
+				return -1;
+			}
+		}
+		s->at[i] = words;
+		words += p[i].len / 4;
+	}
+
+	// set order as far as the dependencies allow
+	for (j = 0; j < n; j++) {
+		for (i = 0; i < n; i++) {
+			if (!((placed >> i) & 1) && (p[i].deps & ~placed) == 0) {
+				break;
+			}
+		}
+		if (i == n) {
+			// a cycle, report one of the patches in it
+			for (i = 0; (placed >> i) & 1; i++);
+			s->failed = i;
+			return -1;
+		}
+		s->order[j] = i;
+		placed |= 1u << i;
+	}
+
+	return 0;
+}
+
+static uint32_t fwpatch_all(const struct fwpatch_set_t *s)
+{
+	return (s->n == 32) ? 0xffffffff : (1u << s->n) - 1;
+}
+
+// mask and everything it depends on
+static uint32_t fwpatch_deps(const struct fwpatch_set_t *s, uint32_t mask)
+{
+	uint32_t i, prev;
+
+	do {
+		prev = mask;
+		for (i = 0; i < s->n; i++) {
+			if ((mask >> i) & 1) {
+				mask |= s->p[i].deps;
+			}
+		}
+	} while (mask != prev);
+
+	return mask;
+}
+
+// mask and every applied patch that depends on it
+static uint32_t fwpatch_users(const struct fwpatch_set_t *s, uint32_t mask)
+{
+	uint32_t i, prev;
+
+	do {
+		prev = mask;
+		for (i = 0; i < s->n; i++) {
+			if (((s->applied >> i) & 1) && (s->p[i].deps & mask)) {
+				mask |= 1u << i;
+			}
+		}
+	} while (mask != prev);
+
+	return mask;
+}
+
+static int fwpatch_read(struct fwpatch_set_t *s, uint32_t i)
+{
+	const struct fwpatch_t *p = &s->p[i];
+	uint32_t words = p->len / 4, done = 0, tries = 0;
+
+	while (done < words) {
+		int ret = s->ops->read(s->ctx, p->addr + 4 * done, &s->cur[s->at[i] + done], words - done);
+
+		if (ret <= 0) {
+			if (++tries == FWPATCH_RETRIES) {
+				s->failed = i;
+				return -2;
+			}
+			continue;
+		}
+		done += ((uint32_t)ret < words - done) ? (uint32_t)ret : words - done;
+	}
+
+	return 0;
+}
+
+static int fwpatch_in_place(const struct fwpatch_set_t *s, uint32_t i)
+{
+	return memcmp(&s->cur[s->at[i]], s->p[i].data, s->p[i].len) == 0;
+}
+
+int fwpatch_scan(struct fwpatch_set_t *s, uint32_t *in, uint32_t *orig)
+{
+	uint32_t i;
+
+	*in = 0;
+	*orig = 0;
+	s->failed = s->n;
+
+	for (i = 0; i < s->n; i++) {
+		const struct fwpatch_t *p = &s->p[i];
+
+		if (fwpatch_read(s, i) < 0) {
+			return -2;
+		}
+		if (fwpatch_in_place(s, i)) {
+			*in |= 1u << i;
+		} else if (!(p->flags & FWPATCH_ANY_ORIG) && kcap_sum(1, (uint8_t *)&s->cur[s->at[i]], p->len) == p->orig_sum) {
+			*orig |= 1u << i;
+		}
+	}
+
+	// put in by someone else, or by us before a restart
+	s->saved &= *in;
+	s->applied = *in;
+
+	return 0;
+}
+
+// hands the request to the hook, failed becomes the patch of the failed entry
+static int fwpatch_commit(struct fwpatch_set_t *s, uint32_t words, const uint8_t *owner)
+{
+	struct wifimon_mem_patch_t h;
+	int ret;
+
+	if (words == 0) {
+		return 0;
+	}
+
+	memset(&h, 0, sizeof(h));
+	h.words = words;
+	memcpy(s->req, &h, sizeof(h));
+
+	ret = s->ops->patch(s->ctx, (struct wifimon_mem_patch_t *)s->req,
+		sizeof(h) + words * sizeof(struct wifimon_mem_patch_ent_t));
+
+	memcpy(&h, s->req, sizeof(h));
+	if (ret < 0) {
+		s->failed = (h.failed < words) ? owner[h.failed] : s->n;
+		s->restored = h.restored;
+		return ret;
+	}
+	s->words = words;
+
+	return ret;
+}
+
+static void fwpatch_ent(struct fwpatch_set_t *s, uint32_t k, uint32_t addr, uint32_t value, uint32_t expect)
+{
+	struct wifimon_mem_patch_ent_t e = { addr, value, expect };
+
+	memcpy(s->req + sizeof(struct wifimon_mem_patch_t) + k * sizeof(e), &e, sizeof(e));
+}
+
+int fwpatch_apply(struct fwpatch_set_t *s, uint32_t mask)
+{
+	uint8_t owner[FWPATCH_WORDS_MAX];
+	uint32_t want, todo = 0, i, j, k = 0;
+	int ret;
+
+	s->failed = s->n;
+	s->words = 0;
+	s->restored = 0;
+
+	if (mask & ~fwpatch_all(s)) {
+		return -1;
+	}
+	want = fwpatch_deps(s, mask);
+
+	// everything involved in bulk first, nothing is written unless all of it checks out
+	for (i = 0; i < s->n; i++) {
+		if (((want >> i) & 1) && fwpatch_read(s, i) < 0) {
+			return -2;
+		}
+	}
+
+	for (j = 0; j < s->n; j++) {
+		const struct fwpatch_t *p = &s->p[i = s->order[j]];
+
+		if (!((want >> i) & 1)) {
+			continue;
+		}
+		if (fwpatch_in_place(s, i)) {
+			if (!((s->applied >> i) & 1)) {
+				s->applied |= 1u << i;
+				s->saved &= ~(1u << i);
+			}
+			continue;
+		}
+		// ours but changed since, or not the firmware it was made for
+		if (((s->applied >> i) & 1) || (!(p->flags & FWPATCH_ANY_ORIG)
+			&& kcap_sum(1, (uint8_t *)&s->cur[s->at[i]], p->len) != p->orig_sum)) {
+			s->failed = i;
+			return -3;
+		}
+		todo |= 1u << i;
+
+		for (uint32_t w = 0; w < p->len / 4; w++) {
+			uint32_t value;
+
+			memcpy(&value, &p->data[4 * w], 4);
+			if (value != s->cur[s->at[i] + w]) {
+				owner[k] = i;
+				fwpatch_ent(s, k++, p->addr + 4 * w, value, s->cur[s->at[i] + w]);
+			}
+		}
+	}
+
+	ret = fwpatch_commit(s, k, owner);
+	if (ret < 0) {
+		return ret;
+	}
+
+	for (i = 0; i < s->n; i++) {
+		if ((todo >> i) & 1) {
+			memcpy(&s->pre[s->at[i]], &s->cur[s->at[i]], s->p[i].len);
+		}
+	}
+	s->applied |= todo;
+	s->saved |= todo;
+
+	return ret;
+}
+
+int fwpatch_undo(struct fwpatch_set_t *s, uint32_t mask)
+{
+	uint8_t owner[FWPATCH_WORDS_MAX];
+	uint32_t want, i, j, k = 0;
+	int ret;
+
+	s->failed = s->n;
+	s->words = 0;
+	s->restored = 0;
+
+	if (mask & ~fwpatch_all(s)) {
+		return -1;
+	}
+
+	// a set that has not scanned does not know what is in firmware, one
+	// found in place has no saved original
+	for (i = 0; i < s->n; i++) {
+		if (!(((mask & ~s->applied) >> i) & 1)) {
+			continue;
+		}
+		if (fwpatch_read(s, i) < 0) {
+			return -2;
+		}
+		if (fwpatch_in_place(s, i)) {
+			s->applied |= 1u << i;
+			s->saved &= ~(1u << i);
+		}
+	}
+	want = fwpatch_users(s, mask & s->applied);
+
+	for (i = 0; i < s->n; i++) {
+		if (!((want >> i) & 1)) {
+			continue;
+		}
+		if (!((s->saved >> i) & 1)) {
+			s->failed = i;
+			return -1;
+		}
+		if (fwpatch_read(s, i) < 0) {
+			return -2;
+		}
+		if (!fwpatch_in_place(s, i)) {
+			s->failed = i;
+			return -3;
+		}
+	}
+
+	// those depending on others first
+	for (j = s->n; j-- > 0; ) {
+		const struct fwpatch_t *p = &s->p[i = s->order[j]];
+
+		if (!((want >> i) & 1)) {
+			continue;
+		}
+		for (uint32_t w = 0; w < p->len / 4; w++) {
+			uint32_t value = s->pre[s->at[i] + w];
+
+			if (value != s->cur[s->at[i] + w]) {
+				owner[k] = i;
+				fwpatch_ent(s, k++, p->addr + 4 * w, value, s->cur[s->at[i] + w]);
+			}
+		}
+	}
+
+	ret = fwpatch_commit(s, k, owner);
+	if (ret < 0) {
+		return ret;
+	}
+
+	s->applied &= ~want;
+	s->saved &= ~want;
+
+	return ret;
+}
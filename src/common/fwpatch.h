@@ -0,0 +1,79 @@
+#ifndef FWPATCH_h_
+#define FWPATCH_h_
+
+#include <stdint.h>
+
+#include "kwifimon_export.h"
+
+// firmware patch sets
+// a patch replaces len bytes at addr, the bytes it replaces have to match
+// the adler32 given for them and are saved when it goes in, so every patch
+// applied can be undone, deps are patches of the same set it needs, they go
+// in before it and come out after it
+// apply and undo read the ranges involved in bulk, check them, then hand
+// every word to the hook in one WLAN_IOCTL_MEM_PATCH, which writes them
+// under a single wlan_lock and puts it all back when a write does not stick,
+// firmware ends up with the whole change or none of it
+
+#define FWPATCH_MAX       32
+#define FWPATCH_WORDS_MAX WIFIMON_MEM_PATCH_MAX
+
+#define FWPATCH_ANY_ORIG  0x0001   // what it replaces is not known, not checked
+
+struct fwpatch_t {
+	const char *name;
+	uint32_t addr;
+	uint32_t len;            // bytes, addr and len word aligned
+	const uint8_t *data;
+	uint32_t orig_sum;       // adler32 of the bytes it replaces
+	uint32_t flags;
+	uint32_t deps;           // bit per patch of the set
+};
+
+struct fwpatch_ops_t {
+	// WLAN_IOCTL_MEM_BULK, returns words read or < 0
+	int (*read)(void *ctx, uint32_t addr, uint32_t *buf, uint32_t words);
+	// WLAN_IOCTL_MEM_PATCH, returns words written or < 0
+	int (*patch)(void *ctx, struct wifimon_mem_patch_t *req, uint32_t len);
+};
+
+struct fwpatch_set_t {
+	const struct fwpatch_ops_t *ops;
+	void *ctx;
+	const struct fwpatch_t *p;
+	uint32_t n;
+	uint32_t applied;        // bit per patch in place
+	uint32_t saved;          // bit per applied patch whose original is known
+	// of the last apply or undo
+	uint32_t failed;         // patch it stopped at, n when none
+	uint32_t words;          // words written
+	uint32_t restored;       // words put back by the hook after a failure
+	uint8_t order[FWPATCH_MAX];       // dependencies first
+	uint16_t at[FWPATCH_MAX];         // first word of each patch in pre and cur
+	uint32_t pre[FWPATCH_WORDS_MAX];  // what applied patches replaced
+	uint32_t cur[FWPATCH_WORDS_MAX];
+	uint8_t req[sizeof(struct wifimon_mem_patch_t) + sizeof(struct wifimon_mem_patch_ent_t) * FWPATCH_WORDS_MAX];
+};
+
+// checks the set: alignment, overlaps, dependency cycles, size
+// returns 0 or -1, failed is the patch at fault
+int fwpatch_init(struct fwpatch_set_t *s, const struct fwpatch_t *p, uint32_t n);
+
+// what is in firmware now, sets in to the patches in place and orig to
+// those whose original is there, patches found in place count as applied
+// returns 0 or -2 when memory could not be read
+int fwpatch_scan(struct fwpatch_set_t *s, uint32_t *in, uint32_t *orig);
+
+// the patches of mask and all they depend on, in one transaction
+// returns words written, -1 bad mask, -2 read failed, -3 memory not what a
+// patch expects, nothing written, -4 write failed and all was put back,
+// -5 putting back failed too
+int fwpatch_apply(struct fwpatch_set_t *s, uint32_t mask);
+
+// the patches of mask and all applied ones depending on them, back to what
+// they replaced, -1 as well when one of them has no saved original, those
+// of mask not known to be applied are read first, in place they count as
+// applied without one
+int fwpatch_undo(struct fwpatch_set_t *s, uint32_t mask);
+
+#endif
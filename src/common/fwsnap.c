@@ -0,0 +1,194 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "fwsnap.h"
+#include "kcap.h"
+
+void fwsnap_rec_seal(struct fwsnap_rec_t *r)
+{
+	r->hsum = kcap_sum(1, (const uint8_t *)r, offsetof(struct fwsnap_rec_t, hsum));
+}
+
+int fwsnap_rec_check(const struct fwsnap_rec_t *r)
+{
+	if (r->magic != FWSNAP_BEGIN_MAGIC && r->magic != FWSNAP_PAGE_MAGIC && r->magic != FWSNAP_END_MAGIC) {
+		return -1;
+	}
+
+	if (r->hsum != kcap_sum(1, (const uint8_t *)r, offsetof(struct fwsnap_rec_t, hsum))) {
+		return -2;
+	}
+
+	if (r->magic == FWSNAP_PAGE_MAGIC) {
+		if (r->size == 0 || r->size > FWSNAP_PAGE_MAX || (r->size & 3)) {
+			return -3;
+		}
+		if ((r->flags & FWSNAP_STORED) ? r->len != r->size : r->len > LZ4BLK_BOUND(r->size)) {
+			return -4;
+		}
+	} else if (r->len != 0) {
+		return -4;
+	}
+
+	return 0;
+}
+
+int fwsnap_init(struct fwsnap_t *s, uint32_t base, uint32_t size, uint32_t page, uint32_t seq)
+{
+	if (page < FWSNAP_PAGE_MIN || page > FWSNAP_PAGE_MAX || (page & (page - 1)) ||
+	    size == 0 || size % page || size / page > FWSNAP_PAGES_MAX) {
+		return -1;
+	}
+
+	s->base = base;
+	s->size = size;
+	s->page = page;
+	s->seq = seq;
+	s->full = 1;
+	s->full_every = 0;
+	s->since_full = 0;
+
+	return 0;
+}
+
+static int fwsnap_put(struct fwsnap_t *s, struct fwsnap_rec_t *r)
+{
+	uint32_t len = sizeof(*r) + r->len;
+
+	fwsnap_rec_seal(r);
+	memcpy(s->zbuf, r, sizeof(*r));
+
+	if (s->ops->write(s->ctx, s->zbuf, len) != (int)len) {
+		return -1;
+	}
+
+	s->out += len;
+
+	return 0;
+}
+
+static int fwsnap_put_page(struct fwsnap_t *s, uint32_t addr, const uint8_t *raw, uint32_t time_ms)
+{
+	struct fwsnap_rec_t r;
+	uint8_t *payload = s->zbuf + sizeof(r);
+	int ret;
+
+	memset(&r, 0, sizeof(r));
+	r.magic = FWSNAP_PAGE_MAGIC;
+	r.seq = s->seq;
+	r.addr = addr;
+	r.size = s->page;
+	r.sum = kcap_sum(1, raw, s->page);
+	r.time_ms = time_ms;
+
+	ret = lz4blk_compress(raw, s->page, payload, LZ4BLK_BOUND(s->page), s->tab);
+	if (ret < 0 || (uint32_t)ret >= s->page) {
+		memcpy(payload, raw, s->page);
+		r.flags = FWSNAP_STORED;
+		r.len = s->page;
+	} else {
+		r.len = ret;
+	}
+
+	return fwsnap_put(s, &r);
+}
+
+int fwsnap_take(struct fwsnap_t *s, uint32_t time_ms)
+{
+	struct wifimon_mem_delta_t *req = (struct wifimon_mem_delta_t *)s->req;
+	uint32_t *hash = (uint32_t *)(req + 1);
+	uint32_t words = s->page / 4;
+	uint32_t npages = s->size / s->page;
+	uint32_t batch = WIFIMON_MEM_BULK_MAX / words;
+	uint32_t i = 0, fails = 0;
+	struct fwsnap_rec_t r;
+	int full = s->full;
+
+	// a reader that lost a snapshot has nothing to apply deltas to until
+	// the next full one
+	if (s->full_every && ++s->since_full >= s->full_every) {
+		full = 1;
+	}
+
+	if (batch > WIFIMON_MEM_DELTA_PAGES) {
+		batch = WIFIMON_MEM_DELTA_PAGES;
+	}
+
+	s->changed = 0;
+	s->ioctls = 0;
+	s->ioctl_bytes = 0;
+	s->out = 0;
+	// anything short of the end record leaves the hashes ahead of the file
+	s->full = 1;
+
+	memset(&r, 0, sizeof(r));
+	r.magic = FWSNAP_BEGIN_MAGIC;
+	r.flags = full ? FWSNAP_FULL : 0;
+	r.page = s->page;
+	r.seq = s->seq;
+	r.addr = s->base;
+	r.size = s->size;
+	r.time_ms = time_ms;
+	if (fwsnap_put(s, &r) < 0) {
+		return -1;
+	}
+
+	while (i < npages) {
+		uint32_t n = (npages - i < batch) ? npages - i : batch;
+		uint32_t len = sizeof(*req) + 4 * n + 4 * n * words;
+		uint8_t *data = (uint8_t *)&hash[n];
+		uint32_t j;
+		int done;
+
+		memset(req, 0, sizeof(*req));
+		req->addr = s->base + i * s->page;
+		req->page_words = words;
+		req->pages = n;
+		req->flags = full ? WIFIMON_MEM_DELTA_FULL : 0;
+		memcpy(hash, &s->hash[i], 4 * n);
+
+		done = s->ops->delta(s->ctx, req, len);
+		s->ioctls++;
+		if (done <= 0) {
+			if (++fails > FWSNAP_RETRIES) {
+				return -2;
+			}
+			continue;
+		}
+		fails = 0;
+		if ((uint32_t)done > n) {
+			done = n;
+		}
+
+		for (j = 0; j < (uint32_t)done; j++) {
+			if (req->changed[j / 32] & (1u << (j % 32))) {
+				if (fwsnap_put_page(s, req->addr + j * s->page, data, time_ms) < 0) {
+					return -1;
+				}
+				data += s->page;
+				s->changed++;
+			}
+		}
+		s->ioctl_bytes += sizeof(*req) + 4 * n + (data - (uint8_t *)&hash[n]);
+		memcpy(&s->hash[i], hash, 4 * done);
+		i += done;
+	}
+
+	memset(&r, 0, sizeof(r));
+	r.magic = FWSNAP_END_MAGIC;
+	r.seq = s->seq;
+	r.addr = s->base;
+	r.size = s->changed;
+	r.time_ms = time_ms;
+	if (fwsnap_put(s, &r) < 0) {
+		return -1;
+	}
+
+	s->seq++;
+	s->full = 0;
+	if (full) {
+		s->since_full = 0;
+	}
+
+	return s->changed;
+}
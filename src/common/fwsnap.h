@@ -0,0 +1,107 @@
+#ifndef FWSNAP_h_
+#define FWSNAP_h_
+
+#include <stdint.h>
+
+#include "kwifimon_export.h"
+#include "lz4blk.h"
+
+// incremental snapshots of firmware memory (.fws)
+// the hook hashes fixed size pages as it reads them and hands back only
+// the pages whose hash moved since the last snapshot, so unchanged memory
+// crosses neither the ioctl nor the card, every word is still read once
+// a snapshot is a begin record, the changed pages and an end record, a
+// reader applies it only once the end record is there, a full snapshot
+// holds every page and is the base the deltas after it build on
+// records are appended, any number of segments can share one file
+
+#define FWSNAP_BEGIN_MAGIC 0x4253574b   // "KWSB"
+#define FWSNAP_PAGE_MAGIC  0x5053574b   // "KWSP"
+#define FWSNAP_END_MAGIC   0x4553574b   // "KWSE"
+
+#define FWSNAP_PAGE_MIN    64
+#define FWSNAP_PAGE_MAX    4096
+#define FWSNAP_PAGES_MAX   4096
+#define FWSNAP_RETRIES     4
+
+#define FWSNAP_FULL        0x0001       // begin: every page follows
+#define FWSNAP_STORED      0x0002       // page: payload is the raw words
+
+struct fwsnap_rec_t {
+	uint32_t magic;
+	uint16_t flags;
+	uint16_t page;           // begin: page size
+	uint32_t seq;            // snapshot number, the same in all its records
+	uint32_t addr;           // begin: segment base, page: its address
+	uint32_t size;           // begin: segment size, page: raw length, end: pages that came
+	uint32_t len;            // payload following this record
+	uint32_t sum;            // page: adler32 of the raw bytes
+	uint32_t time_ms;
+	uint32_t hsum;           // adler32 of the fields above
+} __attribute__ ((packed));
+
+// murmur3 over words, what the hook compares pages by
+static inline uint32_t fwsnap_hash(uint32_t h, uint32_t w)
+{
+	w *= 0xcc9e2d51;
+	w = (w << 15) | (w >> 17);
+	w *= 0x1b873593;
+	h ^= w;
+	h = (h << 13) | (h >> 19);
+
+	return h * 5 + 0xe6546b64;
+}
+
+static inline uint32_t fwsnap_hash_end(uint32_t h, uint32_t words)
+{
+	h ^= words * 4;
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+
+	return h ^ (h >> 16);
+}
+
+struct fwsnap_ops_t {
+	// WLAN_IOCTL_MEM_DELTA, returns pages done or < 0
+	int (*delta)(void *ctx, struct wifimon_mem_delta_t *req, uint32_t len);
+	// appends to the file, bytes written or < 0
+	int (*write)(void *ctx, const void *buf, uint32_t len);
+};
+
+struct fwsnap_t {
+	const struct fwsnap_ops_t *ops;
+	void *ctx;
+	uint32_t base;
+	uint32_t size;
+	uint32_t page;
+	uint32_t seq;            // of the next snapshot
+	int full;                // next snapshot is a full one
+	uint32_t full_every;     // a full one at least every so many, 0 only when needed
+	uint32_t since_full;
+	// counters of the last fwsnap_take call
+	uint32_t changed;        // pages written
+	uint32_t ioctls;
+	uint32_t ioctl_bytes;    // request and reply
+	uint32_t out;            // bytes written to the file
+	uint32_t hash[FWSNAP_PAGES_MAX];
+	uint8_t req[sizeof(struct wifimon_mem_delta_t) + 4 * WIFIMON_MEM_DELTA_PAGES + 4 * WIFIMON_MEM_BULK_MAX];
+	uint8_t zbuf[sizeof(struct fwsnap_rec_t) + LZ4BLK_BOUND(FWSNAP_PAGE_MAX)];
+	uint16_t tab[LZ4BLK_HASH_SIZE];
+};
+
+// page is a power of two from FWSNAP_PAGE_MIN to FWSNAP_PAGE_MAX that
+// divides size, returns -1 otherwise
+int fwsnap_init(struct fwsnap_t *s, uint32_t base, uint32_t size, uint32_t page, uint32_t seq);
+
+// appends a snapshot, a full one the first time and after any failure
+// returns pages written, -1 on a file error, -2 when memory could not be read
+int fwsnap_take(struct fwsnap_t *s, uint32_t time_ms);
+
+// record header is sane, 0 or < 0
+int fwsnap_rec_check(const struct fwsnap_rec_t *r);
+// fills in hsum
+void fwsnap_rec_seal(struct fwsnap_rec_t *r);
+
+#endif
@@ -0,0 +1,68 @@
+#include <stddef.h>
+
+#include "kcap.h"
+#include "lz4blk.h"
+
+#define ADLER_MOD  65521
+#define ADLER_NMAX 5552     // largest run before the sums may overflow
+
+uint32_t kcap_sum(uint32_t sum, const uint8_t *buf, uint32_t len)
+{
+	uint32_t a = sum & 0xffff, b = sum >> 16;
+
+	while (len) {
+		uint32_t n = (len < ADLER_NMAX) ? len : ADLER_NMAX;
+
+		len -= n;
+		while (n >= 8) {
+			a += buf[0]; b += a;
+			a += buf[1]; b += a;
+			a += buf[2]; b += a;
+			a += buf[3]; b += a;
+			a += buf[4]; b += a;
+			a += buf[5]; b += a;
+			a += buf[6]; b += a;
+			a += buf[7]; b += a;
+			buf += 8;
+			n -= 8;
+		}
+		while (n--) {
+			a += *buf++;
+			b += a;
+		}
+		a %= ADLER_MOD;
+		b %= ADLER_MOD;
+	}
+
+	return (b << 16) | a;
+}
+
+void kcap_blk_seal(struct kcap_blk_t *b)
+{
+	b->hsum = kcap_sum(1, (const uint8_t *)b, offsetof(struct kcap_blk_t, hsum));
+}
+
+int kcap_blk_check(const struct kcap_blk_t *b, uint32_t block_max)
+{
+	if (b->magic != KCAP_BLK_MAGIC) {
+		return -1;
+	}
+
+	if (b->hsum != kcap_sum(1, (const uint8_t *)b, offsetof(struct kcap_blk_t, hsum))) {
+		return -2;
+	}
+
+	if (b->raw_len > block_max || b->raw_len > LZ4BLK_MAX) {
+		return -3;
+	}
+
+	if (b->flags & KCAP_BLK_STORED) {
+		if (b->len != b->raw_len) {
+			return -4;
+		}
+	} else if (b->len > LZ4BLK_BOUND(b->raw_len)) {
+		return -4;
+	}
+
+	return 0;
+}
@@ -0,0 +1,43 @@
+#ifndef KCAP_h_
+#define KCAP_h_
+
+#include <stdint.h>
+
+// compressed capture file (.kcap)
+// file header with the pcap global header, then independent blocks
+// a block holds whole pcap records, decompressing every block in order
+// and appending them to the pcap header gives back a plain pcap file
+
+#define KCAP_MAGIC       "KWMCAP\r\n"
+#define KCAP_VERSION     1
+#define KCAP_BLK_MAGIC   0x4b42574b    // "KWBK"
+
+#define KCAP_BLK_STORED  0x0001        // payload is the raw records
+
+struct kcap_hdr_t {
+	char magic[8];
+	uint32_t version;
+	uint32_t block_max;      // largest raw block length
+	uint8_t pcap[24];        // pcap global header
+} __attribute__ ((packed));
+
+struct kcap_blk_t {
+	uint32_t magic;
+	uint16_t flags;
+	uint16_t nrec;           // pcap records in the block
+	uint32_t raw_len;
+	uint32_t len;            // payload length following this header
+	uint32_t ts_sec;         // first record
+	uint32_t ts_usec;
+	uint32_t sum;            // adler32 of the raw records
+	uint32_t hsum;           // adler32 of the header fields above
+} __attribute__ ((packed));
+
+uint32_t kcap_sum(uint32_t sum, const uint8_t *buf, uint32_t len);
+
+// fills in hsum
+void kcap_blk_seal(struct kcap_blk_t *b);
+// header is sane for a file with the given block_max
+int kcap_blk_check(const struct kcap_blk_t *b, uint32_t block_max);
+
+#endif
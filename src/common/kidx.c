@@ -0,0 +1,112 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "kidx.h"
+#include "kcap.h"
+#include "dot11.h"
+
+void kidx_hdr_init(struct kidx_hdr_t *h, uint32_t flags)
+{
+	memcpy(h->magic, KIDX_MAGIC, sizeof(h->magic));
+	h->version = KIDX_VERSION;
+	h->flags = flags;
+	h->bloom_bits = KIDX_BLOOM_BITS;
+	h->bloom_k = KIDX_BLOOM_K;
+}
+
+int kidx_hdr_check(const struct kidx_hdr_t *h)
+{
+	if (memcmp(h->magic, KIDX_MAGIC, sizeof(h->magic)) || h->version != KIDX_VERSION) {
+		return -1;
+	}
+
+	if (h->bloom_bits != KIDX_BLOOM_BITS || h->bloom_k != KIDX_BLOOM_K) {
+		return -2;
+	}
+
+	return 0;
+}
+
+void kidx_ent_reset(struct kidx_ent_t *e)
+{
+	memset(e, 0, sizeof(*e));
+	e->ts_min = UINT64_MAX;
+}
+
+void kidx_ent_add(struct kidx_ent_t *e, uint32_t ts_sec, uint32_t ts_usec, const uint8_t *frame, uint32_t len)
+{
+	uint64_t ts = (uint64_t)ts_sec * 1000000 + ts_usec;
+	struct dot11_hdr_t h;
+
+	if (ts < e->ts_min) {
+		e->ts_min = ts;
+	}
+	if (ts > e->ts_max) {
+		e->ts_max = ts;
+	}
+	e->nrec++;
+
+	if (frame == NULL || dot11_hdr_parse(frame, len, &h) < 0) {
+		return;
+	}
+
+	if (h.ta) {
+		kidx_bloom_add(e->bloom, h.ta);
+	}
+	if (h.bssid && h.bssid != h.ta) {
+		kidx_bloom_add(e->bloom, h.bssid);
+	}
+}
+
+void kidx_ent_seal(struct kidx_ent_t *e)
+{
+	e->sum = kcap_sum(1, (const uint8_t *)e, offsetof(struct kidx_ent_t, sum));
+}
+
+int kidx_ent_check(const struct kidx_ent_t *e)
+{
+	return (e->sum == kcap_sum(1, (const uint8_t *)e, offsetof(struct kidx_ent_t, sum))) ? 0 : -1;
+}
+
+// double hashing over one 32 bit hash of the address
+static inline uint32_t kidx_hash(const uint8_t *a)
+{
+	uint32_t h = 0x811c9dc5;
+	int i;
+
+	for (i = 0; i < 6; i++) {
+		h = (h ^ a[i]) * 0x01000193;
+	}
+
+	return h ^ (h >> 15);
+}
+
+void kidx_bloom_add(uint8_t *bloom, const uint8_t *addr)
+{
+	uint32_t h = kidx_hash(addr);
+	uint32_t d = (h >> 17 | h << 15) | 1;
+	int i;
+
+	for (i = 0; i < KIDX_BLOOM_K; i++) {
+		uint32_t bit = h & (KIDX_BLOOM_BITS - 1);
+		bloom[bit >> 3] |= 1 << (bit & 7);
+		h += d;
+	}
+}
+
+int kidx_bloom_test(const uint8_t *bloom, const uint8_t *addr)
+{
+	uint32_t h = kidx_hash(addr);
+	uint32_t d = (h >> 17 | h << 15) | 1;
+	int i;
+
+	for (i = 0; i < KIDX_BLOOM_K; i++) {
+		uint32_t bit = h & (KIDX_BLOOM_BITS - 1);
+		if (!(bloom[bit >> 3] & (1 << (bit & 7)))) {
+			return 0;
+		}
+		h += d;
+	}
+
+	return 1;
+}
@@ -0,0 +1,55 @@
+#ifndef KIDX_h_
+#define KIDX_h_
+
+#include <stdint.h>
+
+// capture index sidecar (.idx), one entry per batch the writer flushed
+// an entry has the file range of the batch, its time span and a bloom
+// filter of transmitter and bssid addresses of the frames in it, the ta
+// and bssid of dot11_hdr_parse
+// checkpoint entries are written after each sync, the capture is known
+// good up to their offset
+
+#define KIDX_MAGIC       "KWMIDX\r\n"
+#define KIDX_VERSION     2
+#define KIDX_BLOOM_BITS  2048
+#define KIDX_BLOOM_K     3
+
+#define KIDX_KCAP        0x0001        // ranges are .kcap blocks, not pcap records
+
+#define KIDX_ENT_CHECKPOINT 0x0001     // no records, capture synced up to off
+
+struct kidx_hdr_t {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	uint32_t bloom_bits;
+	uint32_t bloom_k;
+} __attribute__ ((packed));
+
+struct kidx_ent_t {
+	uint64_t off;            // file offset of the batch
+	uint32_t len;            // bytes in the file
+	uint32_t nrec;
+	uint64_t ts_min;         // microseconds, checkpoint: whole capture so far
+	uint64_t ts_max;
+	uint64_t rec_total;      // records in the capture up to here
+	uint32_t flags;          // KIDX_ENT_*
+	uint32_t reserved;
+	uint8_t bloom[KIDX_BLOOM_BITS / 8];
+	uint32_t sum;            // adler32 of the fields above
+} __attribute__ ((packed));
+
+void kidx_hdr_init(struct kidx_hdr_t *h, uint32_t flags);
+int kidx_hdr_check(const struct kidx_hdr_t *h);
+
+void kidx_ent_reset(struct kidx_ent_t *e);
+// account one record, frame is the 802.11 frame or NULL
+void kidx_ent_add(struct kidx_ent_t *e, uint32_t ts_sec, uint32_t ts_usec, const uint8_t *frame, uint32_t len);
+void kidx_ent_seal(struct kidx_ent_t *e);
+int kidx_ent_check(const struct kidx_ent_t *e);
+
+void kidx_bloom_add(uint8_t *bloom, const uint8_t *addr);
+int kidx_bloom_test(const uint8_t *bloom, const uint8_t *addr);
+
+#endif
@@ -1,7 +1,16 @@
 #ifndef KWIFIMON_EXPORT_H_
 #define KWIFIMON_EXPORT_H_
 
+#include "lat.h"
+#include "bpf.h"
+
 #define KWIFIMON_NET_PORT 65111
+#define KWIFIMON_NET_DEST_MAX 4
+#define KWIFIMON_RPCAP_PORT 2002
+
+#define KWIFIMON_CAP_COMPRESS 0x00000001   // write .kcap blocks instead of pcap
+#define KWIFIMON_CAP_INDEX    0x00000002   // write a time/address index next to the capture
+#define KWIFIMON_CAP_RT_TIMESTAMP 0x00000004  // add a radiotap timestamp field, system time in us
 
 struct wifimon_stats_t {
 	uint32_t pkt_cnt;
@@ -9,6 +18,180 @@ struct wifimon_stats_t {
 	uint32_t amsdu_cnt;
 	uint32_t bar_cnt;
 	uint32_t evt_cnt;
+	uint32_t drop_cnt;       // capture ring full
+	uint32_t filt_cnt;       // rejected by the capture filter
+};
+
+// knet stream destination, token bucket per destination
+// management frames may use the whole bucket, others stop at a quarter of it
+struct wifimon_net_dest_t {
+	uint32_t addr;           // ipv4 in network byte order, unicast or multicast group
+	uint16_t port;           // 0 is KWIFIMON_NET_PORT
+	uint8_t ttl;             // multicast ttl, 0 is 1
+	uint8_t reserved;
+	uint32_t rate;           // bytes/s, 0 is unlimited
+	uint32_t burst;          // bucket depth in bytes, 0 is rate/8 but at least 16K
+};
+
+struct wifimon_net_cfg_t {
+	uint32_t num;            // 0 is loopback on KWIFIMON_NET_PORT
+	struct wifimon_net_dest_t dest[KWIFIMON_NET_DEST_MAX];
+};
+
+struct wifimon_net_cnt_t {
+	uint32_t sent_pkts;
+	uint32_t sent_bytes;
+	uint32_t drop_rate;      // over rate limit
+	uint32_t drop_err;       // send failed, socket buffer full
+	uint32_t mgmt_prio;      // management frames sent out of the reserve
+};
+
+struct wifimon_net_stats_t {
+	uint32_t num;
+	struct wifimon_net_cnt_t dest[KWIFIMON_NET_DEST_MAX];
+};
+
+struct wifimon_rpcap_stats_t {
+	uint32_t clients;        // connections accepted
+	uint32_t capturing;      // client has a capture running
+	uint32_t offered;        // frames handed to the server, past the client's filter
+	uint32_t sent;           // frames queued to the client
+	uint32_t sent_bytes;
+	uint32_t filtered;       // rejected by the client's filter in the hook
+	uint32_t sampled;        // skipped by client requested sampling
+	uint32_t thinned;        // skipped because the client is slow
+	uint32_t drop_full;      // send buffer full
+	uint32_t thin;           // current 1 in N thinning
+};
+
+// with sync_ms set records are written out and synced at that interval,
+// a crash loses at most that much, checkpoints go to the index
+struct wifimon_cap_cfg_t {
+	uint32_t flags;          // KWIFIMON_CAP_*
+	uint32_t sync_ms;        // 0 writes every batch, syncs on close only
+};
+
+// file capture, bytes are 64 bit since captures can run for hours
+struct wifimon_cap_stats_t {
+	uint32_t blocks;         // blocks written
+	uint32_t stored_busy;    // stored uncompressed, writer was falling behind
+	uint32_t stored_poor;    // stored uncompressed, data did not compress
+	uint32_t idx_entries;
+	uint64_t raw_bytes;      // pcap records staged
+	uint64_t file_bytes;     // written to the file, headers included
+	uint64_t idx_bytes;      // written to the index
+	uint32_t syncs;
+	uint32_t sync_err;
+	uint32_t sync_us_max;    // longest sync
+	uint32_t reserved;
+};
+
+// live tables kept by the hook, least recently seen entries are evicted
+#define KWIFIMON_LIVE_BSS_MAX 128
+#define KWIFIMON_LIVE_STA_MAX 512
+
+struct wifimon_bss_t {
+	uint8_t bssid[6];
+	uint8_t channel;         // from ds params, 0 if none
+	uint8_t ssid_len;
+	uint32_t ssid_hash;      // fnv1a of the ssid
+	uint16_t beacon_int;     // TU
+	int8_t rssi;             // dBm, last beacon or probe response
+	uint8_t reserved;
+	uint32_t beacons;        // beacons and probe responses
+	uint32_t last_seen;      // system time low, us
+	uint32_t air_us;         // frames with this bssid once it is known, wraps
+};
+
+struct wifimon_sta_t {
+	uint8_t addr[6];
+	uint8_t bssid[6];        // last bssid it sent to, zero if none yet
+	uint32_t frames;
+	uint32_t bytes;
+	int16_t snr_avg;         // ewma, 1/16 dB
+	int16_t nf_avg;          // ewma, 1/16 dBm
+	uint32_t last_seen;
+	uint32_t air_us;         // frames it sent, wraps
+};
+
+struct wifimon_live_t {
+	uint32_t now;            // system time low when the snapshot was taken
+	uint32_t nbss;
+	uint32_t nsta;
+	uint32_t bss_evicted;
+	uint32_t sta_evicted;
+	uint32_t window_us;      // since the previous snapshot
+	uint32_t busy_us;        // airtime in that window, busy / window is the utilization
+	uint32_t air_unknown;    // frames at a rate without a known duration
+	uint64_t air_us;         // every frame received on the channel
+	struct wifimon_bss_t bss[KWIFIMON_LIVE_BSS_MAX];
+	struct wifimon_sta_t sta[KWIFIMON_LIVE_STA_MAX];
+};
+
+// hook latency instrumentation stages
+enum wifimon_lat_stage_t {
+	LAT_STAGE_HOOK = 0,      // whole rx hook, without the original handler
+	LAT_STAGE_CLASSIFY,
+	LAT_STAGE_FILTER,
+	LAT_STAGE_COPY,
+	LAT_STAGE_STATS,
+	LAT_STAGE_IOCTL,         // ioctl hook, without the original handler
+	LAT_STAGE_NUM,
+};
+
+struct wifimon_lat_t {
+	uint32_t enabled;
+	uint32_t unit_ns;        // duration of one histogram tick
+	struct lat_hist_t stage[LAT_STAGE_NUM];
+};
+
+// host commands and their responses, recorded by the send and rx hooks
+// into a ring of fixed size records that overwrites the oldest, each one
+// holds the start of what was sent or received, len is the whole of it
+// costs a few stores per command with the trace on, a test of a flag off
+#define WIFIMON_CMDTRACE_SLOTS  1024     // power of two
+#define WIFIMON_CMDTRACE_DATA   40
+#define WIFIMON_CMDTRACE_READ   64       // records per kwifimon_cmdtrace_read
+#define WIFIMON_CMDTRACE_RESP   0x8000   // id bit of a response
+
+enum wifimon_cmdtrace_kind_t {
+	WIFIMON_CMDTRACE_CMD = 1,    // body as handed to wlan_cmd_send2
+	WIFIMON_CMDTRACE_REPLY,      // host command header and body
+	WIFIMON_CMDTRACE_LOST,       // result records overwritten before they were read
+};
+
+struct wifimon_cmdtrace_rec_t {
+	uint32_t seq;            // from 1, in the order records were taken
+	uint32_t ts;             // system time low, us
+	uint16_t kind;
+	uint16_t id;             // command id, responses with WIFIMON_CMDTRACE_RESP
+	uint16_t len;
+	uint16_t seq_num;        // of the response header, 0 for commands
+	int32_t result;          // of the response header, 0 for commands
+	uint16_t caplen;         // bytes of data
+	uint16_t reserved;
+	uint8_t data[WIFIMON_CMDTRACE_DATA];
+};
+
+// records after cursor, which comes back as the last one returned
+struct wifimon_cmdtrace_t {
+	uint32_t cursor;
+	uint32_t n;
+	uint32_t lost;           // overwritten before this read got to them
+	uint32_t reserved;
+	struct wifimon_cmdtrace_rec_t rec[WIFIMON_CMDTRACE_READ];
+};
+
+// what the app saves, this header then the records as read, a LOST record
+// where some were missed
+#define WIFIMON_CMDTRACE_MAGIC  0x5443574b   // "KWCT"
+
+struct wifimon_cmdtrace_hdr_t {
+	uint32_t magic;
+	uint16_t version;        // 1
+	uint16_t rec_size;       // sizeof(struct wifimon_cmdtrace_rec_t)
+	uint32_t unit_ns;        // of ts
+	uint32_t reserved;
 };
 
 struct iface_counter_t {
@@ -86,13 +269,66 @@ enum wifi_ioctl_t {
 	WLAN_IOCTL_ANYCMD            = 0x5011FF05,
 	WLAN_IOCTL_MEM               = 0x5011FF07,
 	WLAN_IOCTL_INIT              = 0x5011FF08,
+	WLAN_IOCTL_MEM_BULK          = 0x5011FF09, // struct wifimon_mem_bulk_t
+	WLAN_IOCTL_MEM_DELTA         = 0x5011FF0A, // struct wifimon_mem_delta_t
+	WLAN_IOCTL_MEM_PATCH         = 0x5011FF0B, // struct wifimon_mem_patch_t
+};
+
+// WLAN_IOCTL_MEM_BULK, words read one after another under a single
+// wlan_lock, the ioctl returns how many were read before the first failure
+#define WIFIMON_MEM_BULK_MAX 1024
+
+struct wifimon_mem_bulk_t {
+	uint32_t addr;
+	uint32_t words;
+	uint32_t data[];
+};
+
+// WLAN_IOCTL_MEM_DELTA, pages are read and hashed under one wlan_lock, the
+// request is followed by the hashes of the pages as last seen, then room
+// for all of their words, pages whose hash differs come back packed in page
+// order with their bit set in changed, the hashes are updated in place
+// returns how many pages were done before the first failed read
+#define WIFIMON_MEM_DELTA_PAGES 64
+#define WIFIMON_MEM_DELTA_FULL  0x0001     // every page counts as changed
+
+struct wifimon_mem_delta_t {
+	uint32_t addr;
+	uint32_t page_words;
+	uint32_t pages;          // page_words * pages up to WIFIMON_MEM_BULK_MAX
+	uint32_t flags;
+	uint32_t changed[WIFIMON_MEM_DELTA_PAGES / 32];
+};
+
+// WLAN_IOCTL_MEM_PATCH, words written as one transaction under a single
+// wlan_lock: all of them have to hold their expected value before the first
+// write, each write is read back, and after a failure every word written so
+// far gets its expected value back
+// returns words written, -1 bad request, -2 read failed, -3 a word was not
+// as expected and nothing was written, -4 a write did not stick and all was
+// put back, -5 putting back failed too, failed is the entry it stopped at
+#define WIFIMON_MEM_PATCH_MAX 256
+
+struct wifimon_mem_patch_ent_t {
+	uint32_t addr;
+	uint32_t value;
+	uint32_t expect;
+};
+
+struct wifimon_mem_patch_t {
+	uint32_t words;
+	uint32_t failed;
+	uint32_t restored;       // words put back after a failure
+	uint32_t reserved;
+	struct wifimon_mem_patch_ent_t ent[];
 };
 
 enum kwifimon_state_t {
 	STATE_IDLE      = 0,
 	STATE_MONITOR   = 0x00000001,
 	STATE_REC_FILE  = 0x00000002,
-	STATE_REC_NET   = 0x00000003,
+	STATE_REC_NET   = 0x00000004,
+	STATE_REC_RPCAP = 0x00000008,
 
 	STATE_ERROR     = 0x80000001,
 	STATE_ERROR_1   = 0x80000002,
@@ -103,7 +339,20 @@ int kwifimon_mod_state(void);
 int kwifimon_mod_stats(struct wifimon_stats_t *s, int reset);
 int kwifimon_cap_start(char *file);
 int kwifimon_cap_stop(void);
+int kwifimon_cap_config(const struct wifimon_cap_cfg_t *cfg);
+int kwifimon_cap_stats(struct wifimon_cap_stats_t *s, int reset);
 int kwifimon_net_start(void);
 int kwifimon_net_stop(void);
+int kwifimon_net_config(const struct wifimon_net_cfg_t *cfg);
+int kwifimon_net_stats(struct wifimon_net_stats_t *s, int reset);
+int kwifimon_filter_set(const struct bpf_insn_t *prog, uint32_t len);
+int kwifimon_rpcap_start(int port);
+int kwifimon_rpcap_stop(void);
+int kwifimon_rpcap_stats(struct wifimon_rpcap_stats_t *s, int reset);
+int kwifimon_live_snapshot(struct wifimon_live_t *l, int reset);
+int kwifimon_lat_enable(int enable);
+int kwifimon_mod_lat(struct wifimon_lat_t *l, int reset);
+int kwifimon_cmdtrace_enable(int enable);
+int kwifimon_cmdtrace_read(struct wifimon_cmdtrace_t *t);
 
 #endif
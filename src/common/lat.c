@@ -0,0 +1,62 @@
+#include <string.h>
+
+#include "lat.h"
+
+void lat_reset(struct lat_hist_t *h)
+{
+	memset(h, 0, sizeof(struct lat_hist_t));
+}
+
+// upper bound of the bucket holding given permille, clamped to max
+uint32_t lat_pct(const struct lat_hist_t *h, uint32_t permille)
+{
+	uint32_t i;
+	uint64_t want, seen = 0;
+
+	if (h->cnt == 0) {
+		return 0;
+	}
+
+	want = ((uint64_t)h->cnt * permille + 999) / 1000;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		seen += h->bucket[i];
+		if (seen >= want) {
+			break;
+		}
+	}
+
+	if (i == 0) {
+		return 0;
+	}
+
+	if (i >= LAT_BUCKETS - 1) {
+		return h->max;
+	}
+
+	uint32_t upper = (1u << i) - 1;
+
+	return (upper < h->max) ? upper : h->max;
+}
+
+void lat_finish(struct lat_hist_t *h)
+{
+	h->p99 = lat_pct(h, 990);
+}
+
+void lat_merge(struct lat_hist_t *dst, const struct lat_hist_t *src)
+{
+	int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		dst->bucket[i] += src->bucket[i];
+	}
+
+	dst->cnt += src->cnt;
+	dst->sum += src->sum;
+	if (src->max > dst->max) {
+		dst->max = src->max;
+	}
+
+	lat_finish(dst);
+}
@@ -0,0 +1,40 @@
+#ifndef LAT_h_
+#define LAT_h_
+
+#include <stdint.h>
+
+// log2 latency histogram, shared by the kernel plugin and host tools
+// bucket 0 counts zero samples, bucket n counts samples in [2^(n-1), 2^n)
+// last bucket takes everything above
+#define LAT_BUCKETS 32
+
+struct lat_hist_t {
+	uint32_t cnt;
+	uint32_t max;
+	uint32_t p99;            // filled by lat_finish()
+	uint32_t bucket[LAT_BUCKETS];
+	uint64_t sum;
+} __attribute__ ((packed));
+
+static inline void lat_add(struct lat_hist_t *h, uint32_t v)
+{
+	uint32_t b = v ? 32 - __builtin_clz(v) : 0;
+
+	if (b >= LAT_BUCKETS) {
+		b = LAT_BUCKETS - 1;
+	}
+
+	h->bucket[b]++;
+	h->cnt++;
+	h->sum += v;
+	if (v > h->max) {
+		h->max = v;
+	}
+}
+
+void lat_reset(struct lat_hist_t *h);
+uint32_t lat_pct(const struct lat_hist_t *h, uint32_t permille);
+void lat_finish(struct lat_hist_t *h);
+void lat_merge(struct lat_hist_t *dst, const struct lat_hist_t *src);
+
+#endif
@@ -0,0 +1,196 @@
+#include <string.h>
+
+#include "lz4blk.h"
+
+#define MINMATCH   4
+#define LASTLIT    5      // last bytes are always literals
+#define MFLIMIT    12     // no match may start closer to the end
+#define SKIP_LOG   6      // search speeds up over incompressible data
+
+static inline uint32_t rd32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, 4);
+
+	return v;
+}
+
+static inline uint32_t hash4(const uint8_t *p)
+{
+	return (rd32(p) * 2654435761u) >> (32 - LZ4BLK_HASH_LOG);
+}
+
+static inline uint8_t *put_len(uint8_t *op, uint32_t n)
+{
+	while (n >= 255) {
+		*op++ = 255;
+		n -= 255;
+	}
+	*op++ = n;
+
+	return op;
+}
+
+int lz4blk_compress(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t cap, uint16_t *tab)
+{
+	const uint8_t *ip = src, *anchor = src;
+	const uint8_t *end = src + len;
+	const uint8_t *mflimit = end - MFLIMIT;
+	const uint8_t *matchlimit = end - LASTLIT;
+	uint8_t *op = dst, *oend = dst + cap;
+	uint32_t lit;
+
+	if (len > LZ4BLK_MAX) {
+		return -1;
+	}
+
+	if (len > MFLIMIT) {
+		uint32_t miss = 0;
+
+		memset(tab, 0, LZ4BLK_HASH_SIZE * sizeof(uint16_t));
+		ip++;
+
+		while (ip < mflimit) {
+			uint32_t h = hash4(ip);
+			const uint8_t *ref = src + tab[h];
+
+			tab[h] = ip - src;
+
+			if (ref >= ip || rd32(ref) != rd32(ip)) {
+				ip += 1 + (miss++ >> SKIP_LOG);
+				continue;
+			}
+			miss = 0;
+
+			// extend backwards into pending literals, then forwards
+			while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+				ip--;
+				ref--;
+			}
+
+			const uint8_t *mp = ip + MINMATCH, *rp = ref + MINMATCH;
+			while (mp < matchlimit && *mp == *rp) {
+				mp++;
+				rp++;
+			}
+
+			uint32_t ml = mp - ip - MINMATCH;
+			uint16_t off = ip - ref;
+
+			lit = ip - anchor;
+			if (op + 1 + lit / 255 + 1 + lit + 2 + ml / 255 + 1 > oend) {
+				return -1;
+			}
+
+			uint8_t *token = op++;
+			*token = ((lit < 15) ? lit : 15) << 4;
+			if (lit >= 15) {
+				op = put_len(op, lit - 15);
+			}
+			memcpy(op, anchor, lit);
+			op += lit;
+
+			*op++ = off & 0xff;
+			*op++ = off >> 8;
+
+			*token |= (ml < 15) ? ml : 15;
+			if (ml >= 15) {
+				op = put_len(op, ml - 15);
+			}
+
+			ip = mp;
+			anchor = ip;
+
+			if (ip < mflimit) {
+				tab[hash4(ip - 2)] = ip - 2 - src;
+			}
+		}
+	}
+
+	lit = end - anchor;
+	if (op + 1 + lit / 255 + 1 + lit > oend) {
+		return -1;
+	}
+
+	*op++ = ((lit < 15) ? lit : 15) << 4;
+	if (lit >= 15) {
+		op = put_len(op, lit - 15);
+	}
+	memcpy(op, anchor, lit);
+	op += lit;
+
+	return op - dst;
+}
+
+int lz4blk_decompress(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t cap)
+{
+	const uint8_t *ip = src, *iend = src + len;
+	uint8_t *op = dst, *oend = dst + cap;
+
+	while (ip < iend) {
+		uint32_t token = *ip++;
+		uint32_t lit = token >> 4, ml, off, b;
+
+		if (lit == 15) {
+			do {
+				if (ip >= iend) {
+					return -1;
+				}
+				b = *ip++;
+				lit += b;
+			} while (b == 255);
+		}
+
+		if (lit > (uint32_t)(iend - ip) || lit > (uint32_t)(oend - op)) {
+			return -1;
+		}
+		memcpy(op, ip, lit);
+		op += lit;
+		ip += lit;
+
+		// last sequence has no match
+		if (ip == iend) {
+			break;
+		}
+
+		if (iend - ip < 2) {
+			return -1;
+		}
+		off = ip[0] | (ip[1] << 8);
+		ip += 2;
+
+		if (off == 0 || off > (uint32_t)(op - dst)) {
+			return -1;
+		}
+
+		ml = token & 15;
+		if (ml == 15) {
+			do {
+				if (ip >= iend) {
+					return -1;
+				}
+				b = *ip++;
+				ml += b;
+			} while (b == 255);
+		}
+		ml += MINMATCH;
+
+		if (ml > (uint32_t)(oend - op)) {
+			return -1;
+		}
+
+		const uint8_t *ref = op - off;
+		if (off >= ml) {
+			memcpy(op, ref, ml);
+			op += ml;
+		} else {
+			// overlapping, runs repeat the last off bytes
+			while (ml--) {
+				*op++ = *ref++;
+			}
+		}
+	}
+
+	return op - dst;
+}
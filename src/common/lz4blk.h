@@ -0,0 +1,20 @@
+#ifndef LZ4BLK_h_
+#define LZ4BLK_h_
+
+#include <stdint.h>
+
+// lz4 block format codec, single blocks up to 64K, no frame format
+// compressor is the plain greedy one, fast enough for the writer thread
+
+#define LZ4BLK_MAX        65536
+#define LZ4BLK_HASH_LOG   12
+#define LZ4BLK_HASH_SIZE  (1 << LZ4BLK_HASH_LOG)
+#define LZ4BLK_BOUND(n)   ((n) + (n) / 255 + 16)
+
+// tab is scratch of LZ4BLK_HASH_SIZE entries, returns compressed length or -1
+int lz4blk_compress(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t cap, uint16_t *tab);
+
+// returns decompressed length or -1 on malformed input
+int lz4blk_decompress(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t cap);
+
+#endif
@@ -0,0 +1,412 @@
+#include <string.h>
+
+#include "rtap.h"
+
+#define BIT_RADIOTAP_NS (1u << IEEE80211_RADIOTAP_RADIOTAP_NAMESPACE)
+#define BIT_VENDOR_NS   (1u << IEEE80211_RADIOTAP_VENDOR_NAMESPACE)
+#define BIT_EXT         (1u << IEEE80211_RADIOTAP_EXT)
+
+#define VENDOR_HDR_LEN  6          // oui, sub namespace, skip length
+
+const struct rtap_field_t rtap_fields[32] = {
+	[IEEE80211_RADIOTAP_TSFT] = { 8, 8 },
+	[IEEE80211_RADIOTAP_FLAGS] = { 1, 1 },
+	[IEEE80211_RADIOTAP_RATE] = { 1, 1 },
+	[IEEE80211_RADIOTAP_CHANNEL] = { 2, 4 },
+	[IEEE80211_RADIOTAP_FHSS] = { 1, 2 },
+	[IEEE80211_RADIOTAP_DBM_ANTSIGNAL] = { 1, 1 },
+	[IEEE80211_RADIOTAP_DBM_ANTNOISE] = { 1, 1 },
+	[IEEE80211_RADIOTAP_LOCK_QUALITY] = { 2, 2 },
+	[IEEE80211_RADIOTAP_TX_ATTENUATION] = { 2, 2 },
+	[IEEE80211_RADIOTAP_DB_TX_ATTENUATION] = { 2, 2 },
+	[IEEE80211_RADIOTAP_DBM_TX_POWER] = { 1, 1 },
+	[IEEE80211_RADIOTAP_ANTENNA] = { 1, 1 },
+	[IEEE80211_RADIOTAP_DB_ANTSIGNAL] = { 1, 1 },
+	[IEEE80211_RADIOTAP_DB_ANTNOISE] = { 1, 1 },
+	[IEEE80211_RADIOTAP_RX_FLAGS] = { 2, 2 },
+	[IEEE80211_RADIOTAP_TX_FLAGS] = { 2, 2 },
+	[IEEE80211_RADIOTAP_RTS_RETRIES] = { 1, 1 },
+	[IEEE80211_RADIOTAP_DATA_RETRIES] = { 1, 1 },
+	[18] = { 4, 8 },                                   // xchannel
+	[IEEE80211_RADIOTAP_MCS] = { 1, 3 },
+	[IEEE80211_RADIOTAP_AMPDU_STATUS] = { 4, 8 },
+	[IEEE80211_RADIOTAP_VHT] = { 2, 12 },
+	[IEEE80211_RADIOTAP_TIMESTAMP] = { 8, 12 },
+	[IEEE80211_RADIOTAP_HE] = { 2, 12 },
+	[IEEE80211_RADIOTAP_HE_MU] = { 2, 12 },
+	[25] = { 2, 6 },                                   // he-mu other user
+	[26] = { 1, 1 },                                   // 0 length psdu
+	[27] = { 2, 4 },                                   // l-sig
+	// 28 is the tlv list, it ends the fixed fields
+};
+
+static inline uint32_t rd16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t rd32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint32_t align_up(uint32_t pos, uint32_t a)
+{
+	return (pos + a - 1) & ~(a - 1);
+}
+
+void rtap_cache_init(struct rtap_cache_t *c)
+{
+	memset(c, 0, sizeof(*c));
+}
+
+// offsets for the present words, vendor data lengths come from the header
+// when there is one, from vskip otherwise
+static int rtap_build(struct rtap_layout_t *l, const uint32_t *present, uint32_t nwords,
+	const uint8_t *hdr, uint32_t len, const uint16_t *vskip)
+{
+	uint32_t pos = sizeof(struct ieee80211_radiotap_header) + 4 * (nwords - 1);
+	uint32_t ns = RTAP_NS_RADIOTAP, seg = 0, skip = 0, partial = 0;
+	uint32_t w;
+
+	memset(l, 0, sizeof(*l));
+	memcpy(l->present, present, nwords * 4);
+	l->nwords = nwords;
+
+	for (w = 0; w < nwords; w++) {
+		uint32_t bits = present[w];
+
+		if ((bits & BIT_RADIOTAP_NS) && (bits & BIT_VENDOR_NS)) {
+			return -1;
+		}
+
+		l->word_ns[w] = ns;
+
+		if (ns == RTAP_NS_VENDOR) {
+			// fields of a vendor namespace are stepped over as a whole
+			if (seg == 0 && !partial) {
+				l->voff[w] = pos;
+				l->vskip[w] = skip;
+				l->flags |= RTAP_LAYOUT_VENDOR;
+				pos += skip;
+			}
+		} else if (!partial) {
+			uint32_t b, m = bits & 0x1fffffff;
+
+			while (m) {
+				b = __builtin_ctz(m);
+				m &= m - 1;
+
+				// nothing is defined past the first word of a namespace
+				if (seg || rtap_fields[b].size == 0) {
+					partial = 1;
+					break;
+				}
+
+				pos = align_up(pos, rtap_fields[b].align);
+				l->off[w * 32 + b] = pos;
+				pos += rtap_fields[b].size;
+			}
+		}
+
+		if (bits & BIT_VENDOR_NS) {
+			if (!partial) {
+				pos = align_up(pos, 2);
+				l->off[w * 32 + IEEE80211_RADIOTAP_VENDOR_NAMESPACE] = pos;
+				skip = 0;
+				if (hdr) {
+					if (pos + VENDOR_HDR_LEN > len) {
+						return -1;
+					}
+					skip = rd16(hdr + pos + 4);
+				} else if (vskip && w + 1 < nwords) {
+					skip = vskip[w + 1];
+				}
+				pos += VENDOR_HDR_LEN;
+			}
+			ns = RTAP_NS_VENDOR;
+			seg = 0;
+		} else if (bits & BIT_RADIOTAP_NS) {
+			ns = RTAP_NS_RADIOTAP;
+			seg = 0;
+		} else {
+			seg++;
+		}
+
+		if (hdr && pos > len) {
+			return -1;
+		}
+	}
+
+	l->end = pos;
+	if (partial) {
+		l->flags |= RTAP_LAYOUT_PARTIAL;
+	}
+
+	return 0;
+}
+
+// present words of the header, the count or -1
+static int rtap_words(const uint8_t *hdr, uint32_t len, uint32_t *present, uint32_t *it_len)
+{
+	uint32_t n = 0, pos = 4;
+
+	if (len < sizeof(struct ieee80211_radiotap_header) || hdr[0] != PKTHDR_RADIOTAP_VERSION) {
+		return -1;
+	}
+
+	*it_len = rd16(hdr + 2);
+	if (*it_len > len || *it_len < sizeof(struct ieee80211_radiotap_header)) {
+		return -1;
+	}
+
+	do {
+		if (n == RTAP_MAX_WORDS || pos + 4 > *it_len) {
+			return -1;
+		}
+		present[n] = rd32(hdr + pos);
+		pos += 4;
+	} while (present[n++] & BIT_EXT);
+
+	return n;
+}
+
+int rtap_layout(struct rtap_layout_t *l, const uint8_t *hdr, uint32_t len)
+{
+	uint32_t present[RTAP_MAX_WORDS], it_len;
+	int n;
+
+	n = rtap_words(hdr, len, present, &it_len);
+	if (n < 0) {
+		return -1;
+	}
+
+	return rtap_build(l, present, n, hdr, it_len, NULL);
+}
+
+static inline uint32_t rtap_hash(const uint32_t *present, uint32_t n)
+{
+	uint32_t h = n;
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		h = (h ^ present[i]) * 0x9e3779b1;
+	}
+
+	return (h >> 24) & (RTAP_CACHE_SIZE - 1);
+}
+
+static inline int rtap_match(const struct rtap_layout_t *l, const uint32_t *present, uint32_t n)
+{
+	uint32_t i;
+
+	if (l->nwords != n) {
+		return 0;
+	}
+	for (i = 0; i < n; i++) {
+		if (l->present[i] != present[i]) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+// fields are a few bytes, cheaper than memcpy calls of variable size
+static inline void copy_bytes(uint8_t *d, const uint8_t *s, uint32_t n)
+{
+	while (n--) {
+		*d++ = *s++;
+	}
+}
+
+const struct rtap_layout_t *rtap_parse(struct rtap_cache_t *c, const uint8_t *hdr, uint32_t len)
+{
+	uint32_t present[RTAP_MAX_WORDS], it_len;
+	struct rtap_layout_t *l;
+	int n;
+
+	n = rtap_words(hdr, len, present, &it_len);
+	if (n < 0) {
+		return NULL;
+	}
+
+	l = &c->ent[rtap_hash(present, n)];
+	if (rtap_match(l, present, n)) {
+		c->hits++;
+		return (l->end <= it_len) ? l : NULL;
+	}
+
+	c->misses++;
+
+	// vendor data lengths are in the header bytes, such layouts are not kept
+	if (rtap_build(&c->scratch[0], present, n, hdr, it_len, NULL) < 0) {
+		return NULL;
+	}
+	if (c->scratch[0].flags & RTAP_LAYOUT_VENDOR) {
+		return &c->scratch[0];
+	}
+
+	*l = c->scratch[0];
+
+	return l;
+}
+
+int rtap_set(const struct rtap_layout_t *l, uint8_t *hdr, uint32_t field, const void *val)
+{
+	if (field >= IEEE80211_RADIOTAP_RADIOTAP_NAMESPACE || l->off[field] == 0) {
+		return -1;
+	}
+
+	memcpy(hdr + l->off[field], val, rtap_fields[field].size);
+
+	return 0;
+}
+
+int rtap_add(struct rtap_cache_t *c, const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t cap,
+	uint32_t field, const void *val)
+{
+	const struct rtap_layout_t *sl, *dl;
+	uint32_t present[RTAP_MAX_WORDS];
+	uint32_t w, n, b, m;
+
+	if (field >= IEEE80211_RADIOTAP_RADIOTAP_NAMESPACE || rtap_fields[field].size == 0) {
+		return -1;
+	}
+
+	sl = rtap_parse(c, src, src_len);
+	if (sl == NULL || (sl->flags & RTAP_LAYOUT_PARTIAL)) {
+		return -1;
+	}
+
+	// already there, only the value changes
+	if (sl->off[field]) {
+		n = rd16(src + 2);
+		if (n > cap) {
+			return -1;
+		}
+		memmove(dst, src, n);
+		return rtap_set(sl, dst, field, val) < 0 ? -1 : (int)n;
+	}
+
+	n = sl->nwords;
+	memcpy(present, sl->present, n * 4);
+	present[0] |= 1u << field;
+
+	if (sl->flags & RTAP_LAYOUT_VENDOR) {
+		// word indices stay, so do the vendor lengths
+		if (rtap_build(&c->scratch[1], present, n, NULL, 0, sl->vskip) < 0) {
+			return -1;
+		}
+		dl = &c->scratch[1];
+	} else {
+		struct rtap_layout_t *e = &c->ent[rtap_hash(present, n)];
+
+		if (rtap_match(e, present, n)) {
+			c->hits++;
+		} else {
+			c->misses++;
+			// both shapes hash to the same slot, keep the source aside
+			if (e == sl) {
+				c->scratch[0] = *sl;
+				sl = &c->scratch[0];
+			}
+			if (rtap_build(e, present, n, NULL, 0, NULL) < 0) {
+				e->nwords = 0;
+				return -1;
+			}
+		}
+		dl = e;
+	}
+
+	if (dl->end > cap || dl->end > 0xffff) {
+		return -1;
+	}
+
+	// padding between fields is zero, trailing bytes of the source are dropped
+	dst[0] = PKTHDR_RADIOTAP_VERSION;
+	dst[1] = 0;
+	dst[2] = dl->end;
+	dst[3] = dl->end >> 8;
+	for (w = 0; w < n; w++) {
+		memcpy(dst + 4 + w * 4, &present[w], 4);
+	}
+	for (w = 4 + n * 4; w < dl->end; w++) {
+		dst[w] = 0;
+	}
+
+	for (w = 0; w < n; w++) {
+		if (sl->voff[w]) {
+			copy_bytes(dst + dl->voff[w], src + sl->voff[w], sl->vskip[w]);
+		}
+
+		m = sl->present[w] & (0x1fffffff | BIT_VENDOR_NS);
+		while (m) {
+			b = __builtin_ctz(m);
+			m &= m - 1;
+
+			uint32_t i = w * 32 + b;
+			if (sl->off[i]) {
+				uint32_t size = (b == IEEE80211_RADIOTAP_VENDOR_NAMESPACE) ? VENDOR_HDR_LEN : rtap_fields[b].size;
+				copy_bytes(dst + dl->off[i], src + sl->off[i], size);
+			}
+		}
+	}
+
+	copy_bytes(dst + dl->off[field], val, rtap_fields[field].size);
+
+	return dl->end;
+}
+
+void rtap_iter_init(struct rtap_iter_t *it, const struct rtap_layout_t *l, const uint8_t *hdr)
+{
+	it->l = l;
+	it->hdr = hdr;
+	it->idx = 0;
+	it->seg = 0;
+}
+
+int rtap_iter_next(struct rtap_iter_t *it, struct rtap_item_t *item)
+{
+	const struct rtap_layout_t *l = it->l;
+
+	while (it->idx < l->nwords * 32u) {
+		uint32_t w = it->idx >> 5, b = it->idx & 31;
+
+		// vendor data sits ahead of whatever the word after it announces,
+		// it gets the slot of bit 31 of the word that announced it
+		if (b == 31) {
+			it->idx++;
+			if (w + 1 < l->nwords && l->voff[w + 1]) {
+				item->ns = RTAP_NS_VENDOR;
+				item->vendor = 1;
+				item->field = 0;
+				item->off = l->voff[w + 1];
+				item->size = l->vskip[w + 1];
+				item->p = it->hdr + item->off;
+				return 1;
+			}
+			continue;
+		}
+
+		if (b == 0 && w > 0 && (l->present[w - 1] & (BIT_RADIOTAP_NS | BIT_VENDOR_NS))) {
+			it->seg = w;
+		}
+
+		it->idx++;
+
+		if (!(l->present[w] & (1u << b)) || l->off[w * 32 + b] == 0) {
+			continue;
+		}
+
+		item->ns = l->word_ns[w];
+		item->vendor = 0;
+		item->field = (w - it->seg) * 32 + b;
+		item->off = l->off[w * 32 + b];
+		item->size = (b == IEEE80211_RADIOTAP_VENDOR_NAMESPACE) ? VENDOR_HDR_LEN : rtap_fields[b].size;
+		item->p = it->hdr + item->off;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,97 @@
+#ifndef RTAP_h_
+#define RTAP_h_
+
+#include <stdint.h>
+
+#include "ieee80211_radiotap.h"
+
+// radiotap headers with any present bitmaps: extended words, radiotap and
+// vendor namespaces, field alignment relative to the header start
+// a layout has the offset of every field for one sequence of present words,
+// layouts are cached by those words so a header of a known shape costs a
+// hash and a compare, fields are then read and written at fixed offsets
+
+#define RTAP_MAX_WORDS   8
+#define RTAP_MAX_FIELDS  (RTAP_MAX_WORDS * 32)
+#define RTAP_CACHE_SIZE  16        // power of two
+
+#define RTAP_NS_RADIOTAP 0
+#define RTAP_NS_VENDOR   1
+
+#define RTAP_LAYOUT_VENDOR  0x01   // has vendor data, depends on the header bytes and is not cached
+#define RTAP_LAYOUT_PARTIAL 0x02   // stopped at a field of unknown size, the ones after are not located
+
+// in the default namespace, size 0 is a field that can not be stepped over
+struct rtap_field_t {
+	uint8_t align;
+	uint8_t size;
+};
+
+extern const struct rtap_field_t rtap_fields[32];
+
+struct rtap_layout_t {
+	uint32_t present[RTAP_MAX_WORDS];
+	uint8_t nwords;
+	uint8_t flags;           // RTAP_LAYOUT_*
+	uint16_t end;            // past the last located field
+	uint8_t word_ns[RTAP_MAX_WORDS];
+	uint16_t voff[RTAP_MAX_WORDS];    // vendor data, for words that start a vendor namespace
+	uint16_t vskip[RTAP_MAX_WORDS];
+	uint16_t off[RTAP_MAX_FIELDS];    // by word * 32 + bit from the header start, 0 when not there
+};
+
+struct rtap_cache_t {
+	struct rtap_layout_t ent[RTAP_CACHE_SIZE];
+	struct rtap_layout_t scratch[2];  // headers with vendor data
+	uint32_t hits;
+	uint32_t misses;
+};
+
+struct rtap_iter_t {
+	const struct rtap_layout_t *l;
+	const uint8_t *hdr;
+	uint32_t idx;
+	uint32_t seg;            // word index where the current namespace started
+};
+
+// a field as the iterator returns it, vendor data comes as one field
+struct rtap_item_t {
+	uint8_t ns;
+	uint8_t vendor;          // vendor data of the namespace announced by the word before
+	uint16_t field;          // number within its namespace, words continue it by 32
+	uint16_t off;
+	uint16_t size;
+	const uint8_t *p;
+};
+
+void rtap_cache_init(struct rtap_cache_t *c);
+
+// layout of the header in hdr, len is what is readable there
+// returns 0, or -1 for a malformed header
+int rtap_layout(struct rtap_layout_t *l, const uint8_t *hdr, uint32_t len);
+
+// layout from the cache, NULL for a malformed header
+// for a header with vendor data it is only good until the next call
+const struct rtap_layout_t *rtap_parse(struct rtap_cache_t *c, const uint8_t *hdr, uint32_t len);
+
+// field of the first radiotap namespace, NULL when not present
+static inline const uint8_t *rtap_get(const struct rtap_layout_t *l, const uint8_t *hdr, uint32_t field)
+{
+	return l->off[field] ? hdr + l->off[field] : NULL;
+}
+
+// overwrite a present field in place, -1 when it is not there
+int rtap_set(const struct rtap_layout_t *l, uint8_t *hdr, uint32_t field, const void *val);
+
+// copy of src with a default namespace field set, added to the first word
+// when missing, fields behind it are moved along their alignment
+// returns the new header length, -1 when it does not fit or src has fields
+// that can not be located
+int rtap_add(struct rtap_cache_t *c, const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t cap,
+	uint32_t field, const void *val);
+
+void rtap_iter_init(struct rtap_iter_t *it, const struct rtap_layout_t *l, const uint8_t *hdr);
+// returns 0 at the end
+int rtap_iter_next(struct rtap_iter_t *it, struct rtap_item_t *item);
+
+#endif
@@ -0,0 +1,248 @@
+#include <string.h>
+
+#include "sigscan.h"
+
+void sigscan_init(struct sigscan_t *s, uint32_t align)
+{
+	memset(s->cls, 0, sizeof(s->cls));
+	memset(s->pair, 0, sizeof(s->pair));
+	memset(s->next, 0, SIGSCAN_CLASSES_MAX);
+	s->stride = SIGSCAN_CLASSES_MAX;
+	s->align = align ? align : 1;
+	s->npat = 0;
+	s->nstate = 1;
+	s->nclass = 1;
+	s->built = 0;
+	s->out[0] = -1;
+	s->depth[0] = 0;
+}
+
+static int hex(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static int parse(struct sigscan_pat_t *p, const char *str)
+{
+	p->len = 0;
+
+	while (*str) {
+		if (*str == ' ') {
+			str++;
+			continue;
+		}
+		if (p->len == SIGSCAN_BYTES_MAX || str[1] == 0) {
+			return -1;
+		}
+		if (str[0] == '?' && str[1] == '?') {
+			p->byte[p->len] = 0;
+			p->mask[p->len] = 0;
+		} else {
+			int hi = hex(str[0]), lo = hex(str[1]);
+			if (hi < 0 || lo < 0) {
+				return -1;
+			}
+			p->byte[p->len] = (hi << 4) | lo;
+			p->mask[p->len] = 0xff;
+		}
+		p->len++;
+		str += 2;
+	}
+
+	return p->len ? 0 : -1;
+}
+
+int sigscan_add(struct sigscan_t *s, const char *pattern)
+{
+	struct sigscan_pat_t *p;
+	uint32_t i, run = 0, best = 0, end = 0, state, need = 0;
+
+	if (s->npat == SIGSCAN_PATTERNS_MAX || s->built) {
+		return -2;
+	}
+	p = &s->pat[s->npat];
+	if (parse(p, pattern) < 0) {
+		return -1;
+	}
+
+	// longest run of exact bytes, its tail if it is too long
+	for (i = 0; i < p->len; i++) {
+		run = p->mask[i] ? run + 1 : 0;
+		if (run > best) {
+			best = run;
+			end = i + 1;
+		}
+	}
+	if (best < SIGSCAN_ANCHOR_MIN) {
+		return -1;
+	}
+	if (best > SIGSCAN_ANCHOR_MAX) {
+		best = SIGSCAN_ANCHOR_MAX;
+	}
+
+	// room for the new classes and states before anything changes
+	uint8_t fresh[256] = { 0 };
+	uint32_t nclass = s->nclass;
+	for (i = end - best; i < end; i++) {
+		if (s->cls[p->byte[i]] == 0 && !fresh[p->byte[i]]) {
+			fresh[p->byte[i]] = 1;
+			nclass++;
+		}
+	}
+	if (nclass > SIGSCAN_CLASSES_MAX) {
+		return -2;
+	}
+	state = 0;
+	for (i = end - best; i < end; i++) {
+		uint8_t c = s->cls[p->byte[i]];
+		if (need == 0 && c && s->next[state * s->stride + c]) {
+			state = s->next[state * s->stride + c];
+		} else {
+			need++;
+		}
+	}
+	if (s->nstate + need > SIGSCAN_STATES_MAX) {
+		return -2;
+	}
+
+	for (i = end - best; i < end; i++) {
+		if (s->cls[p->byte[i]] == 0) {
+			s->cls[p->byte[i]] = s->nclass++;
+		}
+	}
+
+	// into the trie, 0 is no edge while it is one
+	i = p->byte[end - best] | (p->byte[end - best + 1] << 8);
+	s->pair[i >> 3] |= 1 << (i & 7);
+
+	state = 0;
+	for (i = end - best; i < end; i++) {
+		uint8_t *e = &s->next[state * s->stride + s->cls[p->byte[i]]];
+		if (*e == 0) {
+			uint32_t n = s->nstate++;
+			memset(&s->next[n * s->stride], 0, s->stride);
+			s->out[n] = -1;
+			s->depth[n] = s->depth[state] + 1;
+			*e = n;
+		}
+		state = *e;
+	}
+
+	p->anchor = end;
+	p->hits = 0;
+	p->at = 0;
+	p->next = s->out[state];
+	s->out[state] = s->npat;
+
+	return s->npat++;
+}
+
+void sigscan_build(struct sigscan_t *s)
+{
+	uint8_t queue[SIGSCAN_STATES_MAX];
+	uint32_t head = 0, tail = 0, c, n = s->nclass, i;
+	uint8_t *next = s->next;
+
+	if (s->built) {
+		return;
+	}
+
+	// rows as wide as the classes there are, the table the scan walks
+	// stays small enough for the cache
+	for (i = 1; i < s->nstate; i++) {
+		memmove(&next[i * n], &next[i * SIGSCAN_CLASSES_MAX], n);
+	}
+	s->stride = n;
+
+	// breadth first, the fail of a state is settled before its children
+	// need it, missing edges become the edge of the fail state
+	s->fail[0] = 0;
+	s->dict[0] = 0;
+	for (c = 0; c < n; c++) {
+		uint8_t t = next[c];
+		if (t) {
+			s->fail[t] = 0;
+			s->dict[t] = 0;
+			queue[tail++] = t;
+		}
+	}
+	while (head < tail) {
+		uint8_t u = queue[head++];
+		for (c = 0; c < n; c++) {
+			uint8_t t = next[u * n + c];
+			if (t) {
+				uint8_t f = next[s->fail[u] * n + c];
+				s->fail[t] = f;
+				s->dict[t] = (s->out[f] >= 0) ? f : s->dict[f];
+				queue[tail++] = t;
+			} else {
+				next[u * n + c] = next[s->fail[u] * n + c];
+			}
+		}
+	}
+
+	s->built = 1;
+}
+
+static void check(struct sigscan_t *s, int i, const uint8_t *text, uint32_t len, uint32_t pos)
+{
+	for (; i >= 0; i = s->pat[i].next) {
+		struct sigscan_pat_t *p = &s->pat[i];
+		uint32_t start, k;
+
+		if (pos < p->anchor) {
+			continue;
+		}
+		start = pos - p->anchor;
+		if (start % s->align || p->len > len - start) {
+			continue;
+		}
+		for (k = 0; k < p->len; k++) {
+			if ((text[start + k] ^ p->byte[k]) & p->mask[k]) {
+				break;
+			}
+		}
+		if (k == p->len) {
+			if (p->hits++ == 0) {
+				p->at = start;
+			}
+		}
+	}
+}
+
+#define PAIR(s, a, b) ((s)->pair[((a) | ((b) << 8)) >> 3] & (1 << ((a) & 7)))
+
+void sigscan_run(struct sigscan_t *s, const uint8_t *text, uint32_t len)
+{
+	uint32_t i, j, state = 0, n;
+
+	sigscan_build(s);
+	n = s->stride;
+
+	for (i = 0; i < len; i++) {
+		// no match under way, or only one at the last byte that the next
+		// does not go on with, the next anchor starts here or further on
+		if (s->depth[state] <= 1 && !(state && PAIR(s, text[i - 1], text[i]))) {
+			j = i;
+			while (j + 1 < len && !PAIR(s, text[j], text[j + 1])) {
+				j++;
+			}
+			if (j + 1 >= len) {
+				break;
+			}
+			i = j;
+			state = 0;
+		}
+		state = s->next[state * n + s->cls[text[i]]];
+		if (__builtin_expect(s->out[state] < 0 && s->dict[state] == 0, 1)) {
+			continue;
+		}
+		uint32_t t = (s->out[state] >= 0) ? state : s->dict[state];
+		for (; t; t = s->dict[t]) {
+			check(s, s->out[t], text, len, i + 1);
+		}
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef SIGSCAN_h_
+#define SIGSCAN_h_
+
+#include <stdint.h>
+
+// byte signatures matched over module text in one pass
+// a signature is hex bytes with "??" for the ones that change between
+// builds, "2d e9 f0 41 ?? 4b", the longest run without wildcards is its
+// anchor, all anchors go into one aho-corasick automaton over the byte
+// values they have, every anchor hit is checked against the whole signature
+// where no match is under way the scan skips to the next two bytes some
+// anchor starts with, most of the text is passed over without the automaton
+// fixed size tables, no allocation, the kernel plugin runs it as is
+
+#define SIGSCAN_PATTERNS_MAX 32
+#define SIGSCAN_BYTES_MAX    64
+#define SIGSCAN_ANCHOR_MIN   4
+#define SIGSCAN_ANCHOR_MAX   16
+#define SIGSCAN_STATES_MAX   256        // anchor bytes of all patterns, plus one
+#define SIGSCAN_CLASSES_MAX  256        // distinct anchor bytes, plus one
+
+struct sigscan_pat_t {
+	uint8_t byte[SIGSCAN_BYTES_MAX];
+	uint8_t mask[SIGSCAN_BYTES_MAX];  // 0xff where byte counts
+	uint32_t len;
+	uint32_t anchor;                  // end of the anchor in the pattern
+	uint32_t hits;
+	uint32_t at;                      // first hit
+	int32_t next;                     // next pattern with the same anchor end state
+};
+
+struct sigscan_t {
+	uint32_t align;                   // hits start on multiples of it
+	uint32_t npat;
+	uint32_t nstate;
+	uint32_t nclass;
+	uint32_t built;
+	uint32_t stride;                  // of next, nclass once built
+	uint8_t cls[256];                 // 0 for bytes no anchor has
+	uint8_t next[SIGSCAN_STATES_MAX * SIGSCAN_CLASSES_MAX];
+	uint8_t fail[SIGSCAN_STATES_MAX];
+	uint8_t dict[SIGSCAN_STATES_MAX];   // nearest state on the fail chain with patterns, 0 if none
+	uint8_t depth[SIGSCAN_STATES_MAX];
+	uint8_t pair[65536 / 8];            // first two bytes of the anchors
+	int16_t out[SIGSCAN_STATES_MAX];    // first pattern ending here, -1 if none
+	struct sigscan_pat_t pat[SIGSCAN_PATTERNS_MAX];
+};
+
+void sigscan_init(struct sigscan_t *s, uint32_t align);
+// returns the pattern index, -1 if it does not parse or has no anchor
+// of SIGSCAN_ANCHOR_MIN bytes, -2 if a table is full
+int sigscan_add(struct sigscan_t *s, const char *pattern);
+// call once after the last add, run builds it if not, adds fail after it
+void sigscan_build(struct sigscan_t *s);
+// counts the hits of every pattern over text, hits add up over calls
+void sigscan_run(struct sigscan_t *s, const uint8_t *text, uint32_t len);
+
+// offset of the only hit of a pattern, -1 if none, -2 if more
+static inline int32_t sigscan_found(const struct sigscan_t *s, int i)
+{
+	if (s->pat[i].hits == 0) {
+		return -1;
+	}
+
+	return (s->pat[i].hits == 1) ? (int32_t)s->pat[i].at : -2;
+}
+
+// fnv1a of a string, what caches of resolved patterns are keyed by
+static inline uint32_t sigscan_hash(uint32_t h, const char *str)
+{
+	while (str && *str) {
+		h = (h ^ (uint8_t)*str++) * 16777619;
+	}
+
+	return h;
+}
+
+#endif
@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "airtime.h"
+#include "m.h"
+#include "test.h"
+
+// conformance check for the airtime tables: durations worked out by hand
+// from the 802.11 txtime formulas, every rate against a plain computation
+// with divisions, rxpd rates against the driver's rate table, and a-mpdu
+// charges adding up to the whole ppdu
+
+#define MAX_LEN (1 << 20)
+
+static uint64_t n_checked;
+
+struct known_t {
+	const char *name;
+	uint32_t rate;
+	uint32_t len;
+	uint32_t flags;
+	uint32_t us;
+};
+
+static void check_known(void)
+{
+	const struct known_t known[] = {
+		// 192 us plcp, 14 byte ack at 1 bit per us
+		{ "dsss 1 ack", airtime_legacy(2), 14, 0, 304 },
+		{ "dsss 1 short ack", airtime_legacy(2), 14, AIRTIME_F_SHORTPRE, 304 },
+		{ "dsss 2 ack", airtime_legacy(4), 14, 0, 248 },
+		{ "dsss 2 short ack", airtime_legacy(4), 14, AIRTIME_F_SHORTPRE, 152 },
+		// 800 bits / 5.5 = 145.5, length rounds up
+		{ "cck 5.5 100", airtime_legacy(11), 100, 0, 338 },
+		{ "cck 11 1500", airtime_legacy(22), 1500, 0, 1283 },
+		{ "cck 11 short 1500", airtime_legacy(22), 1500, AIRTIME_F_SHORTPRE, 1187 },
+		// 16 + 112 + 6 bits in 24 bit symbols: 6
+		{ "ofdm 6 ack", airtime_legacy(12), 14, 0, 44 },
+		{ "erp 6 ack", airtime_legacy(12), 14, AIRTIME_F_2GHZ, 50 },
+		{ "ofdm 24 ack", airtime_legacy(48), 14, 0, 28 },
+		{ "ofdm 54 1500", airtime_legacy(108), 1500, 0, 244 },
+		{ "ofdm 54 0", airtime_legacy(108), 0, 0, 24 },
+		// 12022 bits / 260 = 47 symbols
+		{ "ht mcs7 20", airtime_ht(7, 0, 0), 1500, 0, 224 },
+		{ "ht mcs7 20 sgi", airtime_ht(7, 0, 1), 1500, 0, 208 },
+		{ "ht mcs7 20 gf", airtime_ht(7, 0, 0), 1500, AIRTIME_F_GF, 212 },
+		{ "ht mcs0 20 2.4", airtime_ht(0, 0, 0), 100, AIRTIME_F_2GHZ, 170 },
+		// two streams, two ltfs, 11.1 symbols
+		{ "ht mcs15 40 sgi", airtime_ht(15, 1, 1), 1500, 0, 84 },
+		// three streams, four ltfs, two encoders above 300 Mbps
+		{ "ht mcs23 40", airtime_ht(23, 1, 0), 8000, 0, 48 + 4 * 40 },
+		{ "ht mcs32 40", airtime_ht(32, 1, 0), 100, 0, 176 },
+		{ "vht mcs9 80 sgi", airtime_vht(9, 1, 2, 1), 1500, 0, 72 },
+		{ "vht mcs7 80 2ss", airtime_vht(7, 2, 2, 0), 4000, 0, 100 },
+		{ "vht mcs9 20 3ss", airtime_vht(9, 3, 0, 0), 1000, 0, 52 + 4 * 8 },
+		// vht is 5 GHz only, greenfield is ht only
+		{ "vht 2.4 gf", airtime_vht(0, 1, 0, 0), 100, AIRTIME_F_2GHZ | AIRTIME_F_GF, 40 + 4 * 32 },
+		{ "vht mcs9 20 1ss", airtime_vht(9, 1, 0, 0), 1000, 0, 0 },
+		{ "vht mcs6 80 3ss", airtime_vht(6, 3, 2, 0), 1000, 0, 0 },
+		{ "ht mcs32 20", airtime_ht(32, 0, 0), 100, 0, 0 },
+		{ "none", AIRTIME_NONE, 1500, AIRTIME_F_SHORTPRE | AIRTIME_F_2GHZ, 0 },
+	};
+	uint32_t i, us;
+
+	for (i = 0; i < sizeof(known) / sizeof(known[0]); i++) {
+		us = airtime_us(known[i].rate, known[i].len, known[i].flags);
+		if (us != known[i].us) {
+			printf("FAIL %s: %u us, expected %u\n", known[i].name, us, known[i].us);
+			fails++;
+		}
+	}
+}
+
+// data rates in 100 kbps at 800 ns gi, one stream
+static const uint16_t ref_legacy[12] = { 10, 20, 55, 110, 60, 90, 120, 180, 240, 360, 480, 540 };
+static const uint16_t ref_ht[2][8] = {
+	{ 65, 130, 195, 260, 390, 520, 585, 650 },
+	{ 135, 270, 405, 540, 810, 1080, 1215, 1350 },
+};
+// vht at 80 MHz in 10 kbps, other widths scale by their data subcarriers
+static const uint16_t ref_vht80[10] = { 2925, 5850, 8775, 11700, 17550, 23400, 26325, 29250, 35100, 39000 };
+
+static uint32_t ceil_div(uint64_t a, uint64_t b)
+{
+	return (a + b - 1) / b;
+}
+
+static uint32_t ref_us(uint32_t kind, uint32_t dbps, uint32_t ltf, uint32_t sgi, uint32_t nes, uint32_t len, uint32_t flags)
+{
+	uint32_t nsym, us;
+
+	if (kind == AIRTIME_DSSS) {
+		// dbps holds the rate in 100 kbps here
+		us = ceil_div(80ull * len, dbps);
+		return ((flags & AIRTIME_F_SHORTPRE) && dbps > 10 ? 96 : 192) + us;
+	}
+
+	nsym = ceil_div(16 + 8ull * len + 6 * nes, dbps);
+	if (kind == AIRTIME_OFDM) {
+		us = 20 + 4 * nsym;
+	} else if (kind == AIRTIME_HT) {
+		us = ((flags & AIRTIME_F_GF) ? 20 : 32) + 4 * ltf + (sgi ? 4 * ceil_div(36 * nsym, 40) : 4 * nsym);
+	} else {
+		return 36 + 4 * ltf + (sgi ? 4 * ceil_div(36 * nsym, 40) : 4 * nsym);
+	}
+
+	return us + ((flags & AIRTIME_F_2GHZ) ? 6 : 0);
+}
+
+static void check_rate(const char *name, uint32_t rate, uint32_t kind, uint32_t dbps, uint32_t ltf, uint32_t sgi, uint32_t nes)
+{
+	uint32_t i, len, flags, us, want;
+
+	for (i = 0; i < 4000; i++) {
+		len = (i < 3000) ? i : rng() % (MAX_LEN + 1);
+		flags = rng() & 7;
+		us = airtime_us(rate, len, flags);
+		want = ref_us(kind, dbps, ltf, sgi, nes, len, flags);
+		n_checked++;
+		if (us != want) {
+			if (fails++ < 8) {
+				printf("FAIL %s: %u bytes flags %u, %u us, expected %u\n", name, len, flags, us, want);
+			}
+			return;
+		}
+	}
+}
+
+static void check_all(void)
+{
+	static const uint8_t ht_ltf[5] = { 0, 1, 2, 4, 4 };
+	static const uint8_t vht_ltf[9] = { 0, 1, 2, 4, 4, 6, 6, 8, 8 };
+	static const uint16_t vht_scale[4] = { 52, 108, 234, 468 };
+	uint32_t i, mcs, nss, bw, sgi, dbps, rate;
+	char name[64];
+
+	for (i = 0; i < 12; i++) {
+		rate = airtime_legacy(ref_legacy[i] / 5);
+		snprintf(name, sizeof(name), "legacy %u", ref_legacy[i]);
+		if (i < 4) {
+			check_rate(name, rate, AIRTIME_DSSS, ref_legacy[i], 0, 0, 0);
+		} else {
+			check_rate(name, rate, AIRTIME_OFDM, ref_legacy[i] * 4 / 10, 0, 0, 1);
+		}
+	}
+
+	for (mcs = 0; mcs < 32; mcs++) {
+		for (bw = 0; bw < 2; bw++) {
+			for (sgi = 0; sgi < 2; sgi++) {
+				nss = mcs / 8 + 1;
+				dbps = ref_ht[bw][mcs & 7] * nss * 4 / 10;
+				snprintf(name, sizeof(name), "ht mcs %u bw %u sgi %u", mcs, bw, sgi);
+				// a second encoder above 300 Mbps at short gi
+				check_rate(name, airtime_ht(mcs, bw, sgi), AIRTIME_HT, dbps, ht_ltf[nss], sgi, dbps * 10 > 300 * 36 ? 2 : 1);
+			}
+		}
+	}
+
+	for (mcs = 0; mcs < 10; mcs++) {
+		for (nss = 1; nss <= 8; nss++) {
+			for (bw = 0; bw < 4; bw++) {
+				uint64_t d = (uint64_t)ref_vht80[mcs] * 4 * nss * vht_scale[bw];
+
+				// 20 MHz mcs 9 only works out for a multiple of 3 streams
+				if (d % (100 * 234)) {
+					if (airtime_us(airtime_vht(mcs, nss, bw, 0), 100, 0) != 0) {
+						printf("FAIL vht mcs %u nss %u bw %u: exists\n", mcs, nss, bw);
+						fails++;
+					}
+					continue;
+				}
+				dbps = d / (100 * 234);
+				rate = airtime_vht(mcs, nss, bw, 0);
+				if (airtime_us(rate, 100, 0) == 0) {
+					continue;
+				}
+				for (sgi = 0; sgi < 2; sgi++) {
+					snprintf(name, sizeof(name), "vht mcs %u nss %u bw %u sgi %u", mcs, nss, bw, sgi);
+					check_rate(name, airtime_vht(mcs, nss, bw, sgi), AIRTIME_VHT, dbps, vht_ltf[nss], sgi,
+						ceil_div(dbps * 10, 600 * 36));
+				}
+			}
+		}
+	}
+}
+
+// the driver's rate for every rxpd rate index, in 500 kbps at long gi
+static void check_rxpd(void)
+{
+	uint32_t idx, ht_info, rate, mw;
+
+	for (ht_info = 0; ht_info < 8; ht_info++) {
+		for (idx = 0; idx < 40; idx++) {
+			rate = airtime_rxpd(idx, ht_info);
+			mw = mwifiex_index_to_data_rate(idx, ht_info);
+
+			if (!(ht_info & 1)) {
+				// the driver falls back to 1 Mbps, a rate the hardware has no index for is unknown here
+				if (idx > 12 || idx == 4) {
+					if (rate != AIRTIME_NONE) {
+						printf("FAIL rxpd legacy %u: rate %u\n", idx, rate);
+						fails++;
+					}
+					continue;
+				}
+				if (airtime_rates[rate].div != (idx < 4 ? mw : 2 * mw)) {
+					printf("FAIL rxpd legacy %u: %u bits, driver rate %u\n", idx, airtime_rates[rate].div, mw);
+					fails++;
+				}
+			} else if (idx < 8 && !(ht_info & 4)) {
+				if (rate != airtime_ht(idx, ht_info & 2, 0) || airtime_rates[rate].div != 2 * mw) {
+					printf("FAIL rxpd ht %u/%u: %u bits, driver rate %u\n", idx, ht_info, airtime_rates[rate].div, mw);
+					fails++;
+				}
+			} else if (idx <= 32 && rate != airtime_ht(idx, ht_info & 2, ht_info & 4)) {
+				printf("FAIL rxpd ht %u/%u: rate %u\n", idx, ht_info, rate);
+				fails++;
+			}
+		}
+	}
+}
+
+// random a-mpdus, the charges of their mpdus against one ppdu of the
+// padded length, a change of reference or rate starts another
+static void check_ampdu(uint32_t iters)
+{
+	struct airtime_ampdu_t a;
+	uint32_t i, k, n, ref, rate, flags, len, total, sum, us;
+
+	airtime_ampdu_end(&a);
+
+	for (i = 0; i < iters; i++) {
+		ref = rng();
+		do {
+			rate = rng() % AIRTIME_RATES;
+		} while (airtime_us(rate, 0, 0) == 0);
+		flags = rng() & 7;
+		n = 1 + rng() % 64;
+
+		for (k = 0, total = 0, sum = 0; k < n; k++) {
+			len = 10 + rng() % 4000;
+			total = ((total + 3) & ~3u) + 4 + len;
+			sum += airtime_ampdu(&a, ref, rate, len, flags);
+		}
+
+		us = airtime_us(rate, total, flags);
+		if (sum != us) {
+			if (fails++ < 8) {
+				printf("FAIL a-mpdu of %u, rate %u: charged %u us, ppdu %u\n", n, rate, sum, us);
+			}
+		}
+		if ((rng() & 3) == 0) {
+			airtime_ampdu_end(&a);
+		}
+	}
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-n a-mpdus] [-s seed]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t iters = 100000;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:s:")) != -1) {
+		switch (c) {
+		case 'n': iters = strtoul(optarg, NULL, 0); break;
+		case 's': rng_state = strtoul(optarg, NULL, 0) | 1; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	airtime_init();
+
+	check_known();
+	check_all();
+	check_rxpd();
+	check_ampdu(iters);
+
+	printf("%llu durations against the formulas, %u a-mpdus\n", (unsigned long long)n_checked, iters);
+	printf("%s\n", fails ? "FAIL" : "ok");
+
+	return fails ? 2 : 0;
+}
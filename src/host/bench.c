@@ -0,0 +1,1038 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <vitasdkkern.h>
+#include <psp2kern/net/net.h>
+
+#include "kwifimon_export.h"
+#include "wlan_kernel.h"
+#include "sigs.h"
+#include "kwifimon.h"
+#include "radiotap.h"
+#include "pcap.h"
+#include "knet.h"
+#include "m.h"
+#include "ring.h"
+#include "lz4blk.h"
+#include "kcap.h"
+#include "live.h"
+#include "dot11.h"
+#include "rtap.h"
+#include "airtime.h"
+
+#include "shim.h"
+#include "sdiogen.h"
+#include "test.h"
+
+// microbenchmarks for the capture hot paths, run on the host against the shim
+// -j prints one json object per line for tracking, -b compares against such a file
+
+#define BENCH_PORT     31399
+#define FRAME_LEN      256
+#define RING_SIZE      (512*1024)
+
+int module_start(SceSize argc, const void *args);
+int module_stop(SceSize argc, const void *args);
+
+extern uint32_t kwifimon_channel_freq;
+extern uint32_t kwifimon_channel_band;
+
+struct bench_t {
+	const char *name;
+	uint64_t (*fn)(uint64_t iters);   // returns a value so the work is not optimized away
+	uint32_t bytes;                   // bytes per op for throughput, 0 if not meaningful
+	const double *ratio;              // reported along, e.g. compression ratio
+	const uint32_t *bytes_var;        // bytes per op only known after setup, overrides bytes
+};
+
+struct bench_res_t {
+	uint64_t iters;
+	double ns_op;
+	double allocs_op;
+};
+
+// allocation counter, malloc and friends are wrapped at link time
+static volatile uint64_t bench_allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+	__sync_fetch_and_add(&bench_allocs, 1);
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+	__sync_fetch_and_add(&bench_allocs, 1);
+	return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+	__sync_fetch_and_add(&bench_allocs, 1);
+	return __real_realloc(p, size);
+}
+
+static uint64_t bench_passed;
+
+// stand-ins for the SceWlanBt functions the module hooks or calls
+static int bench_rx_handler(struct wlan_dev_t *dev, uint8_t *in_pkt, int in_pkt_len, uint32_t *somenumber)
+{
+	bench_passed++;
+	return 0;
+}
+
+// a spread of inputs so branches are not perfectly predicted
+#define NUM_PD 64
+
+static struct rxpd bench_pd[NUM_PD];
+static uint8_t bench_pkt[NUM_PD][sizeof(struct sdio_rx_t) + sizeof(struct rxpd) + FRAME_LEN] __attribute__ ((aligned(4)));
+static uint8_t bench_frame[FRAME_LEN];
+static struct rx_radiotap_hdr bench_rtap;
+
+static const uint32_t bench_freq[] = {
+	2412, 2437, 2462, 2484, 5180, 5240, 5500, 5745, 5825, 4920, 2400, 5000
+};
+
+static void bench_setup_input(void)
+{
+	uint32_t rnd = 0x2545f491;
+	int i;
+
+	for (i = 0; i < NUM_PD; i++) {
+		struct rxpd *pd = &bench_pd[i];
+
+		rnd ^= rnd << 13;
+		rnd ^= rnd >> 17;
+		rnd ^= rnd << 5;
+
+		memset(pd, 0, sizeof(*pd));
+		pd->ht_info = rnd & 7;
+		pd->rx_rate = (pd->ht_info & 1) ? (rnd >> 3) % 16 : (rnd >> 3) % 12;
+		pd->snr = 10 + (rnd >> 8) % 50;
+		pd->nf = -95 + (rnd >> 16) % 10;
+		pd->rx_pkt_type = 0;
+		pd->rx_pkt_offset = sizeof(struct rxpd);
+		pd->rx_pkt_length = FRAME_LEN;
+
+		struct sdio_rx_t *rxt = (struct sdio_rx_t *)bench_pkt[i];
+		rxt->pkt_type = 0;
+		memcpy(bench_pkt[i] + sizeof(struct sdio_rx_t), pd, sizeof(*pd));
+	}
+
+	for (i = 0; i < FRAME_LEN; i++) {
+		bench_frame[i] = i * 7;
+	}
+
+	kwifimon_channel_freq = 2437;
+	kwifimon_channel_band = 0;
+
+	kwifimon_rtap_fill(&bench_rtap, &bench_pd[0]);
+}
+
+// one staged pcap block of generated traffic, as the writer compresses it
+static uint8_t bench_blk[PCAP_BUF_SIZE];
+static uint32_t bench_blk_len;
+static uint8_t bench_zblk[LZ4BLK_BOUND(PCAP_BUF_SIZE)];
+static uint32_t bench_zblk_len;
+static uint16_t bench_ztab[LZ4BLK_HASH_SIZE];
+static double bench_ratio;
+
+static int bench_blk_add(void *ctx, const uint8_t *pkt, uint32_t len, uint32_t delta_us)
+{
+	struct rxpd pd;
+	struct rx_radiotap_hdr rt;
+	pcaprec_hdr_t rec;
+	uint32_t left = PCAP_BUF_SIZE - bench_blk_len;
+
+	memcpy(&pd, pkt + sizeof(struct sdio_rx_t), sizeof(pd));
+	if (sizeof(struct sdio_rx_t) + pd.rx_pkt_offset + pd.rx_pkt_length > len) {
+		return 0;
+	}
+
+	kwifimon_rtap_fill(&rt, &pd);
+
+	rec.ts_sec = 1000 + bench_blk_len / 1000;
+	rec.ts_usec = bench_blk_len % 1000 * 1000 + delta_us % 1000;
+	rec.orig_len = rt.hdr.it_len + pd.rx_pkt_length;
+	rec.incl_len = rec.orig_len;
+
+	// last record is cut short so the block is full
+	if (sizeof(rec) + rec.incl_len > left) {
+		rec.incl_len = left - sizeof(rec);
+	}
+
+	memcpy(bench_blk + bench_blk_len, &rec, sizeof(rec));
+	bench_blk_len += sizeof(rec);
+
+	uint32_t n = (rec.incl_len < rt.hdr.it_len) ? rec.incl_len : rt.hdr.it_len;
+	memcpy(bench_blk + bench_blk_len, &rt, n);
+	memcpy(bench_blk + bench_blk_len + n, pkt + sizeof(struct sdio_rx_t) + pd.rx_pkt_offset, rec.incl_len - n);
+	bench_blk_len += rec.incl_len;
+
+	return left - sizeof(rec) - rec.incl_len < sizeof(rec) + rt.hdr.it_len;
+}
+
+static void bench_setup_blk(void)
+{
+	static struct sdiogen_t g;
+	struct sdiogen_cfg_t cfg;
+
+	// beacons and probes, what a monitor mostly sees and what compresses,
+	// data payloads are random and would be stored anyway
+	sdiogen_default(&cfg);
+	cfg.frames = 0;
+	cfg.w_beacon = 60;
+	cfg.w_probe = 25;
+	cfg.w_data = 10;
+	cfg.w_amsdu = 0;
+	cfg.len_max = 256;
+	sdiogen_init(&g, &cfg);
+	sdiogen_run(&g, bench_blk_add, NULL);
+
+	memset(bench_blk + bench_blk_len, 0, PCAP_BUF_SIZE - bench_blk_len);
+
+	bench_zblk_len = lz4blk_compress(bench_blk, PCAP_BUF_SIZE, bench_zblk, sizeof(bench_zblk), bench_ztab);
+	bench_ratio = (double)PCAP_BUF_SIZE / bench_zblk_len;
+}
+
+static uint64_t b_rtap_fill(uint64_t iters)
+{
+	struct rx_radiotap_hdr rt;
+	uint64_t sum = 0;
+	uint64_t i;
+
+	for (i = 0; i < iters; i++) {
+		kwifimon_rtap_fill(&rt, &bench_pd[i & (NUM_PD - 1)]);
+		sum += rt.rate + rt.mcs_flags;
+		__asm__ volatile("" : : "r"(&rt) : "memory");
+	}
+
+	return sum;
+}
+
+static uint64_t b_data_rate(uint64_t iters)
+{
+	uint64_t sum = 0;
+	uint64_t i;
+
+	for (i = 0; i < iters; i++) {
+		struct rxpd *pd = &bench_pd[i & (NUM_PD - 1)];
+		sum += mwifiex_index_to_data_rate(pd->rx_rate, pd->ht_info);
+	}
+
+	return sum;
+}
+
+static uint64_t b_freq_to_hw(uint64_t iters)
+{
+	uint64_t sum = 0;
+	uint64_t i;
+
+	for (i = 0; i < iters; i++) {
+		sum += m_freq_to_hwvalue(bench_freq[i % 12]);
+	}
+
+	return sum;
+}
+
+static uint64_t b_hw_to_freq(uint64_t iters)
+{
+	uint64_t sum = 0;
+	uint64_t i;
+
+	for (i = 0; i < iters; i++) {
+		uint32_t j = i % 24;
+		sum += m_hwvalue_to_freq((j < 14) ? j + 1 : 36 + (j - 14) * 12, (j < 14) ? 0 : 1);
+	}
+
+	return sum;
+}
+
+static uint64_t b_chan_valid(uint64_t iters)
+{
+	uint64_t sum = 0;
+	uint64_t i;
+
+	for (i = 0; i < iters; i++) {
+		sum += m_chan_valid(i % 200, (i >> 1) & 1) + m_freq_valid(bench_freq[i % 12]);
+	}
+
+	return sum;
+}
+
+// encoding into the staging buffer, flushes go to /dev/null
+static uint64_t b_pcap_write(uint64_t iters)
+{
+	uint64_t sum = 0;
+	uint64_t i;
+
+	if (pcap_open("/dev/null", NULL, NULL) < 0) {
+		return 0;
+	}
+
+	for (i = 0; i < iters; i++) {
+		sum += pcap_write_rt(i, i, &bench_rtap.hdr, bench_frame, FRAME_LEN);
+	}
+
+	pcap_close();
+
+	return sum;
+}
+
+// datagram assembly plus the sendto, nobody listens on the port
+static uint64_t b_knet_write(uint64_t iters)
+{
+	struct wifimon_net_cfg_t cfg;
+	uint64_t sum = 0;
+	uint64_t i;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.num = 1;
+	cfg.dest[0].addr = SCE_NET_INADDR_LOOPBACK;
+	cfg.dest[0].port = BENCH_PORT;
+
+	if (knet_start(&cfg) < 0) {
+		return 0;
+	}
+
+	for (i = 0; i < iters; i++) {
+		sum += knet_write_rt(&bench_rtap.hdr, bench_frame, FRAME_LEN);
+	}
+
+	knet_stop();
+
+	return sum;
+}
+
+// full hook with capture off, classify plus locked counter update
+static uint64_t b_hook_stats(uint64_t iters)
+{
+	rx_hook_t hook = (rx_hook_t)shim_hook(sigs[SIG_RX_HANDLER].fixed);
+	static uint8_t dev[sizeof(struct wlan_dev_t)];
+	uint32_t somenumber = 0;
+	uint64_t i;
+
+	for (i = 0; i < iters; i++) {
+		uint8_t *pkt = bench_pkt[i & (NUM_PD - 1)];
+		hook((struct wlan_dev_t *)dev, pkt, sizeof(bench_pkt[0]), &somenumber);
+	}
+
+	return bench_passed;
+}
+
+static uint64_t b_stats_read(uint64_t iters)
+{
+	struct wifimon_stats_t s;
+	uint64_t sum = 0;
+	uint64_t i;
+
+	for (i = 0; i < iters; i++) {
+		kwifimon_mod_stats(&s, 0);
+		sum += s.pkt_cnt;
+	}
+
+	return sum;
+}
+
+static uint8_t ring_mem[RING_SIZE] __attribute__ ((aligned(64)));
+
+static uint64_t b_ring(uint64_t iters)
+{
+	struct ring_t r;
+	uint64_t sum = 0;
+	uint64_t i;
+
+	ring_init(&r, ring_mem, RING_SIZE);
+
+	for (i = 0; i < iters; i++) {
+		struct ring_rec_t *rec = ring_reserve(&r, FRAME_LEN);
+		rec->type = RING_REC_RT;
+		rec->len = FRAME_LEN;
+		memcpy(ring_rec_data(rec), bench_frame, FRAME_LEN);
+		ring_commit(&r, rec);
+
+		rec = ring_peek(&r);
+		sum += rec->len;
+		ring_release(&r, rec);
+	}
+
+	return sum;
+}
+
+struct spsc_t {
+	struct ring_t r;
+	uint64_t iters;
+	uint64_t sum;
+};
+
+static void *spsc_consumer(void *arg)
+{
+	struct spsc_t *s = arg;
+	uint64_t n = 0;
+
+	while (n < s->iters) {
+		struct ring_rec_t *rec = ring_peek(&s->r);
+		if (rec == NULL) {
+			sched_yield();
+			continue;
+		}
+		s->sum += ring_rec_data(rec)[0];
+		ring_release(&s->r, rec);
+		n++;
+	}
+
+	return NULL;
+}
+
+// producer and consumer on separate threads, like hook and writer
+static uint64_t b_ring_spsc(uint64_t iters)
+{
+	static struct spsc_t s;
+	pthread_t th;
+	uint64_t i;
+
+	ring_init(&s.r, ring_mem, RING_SIZE);
+	s.iters = iters;
+	s.sum = 0;
+
+	if (pthread_create(&th, NULL, spsc_consumer, &s) != 0) {
+		return 0;
+	}
+
+	for (i = 0; i < iters; i++) {
+		struct ring_rec_t *rec;
+
+		while ((rec = ring_reserve(&s.r, FRAME_LEN)) == NULL) {
+			sched_yield();
+		}
+		rec->type = RING_REC_RT;
+		rec->len = FRAME_LEN;
+		memcpy(ring_rec_data(rec), bench_frame, FRAME_LEN);
+		ring_commit(&s.r, rec);
+	}
+
+	pthread_join(th, NULL);
+
+	return s.sum;
+}
+
+static uint64_t b_blk_compress(uint64_t iters)
+{
+	uint64_t sum = 0;
+	uint64_t i;
+
+	for (i = 0; i < iters; i++) {
+		sum += lz4blk_compress(bench_blk, PCAP_BUF_SIZE, bench_zblk, sizeof(bench_zblk), bench_ztab);
+	}
+
+	return sum;
+}
+
+static uint64_t b_blk_decompress(uint64_t iters)
+{
+	static uint8_t out[PCAP_BUF_SIZE];
+	uint64_t sum = 0;
+	uint64_t i;
+
+	for (i = 0; i < iters; i++) {
+		sum += lz4blk_decompress(bench_zblk, bench_zblk_len, out, sizeof(out));
+	}
+
+	return sum;
+}
+
+static uint64_t b_blk_sum(uint64_t iters)
+{
+	uint64_t sum = 0;
+	uint64_t i;
+
+	for (i = 0; i < iters; i++) {
+		sum += kcap_sum(1, bench_blk, PCAP_BUF_SIZE);
+	}
+
+	return sum;
+}
+
+// live table updates from station data frames and beacons
+#define LIVE_STA 256
+
+static uint8_t bench_live_data[LIVE_STA][64];
+static uint8_t bench_live_beacon[128];
+
+static void bench_live_frame(uint8_t *f, uint32_t sta)
+{
+	static const uint8_t bssid[6] = { 0x02, 0x11, 0x22, 0x33, 0x44, 0x55 };
+
+	// qos data, to ds
+	memset(f, 0, 64);
+	f[0] = 0x88;
+	f[1] = 0x01;
+	memcpy(f + 4, bssid, 6);
+	f[10] = 0x02;
+	f[11] = sta >> 24;
+	f[12] = sta >> 16;
+	f[13] = sta >> 8;
+	f[14] = sta;
+	f[15] = 0x5a;
+	memcpy(f + 16, bssid, 6);
+}
+
+static void bench_setup_live(void)
+{
+	static const uint8_t ies[] = { 0, 7, 'k', 'w', 'i', 'f', 'i', 'm', 'n', 1, 4, 0x82, 0x84, 0x8b, 0x96, 3, 1, 6 };
+	uint8_t *f = bench_live_beacon;
+	uint32_t i;
+
+	for (i = 0; i < LIVE_STA; i++) {
+		bench_live_frame(bench_live_data[i], i * 2654435761u);
+	}
+
+	memset(f, 0, sizeof(bench_live_beacon));
+	f[0] = 0x80;
+	memset(f + 4, 0xff, 6);
+	f[10] = 0x02;
+	f[16] = 0x02;
+	f[32] = 100;
+	memcpy(f + 36, ies, sizeof(ies));
+}
+
+static uint64_t b_live_sta_hit(uint64_t iters)
+{
+	uint64_t i;
+
+	live_init();
+	for (i = 0; i < iters; i++) {
+		live_update(&bench_pd[i & (NUM_PD - 1)], bench_live_data[i & (LIVE_STA - 1)], 64);
+	}
+
+	return i;
+}
+
+// a new station every frame with a full table, each one evicts
+static uint64_t b_live_sta_churn(uint64_t iters)
+{
+	static uint8_t f[64];
+	uint64_t i;
+
+	live_init();
+	for (i = 0; i < iters; i++) {
+		bench_live_frame(f, i * 2654435761u);
+		live_update(&bench_pd[i & (NUM_PD - 1)], f, 64);
+	}
+
+	return i;
+}
+
+static uint64_t b_live_beacon(uint64_t iters)
+{
+	uint64_t i;
+
+	live_init();
+	for (i = 0; i < iters; i++) {
+		bench_live_beacon[21] = i & 63;
+		live_update(&bench_pd[i & (NUM_PD - 1)], bench_live_beacon, 36 + 18);
+	}
+
+	return i;
+}
+
+// element extraction from beacons, generated ones with the tail a real ap adds
+#define NUM_BEACON 64
+
+static uint8_t bench_beacon[NUM_BEACON][512];
+static uint32_t bench_beacon_len[NUM_BEACON];
+static uint32_t bench_beacon_n;
+static uint32_t bench_ies_bytes;
+
+static const uint64_t bench_want[] = {
+	DOT11_IE_SSID, DOT11_IE_DS_PARAMS, DOT11_IE_HT_CAP, DOT11_IE_RSN, DOT11_IE_VHT_CAP, DOT11_WANT_WMM,
+};
+
+#define NUM_WANT (sizeof(bench_want) / sizeof(bench_want[0]))
+
+static struct dot11_ie_set_t bench_ie_set;
+
+static int bench_beacon_add(void *ctx, const uint8_t *pkt, uint32_t len, uint32_t delta_us)
+{
+	static const uint8_t tail[] = {
+		7, 6, 'D', 'E', ' ', 1, 13, 20,                        // country
+		42, 1, 0x04,                                           // erp
+		50, 4, 0x30, 0x48, 0x60, 0x6c,                         // extended rates
+		61, 22, 6, 0x05, 0x11, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		127, 8, 0x04, 0, 0x08, 0, 0, 0, 0, 0x40,               // extended capabilities
+		191, 12, 0x91, 0x59, 0x82, 0x0f, 0xea, 0xff, 0, 0, 0xea, 0xff, 0, 0,
+		192, 5, 0, 0, 0, 0xfc, 0xff,
+		221, 24, 0x00, 0x50, 0xf2, 2, 1, 1, 0x80, 0, 0x03, 0xa4, 0, 0, 0x27, 0xa4, 0, 0,
+		0x42, 0x43, 0x5e, 0, 0x62, 0x32, 0x2f, 0,               // wmm
+		221, 7, 0x00, 0x0c, 0x43, 0x04, 0, 0, 0,               // vendor
+		221, 10, 0x00, 0x50, 0xf2, 4, 0x10, 0x4a, 0, 1, 0x10, 0x44,   // wps
+	};
+	const struct rxpd *pd = (const void *)(pkt + sizeof(struct sdio_rx_t));
+	const uint8_t *f = (const uint8_t *)pd + pd->rx_pkt_offset;
+	uint8_t *b = bench_beacon[bench_beacon_n];
+
+	if (pd->rx_pkt_length + sizeof(tail) > sizeof(bench_beacon[0]) || (f[0] & 0xfc) != 0x80) {
+		return 0;
+	}
+
+	memcpy(b, f, pd->rx_pkt_length);
+	memcpy(b + pd->rx_pkt_length, tail, sizeof(tail));
+	bench_beacon_len[bench_beacon_n] = pd->rx_pkt_length + sizeof(tail);
+	bench_ies_bytes += bench_beacon_len[bench_beacon_n] - 36;
+
+	return ++bench_beacon_n == NUM_BEACON;
+}
+
+static void bench_setup_dot11(void)
+{
+	static struct sdiogen_t g;
+	struct sdiogen_cfg_t cfg;
+
+	sdiogen_default(&cfg);
+	cfg.frames = 0;
+	cfg.w_beacon = 1;
+	cfg.w_probe = 0;
+	cfg.w_data = 0;
+	cfg.w_amsdu = 0;
+	cfg.w_bar = 0;
+	sdiogen_init(&g, &cfg);
+	sdiogen_run(&g, bench_beacon_add, NULL);
+
+	bench_ies_bytes /= NUM_BEACON;
+	dot11_ie_set_init(&bench_ie_set, bench_want, NUM_WANT);
+}
+
+static uint64_t b_dot11_hdr(uint64_t iters)
+{
+	struct dot11_hdr_t h;
+	uint64_t sum = 0;
+	uint64_t i;
+
+	for (i = 0; i < iters; i++) {
+		uint32_t k = i & (NUM_BEACON - 1);
+		sum += dot11_hdr_parse(bench_beacon[k], bench_beacon_len[k], &h);
+	}
+
+	return sum;
+}
+
+static uint64_t b_dot11_ies(uint64_t iters)
+{
+	struct dot11_ie_t ie[NUM_WANT];
+	uint64_t sum = 0;
+	uint64_t i;
+
+	for (i = 0; i < iters; i++) {
+		uint32_t k = i & (NUM_BEACON - 1);
+		sum += dot11_ie_parse(&bench_ie_set, bench_beacon[k] + 36, bench_beacon_len[k] - 36, ie);
+		sum += ie[0].len;
+	}
+
+	return sum;
+}
+
+// the same extraction done the obvious way, every element against every want
+static uint64_t b_dot11_ies_naive(uint64_t iters)
+{
+	struct dot11_ie_t ie[NUM_WANT];
+	uint64_t sum = 0;
+	uint64_t i;
+	uint32_t w;
+
+	for (i = 0; i < iters; i++) {
+		uint32_t k = i & (NUM_BEACON - 1);
+		const uint8_t *p = bench_beacon[k] + 36, *end = bench_beacon[k] + bench_beacon_len[k];
+
+		memset(ie, 0, sizeof(ie));
+		while (end - p >= 2 && p[1] <= end - p - 2) {
+			for (w = 0; w < NUM_WANT; w++) {
+				int hit;
+				if (bench_want[w] >> 32) {
+					hit = p[0] == DOT11_IE_VENDOR && p[1] >= 4 &&
+						(((uint32_t)p[2] << 24 | p[3] << 16 | p[4] << 8 | p[5]) == (uint32_t)bench_want[w]);
+				} else {
+					hit = p[0] == bench_want[w];
+				}
+				if (hit && ie[w].n++ == 0) {
+					ie[w].p = p + 2;
+					ie[w].len = p[1];
+				}
+			}
+			p += 2 + p[1];
+		}
+		sum += ie[0].len;
+	}
+
+	return sum;
+}
+
+// radiotap layouts: the header capture() writes and a 3 word one as
+// mac80211 has it for two antennas
+static struct rtap_cache_t bench_rtc;
+static uint8_t bench_rt_ext[38] __attribute__ ((aligned(8)));
+
+static void bench_setup_rtap(void)
+{
+	static const uint32_t present[3] = {
+		0xa000402f,          // tsft flags rate channel antsignal rx_flags, ns, ext
+		0xa0000820,          // antsignal antenna, ns, ext
+		0x00000820,
+	};
+	uint32_t i;
+
+	bench_rt_ext[2] = sizeof(bench_rt_ext);
+	memcpy(bench_rt_ext + 4, present, sizeof(present));
+	for (i = 16; i < sizeof(bench_rt_ext); i++) {
+		bench_rt_ext[i] = i;
+	}
+
+	rtap_cache_init(&bench_rtc);
+}
+
+static uint64_t b_rtap_parse(uint64_t iters)
+{
+	uint64_t sum = 0;
+	uint64_t i;
+
+	for (i = 0; i < iters; i++) {
+		const struct rtap_layout_t *l = rtap_parse(&bench_rtc, (uint8_t *)&bench_rtap, sizeof(bench_rtap));
+		sum += *rtap_get(l, (uint8_t *)&bench_rtap, IEEE80211_RADIOTAP_DB_ANTSIGNAL);
+	}
+
+	return sum;
+}
+
+static uint64_t b_rtap_parse_ext(uint64_t iters)
+{
+	uint64_t sum = 0;
+	uint64_t i;
+
+	for (i = 0; i < iters; i++) {
+		const struct rtap_layout_t *l = rtap_parse(&bench_rtc, bench_rt_ext, sizeof(bench_rt_ext));
+		sum += *rtap_get(l, bench_rt_ext, IEEE80211_RADIOTAP_DBM_ANTSIGNAL);
+	}
+
+	return sum;
+}
+
+static uint64_t b_rtap_layout_ext(uint64_t iters)
+{
+	struct rtap_layout_t l;
+	uint64_t sum = 0;
+	uint64_t i;
+
+	for (i = 0; i < iters; i++) {
+		rtap_layout(&l, bench_rt_ext, sizeof(bench_rt_ext));
+		sum += l.end;
+	}
+
+	return sum;
+}
+
+// timestamp appended to the capture header as capture() does it
+static uint64_t b_rtap_add_ts(uint64_t iters)
+{
+	uint8_t out[64];
+	uint8_t ts[12] = { 0 };
+	uint64_t sum = 0;
+	uint64_t i;
+
+	for (i = 0; i < iters; i++) {
+		ts[0] = i;
+		sum += rtap_add(&bench_rtc, (uint8_t *)&bench_rtap, sizeof(bench_rtap), out, sizeof(out), IEEE80211_RADIOTAP_TIMESTAMP, ts);
+	}
+
+	return sum + out[24];
+}
+
+// per frame airtime as the hook takes it, lengths vary so symbols do
+static uint64_t b_airtime(uint64_t iters)
+{
+	uint64_t sum = 0;
+	uint64_t i;
+
+	for (i = 0; i < iters; i++) {
+		struct rxpd *pd = &bench_pd[i & (NUM_PD - 1)];
+		sum += airtime_us(airtime_rxpd(pd->rx_rate, pd->ht_info), 60 + (i & 1023), AIRTIME_F_2GHZ);
+	}
+
+	return sum;
+}
+
+// the same with a division per frame instead of the reciprocal
+static uint64_t b_airtime_div(uint64_t iters)
+{
+	uint64_t sum = 0;
+	uint64_t i;
+
+	for (i = 0; i < iters; i++) {
+		struct rxpd *pd = &bench_pd[i & (NUM_PD - 1)];
+		const struct airtime_rate_t *r = &airtime_rates[airtime_rxpd(pd->rx_rate, pd->ht_info)];
+		uint32_t bits = ((60 + (i & 1023)) << r->shift) + r->extra;
+		uint32_t sym;
+
+		__asm__ volatile("" : "+r"(bits));
+		sym = r->div ? (bits + r->div - 1) / r->div : 0;
+		if (r->kind == AIRTIME_DSSS) {
+			sum += r->pre_us + sym;
+		} else {
+			sum += r->pre_us + 4 * (r->sgi ? (sym * 9 + 9) / 10 : sym) + 6;
+		}
+	}
+
+	return sum;
+}
+
+// 16 mpdus per a-mpdu
+static uint64_t b_airtime_ampdu(uint64_t iters)
+{
+	struct airtime_ampdu_t a;
+	uint64_t sum = 0;
+	uint64_t i;
+
+	airtime_ampdu_end(&a);
+	for (i = 0; i < iters; i++) {
+		uint32_t rate = airtime_ht((i >> 4) & 7, (i >> 7) & 1, 0);
+		sum += airtime_ampdu(&a, i >> 4, rate, 200 + (i & 1023), AIRTIME_F_2GHZ);
+	}
+
+	return sum;
+}
+
+static const struct bench_t benches[] = {
+	{ "rtap_fill",        b_rtap_fill,   sizeof(struct rx_radiotap_hdr) },
+	{ "data_rate",        b_data_rate,   0 },
+	{ "freq_to_hwvalue",  b_freq_to_hw,  0 },
+	{ "hwvalue_to_freq",  b_hw_to_freq,  0 },
+	{ "chan_freq_valid",  b_chan_valid,  0 },
+	{ "pcap_write_rt",    b_pcap_write,  sizeof(pcaprec_hdr_t) + sizeof(struct rx_radiotap_hdr) + FRAME_LEN },
+	{ "knet_write_rt",    b_knet_write,  sizeof(struct rx_radiotap_hdr) + FRAME_LEN },
+	{ "hook_stats",       b_hook_stats,  0 },
+	{ "stats_read",       b_stats_read,  0 },
+	{ "ring_rt",          b_ring,        sizeof(struct ring_rec_t) + FRAME_LEN },
+	{ "ring_spsc",        b_ring_spsc,   sizeof(struct ring_rec_t) + FRAME_LEN },
+	{ "blk_compress",     b_blk_compress,   PCAP_BUF_SIZE, &bench_ratio },
+	{ "blk_decompress",   b_blk_decompress, PCAP_BUF_SIZE, &bench_ratio },
+	{ "blk_sum",          b_blk_sum,        PCAP_BUF_SIZE },
+	{ "live_sta_hit",     b_live_sta_hit,   0 },
+	{ "live_sta_churn",   b_live_sta_churn, 0 },
+	{ "live_beacon",      b_live_beacon,    0 },
+	{ "dot11_hdr",        b_dot11_hdr,      0 },
+	{ "dot11_ies",        b_dot11_ies,      0, NULL, &bench_ies_bytes },
+	{ "dot11_ies_naive",  b_dot11_ies_naive, 0, NULL, &bench_ies_bytes },
+	{ "rtap_parse",       b_rtap_parse,     sizeof(struct rx_radiotap_hdr) },
+	{ "rtap_parse_ext",   b_rtap_parse_ext, sizeof(bench_rt_ext) },
+	{ "rtap_layout_ext",  b_rtap_layout_ext, sizeof(bench_rt_ext) },
+	{ "rtap_add_ts",      b_rtap_add_ts,    sizeof(struct rx_radiotap_hdr) + 17 },
+	{ "airtime",          b_airtime,        0 },
+	{ "airtime_div",      b_airtime_div,    0 },
+	{ "airtime_ampdu",    b_airtime_ampdu,  0 },
+};
+
+#define NUM_BENCH (sizeof(benches) / sizeof(benches[0]))
+
+static volatile uint64_t bench_sink;
+
+// grow iteration count until one run takes the target time, then keep the best of several runs
+static void bench_run(const struct bench_t *b, uint32_t target_ms, uint32_t runs, struct bench_res_t *res)
+{
+	uint64_t iters = 1000;
+	uint64_t t, best = UINT64_MAX, allocs = 0;
+	uint32_t i;
+
+	for (;;) {
+		t = now_ns();
+		bench_sink += b->fn(iters);
+		t = now_ns() - t;
+		if (t >= (uint64_t)target_ms * 1000000 / 4 || iters >= (1ull << 34)) {
+			break;
+		}
+		iters *= 4;
+	}
+
+	if (t > 0) {
+		iters = iters * target_ms * 1000000 / t;
+	}
+	if (iters == 0) {
+		iters = 1;
+	}
+
+	for (i = 0; i < runs; i++) {
+		uint64_t a = bench_allocs;
+
+		t = now_ns();
+		bench_sink += b->fn(iters);
+		t = now_ns() - t;
+
+		allocs += bench_allocs - a;
+		if (t < best) {
+			best = t;
+		}
+	}
+
+	res->iters = iters;
+	res->ns_op = (double)best / iters;
+	res->allocs_op = (double)allocs / ((double)iters * runs);
+}
+
+// look up ns_op of given bench in a file written with -j
+static double baseline_ns(const char *file, const char *name)
+{
+	char line[512], key[64];
+	double ns = 0;
+	FILE *f;
+
+	f = fopen(file, "r");
+	if (f == NULL) {
+		return 0;
+	}
+
+	snprintf(key, sizeof(key), "\"bench\":\"%s\"", name);
+
+	while (fgets(line, sizeof(line), f)) {
+		char *p;
+
+		if (strstr(line, key) == NULL) {
+			continue;
+		}
+		p = strstr(line, "\"ns_op\":");
+		if (p) {
+			ns = strtod(p + 8, NULL);
+		}
+		break;
+	}
+
+	fclose(f);
+
+	return ns;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-t ms] [-r runs] [-j] [-b baseline [-x percent]] [-o dir] [name ...]\n", name);
+	fprintf(stderr, "  -t  target time of one run (default 200)\n");
+	fprintf(stderr, "  -r  runs per bench, best is reported (default 5)\n");
+	fprintf(stderr, "  -j  json lines output\n");
+	fprintf(stderr, "  -b  compare ns/op against json lines file from an earlier run\n");
+	fprintf(stderr, "  -x  slower than baseline by more than this fails with exit code 2 (default 25)\n");
+	fprintf(stderr, "  -o  directory standing in for ux0: (default /tmp/bench)\n");
+	fprintf(stderr, "  -l  list benches\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *root = "/tmp/bench";
+	const char *base = NULL;
+	uint32_t target_ms = 200, runs = 5, slack = 25;
+	int json = 0, regress = 0;
+	uint32_t i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:r:jb:x:o:lh")) != -1) {
+		switch (opt) {
+		case 't': target_ms = strtoul(optarg, NULL, 0); break;
+		case 'r': runs = strtoul(optarg, NULL, 0); break;
+		case 'j': json = 1; break;
+		case 'b': base = optarg; break;
+		case 'x': slack = strtoul(optarg, NULL, 0); break;
+		case 'o': root = optarg; break;
+		case 'l':
+			for (i = 0; i < NUM_BENCH; i++) {
+				printf("%s\n", benches[i].name);
+			}
+			return 0;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	if (runs == 0 || target_ms == 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	shim_init(root);
+	shim_wlan_init();
+	shim_set_offset(sigs[SIG_RX_HANDLER].fixed, bench_rx_handler);
+
+	module_start(0, NULL);
+	if (kwifimon_mod_state() & 0x80000000) {
+		fprintf(stderr, "module_start failed, state %x\n", kwifimon_mod_state());
+		return 1;
+	}
+
+	bench_setup_input();
+	bench_setup_blk();
+	bench_setup_live();
+	bench_setup_dot11();
+	bench_setup_rtap();
+
+	if (!json) {
+		printf("%-18s %12s %10s %12s %10s %12s\n", "bench", "iters", "ns/op", "Mops/s", "MB/s", "allocs/op");
+	}
+
+	for (i = 0; i < NUM_BENCH; i++) {
+		const struct bench_t *b = &benches[i];
+		struct bench_res_t res;
+		int j;
+
+		if (optind < argc) {
+			for (j = optind; j < argc; j++) {
+				if (strcmp(argv[j], b->name) == 0) {
+					break;
+				}
+			}
+			if (j == argc) {
+				continue;
+			}
+		}
+
+		bench_run(b, target_ms, runs, &res);
+
+		double mops = 1e3 / res.ns_op;
+		uint32_t bytes = b->bytes_var ? *b->bytes_var : b->bytes;
+		double mbs = bytes ? mops * bytes : 0;
+		double ref = base ? baseline_ns(base, b->name) : 0;
+
+		if (json) {
+			printf("{\"bench\":\"%s\",\"iters\":%llu,\"ns_op\":%.2f,\"mops\":%.3f,\"mb_s\":%.1f,\"allocs_op\":%.4f",
+				b->name, (unsigned long long)res.iters, res.ns_op, mops, mbs, res.allocs_op);
+			if (b->ratio) {
+				printf(",\"ratio\":%.3f", *b->ratio);
+			}
+			if (ref > 0) {
+				printf(",\"base_ns_op\":%.2f", ref);
+			}
+			printf("}\n");
+		} else {
+			printf("%-18s %12llu %10.2f %12.3f %10.1f %12.4f", b->name, (unsigned long long)res.iters,
+				res.ns_op, mops, mbs, res.allocs_op);
+			if (b->ratio) {
+				printf("   ratio %.2f", *b->ratio);
+			}
+			if (ref > 0) {
+				printf("   %+6.1f%% vs base", (res.ns_op - ref) * 100 / ref);
+			}
+			printf("\n");
+		}
+
+		if (ref > 0 && res.ns_op > ref * (100 + slack) / 100) {
+			regress++;
+		}
+
+		fflush(stdout);
+	}
+
+	module_stop(0, NULL);
+
+	return regress ? 2 : 0;
+}
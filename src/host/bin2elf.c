@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <elf.h>
+
+#include "elfout.h"
+
+// firmware memory to an ARM ELF for the disassembler: memory dumps named
+// dump-<base>-<size>.bin, a segment map for anything else, or a firmware
+// download image, the ELF goes to a file or stdout without the data ever
+// being copied through a buffer
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-m map | -f image] [-e entry] [-o out.elf] [-v] [dump-<base>-<size>.bin ...]\n", name);
+	fprintf(stderr, "  -m  segment map, lines of <base> <size> <rwx> <file>[@offset] [name]\n");
+	fprintf(stderr, "  -f  firmware download image\n");
+	fprintf(stderr, "  -e  entry point, hex\n");
+	fprintf(stderr, "  -o  output, stdout when not given\n");
+	fprintf(stderr, "  -v  list the segments\n");
+	fprintf(stderr, "without inputs every dump-*.bin here is used\n");
+}
+
+static void report(const struct elfout_t *e, int ret, const char *what)
+{
+	switch (ret) {
+	case -1: fprintf(stderr, "%s: bad input (%u)\n", what, e->failed); break;
+	case -2: fprintf(stderr, "%s: cannot read\n", what); break;
+	case -3: fprintf(stderr, "%s and %s overlap\n", e->seg[e->failed - 1].name, e->seg[e->failed].name); break;
+	case -4: perror("write"); break;
+	case -5: fprintf(stderr, "%s: damaged at block %u\n", what, e->failed); break;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	static struct elfout_t e;
+	const char *map = NULL, *image = NULL, *out = NULL;
+	uint32_t entry = 0;
+	int has_entry = 0, verbose = 0, opt, fd = 1, ret = 0;
+	glob_t g;
+
+	while ((opt = getopt(argc, argv, "m:f:e:o:vh")) != -1) {
+		switch (opt) {
+		case 'm': map = optarg; break;
+		case 'f': image = optarg; break;
+		case 'e': entry = strtoul(optarg, NULL, 16); has_entry = 1; break;
+		case 'o': out = optarg; break;
+		case 'v': verbose = 1; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	if (out == NULL && isatty(1)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	elfout_init(&e);
+
+	if (map) {
+		ret = elfout_map(&e, map);
+		if (ret < 0) {
+			fprintf(stderr, "%s:%u: %s\n", map, e.failed, (ret == -2) ? "cannot read" : "bad line");
+			return 1;
+		}
+	}
+
+	if (image && (ret = elfout_image(&e, image)) < 0) {
+		report(&e, ret, image);
+		return 1;
+	}
+
+	if (optind == argc && map == NULL && image == NULL) {
+		if (glob("dump-*.bin", 0, NULL, &g) != 0) {
+			fprintf(stderr, "no dump-*.bin here\n");
+			return 1;
+		}
+		for (size_t i = 0; i < g.gl_pathc && ret == 0; i++) {
+			ret = elfout_dump(&e, g.gl_pathv[i]);
+			if (ret < 0) {
+				report(&e, ret, g.gl_pathv[i]);
+			}
+		}
+		globfree(&g);
+	}
+
+	for (int i = optind; i < argc && ret == 0; i++) {
+		ret = elfout_dump(&e, argv[i]);
+		if (ret < 0) {
+			report(&e, ret, argv[i]);
+		}
+	}
+
+	if (ret < 0) {
+		return 1;
+	}
+
+	if (has_entry) {
+		e.entry = entry;
+	}
+
+	ret = elfout_layout(&e);
+	if (ret < 0) {
+		report(&e, ret, "layout");
+		return 1;
+	}
+
+	if (verbose) {
+		for (uint32_t i = 0; i < e.nseg; i++) {
+			const struct elfout_seg_t *s = &e.seg[i];
+
+			fprintf(stderr, "%-10s %08x-%08x %c%c%c %8x in file at %08llx, %u pieces\n", s->name,
+				s->vaddr, s->vaddr + s->memsz, (s->pf & PF_R) ? 'r' : '-', (s->pf & PF_W) ? 'w' : '-',
+				(s->pf & PF_X) ? 'x' : '-', s->filesz, (unsigned long long)s->offset, s->count);
+		}
+		fprintf(stderr, "entry %08x, %llu bytes\n", e.entry, (unsigned long long)e.size);
+	}
+
+	if (out && (fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+		perror(out);
+		return 1;
+	}
+
+	ret = elfout_write(&e, fd, ELFOUT_AUTO);
+	if (ret < 0) {
+		report(&e, ret, out ? out : "stdout");
+	}
+
+	if (out) {
+		close(fd);
+	}
+	elfout_close(&e);
+
+	return (ret < 0) ? 1 : 0;
+}
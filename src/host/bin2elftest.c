@@ -0,0 +1,649 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <elf.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "elfout.h"
+#include "test.h"
+
+// ELFs from synthetic dumps, segment maps and the marvell image, written
+// every way elfout can, checked field by field the way readelf reads them
+// and byte for byte against the inputs, plus the inputs it has to refuse
+// with -b it measures instead how fast each way writes large dumps
+
+// what memory should look like: ranges and where their bytes come from
+struct want_t {
+	uint32_t vaddr;
+	uint32_t memsz;
+	uint32_t pf;
+	const uint8_t *data;     // filesz bytes, the rest zero
+	uint32_t filesz;
+	const char *name;        // NULL for any
+};
+
+static uint8_t *load(const char *file, uint64_t *size)
+{
+	struct stat st;
+	uint8_t *buf;
+	int fd = open(file, O_RDONLY);
+
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		return NULL;
+	}
+	buf = malloc(st.st_size + 1);
+	if (buf && read(fd, buf, st.st_size) != st.st_size) {
+		free(buf);
+		buf = NULL;
+	}
+	close(fd);
+	*size = st.st_size;
+
+	return buf;
+}
+
+static int save(const char *file, const uint8_t *buf, uint64_t len)
+{
+	int fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	int ok = fd >= 0 && write(fd, buf, len) == (ssize_t)len;
+
+	close(fd);
+	return ok ? 0 : -1;
+}
+
+static int overlaps(uint64_t a, uint64_t alen, uint64_t b, uint64_t blen)
+{
+	return alen && blen && a < b + blen && b < a + alen;
+}
+
+// the checks readelf -h -l -S -W does, then the contents
+static int elf_check(const char *what, const uint8_t *buf, uint64_t size, const struct want_t *want, uint32_t nwant, uint32_t entry)
+{
+	const Elf32_Ehdr *eh = (const Elf32_Ehdr *)buf;
+	const Elf32_Phdr *ph;
+	const Elf32_Shdr *sh, *str;
+
+#define CHECK(cond, ...) do { if (!(cond)) { printf("  %s: ", what); printf(__VA_ARGS__); printf(": FAIL\n"); return 1; } } while (0)
+
+	CHECK(size >= sizeof(*eh), "no header");
+	CHECK(memcmp(eh->e_ident, ELFMAG, SELFMAG) == 0 && eh->e_ident[EI_CLASS] == ELFCLASS32
+		&& eh->e_ident[EI_DATA] == ELFDATA2LSB && eh->e_ident[EI_VERSION] == EV_CURRENT, "ident");
+	CHECK(eh->e_type == ET_EXEC && eh->e_machine == EM_ARM && eh->e_version == EV_CURRENT, "type");
+	CHECK(eh->e_ehsize == sizeof(*eh) && eh->e_phentsize == sizeof(*ph) && eh->e_shentsize == sizeof(*sh), "sizes");
+	CHECK(eh->e_entry == entry, "entry %08x", eh->e_entry);
+	CHECK((uint64_t)eh->e_phoff + eh->e_phnum * sizeof(*ph) <= size, "phdrs past end");
+	CHECK((uint64_t)eh->e_shoff + eh->e_shnum * sizeof(*sh) <= size, "shdrs past end");
+	CHECK(eh->e_shstrndx < eh->e_shnum, "shstrndx");
+	CHECK(eh->e_phnum == nwant && eh->e_shnum == nwant + 2, "%u segments, want %u", eh->e_phnum, nwant);
+
+	ph = (const Elf32_Phdr *)(buf + eh->e_phoff);
+	sh = (const Elf32_Shdr *)(buf + eh->e_shoff);
+	str = &sh[eh->e_shstrndx];
+	CHECK(str->sh_type == SHT_STRTAB && (uint64_t)str->sh_offset + str->sh_size <= size && str->sh_size
+		&& buf[str->sh_offset + str->sh_size - 1] == 0, "shstrtab");
+	CHECK(sh[0].sh_type == SHT_NULL && sh[0].sh_size == 0 && sh[0].sh_addr == 0, "section 0");
+
+	for (uint32_t i = 1; i < eh->e_shnum; i++) {
+		CHECK(sh[i].sh_name < str->sh_size, "section %u name", i);
+	}
+
+	for (uint32_t i = 0; i < eh->e_phnum; i++) {
+		const Elf32_Phdr *p = &ph[i];
+		const Elf32_Shdr *s = &sh[i + 1];
+		const struct want_t *w = &want[i];
+		const char *name = (const char *)buf + str->sh_offset + s->sh_name;
+
+		CHECK(p->p_type == PT_LOAD && p->p_filesz <= p->p_memsz, "segment %u", i);
+		CHECK((uint64_t)p->p_offset + p->p_filesz <= size, "segment %u past end", i);
+		CHECK(p->p_align <= 1 || p->p_offset % p->p_align == p->p_vaddr % p->p_align, "segment %u align", i);
+		CHECK(i == 0 || (uint64_t)ph[i - 1].p_vaddr + ph[i - 1].p_memsz <= p->p_vaddr, "segment %u overlaps", i);
+
+		// data never shares bytes with headers or other data
+		CHECK(!overlaps(p->p_offset, p->p_filesz, 0, eh->e_shoff + eh->e_shnum * sizeof(*sh))
+			&& !overlaps(p->p_offset, p->p_filesz, str->sh_offset, str->sh_size), "segment %u on headers", i);
+		for (uint32_t j = 0; j < i; j++) {
+			CHECK(!overlaps(p->p_offset, p->p_filesz, ph[j].p_offset, ph[j].p_filesz), "segments %u %u share bytes", j, i);
+		}
+
+		// the section says the same
+		CHECK(s->sh_addr == p->p_vaddr && s->sh_offset == p->p_offset
+			&& s->sh_size == (p->p_filesz ? p->p_filesz : p->p_memsz)
+			&& s->sh_type == (p->p_filesz ? SHT_PROGBITS : SHT_NOBITS) && (s->sh_flags & SHF_ALLOC)
+			&& !!(s->sh_flags & SHF_EXECINSTR) == !!(p->p_flags & PF_X)
+			&& !!(s->sh_flags & SHF_WRITE) == !!(p->p_flags & PF_W), "section %s", name);
+
+		CHECK(p->p_vaddr == w->vaddr && p->p_memsz == w->memsz && p->p_filesz == w->filesz && p->p_flags == w->pf,
+			"segment %u %08x+%x/%x, want %08x+%x/%x", i, p->p_vaddr, p->p_filesz, p->p_memsz, w->vaddr, w->filesz, w->memsz);
+		CHECK(w->name == NULL || strcmp(name, w->name) == 0, "section %s, want %s", name, w->name);
+		CHECK(memcmp(buf + p->p_offset, w->data, w->filesz) == 0, "%s contents", name);
+	}
+
+#undef CHECK
+
+	return 0;
+}
+
+static int readelf_check(const char *what, const char *file)
+{
+	char cmd[600], line[512];
+	int bad = 0, st;
+	FILE *p;
+
+	if (system("readelf -v >/dev/null 2>&1") != 0) {
+		return 0;
+	}
+
+	snprintf(cmd, sizeof(cmd), "readelf -W -h -l -S %s 2>&1", file);
+	p = popen(cmd, "r");
+	while (p && fgets(line, sizeof(line), p)) {
+		if (strstr(line, "Warning") || strstr(line, "Error")) {
+			printf("  %s", line);
+			bad = 1;
+		}
+	}
+	st = p ? pclose(p) : -1;
+
+	return check(what, !bad && st == 0);
+}
+
+// every way of writing the same ELF, all have to agree
+static int write_all_ways(const char *what, struct elfout_t *e, const char *dir, const struct want_t *want, uint32_t nwant)
+{
+	static const char *modes[] = { "auto", "copy", "writev", "buffer", "pipe" };
+	uint8_t *first = NULL;
+	uint64_t first_size = 0;
+	char file[512], msg[128];
+	int fail = 0;
+
+	for (int m = 0; m < 5; m++) {
+		uint8_t *buf;
+		uint64_t size;
+		int fd;
+
+		snprintf(file, sizeof(file), "%s/out-%s.elf", dir, modes[m]);
+		if (m < 4) {
+			fd = open(file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+			// something left over that has to go
+			if (write(fd, "stale", 5) != 5 || lseek(fd, 0, SEEK_SET) != 0) {
+				return check("stale", 0);
+			}
+			snprintf(msg, sizeof(msg), "%s %s write", what, modes[m]);
+			fail |= check(msg, elfout_write(e, fd, m) == 0);
+			close(fd);
+		} else {
+			int pfd[2], out = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			uint8_t chunk[65536];
+			ssize_t n;
+			pid_t pid;
+
+			if (pipe(pfd) < 0) {
+				return check("pipe", 0);
+			}
+			pid = fork();
+			if (pid == 0) {
+				close(pfd[0]);
+				_exit(elfout_write(e, pfd[1], ELFOUT_AUTO) == 0 ? 0 : 1);
+			}
+			close(pfd[1]);
+			while ((n = read(pfd[0], chunk, sizeof(chunk))) > 0) {
+				if (write(out, chunk, n) != n) {
+					break;
+				}
+			}
+			close(pfd[0]);
+			close(out);
+			waitpid(pid, &fd, 0);
+			snprintf(msg, sizeof(msg), "%s pipe write", what);
+			fail |= check(msg, WIFEXITED(fd) && WEXITSTATUS(fd) == 0);
+		}
+
+		buf = load(file, &size);
+		snprintf(msg, sizeof(msg), "%s %s size", what, modes[m]);
+		fail |= check(msg, buf && size == e->size);
+		if (buf == NULL) {
+			return 1;
+		}
+
+		if (first == NULL) {
+			snprintf(msg, sizeof(msg), "%s %s", what, modes[m]);
+			fail |= elf_check(msg, buf, size, want, nwant, e->entry);
+			snprintf(msg, sizeof(msg), "%s readelf", what);
+			fail |= readelf_check(msg, file);
+			first = buf;
+			first_size = size;
+		} else {
+			snprintf(msg, sizeof(msg), "%s %s same as auto", what, modes[m]);
+			fail |= check(msg, size == first_size && memcmp(buf, first, size) == 0);
+			free(buf);
+		}
+	}
+	free(first);
+
+	return fail;
+}
+
+struct dump_t {
+	uint32_t base;
+	uint32_t size;
+	uint32_t file_size;      // short of size for a dump cut off
+	uint8_t *data;
+};
+
+static struct dump_t dumps[] = {
+	{ 0xc0050000, 0x00008000, 0x00008000 },
+	{ 0x00000000, 0x00080000, 0x00080000 },
+	{ 0xc0020000, 0x00020000, 0x00020000 },
+	{ 0x03f00000, 0x00050000, 0x00050000 },
+	{ 0x04000000, 0x00010000, 0x0000c000 },
+	{ 0xc0000000, 0x00020000, 0x00020000 },
+	{ 0x80000000, 0x00010000, 0x00010000 },
+};
+
+#define DUMPS (sizeof(dumps) / sizeof(dumps[0]))
+
+static int check_dumps(const char *dir)
+{
+	static struct elfout_t e;
+	static uint8_t c0[0x40000];
+	char file[512];
+	int fail = 0;
+
+	for (uint32_t i = 0; i < DUMPS; i++) {
+		dumps[i].data = malloc(dumps[i].size);
+		for (uint32_t j = 0; j < dumps[i].size; j++) {
+			dumps[i].data[j] = rng();
+		}
+		snprintf(file, sizeof(file), "%s/dump-%08x-%08x.bin", dir, dumps[i].base, dumps[i].size);
+		save(file, dumps[i].data, dumps[i].file_size);
+	}
+	memcpy(c0, dumps[5].data, 0x20000);
+	memcpy(c0 + 0x20000, dumps[2].data, 0x20000);
+
+	// in address order, the two dumps of ram next to each other as one
+	const struct want_t want[] = {
+		{ 0x00000000, 0x80000, PF_R | PF_W | PF_X, dumps[1].data, 0x80000, ".000" },
+		{ 0x03f00000, 0x50000, PF_R | PF_X, dumps[3].data, 0x50000, ".03f" },
+		{ 0x04000000, 0x10000, PF_R | PF_W | PF_X, dumps[4].data, 0xc000, ".040" },
+		{ 0x80000000, 0x10000, PF_R | PF_W, dumps[6].data, 0x10000, ".800" },
+		{ 0xc0000000, 0x40000, PF_R | PF_W | PF_X, c0, 0x40000, ".c00" },
+		{ 0xc0050000, 0x08000, PF_R | PF_W | PF_X, dumps[0].data, 0x8000, ".c00_c0050000" },
+	};
+
+	elfout_init(&e);
+	for (uint32_t i = 0; i < DUMPS; i++) {
+		snprintf(file, sizeof(file), "%s/dump-%08x-%08x.bin", dir, dumps[i].base, dumps[i].size);
+		fail |= check("dump", elfout_dump(&e, file) == 0);
+	}
+	fail |= check("dump layout", elfout_layout(&e) == 0);
+	fail |= write_all_ways("dumps", &e, dir, want, sizeof(want) / sizeof(want[0]));
+	elfout_close(&e);
+
+	printf("dumps:    %s\n", fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+static int check_map(const char *dir)
+{
+	static struct elfout_t e;
+	static uint8_t packed[0x1000 + 0x50000 + 0x10000];
+	char file[512];
+	FILE *f;
+	int fail = 0;
+
+	// two dumps packed into one file behind a header, one of them read
+	// from its offset to the end
+	memset(packed, 0xee, 0x1000);
+	memcpy(packed + 0x1000, dumps[3].data, 0x50000);
+	memcpy(packed + 0x51000, dumps[6].data, 0x10000);
+	snprintf(file, sizeof(file), "%s/packed.bin", dir);
+	save(file, packed, sizeof(packed));
+
+	snprintf(file, sizeof(file), "%s/map", dir);
+	f = fopen(file, "w");
+	fprintf(f, "# base     size   rwx  file                        name\n");
+	fprintf(f, "entry 03f00100\n");
+	fprintf(f, "00000000 80000  r-x  dump-00000000-00080000.bin  .text\n");
+	fprintf(f, "\n");
+	fprintf(f, "03f00000 50000  r-x  packed.bin@1000             .rom   # behind the header\n");
+	fprintf(f, "04000000 20000  rw-  dump-04000000-00010000.bin  .tcm\n");
+	fprintf(f, "80000000 -      rw-  packed.bin@51000\n");
+	fprintf(f, "90000000 c000   rw-  -                           .io\n");
+	fprintf(f, "c0000000 20000  rwx  dump-c0000000-00020000.bin\n");
+	fprintf(f, "c0020000 20000  rwx  dump-c0020000-00020000.bin  .c02\n");
+	fclose(f);
+
+	const struct want_t want[] = {
+		{ 0x00000000, 0x80000, PF_R | PF_X, dumps[1].data, 0x80000, ".text" },
+		{ 0x03f00000, 0x50000, PF_R | PF_X, dumps[3].data, 0x50000, ".rom" },
+		{ 0x04000000, 0x20000, PF_R | PF_W, dumps[4].data, 0xc000, ".tcm" },
+		{ 0x80000000, 0x10000, PF_R | PF_W, dumps[6].data, 0x10000, ".800" },
+		{ 0x90000000, 0x0c000, PF_R | PF_W, NULL, 0, ".io" },
+		// rows of a map are kept apart
+		{ 0xc0000000, 0x20000, PF_R | PF_W | PF_X, dumps[5].data, 0x20000, ".c00" },
+		{ 0xc0020000, 0x20000, PF_R | PF_W | PF_X, dumps[2].data, 0x20000, ".c02" },
+	};
+
+	elfout_init(&e);
+	fail |= check("map", elfout_map(&e, file) == 0);
+	fail |= check("map layout", elfout_layout(&e) == 0);
+	fail |= check("map entry", e.entry == 0x03f00100);
+	fail |= write_all_ways("map", &e, dir, want, sizeof(want) / sizeof(want[0]));
+	elfout_close(&e);
+
+	printf("map:      %s\n", fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+static int map_error(const char *dir, const char *text, int ret, uint32_t line)
+{
+	static struct elfout_t e;
+	char file[512];
+	int got;
+	FILE *f;
+
+	snprintf(file, sizeof(file), "%s/badmap", dir);
+	f = fopen(file, "w");
+	fputs(text, f);
+	fclose(f);
+
+	elfout_init(&e);
+	got = elfout_map(&e, file);
+	if (got == 0) {
+		got = elfout_layout(&e);
+		// the second of the two, in address order
+		line = (got == -3) ? e.failed : line;
+	}
+	elfout_close(&e);
+
+	if (got != ret || e.failed != line) {
+		printf("  %s  got %d at %u, want %d at %u\n", text, got, e.failed, ret, line);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int check_errors(const char *dir)
+{
+	static struct elfout_t e;
+	char file[512];
+	int fail = 0;
+
+	fail |= map_error(dir, "0 80000 rwx nothere.bin\n", -2, 1);
+	fail |= map_error(dir, "# fine\n0 80000 rwz dump-00000000-00080000.bin\n", -1, 2);
+	fail |= map_error(dir, "0 80000 rwx\n", -1, 1);
+	fail |= map_error(dir, "2 80000 rwx dump-00000000-00080000.bin\n", -1, 1);
+	fail |= map_error(dir, "0 80000 rwx dump-00000000-00080000.bin@90000\n", -1, 1);
+	fail |= map_error(dir, "0 - rwx -\n", -1, 1);
+	fail |= map_error(dir, "entry\n", -1, 1);
+	fail |= map_error(dir, "ffff0000 20000 rw- -\n", -1, 1);
+	fail |= map_error(dir, "0 80000 rwx dump-00000000-00080000.bin\n40000 1000 rw- -\n", -3, 1);
+	fail |= check("map errors", fail == 0);
+
+	elfout_init(&e);
+	snprintf(file, sizeof(file), "%s/packed.bin", dir);
+	fail |= check("not a dump name", elfout_dump(&e, file) == -1);
+	snprintf(file, sizeof(file), "%s/dump-00000000-00080000.bin.old", dir);
+	fail |= check("dump name suffix", elfout_dump(&e, file) == -1);
+	snprintf(file, sizeof(file), "%s/dump-00000002-00080000.bin", dir);
+	fail |= check("dump misaligned", elfout_dump(&e, file) == -1);
+	snprintf(file, sizeof(file), "%s/dump-0badc0d0-00001000.bin", dir);
+	fail |= check("dump missing", elfout_dump(&e, file) == -2);
+	elfout_close(&e);
+
+	// the same dump twice
+	elfout_init(&e);
+	snprintf(file, sizeof(file), "%s/dump-00000000-00080000.bin", dir);
+	elfout_dump(&e, file);
+	elfout_dump(&e, file);
+	fail |= check("dump twice", elfout_layout(&e) == -3);
+	elfout_close(&e);
+
+	printf("errors:   %s\n", fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+// the image walked here without elfout, checks left out
+static uint32_t image_want(const uint8_t *img, uint64_t size, struct want_t *want, uint8_t **mem, uint32_t *entry)
+{
+	uint64_t off = 0;
+	uint32_t n = 0;
+
+	while (off + 16 <= size) {
+		uint32_t h[4];
+
+		memcpy(h, img + off, 16);
+		off += 16;
+		if (h[0] == 4) {
+			*entry = h[1];
+			break;
+		}
+		if (n && want[n - 1].vaddr + want[n - 1].memsz == h[1] && !((h[1] ^ want[n - 1].vaddr) & 0xffc00000)) {
+			memcpy(mem[n - 1] + want[n - 1].memsz, img + off, h[2] - 4);
+			want[n - 1].memsz += h[2] - 4;
+		} else {
+			mem[n] = malloc(0x200000);
+			memcpy(mem[n], img + off, h[2] - 4);
+			want[n].vaddr = h[1];
+			want[n].memsz = h[2] - 4;
+			want[n].pf = (h[1] & 0xffc00000) == 0x03c00000 ? PF_R | PF_X
+				: ((h[1] & 0xffc00000) == 0x80000000 || (h[1] & 0xffc00000) == 0x90000000) ? PF_R | PF_W
+				: ((h[1] & 0xffc00000) == 0x00000000 || (h[1] & 0xffc00000) == 0x04000000
+					|| (h[1] & 0xffc00000) == 0xc0000000) ? PF_R | PF_W | PF_X : PF_R | PF_W;
+			want[n].name = NULL;
+			n++;
+		}
+		off += h[2];
+	}
+
+	for (uint32_t i = 0; i < n; i++) {
+		want[i].data = mem[i];
+		want[i].filesz = want[i].memsz;
+	}
+
+	return n;
+}
+
+static int check_image(const char *dir, const char *image)
+{
+	static struct elfout_t e;
+	struct want_t want[64];
+	uint8_t *mem[64];
+	uint32_t n, entry = ~0u;
+	uint64_t size;
+	uint8_t *img = load(image, &size);
+	char file[512];
+	int fail = 0;
+
+	if (img == NULL) {
+		printf("image:    %s not there, skipped\n", image);
+		return 0;
+	}
+
+	n = image_want(img, size, want, mem, &entry);
+
+	elfout_init(&e);
+	fail |= check("image", elfout_image(&e, image) == 0);
+	fail |= check("image layout", elfout_layout(&e) == 0);
+	fail |= check("image entry", e.entry == entry);
+	fail |= write_all_ways("image", &e, dir, want, n);
+	elfout_close(&e);
+
+	// a bit flipped in the header of the second block, in its data, then cut off
+	snprintf(file, sizeof(file), "%s/damaged.bin", dir);
+	for (int k = 0; k < 3; k++) {
+		uint32_t len0;
+		uint64_t at;
+
+		memcpy(&len0, img + 8, 4);
+		at = 16 + len0 + ((k == 0) ? 5 : 16 + 300);
+		img[at] ^= (k < 2) ? 0x20 : 0;
+		save(file, img, (k == 2) ? size / 2 : size);
+		img[at] ^= (k < 2) ? 0x20 : 0;
+
+		elfout_init(&e);
+		fail |= check("image damaged", elfout_image(&e, file) == -5 && (k == 2 || e.failed == 1));
+		elfout_close(&e);
+	}
+
+	for (uint32_t i = 0; i < n; i++) {
+		free(mem[i]);
+	}
+	free(img);
+
+	printf("image:    %s, %u segments\n", fail ? "FAIL" : "ok", n);
+
+	return fail;
+}
+
+// large dumps, each way of writing them, best of a few runs
+static int bench(const char *dir, uint32_t mib)
+{
+	static const char *modes[] = { "auto", "copy_file_range", "writev", "buffer (fread+fwrite)" };
+	static struct elfout_t e;
+	uint32_t seg = mib / 4, i;
+	char file[512];
+	uint8_t *chunk = malloc(1 << 20);
+
+	for (i = 0; i < (1 << 20); i++) {
+		chunk[i] = rng();
+	}
+
+	// four regions, the gaps between them keep the segments apart
+	elfout_init(&e);
+	for (i = 0; i < 4; i++) {
+		uint32_t base = i * 0x40000000;
+		int fd;
+
+		snprintf(file, sizeof(file), "%s/dump-%08x-%08x.bin", dir, base, seg << 20);
+		fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		for (uint32_t m = 0; m < seg; m++) {
+			chunk[m & 0xfffff] ^= m;
+			if (write(fd, chunk, 1 << 20) != 1 << 20) {
+				fprintf(stderr, "%s: write failed\n", file);
+				return 1;
+			}
+		}
+		close(fd);
+		if (elfout_dump(&e, file) < 0) {
+			return 1;
+		}
+	}
+	elfout_layout(&e);
+	free(chunk);
+
+	printf("%u MiB in %u segments\n", 4 * seg, e.nseg);
+	printf("%-24s %10s %10s %8s\n", "", "ms", "MiB/s", "calls");
+
+	for (int m = ELFOUT_AUTO; m <= ELFOUT_BUFFER; m++) {
+		double best = 1e9;
+
+		for (int run = 0; run < 3; run++) {
+			double t0;
+			int fd;
+
+			snprintf(file, sizeof(file), "%s/bench.elf", dir);
+			unlink(file);
+			fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			t0 = now();
+			if (elfout_write(&e, fd, m) < 0) {
+				fprintf(stderr, "%s: write failed\n", modes[m]);
+				return 1;
+			}
+			fsync(fd);
+			close(fd);
+			if (now() - t0 < best) {
+				best = now() - t0;
+			}
+		}
+		printf("%-24s %10.1f %10.0f %8u\n", modes[m], best * 1e3, e.size / best / (1 << 20), e.calls);
+	}
+
+	// into a pipe, the way bin2elf > x.elf in a pipeline writes
+	for (int m = ELFOUT_WRITEV; m <= ELFOUT_BUFFER; m++) {
+		static uint8_t sink[1 << 16];
+		int pfd[2], st;
+		double t0;
+		pid_t pid;
+
+		if (pipe(pfd) < 0) {
+			return 1;
+		}
+		t0 = now();
+		pid = fork();
+		if (pid == 0) {
+			close(pfd[0]);
+			_exit(elfout_write(&e, pfd[1], m) == 0 ? 0 : 1);
+		}
+		close(pfd[1]);
+		while (read(pfd[0], sink, sizeof(sink)) > 0);
+		close(pfd[0]);
+		waitpid(pid, &st, 0);
+		printf("%-24s %10.1f %10.0f\n", (m == ELFOUT_WRITEV) ? "writev into a pipe" : "buffer into a pipe",
+			(now() - t0) * 1e3, e.size / (now() - t0) / (1 << 20));
+	}
+
+	elfout_close(&e);
+	snprintf(file, sizeof(file), "%s/bench.elf", dir);
+	unlink(file);
+	for (i = 0; i < 4; i++) {
+		snprintf(file, sizeof(file), "%s/dump-%08x-%08x.bin", dir, i * 0x40000000, seg << 20);
+		unlink(file);
+	}
+
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-b] [-m MiB] [-s seed] [-i image] [-o dir]\n", name);
+	fprintf(stderr, "  -b  write speed for large dumps instead of the checks\n");
+	fprintf(stderr, "  -m  size of the dumps for -b (512)\n");
+	fprintf(stderr, "  -i  firmware image to convert (doc/marvell/sd8787_uapsta.bin)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	char image[512];
+	const char *dir = "/tmp/bin2elftest";
+	const char *src = __FILE__, *slash = strrchr(src, '/');
+	uint32_t mib = 512;
+	int opt, fail = 0, do_bench = 0;
+
+	snprintf(image, sizeof(image), "%.*s../../doc/marvell/sd8787_uapsta.bin", slash ? (int)(slash - src + 1) : 0, src);
+
+	while ((opt = getopt(argc, argv, "bm:s:i:o:h")) != -1) {
+		switch (opt) {
+		case 'b': do_bench = 1; break;
+		case 'm': mib = strtoul(optarg, NULL, 0); break;
+		case 's': rng_state = strtoul(optarg, NULL, 0) | 1; break;
+		case 'i': snprintf(image, sizeof(image), "%s", optarg); break;
+		case 'o': dir = optarg; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	mkdir(dir, 0755);
+
+	if (do_bench) {
+		return bench(dir, mib < 4 ? 4 : mib);
+	}
+
+	fail |= check_dumps(dir);
+	fail |= check_map(dir);
+	fail |= check_errors(dir);
+	fail |= check_image(dir, image);
+
+	printf("%s\n", fail ? "FAIL" : "ok");
+
+	return fail ? 2 : 0;
+}
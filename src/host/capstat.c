@@ -0,0 +1,1310 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pcap.h"
+#include "radiotap.h"
+#include "rtap.h"
+#include "dot11.h"
+#include "airtime.h"
+
+// offline capture statistics: per bss airtime, rate and mcs use, retries,
+// snr and channel utilization from a pcap or pcapng file
+// the file is mapped and cut into chunks that threads parse independently,
+// a chunk starts at the first offset past its nominal start where a chain of
+// plausible records begins, and each thread parses past its nominal end up
+// to the next record boundary, so the chunks only have to agree at the
+// seams: where one stopped is where the next one started, checked after the
+// run, anything else falls back to a single pass
+// all totals are integers, merged results do not depend on the split, an
+// a-mpdu a chunk start cuts is charged after the run, see ampdu_settle
+
+#define MAX_THREADS   64
+#define MAX_IFACE     16
+#define SYNC_RECS     8          // records that have to chain up at a chunk start
+#define CHUNK_MIN     (16 << 20)
+#define NUM_FREQ      8192
+#define SNR_MAX       80
+#define TS_WINDOW     (1u << 25) // seconds around the first record a timestamp may be
+
+#define PCAPNG_SHB    0x0a0d0d0a
+#define PCAPNG_IDB    1
+#define PCAPNG_PB     2
+#define PCAPNG_SPB    3
+#define PCAPNG_NRB    4
+#define PCAPNG_ISB    5
+#define PCAPNG_EPB    6
+#define PCAPNG_DSB    10
+#define PCAPNG_MAGIC  0x1a2b3c4d
+
+#define LINK_80211    105
+#define LINK_RADIOTAP 127
+
+#define FC_RETRY      0x0800
+
+struct iface_t {
+	uint32_t linktype;
+	uint32_t snaplen;
+	uint64_t per_sec;        // timestamp units per second
+};
+
+struct cap_t {
+	const uint8_t *p;
+	uint64_t len;
+	int ng;                  // pcapng
+	int swap;                // other byte order than ours
+	int ns;                  // pcap with nanosecond timestamps
+	uint32_t ts_first;       // pcap seconds of the first record
+	uint64_t data_off;       // first record, past file and interface headers
+	struct iface_t ifs[MAX_IFACE];
+	uint32_t nif;
+};
+
+struct bss_t {
+	uint8_t bssid[6];
+	uint8_t used;
+	uint8_t ssid_len;
+	char ssid[32];
+	uint8_t chan;            // from the ds parameter set, 0 when not seen
+	uint64_t frames;
+	uint64_t bytes;
+	uint64_t retries;
+	uint64_t air_us;
+	int64_t snr_sum;
+	uint64_t snr_n;
+};
+
+struct chan_t {
+	uint64_t frames;
+	uint64_t air_us;
+	uint64_t dwell_us;       // time between consecutive frames on it
+};
+
+// an a-mpdu cut by a chunk start: its mpdus at the start of a chunk are
+// only sized, the one still open at the end of the chunk before is kept,
+// the charge is settled after the run with both at hand
+// its mpdus share addresses and channel, the first one gets the charge
+struct amp_run_t {
+	struct airtime_ampdu_t amp;
+	uint8_t bssid[6];
+	uint8_t has_bss;
+	uint8_t open;            // ran to the end of the chunk
+	uint32_t freq;
+};
+
+struct stats_t {
+	uint64_t frames;
+	uint64_t bytes;
+	uint64_t bad;            // radiotap or 802.11 header not parseable
+	uint64_t fcs_bad;
+	uint64_t resync_bytes;   // skipped looking for the next record
+	uint64_t retries;
+	uint64_t type[4];
+	uint64_t air_us;
+	uint64_t ts_min;
+	uint64_t ts_max;
+	uint64_t legacy[256];    // by rate in 500 kbps
+	uint64_t ht[32][2][2];   // mcs, 40 MHz, short gi
+	uint64_t vht[8][10];     // nss - 1, mcs
+	uint64_t snr[SNR_MAX + 1];
+	uint64_t no_bss;         // frames without a bssid, acks, cts and probe requests mostly
+	struct chan_t chan[NUM_FREQ];
+	uint32_t last_freq;
+	uint64_t last_ts;
+	struct bss_t *bss;
+	uint32_t nbss;
+	uint32_t bss_cap;
+	int abort;               // needs a single pass, see parse_ng
+	struct airtime_ampdu_t amp;
+	struct amp_run_t *lead;  // while at the start of a chunk
+	struct rtap_cache_t rtc;
+	struct dot11_ie_set_t ies;
+};
+
+struct chunk_t {
+	uint64_t start;          // nominal, then where parsing began
+	uint64_t end;            // nominal
+	uint64_t reached;        // first record boundary at or past end
+	struct amp_run_t lead;
+	struct airtime_ampdu_t tail;
+};
+
+struct run_t {
+	struct cap_t *cap;
+	struct chunk_t *chunks;
+	uint32_t nchunks;
+	uint32_t next;
+	struct stats_t *stats;
+};
+
+static const uint64_t ies_want[] = { DOT11_IE_SSID, DOT11_IE_DS_PARAMS };
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline uint32_t rd16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t cap32(const struct cap_t *c, const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, 4);
+
+	return c->swap ? __builtin_bswap32(v) : v;
+}
+
+static inline uint32_t cap16(const struct cap_t *c, const uint8_t *p)
+{
+	uint16_t v;
+
+	memcpy(&v, p, 2);
+
+	return c->swap ? __builtin_bswap16(v) : v;
+}
+
+struct phy_t {
+	uint8_t kind;            // 0 legacy, 1 ht, 2 vht
+	uint8_t rate;            // legacy, 500 kbps
+	uint8_t mcs;
+	uint8_t nss;
+	uint8_t bw;              // 0 20, 1 40, 2 80, 3 160 MHz
+	uint8_t sgi;
+};
+
+static struct bss_t *bss_get(struct stats_t *s, const uint8_t *bssid)
+{
+	uint32_t i, h;
+
+	if (2 * (s->nbss + 1) > s->bss_cap) {
+		struct bss_t *old = s->bss;
+		uint32_t n = s->bss_cap;
+
+		s->bss_cap = n ? 2 * n : 256;
+		s->bss = calloc(s->bss_cap, sizeof(struct bss_t));
+		s->nbss = 0;
+		for (i = 0; i < n; i++) {
+			if (old[i].used) {
+				*bss_get(s, old[i].bssid) = old[i];
+			}
+		}
+		free(old);
+	}
+
+	h = (bssid[5] | bssid[4] << 8 | bssid[3] << 16) * 0x9e3779b1;
+	for (i = h >> 8;; i++) {
+		struct bss_t *b = &s->bss[i & (s->bss_cap - 1)];
+
+		if (!b->used) {
+			b->used = 1;
+			memcpy(b->bssid, bssid, 6);
+			s->nbss++;
+			return b;
+		}
+		if (memcmp(b->bssid, bssid, 6) == 0) {
+			return b;
+		}
+	}
+}
+
+// the longest ssid wins, then the smaller one, whatever order frames come in
+static void bss_ssid(struct bss_t *b, const uint8_t *ssid, uint32_t len)
+{
+	if (len > sizeof(b->ssid)) {
+		return;
+	}
+	if (len > b->ssid_len || (len == b->ssid_len && memcmp(ssid, b->ssid, len) < 0)) {
+		memcpy(b->ssid, ssid, len);
+		b->ssid_len = len;
+	}
+}
+
+static void stats_init(struct stats_t *s)
+{
+	memset(s, 0, sizeof(*s));
+	s->ts_min = UINT64_MAX;
+	rtap_cache_init(&s->rtc);
+	dot11_ie_set_init(&s->ies, ies_want, sizeof(ies_want) / sizeof(ies_want[0]));
+}
+
+// charge of one frame, mpdus of an a-mpdu that starts the chunk are only sized
+static uint32_t frame_airtime(struct stats_t *s, uint32_t rate, uint32_t flags, int ampdu, uint32_t ref, uint32_t len,
+	const struct dot11_hdr_t *h, uint32_t freq)
+{
+	struct amp_run_t *r = s->lead;
+
+	if (r && ampdu) {
+		if (r->amp.rate == AIRTIME_NONE) {
+			r->has_bss = h->bssid && memcmp(h->bssid, "\xff\xff\xff\xff\xff\xff", 6) != 0;
+			if (r->has_bss) {
+				memcpy(r->bssid, h->bssid, 6);
+			}
+			r->freq = freq;
+			airtime_ampdu(&r->amp, ref, rate, len, flags);
+			return 0;
+		}
+		if (r->amp.ref == ref && r->amp.rate == rate && r->amp.flags == flags) {
+			airtime_ampdu(&r->amp, ref, rate, len, flags);
+			return 0;
+		}
+	}
+	if (r) {
+		r->open = 0;
+		s->lead = NULL;
+	}
+
+	if (!ampdu) {
+		airtime_ampdu_end(&s->amp);
+		return airtime_us(rate, len, flags);
+	}
+
+	return airtime_ampdu(&s->amp, ref, rate, len, flags);
+}
+
+static void frame(struct stats_t *s, uint32_t linktype, uint64_t ts, const uint8_t *f, uint32_t len, uint32_t orig)
+{
+	struct phy_t phy = { 0 };
+	struct dot11_hdr_t h;
+	uint32_t freq = 0, fcs = 0, air, rate, flags = 0, ref = 0;
+	int sig = 0, noise = 0, have_sig = 0, have_noise = 0, ampdu = 0;
+
+	if (linktype == LINK_RADIOTAP) {
+		const struct rtap_layout_t *l = rtap_parse(&s->rtc, f, len);
+		const uint8_t *v;
+		uint32_t it_len;
+
+		if (l == NULL) {
+			s->bad++;
+			return;
+		}
+
+		if ((v = rtap_get(l, f, IEEE80211_RADIOTAP_FLAGS)) != NULL) {
+			if (v[0] & IEEE80211_RADIOTAP_F_BADFCS) {
+				s->fcs_bad++;
+				return;
+			}
+			fcs = (v[0] & IEEE80211_RADIOTAP_F_FCS) != 0;
+			flags |= (v[0] & IEEE80211_RADIOTAP_F_SHORTPRE) ? AIRTIME_F_SHORTPRE : 0;
+		}
+		if ((v = rtap_get(l, f, IEEE80211_RADIOTAP_RATE)) != NULL) {
+			phy.rate = v[0];
+		}
+		if ((v = rtap_get(l, f, IEEE80211_RADIOTAP_CHANNEL)) != NULL) {
+			freq = rd16(v);
+			if ((rd16(v + 2) & IEEE80211_CHAN_2GHZ) || (freq && freq < 3000)) {
+				flags |= AIRTIME_F_2GHZ;
+			}
+		}
+		if ((v = rtap_get(l, f, IEEE80211_RADIOTAP_DBM_ANTSIGNAL)) != NULL ||
+		    (v = rtap_get(l, f, IEEE80211_RADIOTAP_DB_ANTSIGNAL)) != NULL) {
+			sig = (int8_t)v[0];
+			have_sig = 1;
+		}
+		if ((v = rtap_get(l, f, IEEE80211_RADIOTAP_DBM_ANTNOISE)) != NULL ||
+		    (v = rtap_get(l, f, IEEE80211_RADIOTAP_DB_ANTNOISE)) != NULL) {
+			noise = (int8_t)v[0];
+			have_noise = 1;
+		}
+		if ((v = rtap_get(l, f, IEEE80211_RADIOTAP_MCS)) != NULL && (v[0] & IEEE80211_RADIOTAP_MCS_HAVE_MCS)) {
+			phy.kind = 1;
+			phy.mcs = v[2] & 31;
+			phy.bw = (v[0] & IEEE80211_RADIOTAP_MCS_HAVE_BW) && (v[1] & IEEE80211_RADIOTAP_MCS_BW_MASK) == IEEE80211_RADIOTAP_MCS_BW_40;
+			phy.sgi = (v[0] & IEEE80211_RADIOTAP_MCS_HAVE_GI) && (v[1] & IEEE80211_RADIOTAP_MCS_SGI);
+			if ((v[0] & IEEE80211_RADIOTAP_MCS_HAVE_FMT) && (v[1] & IEEE80211_RADIOTAP_MCS_FMT_GF)) {
+				flags |= AIRTIME_F_GF;
+			}
+		}
+		if ((v = rtap_get(l, f, IEEE80211_RADIOTAP_VHT)) != NULL && (v[4] & 0xf)) {
+			static const uint8_t vht_bw[32] = {
+				0, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+			};
+			phy.kind = 2;
+			// first user only
+			phy.mcs = v[4] >> 4;
+			phy.nss = v[4] & 0xf;
+			phy.bw = vht_bw[v[3] & 31];
+			phy.sgi = (v[2] & 0x04) != 0;
+		}
+		if ((v = rtap_get(l, f, IEEE80211_RADIOTAP_AMPDU_STATUS)) != NULL) {
+			ampdu = 1;
+			ref = v[0] | (v[1] << 8) | (v[2] << 16) | ((uint32_t)v[3] << 24);
+		}
+
+		it_len = rd16(f + 2);
+		f += it_len;
+		len -= it_len;
+		orig -= (orig > it_len) ? it_len : orig;
+	} else if (linktype != LINK_80211) {
+		s->bad++;
+		return;
+	}
+
+	if (fcs && len >= 4) {
+		len -= 4;
+	}
+
+	if (dot11_hdr_parse(f, len, &h) < 0) {
+		s->bad++;
+		return;
+	}
+
+	if (phy.kind == 0) {
+		rate = airtime_legacy(phy.rate);
+	} else if (phy.kind == 1) {
+		rate = airtime_ht(phy.mcs, phy.bw, phy.sgi);
+	} else {
+		rate = airtime_vht(phy.mcs, phy.nss, phy.bw, phy.sgi);
+	}
+
+	// the psdu on air has the fcs whether it was captured or not
+	air = frame_airtime(s, rate, flags, ampdu && rate != AIRTIME_NONE, ref, fcs ? orig : orig + 4, &h, freq);
+
+	s->frames++;
+	s->bytes += len;
+	s->air_us += air;
+	s->type[DOT11_FC_TYPE(h.fc)]++;
+	if (ts < s->ts_min) {
+		s->ts_min = ts;
+	}
+	if (ts > s->ts_max) {
+		s->ts_max = ts;
+	}
+
+	if (phy.kind == 0) {
+		s->legacy[phy.rate]++;
+	} else if (phy.kind == 1) {
+		s->ht[phy.mcs][phy.bw][phy.sgi]++;
+	} else if (phy.mcs <= 9 && phy.nss >= 1 && phy.nss <= 8) {
+		s->vht[phy.nss - 1][phy.mcs]++;
+	}
+
+	if (h.fc & FC_RETRY) {
+		s->retries++;
+	}
+
+	int snr = -1;
+	if (have_sig && have_noise) {
+		snr = sig - noise;
+		snr = snr < 0 ? 0 : snr > SNR_MAX ? SNR_MAX : snr;
+		s->snr[snr]++;
+	}
+
+	if (freq && freq < NUM_FREQ) {
+		struct chan_t *ch = &s->chan[freq];
+
+		ch->frames++;
+		ch->air_us += air;
+		// gaps over a second are the capture being off the channel
+		if (freq == s->last_freq && ts >= s->last_ts && ts - s->last_ts < 1000000) {
+			ch->dwell_us += ts - s->last_ts;
+		}
+		s->last_freq = freq;
+		s->last_ts = ts;
+	}
+
+	// probe requests carry the wildcard
+	if (h.bssid == NULL || memcmp(h.bssid, "\xff\xff\xff\xff\xff\xff", 6) == 0) {
+		s->no_bss++;
+		return;
+	}
+
+	struct bss_t *b = bss_get(s, h.bssid);
+
+	b->frames++;
+	b->bytes += len;
+	b->air_us += air;
+	if (h.fc & FC_RETRY) {
+		b->retries++;
+	}
+	if (snr >= 0) {
+		b->snr_sum += snr;
+		b->snr_n++;
+	}
+
+	if (DOT11_FC_TYPE(h.fc) == DOT11_TYPE_MGMT &&
+	    (DOT11_FC_SUBTYPE(h.fc) == DOT11_BEACON || DOT11_FC_SUBTYPE(h.fc) == DOT11_PROBE_RESP)) {
+		struct dot11_ie_t ie[2];
+		const uint8_t *p;
+		uint32_t n;
+		int ch;
+
+		if (dot11_mgmt_ies(&h, &p, &n) == 0) {
+			dot11_ie_parse(&s->ies, p, n, ie);
+			if (ie[0].p) {
+				bss_ssid(b, ie[0].p, ie[0].len);
+			}
+			ch = dot11_ie_ds_channel(&ie[1]);
+			if (ch > b->chan) {
+				b->chan = ch;
+			}
+		}
+	}
+}
+
+// plausible pcap record at off, with its data inside the file
+static int pcap_rec_ok(const struct cap_t *c, uint64_t off)
+{
+	const uint8_t *r = c->p + off;
+	uint32_t sec, frac, incl, orig;
+
+	if (off + sizeof(pcaprec_hdr_t) > c->len) {
+		return 0;
+	}
+
+	sec = cap32(c, r);
+	frac = cap32(c, r + 4);
+	incl = cap32(c, r + 8);
+	orig = cap32(c, r + 12);
+
+	if (incl > c->ifs[0].snaplen || incl > orig || frac >= (c->ns ? 1000000000u : 1000000u) ||
+	    sec - c->ts_first + TS_WINDOW > 2 * TS_WINDOW || incl > c->len - off - sizeof(pcaprec_hdr_t)) {
+		return 0;
+	}
+
+	if (c->ifs[0].linktype == LINK_RADIOTAP) {
+		r += sizeof(pcaprec_hdr_t);
+		if (incl < 8 || r[0] != 0 || rd16(r + 2) < 8 || rd16(r + 2) > incl) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+// plausible pcapng block at off, length repeated at its end
+static int ng_block_ok(const struct cap_t *c, uint64_t off)
+{
+	uint32_t type, blen;
+
+	if (off + 12 > c->len) {
+		return 0;
+	}
+
+	type = cap32(c, c->p + off);
+	blen = cap32(c, c->p + off + 4);
+
+	if ((blen & 3) || blen < 12 || blen > c->len - off || cap32(c, c->p + off + blen - 4) != blen) {
+		return 0;
+	}
+
+	switch (type) {
+	case PCAPNG_SHB: case PCAPNG_IDB: case PCAPNG_PB: case PCAPNG_SPB:
+	case PCAPNG_NRB: case PCAPNG_ISB: case PCAPNG_EPB: case PCAPNG_DSB:
+		return 1;
+	default:
+		// custom blocks
+		return type == 0xbad || type == 0x40000bad;
+	}
+}
+
+static inline uint64_t next_off(const struct cap_t *c, uint64_t off)
+{
+	if (c->ng) {
+		return off + cap32(c, c->p + off + 4);
+	}
+
+	return off + sizeof(pcaprec_hdr_t) + cap32(c, c->p + off + 8);
+}
+
+// first offset from off where SYNC_RECS records chain up, or the file ends
+// after fewer of them exactly at its end
+static uint64_t sync_at(const struct cap_t *c, uint64_t off)
+{
+	for (; off < c->len; off++) {
+		uint64_t o = off;
+		uint32_t k;
+
+		for (k = 0; k < SYNC_RECS && o < c->len; k++) {
+			if (!(c->ng ? ng_block_ok(c, o) : pcap_rec_ok(c, o))) {
+				break;
+			}
+			o = next_off(c, o);
+		}
+		if (k == SYNC_RECS || o == c->len) {
+			return off;
+		}
+	}
+
+	return c->len;
+}
+
+static uint64_t parse_pcap(const struct cap_t *c, uint64_t off, uint64_t end, struct stats_t *s)
+{
+	uint32_t linktype = c->ifs[0].linktype;
+
+	while (off < end) {
+		const uint8_t *r = c->p + off;
+
+		if (!pcap_rec_ok(c, off)) {
+			uint64_t n = sync_at(c, off + 1);
+			s->resync_bytes += n - off;
+			off = n;
+			continue;
+		}
+
+		uint32_t incl = cap32(c, r + 8);
+		uint64_t ts = (uint64_t)cap32(c, r) * 1000000 + (c->ns ? cap32(c, r + 4) / 1000 : cap32(c, r + 4));
+
+		frame(s, linktype, ts, r + sizeof(pcaprec_hdr_t), incl, cap32(c, r + 12));
+		off += sizeof(pcaprec_hdr_t) + incl;
+	}
+
+	return off;
+}
+
+static uint64_t ng_ts_us(const struct iface_t *i, uint64_t ts)
+{
+	if (i->per_sec == 1000000) {
+		return ts;
+	}
+
+	return (unsigned __int128)ts * 1000000 / i->per_sec;
+}
+
+static int ng_idb(struct cap_t *c, uint64_t off)
+{
+	const uint8_t *b = c->p + off;
+	uint32_t blen = cap32(c, b + 4), o = 16;
+	struct iface_t *i;
+
+	if (c->nif == MAX_IFACE || blen < 20) {
+		return -1;
+	}
+
+	i = &c->ifs[c->nif++];
+	i->linktype = cap16(c, b + 8);
+	i->snaplen = cap32(c, b + 12);
+	i->per_sec = 1000000;
+	if (i->snaplen == 0) {
+		i->snaplen = UINT32_MAX;
+	}
+
+	// options up to the trailing length
+	while (o + 4 <= blen - 4) {
+		uint32_t code = cap16(c, b + o), olen = cap16(c, b + o + 2);
+
+		if (code == 0 || o + 4 + olen > blen - 4) {
+			break;
+		}
+		if (code == 9 && olen >= 1) {
+			uint8_t r = b[o + 4];
+			uint32_t e = r & 0x7f, k;
+
+			if ((r & 0x80) && e < 64) {
+				i->per_sec = 1ull << e;
+			} else if (!(r & 0x80) && e <= 19) {
+				for (i->per_sec = 1, k = 0; k < e; k++) {
+					i->per_sec *= 10;
+				}
+			}
+		}
+		o += 4 + ((olen + 3) & ~3u);
+	}
+
+	return 0;
+}
+
+// a section header, its byte order holds until the next one
+static int ng_shb(struct cap_t *c, uint64_t off)
+{
+	uint32_t magic;
+
+	if (off + 28 > c->len) {
+		return -1;
+	}
+
+	memcpy(&magic, c->p + off + 8, 4);
+	if (magic == PCAPNG_MAGIC) {
+		c->swap = 0;
+	} else if (magic == __builtin_bswap32(PCAPNG_MAGIC)) {
+		c->swap = 1;
+	} else {
+		return -1;
+	}
+	c->nif = 0;
+
+	return 0;
+}
+
+// with c NULL in a worker, interface and section headers past the leading
+// ones stop the chunk, the run is redone in a single pass that has them
+static uint64_t parse_ng(const struct cap_t *cc, struct cap_t *c, uint64_t off, uint64_t end, struct stats_t *s)
+{
+	const struct cap_t *r = c ? c : cc;
+
+	while (off < end) {
+		const uint8_t *b = r->p + off;
+		const struct iface_t *i;
+		uint32_t type, blen, id, caplen, orig;
+		uint64_t ts;
+
+		if (!ng_block_ok(r, off)) {
+			uint64_t n = sync_at(r, off + 1);
+			s->resync_bytes += n - off;
+			off = n;
+			continue;
+		}
+
+		type = cap32(r, b);
+		blen = cap32(r, b + 4);
+
+		switch (type) {
+		case PCAPNG_EPB:
+		case PCAPNG_PB:
+			if (blen < 32) {
+				s->bad++;
+				break;
+			}
+			id = (type == PCAPNG_EPB) ? cap32(r, b + 8) : cap16(r, b + 8);
+			caplen = cap32(r, b + 20);
+			orig = cap32(r, b + 24);
+			if (id >= r->nif || caplen > blen - 32) {
+				s->bad++;
+				break;
+			}
+			i = &r->ifs[id];
+			ts = ng_ts_us(i, (uint64_t)cap32(r, b + 12) << 32 | cap32(r, b + 16));
+			frame(s, i->linktype, ts, b + 28, caplen, orig);
+			break;
+
+		case PCAPNG_SPB:
+			if (blen < 16 || r->nif == 0) {
+				s->bad++;
+				break;
+			}
+			orig = cap32(r, b + 8);
+			caplen = orig;
+			if (caplen > blen - 16) {
+				caplen = blen - 16;
+			}
+			if (caplen > r->ifs[0].snaplen) {
+				caplen = r->ifs[0].snaplen;
+			}
+			// no timestamp
+			frame(s, r->ifs[0].linktype, s->last_ts, b + 12, caplen, orig);
+			break;
+
+		case PCAPNG_SHB:
+		case PCAPNG_IDB:
+			if (c == NULL) {
+				s->abort = 1;
+				return off;
+			}
+			if (type == PCAPNG_SHB ? ng_shb(c, off) < 0 : ng_idb(c, off) < 0) {
+				s->bad++;
+			}
+			break;
+
+		default:
+			break;
+		}
+
+		off += blen;
+	}
+
+	return off;
+}
+
+static void chunk_begin(struct stats_t *s, struct chunk_t *ch)
+{
+	airtime_ampdu_end(&s->amp);
+	airtime_ampdu_end(&ch->lead.amp);
+	ch->lead.open = 1;
+	s->lead = &ch->lead;
+}
+
+static void chunk_end(struct stats_t *s, struct chunk_t *ch)
+{
+	ch->tail = s->amp;
+	s->lead = NULL;
+}
+
+// a-mpdus cut by chunk starts, with the chunks in file order: the part at a
+// chunk start adds what the whole one takes over the part before it
+static void ampdu_settle(struct stats_t *s, const struct chunk_t *chunks, uint32_t n)
+{
+	struct airtime_ampdu_t carry = { 0 }, a;
+	uint32_t k, air;
+
+	airtime_ampdu_end(&carry);
+
+	for (k = 0; k < n; k++) {
+		const struct amp_run_t *r = &chunks[k].lead;
+
+		a = r->amp;
+		if (a.rate != AIRTIME_NONE) {
+			if (carry.rate == a.rate && carry.ref == a.ref && carry.flags == a.flags) {
+				a.len += (carry.len + 3) & ~3u;
+				a.us = airtime_us(a.rate, a.len, a.flags);
+				air = a.us - carry.us;
+			} else {
+				air = a.us;
+			}
+
+			s->air_us += air;
+			if (r->freq && r->freq < NUM_FREQ) {
+				s->chan[r->freq].air_us += air;
+			}
+			if (r->has_bss) {
+				bss_get(s, r->bssid)->air_us += air;
+			}
+		}
+
+		// a chunk that is all one a-mpdu passes it on
+		if (!r->open) {
+			carry = chunks[k].tail;
+		} else if (a.rate != AIRTIME_NONE) {
+			carry = a;
+		}
+	}
+}
+
+static void *worker(void *arg)
+{
+	struct run_t *run = ((void **)arg)[0];
+	struct stats_t *s = ((void **)arg)[1];
+	uint32_t k;
+
+	while ((k = __sync_fetch_and_add(&run->next, 1)) < run->nchunks) {
+		struct chunk_t *ch = &run->chunks[k];
+
+		if (k > 0) {
+			ch->start = sync_at(run->cap, ch->start);
+		}
+
+		// a chunk does not carry the channel over from one it did not follow
+		s->last_freq = 0;
+		chunk_begin(s, ch);
+		if (run->cap->ng) {
+			ch->reached = parse_ng(run->cap, NULL, ch->start, ch->end, s);
+		} else {
+			ch->reached = parse_pcap(run->cap, ch->start, ch->end, s);
+		}
+		chunk_end(s, ch);
+		if (s->abort) {
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static void stats_merge(struct stats_t *d, const struct stats_t *s)
+{
+	uint32_t i;
+
+	d->frames += s->frames;
+	d->bytes += s->bytes;
+	d->bad += s->bad;
+	d->fcs_bad += s->fcs_bad;
+	d->resync_bytes += s->resync_bytes;
+	d->retries += s->retries;
+	d->air_us += s->air_us;
+	d->no_bss += s->no_bss;
+	for (i = 0; i < 4; i++) {
+		d->type[i] += s->type[i];
+	}
+	if (s->ts_min < d->ts_min) {
+		d->ts_min = s->ts_min;
+	}
+	if (s->ts_max > d->ts_max) {
+		d->ts_max = s->ts_max;
+	}
+	for (i = 0; i < 256; i++) {
+		d->legacy[i] += s->legacy[i];
+	}
+	for (i = 0; i < 32 * 2 * 2; i++) {
+		(&d->ht[0][0][0])[i] += (&s->ht[0][0][0])[i];
+	}
+	for (i = 0; i < 8 * 10; i++) {
+		(&d->vht[0][0])[i] += (&s->vht[0][0])[i];
+	}
+	for (i = 0; i <= SNR_MAX; i++) {
+		d->snr[i] += s->snr[i];
+	}
+	for (i = 0; i < NUM_FREQ; i++) {
+		d->chan[i].frames += s->chan[i].frames;
+		d->chan[i].air_us += s->chan[i].air_us;
+		d->chan[i].dwell_us += s->chan[i].dwell_us;
+	}
+	for (i = 0; i < s->bss_cap; i++) {
+		const struct bss_t *b = &s->bss[i];
+		struct bss_t *m;
+
+		if (!b->used) {
+			continue;
+		}
+		m = bss_get(d, b->bssid);
+		m->frames += b->frames;
+		m->bytes += b->bytes;
+		m->retries += b->retries;
+		m->air_us += b->air_us;
+		m->snr_sum += b->snr_sum;
+		m->snr_n += b->snr_n;
+		if (b->chan > m->chan) {
+			m->chan = b->chan;
+		}
+		bss_ssid(m, (const uint8_t *)b->ssid, b->ssid_len);
+	}
+}
+
+static void stats_free(struct stats_t *s)
+{
+	free(s->bss);
+	s->bss = NULL;
+}
+
+// result in out, a single pass when the chunks did not line up
+static int analyze(struct cap_t *c, uint32_t threads, uint64_t chunk_size, struct stats_t *out, uint32_t *chunks_used)
+{
+	struct stats_t *st = calloc(threads, sizeof(struct stats_t));
+	pthread_t tid[MAX_THREADS];
+	void *args[MAX_THREADS][2];
+	struct run_t run;
+	uint64_t span = c->len - c->data_off;
+	uint32_t i, n, started;
+	int ok = 1;
+
+	if (st == NULL) {
+		return -1;
+	}
+
+	// more chunks than threads so a slow one does not hold up the end
+	n = span / chunk_size;
+	if (n < threads) {
+		n = (span >= threads * 4096ull) ? threads : 1;
+	}
+
+	memset(&run, 0, sizeof(run));
+	run.cap = c;
+	run.nchunks = n;
+	run.chunks = calloc(n, sizeof(struct chunk_t));
+	if (run.chunks == NULL) {
+		free(st);
+		return -1;
+	}
+	run.stats = st;
+	for (i = 0; i < n; i++) {
+		run.chunks[i].start = c->data_off + span * i / n;
+		run.chunks[i].end = c->data_off + span * (i + 1) / n;
+	}
+
+	for (i = 0; i < threads; i++) {
+		stats_init(&st[i]);
+		args[i][0] = &run;
+		args[i][1] = &st[i];
+	}
+	// chunks are taken from a shared counter, the threads that did start
+	// get the ones a missing thread would have had
+	for (started = 1; started < threads; started++) {
+		if (pthread_create(&tid[started], NULL, worker, args[started]) != 0) {
+			break;
+		}
+	}
+	worker(args[0]);
+	for (i = 1; i < started; i++) {
+		pthread_join(tid[i], NULL);
+	}
+
+	for (i = 0; i < threads; i++) {
+		ok &= !st[i].abort;
+	}
+	for (i = 0; ok && i + 1 < n; i++) {
+		ok &= run.chunks[i].reached == run.chunks[i + 1].start;
+	}
+
+	stats_init(out);
+	if (ok) {
+		for (i = 0; i < threads; i++) {
+			stats_merge(out, &st[i]);
+		}
+		ampdu_settle(out, run.chunks, n);
+		*chunks_used = n;
+	} else {
+		struct cap_t cs = *c;
+		struct chunk_t one;
+
+		memset(&one, 0, sizeof(one));
+		chunk_begin(out, &one);
+		if (c->ng) {
+			parse_ng(NULL, &cs, c->data_off, c->len, out);
+		} else {
+			parse_pcap(c, c->data_off, c->len, out);
+		}
+		chunk_end(out, &one);
+		ampdu_settle(out, &one, 1);
+		*chunks_used = 1;
+	}
+
+	for (i = 0; i < threads; i++) {
+		stats_free(&st[i]);
+	}
+	free(st);
+	free(run.chunks);
+
+	return 0;
+}
+
+static int cap_open(struct cap_t *c, const char *file)
+{
+	struct stat st;
+	int fd;
+
+	memset(c, 0, sizeof(*c));
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(pcap_hdr_t)) {
+		close(fd);
+		return -2;
+	}
+
+	c->len = st.st_size;
+	c->p = mmap(NULL, c->len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (c->p == MAP_FAILED) {
+		return -1;
+	}
+	madvise((void *)c->p, c->len, MADV_SEQUENTIAL);
+
+	uint32_t magic;
+	memcpy(&magic, c->p, 4);
+
+	if (magic == PCAPNG_SHB) {
+		uint64_t off = 0;
+
+		c->ng = 1;
+		if (ng_shb(c, 0) < 0 || !ng_block_ok(c, 0)) {
+			return -2;
+		}
+
+		// interfaces described ahead of the first packet are known to all chunks
+		while (off < c->len && ng_block_ok(c, off)) {
+			uint32_t type = cap32(c, c->p + off);
+
+			if (type == PCAPNG_IDB) {
+				ng_idb(c, off);
+			} else if (type != PCAPNG_SHB || off != 0) {
+				break;
+			}
+			off = next_off(c, off);
+		}
+		c->data_off = off;
+
+		return 0;
+	}
+
+	if (magic == 0xa1b2c3d4 || magic == 0xa1b23c4d) {
+		c->swap = 0;
+	} else if (magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1) {
+		c->swap = 1;
+	} else {
+		return -2;
+	}
+
+	c->ns = (magic == 0xa1b23c4d || magic == 0x4d3cb2a1);
+	c->ifs[0].snaplen = cap32(c, c->p + 16);
+	c->ifs[0].linktype = cap32(c, c->p + 20);
+	c->nif = 1;
+	if (c->ifs[0].snaplen == 0) {
+		c->ifs[0].snaplen = UINT32_MAX;
+	}
+	// some writers put 65535 there and still write jumbo records
+	if (c->ifs[0].snaplen < 262144) {
+		c->ifs[0].snaplen = 262144;
+	}
+	c->data_off = sizeof(pcap_hdr_t);
+	if (c->len >= sizeof(pcap_hdr_t) + 4) {
+		c->ts_first = cap32(c, c->p + sizeof(pcap_hdr_t));
+	}
+
+	return 0;
+}
+
+// fingerprint of everything that must not depend on the number of threads,
+// dwell times do as a chunk starts without the previous frame
+static uint64_t stats_digest(const struct stats_t *s)
+{
+	uint64_t h = 0xcbf29ce484222325ull;
+	uint64_t v[12];
+	uint32_t i, j;
+
+#define MIX(x) do { uint64_t _x = (x); for (j = 0; j < 8; j++) { h = (h ^ (uint8_t)(_x >> (8 * j))) * 0x100000001b3ull; } } while (0)
+
+	v[0] = s->frames; v[1] = s->bytes; v[2] = s->bad; v[3] = s->fcs_bad; v[4] = s->retries;
+	v[5] = s->air_us; v[6] = s->ts_min; v[7] = s->ts_max; v[8] = s->no_bss; v[9] = s->nbss;
+	v[10] = s->resync_bytes; v[11] = s->type[0] ^ s->type[1] << 20 ^ s->type[2] << 40;
+	for (i = 0; i < 12; i++) {
+		MIX(v[i]);
+	}
+	for (i = 0; i < 256; i++) {
+		MIX(s->legacy[i]);
+	}
+	for (i = 0; i < 32 * 2 * 2; i++) {
+		MIX((&s->ht[0][0][0])[i]);
+	}
+	for (i = 0; i < 8 * 10; i++) {
+		MIX((&s->vht[0][0])[i]);
+	}
+	for (i = 0; i <= SNR_MAX; i++) {
+		MIX(s->snr[i]);
+	}
+	for (i = 0; i < NUM_FREQ; i++) {
+		MIX(s->chan[i].frames);
+		MIX(s->chan[i].air_us);
+	}
+
+	// the bss table order depends on insertion, sum per entry hashes instead
+	uint64_t bh = 0;
+	for (i = 0; i < s->bss_cap; i++) {
+		const struct bss_t *b = &s->bss[i];
+		uint64_t e = 0xcbf29ce484222325ull;
+
+		if (!b->used) {
+			continue;
+		}
+		for (j = 0; j < 6; j++) {
+			e = (e ^ b->bssid[j]) * 0x100000001b3ull;
+		}
+		for (j = 0; j < b->ssid_len; j++) {
+			e = (e ^ (uint8_t)b->ssid[j]) * 0x100000001b3ull;
+		}
+		e = (e ^ b->chan ^ b->frames << 8 ^ b->bytes << 24 ^ b->retries << 40) * 0x100000001b3ull;
+		e = (e ^ b->air_us ^ (uint64_t)b->snr_sum << 32 ^ b->snr_n) * 0x100000001b3ull;
+		bh += e;
+	}
+	MIX(bh);
+
+#undef MIX
+
+	return h;
+}
+
+static int cmp_bss_air(const void *a, const void *b)
+{
+	const struct bss_t *x = a, *y = b;
+
+	if (x->air_us != y->air_us) {
+		return (x->air_us < y->air_us) - (x->air_us > y->air_us);
+	}
+
+	return memcmp(x->bssid, y->bssid, 6);
+}
+
+static double pct(uint64_t a, uint64_t b)
+{
+	return b ? a * 100.0 / b : 0.0;
+}
+
+static void report(const struct stats_t *s, uint32_t top)
+{
+	double span = (s->ts_max > s->ts_min) ? (s->ts_max - s->ts_min) / 1e6 : 0.0;
+	uint64_t n;
+	uint32_t i, j, k;
+
+	printf("frames:   %llu (%llu bytes), mgmt %llu ctrl %llu data %llu, bad %llu, fcs errors %llu, resync %llu bytes\n",
+		(unsigned long long)s->frames, (unsigned long long)s->bytes, (unsigned long long)s->type[0],
+		(unsigned long long)s->type[1], (unsigned long long)s->type[2], (unsigned long long)s->bad,
+		(unsigned long long)s->fcs_bad, (unsigned long long)s->resync_bytes);
+	printf("span:     %.3f s, airtime %.3f s, retries %llu (%.2f%%)\n", span, s->air_us / 1e6,
+		(unsigned long long)s->retries, pct(s->retries, s->frames));
+
+	printf("\nchannel   frames       airtime ms   dwell ms     util\n");
+	for (i = 0; i < NUM_FREQ; i++) {
+		const struct chan_t *c = &s->chan[i];
+		if (c->frames) {
+			printf("%-9u %-12llu %-12.1f %-12.1f %5.1f%%\n", i, (unsigned long long)c->frames, c->air_us / 1e3,
+				c->dwell_us / 1e3, c->dwell_us ? c->air_us * 100.0 / c->dwell_us : 0.0);
+		}
+	}
+
+	// busiest first
+	struct bss_t *b = malloc((s->nbss + 1) * sizeof(struct bss_t));
+	for (i = 0, n = 0; i < s->bss_cap; i++) {
+		if (s->bss[i].used) {
+			b[n++] = s->bss[i];
+		}
+	}
+	qsort(b, n, sizeof(struct bss_t), cmp_bss_air);
+
+	printf("\nbssid             ch  ssid                              frames       airtime ms   air%%    retry%%  snr\n");
+	for (i = 0; i < n && i < top; i++) {
+		char ssid[33];
+
+		for (j = 0; j < b[i].ssid_len; j++) {
+			ssid[j] = (b[i].ssid[j] >= 0x20 && b[i].ssid[j] < 0x7f) ? b[i].ssid[j] : '.';
+		}
+		ssid[j] = 0;
+		printf("%02x:%02x:%02x:%02x:%02x:%02x %-3u %-33s %-12llu %-12.1f %5.1f%%  %5.1f%%  %.1f\n",
+			b[i].bssid[0], b[i].bssid[1], b[i].bssid[2], b[i].bssid[3], b[i].bssid[4], b[i].bssid[5],
+			b[i].chan, ssid, (unsigned long long)b[i].frames, b[i].air_us / 1e3, pct(b[i].air_us, s->air_us),
+			pct(b[i].retries, b[i].frames), b[i].snr_n ? (double)b[i].snr_sum / b[i].snr_n : 0.0);
+	}
+	if (n > top) {
+		printf("... %llu more\n", (unsigned long long)(n - top));
+	}
+	printf("no bssid: %llu frames\n", (unsigned long long)s->no_bss);
+	free(b);
+
+	printf("\nrate        frames       share\n");
+	for (i = 0; i < 256; i++) {
+		if (s->legacy[i]) {
+			printf("%5.1f Mb/s  %-12llu %5.1f%%\n", i / 2.0, (unsigned long long)s->legacy[i], pct(s->legacy[i], s->frames));
+		}
+	}
+	for (i = 0; i < 32; i++) {
+		for (j = 0; j < 2; j++) {
+			for (k = 0; k < 2; k++) {
+				if (s->ht[i][j][k]) {
+					printf("ht mcs %-2u %s %s %-12llu %5.1f%%\n", i, j ? "40" : "20", k ? "sgi" : "lgi",
+						(unsigned long long)s->ht[i][j][k], pct(s->ht[i][j][k], s->frames));
+				}
+			}
+		}
+	}
+	for (i = 0; i < 8; i++) {
+		for (j = 0; j < 10; j++) {
+			if (s->vht[i][j]) {
+				printf("vht mcs %u nss %u  %-12llu %5.1f%%\n", j, i + 1, (unsigned long long)s->vht[i][j],
+					pct(s->vht[i][j], s->frames));
+			}
+		}
+	}
+
+	uint64_t snr_n = 0, snr_top = 0;
+	for (i = 0; i <= SNR_MAX; i++) {
+		snr_n += s->snr[i];
+	}
+	for (i = 0; i <= SNR_MAX; i += 5) {
+		uint64_t c = 0;
+		for (j = i; j < i + 5 && j <= SNR_MAX; j++) {
+			c += s->snr[j];
+		}
+		snr_top = c > snr_top ? c : snr_top;
+	}
+	if (snr_n) {
+		printf("\nsnr dB   frames\n");
+		for (i = 0; i <= SNR_MAX; i += 5) {
+			uint64_t c = 0;
+			for (j = i; j < i + 5 && j <= SNR_MAX; j++) {
+				c += s->snr[j];
+			}
+			if (c) {
+				printf("%2u-%-2u    %-12llu %.*s\n", i, i + 4, (unsigned long long)c, (int)(c * 50 / snr_top),
+					"##################################################");
+			}
+		}
+	}
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-t threads] [-c chunk KiB] [-n top] [-B] capture\n", name);
+	fprintf(stderr, "  -t  worker threads (default: online cpus)\n");
+	fprintf(stderr, "  -c  chunk size (default %u KiB), at least one chunk per thread\n", CHUNK_MIN >> 10);
+	fprintf(stderr, "  -n  bss entries to list (default 20)\n");
+	fprintf(stderr, "  -B  time 1, 2, 4 and 8 threads, check they agree\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct cap_t c;
+	struct stats_t s;
+	uint64_t chunk = CHUNK_MIN;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	uint32_t threads = (cpus < 1) ? 1 : (cpus > MAX_THREADS) ? MAX_THREADS : cpus;
+	uint32_t top = 20, used;
+	int bench = 0;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "t:c:n:Bh")) != -1) {
+		switch (opt) {
+		case 't': threads = strtoul(optarg, NULL, 0); break;
+		case 'c': chunk = strtoull(optarg, NULL, 0) << 10; break;
+		case 'n': top = strtoul(optarg, NULL, 0); break;
+		case 'B': bench = 1; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	if (argc - optind != 1 || threads == 0 || threads > MAX_THREADS || chunk == 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	const char *file = argv[optind];
+	airtime_init();
+
+	ret = cap_open(&c, file);
+	if (ret < 0) {
+		fprintf(stderr, "%s: %s\n", file, ret == -1 ? "cannot read" : "not a pcap or pcapng file");
+		return 1;
+	}
+
+	if (bench) {
+		static const uint32_t nt[] = { 1, 2, 4, 8 };
+		uint64_t digest = 0, t1 = 0;
+		int bad = 0;
+
+		// once to have the file in the page cache
+		if (analyze(&c, 1, chunk, &s, &used) < 0) {
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+		stats_free(&s);
+
+		printf("%llu bytes, %ld cpus online\n", (unsigned long long)c.len, cpus);
+		printf("threads  chunks   time ms      MB/s       Mframes/s  speedup\n");
+		for (uint32_t i = 0; i < sizeof(nt) / sizeof(nt[0]); i++) {
+			uint64_t t = now_ns();
+			if (analyze(&c, nt[i], chunk, &s, &used) < 0) {
+				fprintf(stderr, "out of memory\n");
+				return 1;
+			}
+			t = now_ns() - t;
+
+			uint64_t d = stats_digest(&s);
+			if (i == 0) {
+				digest = d;
+				t1 = t;
+			}
+			printf("%-8u %-8u %-12.1f %-10.1f %-10.3f %.2fx%s\n", nt[i], used, t / 1e6, c.len * 1e3 / t,
+				s.frames * 1e3 / t, (double)t1 / t, d == digest ? "" : "  MISMATCH");
+			bad |= d != digest;
+			stats_free(&s);
+		}
+
+		munmap((void *)c.p, c.len);
+		return bad ? 2 : 0;
+	}
+
+	if (analyze(&c, threads, chunk, &s, &used) < 0) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	printf("file:     %s, %llu bytes, %s, %u threads, %u chunks\n", file, (unsigned long long)c.len,
+		c.ng ? "pcapng" : "pcap", threads, used);
+	report(&s, top);
+
+	stats_free(&s);
+	munmap((void *)c.p, c.len);
+
+	return 0;
+}
@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cmdtraceio.h"
+#include "fwsym.h"
+
+// host command trace of the app, ux0:data/cmd.wct, as a latency table per
+// command, names out of fw.h, or with -l every record
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-c fw.h] [-l] in.wct\n", name);
+	fprintf(stderr, "  -c  command ids (doc/mwifiex/fw.h)\n");
+	fprintf(stderr, "  -l  every record as it was taken\n");
+}
+
+static const char *name_of(const struct fwsym_t *f, uint16_t id)
+{
+	const char *n = fwsym_cmd_name(f, id & ~WIFIMON_CMDTRACE_RESP);
+
+	return n ? n : "?";
+}
+
+static void list(const struct fwsym_t *f, const struct wifimon_cmdtrace_rec_t *r)
+{
+	if (r->kind == WIFIMON_CMDTRACE_LOST) {
+		printf("%10s  lost %d\n", "", (int)r->result);
+		return;
+	}
+
+	printf("%10u  %s %04x %-32s %5u", r->ts, (r->kind == WIFIMON_CMDTRACE_CMD) ? "cmd " : "resp",
+		r->id, name_of(f, r->id), r->len);
+	if (r->kind == WIFIMON_CMDTRACE_REPLY) {
+		printf("  seq %u result %d", r->seq_num, (int)r->result);
+	}
+	printf("\n%10s ", "");
+	for (uint32_t i = 0; i < r->caplen && i < WIFIMON_CMDTRACE_DATA; i++) {
+		printf(" %02x", r->data[i]);
+	}
+	printf("%s\n", (r->caplen < r->len) ? " ..." : "");
+}
+
+int main(int argc, char *argv[])
+{
+	static struct fwsym_t f;
+	static struct cmdtrace_stats_t s;
+	struct cmdtrace_file_t t;
+	struct wifimon_cmdtrace_rec_t r;
+	char cmds[512];
+	const char *src = __FILE__, *slash = strrchr(src, '/');
+	int opt, verbose = 0, ret;
+
+	snprintf(cmds, sizeof(cmds), "%.*s../../doc/mwifiex/fw.h", slash ? (int)(slash - src + 1) : 0, src);
+
+	while ((opt = getopt(argc, argv, "c:lh")) != -1) {
+		switch (opt) {
+		case 'c': snprintf(cmds, sizeof(cmds), "%s", optarg); break;
+		case 'l': verbose = 1; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+	if (argc - optind != 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	fwsym_init(&f);
+	if (fwsym_cmds(&f, cmds) < 0) {
+		fprintf(stderr, "%s: cannot read\n", cmds);
+		return 1;
+	}
+	ret = cmdtrace_open(&t, argv[optind]);
+	if (ret < 0) {
+		fprintf(stderr, "%s: %s\n", argv[optind], (ret == -2) ? "cannot read" : "not a command trace");
+		return 1;
+	}
+
+	cmdtrace_stats_init(&s);
+	s.unit_ns = t.hdr.unit_ns;
+	while (cmdtrace_next(&t, &r)) {
+		if (verbose) {
+			list(&f, &r);
+		}
+		if (cmdtrace_stats_add(&s, &r) < 0) {
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+	}
+	cmdtrace_close(&t);
+	cmdtrace_stats_finish(&s);
+
+	printf("%-4s  %-32s %6s %6s %6s %6s %8s %8s %8s %8s\n", "id", "command", "sent", "resp", "none", "fail", "p50 us", "p90 us", "p99 us", "max us");
+	for (uint32_t i = 0; i < s.nid; i++) {
+		const struct cmdtrace_id_t *c = &s.id[i];
+
+		printf("%04x  %-32s %6u %6u %6u %6u", c->id, name_of(&f, c->id), c->sent, c->answered, c->unanswered, c->failed);
+		if (c->nlat) {
+			printf(" %8u %8u %8u %8u\n", c->p50, c->p90, c->p99, c->max);
+		} else {
+			printf(" %8s %8s %8s %8s\n", "-", "-", "-", "-");
+		}
+	}
+	printf("%u records, %u lost, %u sends forgotten at a loss, %u responses without a send\n",
+		s.records, s.lost, s.forgotten, s.orphans);
+	if (s.dropped) {
+		printf("%u records of ids over %d\n", s.dropped, CMDTRACE_IDS_MAX);
+	}
+
+	cmdtrace_stats_free(&s);
+	fwsym_free(&f);
+
+	return 0;
+}
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cmdtraceio.h"
+
+int cmdtrace_open(struct cmdtrace_file_t *t, const char *path)
+{
+	t->f = fopen(path, "rb");
+	if (t->f == NULL) {
+		return -2;
+	}
+
+	if (fread(&t->hdr, sizeof(t->hdr), 1, t->f) != 1 ||
+		t->hdr.magic != WIFIMON_CMDTRACE_MAGIC || t->hdr.version != 1 ||
+		t->hdr.rec_size != sizeof(struct wifimon_cmdtrace_rec_t)) {
+		fclose(t->f);
+		t->f = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+void cmdtrace_close(struct cmdtrace_file_t *t)
+{
+	if (t->f) {
+		fclose(t->f);
+		t->f = NULL;
+	}
+}
+
+int cmdtrace_next(struct cmdtrace_file_t *t, struct wifimon_cmdtrace_rec_t *r)
+{
+	// a record cut short by the app stopping is the end
+	return fread(r, sizeof(*r), 1, t->f) == 1;
+}
+
+void cmdtrace_stats_init(struct cmdtrace_stats_t *s)
+{
+	memset(s, 0, sizeof(*s));
+	s->unit_ns = 1000;
+}
+
+void cmdtrace_stats_free(struct cmdtrace_stats_t *s)
+{
+	for (uint32_t i = 0; i < s->nid; i++) {
+		free(s->id[i].lat);
+	}
+	s->nid = 0;
+}
+
+static struct cmdtrace_id_t *id_of(struct cmdtrace_stats_t *s, uint16_t id, int add)
+{
+	struct cmdtrace_id_t *c;
+
+	for (uint32_t i = 0; i < s->nid; i++) {
+		if (s->id[i].id == id) {
+			return &s->id[i];
+		}
+	}
+	if (!add || s->nid == CMDTRACE_IDS_MAX) {
+		return NULL;
+	}
+
+	c = &s->id[s->nid++];
+	memset(c, 0, sizeof(*c));
+	c->id = id;
+
+	return c;
+}
+
+int cmdtrace_stats_add(struct cmdtrace_stats_t *s, const struct wifimon_cmdtrace_rec_t *r)
+{
+	struct cmdtrace_id_t *c;
+	uint16_t id = r->id & ~WIFIMON_CMDTRACE_RESP;
+
+	switch (r->kind) {
+	case WIFIMON_CMDTRACE_CMD:
+		s->records++;
+		c = id_of(s, id, 1);
+		if (c == NULL) {
+			s->dropped++;
+			return 0;
+		}
+		c->sent++;
+		if (c->nopen == CMDTRACE_OPEN_MAX) {
+			memmove(c->open, c->open + 1, (CMDTRACE_OPEN_MAX - 1) * sizeof(c->open[0]));
+			c->nopen--;
+			c->unanswered++;
+		}
+		c->open[c->nopen++] = r->ts;
+		break;
+
+	case WIFIMON_CMDTRACE_REPLY:
+		s->records++;
+		c = id_of(s, id, 0);
+		if (c == NULL || c->nopen == 0) {
+			s->orphans++;
+			return 0;
+		}
+		if (c->nlat == c->cap) {
+			uint32_t cap = c->cap ? 2 * c->cap : 64;
+			uint32_t *lat = realloc(c->lat, cap * sizeof(uint32_t));
+
+			if (lat == NULL) {
+				return -1;
+			}
+			c->lat = lat;
+			c->cap = cap;
+		}
+		// ts wraps every 2^32 units, differences do not care
+		c->lat[c->nlat++] = (uint64_t)(uint32_t)(r->ts - c->open[0]) * s->unit_ns / 1000;
+		memmove(c->open, c->open + 1, (c->nopen - 1) * sizeof(c->open[0]));
+		c->nopen--;
+		c->answered++;
+		if (r->result != 0) {
+			c->failed++;
+		}
+		break;
+
+	case WIFIMON_CMDTRACE_LOST:
+		s->lost += r->result;
+		for (uint32_t i = 0; i < s->nid; i++) {
+			s->forgotten += s->id[i].nopen;
+			s->id[i].nopen = 0;
+		}
+		break;
+	}
+
+	return 0;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static int cmp_id(const void *a, const void *b)
+{
+	return (int)((const struct cmdtrace_id_t *)a)->id - (int)((const struct cmdtrace_id_t *)b)->id;
+}
+
+// nearest rank
+static uint32_t pct(const uint32_t *v, uint32_t n, uint32_t p)
+{
+	uint32_t rank = ((uint64_t)n * p + 99) / 100;
+
+	return v[rank ? rank - 1 : 0];
+}
+
+void cmdtrace_stats_finish(struct cmdtrace_stats_t *s)
+{
+	for (uint32_t i = 0; i < s->nid; i++) {
+		struct cmdtrace_id_t *c = &s->id[i];
+
+		c->unanswered += c->nopen;
+		c->nopen = 0;
+		if (c->nlat == 0) {
+			continue;
+		}
+		qsort(c->lat, c->nlat, sizeof(uint32_t), cmp_u32);
+		c->p50 = pct(c->lat, c->nlat, 50);
+		c->p90 = pct(c->lat, c->nlat, 90);
+		c->p99 = pct(c->lat, c->nlat, 99);
+		c->max = c->lat[c->nlat - 1];
+	}
+
+	qsort(s->id, s->nid, sizeof(s->id[0]), cmp_id);
+}
@@ -0,0 +1,60 @@
+#ifndef CMDTRACEIO_h_
+#define CMDTRACEIO_h_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "kwifimon_export.h"
+
+// .wct files of the app, a wifimon_cmdtrace_hdr_t then records, and the
+// latency of each command out of them
+// the firmware works one command at a time, a response is matched to the
+// oldest unanswered send of its id, a LOST record forgets what was
+// outstanding since its response may have been among the lost
+
+#define CMDTRACE_IDS_MAX   256
+#define CMDTRACE_OPEN_MAX  8     // sends of one id waiting for a response
+
+struct cmdtrace_file_t {
+	FILE *f;
+	struct wifimon_cmdtrace_hdr_t hdr;
+};
+
+// returns 0, -1 not a trace, -2 cannot read
+int cmdtrace_open(struct cmdtrace_file_t *t, const char *path);
+void cmdtrace_close(struct cmdtrace_file_t *t);
+// returns 1, 0 at the end
+int cmdtrace_next(struct cmdtrace_file_t *t, struct wifimon_cmdtrace_rec_t *r);
+
+struct cmdtrace_id_t {
+	uint16_t id;
+	uint32_t sent;
+	uint32_t answered;
+	uint32_t failed;         // answered with a result other than 0
+	uint32_t unanswered;     // displaced from open or still there at the end
+	uint32_t nopen;
+	uint32_t open[CMDTRACE_OPEN_MAX];   // ts of the sends, oldest first
+	uint32_t *lat;           // us, sorted by cmdtrace_stats_finish
+	uint32_t nlat;
+	uint32_t cap;
+	uint32_t p50, p90, p99, max;
+};
+
+struct cmdtrace_stats_t {
+	uint32_t unit_ns;        // of the ts, 1000 unless the header says
+	uint32_t nid;
+	struct cmdtrace_id_t id[CMDTRACE_IDS_MAX];   // in id order after finish
+	uint32_t records;        // commands and responses
+	uint32_t lost;           // records the ring overwrote
+	uint32_t forgotten;      // outstanding sends at a LOST record
+	uint32_t orphans;        // responses with no send
+	uint32_t dropped;        // ids over CMDTRACE_IDS_MAX
+};
+
+void cmdtrace_stats_init(struct cmdtrace_stats_t *s);
+void cmdtrace_stats_free(struct cmdtrace_stats_t *s);
+// returns 0 or -1 out of memory
+int cmdtrace_stats_add(struct cmdtrace_stats_t *s, const struct wifimon_cmdtrace_rec_t *r);
+void cmdtrace_stats_finish(struct cmdtrace_stats_t *s);
+
+#endif
@@ -0,0 +1,445 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <vitasdkkern.h>
+
+#include "kwifimon_export.h"
+#include "wlan_kernel.h"
+#include "sigs.h"
+#include "kwifimon.h"
+#include "cmdtrace.h"
+#include "cmdtraceio.h"
+
+#include "shim.h"
+#include "test.h"
+
+// commands through the send hook and responses through the rx hook into
+// the trace ring and out of kwifimon_cmdtrace_read, the ring overrun and
+// raced by producers on several threads against a reader, every record a
+// reader gets has to be whole and lost ones counted, then the latency
+// table of a trace file written here
+
+int module_start(SceSize argc, const void *args);
+int module_stop(SceSize argc, const void *args);
+
+typedef int (*send_hook_t)(struct wlan_dev_t *dev, struct wlan_cmd_t *cmd, uint16_t cmdid, int cmd_len);
+
+static uint32_t rx_calls, send_calls;
+
+static int test_rx_handler(struct wlan_dev_t *dev, uint8_t *in_pkt, int in_pkt_len, uint32_t *somenumber)
+{
+	rx_calls++;
+	return 0;
+}
+
+static int test_ioctl(struct netdev_t *netdev, unsigned int req, uint8_t *buf, int buf_len)
+{
+	return 0;
+}
+
+static int test_send2(struct wlan_dev_t *dev, struct wlan_cmd_t *cmd, uint16_t cmdid, int cmd_len)
+{
+	send_calls++;
+	return 0;
+}
+
+// sdio header, host command header and body
+static int resp(uint8_t *pkt, uint16_t id, uint16_t seq, uint16_t result, uint32_t body)
+{
+	uint16_t size = 8 + body;
+
+	memset(pkt, 0, 4 + size);
+	pkt[0] = (4 + size) & 0xff;
+	pkt[1] = (4 + size) >> 8;
+	pkt[2] = 1;
+	pkt[4] = id & 0xff;
+	pkt[5] = id >> 8;
+	pkt[6] = size & 0xff;
+	pkt[7] = size >> 8;
+	pkt[8] = seq & 0xff;
+	pkt[9] = seq >> 8;
+	pkt[10] = result & 0xff;
+	pkt[11] = result >> 8;
+	for (uint32_t i = 0; i < body; i++) {
+		pkt[12 + i] = i;
+	}
+
+	return 4 + size;
+}
+
+static int check_hooks(void)
+{
+	static struct wifimon_cmdtrace_t t;
+	static uint8_t dev[sizeof(struct wlan_dev_t)];
+	send_hook_t send = (send_hook_t)shim_hook(sigs[SIG_CMD_SEND2].fixed);
+	rx_hook_t rx = (rx_hook_t)shim_hook(sigs[SIG_RX_HANDLER].fixed);
+	struct wlan_cmd_t cmd;
+	uint8_t body[100], pkt[256];
+	uint32_t n;
+	int fail = 0, len;
+
+	for (uint32_t i = 0; i < sizeof(body); i++) {
+		body[i] = 0x80 + i;
+	}
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.out_data = body;
+
+	// off, passed on and nothing kept
+	send_calls = rx_calls = 0;
+	send((struct wlan_dev_t *)dev, &cmd, 0x0003, 10);
+	len = resp(pkt, 0x8003, 1, 0, 4);
+	rx((struct wlan_dev_t *)dev, pkt, len, &n);
+	memset(&t, 0, sizeof(t));
+	fail |= check("off read", kwifimon_cmdtrace_read(&t) >= 0);
+	fail |= check("off", t.n == 0 && t.lost == 0 && send_calls == 1 && rx_calls == 1);
+
+	kwifimon_cmdtrace_enable(1);
+	send_calls = rx_calls = 0;
+	send((struct wlan_dev_t *)dev, &cmd, 0x0003, 10);
+	send((struct wlan_dev_t *)dev, &cmd, 0x00a9, sizeof(body));
+	len = resp(pkt, 0x8003, 7, 0, 4);
+	rx((struct wlan_dev_t *)dev, pkt, len, &n);
+	len = resp(pkt, 0x80a9, 8, 2, 120);
+	rx((struct wlan_dev_t *)dev, pkt, len, &n);
+	// a response too short for its header, passed on but not kept
+	rx((struct wlan_dev_t *)dev, pkt, 8, &n);
+	fail |= check("passed on", send_calls == 2 && rx_calls == 3);
+
+	t.cursor = 0;
+	fail |= check("read", kwifimon_cmdtrace_read(&t) >= 0);
+	fail |= check("count", t.n == 4 && t.lost == 0 && t.cursor == 4);
+	if (t.n == 4) {
+		const struct wifimon_cmdtrace_rec_t *r = t.rec;
+
+		fail |= check("seq", r[0].seq == 1 && r[1].seq == 2 && r[2].seq == 3 && r[3].seq == 4);
+		fail |= check("cmd", r[0].kind == WIFIMON_CMDTRACE_CMD && r[0].id == 3 && r[0].len == 10 &&
+			r[0].caplen == 10 && memcmp(r[0].data, body, 10) == 0 && r[0].result == 0);
+		fail |= check("cmd cut", r[1].id == 0xa9 && r[1].len == sizeof(body) &&
+			r[1].caplen == WIFIMON_CMDTRACE_DATA && memcmp(r[1].data, body, WIFIMON_CMDTRACE_DATA) == 0);
+		fail |= check("resp", r[2].kind == WIFIMON_CMDTRACE_REPLY && r[2].id == 0x8003 && r[2].seq_num == 7 &&
+			r[2].result == 0 && r[2].len == 12 && r[2].caplen == 12 && r[2].data[0] == 0x03 && r[2].data[1] == 0x80);
+		fail |= check("resp cut", r[3].id == 0x80a9 && r[3].seq_num == 8 && r[3].result == 2 &&
+			r[3].len == 128 && r[3].caplen == WIFIMON_CMDTRACE_DATA && r[3].data[8] == 0 && r[3].data[39] == 31);
+		fail |= check("ts", (int32_t)(r[3].ts - r[0].ts) >= 0);
+	}
+
+	// nothing new, the cursor stays
+	fail |= check("again", kwifimon_cmdtrace_read(&t) >= 0 && t.n == 0 && t.cursor == 4);
+
+	// turned on again the ring starts over, the old cursor with it
+	kwifimon_cmdtrace_enable(0);
+	kwifimon_cmdtrace_enable(1);
+	send((struct wlan_dev_t *)dev, &cmd, 0x0005, 0);
+	fail |= check("restart", kwifimon_cmdtrace_read(&t) >= 0 && t.n == 1 && t.rec[0].seq == 1 && t.rec[0].caplen == 0);
+	kwifimon_cmdtrace_enable(0);
+
+	printf("hooks:    %s\n", fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+static int check_overrun(void)
+{
+	static struct wifimon_cmdtrace_rec_t out[WIFIMON_CMDTRACE_SLOTS];
+	uint32_t cursor = 0, lost = 0, total = 0, n, l, want;
+	uint8_t body[4];
+	int fail = 0;
+
+	cmdtrace_enable(1);
+	for (uint32_t i = 0; i < 3 * WIFIMON_CMDTRACE_SLOTS + 5; i++) {
+		memcpy(body, &i, 4);
+		cmdtrace_cmd(i & 0xfff, body, 4);
+	}
+
+	want = 2 * WIFIMON_CMDTRACE_SLOTS + 5;
+	while ((n = cmdtrace_read(&cursor, out + total, 100, &l)) > 0) {
+		if (total == 0) {
+			fail |= check("first", out[0].seq == want + 1);
+		}
+		total += n;
+		lost += l;
+	}
+	fail |= check("lost", lost == want && total == WIFIMON_CMDTRACE_SLOTS);
+	for (uint32_t i = 0; i < total; i++) {
+		uint32_t v;
+
+		memcpy(&v, out[i].data, 4);
+		fail |= check("order", out[i].seq == want + 1 + i && v == want + i);
+	}
+	cmdtrace_enable(0);
+
+	printf("overrun:  %s, %u lost, %u read\n", fail ? "FAIL" : "ok", lost, total);
+
+	return fail;
+}
+
+#define RACE_THREADS 4
+
+struct race_t {
+	uint32_t thread;
+	uint32_t n;
+};
+
+// body and id both follow from the thread and its count, a torn record
+// has one not matching the other
+static void race_body(uint8_t *body, uint16_t id)
+{
+	for (uint32_t i = 0; i < WIFIMON_CMDTRACE_DATA; i++) {
+		body[i] = (id * 31 + i) & 0xff;
+	}
+}
+
+static void *race_producer(void *arg)
+{
+	struct race_t *r = arg;
+	uint8_t body[WIFIMON_CMDTRACE_DATA];
+
+	for (uint32_t i = 0; i < r->n; i++) {
+		uint16_t id = (r->thread << 12) | (i & 0xfff);
+
+		race_body(body, id);
+		cmdtrace_cmd(id, body, WIFIMON_CMDTRACE_DATA + (id & 7));
+	}
+
+	return NULL;
+}
+
+static int check_race(uint32_t rounds)
+{
+	static struct wifimon_cmdtrace_rec_t out[WIFIMON_CMDTRACE_READ];
+	struct race_t r[RACE_THREADS];
+	pthread_t th[RACE_THREADS];
+	uint32_t cursor = 0, got = 0, lost = 0, torn = 0, last = 0, order = 0;
+	uint32_t per = rounds * 100, total = per * RACE_THREADS;
+	uint8_t body[WIFIMON_CMDTRACE_DATA];
+	int fail = 0;
+
+	cmdtrace_enable(1);
+	for (uint32_t i = 0; i < RACE_THREADS; i++) {
+		r[i].thread = i;
+		r[i].n = per;
+		pthread_create(&th[i], NULL, race_producer, &r[i]);
+	}
+
+	while (got + lost < total) {
+		uint32_t l, n = cmdtrace_read(&cursor, out, WIFIMON_CMDTRACE_READ, &l);
+
+		lost += l;
+		for (uint32_t i = 0; i < n; i++) {
+			race_body(body, out[i].id);
+			torn += memcmp(out[i].data, body, WIFIMON_CMDTRACE_DATA) != 0 ||
+				out[i].len != WIFIMON_CMDTRACE_DATA + (out[i].id & 7);
+			order += out[i].seq <= last;
+			last = out[i].seq;
+		}
+		got += n;
+		if (n == 0) {
+			sched_yield();
+		}
+	}
+	for (uint32_t i = 0; i < RACE_THREADS; i++) {
+		pthread_join(th[i], NULL);
+	}
+	cmdtrace_enable(0);
+
+	fail |= check("whole", torn == 0);
+	fail |= check("in order", order == 0);
+	fail |= check("all counted", got + lost == total && cursor == total);
+
+	printf("race:     %s, %u threads, %u read, %u lost\n", fail ? "FAIL" : "ok", RACE_THREADS, got, lost);
+
+	return fail;
+}
+
+static void put(FILE *f, uint16_t kind, uint16_t id, uint32_t ts, int32_t result)
+{
+	struct wifimon_cmdtrace_rec_t r;
+
+	memset(&r, 0, sizeof(r));
+	r.kind = kind;
+	r.id = id;
+	r.ts = ts;
+	r.result = result;
+	fwrite(&r, sizeof(r), 1, f);
+}
+
+static int check_decode(const char *dir)
+{
+	static struct cmdtrace_stats_t s;
+	struct cmdtrace_file_t t;
+	struct wifimon_cmdtrace_hdr_t h;
+	struct wifimon_cmdtrace_rec_t r;
+	char path[512];
+	uint32_t ts = 0xfffff000;
+	FILE *f;
+	int fail = 0;
+
+	snprintf(path, sizeof(path), "%s/cmd.wct", dir);
+	f = fopen(path, "wb");
+	if (f == NULL) {
+		return check("create", 0);
+	}
+	memset(&h, 0, sizeof(h));
+	h.magic = WIFIMON_CMDTRACE_MAGIC;
+	h.version = 1;
+	h.rec_size = sizeof(struct wifimon_cmdtrace_rec_t);
+	h.unit_ns = 1000;
+	fwrite(&h, sizeof(h), 1, f);
+
+	// 0x0003 answered after 10, 20 .. 1000 us, in a shuffled order and
+	// across the wrap of ts, every tenth with an error
+	for (uint32_t i = 1; i <= 100; i++) {
+		uint32_t lat = 10 * (1 + (i * 37) % 100);
+
+		put(f, WIFIMON_CMDTRACE_CMD, 0x0003, ts, 0);
+		put(f, WIFIMON_CMDTRACE_REPLY, 0x8003, ts + lat, (i % 10) ? 0 : 1);
+		ts += 2000;
+	}
+	// two sends outstanding at once, answered in order
+	put(f, WIFIMON_CMDTRACE_CMD, 0x00a9, ts, 0);
+	put(f, WIFIMON_CMDTRACE_CMD, 0x00a9, ts + 5, 0);
+	put(f, WIFIMON_CMDTRACE_REPLY, 0x80a9, ts + 50, 0);
+	put(f, WIFIMON_CMDTRACE_REPLY, 0x80a9, ts + 60, 0);
+	// a send forgotten at a loss, then its response has no send
+	put(f, WIFIMON_CMDTRACE_CMD, 0x0016, ts + 100, 0);
+	put(f, WIFIMON_CMDTRACE_LOST, 0, 0, 17);
+	put(f, WIFIMON_CMDTRACE_REPLY, 0x8016, ts + 200, 0);
+	// never answered
+	put(f, WIFIMON_CMDTRACE_CMD, 0x0028, ts + 300, 0);
+	// half a record, the app stopped in the middle of it
+	fwrite(&h, sizeof(h), 1, f);
+	fclose(f);
+
+	fail |= check("open", cmdtrace_open(&t, path) == 0);
+	cmdtrace_stats_init(&s);
+	s.unit_ns = t.hdr.unit_ns;
+	while (t.f && cmdtrace_next(&t, &r)) {
+		cmdtrace_stats_add(&s, &r);
+	}
+	cmdtrace_close(&t);
+	cmdtrace_stats_finish(&s);
+
+	fail |= check("records", s.records == 207 && s.lost == 17 && s.forgotten == 1 && s.orphans == 1);
+	fail |= check("ids", s.nid == 4 && s.id[0].id == 0x0003 && s.id[1].id == 0x0016 &&
+		s.id[2].id == 0x0028 && s.id[3].id == 0x00a9);
+	if (s.nid == 4) {
+		const struct cmdtrace_id_t *c = &s.id[0];
+
+		fail |= check("counts", c->sent == 100 && c->answered == 100 && c->failed == 10 && c->unanswered == 0);
+		fail |= check("percentiles", c->p50 == 500 && c->p90 == 900 && c->p99 == 990 && c->max == 1000);
+		fail |= check("forgotten", s.id[1].sent == 1 && s.id[1].answered == 0 && s.id[1].unanswered == 0);
+		fail |= check("unanswered", s.id[2].sent == 1 && s.id[2].unanswered == 1 && s.id[2].nlat == 0);
+		fail |= check("in order", s.id[3].answered == 2 && s.id[3].p50 == 50 && s.id[3].max == 55);
+	}
+	cmdtrace_stats_free(&s);
+
+	// not a trace
+	f = fopen(path, "wb");
+	h.version = 2;
+	fwrite(&h, sizeof(h), 1, f);
+	fclose(f);
+	fail |= check("version", cmdtrace_open(&t, path) == -1);
+	snprintf(path, sizeof(path), "%s/none.wct", dir);
+	unlink(path);
+	fail |= check("missing", cmdtrace_open(&t, path) == -2);
+
+	printf("decode:   %s\n", fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+// what a command costs the send hook with the trace on and off
+static int bench(uint32_t rounds)
+{
+	static uint8_t dev[sizeof(struct wlan_dev_t)];
+	send_hook_t send = (send_hook_t)shim_hook(sigs[SIG_CMD_SEND2].fixed);
+	uint8_t body[64];
+	struct wlan_cmd_t cmd;
+	uint32_t n = rounds * 1000;
+	double best[2] = { 1e9, 1e9 };
+
+	memset(body, 0x5a, sizeof(body));
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.out_data = body;
+
+	for (int run = 0; run < 5; run++) {
+		for (int on = 0; on < 2; on++) {
+			double t0;
+
+			kwifimon_cmdtrace_enable(on);
+			t0 = now();
+			for (uint32_t i = 0; i < n; i++) {
+				send((struct wlan_dev_t *)dev, &cmd, i & 0xff, sizeof(body));
+			}
+			if (now() - t0 < best[on]) {
+				best[on] = now() - t0;
+			}
+		}
+	}
+	kwifimon_cmdtrace_enable(0);
+
+	printf("%u commands through the send hook\n", n);
+	printf("  trace off  %6.1f ns\n", best[0] / n * 1e9);
+	printf("  trace on   %6.1f ns\n", best[1] / n * 1e9);
+
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-b] [-n rounds] [-s seed] [-o dir]\n", name);
+	fprintf(stderr, "  -b  cost of the send hook instead of the checks\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *dir = "/tmp/cmdtracetest";
+	uint32_t rounds = 200;
+	int opt, fail = 0, do_bench = 0;
+
+	while ((opt = getopt(argc, argv, "bn:s:o:h")) != -1) {
+		switch (opt) {
+		case 'b': do_bench = 1; break;
+		case 'n': rounds = strtoul(optarg, NULL, 0); break;
+		case 's': rng_state = strtoul(optarg, NULL, 0) | 1; break;
+		case 'o': dir = optarg; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	mkdir(dir, 0755);
+	shim_init(dir);
+	shim_wlan_init();
+	shim_set_offset(sigs[SIG_RX_HANDLER].fixed, test_rx_handler);
+	shim_set_offset(sigs[SIG_IOCTL].fixed, test_ioctl);
+	shim_set_offset(sigs[SIG_CMD_SEND2].fixed, test_send2);
+
+	module_start(0, NULL);
+	if (kwifimon_mod_state() & 0x80000000) {
+		fprintf(stderr, "module_start failed, state %x\n", kwifimon_mod_state());
+		return 1;
+	}
+
+	if (do_bench) {
+		fail = bench(rounds);
+		module_stop(0, NULL);
+		return fail;
+	}
+
+	fail |= check_hooks();
+	fail |= check_overrun();
+	fail |= check_race(rounds + rng() % 8);
+	fail |= check_decode(dir);
+
+	module_stop(0, NULL);
+
+	printf("%s\n", fail ? "FAIL" : "ok");
+
+	return fail ? 2 : 0;
+}
@@ -0,0 +1,405 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "dot11.h"
+
+#include "sdiogen.h"
+#include "wlan_kernel.h"
+#include "kwifimon.h"
+#include "test.h"
+
+// robustness check for the 802.11 parser: generated frames, mutations of
+// them and plain noise, each in a heap buffer of exactly its length so an
+// overread trips the sanitizers, results checked against a naive walk
+
+#define CORPUS    512
+#define MAX_FRAME 2048
+
+struct input_t {
+	uint8_t *p;
+	uint32_t len;
+};
+
+static struct input_t corpus[CORPUS];
+static uint32_t ncorpus;
+
+static uint64_t n_hdr, n_ies, n_trunc, n_found, n_rsn, n_ht, n_vht;
+
+static int corpus_add(void *ctx, const uint8_t *pkt, uint32_t len, uint32_t delta_us)
+{
+	const struct rxpd *rx_pd = (const void *)(pkt + sizeof(struct sdio_rx_t));
+	const uint8_t *f = (const uint8_t *)rx_pd + rx_pd->rx_pkt_offset;
+	uint32_t n = rx_pd->rx_pkt_length;
+
+	if (n > MAX_FRAME) {
+		n = MAX_FRAME;
+	}
+
+	corpus[ncorpus].p = malloc(n);
+	memcpy(corpus[ncorpus].p, f, n);
+	corpus[ncorpus].len = n;
+
+	return ++ncorpus == CORPUS;
+}
+
+// mgmt heavy so most inputs reach the elements
+static void corpus_init(uint32_t seed)
+{
+	static struct sdiogen_t g;
+	struct sdiogen_cfg_t cfg;
+
+	sdiogen_default(&cfg);
+	cfg.seed = seed;
+	cfg.frames = CORPUS;
+	cfg.w_beacon = 40;
+	cfg.w_probe = 40;
+	cfg.w_data = 10;
+	cfg.len_max = 256;
+	sdiogen_init(&g, &cfg);
+	sdiogen_run(&g, corpus_add, NULL);
+}
+
+static uint32_t mutate(uint8_t *buf, uint32_t cap)
+{
+	const struct input_t *in = &corpus[rng() % ncorpus];
+	uint32_t len = in->len, i, n;
+
+	memcpy(buf, in->p, len);
+
+	n = 1 + rng() % 8;
+	for (i = 0; i < n; i++) {
+		uint32_t at = len ? rng() % len : 0;
+
+		switch (rng() % 8) {
+		case 0:
+			if (len) {
+				buf[at] ^= 1 << (rng() & 7);
+			}
+			break;
+		case 1:
+			// element lengths are the interesting bytes
+			if (len) {
+				static const uint8_t edge[] = { 0, 1, 2, 3, 4, 0x7f, 0x80, 0xfe, 0xff };
+				buf[at] = edge[rng() % sizeof(edge)];
+			}
+			break;
+		case 2:
+			len = rng() % (len + 1);
+			break;
+		case 3:
+			if (len < cap) {
+				memmove(buf + at + 1, buf + at, len - at);
+				buf[at] = rng();
+				len++;
+			}
+			break;
+		case 4: {
+			// splice the tail of another input
+			const struct input_t *o = &corpus[rng() % ncorpus];
+			uint32_t from = o->len ? rng() % o->len : 0;
+			uint32_t k = o->len - from;
+			if (at + k > cap) {
+				k = cap - at;
+			}
+			memcpy(buf + at, o->p + from, k);
+			len = at + k;
+			break;
+		}
+		case 5:
+			// a random element
+			if (len + 2 < cap) {
+				uint32_t l = rng() % 40;
+				if (len + 2 + l > cap) {
+					l = cap - len - 2;
+				}
+				buf[len] = rng();
+				buf[len + 1] = (rng() & 3) ? l : rng();
+				for (n = 0; n < l; n++) {
+					buf[len + 2 + n] = rng();
+				}
+				len += 2 + l;
+			}
+			break;
+		case 6:
+			if (len) {
+				buf[at] = rng();
+			}
+			break;
+		default:
+			if (len >= 2) {
+				buf[0] = rng();
+				buf[1] = rng();
+			}
+			break;
+		}
+	}
+
+	return len;
+}
+
+static uint32_t noise(uint8_t *buf, uint32_t cap)
+{
+	uint32_t len = rng() % 128, i;
+
+	for (i = 0; i < len; i++) {
+		buf[i] = rng();
+	}
+
+	return len;
+}
+
+// naive reference: every element, then match against the wants
+struct ref_t {
+	int walked;
+	struct dot11_ie_t ie[DOT11_IE_SLOTS];
+};
+
+static void ref_parse(const uint64_t *want, uint32_t nwant, const uint8_t *p, uint32_t len, struct ref_t *r)
+{
+	uint32_t pos = 0, i;
+
+	memset(r, 0, sizeof(*r));
+
+	while (1) {
+		if (pos == len) {
+			return;
+		}
+		if (pos + 2 > len || pos + 2 + p[pos + 1] > len) {
+			r->walked = -1;
+			return;
+		}
+
+		uint8_t id = p[pos], l = p[pos + 1];
+		const uint8_t *d = p + pos + 2;
+
+		for (i = 0; i < nwant; i++) {
+			int hit;
+
+			if ((want[i] >> 32) == 1) {
+				uint32_t oui = (want[i] >> 8) & 0xffffff;
+				hit = id == DOT11_IE_VENDOR && l >= 4 &&
+					((uint32_t)d[0] << 16 | d[1] << 8 | d[2]) == oui && d[3] == (want[i] & 0xff);
+			} else if ((want[i] >> 32) == 2) {
+				hit = id == DOT11_IE_EXT && l >= 1 && d[0] == (want[i] & 0xff);
+			} else {
+				hit = id == want[i];
+			}
+
+			if (hit && r->ie[i].n++ == 0) {
+				r->ie[i].p = d;
+				r->ie[i].len = l;
+			}
+		}
+
+		pos += 2 + l;
+		r->walked++;
+	}
+}
+
+static const uint64_t want_pool[] = {
+	DOT11_IE_SSID, DOT11_IE_RATES, DOT11_IE_DS_PARAMS, DOT11_IE_TIM, DOT11_IE_COUNTRY,
+	DOT11_IE_HT_CAP, DOT11_IE_RSN, DOT11_IE_EXT_RATES, DOT11_IE_HT_OP, DOT11_IE_VHT_CAP,
+	DOT11_IE_VHT_OP, 2, 4, 42, 127, 254,
+	DOT11_WANT_WPA, DOT11_WANT_WMM, DOT11_WANT_WPS, DOT11_WANT_VENDOR(0x00904c, 0x33),
+	DOT11_WANT_VENDOR(0xfffffe, 0xff), DOT11_WANT_HE_CAP, DOT11_WANT_EXT(36), DOT11_WANT_EXT(0),
+};
+
+#define NUM_WANT_POOL (sizeof(want_pool) / sizeof(want_pool[0]))
+
+static void check_decoders(const struct dot11_ie_t *ie)
+{
+	struct dot11_rsn_t rsn;
+	struct dot11_ht_t ht;
+	struct dot11_vht_t vht;
+
+	// any element, the decoders must hold up against all of them
+	n_rsn += dot11_ie_rsn(ie, &rsn) == 0;
+	n_ht += dot11_ie_ht(ie, &ht) == 0;
+	n_vht += dot11_ie_vht(ie, &vht) == 0;
+	dot11_ie_ds_channel(ie);
+}
+
+static void check_one(const uint8_t *buf, uint32_t len)
+{
+	struct dot11_hdr_t h;
+	const uint8_t *ies;
+	uint32_t ies_len, i;
+	uint8_t *f = malloc(len ? len : 1);
+
+	memcpy(f, buf, len);
+
+	int n = dot11_hdr_parse(f, len, &h);
+	if (n >= 0) {
+		n_hdr++;
+		if (n != (int)h.hdr_len || h.hdr_len > len || h.body != f + h.hdr_len || h.body_len != len - h.hdr_len) {
+			fail("header bounds", f, len);
+		}
+
+		// what the index keeps lies inside the header
+		if ((h.ta && (h.ta < f || h.ta + 6 > f + h.hdr_len)) ||
+			(h.bssid && (h.bssid < f || h.bssid + 6 > f + h.hdr_len))) {
+			fail("addresses outside the header", f, len);
+		}
+	}
+
+	// the body as if it had a management header, and the raw bytes as elements
+	const uint8_t *streams[2] = { NULL, f };
+	uint32_t lens[2] = { 0, len };
+
+	if (n >= 0 && dot11_mgmt_ies(&h, &ies, &ies_len) == 0) {
+		if (ies < h.body || ies + ies_len != f + len) {
+			fail("mgmt elements bounds", f, len);
+		}
+		streams[0] = ies;
+		lens[0] = ies_len;
+	}
+
+	for (int s = 0; s < 2; s++) {
+		struct dot11_ie_set_t set;
+		struct dot11_ie_t out[DOT11_IE_SLOTS];
+		struct ref_t ref;
+		uint64_t want[DOT11_IE_SLOTS];
+		uint32_t nwant = 1 + rng() % DOT11_IE_SLOTS, k = 0;
+
+		if (streams[s] == NULL) {
+			continue;
+		}
+
+		// distinct plain ids, vendor and extension wants may repeat
+		while (k < nwant) {
+			uint64_t w = want_pool[rng() % NUM_WANT_POOL];
+			for (i = 0; i < k && (w >> 32 || want[i] != w); i++);
+			if (i == k) {
+				want[k++] = w;
+			}
+		}
+
+		if (dot11_ie_set_init(&set, want, nwant) < 0) {
+			fail("set init", NULL, 0);
+			continue;
+		}
+
+		int walked = dot11_ie_parse(&set, streams[s], lens[s], out);
+		ref_parse(want, nwant, streams[s], lens[s], &ref);
+
+		n_ies++;
+		n_trunc += walked < 0;
+		if (walked != ref.walked) {
+			fail("walked count", streams[s], lens[s]);
+		}
+
+		for (i = 0; i < nwant; i++) {
+			if (out[i].p != ref.ie[i].p || out[i].len != ref.ie[i].len || out[i].n != ref.ie[i].n) {
+				fail("element slot", streams[s], lens[s]);
+				break;
+			}
+			if (out[i].p) {
+				n_found++;
+				if (out[i].p < streams[s] || out[i].p + out[i].len > streams[s] + lens[s]) {
+					fail("element outside input", streams[s], lens[s]);
+				}
+				check_decoders(&out[i]);
+			}
+		}
+	}
+
+	free(f);
+}
+
+// fixed cases the random inputs are unlikely to hit exactly
+static void check_fixed(void)
+{
+	static const uint8_t rsn_full[] = {
+		1, 0, 0x00, 0x0f, 0xac, 4, 2, 0, 0x00, 0x0f, 0xac, 4, 0x00, 0x0f, 0xac, 2,
+		1, 0, 0x00, 0x0f, 0xac, 2, 0x0c, 0x00
+	};
+	struct dot11_ie_t ie = { rsn_full, sizeof(rsn_full), 1 };
+	struct dot11_rsn_t rsn;
+	struct dot11_ie_set_t set;
+	uint64_t want[DOT11_IE_SLOTS + 1];
+	uint32_t i;
+
+	if (dot11_ie_rsn(&ie, &rsn) < 0 || rsn.version != 1 || rsn.group != 0x000fac04 || rsn.npairwise != 2 ||
+		rsn.pairwise[1] != 0x000fac02 || rsn.nakm != 1 || rsn.akm[0] != 0x000fac02 || rsn.caps != 0x000c) {
+		fail("rsn decode", rsn_full, sizeof(rsn_full));
+	}
+
+	// every prefix is either a valid shorter element or rejected, never read past
+	for (i = 0; i < sizeof(rsn_full); i++) {
+		uint8_t *p = malloc(i ? i : 1);
+		memcpy(p, rsn_full, i);
+		ie.p = p;
+		ie.len = i;
+		int ret = dot11_ie_rsn(&ie, &rsn);
+		int ok = (i == 2 || i == 6 || i == 16 || i == 22 || i == 24);
+		if ((ret == 0) != ok) {
+			fail("rsn prefix", p, i);
+		}
+		free(p);
+	}
+
+	for (i = 0; i <= DOT11_IE_SLOTS; i++) {
+		want[i] = i;
+	}
+	if (dot11_ie_set_init(&set, want, DOT11_IE_SLOTS + 1) == 0) {
+		fail("too many wants accepted", NULL, 0);
+	}
+	want[1] = 0;
+	if (dot11_ie_set_init(&set, want, 2) == 0) {
+		fail("duplicate want accepted", NULL, 0);
+	}
+	want[0] = DOT11_IE_VENDOR;
+	if (dot11_ie_set_init(&set, want, 1) == 0) {
+		fail("bare vendor want accepted", NULL, 0);
+	}
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-n iterations] [-s seed]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	static uint8_t buf[MAX_FRAME + 64];
+	uint64_t iters = 1000000, i;
+	uint32_t seed = time(NULL);
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:s:h")) != -1) {
+		switch (opt) {
+		case 'n': iters = strtoull(optarg, NULL, 0); break;
+		case 's': seed = strtoul(optarg, NULL, 0); break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	rng_state = seed | 1;
+	corpus_init(seed);
+	check_fixed();
+
+	for (i = 0; i < ncorpus; i++) {
+		check_one(corpus[i].p, corpus[i].len);
+	}
+
+	for (i = 0; i < iters; i++) {
+		uint32_t len = (i % 16) ? mutate(buf, sizeof(buf)) : noise(buf, sizeof(buf));
+		check_one(buf, len);
+	}
+
+	printf("seed %u, %llu inputs: %llu headers, %llu element streams (%llu truncated), %llu elements found\n",
+		seed, (unsigned long long)(iters + ncorpus), (unsigned long long)n_hdr, (unsigned long long)n_ies,
+		(unsigned long long)n_trunc, (unsigned long long)n_found);
+	printf("decoded %llu rsn, %llu ht, %llu vht, %s\n", (unsigned long long)n_rsn, (unsigned long long)n_ht,
+		(unsigned long long)n_vht, fails ? "FAIL" : "ok");
+
+	for (i = 0; i < ncorpus; i++) {
+		free(corpus[i].p);
+	}
+
+	return fails ? 2 : 0;
+}
@@ -0,0 +1,694 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "elfout.h"
+#include "fwimage.h"
+
+#define ELFOUT_ALIGN 4096
+
+void elfout_init(struct elfout_t *e)
+{
+	memset(e, 0, sizeof(*e));
+}
+
+void elfout_close(struct elfout_t *e)
+{
+	uint32_t i;
+
+	for (i = 0; i < e->nfile; i++) {
+		if (e->file[i].map) {
+			munmap((void *)e->file[i].map, e->file[i].size);
+		}
+		close(e->file[i].fd);
+	}
+	e->nfile = 0;
+}
+
+int elfout_file(struct elfout_t *e, const char *name)
+{
+	struct elfout_file_t *f = &e->file[e->nfile];
+	struct stat st;
+
+	if (e->nfile == ELFOUT_FILES_MAX) {
+		return -2;
+	}
+
+	f->fd = open(name, O_RDONLY);
+	if (f->fd < 0) {
+		return -2;
+	}
+	if (fstat(f->fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+		close(f->fd);
+		return -2;
+	}
+
+	f->size = st.st_size;
+	f->map = NULL;
+	if (f->size) {
+		void *map = mmap(NULL, f->size, PROT_READ, MAP_SHARED, f->fd, 0);
+
+		if (map == MAP_FAILED) {
+			close(f->fd);
+			return -2;
+		}
+		madvise(map, f->size, MADV_SEQUENTIAL);
+		f->map = map;
+	}
+
+	return e->nfile++;
+}
+
+int elfout_input(struct elfout_t *e, const char *name, uint32_t vaddr, uint32_t memsz, uint32_t pf, uint32_t flags)
+{
+	struct elfout_seg_t *s = &e->seg[e->nseg];
+
+	if (e->nseg == ELFOUT_INPUTS_MAX || memsz == 0 || (uint64_t)vaddr + memsz > 0x100000000ull) {
+		e->failed = e->nseg;
+		return -1;
+	}
+
+	memset(s, 0, sizeof(*s));
+	if (name && name[0]) {
+		snprintf(s->name, sizeof(s->name), "%s", name);
+	} else {
+		snprintf(s->name, sizeof(s->name), ".%03x", vaddr >> 20);
+	}
+	s->vaddr = vaddr;
+	s->memsz = memsz;
+	s->pf = pf;
+	s->flags = flags;
+	s->first = e->npiece;
+
+	return e->nseg++;
+}
+
+int elfout_piece(struct elfout_t *e, uint32_t file, uint64_t off, uint32_t vaddr, uint32_t len)
+{
+	struct elfout_seg_t *s = &e->seg[e->nseg - 1];
+	struct elfout_piece_t *p = &e->piece[e->npiece];
+
+	// pieces fill an input from its start, one after another
+	if (e->nseg == 0 || e->npiece == ELFOUT_PIECES_MAX || file >= e->nfile
+		|| off + len > e->file[file].size || vaddr != s->vaddr + s->filesz
+		|| len > s->memsz - s->filesz) {
+		e->failed = e->nseg - 1;
+		return -1;
+	}
+
+	if (len == 0) {
+		return 0;
+	}
+
+	p->vaddr = vaddr;
+	p->len = len;
+	p->file = file;
+	p->off = off;
+	s->filesz += len;
+	s->count++;
+	e->npiece++;
+
+	return 0;
+}
+
+// regions of the 8787, what each of them holds
+static uint32_t elfout_region_pf(uint32_t addr)
+{
+	switch (addr & 0xffc00000) {
+	case 0x00000000: return PF_R | PF_W | PF_X;   // code ram
+	case 0x03c00000: return PF_R | PF_X;          // code rom
+	case 0x04000000: return PF_R | PF_W | PF_X;   // tcm, boot code puts the stack here
+	case 0xc0000000: return PF_R | PF_W | PF_X;   // ram, more code, data, heap
+	default: return PF_R | PF_W;                  // peripherals
+	}
+}
+
+int elfout_dump(struct elfout_t *e, const char *path)
+{
+	const char *name = strrchr(path, '/');
+	unsigned int base, size;
+	int n = 0, f, ret;
+
+	name = name ? name + 1 : path;
+	if (sscanf(name, "dump-%8x-%8x.bin%n", &base, &size, &n) != 2 || name[n] != 0 || (base & 3)) {
+		e->failed = e->nseg;
+		return -1;
+	}
+
+	f = elfout_file(e, path);
+	if (f < 0) {
+		e->failed = e->nseg;
+		return f;
+	}
+
+	ret = elfout_input(e, NULL, base, size, elfout_region_pf(base), ELFOUT_MERGE);
+	if (ret < 0) {
+		return ret;
+	}
+
+	// a dump cut short is what it is, the rest reads as zero
+	return elfout_piece(e, f, 0, base, (e->file[f].size < size) ? e->file[f].size : size);
+}
+
+static int elfout_map_line(struct elfout_t *e, char *line, const char *dir)
+{
+	char *tok[6], *at, *end, path[PATH_MAX];
+	uint32_t base, size, pf = 0;
+	uint64_t off = 0;
+	int n = 0, f = -1, ret;
+
+	for (char *t = strtok(line, " \t\r\n"); t && n < 6; t = strtok(NULL, " \t\r\n")) {
+		if (t[0] == '#') {
+			break;
+		}
+		tok[n++] = t;
+	}
+
+	if (n == 0) {
+		return 0;
+	}
+
+	if (strcmp(tok[0], "entry") == 0) {
+		if (n != 2) {
+			return -1;
+		}
+		e->entry = strtoul(tok[1], &end, 16);
+		return (*end == 0) ? 0 : -1;
+	}
+
+	if (n < 4 || n > 5 || strlen(tok[2]) != 3) {
+		return -1;
+	}
+
+	base = strtoul(tok[0], &end, 16);
+	if (*end || (base & 3)) {
+		return -1;
+	}
+
+	for (int i = 0; i < 3; i++) {
+		if (tok[2][i] == "rwx"[i]) {
+			pf |= (i == 0) ? PF_R : (i == 1) ? PF_W : PF_X;
+		} else if (tok[2][i] != '-') {
+			return -1;
+		}
+	}
+
+	if (strcmp(tok[3], "-") != 0) {
+		if ((at = strchr(tok[3], '@')) != NULL) {
+			*at++ = 0;
+			off = strtoull(at, &end, 16);
+			if (*end) {
+				return -1;
+			}
+		}
+		if (snprintf(path, sizeof(path), "%s%s%s", (tok[3][0] == '/' || dir == NULL) ? "" : dir,
+			(tok[3][0] == '/' || dir == NULL) ? "" : "/", tok[3]) >= (int)sizeof(path)) {
+			return -1;
+		}
+		f = elfout_file(e, path);
+		if (f < 0) {
+			return f;
+		}
+		if (off > e->file[f].size) {
+			return -1;
+		}
+	}
+
+	if (strcmp(tok[1], "-") == 0) {
+		if (f < 0) {
+			return -1;
+		}
+		size = e->file[f].size - off;
+	} else {
+		size = strtoul(tok[1], &end, 16);
+		if (*end) {
+			return -1;
+		}
+	}
+
+	ret = elfout_input(e, (n == 5) ? tok[4] : NULL, base, size, pf, 0);
+	if (ret < 0 || f < 0) {
+		return (ret < 0) ? ret : 0;
+	}
+
+	return elfout_piece(e, f, off, base, (e->file[f].size - off < size) ? e->file[f].size - off : size);
+}
+
+int elfout_map(struct elfout_t *e, const char *path)
+{
+	char line[1024], dir[PATH_MAX];
+	const char *slash = strrchr(path, '/');
+	uint32_t n = 0;
+	FILE *f;
+	int ret = 0;
+
+	if (slash) {
+		snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path), path);
+	}
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		return -2;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		n++;
+		ret = elfout_map_line(e, line, slash ? dir : NULL);
+		if (ret < 0) {
+			e->failed = n;
+			break;
+		}
+	}
+	fclose(f);
+
+	return ret;
+}
+
+// the blocks come from fwimage, crcs checked over all cpus, commands other
+// than data carry nothing to load
+int elfout_image(struct elfout_t *e, const char *path)
+{
+	struct elfout_seg_t *s = NULL;
+	struct fwimage_t w;
+	int f = elfout_file(e, path), ret;
+
+	if (f < 0) {
+		return f;
+	}
+	if (e->file[f].size > UINT32_MAX) {
+		return -1;
+	}
+
+	fwimage_init(&w);
+	ret = fwimage_parse(&w, e->file[f].map, e->file[f].size);
+	if (ret == 0) {
+		ret = fwimage_verify(&w, FWIMAGE_THREADS_AUTO);
+	}
+	e->failed = w.failed;
+
+	for (uint32_t i = 0; i < w.nblock && ret == 0; i++) {
+		const struct fwimage_block_t *b = &w.block[i];
+
+		if (b->cmd != FWIMAGE_CMD_DATA) {
+			continue;
+		}
+
+		// blocks carry on where the one before ended, mostly
+		if (s == NULL || b->addr != s->vaddr + s->memsz || (b->addr ^ s->vaddr) & FWIMAGE_REGION_MASK) {
+			ret = elfout_input(e, NULL, b->addr, b->len ? b->len : 4, elfout_region_pf(b->addr), ELFOUT_MERGE);
+			if (ret < 0) {
+				break;
+			}
+			s = &e->seg[ret];
+			s->memsz = 0;
+			ret = 0;
+		}
+		s->memsz += b->len;
+		if (elfout_piece(e, f, b->off + 16, b->addr, b->len) < 0) {
+			ret = -1;
+		}
+	}
+
+	e->entry = w.entry;
+	fwimage_close(&w);
+
+	return ret;
+}
+
+static int elfout_cmp(const void *a, const void *b)
+{
+	const struct elfout_seg_t *x = a, *y = b;
+
+	return (x->vaddr > y->vaddr) - (x->vaddr < y->vaddr);
+}
+
+int elfout_layout(struct elfout_t *e)
+{
+	struct elfout_piece_t *piece;
+	uint32_t i, n = 0, np = 0;
+	uint64_t off, strs = 1 + sizeof(".shstrtab");
+
+	// inputs in address order, their pieces with them
+	qsort(e->seg, e->nseg, sizeof(e->seg[0]), elfout_cmp);
+
+	piece = malloc(sizeof(*piece) * (e->npiece ? e->npiece : 1));
+	if (piece == NULL) {
+		return -1;
+	}
+	for (i = 0; i < e->nseg; i++) {
+		memcpy(&piece[np], &e->piece[e->seg[i].first], sizeof(*piece) * e->seg[i].count);
+		e->seg[i].first = np;
+		np += e->seg[i].count;
+	}
+	memcpy(e->piece, piece, sizeof(*piece) * np);
+	free(piece);
+
+	for (i = 0; i < e->nseg; i++) {
+		struct elfout_seg_t *a = &e->seg[n - (n > 0)], *b = &e->seg[i];
+
+		if (n && (uint64_t)a->vaddr + a->memsz > b->vaddr) {
+			e->failed = i;
+			return -3;
+		}
+		if (n && (a->flags & b->flags & ELFOUT_MERGE) && a->vaddr + a->memsz == b->vaddr
+			&& a->filesz == a->memsz && a->pf == b->pf) {
+			a->memsz += b->memsz;
+			a->filesz += b->filesz;
+			a->count += b->count;
+			continue;
+		}
+		e->seg[n++] = *b;
+	}
+	e->nseg = n;
+
+	// a region in several pieces, the later ones get their address added
+	for (i = 1; i < e->nseg; i++) {
+		for (uint32_t j = 0; j < i; j++) {
+			if (strcmp(e->seg[i].name, e->seg[j].name) == 0) {
+				char name[sizeof(e->seg[i].name)];
+
+				snprintf(name, sizeof(name), "%.14s_%08x", e->seg[i].name, e->seg[i].vaddr);
+				memcpy(e->seg[i].name, name, sizeof(name));
+				break;
+			}
+		}
+	}
+
+	for (i = 0; i < e->nseg; i++) {
+		strs += strlen(e->seg[i].name) + 1;
+	}
+	e->hdr_size = sizeof(Elf32_Ehdr) + e->nseg * sizeof(Elf32_Phdr) + (e->nseg + 2) * sizeof(Elf32_Shdr) + strs;
+
+	// page aligned data, copy_file_range can share the blocks
+	off = e->hdr_size;
+	for (i = 0; i < e->nseg; i++) {
+		if (e->seg[i].filesz) {
+			off = (off + ELFOUT_ALIGN - 1) & ~(uint64_t)(ELFOUT_ALIGN - 1);
+		}
+		e->seg[i].offset = off;
+		off += e->seg[i].filesz;
+	}
+	e->size = off;
+
+	return 0;
+}
+
+static uint8_t *elfout_header(struct elfout_t *e)
+{
+	uint8_t *buf = calloc(1, e->hdr_size);
+	Elf32_Ehdr *eh = (Elf32_Ehdr *)buf;
+	Elf32_Phdr *ph = (Elf32_Phdr *)(buf + sizeof(*eh));
+	Elf32_Shdr *sh = (Elf32_Shdr *)(ph + e->nseg);
+	char *str = (char *)(sh + e->nseg + 2);
+	uint32_t i, strs = 1;
+
+	if (buf == NULL) {
+		return NULL;
+	}
+
+	memcpy(eh->e_ident, ELFMAG, SELFMAG);
+	eh->e_ident[EI_CLASS] = ELFCLASS32;
+	eh->e_ident[EI_DATA] = ELFDATA2LSB;
+	eh->e_ident[EI_VERSION] = EV_CURRENT;
+	eh->e_ident[EI_OSABI] = ELFOSABI_STANDALONE;
+	eh->e_type = ET_EXEC;
+	eh->e_machine = EM_ARM;
+	eh->e_version = EV_CURRENT;
+	eh->e_entry = e->entry;
+	eh->e_phoff = sizeof(*eh);
+	eh->e_shoff = sizeof(*eh) + e->nseg * sizeof(*ph);
+	eh->e_ehsize = sizeof(*eh);
+	eh->e_phentsize = sizeof(*ph);
+	eh->e_phnum = e->nseg;
+	eh->e_shentsize = sizeof(*sh);
+	eh->e_shnum = e->nseg + 2;
+	eh->e_shstrndx = e->nseg + 1;
+
+	for (i = 0; i < e->nseg; i++) {
+		const struct elfout_seg_t *s = &e->seg[i];
+		uint32_t align = (s->vaddr & 3) ? 1 : 4;
+
+		ph[i].p_type = PT_LOAD;
+		ph[i].p_offset = s->offset;
+		ph[i].p_vaddr = s->vaddr;
+		ph[i].p_paddr = s->vaddr;
+		ph[i].p_filesz = s->filesz;
+		ph[i].p_memsz = s->memsz;
+		ph[i].p_flags = s->pf;
+		ph[i].p_align = align;
+
+		sh[i + 1].sh_name = strs;
+		sh[i + 1].sh_type = s->filesz ? SHT_PROGBITS : SHT_NOBITS;
+		sh[i + 1].sh_flags = SHF_ALLOC | ((s->pf & PF_W) ? SHF_WRITE : 0) | ((s->pf & PF_X) ? SHF_EXECINSTR : 0);
+		sh[i + 1].sh_addr = s->vaddr;
+		sh[i + 1].sh_offset = s->offset;
+		sh[i + 1].sh_size = s->filesz ? s->filesz : s->memsz;
+		sh[i + 1].sh_addralign = align;
+		strcpy(str + strs, s->name);
+		strs += strlen(s->name) + 1;
+	}
+
+	sh[i + 1].sh_name = strs;
+	sh[i + 1].sh_type = SHT_STRTAB;
+	sh[i + 1].sh_offset = (uint8_t *)str - buf;
+	sh[i + 1].sh_size = strs + sizeof(".shstrtab");
+	sh[i + 1].sh_addralign = 1;
+	strcpy(str + strs, ".shstrtab");
+
+	return buf;
+}
+
+static int elfout_pwrite(struct elfout_t *e, int out, const uint8_t *buf, uint64_t len, uint64_t off)
+{
+	while (len) {
+		ssize_t ret = pwrite(out, buf, len, off);
+
+		if (ret <= 0) {
+			if (ret < 0 && errno == EINTR) {
+				continue;
+			}
+			return -4;
+		}
+		buf += ret;
+		off += ret;
+		len -= ret;
+		e->written += ret;
+		e->calls++;
+	}
+
+	return 0;
+}
+
+// in place, data goes from file to file inside the kernel
+static int elfout_copy(struct elfout_t *e, int out, const uint8_t *hdr)
+{
+	int fallback = 0;
+
+	if (elfout_pwrite(e, out, hdr, e->hdr_size, 0) < 0) {
+		return -4;
+	}
+
+	for (uint32_t i = 0; i < e->nseg; i++) {
+		const struct elfout_seg_t *s = &e->seg[i];
+
+		for (uint32_t j = s->first; j < s->first + s->count; j++) {
+			const struct elfout_piece_t *p = &e->piece[j];
+			const struct elfout_file_t *f = &e->file[p->file];
+			loff_t src = p->off, dst = s->offset + (p->vaddr - s->vaddr);
+			uint64_t left = p->len;
+
+			while (left && !fallback) {
+				ssize_t ret = copy_file_range(f->fd, &src, out, &dst, left, 0);
+
+				if (ret < 0 && errno == EINTR) {
+					continue;
+				}
+				if (ret <= 0) {
+					// another filesystem or an older kernel
+					if (ret < 0 && errno != EXDEV && errno != EINVAL && errno != ENOSYS
+						&& errno != EOPNOTSUPP && errno != EBADF) {
+						return -4;
+					}
+					fallback = 1;
+					break;
+				}
+				left -= ret;
+				e->copied += ret;
+				e->calls++;
+			}
+
+			if (left && elfout_pwrite(e, out, f->map + src, left, dst) < 0) {
+				return -4;
+			}
+		}
+	}
+
+	// gaps between segments stay holes
+	return (ftruncate(out, e->size) < 0) ? -4 : 0;
+}
+
+struct elfout_iov_t {
+	struct iovec iov[IOV_MAX];
+	int n;
+};
+
+static int elfout_flush(struct elfout_t *e, int out, struct elfout_iov_t *v)
+{
+	struct iovec *iov = v->iov;
+	int n = v->n;
+
+	while (n) {
+		ssize_t ret = writev(out, iov, n);
+
+		if (ret <= 0) {
+			if (ret < 0 && errno == EINTR) {
+				continue;
+			}
+			return -4;
+		}
+		e->written += ret;
+		e->calls++;
+		while (n && (size_t)ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			n--;
+		}
+		if (n) {
+			iov->iov_base = (uint8_t *)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+	v->n = 0;
+
+	return 0;
+}
+
+static int elfout_add(struct elfout_t *e, int out, struct elfout_iov_t *v, const void *buf, uint64_t len)
+{
+	while (len) {
+		// iov_len is not limited, a write is
+		uint64_t chunk = (len > 0x40000000) ? 0x40000000 : len;
+
+		if (v->n == IOV_MAX && elfout_flush(e, out, v) < 0) {
+			return -4;
+		}
+		v->iov[v->n].iov_base = (void *)buf;
+		v->iov[v->n].iov_len = chunk;
+		v->n++;
+		buf = (const uint8_t *)buf + chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+// in order, for pipes, straight from the mappings
+static int elfout_writev(struct elfout_t *e, int out, const uint8_t *hdr)
+{
+	static const uint8_t zero[ELFOUT_ALIGN];
+	static struct elfout_iov_t v;
+	uint64_t pos = e->hdr_size;
+
+	v.n = 0;
+	if (elfout_add(e, out, &v, hdr, e->hdr_size) < 0) {
+		return -4;
+	}
+
+	for (uint32_t i = 0; i < e->nseg; i++) {
+		const struct elfout_seg_t *s = &e->seg[i];
+
+		if (s->filesz == 0) {
+			continue;
+		}
+		if (elfout_add(e, out, &v, zero, s->offset - pos) < 0) {
+			return -4;
+		}
+		for (uint32_t j = s->first; j < s->first + s->count; j++) {
+			const struct elfout_piece_t *p = &e->piece[j];
+
+			if (elfout_add(e, out, &v, e->file[p->file].map + p->off, p->len) < 0) {
+				return -4;
+			}
+		}
+		pos = s->offset + s->filesz;
+	}
+
+	return elfout_flush(e, out, &v);
+}
+
+// the way it used to be done: everything read into one buffer first
+static int elfout_buffer(struct elfout_t *e, int out, const uint8_t *hdr)
+{
+	uint8_t *buf = calloc(1, e->size);
+	int ret = 0;
+
+	if (buf == NULL) {
+		return -4;
+	}
+	memcpy(buf, hdr, e->hdr_size);
+
+	for (uint32_t i = 0; i < e->nseg && ret == 0; i++) {
+		const struct elfout_seg_t *s = &e->seg[i];
+
+		for (uint32_t j = s->first; j < s->first + s->count; j++) {
+			const struct elfout_piece_t *p = &e->piece[j];
+
+			if (pread(e->file[p->file].fd, buf + s->offset + (p->vaddr - s->vaddr), p->len, p->off) != p->len) {
+				ret = -4;
+				break;
+			}
+		}
+	}
+
+	for (uint64_t done = 0; ret == 0 && done < e->size; ) {
+		ssize_t n = write(out, buf + done, e->size - done);
+
+		if (n <= 0) {
+			ret = -4;
+			break;
+		}
+		done += n;
+		e->written += n;
+		e->calls++;
+	}
+	free(buf);
+
+	return ret;
+}
+
+int elfout_write(struct elfout_t *e, int out, int mode)
+{
+	uint8_t *hdr = elfout_header(e);
+	struct stat st;
+	int ret;
+
+	if (hdr == NULL) {
+		return -4;
+	}
+
+	e->copied = 0;
+	e->written = 0;
+	e->calls = 0;
+
+	if (mode == ELFOUT_AUTO) {
+		mode = (fstat(out, &st) == 0 && S_ISREG(st.st_mode)) ? ELFOUT_COPY : ELFOUT_WRITEV;
+	}
+
+	switch (mode) {
+	case ELFOUT_COPY: ret = elfout_copy(e, out, hdr); break;
+	case ELFOUT_BUFFER: ret = elfout_buffer(e, out, hdr); break;
+	default: ret = elfout_writev(e, out, hdr); break;
+	}
+	free(hdr);
+
+	return ret;
+}
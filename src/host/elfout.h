@@ -0,0 +1,96 @@
+#ifndef ELFOUT_h_
+#define ELFOUT_h_
+
+#include <stdint.h>
+
+// streaming ELF writer for firmware memory, the inputs are mapped and their
+// bytes go to the output with copy_file_range or writev straight from the
+// mapping, nothing is copied into a buffer of ours
+// an input is a range of memory, the part of it backed by file data is a
+// list of pieces, any ranges work as long as they do not overlap, gaps
+// between them end up as separate segments
+// calls return 0 or an index, -1 bad input, -2 file not readable, -3 two
+// inputs overlap, -4 write failed, -5 image damaged, failed is the input,
+// line or block an error is about
+
+#define ELFOUT_INPUTS_MAX 256
+#define ELFOUT_PIECES_MAX 8192
+#define ELFOUT_FILES_MAX  64
+
+#define ELFOUT_MERGE      0x0001   // joins inputs right before and after it
+
+enum {
+	ELFOUT_AUTO,             // copy_file_range into files, writev otherwise
+	ELFOUT_COPY,             // copy_file_range, writev where it cannot
+	ELFOUT_WRITEV,
+	ELFOUT_BUFFER,           // read into a buffer and write that, to compare
+};
+
+struct elfout_file_t {
+	int fd;
+	uint64_t size;
+	const uint8_t *map;
+};
+
+struct elfout_piece_t {
+	uint32_t vaddr;
+	uint32_t len;
+	uint32_t file;
+	uint64_t off;
+};
+
+struct elfout_seg_t {
+	char name[24];
+	uint32_t vaddr;
+	uint32_t memsz;
+	uint32_t filesz;         // memsz past it is zero
+	uint32_t pf;             // PF_R, PF_W, PF_X
+	uint32_t flags;
+	uint32_t first;          // pieces, in address order
+	uint32_t count;
+	uint64_t offset;         // in the ELF
+};
+
+struct elfout_t {
+	uint32_t entry;
+	uint32_t nseg;
+	uint32_t npiece;
+	uint32_t nfile;
+	uint32_t failed;         // input or line an error is about
+	uint64_t size;           // of the ELF, after elfout_layout
+	uint64_t hdr_size;
+	// how the last elfout_write moved the bytes
+	uint64_t copied;         // copy_file_range
+	uint64_t written;        // writev or write
+	uint32_t calls;
+	struct elfout_seg_t seg[ELFOUT_INPUTS_MAX];
+	struct elfout_piece_t piece[ELFOUT_PIECES_MAX];
+	struct elfout_file_t file[ELFOUT_FILES_MAX];
+};
+
+void elfout_init(struct elfout_t *e);
+void elfout_close(struct elfout_t *e);
+
+// maps a file, returns its index or -2
+int elfout_file(struct elfout_t *e, const char *name);
+// a range of memory, pf as in the program header, returns its index or -1
+int elfout_input(struct elfout_t *e, const char *name, uint32_t vaddr, uint32_t memsz, uint32_t pf, uint32_t flags);
+// len bytes of file at off backing vaddr of the last input, returns 0 or -1
+int elfout_piece(struct elfout_t *e, uint32_t file, uint64_t off, uint32_t vaddr, uint32_t len);
+
+// dump-<base>-<size>.bin, base and size from the name
+int elfout_dump(struct elfout_t *e, const char *path);
+// segment map, one line per input:
+//   <base> <size> <rwx> <file>[@offset] [name]
+// all numbers hex, file - for memory without data, size - for the file
+// size, entry <addr> sets the entry point, # starts a comment
+// files are relative to the map, failed is the line of an error
+int elfout_map(struct elfout_t *e, const char *path);
+// marvell firmware download image, one input per block
+int elfout_image(struct elfout_t *e, const char *path);
+
+// sorts, merges and places the inputs
+int elfout_layout(struct elfout_t *e);
+int elfout_write(struct elfout_t *e, int out, int mode);
+
+#endif
@@ -0,0 +1,201 @@
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FWCRC_X86
+#endif
+
+#include "fwcrc.h"
+
+#define FWCRC_POLY 0x04C11DB7
+
+// t[k][b] is the crc of byte b followed by k zero bytes
+static uint32_t t[8][256];
+
+#ifdef FWCRC_X86
+// x^(d+64) mod p and x^d mod p, folding 128 bits forward by d bits
+static uint64_t k128[2], k256[2], k384[2], k512[2];
+#endif
+
+static int best;
+
+// x^n mod p
+static uint32_t fwcrc_xpow(uint32_t n)
+{
+	uint32_t r = 1;
+
+	while (n--) {
+		r = (r & 0x80000000) ? (r << 1) ^ FWCRC_POLY : r << 1;
+	}
+
+	return r;
+}
+
+__attribute__((constructor))
+static void fwcrc_init(void)
+{
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t r = i << 24;
+
+		for (int bit = 0; bit < 8; bit++) {
+			r = (r & 0x80000000) ? (r << 1) ^ FWCRC_POLY : r << 1;
+		}
+		t[0][i] = r;
+	}
+	for (uint32_t k = 1; k < 8; k++) {
+		for (uint32_t i = 0; i < 256; i++) {
+			t[k][i] = (t[k - 1][i] << 8) ^ t[0][t[k - 1][i] >> 24];
+		}
+	}
+
+	best = FWCRC_SLICE8;
+
+#ifdef FWCRC_X86
+	k128[0] = fwcrc_xpow(128);
+	k128[1] = fwcrc_xpow(128 + 64);
+	k256[0] = fwcrc_xpow(256);
+	k256[1] = fwcrc_xpow(256 + 64);
+	k384[0] = fwcrc_xpow(384);
+	k384[1] = fwcrc_xpow(384 + 64);
+	k512[0] = fwcrc_xpow(512);
+	k512[1] = fwcrc_xpow(512 + 64);
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3")) {
+		best = FWCRC_CLMUL;
+	}
+#endif
+}
+
+static uint32_t fwcrc_byte(uint32_t crc, const uint8_t *p, size_t len)
+{
+	while (len--) {
+		crc = t[0][*p++ ^ (crc >> 24)] ^ (crc << 8);
+	}
+
+	return crc;
+}
+
+static uint32_t fwcrc_slice8(uint32_t crc, const uint8_t *p, size_t len)
+{
+	while (len >= 8) {
+		uint32_t a = crc ^ ((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3]);
+
+		crc = t[7][a >> 24] ^ t[6][(a >> 16) & 0xff] ^ t[5][(a >> 8) & 0xff] ^ t[4][a & 0xff]
+			^ t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+		p += 8;
+		len -= 8;
+	}
+
+	return fwcrc_byte(crc, p, len);
+}
+
+#ifdef FWCRC_X86
+
+// 16 bytes as one polynomial, the first byte holding the highest terms
+#define FWCRC_LOAD(p) _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p)), rev)
+#define FWCRC_FOLD(x, k) _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11), _mm_clmulepi64_si128(x, k, 0x00))
+
+// the message is folded into four 128 bit remainders, each moved 512 bits
+// forward per stride by multiplying its halves with x^576 and x^512 mod p,
+// the four into one, the crc of that is the crc of what it stands for
+__attribute__((target("pclmul,ssse3")))
+static uint32_t fwcrc_clmul(uint32_t crc, const uint8_t *p, size_t len)
+{
+	const __m128i rev = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m128i c128 = _mm_set_epi64x(k128[1], k128[0]);
+	const __m128i c256 = _mm_set_epi64x(k256[1], k256[0]);
+	const __m128i c384 = _mm_set_epi64x(k384[1], k384[0]);
+	const __m128i c512 = _mm_set_epi64x(k512[1], k512[0]);
+	__m128i x0, x1, x2, x3;
+	uint8_t b[16];
+
+	if (len < 64) {
+		return fwcrc_slice8(crc, p, len);
+	}
+
+	// an initial remainder is the same as xoring it into the first word
+	x0 = _mm_xor_si128(FWCRC_LOAD(p), _mm_set_epi32(crc, 0, 0, 0));
+	x1 = FWCRC_LOAD(p + 16);
+	x2 = FWCRC_LOAD(p + 32);
+	x3 = FWCRC_LOAD(p + 48);
+	p += 64;
+	len -= 64;
+
+	while (len >= 64) {
+		x0 = _mm_xor_si128(FWCRC_FOLD(x0, c512), FWCRC_LOAD(p));
+		x1 = _mm_xor_si128(FWCRC_FOLD(x1, c512), FWCRC_LOAD(p + 16));
+		x2 = _mm_xor_si128(FWCRC_FOLD(x2, c512), FWCRC_LOAD(p + 32));
+		x3 = _mm_xor_si128(FWCRC_FOLD(x3, c512), FWCRC_LOAD(p + 48));
+		p += 64;
+		len -= 64;
+	}
+
+	x0 = _mm_xor_si128(_mm_xor_si128(FWCRC_FOLD(x0, c384), FWCRC_FOLD(x1, c256)),
+		_mm_xor_si128(FWCRC_FOLD(x2, c128), x3));
+
+	while (len >= 16) {
+		x0 = _mm_xor_si128(FWCRC_FOLD(x0, c128), FWCRC_LOAD(p));
+		p += 16;
+		len -= 16;
+	}
+
+	_mm_storeu_si128((__m128i *)b, _mm_shuffle_epi8(x0, rev));
+
+	return fwcrc_slice8(fwcrc_slice8(0, b, 16), p, len);
+}
+
+#endif
+
+int fwcrc_has(int impl)
+{
+	switch (impl) {
+	case FWCRC_BYTE:
+	case FWCRC_SLICE8:
+		return 1;
+	case FWCRC_CLMUL:
+		return best == FWCRC_CLMUL;
+	default:
+		return 0;
+	}
+}
+
+uint32_t fwcrc_with(int impl, uint32_t crc, const void *buf, size_t len)
+{
+	switch (impl) {
+	case FWCRC_BYTE:
+		return fwcrc_byte(crc, buf, len);
+#ifdef FWCRC_X86
+	case FWCRC_CLMUL:
+		if (best == FWCRC_CLMUL) {
+			return fwcrc_clmul(crc, buf, len);
+		}
+		// fall through
+#endif
+	default:
+		return fwcrc_slice8(crc, buf, len);
+	}
+}
+
+uint32_t fwcrc(uint32_t crc, const void *buf, size_t len)
+{
+#ifdef FWCRC_X86
+	if (best == FWCRC_CLMUL) {
+		return fwcrc_clmul(crc, buf, len);
+	}
+#endif
+
+	return fwcrc_slice8(crc, buf, len);
+}
+
+int fwcrc_impl(void)
+{
+	return best;
+}
+
+const char *fwcrc_name(int impl)
+{
+	static const char *names[] = { "byte", "slice8", "clmul" };
+
+	return (impl >= 0 && impl < FWCRC_IMPLS) ? names[impl] : "?";
+}
@@ -0,0 +1,30 @@
+#ifndef FWCRC_h_
+#define FWCRC_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// crc32 of the marvell download images: poly 0x04C11DB7, msb first, not
+// reflected, no final xor, the image uses 0 as the initial remainder and a
+// header or block followed by its crc comes out as 0
+// fwcrc picks the fastest of the implementations the cpu has at startup,
+// carry-less multiply folding over 64 byte strides, slice-by-8 otherwise,
+// byte at a time as the reference
+
+enum {
+	FWCRC_BYTE,
+	FWCRC_SLICE8,
+	FWCRC_CLMUL,             // x86 pclmulqdq
+	FWCRC_IMPLS,
+};
+
+uint32_t fwcrc(uint32_t crc, const void *buf, size_t len);
+
+// a given implementation, 0 when the cpu does not have it
+int fwcrc_has(int impl);
+uint32_t fwcrc_with(int impl, uint32_t crc, const void *buf, size_t len);
+// the one fwcrc uses
+int fwcrc_impl(void);
+const char *fwcrc_name(int impl);
+
+#endif
@@ -0,0 +1,336 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "fwcrc.h"
+#include "test.h"
+
+// every implementation of fwcrc against the table crc bin2elf always had,
+// over every length up to a few strides at every alignment, random initial
+// remainders, large buffers and every header and block of the marvell
+// images, which have to come out as 0
+// with -b it measures instead how fast each one is over the images, whole
+// and block by block the way the converters check them
+
+// the reference, as it was in doc/re/bin2elf.c
+
+static unsigned crctable[256];
+
+#define POLYNOMIAL 0x04C11DB7
+
+static void init_crc(void){
+	unsigned dividend = 0;
+	do{
+		unsigned remainder = dividend << 24;
+		unsigned bit = 0;
+		do{
+			if(remainder & 0x80000000){
+				remainder <<= 1;
+				remainder ^= POLYNOMIAL;
+			}else{
+				remainder <<= 1;
+			}
+		}while(++bit<8);
+		crctable[dividend++] = remainder;
+	}while(dividend<256);
+}
+
+// for Marvell, pass 0 as the initial remainder
+static unsigned do_crc(unsigned remainder, const unsigned char *p, unsigned n){
+	unsigned i = 0;
+	while(i < n){
+		unsigned char data = *p ^ (remainder >> 24);
+		remainder = crctable[data] ^ (remainder << 8);
+		p++;
+		i++;
+	}
+	return remainder;
+}
+
+static uint8_t *load(const char *file, uint32_t *size)
+{
+	struct stat st;
+	uint8_t *buf;
+	int fd = open(file, O_RDONLY);
+
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		return NULL;
+	}
+	buf = malloc(st.st_size + 1);
+	if (buf && read(fd, buf, st.st_size) != st.st_size) {
+		free(buf);
+		buf = NULL;
+	}
+	close(fd);
+	*size = st.st_size;
+
+	return buf;
+}
+
+static uint32_t le32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// the blocks of an image, offsets of headers and data lengths
+struct block_t {
+	uint32_t off;
+	uint32_t len;
+};
+
+static int blocks(const uint8_t *img, uint32_t size, struct block_t *b, int max)
+{
+	uint32_t off = 0;
+	int n = 0;
+
+	while (off + 16 <= size && n < max) {
+		uint32_t cmd = le32(img + off), len = le32(img + off + 8);
+
+		if (len > size - off - 16) {
+			return -1;
+		}
+		b[n].off = off;
+		b[n].len = len;
+		n++;
+		off += 16 + len;
+		if (cmd == 4 && len == 0) {
+			break;
+		}
+	}
+
+	return n;
+}
+
+static int check_impl(int impl)
+{
+	static uint8_t buf[1 << 20];
+	uint32_t i, bad = 0;
+
+	for (i = 0; i < sizeof(buf); i++) {
+		buf[i] = rng();
+	}
+
+	// each length from every alignment, from 0 and a random remainder
+	for (uint32_t len = 0; len <= 320; len++) {
+		for (uint32_t align = 0; align < 16; align++) {
+			uint32_t init = (align & 1) ? rng() : 0;
+
+			if (fwcrc_with(impl, init, buf + align, len) != do_crc(init, buf + align, len)) {
+				if (bad++ < 4) {
+					printf("  %s len %u align %u init %08x: FAIL\n", fwcrc_name(impl), len, align, init);
+				}
+			}
+		}
+	}
+
+	// random pieces, chained the way a crc over a stream is
+	for (i = 0; i < 2000; i++) {
+		uint32_t off = rng() % (sizeof(buf) / 2), len = rng() % (sizeof(buf) / 2);
+		uint32_t init = rng(), cut = len ? rng() % len : 0;
+		uint32_t want = do_crc(init, buf + off, len);
+		uint32_t one = fwcrc_with(impl, init, buf + off, len);
+		uint32_t two = fwcrc_with(impl, fwcrc_with(impl, init, buf + off, cut), buf + off + cut, len - cut);
+
+		if (one != want || two != want) {
+			if (bad++ < 4) {
+				printf("  %s off %u len %u cut %u: %08x %08x want %08x: FAIL\n",
+					fwcrc_name(impl), off, len, cut, one, two, want);
+			}
+		}
+	}
+
+	// a block followed by its crc, msb first
+	for (i = 0; i < 64; i++) {
+		uint32_t len = rng() % 4096, crc = do_crc(0, buf, len);
+		uint8_t *p = buf + len;
+		uint8_t save[4];
+
+		memcpy(save, p, 4);
+		p[0] = crc >> 24;
+		p[1] = crc >> 16;
+		p[2] = crc >> 8;
+		p[3] = crc;
+		if (fwcrc_with(impl, 0, buf, len + 4) != 0) {
+			if (bad++ < 4) {
+				printf("  %s len %u with its crc: FAIL\n", fwcrc_name(impl), len);
+			}
+		}
+		memcpy(p, save, 4);
+	}
+
+	printf("  %-8s %s\n", fwcrc_name(impl), bad ? "FAIL" : "ok");
+
+	return bad != 0;
+}
+
+static int check_image(const char *file)
+{
+	static struct block_t b[4096];
+	uint32_t size, bad = 0;
+	uint8_t *img = load(file, &size);
+	int n;
+
+	if (!img) {
+		printf("  %s: not found, skipped\n", file);
+		return 0;
+	}
+	n = blocks(img, size, b, 4096);
+	if (n <= 0) {
+		printf("  %s: no blocks: FAIL\n", file);
+		free(img);
+		return 1;
+	}
+
+	for (int impl = 0; impl < FWCRC_IMPLS; impl++) {
+		if (!fwcrc_has(impl)) {
+			continue;
+		}
+		for (int i = 0; i < n; i++) {
+			const uint8_t *h = img + b[i].off;
+
+			if (fwcrc_with(impl, 0, h, 16) != 0
+				|| (b[i].len && fwcrc_with(impl, 0, h + 16, b[i].len) != 0)) {
+				if (bad++ < 4) {
+					printf("  %s %s block %d at %x: FAIL\n", file, fwcrc_name(impl), i, b[i].off);
+				}
+			}
+		}
+		if (fwcrc_with(impl, 0, img, size) != do_crc(0, img, size)) {
+			bad++;
+			printf("  %s %s whole image: FAIL\n", file, fwcrc_name(impl));
+		}
+	}
+	printf("  %s: %d blocks %s\n", strrchr(file, '/') ? strrchr(file, '/') + 1 : file, n, bad ? "FAIL" : "ok");
+	free(img);
+
+	return bad != 0;
+}
+
+// each image whole, and block by block as header and data, best of a few runs
+static int bench(const char *dir, uint32_t rounds)
+{
+	static const char *names[] = { "sd8787_uapsta.bin", "sd8897_uapsta.bin" };
+	static struct block_t b[4096];
+	char file[640];
+	volatile uint32_t sink = 0;
+
+	printf("cpu has clmul: %s, fwcrc uses %s\n", fwcrc_has(FWCRC_CLMUL) ? "yes" : "no", fwcrc_name(fwcrc_impl()));
+	printf("%-20s %-8s %12s %10s %12s %10s\n", "", "", "whole MiB/s", "x byte", "blocks MiB/s", "x byte");
+
+	for (uint32_t f = 0; f < sizeof(names) / sizeof(names[0]); f++) {
+		double base[2] = { 0, 0 };
+		uint32_t size;
+		uint8_t *img;
+		int n;
+
+		snprintf(file, sizeof(file), "%s/%s", dir, names[f]);
+		img = load(file, &size);
+		if (!img) {
+			fprintf(stderr, "%s: not readable\n", file);
+			return 1;
+		}
+		n = blocks(img, size, b, 4096);
+
+		for (int impl = 0; impl < FWCRC_IMPLS; impl++) {
+			double best[2] = { 1e9, 1e9 };
+
+			if (!fwcrc_has(impl)) {
+				continue;
+			}
+			for (int run = 0; run < 5; run++) {
+				double t0 = now();
+
+				for (uint32_t r = 0; r < rounds; r++) {
+					sink ^= fwcrc_with(impl, 0, img, size);
+				}
+				if (now() - t0 < best[0]) {
+					best[0] = now() - t0;
+				}
+
+				t0 = now();
+				for (uint32_t r = 0; r < rounds; r++) {
+					for (int i = 0; i < n; i++) {
+						sink ^= fwcrc_with(impl, 0, img + b[i].off, 16);
+						sink ^= fwcrc_with(impl, 0, img + b[i].off + 16, b[i].len);
+					}
+				}
+				if (now() - t0 < best[1]) {
+					best[1] = now() - t0;
+				}
+			}
+			if (impl == FWCRC_BYTE) {
+				base[0] = best[0];
+				base[1] = best[1];
+			}
+			printf("%-20s %-8s %12.0f %10.1f %12.0f %10.1f\n", names[f], fwcrc_name(impl),
+				(double)size * rounds / best[0] / (1 << 20), base[0] / best[0],
+				(double)size * rounds / best[1] / (1 << 20), base[1] / best[1]);
+		}
+		free(img);
+	}
+
+	return sink == 0xffffffff;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-b] [-n rounds] [-s seed] [-d dir]\n", name);
+	fprintf(stderr, "  -b  speed of each implementation over the images instead of the checks\n");
+	fprintf(stderr, "  -n  passes over each image for -b (200)\n");
+	fprintf(stderr, "  -d  where the images are (doc/marvell)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	static const char *images[] = { "sd8787_uapsta.bin", "sd8797_uapsta.bin", "sd8897_uapsta.bin", "pcie8897_uapsta.bin" };
+	char dir[512], file[640];
+	const char *src = __FILE__, *slash = strrchr(src, '/');
+	uint32_t rounds = 200;
+	int opt, fail = 0, do_bench = 0;
+
+	snprintf(dir, sizeof(dir), "%.*s../../doc/marvell", slash ? (int)(slash - src + 1) : 0, src);
+
+	while ((opt = getopt(argc, argv, "bn:s:d:h")) != -1) {
+		switch (opt) {
+		case 'b': do_bench = 1; break;
+		case 'n': rounds = strtoul(optarg, NULL, 0); break;
+		case 's': rng_state = strtoul(optarg, NULL, 0) | 1; break;
+		case 'd': snprintf(dir, sizeof(dir), "%s", optarg); break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	init_crc();
+
+	if (do_bench) {
+		return bench(dir, rounds ? rounds : 1);
+	}
+
+	printf("implementations, fwcrc uses %s\n", fwcrc_name(fwcrc_impl()));
+	for (int impl = 0; impl < FWCRC_IMPLS; impl++) {
+		if (fwcrc_has(impl)) {
+			fail |= check_impl(impl);
+		} else {
+			printf("  %-8s not on this cpu\n", fwcrc_name(impl));
+		}
+	}
+	fail |= fwcrc(0, "123456789", 9) != do_crc(0, (const uint8_t *)"123456789", 9);
+
+	printf("images\n");
+	for (uint32_t i = 0; i < sizeof(images) / sizeof(images[0]); i++) {
+		snprintf(file, sizeof(file), "%s/%s", dir, images[i]);
+		fail |= check_image(file);
+	}
+
+	printf("%s\n", fail ? "FAIL" : "ok");
+
+	return fail ? 2 : 0;
+}
@@ -0,0 +1,598 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "fwdiff.h"
+
+#define FWDIFF_CHAIN_MAX  64       // candidates tried per rolling hash hit
+#define FWDIFF_ANCHOR_GAP 4096     // matches further apart do not anchor a site
+
+// rolling hash multiplier and its power for the byte leaving the window
+#define FWDIFF_ROLL_MUL   0x01000193u
+
+static uint64_t gear[256];
+static uint32_t roll_out;
+
+__attribute__((constructor))
+static void fwdiff_setup(void)
+{
+	uint64_t x = 0x9e3779b97f4a7c15ull;
+
+	// splitmix64, the table has to be the same on every run
+	for (int i = 0; i < 256; i++) {
+		uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		gear[i] = z ^ (z >> 31);
+	}
+
+	roll_out = 1;
+	for (int i = 1; i < FWDIFF_WINDOW; i++) {
+		roll_out *= FWDIFF_ROLL_MUL;
+	}
+}
+
+void fwdiff_mem_init(struct fwdiff_mem_t *m)
+{
+	memset(m, 0, sizeof(*m));
+}
+
+void fwdiff_mem_free(struct fwdiff_mem_t *m)
+{
+	for (uint32_t i = 0; i < m->nregion; i++) {
+		free(m->region[i].mem);
+	}
+	fwdiff_mem_init(m);
+}
+
+int fwdiff_mem_add(struct fwdiff_mem_t *m, uint32_t lo, const void *data, uint32_t len)
+{
+	struct fwdiff_region_t *r = &m->region[m->nregion];
+
+	if (m->nregion == FWIMAGE_REGIONS_MAX || (uint64_t)lo + len > UINT32_MAX) {
+		return -1;
+	}
+	r->mem = malloc(len ? len : 1);
+	if (r->mem == NULL) {
+		return -1;
+	}
+	if (data) {
+		memcpy(r->mem, data, len);
+	} else {
+		memset(r->mem, 0, len);
+	}
+	r->lo = lo;
+	r->hi = lo + len;
+
+	return m->nregion++;
+}
+
+int fwdiff_mem_load(struct fwdiff_mem_t *m, const struct fwimage_t *w)
+{
+	uint32_t first = m->nregion;
+
+	for (uint32_t i = 0; i < w->nregion; i++) {
+		if (fwdiff_mem_add(m, w->region[i].lo, NULL, w->region[i].hi - w->region[i].lo) < 0) {
+			return -1;
+		}
+	}
+	for (uint32_t i = 0; i < w->nblock; i++) {
+		const struct fwimage_block_t *b = &w->block[i];
+		struct fwdiff_region_t *r;
+
+		if (b->cmd != FWIMAGE_CMD_DATA || b->error != FWIMAGE_OK) {
+			continue;
+		}
+		r = &m->region[first + b->region];
+		memcpy(r->mem + (b->addr - r->lo), w->data + b->off + 16, b->len);
+	}
+
+	return 0;
+}
+
+void fwdiff_init(struct fwdiff_t *d)
+{
+	memset(d, 0, sizeof(*d));
+}
+
+void fwdiff_free(struct fwdiff_t *d)
+{
+	free(d->range);
+	fwdiff_init(d);
+}
+
+// matches inside one pair of regions, offsets from their starts
+struct fwdiff_match_t {
+	uint32_t a;
+	uint32_t b;
+	uint32_t len;
+};
+
+struct fwdiff_work_t {
+	const uint8_t *a;
+	uint32_t alen;
+	const uint8_t *b;
+	uint32_t blen;
+	struct fwdiff_match_t *match;
+	uint32_t nmatch;
+	uint32_t nalloc;
+	int32_t delta;           // of the last match, preferred for the next
+};
+
+static int fwdiff_push(struct fwdiff_work_t *k, uint32_t a, uint32_t b, uint32_t len)
+{
+	if (k->nmatch == k->nalloc) {
+		uint32_t n = k->nalloc ? k->nalloc * 2 : 256;
+		struct fwdiff_match_t *m = realloc(k->match, sizeof(*m) * n);
+
+		if (m == NULL) {
+			return -1;
+		}
+		k->match = m;
+		k->nalloc = n;
+	}
+	k->match[k->nmatch].a = a;
+	k->match[k->nmatch].b = b;
+	k->match[k->nmatch].len = len;
+	k->nmatch++;
+	k->delta = (int32_t)(b - a);
+
+	return 0;
+}
+
+// a match at a, b grown forward up to b_end and back down to b_start
+static uint32_t fwdiff_grow(const struct fwdiff_work_t *k, uint32_t *a, uint32_t *b, uint32_t len,
+	uint32_t b_start, uint32_t b_end)
+{
+	while (*a + len < k->alen && *b + len < b_end && k->a[*a + len] == k->b[*b + len]) {
+		len++;
+	}
+	while (*a > 0 && *b > b_start && k->a[*a - 1] == k->b[*b - 1]) {
+		(*a)--;
+		(*b)--;
+		len++;
+	}
+
+	return len;
+}
+
+// next content defined boundary after off
+static uint32_t fwdiff_cut(const uint8_t *p, uint32_t off, uint32_t len)
+{
+	uint32_t end = (len - off > FWDIFF_CHUNK_MAX) ? off + FWDIFF_CHUNK_MAX : len;
+	uint64_t h = 0;
+
+	if (end - off <= FWDIFF_CHUNK_MIN) {
+		return end;
+	}
+	for (uint32_t i = off; i < end; i++) {
+		h = (h << 1) + gear[p[i]];
+		if (i - off >= FWDIFF_CHUNK_MIN && (h >> 56) == 0) {
+			return i + 1;
+		}
+	}
+
+	return end;
+}
+
+static uint64_t fwdiff_hash(const uint8_t *p, uint32_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ull;
+
+	while (len--) {
+		h = (h ^ *p++) * 0x100000001b3ull;
+	}
+
+	return h;
+}
+
+struct fwdiff_chunk_t {
+	uint64_t hash;
+	uint32_t off;
+	uint32_t len;            // 0 for an empty slot
+};
+
+// chunks of b looked up among the chunks of a, each hit grown into a match
+static int fwdiff_chunks(struct fwdiff_work_t *k, uint32_t *chunks, uint32_t *hits)
+{
+	struct fwdiff_chunk_t *t;
+	uint32_t size = 1024, mask, off, covered = 0;
+
+	while (size < k->alen / FWDIFF_CHUNK_MIN * 2) {
+		size *= 2;
+	}
+	mask = size - 1;
+	t = calloc(size, sizeof(*t));
+	if (t == NULL) {
+		return -1;
+	}
+
+	for (off = 0; off < k->alen; ) {
+		uint32_t end = fwdiff_cut(k->a, off, k->alen);
+		uint64_t h = fwdiff_hash(k->a + off, end - off);
+		uint32_t i = h & mask;
+
+		while (t[i].len) {
+			i = (i + 1) & mask;
+		}
+		t[i].hash = h;
+		t[i].off = off;
+		t[i].len = end - off;
+		off = end;
+	}
+
+	for (off = 0; off < k->blen; ) {
+		uint32_t end = fwdiff_cut(k->b, off, k->blen);
+		uint64_t h = fwdiff_hash(k->b + off, end - off);
+		uint32_t i = h & mask, a = 0, found = 0;
+
+		(*chunks)++;
+		if (off < covered) {
+			off = end;
+			continue;
+		}
+		// of equal chunks the one keeping the distance of the last match
+		for (; t[i].len; i = (i + 1) & mask) {
+			if (t[i].hash != h || t[i].len != end - off || memcmp(k->a + t[i].off, k->b + off, end - off)) {
+				continue;
+			}
+			if (!found || (int32_t)(off - t[i].off) == k->delta) {
+				a = t[i].off;
+				found = 1;
+			}
+		}
+		if (found) {
+			uint32_t b = off, len = fwdiff_grow(k, &a, &b, end - off, covered, k->blen);
+
+			if (len >= FWDIFF_MIN_MATCH) {
+				if (fwdiff_push(k, a, b, len) < 0) {
+					free(t);
+					return -1;
+				}
+				(*hits)++;
+				covered = b + len;
+			}
+		}
+		off = end;
+	}
+
+	free(t);
+
+	return 0;
+}
+
+static uint32_t fwdiff_roll(const uint8_t *p)
+{
+	uint32_t h = 0;
+
+	for (int i = 0; i < FWDIFF_WINDOW; i++) {
+		h = h * FWDIFF_ROLL_MUL + p[i];
+	}
+
+	return h;
+}
+
+// gaps the chunks left, searched at every byte
+static int fwdiff_gaps(struct fwdiff_work_t *k, uint32_t *hits)
+{
+	uint32_t bits = 10, nchunk = k->nmatch, g;
+	int32_t *head, *next;
+	int ret = 0;
+
+	if (k->alen < FWDIFF_WINDOW) {
+		return 0;
+	}
+	while ((1u << bits) < k->alen && bits < 24) {
+		bits++;
+	}
+	head = malloc(sizeof(*head) << bits);
+	next = malloc(sizeof(*next) * k->alen);
+	if (head == NULL || next == NULL) {
+		free(head);
+		free(next);
+		return -1;
+	}
+	memset(head, 0xff, sizeof(*head) << bits);
+
+	// newest first in each chain, a run of one byte only goes in once
+	for (uint32_t p = 0, h = fwdiff_roll(k->a); ; p++) {
+		uint32_t slot = (h * 0x9e3779b1u) >> (32 - bits);
+
+		if (p == 0 || k->a[p - 1] != k->a[p] || k->a[p] != k->a[p + FWDIFF_WINDOW - 1]) {
+			next[p] = head[slot];
+			head[slot] = p;
+		}
+		if (p + FWDIFF_WINDOW >= k->alen) {
+			break;
+		}
+		h = (h - k->a[p] * roll_out) * FWDIFF_ROLL_MUL + k->a[p + FWDIFF_WINDOW];
+	}
+
+	// the chunk matches are in order of b, the gaps between them
+	for (g = 0; g <= nchunk && ret == 0; g++) {
+		uint32_t start = g ? k->match[g - 1].b + k->match[g - 1].len : 0;
+		uint32_t end = (g < nchunk) ? k->match[g].b : k->blen;
+		uint32_t p = start, h;
+
+		if (end - start < FWDIFF_MIN_MATCH) {
+			continue;
+		}
+		if (g) {
+			k->delta = (int32_t)(k->match[g - 1].b - k->match[g - 1].a);
+		}
+		h = fwdiff_roll(k->b + p);
+		while (p + FWDIFF_WINDOW <= end) {
+			uint32_t slot = (h * 0x9e3779b1u) >> (32 - bits);
+			uint32_t best = 0, best_a = 0, best_b = 0, tries = 0;
+
+			for (int32_t c = head[slot]; c >= 0 && tries < FWDIFF_CHAIN_MAX; c = next[c], tries++) {
+				uint32_t a = c, b = p, len;
+
+				if (memcmp(k->a + a, k->b + b, FWDIFF_WINDOW)) {
+					continue;
+				}
+				len = fwdiff_grow(k, &a, &b, FWDIFF_WINDOW, start, end);
+				if (len > best || (len == best && (int32_t)(b - a) == k->delta)) {
+					best = len;
+					best_a = a;
+					best_b = b;
+				}
+			}
+			if (best >= FWDIFF_MIN_MATCH) {
+				if (fwdiff_push(k, best_a, best_b, best) < 0) {
+					ret = -1;
+					break;
+				}
+				(*hits)++;
+				start = p = best_b + best;
+				if (p + FWDIFF_WINDOW <= end) {
+					h = fwdiff_roll(k->b + p);
+				}
+				continue;
+			}
+			if (p + FWDIFF_WINDOW < end) {
+				h = (h - k->b[p] * roll_out) * FWDIFF_ROLL_MUL + k->b[p + FWDIFF_WINDOW];
+			}
+			p++;
+		}
+	}
+
+	free(head);
+	free(next);
+
+	return ret;
+}
+
+static int fwdiff_add(struct fwdiff_t *d, uint32_t kind, uint32_t b, uint32_t len, uint32_t a, uint32_t alen)
+{
+	struct fwdiff_range_t *r = d->nrange ? &d->range[d->nrange - 1] : NULL;
+
+	if (len == 0 && alen == 0) {
+		return 0;
+	}
+
+	// matches that carry on at the same distance are one range
+	if (r && kind != FWDIFF_CHANGED && r->kind == kind && r->b + r->len == b && r->a + r->alen == a) {
+		r->len += len;
+		r->alen += alen;
+	} else {
+		if (d->nrange == d->nalloc) {
+			uint32_t n = d->nalloc ? d->nalloc * 2 : 256;
+
+			r = realloc(d->range, sizeof(*r) * n);
+			if (r == NULL) {
+				return -1;
+			}
+			d->range = r;
+			d->nalloc = n;
+		}
+		r = &d->range[d->nrange++];
+		r->kind = kind;
+		r->b = b;
+		r->len = len;
+		r->a = a;
+		r->alen = alen;
+	}
+
+	switch (kind) {
+	case FWDIFF_SAME: d->same += len; break;
+	case FWDIFF_MOVED: d->moved += len; break;
+	default: d->changed += len; break;
+	}
+
+	return 0;
+}
+
+static int fwdiff_match_cmp(const void *x, const void *y)
+{
+	const struct fwdiff_match_t *p = x, *q = y;
+
+	return (p->b > q->b) - (p->b < q->b);
+}
+
+static int fwdiff_region(struct fwdiff_t *d, const struct fwdiff_region_t *ra, const struct fwdiff_region_t *rb)
+{
+	struct fwdiff_work_t k;
+	uint32_t b = 0, a = 0;
+	int ret;
+
+	memset(&k, 0, sizeof(k));
+	k.a = ra->mem;
+	k.alen = ra->hi - ra->lo;
+	k.b = rb->mem;
+	k.blen = rb->hi - rb->lo;
+
+	ret = fwdiff_chunks(&k, &d->chunks, &d->chunk_hits);
+	if (ret == 0) {
+		ret = fwdiff_gaps(&k, &d->roll_hits);
+	}
+	qsort(k.match, k.nmatch, sizeof(k.match[0]), fwdiff_match_cmp);
+
+	for (uint32_t i = 0; i < k.nmatch && ret == 0; i++) {
+		const struct fwdiff_match_t *m = &k.match[i];
+
+		ret = fwdiff_add(d, FWDIFF_CHANGED, rb->lo + b, m->b - b, ra->lo + a, (m->a > a) ? m->a - a : 0);
+		if (ret == 0) {
+			ret = fwdiff_add(d, (ra->lo + m->a == rb->lo + m->b) ? FWDIFF_SAME : FWDIFF_MOVED,
+				rb->lo + m->b, m->len, ra->lo + m->a, m->len);
+		}
+		b = m->b + m->len;
+		a = m->a + m->len;
+	}
+	if (ret == 0) {
+		ret = fwdiff_add(d, FWDIFF_CHANGED, rb->lo + b, k.blen - b, ra->lo + a, (k.alen > a) ? k.alen - a : 0);
+	}
+	free(k.match);
+
+	return ret;
+}
+
+int fwdiff_run(struct fwdiff_t *d, const struct fwdiff_mem_t *a, const struct fwdiff_mem_t *b)
+{
+	fwdiff_free(d);
+
+	for (uint32_t i = 0; i < b->nregion; i++) {
+		const struct fwdiff_region_t *rb = &b->region[i], *ra = NULL;
+		int ret;
+
+		for (uint32_t j = 0; j < a->nregion; j++) {
+			if ((a->region[j].lo & FWIMAGE_REGION_MASK) == (rb->lo & FWIMAGE_REGION_MASK)) {
+				ra = &a->region[j];
+			}
+		}
+		if (ra) {
+			ret = fwdiff_region(d, ra, rb);
+		} else {
+			ret = fwdiff_add(d, FWDIFF_CHANGED, rb->lo, rb->hi - rb->lo, 0, 0);
+		}
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+static const struct fwdiff_region_t *fwdiff_in(const struct fwdiff_mem_t *m, uint32_t addr, uint32_t len)
+{
+	for (uint32_t i = 0; i < m->nregion; i++) {
+		if (addr >= m->region[i].lo && (uint64_t)addr + len <= m->region[i].hi) {
+			return &m->region[i];
+		}
+	}
+
+	return NULL;
+}
+
+// where the bytes before a site, after it or both are found exactly once,
+// the site is between them
+static int fwdiff_context(const struct fwdiff_mem_t *a, const struct fwdiff_mem_t *b, struct fwdiff_site_t *site)
+{
+	const struct fwdiff_region_t *ra = fwdiff_in(a, site->addr, site->len);
+	const uint8_t *pre, *post;
+	uint32_t npre, npost, found = 0, to = 0;
+
+	if (ra == NULL) {
+		return FWDIFF_NONE;
+	}
+	npre = site->addr - ra->lo;
+	npre = (npre > FWDIFF_CONTEXT) ? FWDIFF_CONTEXT : npre;
+	npost = ra->hi - site->addr - site->len;
+	npost = (npost > FWDIFF_CONTEXT) ? FWDIFF_CONTEXT : npost;
+	pre = ra->mem + (site->addr - ra->lo) - npre;
+	post = ra->mem + (site->addr - ra->lo) + site->len;
+	if (npre + npost < FWDIFF_CONTEXT) {
+		return FWDIFF_NONE;
+	}
+
+	for (uint32_t i = 0; i < b->nregion && found < 2; i++) {
+		const struct fwdiff_region_t *rb = &b->region[i];
+		uint32_t n = rb->hi - rb->lo;
+
+		for (uint32_t p = 0; p + npre + site->len + npost <= n && found < 2; p++) {
+			if (memcmp(rb->mem + p, pre, npre) == 0
+				&& memcmp(rb->mem + p + npre + site->len, post, npost) == 0) {
+				to = rb->lo + p + npre;
+				found++;
+			}
+		}
+	}
+	if (found != 1) {
+		return FWDIFF_NONE;
+	}
+	site->to = to;
+
+	return FWDIFF_CONTEXT_FOUND;
+}
+
+int fwdiff_site(const struct fwdiff_t *d, const struct fwdiff_mem_t *a, const struct fwdiff_mem_t *b,
+	struct fwdiff_site_t *site)
+{
+	const struct fwdiff_range_t *before = NULL, *after = NULL;
+	uint32_t end = site->addr + site->len;
+
+	site->to = 0;
+	site->how = FWDIFF_NONE;
+
+	// past the data of the region in both
+	if (fwdiff_in(a, site->addr, site->len) == NULL) {
+		uint32_t base = site->addr & FWIMAGE_REGION_MASK;
+		int clear = 1;
+
+		for (uint32_t i = 0; i < a->nregion; i++) {
+			clear &= (a->region[i].lo & FWIMAGE_REGION_MASK) != base || a->region[i].hi <= site->addr;
+		}
+		for (uint32_t i = 0; i < b->nregion; i++) {
+			clear &= (b->region[i].lo & FWIMAGE_REGION_MASK) != base || b->region[i].hi <= site->addr;
+		}
+		if (clear) {
+			site->to = site->addr;
+			site->how = FWDIFF_FREE;
+		}
+		return site->how;
+	}
+
+	for (uint32_t i = 0; i < d->nrange; i++) {
+		const struct fwdiff_range_t *r = &d->range[i];
+
+		if (r->kind == FWDIFF_CHANGED || (r->a & FWIMAGE_REGION_MASK) != (site->addr & FWIMAGE_REGION_MASK)) {
+			continue;
+		}
+		if (r->a <= site->addr && end <= r->a + r->len) {
+			site->to = r->b + (site->addr - r->a);
+			site->how = FWDIFF_EXACT;
+			return site->how;
+		}
+		if (r->a < site->addr && (before == NULL || r->a + r->len > before->a + before->len)) {
+			before = r;
+		}
+		if (r->a + r->len > end && (after == NULL || r->a < after->a)) {
+			after = r;
+		}
+	}
+
+	if (before && after && before->b - before->a == after->b - after->a
+		&& after->a - (before->a + before->len) <= FWDIFF_ANCHOR_GAP) {
+		site->to = site->addr + (before->b - before->a);
+		site->how = FWDIFF_ANCHORED;
+		return site->how;
+	}
+
+	site->how = fwdiff_context(a, b, site);
+
+	return site->how;
+}
+
+const char *fwdiff_kind(uint32_t kind)
+{
+	static const char *names[] = { "same", "moved", "changed" };
+
+	return (kind <= FWDIFF_CHANGED) ? names[kind] : "?";
+}
+
+const char *fwdiff_how(uint32_t how)
+{
+	static const char *names[] = { "not found", "exact", "anchored", "context", "free" };
+
+	return (how <= FWDIFF_FREE) ? names[how] : "?";
+}
@@ -0,0 +1,99 @@
+#ifndef FWDIFF_h_
+#define FWDIFF_h_
+
+#include <stdint.h>
+
+#include "fwimage.h"
+
+// block level diff of two firmware images as they sit in memory
+// each region of the new image is cut into content defined chunks, chunks
+// found in the same region of the old one anchor the diff, the gaps between
+// anchors are searched again at every byte with a rolling hash over the old
+// region, every match grows both ways as far as the bytes agree
+// what is left over is changed, matches are identical where the address
+// stayed and moved where it did not
+// patch sites of the old image are carried over through the matches, or
+// the context around them where no match covers them
+
+#define FWDIFF_WINDOW     16       // rolling hash window
+#define FWDIFF_MIN_MATCH  32       // shorter matches are taken as changed
+#define FWDIFF_CHUNK_MIN  64
+#define FWDIFF_CHUNK_MAX  2048     // about 256 on average
+#define FWDIFF_CONTEXT    32       // bytes on each side of a site to look for
+
+enum {
+	FWDIFF_SAME,
+	FWDIFF_MOVED,
+	FWDIFF_CHANGED,          // a and alen the old bytes it replaced, if any
+};
+
+// how a site was carried over
+enum {
+	FWDIFF_NONE,             // not found
+	FWDIFF_EXACT,            // inside a match
+	FWDIFF_ANCHORED,         // between matches that moved the same way
+	FWDIFF_CONTEXT_FOUND,    // the bytes around it, once in the new image
+	FWDIFF_FREE,             // past the data in both, stays where it is
+};
+
+struct fwdiff_region_t {
+	uint32_t lo;
+	uint32_t hi;
+	uint8_t *mem;            // hi - lo bytes, zero where no block writes
+};
+
+// an image loaded the way the download puts it into memory
+struct fwdiff_mem_t {
+	uint32_t nregion;
+	struct fwdiff_region_t region[FWIMAGE_REGIONS_MAX];
+};
+
+struct fwdiff_range_t {
+	uint32_t kind;
+	uint32_t b;              // in the new image
+	uint32_t len;
+	uint32_t a;              // in the old image
+	uint32_t alen;
+};
+
+struct fwdiff_t {
+	uint32_t nrange;
+	uint32_t nalloc;
+	struct fwdiff_range_t *range;    // in order of b
+	// bytes of the new image
+	uint64_t same;
+	uint64_t moved;
+	uint64_t changed;
+	// where the matches came from
+	uint32_t chunks;
+	uint32_t chunk_hits;
+	uint32_t roll_hits;
+};
+
+struct fwdiff_site_t {
+	const char *name;
+	uint32_t addr;           // in the old image
+	uint32_t len;
+	uint32_t to;             // in the new one
+	uint32_t how;
+};
+
+void fwdiff_mem_init(struct fwdiff_mem_t *m);
+void fwdiff_mem_free(struct fwdiff_mem_t *m);
+// data blocks in order, later ones over earlier, returns 0 or -1
+int fwdiff_mem_load(struct fwdiff_mem_t *m, const struct fwimage_t *w);
+// a region of len bytes at lo, copied, returns its index or -1
+int fwdiff_mem_add(struct fwdiff_mem_t *m, uint32_t lo, const void *data, uint32_t len);
+
+void fwdiff_init(struct fwdiff_t *d);
+void fwdiff_free(struct fwdiff_t *d);
+// a against b, regions are paired by their 4 MiB base, returns 0 or -1
+int fwdiff_run(struct fwdiff_t *d, const struct fwdiff_mem_t *a, const struct fwdiff_mem_t *b);
+// returns how
+int fwdiff_site(const struct fwdiff_t *d, const struct fwdiff_mem_t *a, const struct fwdiff_mem_t *b,
+	struct fwdiff_site_t *site);
+
+const char *fwdiff_kind(uint32_t kind);
+const char *fwdiff_how(uint32_t how);
+
+#endif
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "fwimage.h"
+#include "fwdiff.h"
+
+// what changed between two firmware download images, range by range as
+// they load into memory, and where the patch sites of the old one are in
+// the new one
+
+#define SITES_MAX 64
+
+// the sites of src/app/patch.c, the hook those of rxfwd.hook for robin_ax
+static struct fwdiff_site_t sites[SITES_MAX] = {
+	{ "hook", 0x0005fedc, 52 },
+	{ "call", 0x0000baa4, 4 },
+	{ "p3", 0x00000a3c, 4 },
+	{ "p4", 0x000001f0, 4 },
+};
+static int nsite = 4;
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-s] [-p name=addr[:len] ...] old.bin new.bin\n", name);
+	fprintf(stderr, "  -s  summary and sites only, no ranges\n");
+	fprintf(stderr, "  -p  patch site in the old image, hex, instead of the ones in patch.c\n");
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int load(const char *path, struct fwimage_t *w, struct fwdiff_mem_t *m)
+{
+	int ret = fwimage_open(w, path);
+
+	if (ret == 0) {
+		ret = fwimage_verify(w, FWIMAGE_THREADS_AUTO);
+	}
+	if (ret == -2) {
+		fprintf(stderr, "%s: cannot read\n", path);
+		return -1;
+	}
+	if (ret < 0) {
+		fprintf(stderr, "%s: damaged at block %u (%s)\n", path, w->failed,
+			(w->failed < w->nblock) ? fwimage_error(w->block[w->failed].error) : "?");
+		return -1;
+	}
+
+	return fwdiff_mem_load(m, w);
+}
+
+static int add_site(const char *arg, int reset)
+{
+	static char names[SITES_MAX][32];
+	const char *eq = strchr(arg, '=');
+	char *end;
+
+	if (reset) {
+		nsite = 0;
+	}
+	if (eq == NULL || eq - arg >= 32 || nsite == SITES_MAX) {
+		return -1;
+	}
+	memcpy(names[nsite], arg, eq - arg);
+	names[nsite][eq - arg] = 0;
+	sites[nsite].name = names[nsite];
+	sites[nsite].addr = strtoul(eq + 1, &end, 16);
+	sites[nsite].len = (*end == ':') ? strtoul(end + 1, &end, 0) : 4;
+	if (*end != 0 || sites[nsite].len == 0) {
+		return -1;
+	}
+	nsite++;
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	static struct fwimage_t wa, wb;
+	static struct fwdiff_mem_t a, b;
+	static struct fwdiff_t d;
+	int opt, summary = 0, own_sites = 0;
+	double t0, t1;
+
+	while ((opt = getopt(argc, argv, "sp:h")) != -1) {
+		switch (opt) {
+		case 's': summary = 1; break;
+		case 'p':
+			if (add_site(optarg, !own_sites) < 0) {
+				fprintf(stderr, "bad site %s\n", optarg);
+				return 1;
+			}
+			own_sites = 1;
+			break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	if (argc - optind != 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	fwimage_init(&wa);
+	fwimage_init(&wb);
+	fwdiff_mem_init(&a);
+	fwdiff_mem_init(&b);
+	fwdiff_init(&d);
+
+	t0 = now();
+	if (load(argv[optind], &wa, &a) < 0 || load(argv[optind + 1], &wb, &b) < 0) {
+		return 1;
+	}
+	if (fwdiff_run(&d, &a, &b) < 0) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	t1 = now();
+
+	if (!summary) {
+		for (uint32_t i = 0; i < d.nrange; i++) {
+			const struct fwdiff_range_t *r = &d.range[i];
+
+			switch (r->kind) {
+			case FWDIFF_SAME:
+				printf("same    %08x-%08x\n", r->b, r->b + r->len);
+				break;
+			case FWDIFF_MOVED:
+				printf("moved   %08x-%08x from %08x %+d\n", r->b, r->b + r->len, r->a, (int32_t)(r->b - r->a));
+				break;
+			default:
+				printf("changed %08x-%08x", r->b, r->b + r->len);
+				if (r->alen) {
+					printf(" was %08x-%08x", r->a, r->a + r->alen);
+				}
+				printf("\n");
+				break;
+			}
+		}
+	}
+
+	printf("%llu bytes same, %llu moved, %llu changed in %u ranges, %u of %u chunks and %u rolling matches, %.1f ms\n",
+		(unsigned long long)d.same, (unsigned long long)d.moved, (unsigned long long)d.changed,
+		d.nrange, d.chunk_hits, d.chunks, d.roll_hits, (t1 - t0) * 1e3);
+
+	for (int i = 0; i < nsite; i++) {
+		struct fwdiff_site_t *s = &sites[i];
+
+		if (fwdiff_site(&d, &a, &b, s) == FWDIFF_NONE) {
+			printf("site %-8s %08x  not found\n", s->name, s->addr);
+		} else {
+			printf("site %-8s %08x -> %08x %s\n", s->name, s->addr, s->to, fwdiff_how(s->how));
+		}
+	}
+
+	fwdiff_free(&d);
+	fwdiff_mem_free(&a);
+	fwdiff_mem_free(&b);
+	fwimage_close(&wa);
+	fwimage_close(&wb);
+
+	return 0;
+}
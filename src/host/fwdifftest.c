@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "fwimage.h"
+#include "fwdiff.h"
+#include "test.h"
+
+// diffs of memory with known edits, bytes inserted, deleted, swapped and
+// flipped, the ranges have to cover the new image exactly, say the same
+// bytes are the same, and put the edits where they were made, patch sites
+// have to land where the edit moved them
+// then the images in doc/marvell against each other, with -b how long each
+// pair and a large edited image take
+
+static const uint8_t *at(const struct fwdiff_mem_t *m, uint32_t addr, uint32_t len)
+{
+	for (uint32_t i = 0; i < m->nregion; i++) {
+		if (addr >= m->region[i].lo && (uint64_t)addr + len <= m->region[i].hi) {
+			return m->region[i].mem + (addr - m->region[i].lo);
+		}
+	}
+
+	return NULL;
+}
+
+// ranges in order over every region of b, matches with the bytes they claim
+static int consistent(const struct fwdiff_t *d, const struct fwdiff_mem_t *a, const struct fwdiff_mem_t *b)
+{
+	uint64_t sum[3] = { 0, 0, 0 };
+	uint32_t i = 0;
+	int fail = 0;
+
+	for (uint32_t r = 0; r < b->nregion; r++) {
+		uint32_t pos = b->region[r].lo;
+
+		// regions need not be in address order, a deletion can sit at the end
+		for (; i < d->nrange && d->range[i].b >= b->region[r].lo
+			&& (d->range[i].b < b->region[r].hi || (d->range[i].b == pos && d->range[i].len == 0)); i++) {
+			const struct fwdiff_range_t *x = &d->range[i];
+
+			fail |= x->b != pos;
+			pos += x->len;
+			sum[x->kind] += x->len;
+			if (x->kind == FWDIFF_CHANGED) {
+				continue;
+			}
+			fail |= x->len < FWDIFF_MIN_MATCH || x->len != x->alen;
+			fail |= (x->kind == FWDIFF_SAME) != (x->a == x->b);
+			fail |= at(a, x->a, x->len) == NULL || memcmp(at(a, x->a, x->len), at(b, x->b, x->len), x->len) != 0;
+		}
+		fail |= pos != b->region[r].hi;
+	}
+	fail |= i != d->nrange;
+	fail |= sum[0] != d->same || sum[1] != d->moved || sum[2] != d->changed;
+
+	return fail;
+}
+
+static int diff(struct fwdiff_t *d, const struct fwdiff_mem_t *a, const struct fwdiff_mem_t *b)
+{
+	return fwdiff_run(d, a, b) == 0 && consistent(d, a, b) == 0;
+}
+
+static int site(const struct fwdiff_t *d, const struct fwdiff_mem_t *a, const struct fwdiff_mem_t *b,
+	uint32_t addr, uint32_t len, uint32_t how, uint32_t to)
+{
+	struct fwdiff_site_t s = { "site", addr, len, 0, 0 };
+
+	fwdiff_site(d, a, b, &s);
+	if (s.how != how || (how != FWDIFF_NONE && s.to != to)) {
+		printf("  site %08x: %s %08x, want %s %08x\n", addr, fwdiff_how(s.how), s.to, fwdiff_how(how), to);
+		return 0;
+	}
+
+	return 1;
+}
+
+#define SIZE  (512 << 10)
+#define BASE  0x00000000
+#define BASE2 0xc0000000
+
+// random bytes have no repeats for matches to be confused by, the regions
+// of a: one at 0 and one at 0xc0000000
+static void make(struct fwdiff_mem_t *a, uint8_t *m0, uint8_t *m2)
+{
+	for (uint32_t i = 0; i < SIZE; i++) {
+		m0[i] = rng();
+		m2[i] = rng();
+	}
+	fwdiff_mem_init(a);
+	fwdiff_mem_add(a, BASE, m0, SIZE);
+	fwdiff_mem_add(a, BASE2, m2, SIZE / 2);
+}
+
+static int check_edits(void)
+{
+	static uint8_t m0[SIZE], m2[SIZE], e[2 * SIZE];
+	struct fwdiff_mem_t a, b;
+	struct fwdiff_t d;
+	int fail = 0;
+
+	fwdiff_init(&d);
+
+	for (int round = 0; round < 20; round++) {
+		uint32_t x = 4096 + rng() % (SIZE / 2), k = 1 + rng() % 3000, n;
+
+		make(&a, m0, m2);
+
+		// the same
+		fwdiff_mem_init(&b);
+		fwdiff_mem_add(&b, BASE, m0, SIZE);
+		fwdiff_mem_add(&b, BASE2, m2, SIZE / 2);
+		fail |= check("same", diff(&d, &a, &b) && d.nrange == 2 && d.same == SIZE + SIZE / 2);
+		fail |= check("same site", site(&d, &a, &b, 0x1000, 4, FWDIFF_EXACT, 0x1000));
+		fail |= check("same free", site(&d, &a, &b, SIZE + 0x100, 52, FWDIFF_FREE, SIZE + 0x100));
+		fwdiff_mem_free(&b);
+
+		// k random bytes in at x, whatever comes after is k further on
+		memcpy(e, m0, x);
+		for (uint32_t i = 0; i < k; i++) {
+			e[x + i] = rng();
+		}
+		memcpy(e + x + k, m0 + x, SIZE - x);
+		fwdiff_mem_add(&b, BASE, e, SIZE + k);
+		fwdiff_mem_add(&b, BASE2, m2, SIZE / 2);
+		fail |= check("insert", diff(&d, &a, &b) && d.changed <= k && d.changed + 4 >= k
+			&& d.moved + 4 >= SIZE - x && d.same + 4 >= x + SIZE / 2);
+		fail |= check("insert before", site(&d, &a, &b, x - 100, 4, FWDIFF_EXACT, x - 100));
+		fail |= check("insert after", site(&d, &a, &b, x + 100, 4, FWDIFF_EXACT, x + 100 + k));
+		fwdiff_mem_free(&b);
+
+		// k bytes out at x, a range with nothing of b standing for them
+		memcpy(e, m0, x);
+		memcpy(e + x, m0 + x + k, SIZE - x - k);
+		fwdiff_mem_add(&b, BASE, e, SIZE - k);
+		fwdiff_mem_add(&b, BASE2, m2, SIZE / 2);
+		fail |= check("delete", diff(&d, &a, &b) && d.changed == 0 && d.same + d.moved == SIZE - k + SIZE / 2);
+		fail |= check("delete after", site(&d, &a, &b, x + k + 8, 4, FWDIFF_EXACT, x + 8));
+		fail |= check("deleted", site(&d, &a, &b, x + k / 2, 1, FWDIFF_NONE, 0));
+		fwdiff_mem_free(&b);
+
+		// two pieces of k bytes and more swapped
+		n = k + 64;
+		memcpy(e, m0, SIZE);
+		memcpy(e + x, m0 + x + n, n);
+		memcpy(e + x + n, m0 + x, n);
+		fwdiff_mem_add(&b, BASE, e, SIZE);
+		fwdiff_mem_add(&b, BASE2, m2, SIZE / 2);
+		fail |= check("swap", diff(&d, &a, &b) && d.moved >= 2 * n - 8 && d.changed <= 8);
+		fail |= check("swap site", site(&d, &a, &b, x + 10, 4, FWDIFF_EXACT, x + n + 10));
+		fwdiff_mem_free(&b);
+
+		// bytes flipped far apart, one of them where a site is, and the first
+		// word of the region, before which there is nothing to anchor on
+		memcpy(e, m0, SIZE);
+		for (uint32_t i = 1; i <= 50; i++) {
+			e[i * (SIZE / 52) + rng() % 1000] ^= 1 + rng() % 255;
+		}
+		e[x + 1] ^= 0x55;
+		e[0] ^= 0xaa;
+		e[3] ^= 0xaa;
+		fwdiff_mem_add(&b, BASE, e, SIZE);
+		fwdiff_mem_add(&b, BASE2, m2, SIZE / 2);
+		fail |= check("flip", diff(&d, &a, &b) && d.moved == 0 && d.changed <= 52 * FWDIFF_MIN_MATCH);
+		fail |= check("flip site", site(&d, &a, &b, x, 4, FWDIFF_ANCHORED, x));
+		fail |= check("flip start", site(&d, &a, &b, 0, 4, FWDIFF_CONTEXT_FOUND, 0));
+		fwdiff_mem_free(&b);
+
+		// a region only in b is all changed
+		fwdiff_mem_add(&b, BASE, m0, SIZE);
+		fwdiff_mem_add(&b, 0x04000000, m2, 4096);
+		fail |= check("new region", diff(&d, &a, &b) && d.changed == 4096 && d.same == SIZE);
+		fwdiff_mem_free(&b);
+
+		fwdiff_mem_free(&a);
+	}
+	fwdiff_free(&d);
+
+	printf("%-36s %s\n", "edits", fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+static int load(const char *dir, const char *name, struct fwdiff_mem_t *m)
+{
+	struct fwimage_t w;
+	char file[640];
+	int ret;
+
+	snprintf(file, sizeof(file), "%s/%s", dir, name);
+	fwimage_init(&w);
+	ret = fwimage_open(&w, file);
+	if (ret == 0) {
+		ret = fwimage_verify(&w, FWIMAGE_THREADS_AUTO);
+	}
+	fwdiff_mem_init(m);
+	if (ret == 0) {
+		ret = fwdiff_mem_load(m, &w);
+	}
+	fwimage_close(&w);
+
+	return ret;
+}
+
+static const char *images[] = { "sd8787_uapsta.bin", "sd8797_uapsta.bin", "sd8897_uapsta.bin", "pcie8897_uapsta.bin" };
+#define IMAGES (sizeof(images) / sizeof(images[0]))
+
+static int check_marvell(const char *dir, int bench)
+{
+	static struct fwdiff_mem_t m[IMAGES];
+	struct fwdiff_t d;
+	int fail = 0, have[IMAGES];
+
+	for (uint32_t i = 0; i < IMAGES; i++) {
+		have[i] = load(dir, images[i], &m[i]) == 0;
+	}
+
+	fwdiff_init(&d);
+	for (uint32_t i = 0; i < IMAGES; i++) {
+		for (uint32_t j = 0; j < IMAGES; j++) {
+			char what[64];
+			double best = 1e9;
+
+			if (!have[i] || !have[j]) {
+				continue;
+			}
+			for (int run = 0; run < (bench ? 10 : 1); run++) {
+				double t0 = now();
+
+				fwdiff_run(&d, &m[i], &m[j]);
+				if (now() - t0 < best) {
+					best = now() - t0;
+				}
+			}
+			snprintf(what, sizeof(what), "%.8s -> %.8s", images[i], images[j]);
+			if (bench) {
+				printf("%-24s %8.1f ms %8llu same %8llu moved %8llu changed %5u ranges\n", what, best * 1e3,
+					(unsigned long long)d.same, (unsigned long long)d.moved,
+					(unsigned long long)d.changed, d.nrange);
+				continue;
+			}
+			fail |= check(what, consistent(&d, &m[i], &m[j]) == 0 && (i != j || d.changed == 0));
+		}
+	}
+	fwdiff_free(&d);
+	for (uint32_t i = 0; i < IMAGES; i++) {
+		fwdiff_mem_free(&m[i]);
+	}
+
+	if (!bench) {
+		printf("%-36s %s\n", "marvell images", fail ? "FAIL" : "ok");
+	}
+
+	return fail;
+}
+
+// an image the size of the largest bundled one times scale, edited all over
+static int bench_edits(uint32_t scale)
+{
+	uint32_t size = scale << 20, n = 0;
+	uint8_t *a = malloc(size), *b = malloc(size + (size >> 4));
+	struct fwdiff_mem_t ma, mb;
+	struct fwdiff_t d;
+	double best = 1e9;
+
+	for (uint32_t i = 0; i < size; i++) {
+		a[i] = rng();
+	}
+	// pieces copied over with a few bytes inserted, dropped or flipped between
+	for (uint32_t i = 0; i < size; ) {
+		uint32_t len = 256 + rng() % 8192, op = rng() % 4;
+
+		len = (len > size - i) ? size - i : len;
+		memcpy(b + n, a + i, len);
+		n += len;
+		i += len;
+		if (op == 0 && n + 16 < size + (size >> 4)) {
+			for (int k = 0; k < 16; k++) {
+				b[n++] = rng();
+			}
+		} else if (op == 1) {
+			i += 16;
+		} else if (op == 2 && n) {
+			b[n - 1] ^= 0xff;
+		}
+	}
+
+	fwdiff_mem_init(&ma);
+	fwdiff_mem_init(&mb);
+	fwdiff_mem_add(&ma, 0, a, size);
+	fwdiff_mem_add(&mb, 0, b, (n > size + (size >> 4)) ? size + (size >> 4) : n);
+	fwdiff_init(&d);
+	for (int run = 0; run < 5; run++) {
+		double t0 = now();
+
+		fwdiff_run(&d, &ma, &mb);
+		if (now() - t0 < best) {
+			best = now() - t0;
+		}
+	}
+	printf("%-24s %8.1f ms %8llu same %8llu moved %8llu changed %5u ranges, %u MiB\n", "edited", best * 1e3,
+		(unsigned long long)d.same, (unsigned long long)d.moved, (unsigned long long)d.changed, d.nrange, scale);
+
+	fwdiff_free(&d);
+	fwdiff_mem_free(&ma);
+	fwdiff_mem_free(&mb);
+	free(a);
+	free(b);
+
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-b] [-m MiB] [-s seed] [-d dir]\n", name);
+	fprintf(stderr, "  -b  time every pair of images instead of the checks\n");
+	fprintf(stderr, "  -m  size of the edited image for -b (4)\n");
+	fprintf(stderr, "  -d  where the images are (doc/marvell)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	char dir[512];
+	const char *src = __FILE__, *slash = strrchr(src, '/');
+	uint32_t mib = 4;
+	int opt, fail = 0, do_bench = 0;
+
+	snprintf(dir, sizeof(dir), "%.*s../../doc/marvell", slash ? (int)(slash - src + 1) : 0, src);
+
+	while ((opt = getopt(argc, argv, "bm:s:d:h")) != -1) {
+		switch (opt) {
+		case 'b': do_bench = 1; break;
+		case 'm': mib = strtoul(optarg, NULL, 0); break;
+		case 's': rng_state = strtoul(optarg, NULL, 0) | 1; break;
+		case 'd': snprintf(dir, sizeof(dir), "%s", optarg); break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	if (do_bench) {
+		check_marvell(dir, 1);
+		return bench_edits((mib < 1) ? 1 : (mib > 1024) ? 1024 : mib);
+	}
+
+	fail |= check_edits();
+	fail |= check_marvell(dir, 0);
+
+	printf("%s\n", fail ? "FAIL" : "ok");
+
+	return fail ? 2 : 0;
+}
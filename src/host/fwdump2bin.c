@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "fwdump.h"
+
+// .fwd firmware dump to the raw dump-<base>-<size>.bin bin2elf takes,
+// a dump cut short gives the part before the first damaged chunk
+
+static int file_pread(void *ctx, void *buf, uint32_t len, uint32_t off)
+{
+	return pread(*(int *)ctx, buf, len, off);
+}
+
+static const struct fwdump_ops_t file_ops = {
+	.pread = file_pread,
+};
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-o out.bin] in.fwd\n", name);
+	fprintf(stderr, "  default output is dump-<base>-<size>.bin, size being what the file holds\n");
+}
+
+int main(int argc, char *argv[])
+{
+	static struct fwdump_t d;
+	struct fwdump_chk_t c;
+	const char *out = NULL;
+	char name[64];
+	uint8_t *seg;
+	int fd, opt, n;
+	FILE *f;
+
+	while ((opt = getopt(argc, argv, "o:h")) != -1) {
+		switch (opt) {
+		case 'o': out = optarg; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	if (argc - optind != 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	fd = open(argv[optind], O_RDONLY);
+	d.ops = &file_ops;
+	d.ctx = &fd;
+	if (fd < 0 || fwdump_open(&d) < 0) {
+		fprintf(stderr, "%s: not a firmware dump\n", argv[optind]);
+		return 1;
+	}
+
+	seg = malloc(d.hdr.size ? d.hdr.size : 1);
+	if (seg == NULL) {
+		return 1;
+	}
+
+	while ((n = fwdump_next(&d, &c)) > 0) {
+		memcpy(seg + (c.addr - d.hdr.base), d.raw, n);
+	}
+	close(fd);
+
+	uint32_t size = d.addr - d.hdr.base;
+
+	if (out == NULL) {
+		snprintf(name, sizeof(name), "dump-%08x-%08x.bin", d.hdr.base, size);
+		out = name;
+	}
+
+	if ((f = fopen(out, "wb")) == NULL || fwrite(seg, 1, size, f) != size || fclose(f) != 0) {
+		fprintf(stderr, "%s: write failed\n", out);
+		return 1;
+	}
+
+	printf("%s: %08x, %u of %u bytes%s\n", out, d.hdr.base, size, d.hdr.size,
+		n == 0 ? "" : ", dump incomplete or damaged");
+
+	free(seg);
+
+	return n == 0 ? 0 : 2;
+}
@@ -0,0 +1,446 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <vitasdkkern.h>
+
+#include "kwifimon_export.h"
+#include "wlan_kernel.h"
+#include "sigs.h"
+#include "fwdump.h"
+
+#include "shim.h"
+#include "test.h"
+
+// dumps simulated firmware memory through the bulk read ioctl of the hook
+// with reads failing at random, writes cut off part way as if the vita lost
+// power, damaged files and unreadable ranges, every dump is read back and
+// compared with the memory, resumes must keep what was good
+
+int module_start(SceSize argc, const void *args);
+int module_stop(SceSize argc, const void *args);
+
+struct sim_seg_t {
+	uint32_t base;
+	uint32_t size;
+	uint32_t *mem;
+};
+
+static struct sim_seg_t sim_segs[] = {
+	{ 0x00000000, 0x00060000 },
+	{ 0x04000000, 0x00010000 },
+	{ 0xc0000000, 0x00040000 },
+	{ 0x03f00000, 0x00050000 },
+	{ 0x80000000, 0x00010000 },
+};
+
+#define SIM_SEGS (sizeof(sim_segs) / sizeof(sim_segs[0]))
+
+static uint32_t sim_fail_pct;        // per word, in 1/10000
+static uint32_t sim_dead_lo, sim_dead_hi;
+static uint64_t sim_reads;
+
+static int sim_mem_read(struct wlan_dev_t *dev, uint32_t addr, uint32_t *value)
+{
+	uint32_t i;
+
+	if (addr >= sim_dead_lo && addr < sim_dead_hi) {
+		return -1;
+	}
+
+	if (sim_fail_pct && rng() % 10000 < sim_fail_pct) {
+		return -1;
+	}
+
+	for (i = 0; i < SIM_SEGS; i++) {
+		if (addr - sim_segs[i].base < sim_segs[i].size) {
+			*value = sim_segs[i].mem[(addr - sim_segs[i].base) / 4];
+			sim_reads++;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+static int sim_mem_write(struct wlan_dev_t *dev, uint32_t addr, uint32_t value)
+{
+	return -1;
+}
+
+// code like runs, zero fill, tables and noise
+static void sim_fill(struct sim_seg_t *s)
+{
+	uint32_t i, w = 0;
+
+	s->mem = malloc(s->size);
+	for (i = 0; i < s->size / 4; i++) {
+		if (i % 1024 == 0) {
+			w = rng() % 4;
+		}
+		switch (w) {
+		case 0: s->mem[i] = 0; break;
+		case 1: s->mem[i] = 0x4b000000 | ((i * 7) & 0xffff); break;
+		case 2: s->mem[i] = (i & 15) ? s->mem[i - 1] + 4 : rng(); break;
+		default: s->mem[i] = rng(); break;
+		}
+	}
+}
+
+// the app side: bulk ioctl into the hook, file with injected write failures
+
+struct test_ctx_t {
+	int fd;
+	struct netdev_t *netdev;
+	ioctl_hook_t ioctl;
+	int32_t writes_left;     // < 0 no limit
+	uint32_t ioctls;
+};
+
+static int test_read(void *ctx, uint32_t addr, uint32_t *buf, uint32_t words)
+{
+	static uint8_t request[sizeof(struct wifimon_mem_bulk_t) + 4 * WIFIMON_MEM_BULK_MAX];
+	struct test_ctx_t *t = ctx;
+	struct wifimon_mem_bulk_t b;
+
+	if (words > WIFIMON_MEM_BULK_MAX) {
+		words = WIFIMON_MEM_BULK_MAX;
+	}
+
+	b.addr = addr;
+	b.words = words;
+	memcpy(request, &b, sizeof(b));
+	t->ioctls++;
+
+	int ret = t->ioctl(t->netdev, WLAN_IOCTL_MEM_BULK, request, sizeof(b) + 4 * words);
+	if (ret > 0) {
+		memcpy(buf, &request[sizeof(b)], 4 * ret);
+	}
+
+	return ret;
+}
+
+static int test_pread(void *ctx, void *buf, uint32_t len, uint32_t off)
+{
+	struct test_ctx_t *t = ctx;
+
+	return pread(t->fd, buf, len, off);
+}
+
+// power loss: the last write makes it part way
+static int test_pwrite(void *ctx, const void *buf, uint32_t len, uint32_t off)
+{
+	struct test_ctx_t *t = ctx;
+
+	if (t->writes_left == 0) {
+		if (pwrite(t->fd, buf, rng() % len, off) < 0) {
+			return -1;
+		}
+		return -1;
+	}
+	if (t->writes_left > 0) {
+		t->writes_left--;
+	}
+
+	return pwrite(t->fd, buf, len, off);
+}
+
+static const struct fwdump_ops_t test_ops = {
+	.read = test_read,
+	.pread = test_pread,
+	.pwrite = test_pwrite,
+};
+
+static struct fwdump_t dump;
+static struct netdev_t netdev;
+static uint8_t dev[sizeof(struct wlan_dev_t)];
+
+static int test_open(struct test_ctx_t *t, const char *file, int trunc)
+{
+	memset(t, 0, sizeof(*t));
+	t->fd = open(file, O_RDWR | O_CREAT | (trunc ? O_TRUNC : 0), 0644);
+	t->netdev = &netdev;
+	t->ioctl = (ioctl_hook_t)shim_hook(sigs[SIG_IOCTL].fixed);
+	t->writes_left = -1;
+	dump.ops = &test_ops;
+	dump.ctx = t;
+
+	return t->fd;
+}
+
+// whole file read back against the memory, returns bytes matching
+static int verify(const char *file, const struct sim_seg_t *s, int complete)
+{
+	struct test_ctx_t t;
+	struct fwdump_chk_t c;
+	int n = 0, ret = 0;
+
+	if (test_open(&t, file, 0) < 0 || fwdump_open(&dump) < 0) {
+		if (complete) {
+			fprintf(stderr, "%s: no header\n", file);
+		}
+		close(t.fd);
+		return -1;
+	}
+
+	if (dump.hdr.base != s->base || dump.hdr.size != s->size) {
+		fprintf(stderr, "%s: holds %08x/%x\n", file, dump.hdr.base, dump.hdr.size);
+		ret = -1;
+	}
+
+	while (ret >= 0 && (n = fwdump_next(&dump, &c)) > 0) {
+		if (memcmp(dump.raw, &s->mem[(c.addr - s->base) / 4], n) != 0) {
+			fprintf(stderr, "%s: chunk at %08x differs\n", file, c.addr);
+			ret = -1;
+		}
+		ret += (ret >= 0) ? n : 0;
+	}
+
+	if (ret >= 0 && complete && (n != 0 || (uint32_t)ret != s->size)) {
+		fprintf(stderr, "%s: %u of %u bytes, %s\n", file, ret, s->size, n ? "no end record" : "end record");
+		ret = -1;
+	}
+
+	close(t.fd);
+
+	return ret;
+}
+
+static int check_clean(const char *dir)
+{
+	struct test_ctx_t t;
+	char file[256];
+	uint32_t i, out = 0, raw = 0;
+	int fail = 0;
+
+	for (i = 0; i < SIM_SEGS; i++) {
+		struct sim_seg_t *s = &sim_segs[i];
+
+		snprintf(file, sizeof(file), "%s/dump-%08x-%08x.fwd", dir, s->base, s->size);
+		test_open(&t, file, 1);
+		if (fwdump_segment(&dump, s->base, s->size, i + 1) != 0 || dump.resumed != 0 ||
+		    dump.chunks != (s->size + FWDUMP_CHUNK - 1) / FWDUMP_CHUNK || t.ioctls != dump.chunks) {
+			fprintf(stderr, "clean %08x: chunks %u ioctls %u resumed %u\n", s->base, dump.chunks, t.ioctls, dump.resumed);
+			fail = 1;
+		}
+		out += dump.out;
+		raw += s->size;
+		close(t.fd);
+
+		if (verify(file, s, 1) < 0) {
+			fail = 1;
+		}
+
+		// complete already, memory has changed since and is read again
+		s->mem[s->size / 8] ^= 0x5a5a5a5a;
+		test_open(&t, file, 0);
+		if (fwdump_segment(&dump, s->base, s->size, 99) != 0 || dump.resumed != 0 || dump.hdr.id != 99 ||
+		    t.ioctls != dump.chunks || dump.chunks != (s->size + FWDUMP_CHUNK - 1) / FWDUMP_CHUNK) {
+			fprintf(stderr, "complete %08x: resumed %u, read %u times\n", s->base, dump.resumed, t.ioctls);
+			fail = 1;
+		}
+		close(t.fd);
+		if (verify(file, s, 1) < 0) {
+			fail = 1;
+		}
+	}
+
+	printf("clean:   %u segments, %u -> %u bytes\n", (unsigned)SIM_SEGS, raw, out);
+
+	return fail;
+}
+
+// reads fail per word, the hook hands back partial chunks
+static int check_flaky(const char *dir)
+{
+	struct sim_seg_t *s = &sim_segs[0];
+	struct test_ctx_t t;
+	char file[256];
+	int fail = 0;
+
+	snprintf(file, sizeof(file), "%s/flaky.fwd", dir);
+	test_open(&t, file, 1);
+	sim_fail_pct = 5;
+	if (fwdump_segment(&dump, s->base, s->size, 7) != 0 || dump.retries == 0) {
+		fprintf(stderr, "flaky: failed, %u retries\n", dump.retries);
+		fail = 1;
+	}
+	sim_fail_pct = 0;
+	close(t.fd);
+	printf("flaky:   %u ioctls for %u chunks, %u retries\n", t.ioctls, dump.chunks, dump.retries);
+
+	return fail | (verify(file, s, 1) < 0);
+}
+
+// power lost after a random number of writes, each run picks up the last one
+static int check_resume(const char *dir, uint32_t rounds)
+{
+	struct test_ctx_t t;
+	char file[256];
+	uint32_t r, runs = 0, reread = 0;
+	int fail = 0;
+
+	snprintf(file, sizeof(file), "%s/resume.fwd", dir);
+
+	for (r = 0; r < rounds; r++) {
+		struct sim_seg_t *s = &sim_segs[rng() % SIM_SEGS];
+		uint64_t reads = 0;
+		int ret = -1, n;
+
+		test_open(&t, file, 1);
+		close(t.fd);
+
+		for (n = 0; ret != 0 && n < 1000; n++) {
+			uint64_t before = sim_reads;
+			int good = verify(file, s, 0);
+
+			test_open(&t, file, 0);
+			t.writes_left = rng() % 40;
+			ret = fwdump_segment(&dump, s->base, s->size, r + 1);
+			close(t.fd);
+			runs++;
+			reads += sim_reads - before;
+
+			// a resume keeps exactly what was good, the cut record aside
+			if ((ret != 0 && ret != -1) || dump.resumed != (uint32_t)(good < 0 ? 0 : good)) {
+				fprintf(stderr, "resume %08x run %d: ret %d resumed %u of %d good\n", s->base, n, ret, dump.resumed, good);
+				fail = 1;
+				break;
+			}
+		}
+
+		if (ret != 0 || verify(file, s, 1) < 0) {
+			fprintf(stderr, "resume %08x: not complete after %d runs\n", s->base, n);
+			fail = 1;
+		}
+
+		// torn writes cost at most the chunk they cut each run
+		if (reads > s->size / 4 + (uint64_t)n * FWDUMP_CHUNK / 4) {
+			fprintf(stderr, "resume %08x: %llu words read for %u\n", s->base, (unsigned long long)reads, s->size / 4);
+			fail = 1;
+		}
+		reread += reads * 4 - s->size;
+	}
+
+	printf("resume:  %u segments in %u runs, %u bytes read again\n", rounds, runs, reread);
+
+	return fail;
+}
+
+static int check_damage(const char *dir)
+{
+	struct sim_seg_t *s = &sim_segs[2];
+	struct test_ctx_t t;
+	char file[256];
+	uint32_t off, i;
+	int fail = 0;
+
+	snprintf(file, sizeof(file), "%s/damage.fwd", dir);
+
+	// a flipped byte anywhere loses what follows it and nothing before
+	for (i = 0; i < 20; i++) {
+		uint8_t b;
+		int kept;
+
+		test_open(&t, file, 1);
+		fwdump_segment(&dump, s->base, s->size, 3);
+		off = rng() % dump.off;
+		pread(t.fd, &b, 1, off);
+		b ^= 1 << (rng() % 8);
+		pwrite(t.fd, &b, 1, off);
+		close(t.fd);
+
+		kept = verify(file, s, 0);
+		test_open(&t, file, 0);
+		if (fwdump_segment(&dump, s->base, s->size, 4) != 0 || (kept >= 0 && dump.resumed != (uint32_t)kept)) {
+			fprintf(stderr, "damage at %u: kept %d resumed %u\n", off, kept, dump.resumed);
+			fail = 1;
+		}
+		close(t.fd);
+		fail |= (verify(file, s, 1) < 0);
+	}
+
+	// some other segment in the file starts over
+	test_open(&t, file, 0);
+	if (fwdump_segment(&dump, sim_segs[1].base, sim_segs[1].size, 5) != 0 || dump.resumed != 0) {
+		fprintf(stderr, "other segment: resumed %u\n", dump.resumed);
+		fail = 1;
+	}
+	close(t.fd);
+	fail |= (verify(file, &sim_segs[1], 1) < 0);
+
+	// unreadable range, what comes before it is kept for later
+	sim_dead_lo = s->base + 0x21000;
+	sim_dead_hi = s->base + 0x22000;
+	test_open(&t, file, 1);
+	if (fwdump_segment(&dump, s->base, s->size, 6) != -2 || dump.addr != sim_dead_lo) {
+		fprintf(stderr, "dead range: stopped at %08x\n", dump.addr);
+		fail = 1;
+	}
+	close(t.fd);
+	sim_dead_lo = sim_dead_hi = 0;
+	test_open(&t, file, 0);
+	if (fwdump_segment(&dump, s->base, s->size, 6) != 0 || dump.resumed != 0x21000) {
+		fprintf(stderr, "dead range: resumed %u\n", dump.resumed);
+		fail = 1;
+	}
+	close(t.fd);
+	fail |= (verify(file, s, 1) < 0);
+
+	printf("damage:  %s\n", fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-n rounds] [-s seed] [-o dir]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *dir = "/tmp/fwdumptest";
+	uint32_t rounds = 50, i;
+	int opt, fail = 0;
+
+	while ((opt = getopt(argc, argv, "n:s:o:h")) != -1) {
+		switch (opt) {
+		case 'n': rounds = strtoul(optarg, NULL, 0); break;
+		case 's': rng_state = strtoul(optarg, NULL, 0) | 1; break;
+		case 'o': dir = optarg; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	mkdir(dir, 0755);
+	shim_init(dir);
+	shim_wlan_init();
+	shim_set_offset(sigs[SIG_MEM_READ].fixed, sim_mem_read);
+	shim_set_offset(sigs[SIG_MEM_WRITE].fixed, sim_mem_write);
+
+	module_start(0, NULL);
+	if (kwifimon_mod_state() & 0x80000000) {
+		fprintf(stderr, "module_start failed, state %x\n", kwifimon_mod_state());
+		return 1;
+	}
+	netdev.priv = (struct wlan_dev_t *)dev;
+
+	for (i = 0; i < SIM_SEGS; i++) {
+		sim_fill(&sim_segs[i]);
+	}
+
+	fail |= check_clean(dir);
+	fail |= check_flaky(dir);
+	fail |= check_resume(dir, rounds);
+	fail |= check_damage(dir);
+
+	module_stop(0, NULL);
+
+	printf("%s\n", fail ? "FAIL" : "ok");
+
+	return fail ? 2 : 0;
+}
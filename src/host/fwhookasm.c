@@ -0,0 +1,437 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "fwhookasm.h"
+
+#define TOKENS_MAX 64
+
+static int fail(struct fwhookasm_t *a, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(a->error, sizeof(a->error), fmt, ap);
+	va_end(ap);
+
+	return -1;
+}
+
+static int is_name(const char *s)
+{
+	if (!isalpha((unsigned char)*s) && *s != '_') {
+		return 0;
+	}
+	while (*s) {
+		if (!isalnum((unsigned char)*s) && *s != '_') {
+			return 0;
+		}
+		s++;
+	}
+
+	return 1;
+}
+
+static int is_byte(const char *s)
+{
+	return strlen(s) == 2 && isxdigit((unsigned char)s[0]) && isxdigit((unsigned char)s[1]);
+}
+
+static int number(const char *s, uint32_t *v)
+{
+	char *end;
+
+	if (!isdigit((unsigned char)*s)) {
+		return -1;
+	}
+	*v = strtoul(s, &end, 0);
+
+	return (*end == 0) ? 0 : -1;
+}
+
+// index of the symbol, added if new, -1 when there is no room
+static int sym_of(struct fwhookasm_t *a, const char *name)
+{
+	for (uint32_t i = 0; i < a->h.nsym; i++) {
+		if (strcmp(a->sym[i], name) == 0) {
+			return i;
+		}
+	}
+	if (a->h.nsym == FWHOOK_SYMS_MAX) {
+		return -1;
+	}
+	// name can be one of a's own, all of them fit
+	memmove(a->sym[a->h.nsym], name, strlen(name) + 1);
+
+	return a->h.nsym++;
+}
+
+static int label_of(const struct fwhookasm_t *a, const char *name)
+{
+	for (uint32_t i = 0; i < a->nlabel; i++) {
+		if (strcmp(a->label[i], name) == 0) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+// name[+-offset], the name kept for later, labels can come after their use
+static int ref(struct fwhookasm_t *a, const char *s, char *name, int32_t *addend)
+{
+	const char *op = strpbrk(s, "+-");
+	uint32_t v = 0;
+
+	if ((op ? op - s : (long)strlen(s)) >= FWHOOKASM_NAME) {
+		return fail(a, "name too long: %s", s);
+	}
+	snprintf(name, FWHOOKASM_NAME, "%.*s", op ? (int)(op - s) : (int)strlen(s), s);
+	if (!is_name(name) || (op && number(op + 1, &v) < 0)) {
+		return fail(a, "bad reference %s", s);
+	}
+	*addend = (op && *op == '-') ? -(int32_t)v : (int32_t)v;
+
+	return 0;
+}
+
+static int put(struct fwhookasm_t *a, const uint8_t *p, uint32_t n)
+{
+	if (a->h.len + n > FWHOOK_PAYLOAD_MAX) {
+		return fail(a, "payload over %d bytes", FWHOOK_PAYLOAD_MAX);
+	}
+	if (p) {
+		memcpy(a->payload + a->h.len, p, n);
+	} else {
+		memset(a->payload + a->h.len, 0, n);
+	}
+	a->h.len += n;
+
+	return 0;
+}
+
+static int reloc(struct fwhookasm_t *a, uint32_t type, const char *s)
+{
+	struct fwhook_rel_t *r = &a->rel[a->h.nrel];
+	uint32_t v;
+
+	// plain numbers are plain words, a branch has to be relocated
+	if (type == FWHOOK_ABS32 && number(s, &v) == 0) {
+		uint8_t w[4] = { v, v >> 8, v >> 16, v >> 24 };
+
+		return put(a, w, 4);
+	}
+	if (a->h.nrel == FWHOOK_RELS_MAX) {
+		return fail(a, "over %d relocations", FWHOOK_RELS_MAX);
+	}
+	if (type != FWHOOK_ABS32 && (a->h.len & 1)) {
+		return fail(a, "branch at odd offset %u", a->h.len);
+	}
+	if (ref(a, s, a->ref[a->h.nrel], &r->addend) < 0) {
+		return -1;
+	}
+	r->off = a->h.len;
+	r->type = type;
+	a->h.nrel++;
+
+	return put(a, NULL, 4);
+}
+
+static int line(struct fwhookasm_t *a, char **tok, int n, int32_t *cur)
+{
+	uint32_t v;
+	int s;
+
+	if (strcmp(tok[0], "version") == 0) {
+		if (n != 2 || number(tok[1], &v) < 0) {
+			return fail(a, "version <n>");
+		}
+		if (v != FWHOOK_VERSION) {
+			return fail(a, "version %u, this is %d", v, FWHOOK_VERSION);
+		}
+		a->h.version = v;
+	} else if (strcmp(tok[0], "hook") == 0) {
+		if (n != 2 || !is_name(tok[1]) || strlen(tok[1]) >= FWHOOKASM_NAME) {
+			return fail(a, "hook <name>");
+		}
+		snprintf(a->name, sizeof(a->name), "%s", tok[1]);
+	} else if (strcmp(tok[0], "site") == 0 || strcmp(tok[0], "at") == 0) {
+		int site = (tok[0][0] == 's'), k = site ? FWHOOK_SYM_SITE : FWHOOK_SYM_AT;
+
+		if (n != (site ? 2 + FWHOOK_TRAMP_LEN : 2) || !is_name(tok[1]) || strlen(tok[1]) >= FWHOOKASM_NAME) {
+			return fail(a, site ? "site <sym> <%d bytes>" : "at <sym>", FWHOOK_TRAMP_LEN);
+		}
+		if (a->sym[k][0]) {
+			return fail(a, "%s given twice", tok[0]);
+		}
+		for (uint32_t i = 0; i < a->h.nsym; i++) {
+			if (strcmp(a->sym[i], tok[1]) == 0) {
+				return fail(a, "%s named before %s", tok[1], tok[0]);
+			}
+		}
+		snprintf(a->sym[k], FWHOOKASM_NAME, "%s", tok[1]);
+		for (int i = 0; site && i < FWHOOK_TRAMP_LEN; i++) {
+			if (!is_byte(tok[2 + i])) {
+				return fail(a, "bad byte %s", tok[2 + i]);
+			}
+			a->orig[i] = strtoul(tok[2 + i], NULL, 16);
+		}
+	} else if (strcmp(tok[0], "entry") == 0) {
+		if (n != 2 || !is_name(tok[1]) || strlen(tok[1]) >= FWHOOKASM_NAME) {
+			return fail(a, "entry <label>");
+		}
+		snprintf(a->entry, sizeof(a->entry), "%s", tok[1]);
+	} else if (strcmp(tok[0], "build") == 0) {
+		if (n != 2 || strlen(tok[1]) >= FWHOOKASM_NAME) {
+			return fail(a, "build <name>");
+		}
+		for (uint32_t i = 0; i < a->h.nbuild; i++) {
+			if (strcmp(a->bname[i], tok[1]) == 0) {
+				return fail(a, "build %s given twice", tok[1]);
+			}
+		}
+		if (a->h.nbuild == FWHOOKASM_BUILDS) {
+			return fail(a, "over %d builds", FWHOOKASM_BUILDS);
+		}
+		*cur = a->h.nbuild++;
+		snprintf(a->bname[*cur], FWHOOKASM_NAME, "%s", tok[1]);
+		a->build[*cur].name = a->bname[*cur];
+	} else if (n >= 2 && strcmp(tok[1], "=") == 0) {
+		if (*cur < 0) {
+			return fail(a, "address outside a build");
+		}
+		if (n != 3 || !is_name(tok[0]) || strlen(tok[0]) >= FWHOOKASM_NAME || number(tok[2], &v) < 0) {
+			return fail(a, "<sym> = <addr>");
+		}
+		if (label_of(a, tok[0]) >= 0) {
+			return fail(a, "%s is a label and a symbol", tok[0]);
+		}
+		if ((s = sym_of(a, tok[0])) < 0) {
+			return fail(a, "no room for %s", tok[0]);
+		}
+		if (a->given[*cur] & (1 << s)) {
+			return fail(a, "%s given twice", tok[0]);
+		}
+		a->build[*cur].addr[s] = v;
+		a->given[*cur] |= 1 << s;
+	} else if (n == 1 && tok[0][strlen(tok[0]) - 1] == ':') {
+		tok[0][strlen(tok[0]) - 1] = 0;
+		if (!is_name(tok[0]) || strlen(tok[0]) >= FWHOOKASM_NAME) {
+			return fail(a, "bad label %s", tok[0]);
+		}
+		if (label_of(a, tok[0]) >= 0) {
+			return fail(a, "label %s twice", tok[0]);
+		}
+		if (a->nlabel == FWHOOKASM_LABELS) {
+			return fail(a, "over %d labels", FWHOOKASM_LABELS);
+		}
+		snprintf(a->label[a->nlabel], FWHOOKASM_NAME, "%s", tok[0]);
+		a->label_at[a->nlabel++] = a->h.len;
+	} else if (strcmp(tok[0], "bl") == 0 || strcmp(tok[0], "blx") == 0 || strcmp(tok[0], "word") == 0) {
+		if (n != 2) {
+			return fail(a, "%s <ref>", tok[0]);
+		}
+		return reloc(a, (tok[0][0] == 'w') ? FWHOOK_ABS32 : tok[0][2] ? FWHOOK_BLX : FWHOOK_BL, tok[1]);
+	} else if (strcmp(tok[0], "align") == 0) {
+		if (n != 2 || number(tok[1], &v) < 0 || v == 0 || v > 16 || (v & (v - 1))) {
+			return fail(a, "align <1 2 4 8 16>");
+		}
+		return put(a, NULL, -a->h.len & (v - 1));
+	} else if (strcmp(tok[0], "space") == 0) {
+		if (n != 2 || number(tok[1], &v) < 0 || v > FWHOOK_PAYLOAD_MAX) {
+			return fail(a, "space <n>");
+		}
+		return put(a, NULL, v);
+	} else {
+		uint8_t b[TOKENS_MAX];
+
+		for (int i = 0; i < n; i++) {
+			if (!is_byte(tok[i])) {
+				return fail(a, "what is %s", tok[i]);
+			}
+			b[i] = strtoul(tok[i], NULL, 16);
+		}
+		return put(a, b, n);
+	}
+
+	return 0;
+}
+
+// references to labels and symbols, then what the descriptor still lacks
+static int finish(struct fwhookasm_t *a)
+{
+	int k;
+
+	if (a->h.version != FWHOOK_VERSION) {
+		return fail(a, "no version");
+	}
+	if (a->name[0] == 0 || a->sym[FWHOOK_SYM_SITE][0] == 0 || a->sym[FWHOOK_SYM_AT][0] == 0) {
+		return fail(a, "needs hook, site and at");
+	}
+	if (a->h.len == 0 || (a->h.len & 3)) {
+		return fail(a, "payload of %u bytes, not a word multiple", a->h.len);
+	}
+	for (uint32_t i = 0; i < a->h.nrel; i++) {
+		if ((k = label_of(a, a->ref[i])) >= 0) {
+			a->rel[i].sym = FWHOOK_SELF;
+			a->rel[i].addend += a->label_at[k];
+		} else if ((k = sym_of(a, a->ref[i])) >= 0) {
+			a->rel[i].sym = k;
+		} else {
+			return fail(a, "no room for %s", a->ref[i]);
+		}
+	}
+	if (a->entry[0]) {
+		if ((k = label_of(a, a->entry)) < 0) {
+			return fail(a, "no label %s", a->entry);
+		}
+		a->h.entry = a->label_at[k];
+	}
+	if (a->h.nbuild == 0) {
+		return fail(a, "no build");
+	}
+	for (uint32_t s = 0; s < a->h.nsym; s++) {
+		if (label_of(a, a->sym[s]) >= 0) {
+			return fail(a, "%s is a label and a symbol", a->sym[s]);
+		}
+	}
+	for (uint32_t i = 0; i < a->h.nbuild; i++) {
+		for (uint32_t s = 0; s < a->h.nsym; s++) {
+			if (!(a->given[i] & (1 << s))) {
+				return fail(a, "build %s has no %s", a->bname[i], a->sym[s]);
+			}
+		}
+	}
+
+	return 0;
+}
+
+int fwhookasm_load(struct fwhookasm_t *a, const char *path)
+{
+	char buf[512], *tok[TOKENS_MAX], *save;
+	int32_t cur = -1;
+	FILE *fp = fopen(path, "r");
+	int ret = 0;
+
+	memset(a, 0, sizeof(*a));
+	if (fp == NULL) {
+		return -2;
+	}
+	a->h.nsym = 2;
+	while (ret == 0 && fgets(buf, sizeof(buf), fp)) {
+		char *hash = strchr(buf, '#');
+		int n = 0;
+
+		a->line++;
+		if (hash) {
+			*hash = 0;
+		}
+		for (char *t = strtok_r(buf, " \t\r\n", &save); t; t = strtok_r(NULL, " \t\r\n", &save)) {
+			if (n == TOKENS_MAX) {
+				ret = fail(a, "over %d tokens", TOKENS_MAX);
+				break;
+			}
+			tok[n++] = t;
+		}
+		if (ret == 0 && n) {
+			ret = line(a, tok, n, &cur);
+		}
+	}
+	fclose(fp);
+	if (ret == 0) {
+		a->line = 0;
+		ret = finish(a);
+	}
+	if (ret < 0) {
+		return -1;
+	}
+
+	for (uint32_t i = 0; i < a->h.nsym; i++) {
+		a->symp[i] = a->sym[i];
+	}
+	a->h.name = a->name;
+	a->h.sym = a->symp;
+	a->h.orig = a->orig;
+	a->h.payload = a->payload;
+	a->h.rel = a->rel;
+	a->h.build = a->build;
+
+	return 0;
+}
+
+static const char *type_name(uint32_t type)
+{
+	switch (type) {
+	case FWHOOK_BL: return "FWHOOK_BL";
+	case FWHOOK_BLX: return "FWHOOK_BLX";
+	default: return "FWHOOK_ABS32";
+	}
+}
+
+void fwhookasm_write(const struct fwhookasm_t *a, const char *source, FILE *fp)
+{
+	const char *n = a->name;
+
+	fprintf(fp, "// %s assembled by fwhook, do not edit\n\n", source);
+
+	fprintf(fp, "static const char *const %s_sym[] = {\n", n);
+	for (uint32_t i = 0; i < a->h.nsym; i++) {
+		fprintf(fp, "\t\"%s\",\n", a->sym[i]);
+	}
+	fprintf(fp, "};\n\n");
+
+	fprintf(fp, "// what the bl replaces\n");
+	fprintf(fp, "static const uint8_t %s_orig[] = {\n\t", n);
+	for (uint32_t i = 0; i < FWHOOK_TRAMP_LEN; i++) {
+		fprintf(fp, "0x%02x,%s", a->orig[i], (i + 1 < FWHOOK_TRAMP_LEN) ? " " : "\n");
+	}
+	fprintf(fp, "};\n\n");
+
+	fprintf(fp, "static const uint8_t %s_payload[] = {\n", n);
+	for (uint32_t i = 0; i < a->h.len; i++) {
+		fprintf(fp, "%s0x%02x,%s", (i % 12) ? "" : "\t", a->payload[i],
+			(i % 12 == 11 || i + 1 == a->h.len) ? "\n" : " ");
+	}
+	fprintf(fp, "};\n\n");
+
+	fprintf(fp, "static const struct fwhook_rel_t %s_rel[] = {\n", n);
+	for (uint32_t i = 0; i < a->h.nrel; i++) {
+		const struct fwhook_rel_t *r = &a->rel[i];
+
+		if (r->sym == FWHOOK_SELF) {
+			fprintf(fp, "\t{ 0x%04x, %s, FWHOOK_SELF, %d },", r->off, type_name(r->type), r->addend);
+		} else {
+			fprintf(fp, "\t{ 0x%04x, %s, %u, %d },", r->off, type_name(r->type), r->sym, r->addend);
+		}
+		fprintf(fp, "   // %s\n", a->ref[i]);
+	}
+	fprintf(fp, "};\n\n");
+
+	fprintf(fp, "static const struct fwhook_build_t %s_build[] = {\n", n);
+	for (uint32_t i = 0; i < a->h.nbuild; i++) {
+		fprintf(fp, "\t{ \"%s\", {", a->bname[i]);
+		for (uint32_t s = 0; s < a->h.nsym; s++) {
+			fprintf(fp, "%s0x%08x", s ? ", " : " ", a->build[i].addr[s]);
+		}
+		fprintf(fp, " } },\n");
+	}
+	fprintf(fp, "};\n\n");
+
+	fprintf(fp, "static const struct fwhook_t %s_hook = {\n", n);
+	fprintf(fp, "\t.version = FWHOOK_VERSION,\n");
+	fprintf(fp, "\t.name = \"%s\",\n", n);
+	fprintf(fp, "\t.sym = %s_sym,\n", n);
+	fprintf(fp, "\t.nsym = %u,\n", a->h.nsym);
+	fprintf(fp, "\t.orig = %s_orig,\n", n);
+	fprintf(fp, "\t.payload = %s_payload,\n", n);
+	fprintf(fp, "\t.len = %u,\n", a->h.len);
+	fprintf(fp, "\t.entry = %u,\n", a->h.entry);
+	fprintf(fp, "\t.rel = %s_rel,\n", n);
+	fprintf(fp, "\t.nrel = %u,\n", a->h.nrel);
+	fprintf(fp, "\t.build = %s_build,\n", n);
+	fprintf(fp, "\t.nbuild = %u,\n", a->h.nbuild);
+	fprintf(fp, "};\n");
+}
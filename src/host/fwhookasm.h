@@ -0,0 +1,60 @@
+#ifndef FWHOOKASM_h_
+#define FWHOOKASM_h_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "fwhook.h"
+
+// .hook sources to fwhook descriptors, a line at a time, # to the end of a
+// line is a comment
+//   version 1            format of the source, FWHOOK_VERSION
+//   hook <name>
+//   site <sym> <bytes>   the bl goes at sym, over the 4 bytes given
+//   at <sym>             where the payload goes
+//   entry <label>        where in the payload the bl goes, its start if none
+//   build <name>         a firmware build, its addresses follow as
+//   <sym> = <addr>
+// and the payload
+//   <label>:
+//   b1 68 31 44          bytes as they go
+//   bl <ref>             thumb bl, blx to arm
+//   word <ref>           address word
+//   align <n>
+//   space <n>            zero bytes
+// a ref is a symbol or label with an optional +/- offset, or a number
+// symbols come about where they are first named, every build needs an
+// address for each
+
+#define FWHOOKASM_NAME     32
+#define FWHOOKASM_BUILDS   16
+#define FWHOOKASM_LABELS   32
+
+struct fwhookasm_t {
+	struct fwhook_t h;
+	char name[FWHOOKASM_NAME];
+	char sym[FWHOOK_SYMS_MAX][FWHOOKASM_NAME];
+	const char *symp[FWHOOK_SYMS_MAX];
+	uint8_t orig[FWHOOK_TRAMP_LEN];
+	uint8_t payload[FWHOOK_PAYLOAD_MAX];
+	struct fwhook_rel_t rel[FWHOOK_RELS_MAX];
+	char ref[FWHOOK_RELS_MAX][FWHOOKASM_NAME];   // what each relocation names
+	struct fwhook_build_t build[FWHOOKASM_BUILDS];
+	char bname[FWHOOKASM_BUILDS][FWHOOKASM_NAME];
+	uint32_t given[FWHOOKASM_BUILDS];           // bit per symbol with an address
+	uint32_t nlabel;
+	char label[FWHOOKASM_LABELS][FWHOOKASM_NAME];
+	uint32_t label_at[FWHOOKASM_LABELS];
+	char entry[FWHOOKASM_NAME];
+	// of the first error
+	uint32_t line;
+	char error[96];
+};
+
+// returns 0, -1 with line and error set or -2 cannot read
+int fwhookasm_load(struct fwhookasm_t *a, const char *path);
+
+// the descriptor as C for the app, source names the .hook in the comment
+void fwhookasm_write(const struct fwhookasm_t *a, const char *source, FILE *fp);
+
+#endif
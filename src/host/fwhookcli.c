@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fwhook.h"
+#include "fwhookasm.h"
+#include "fwimage.h"
+#include "fwdiff.h"
+
+// a .hook source assembled, linked for each of its builds and checked: the
+// branches decoded back, and with -e the site of a firmware download image
+// holding what the bl replaces, or the bl itself where the image has the
+// hook already
+// -c writes the descriptor the app links at runtime
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-b build] [-e fw.bin] [-c out.h] [-l] in.hook\n", name);
+	fprintf(stderr, "  -b  only this build\n");
+	fprintf(stderr, "  -e  download image the build is for, its site checked\n");
+	fprintf(stderr, "  -c  descriptor as C for the app\n");
+	fprintf(stderr, "  -l  the linked bytes and every branch\n");
+}
+
+static void hex(const uint8_t *p, uint32_t n)
+{
+	for (uint32_t i = 0; i < n; i++) {
+		printf("%s%02x", i ? " " : "", p[i]);
+	}
+}
+
+static void listing(const struct fwhookasm_t *a, const struct fwhook_link_t *l)
+{
+	const struct fwhook_t *h = &a->h;
+	uint32_t to;
+
+	for (uint32_t i = 0; i < h->len; i += 16) {
+		printf("  %08x  ", l->at + i);
+		hex(l->payload + i, (h->len - i < 16) ? h->len - i : 16);
+		printf("\n");
+	}
+	for (uint32_t i = 0; i < h->nrel; i++) {
+		const struct fwhook_rel_t *r = &h->rel[i];
+		const uint8_t *p = l->payload + r->off;
+
+		printf("  %08x  ", l->at + r->off);
+		hex(p, 4);
+		if (r->type == FWHOOK_ABS32) {
+			printf("  .word 0x%x", p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+		} else {
+			fwhook_bl_decode(p, l->at + r->off, &to);
+			printf("  %s 0x%x", (r->type == FWHOOK_BLX) ? "blx" : "bl", to);
+		}
+		printf("  %s", (r->sym == FWHOOK_SELF) ? h->name : h->sym[r->sym]);
+		printf(r->addend ? "%+d\n" : "\n", (int)r->addend);
+	}
+	fwhook_bl_decode(l->tramp, l->site, &to);
+	printf("  %08x  ", l->site);
+	hex(l->tramp, FWHOOK_TRAMP_LEN);
+	printf("  bl 0x%x  replaces ", to);
+	hex(h->orig, FWHOOK_TRAMP_LEN);
+	printf("\n");
+}
+
+// bytes at addr of the image as it loads, NULL where nothing loads
+static const uint8_t *image_at(const struct fwdiff_mem_t *m, uint32_t addr, uint32_t len)
+{
+	for (uint32_t i = 0; i < m->nregion; i++) {
+		const struct fwdiff_region_t *r = &m->region[i];
+
+		if (addr >= r->lo && addr + len <= r->hi) {
+			return r->mem + (addr - r->lo);
+		}
+	}
+
+	return NULL;
+}
+
+static int load(const char *path, struct fwimage_t *w, struct fwdiff_mem_t *m)
+{
+	int ret = fwimage_open(w, path);
+
+	if (ret == 0) {
+		ret = fwimage_verify(w, FWIMAGE_THREADS_AUTO);
+	}
+	if (ret == -2) {
+		fprintf(stderr, "%s: cannot read\n", path);
+		return -1;
+	}
+	if (ret < 0) {
+		fprintf(stderr, "%s: damaged at block %u (%s)\n", path, w->failed,
+			(w->failed < w->nblock) ? fwimage_error(w->block[w->failed].error) : "?");
+		return -1;
+	}
+
+	return fwdiff_mem_load(m, w);
+}
+
+int main(int argc, char *argv[])
+{
+	static struct fwhookasm_t a;
+	static struct fwimage_t w;
+	static struct fwdiff_mem_t m;
+	struct fwhook_link_t l;
+	const char *build = NULL, *image = NULL, *out = NULL;
+	int opt, list = 0, fail = 0, ret;
+
+	while ((opt = getopt(argc, argv, "b:e:c:lh")) != -1) {
+		switch (opt) {
+		case 'b': build = optarg; break;
+		case 'e': image = optarg; break;
+		case 'c': out = optarg; break;
+		case 'l': list = 1; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+	if (argc - optind != 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	ret = fwhookasm_load(&a, argv[optind]);
+	if (ret == -2) {
+		fprintf(stderr, "%s: cannot read\n", argv[optind]);
+		return 1;
+	}
+	if (ret < 0) {
+		fprintf(stderr, "%s:%u: %s\n", argv[optind], a.line, a.error);
+		return 1;
+	}
+	if (build && fwhook_build(&a.h, build) < 0) {
+		fprintf(stderr, "%s: no build %s\n", argv[optind], build);
+		return 1;
+	}
+	if (image) {
+		fwimage_init(&w);
+		fwdiff_mem_init(&m);
+		if (load(image, &w, &m) < 0) {
+			return 1;
+		}
+	}
+
+	for (uint32_t i = 0; i < a.h.nbuild; i++) {
+		const char *name = a.h.build[i].name;
+
+		if (build && strcmp(build, name)) {
+			continue;
+		}
+		ret = fwhook_link(&a.h, i, &l);
+		if (ret == 0) {
+			ret = fwhook_verify(&a.h, i, &l);
+		}
+		if (ret == -1) {
+			printf("%s: site or payload not word aligned\n", name);
+			fail = 1;
+			continue;
+		}
+		if (ret < 0) {
+			printf("%s: %s %s\n", name, (l.failed < a.h.nrel) ? a.ref[l.failed] : (l.failed == a.h.nrel) ? "bl at" : "payload",
+				(ret == -2) ? "out of reach" : "does not decode back");
+			fail = 1;
+			continue;
+		}
+		printf("%s: %u bytes at %08x, bl at %08x, %u relocations, verified\n", name, a.h.len, l.at, l.site, a.h.nrel);
+		if (list) {
+			listing(&a, &l);
+		}
+
+		if (image) {
+			const uint8_t *p = image_at(&m, l.site, FWHOOK_TRAMP_LEN);
+
+			if (p && memcmp(p, a.h.orig, FWHOOK_TRAMP_LEN) == 0) {
+				printf("%s: %s holds what the bl replaces\n", name, image);
+			} else if (p && memcmp(p, l.tramp, FWHOOK_TRAMP_LEN) == 0) {
+				printf("%s: %s has the bl already\n", name, image);
+			} else {
+				printf("%s: %s is another build, ", name, image);
+				if (p) {
+					hex(p, FWHOOK_TRAMP_LEN);
+					printf(" at %08x\n", l.site);
+				} else {
+					printf("nothing loads at %08x\n", l.site);
+				}
+				fail = 1;
+			}
+		}
+	}
+
+	if (out) {
+		FILE *fp = fopen(out, "w");
+		const char *slash = strrchr(argv[optind], '/');
+
+		if (fp == NULL) {
+			fprintf(stderr, "%s: cannot create\n", out);
+			return 1;
+		}
+		fwhookasm_write(&a, slash ? slash + 1 : argv[optind], fp);
+		if (fclose(fp) != 0) {
+			fprintf(stderr, "%s: write failed\n", out);
+			return 1;
+		}
+	}
+
+	if (image) {
+		fwdiff_mem_free(&m);
+		fwimage_close(&w);
+	}
+
+	return fail;
+}
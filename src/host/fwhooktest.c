@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "fwhook.h"
+#include "fwhookasm.h"
+#include "kcap.h"
+
+#include "../app/rxfwd_hook.h"
+#include "test.h"
+
+// thumb bl and blx encoded and decoded back over their whole reach, the
+// rx forwarding hook of the app assembled out of rxfwd.hook and linked to
+// the bytes patch.c had by hand before, then linked for a build where
+// everything moved, and the verifier catching every byte that is off
+// rxfwd_hook.h has to be what fwhook makes of rxfwd.hook now
+
+// as the hook was in patch.c, p1 at 0x5fedc and p2 at 0xbaa4
+static const uint8_t p1_patch[] = {
+	0xb1, 0x68, 0x31, 0x44, 0x70, 0x69, 0x00, 0x28, 0x00, 0xD1, 0x05, 0x48, 0xA0, 0xF7, 0x75, 0xFD, 0x00, 0x25, 0x02, 0xAA,
+	0x03, 0xA9, 0x04, 0xA8, 0xAB, 0xF7, 0xB6, 0xFD, 0xAB, 0xF7, 0xDA, 0xFD, 0x00, 0xFF, 0x05, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+static const uint8_t p2_patch[] = { 0x54, 0xf0, 0x1a, 0xfa };
+
+static int check_bl(uint32_t rounds)
+{
+	static const uint8_t movs[4] = { 0x00, 0x25, 0x02, 0xaa };
+	uint8_t b[4];
+	uint32_t to = 0, site, target;
+	int fail = 0, ok = 1, blx;
+
+	printf("bl encoding\n");
+	fail |= check("p2 is bl 0x5fedc", fwhook_bl_decode(p2_patch, 0xbaa4, &to) == FWHOOK_BL && to == 0x5fedc);
+	fail |= check("p2 encoded", fwhook_bl_encode(0xbaa4, 0x5fedc, 0, b) == 0 && memcmp(b, p2_patch, 4) == 0);
+	fail |= check("movs is no bl", fwhook_bl_decode(movs, 0xbaa4, &to) < 0);
+	fail |= check("blx with h set is no blx", fwhook_bl_decode((const uint8_t []){ 0x00, 0xf0, 0x01, 0xe8 }, 0, &to) < 0);
+
+	// the ends of the reach
+	fail |= check("furthest back", fwhook_bl_encode(0x400000, 0x4, 0, b) == 0 &&
+		fwhook_bl_decode(b, 0x400000, &to) == FWHOOK_BL && to == 0x4);
+	fail |= check("furthest ahead", fwhook_bl_encode(0x1000, 0x401002, 0, b) == 0 &&
+		fwhook_bl_decode(b, 0x1000, &to) == FWHOOK_BL && to == 0x401002);
+	fail |= check("out of reach back", fwhook_bl_encode(0x400000, 0x2, 0, b) < 0);
+	fail |= check("out of reach ahead", fwhook_bl_encode(0x1000, 0x401004, 0, b) < 0);
+	fail |= check("odd target", fwhook_bl_encode(0x1000, 0x2001, 0, b) < 0);
+	fail |= check("odd site", fwhook_bl_encode(0x1001, 0x2000, 0, b) < 0);
+	fail |= check("blx to unaligned arm", fwhook_bl_encode(0x1000, 0x2002, 1, b) < 0);
+	// blx counts from the word aligned pc
+	fail |= check("blx from halfword site", fwhook_bl_encode(0x1002, 0x2000, 1, b) == 0 &&
+		fwhook_bl_decode(b, 0x1002, &to) == FWHOOK_BLX && to == 0x2000);
+
+	for (uint32_t i = 0; i < rounds && ok; i++) {
+		int32_t off = (int32_t)((rng() % (2 * FWHOOK_BL_REACH)) & ~3u) - FWHOOK_BL_REACH;
+
+		blx = rng() & 1;
+		site = (rng() & 0x0ffffffe) + FWHOOK_BL_REACH;
+		target = (site + 4 + off) & (blx ? ~3u : ~1u);
+		ok = fwhook_bl_encode(site, target, blx, b) == 0 &&
+			fwhook_bl_decode(b, site, &to) == (blx ? FWHOOK_BLX : FWHOOK_BL) && to == target;
+	}
+	fail |= check("random round trip", ok);
+
+	return fail;
+}
+
+static int check_rxfwd(const char *hook, const char *header, const char *dir)
+{
+	static struct fwhookasm_t a;
+	struct fwhook_link_t l, g;
+	struct fwpatch_t p[3];
+	char path[512], want[8192], got[8192];
+	size_t nw = 0, ng = 0;
+	FILE *fp;
+	int fail = 0, b;
+
+	printf("rx forwarding hook\n");
+	if (check("rxfwd.hook assembles", fwhookasm_load(&a, hook) == 0)) {
+		printf("  %s:%u: %s\n", hook, a.line, a.error);
+		return 1;
+	}
+	b = fwhook_build(&a.h, "robin_ax");
+	fail |= check("robin_ax build", b == 0 && fwhook_build(&a.h, "nope") < 0);
+	fail |= check("links", fwhook_link(&a.h, b, &l) == 0 && fwhook_verify(&a.h, b, &l) == 0);
+	fail |= check("payload is p1", a.h.len == sizeof(p1_patch) && memcmp(l.payload, p1_patch, sizeof(p1_patch)) == 0);
+	fail |= check("bl is p2", l.site == 0xbaa4 && memcmp(l.tramp, p2_patch, 4) == 0);
+
+	// behind a patch of the set, as the bl depends on the payload
+	fwhook_patches(&a.h, &l, &p[1], 1);
+	fail |= check("payload patch", p[1].addr == 0x5fedc && p[1].len == 52 && p[1].data == l.payload &&
+		(p[1].flags & FWPATCH_ANY_ORIG) && p[1].deps == 0);
+	fail |= check("bl patch", p[2].addr == 0xbaa4 && p[2].len == 4 && p[2].orig_sum == 0x012100d2 &&
+		p[2].flags == 0 && p[2].deps == (1 << 1));
+
+	// the descriptor the app has, as compiled in and as text
+	fail |= check("app descriptor links the same", fwhook_link(&rxfwd_hook, 0, &g) == 0 &&
+		memcmp(g.payload, l.payload, a.h.len) == 0 && memcmp(g.tramp, l.tramp, 4) == 0);
+	snprintf(path, sizeof(path), "%s/rxfwd_hook.h", dir);
+	fp = fopen(path, "w");
+	if (fp) {
+		fwhookasm_write(&a, "rxfwd.hook", fp);
+		fclose(fp);
+	}
+	if ((fp = fopen(path, "r"))) {
+		ng = fread(got, 1, sizeof(got), fp);
+		fclose(fp);
+	}
+	if ((fp = fopen(header, "r"))) {
+		nw = fread(want, 1, sizeof(want), fp);
+		fclose(fp);
+	}
+	fail |= check("rxfwd_hook.h up to date", nw && nw == ng && memcmp(want, got, nw) == 0);
+
+	return fail;
+}
+
+// the app's hook for a build where the site, the free place and what it
+// calls all moved
+static int check_moved(void)
+{
+	struct fwhook_build_t build[3] = {
+		{ "moved", { 0x0000c0a0, 0x0007f000, 0x00000a10, 0x0000c060 } },
+		{ "far", { 0x0000c0a0, 0x0047f000, 0x00000a10, 0x0000c060 } },
+		{ "odd", { 0x0000c0a2, 0x0007f000, 0x00000a10, 0x0000c060 } },
+	};
+	struct fwhook_t h = rxfwd_hook;
+	struct fwhook_link_t l;
+	uint32_t to;
+	int fail = 0;
+
+	printf("moved build\n");
+	h.build = build;
+	h.nbuild = 3;
+	fail |= check("links", fwhook_link(&h, 0, &l) == 0 && fwhook_verify(&h, 0, &l) == 0);
+	fail |= check("bl to the payload", fwhook_bl_decode(l.tramp, 0xc0a0, &to) == FWHOOK_BL && to == 0x7f000);
+	fail |= check("rx_forward", fwhook_bl_decode(l.payload + 0x0c, 0x7f00c, &to) == FWHOOK_BL && to == 0xa10);
+	fail |= check("rx_call", fwhook_bl_decode(l.payload + 0x18, 0x7f018, &to) == FWHOOK_BL && to == 0xc060);
+	fail |= check("back past the call", fwhook_bl_decode(l.payload + 0x1c, 0x7f01c, &to) == FWHOOK_BL && to == 0xc0ac);
+	fail |= check("buffer word", l.payload[0x20] == 0x24 && l.payload[0x21] == 0xf0 && l.payload[0x22] == 0x07 && l.payload[0x23] == 0);
+	fail |= check("rest as it was", memcmp(l.payload, p1_patch, 0x0c) == 0 && memcmp(l.payload + 0x10, p1_patch + 0x10, 8) == 0 &&
+		memcmp(l.payload + 0x24, p1_patch + 0x24, 16) == 0);
+
+	// every kind of wrong byte is caught and says where
+	l.payload[0x19] ^= 0x01;
+	fail |= check("bl off", fwhook_verify(&h, 0, &l) == -3 && l.failed == 1);
+	l.payload[0x19] ^= 0x01;
+	l.payload[0x22] ^= 0x01;
+	fail |= check("word off", fwhook_verify(&h, 0, &l) == -3 && l.failed == 3);
+	l.payload[0x22] ^= 0x01;
+	l.payload[0x03] ^= 0x80;
+	fail |= check("code off", fwhook_verify(&h, 0, &l) == -3 && l.failed == h.nrel + 1);
+	l.payload[0x03] ^= 0x80;
+	l.tramp[0] ^= 0x04;
+	fail |= check("site bl off", fwhook_verify(&h, 0, &l) == -3 && l.failed == h.nrel);
+	l.tramp[0] ^= 0x04;
+	fail |= check("all back", fwhook_verify(&h, 0, &l) == 0);
+	fail |= check("not for another build", fwhook_verify(&h, 1, &l) == -3);
+
+	// the payload 4 MiB away cannot be called, from it rx_forward is first
+	fail |= check("far", fwhook_link(&h, 1, &l) == -2 && l.failed == 0);
+	fail |= check("site not word aligned", fwhook_link(&h, 2, &l) == -1);
+	fail |= check("no such build", fwhook_link(&h, 3, &l) == -1);
+	h.version = FWHOOK_VERSION + 1;
+	fail |= check("other version", fwhook_link(&h, 0, &l) == -1);
+
+	return fail;
+}
+
+// a .hook of its own, the error and line it should stop at or NULL
+struct src_t {
+	const char *text;
+	const char *error;
+	uint32_t line;
+};
+
+static const char head[] = "version 1\nhook t\nsite s 00 bf 00 bf\nat free\n";
+
+static const struct src_t srcs[] = {
+	{ "bl fn\nbl fn+0x10\nblx arm\nword end-4\nword 0x12345678\nend:\nbuild b\ns = 0x100\nfree = 0x2000\nfn = 0x400\narm = 0x800\n", NULL, 0 },
+	{ "entry in\n00 bf\n00 bf\nin:\nbl fn\nbuild b\ns = 0x100\nfree = 0x2000\nfn = 0x400\n", NULL, 0 },
+	{ "00 bf 00 bf\nbuild b\ns = 0x100\nfree = 0x2000\nbuild c\ns = 0x104\nfree = 0x3000\n", NULL, 0 },
+	{ "00 bf 00 bf\nmov r0, r1\n", "what is mov", 6 },
+	{ "00\nbl fn\n", "branch at odd offset 1", 6 },
+	{ "00 bf 00 bf\nbuild b\ns = 0x100\n", "build b has no free", 0 },
+	{ "bl fn\nbuild b\ns = 0x100\nfree = 0x2000\n", "build b has no fn", 0 },
+	{ "00 bf\n", "payload of 2 bytes, not a word multiple", 0 },
+	{ "00 bf 00 bf\n", "no build", 0 },
+	{ "fn = 0x100\n", "address outside a build", 5 },
+	{ "entry x\n00 bf 00 bf\nbuild b\ns = 0x100\nfree = 0x2000\n", "no label x", 0 },
+	{ "x:\nx:\n", "label x twice", 6 },
+	{ "free:\n00 bf 00 bf\nbuild b\ns = 0x100\nfree = 0x2000\n", "free is a label and a symbol", 9 },
+	{ "bl x\nbuild b\ns = 0x100\nfree = 0x2000\nx = 0x10\nx:\n", "x is a label and a symbol", 0 },
+	{ "bl fn+y\n", "bad reference fn+y", 5 },
+	{ "site t 00 00 00 00\n", "site given twice", 5 },
+	{ "version 2\n", "version 2, this is 1", 5 },
+	{ "space 300\n", "space <n>", 5 },
+	{ "space 200\nspace 60\n", "payload over 256 bytes", 6 },
+};
+
+static int check_parse(const char *dir)
+{
+	static struct fwhookasm_t a;
+	struct fwhook_link_t l;
+	char path[512];
+	uint32_t to;
+	int fail = 0;
+
+	printf("hook sources\n");
+	snprintf(path, sizeof(path), "%s/t.hook", dir);
+	for (uint32_t i = 0; i < sizeof(srcs) / sizeof(srcs[0]); i++) {
+		const struct src_t *s = &srcs[i];
+		FILE *fp = fopen(path, "w");
+		char what[64];
+		int ret;
+
+		if (fp == NULL) {
+			return check("temp file", 0);
+		}
+		fprintf(fp, "%s%s", head, s->text);
+		fclose(fp);
+		ret = fwhookasm_load(&a, path);
+		snprintf(what, sizeof(what), "source %u", i);
+		if (s->error) {
+			fail |= check(what, ret == -1 && strcmp(a.error, s->error) == 0 && a.line == s->line);
+		} else {
+			fail |= check(what, ret == 0 && fwhook_link(&a.h, 0, &l) == 0 && fwhook_verify(&a.h, 0, &l) == 0);
+		}
+		if (ret < 0 && !s->error) {
+			printf("  %u: %s\n", a.line, a.error);
+		}
+		if (i == 0 && ret == 0) {
+			fail |= check("relocations", a.h.nrel == 4 && a.h.len == 20 &&
+				a.rel[3].sym == FWHOOK_SELF && a.rel[3].addend == 20 - 4);
+			fail |= check("bl plus", fwhook_bl_decode(l.payload + 4, 0x2004, &to) == FWHOOK_BL && to == 0x410);
+			fail |= check("blx", fwhook_bl_decode(l.payload + 8, 0x2008, &to) == FWHOOK_BLX && to == 0x800);
+			fail |= check("words", l.payload[12] == 0x10 && l.payload[13] == 0x20 && l.payload[16] == 0x78 && l.payload[19] == 0x12);
+		}
+		if (i == 1 && ret == 0) {
+			fail |= check("entry", a.h.entry == 4 && fwhook_bl_decode(l.tramp, 0x100, &to) == FWHOOK_BL && to == 0x2004);
+		}
+		if (i == 2 && ret == 0) {
+			fail |= check("second build", fwhook_link(&a.h, 1, &l) == 0 && l.site == 0x104 && l.at == 0x3000);
+		}
+	}
+	fail |= check("missing file", fwhookasm_load(&a, "/nonexistent/t.hook") == -2);
+
+	return fail;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-n rounds] [-s seed] [-o dir]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *dir = "/tmp/fwhooktest", *src = __FILE__, *slash = strrchr(src, '/');
+	char hook[512], header[512];
+	uint32_t rounds = 200000;
+	int opt, fail = 0, len = slash ? (int)(slash - src + 1) : 0;
+
+	while ((opt = getopt(argc, argv, "n:s:o:h")) != -1) {
+		switch (opt) {
+		case 'n': rounds = strtoul(optarg, NULL, 0); break;
+		case 's': rng_state = strtoul(optarg, NULL, 0) | 1; break;
+		case 'o': dir = optarg; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	mkdir(dir, 0755);
+	snprintf(hook, sizeof(hook), "%.*s../app/rxfwd.hook", len, src);
+	snprintf(header, sizeof(header), "%.*s../app/rxfwd_hook.h", len, src);
+
+	fail |= check_bl(rounds);
+	fail |= check_rxfwd(hook, header, dir);
+	fail |= check_moved();
+	fail |= check_parse(dir);
+
+	printf("%s\n", fail ? "FAIL" : "ok");
+
+	return fail ? 2 : 0;
+}
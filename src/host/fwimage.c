@@ -0,0 +1,289 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fwimage.h"
+#include "fwcrc.h"
+
+#define FWIMAGE_HDR 16
+
+void fwimage_init(struct fwimage_t *w)
+{
+	memset(w, 0, sizeof(*w));
+	w->fd = -1;
+}
+
+void fwimage_close(struct fwimage_t *w)
+{
+	free(w->block);
+	if (w->fd >= 0) {
+		if (w->data) {
+			munmap((void *)w->data, w->size);
+		}
+		close(w->fd);
+	}
+	fwimage_init(w);
+}
+
+int fwimage_open(struct fwimage_t *w, const char *path)
+{
+	struct stat st;
+	void *map = NULL;
+	int fd = open(path, O_RDONLY), ret;
+
+	if (fd < 0) {
+		return -2;
+	}
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size > UINT32_MAX) {
+		close(fd);
+		return -2;
+	}
+	if (st.st_size) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (map == MAP_FAILED) {
+			close(fd);
+			return -2;
+		}
+	}
+
+	ret = fwimage_parse(w, map, st.st_size);
+	w->fd = fd;
+
+	return ret;
+}
+
+static uint32_t fwimage_le32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static struct fwimage_block_t *fwimage_add(struct fwimage_t *w, uint32_t off)
+{
+	struct fwimage_block_t *b;
+
+	if (w->nblock == w->nalloc) {
+		uint32_t n = w->nalloc ? w->nalloc * 2 : 1024;
+
+		b = realloc(w->block, sizeof(*b) * n);
+		if (b == NULL) {
+			return NULL;
+		}
+		w->block = b;
+		w->nalloc = n;
+	}
+
+	b = &w->block[w->nblock++];
+	memset(b, 0, sizeof(*b));
+	b->off = off;
+	b->cmd = ~0u;
+
+	return b;
+}
+
+static int fwimage_region(struct fwimage_t *w, struct fwimage_block_t *b)
+{
+	struct fwimage_region_t *r;
+	uint32_t i, base = b->addr & FWIMAGE_REGION_MASK;
+
+	for (i = 0; i < w->nregion && w->region[i].base != base; i++);
+	if (i == FWIMAGE_REGIONS_MAX) {
+		return -1;
+	}
+
+	r = &w->region[i];
+	if (i == w->nregion) {
+		w->nregion++;
+		r->base = base;
+		r->lo = b->addr;
+		r->hi = b->addr + b->len;
+	}
+	if (b->addr < r->lo) {
+		r->lo = b->addr;
+	}
+	if (b->addr + b->len > r->hi) {
+		r->hi = b->addr + b->len;
+	}
+	r->blocks++;
+	r->bytes += b->len;
+	b->region = i;
+
+	return 0;
+}
+
+// headers only, the data is stepped over
+int fwimage_parse(struct fwimage_t *w, const void *data, uint32_t size)
+{
+	const uint8_t *p = data;
+	uint32_t off = 0;
+
+	free(w->block);
+	fwimage_init(w);
+	w->data = data;
+	w->size = size;
+
+	while (off < size) {
+		struct fwimage_block_t *b = fwimage_add(w, off);
+
+		if (b == NULL) {
+			return -1;
+		}
+		if (size - off < FWIMAGE_HDR) {
+			b->error = FWIMAGE_CUT;
+			break;
+		}
+
+		b->cmd = fwimage_le32(p + off);
+		b->addr = fwimage_le32(p + off + 4);
+		b->datalength = fwimage_le32(p + off + 8);
+		off += FWIMAGE_HDR;
+
+		if (b->cmd == FWIMAGE_CMD_LAST && b->datalength == 0) {
+			w->entry = b->addr;
+			w->last = 1;
+			w->trailing = size - off;
+			break;
+		}
+		if (b->datalength > size - off) {
+			b->error = FWIMAGE_CUT;
+			break;
+		}
+		if (b->cmd == FWIMAGE_CMD_DATA) {
+			if (b->datalength < 4) {
+				b->error = FWIMAGE_SHORT;
+			} else if ((uint64_t)b->addr + b->datalength - 4 > UINT32_MAX) {
+				b->error = FWIMAGE_RANGE;
+			} else {
+				b->len = b->datalength - 4;
+				if (fwimage_region(w, b) < 0) {
+					w->failed = w->nblock - 1;
+					return -1;
+				}
+			}
+		}
+		off += b->datalength;
+	}
+
+	if (!w->last && (w->nblock == 0 || w->block[w->nblock - 1].error == FWIMAGE_OK)) {
+		struct fwimage_block_t *b = fwimage_add(w, off);
+
+		if (b == NULL) {
+			return -1;
+		}
+		b->error = FWIMAGE_NO_LAST;
+	}
+
+	for (uint32_t i = 0; i < w->nblock; i++) {
+		if (w->block[i].error && w->errors++ == 0) {
+			w->failed = i;
+		}
+	}
+
+	return w->errors ? -5 : 0;
+}
+
+struct fwimage_part_t {
+	struct fwimage_t *w;
+	uint32_t first;
+	uint32_t end;
+	pthread_t thread;
+};
+
+static void *fwimage_check(void *arg)
+{
+	struct fwimage_part_t *part = arg;
+	struct fwimage_t *w = part->w;
+
+	for (uint32_t i = part->first; i < part->end; i++) {
+		struct fwimage_block_t *b = &w->block[i];
+		const uint8_t *p = w->data + b->off;
+
+		if (b->error == FWIMAGE_HDR_CRC || b->error == FWIMAGE_DATA_CRC) {
+			b->error = FWIMAGE_OK;
+		}
+		if (b->error != FWIMAGE_OK) {
+			continue;
+		}
+		if (fwcrc(0, p, FWIMAGE_HDR) != 0) {
+			b->error = FWIMAGE_HDR_CRC;
+		} else if (b->datalength && fwcrc(0, p + FWIMAGE_HDR, b->datalength) != 0) {
+			b->error = FWIMAGE_DATA_CRC;
+		}
+	}
+
+	return NULL;
+}
+
+// the blocks are split where the file splits into equal parts, each thread
+// only writes the errors of its own blocks
+int fwimage_verify(struct fwimage_t *w, int threads)
+{
+	struct fwimage_part_t part[FWIMAGE_THREADS_MAX];
+	uint32_t n = threads, i, k;
+
+	if (threads == FWIMAGE_THREADS_AUTO) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+		n = w->size / FWIMAGE_SPLIT_MIN;
+		if (cpus > 0 && n > (uint32_t)cpus) {
+			n = cpus;
+		}
+	}
+	if (n > FWIMAGE_THREADS_MAX) {
+		n = FWIMAGE_THREADS_MAX;
+	}
+	if (n > w->nblock) {
+		n = w->nblock;
+	}
+	if (n == 0) {
+		n = 1;
+	}
+
+	for (i = 0, k = 0; k < n; k++) {
+		uint64_t end = (uint64_t)w->size * (k + 1) / n;
+
+		part[k].w = w;
+		part[k].first = i;
+		while (i < w->nblock && (w->block[i].off < end || k == n - 1)) {
+			i++;
+		}
+		part[k].end = i;
+	}
+
+	for (k = 1; k < n; k++) {
+		if (pthread_create(&part[k].thread, NULL, fwimage_check, &part[k]) != 0) {
+			break;
+		}
+	}
+	w->threads = k;
+	fwimage_check(&part[0]);
+	// parts that did not get a thread
+	for (i = k; i < n; i++) {
+		fwimage_check(&part[i]);
+	}
+	while (--k > 0) {
+		pthread_join(part[k].thread, NULL);
+	}
+
+	w->errors = 0;
+	w->failed = 0;
+	for (i = 0; i < w->nblock; i++) {
+		if (w->block[i].error && w->errors++ == 0) {
+			w->failed = i;
+		}
+	}
+
+	return w->errors ? -5 : 0;
+}
+
+const char *fwimage_error(uint32_t error)
+{
+	static const char *names[] = {
+		"ok", "cut off", "too short", "header crc", "data crc", "past 4 GiB", "no last block",
+	};
+
+	return (error < FWIMAGE_ERRORS) ? names[error] : "?";
+}
@@ -0,0 +1,90 @@
+#ifndef FWIMAGE_h_
+#define FWIMAGE_h_
+
+#include <stdint.h>
+
+// marvell firmware download images: a chain of blocks, a 16 byte header
+// {cmd, addr, datalength, crc} and datalength bytes of data ending in their
+// own crc, both crcs making what they cover come out as 0
+// fwimage_parse follows the chain once, reading only the headers, and lists
+// the blocks and where in memory they go, fwimage_verify then checks both
+// crcs of every block, split over threads
+// calls return 0, -1 bad input, -2 file not readable, -5 image damaged,
+// errors are kept per block, failed is the first block with one, the list
+// ends at a block the chain breaks at, a file without the last block gets
+// an entry with cmd ~0 where it would have been
+
+#define FWIMAGE_CMD_DATA     1
+#define FWIMAGE_CMD_LAST     4         // no data, addr is the entry point
+
+#define FWIMAGE_REGION_MASK  0xffc00000
+#define FWIMAGE_REGIONS_MAX  16
+
+// thread count for fwimage_verify to pick, the cpus as far as each gets
+// FWIMAGE_SPLIT_MIN bytes, a thread costs more than the crc of less
+#define FWIMAGE_THREADS_AUTO 0
+#define FWIMAGE_THREADS_MAX  64
+#define FWIMAGE_SPLIT_MIN    (1 << 20)
+
+enum {
+	FWIMAGE_OK,
+	FWIMAGE_CUT,             // header or data past the end of the file
+	FWIMAGE_SHORT,           // data block too short for its crc
+	FWIMAGE_HDR_CRC,
+	FWIMAGE_DATA_CRC,
+	FWIMAGE_RANGE,           // data past the end of the address space
+	FWIMAGE_NO_LAST,         // the file ends without the last block
+	FWIMAGE_ERRORS,
+};
+
+struct fwimage_block_t {
+	uint32_t off;            // of the header in the file
+	uint32_t cmd;
+	uint32_t addr;
+	uint32_t len;            // data without its crc, 0 for other commands
+	uint32_t datalength;     // as in the header
+	uint32_t region;         // index in region[], data blocks only
+	uint32_t error;
+};
+
+// where the data blocks of one 4 MiB region land
+struct fwimage_region_t {
+	uint32_t base;           // addr & FWIMAGE_REGION_MASK
+	uint32_t lo;
+	uint32_t hi;             // one past the last byte
+	uint32_t blocks;
+	uint32_t bytes;          // data in it
+};
+
+struct fwimage_t {
+	const uint8_t *data;
+	uint32_t size;
+	int fd;                  // set by fwimage_open, -1 otherwise
+	uint32_t entry;
+	int last;                // the last block was found
+	uint32_t trailing;       // bytes after it, left alone
+	uint32_t nblock;
+	uint32_t nalloc;
+	struct fwimage_block_t *block;
+	uint32_t nregion;
+	struct fwimage_region_t region[FWIMAGE_REGIONS_MAX];
+	uint32_t errors;         // blocks with an error
+	uint32_t failed;
+	uint32_t threads;        // used by the last fwimage_verify
+};
+
+void fwimage_init(struct fwimage_t *w);
+// frees the block list, unmaps what fwimage_open mapped
+void fwimage_close(struct fwimage_t *w);
+
+// maps a file and parses it
+int fwimage_open(struct fwimage_t *w, const char *path);
+// size bytes at data, which have to stay there until fwimage_close, starts
+// over on a parsed w but not on an opened one
+int fwimage_parse(struct fwimage_t *w, const void *data, uint32_t size);
+// header and data crcs of every block, threads or FWIMAGE_THREADS_AUTO
+int fwimage_verify(struct fwimage_t *w, int threads);
+
+const char *fwimage_error(uint32_t error);
+
+#endif
@@ -0,0 +1,444 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "fwimage.h"
+#include "fwcrc.h"
+#include "test.h"
+
+// the parser over the images in doc/marvell and over generated ones with
+// bits flipped, blocks cut off, missing and out of range, every error has
+// to land on its block and come out the same for any number of threads
+// with -b it measures instead how parse and verify scale with threads over
+// the images and a large generated one
+
+static uint8_t *load(const char *file, uint32_t *size)
+{
+	struct stat st;
+	uint8_t *buf;
+	int fd = open(file, O_RDONLY);
+
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		return NULL;
+	}
+	buf = malloc(st.st_size + 1);
+	if (buf && read(fd, buf, st.st_size) != st.st_size) {
+		free(buf);
+		buf = NULL;
+	}
+	close(fd);
+	*size = st.st_size;
+
+	return buf;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+// a crc goes after what it covers msb first
+static void put_crc(uint8_t *p, uint32_t len)
+{
+	uint32_t crc = fwcrc(0, p, len);
+
+	p[len] = crc >> 24;
+	p[len + 1] = crc >> 16;
+	p[len + 2] = crc >> 8;
+	p[len + 3] = crc;
+}
+
+static uint32_t put_block(uint8_t *img, uint32_t off, uint32_t cmd, uint32_t addr, uint32_t datalength)
+{
+	uint8_t *h = img + off;
+
+	put_le32(h, cmd);
+	put_le32(h + 4, addr);
+	put_le32(h + 8, datalength);
+	put_crc(h, 12);
+	if (datalength >= 4) {
+		for (uint32_t i = 0; i < datalength - 4; i++) {
+			h[16 + i] = rng();
+		}
+		put_crc(h + 16, datalength - 4);
+	}
+
+	return off + 16 + datalength;
+}
+
+// what a generated image holds
+struct gen_t {
+	uint32_t size;
+	uint32_t nblock;
+	uint32_t off[8192];
+	uint32_t entry;
+};
+
+// data blocks of up to max bytes spread over the three regions the 8787
+// loads, in order within each until 3 MiB and round again, then the last
+// block
+static uint32_t gen(uint8_t *img, uint32_t nblock, uint32_t max, struct gen_t *g)
+{
+	static const uint32_t bases[] = { 0x00000000, 0x04000000, 0xc0000000 };
+	uint32_t at[3] = { 0x100, 0x04000000, 0xc0000400 };
+	uint32_t off = 0;
+
+	g->nblock = 0;
+	for (uint32_t i = 0; i < nblock; i++) {
+		uint32_t r = rng() % 3, len = 4 + (rng() % (max / 4)) * 4;
+
+		g->off[g->nblock++] = off;
+		off = put_block(img, off, FWIMAGE_CMD_DATA, at[r], len);
+		at[r] = bases[r] + (at[r] + len - 4 - bases[r]) % 0x300000;
+	}
+	g->entry = 0x1234;
+	g->off[g->nblock++] = off;
+	off = put_block(img, off, FWIMAGE_CMD_LAST, g->entry, 0);
+	g->size = off;
+
+	return off;
+}
+
+// the chain followed the plain way, for the regions to compare against
+static int walk(const uint8_t *img, uint32_t size, struct fwimage_region_t *reg, uint32_t *nreg, uint32_t *entry)
+{
+	uint32_t off = 0, n = 0;
+
+	*nreg = 0;
+	while (off + 16 <= size) {
+		uint32_t cmd, addr, len, r;
+
+		memcpy(&cmd, img + off, 4);
+		memcpy(&addr, img + off + 4, 4);
+		memcpy(&len, img + off + 8, 4);
+		n++;
+		off += 16;
+		if (cmd == FWIMAGE_CMD_LAST && len == 0) {
+			*entry = addr;
+			return n;
+		}
+		if (cmd == FWIMAGE_CMD_DATA) {
+			for (r = 0; r < *nreg && reg[r].base != (addr & FWIMAGE_REGION_MASK); r++);
+			if (r == *nreg) {
+				memset(&reg[r], 0, sizeof(reg[r]));
+				reg[r].base = addr & FWIMAGE_REGION_MASK;
+				reg[r].lo = addr;
+				(*nreg)++;
+			}
+			reg[r].lo = (addr < reg[r].lo) ? addr : reg[r].lo;
+			reg[r].hi = (addr + len - 4 > reg[r].hi) ? addr + len - 4 : reg[r].hi;
+			reg[r].blocks++;
+			reg[r].bytes += len - 4;
+		}
+		off += len;
+	}
+
+	return -1;
+}
+
+// the same errors whatever the thread count
+static int verify_all(struct fwimage_t *w, uint32_t *errors, uint32_t *failed)
+{
+	static const int threads[] = { 1, 2, 3, 8, FWIMAGE_THREADS_AUTO };
+	uint8_t *first = NULL;
+	int ret = 0, fail = 0;
+
+	for (uint32_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+		int r = fwimage_verify(w, threads[t]);
+
+		if (t == 0) {
+			ret = r;
+			*errors = w->errors;
+			*failed = w->failed;
+			first = malloc(w->nblock);
+			for (uint32_t i = 0; i < w->nblock; i++) {
+				first[i] = w->block[i].error;
+			}
+			continue;
+		}
+		fail |= r != ret || w->errors != *errors || w->failed != *failed;
+		for (uint32_t i = 0; i < w->nblock; i++) {
+			fail |= first[i] != w->block[i].error;
+		}
+	}
+	free(first);
+	if (fail) {
+		printf("  results differ between thread counts: FAIL\n");
+		return -100;
+	}
+
+	return ret;
+}
+
+static int check_marvell(const char *dir)
+{
+	static const char *images[] = { "sd8787_uapsta.bin", "sd8797_uapsta.bin", "sd8897_uapsta.bin", "pcie8897_uapsta.bin" };
+	int fail = 0;
+
+	for (uint32_t i = 0; i < sizeof(images) / sizeof(images[0]); i++) {
+		struct fwimage_region_t reg[FWIMAGE_REGIONS_MAX];
+		struct fwimage_t w;
+		char file[640];
+		uint32_t size, nreg, entry = 0, errors, failed;
+		uint8_t *img;
+		int n, f = 0;
+
+		snprintf(file, sizeof(file), "%s/%s", dir, images[i]);
+		img = load(file, &size);
+		if (img == NULL) {
+			printf("%-20s not there, skipped\n", images[i]);
+			continue;
+		}
+		n = walk(img, size, reg, &nreg, &entry);
+
+		fwimage_init(&w);
+		f |= check("open", fwimage_open(&w, file) == 0);
+		f |= check("verify", verify_all(&w, &errors, &failed) == 0 && errors == 0);
+		f |= check("blocks", (int)w.nblock == n);
+		f |= check("entry", w.last && w.entry == entry && w.trailing == 0);
+		f |= check("regions", w.nregion == nreg && memcmp(w.region, reg, sizeof(reg[0]) * nreg) == 0);
+		fwimage_close(&w);
+
+		printf("%-20s %s, %d blocks, %u regions\n", images[i], f ? "FAIL" : "ok", n, nreg);
+		free(img);
+		fail |= f;
+	}
+
+	return fail;
+}
+
+static int check_generated(void)
+{
+	static struct gen_t g;
+	static uint8_t img[4 << 20], copy[4 << 20];
+	struct fwimage_region_t reg[FWIMAGE_REGIONS_MAX];
+	struct fwimage_t w;
+	uint32_t size, nreg, entry, errors, failed;
+	int fail = 0;
+
+	fwimage_init(&w);
+
+	for (int round = 0; round < 50; round++) {
+		uint32_t bad[8], nbad = 1 + rng() % 4, want_failed = ~0u;
+
+		size = gen(img, 200 + rng() % 2000, 1024, &g);
+		walk(img, size, reg, &nreg, &entry);
+
+		fail |= check("generated", fwimage_parse(&w, img, size) == 0 && verify_all(&w, &errors, &failed) == 0);
+		fail |= check("generated blocks", w.nblock == g.nblock && w.entry == g.entry);
+		fail |= check("generated regions", w.nregion == nreg && memcmp(w.region, reg, sizeof(reg[0]) * nreg) == 0);
+		for (uint32_t i = 0; i < g.nblock && i < w.nblock; i++) {
+			fail |= w.block[i].off != g.off[i];
+		}
+
+		// bits flipped anywhere but in the lengths, which would break the chain
+		memcpy(copy, img, size);
+		for (uint32_t k = 0; k < nbad; k++) {
+			uint32_t b, at, datalength, j;
+
+			// one flip per block, two could cancel out
+			do {
+				b = rng() % (g.nblock - 1);
+				for (j = 0; j < k && bad[j] / 2 != b; j++);
+			} while (j < k);
+			datalength = g.off[b + 1] - g.off[b] - 16;
+
+			do {
+				at = rng() % (16 + datalength);
+			} while (at >= 8 && at < 12);
+			copy[g.off[b] + at] ^= 1 << (rng() % 8);
+			bad[k] = b * 2 + (at >= 16);
+			want_failed = (b < want_failed) ? b : want_failed;
+		}
+		fwimage_parse(&w, copy, size);
+		fail |= check("flipped", verify_all(&w, &errors, &failed) == -5 && failed == want_failed);
+		for (uint32_t k = 0; k < nbad; k++) {
+			uint32_t e = w.block[bad[k] / 2].error;
+
+			fail |= check("flipped block", e == ((bad[k] & 1) ? FWIMAGE_DATA_CRC : FWIMAGE_HDR_CRC));
+		}
+		for (uint32_t i = 0, j; i < w.nblock; i++) {
+			for (j = 0; j < nbad && bad[j] / 2 != i; j++);
+			fail |= check("flipped others", (j < nbad) == (w.block[i].error != FWIMAGE_OK));
+		}
+
+		// cut off anywhere
+		{
+			uint32_t cut = rng() % size, b;
+
+			for (b = 0; b + 1 < g.nblock && g.off[b + 1] <= cut; b++);
+			fwimage_parse(&w, img, cut);
+			if (cut == g.off[b]) {
+				fail |= check("cut between", w.nblock == b + 1 && w.block[b].error == FWIMAGE_NO_LAST);
+			} else {
+				fail |= check("cut", w.nblock == b + 1 && w.block[b].error == FWIMAGE_CUT);
+			}
+			fail |= check("cut verify", verify_all(&w, &errors, &failed) == -5 && errors == 1 && failed == b);
+		}
+	}
+
+	// no blocks at all
+	fail |= check("empty", fwimage_parse(&w, img, 0) == -5 && w.nblock == 1 && w.block[0].error == FWIMAGE_NO_LAST);
+
+	// data blocks too short for a crc or running past 4 GiB, then more after
+	{
+		uint32_t off = put_block(img, 0, FWIMAGE_CMD_DATA, 0x100, 8);
+
+		off = put_block(img, off, FWIMAGE_CMD_DATA, 0x104, 0);
+		off = put_block(img, off, FWIMAGE_CMD_DATA, 0xfffffff0, 100);
+		off = put_block(img, off, 6, 0, 0);
+		off = put_block(img, off, FWIMAGE_CMD_DATA, 0xc0000000, 100);
+		off = put_block(img, off, FWIMAGE_CMD_LAST, 0x100, 0);
+		memset(img + off, 0xee, 300);
+
+		fail |= check("short", fwimage_parse(&w, img, off + 300) == -5 && w.errors == 2 && w.failed == 1);
+		fail |= check("short blocks", w.nblock == 6 && w.block[1].error == FWIMAGE_SHORT
+			&& w.block[2].error == FWIMAGE_RANGE && w.block[3].cmd == 6 && w.block[3].error == FWIMAGE_OK);
+		fail |= check("short verify", verify_all(&w, &errors, &failed) == -5 && errors == 2);
+		fail |= check("short regions", w.nregion == 2 && w.region[0].hi == 0x104 && w.region[1].bytes == 96);
+		fail |= check("trailing", w.last && w.entry == 0x100 && w.trailing == 300);
+	}
+
+	// more regions than there is room for
+	{
+		uint32_t off = 0;
+
+		for (uint32_t i = 0; i <= FWIMAGE_REGIONS_MAX; i++) {
+			off = put_block(img, off, FWIMAGE_CMD_DATA, i << 22, 8);
+		}
+		off = put_block(img, off, FWIMAGE_CMD_LAST, 0, 0);
+		fail |= check("regions", fwimage_parse(&w, img, off) == -1 && w.failed == FWIMAGE_REGIONS_MAX);
+	}
+
+	fwimage_close(&w);
+	fail |= check("missing file", fwimage_open(&w, "/nonexistent/fw.bin") == -2);
+	fwimage_close(&w);
+
+	printf("%-20s %s\n", "generated", fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+// parse, and verify over a number of threads, best of a few runs each
+static void bench_one(const char *name, const uint8_t *img, uint32_t size, uint32_t rounds)
+{
+	static const int threads[] = { 1, 2, 4, 8, FWIMAGE_THREADS_AUTO };
+	struct fwimage_t w;
+	double parse = 1e9, one = 0;
+
+	fwimage_init(&w);
+	for (int run = 0; run < 5; run++) {
+		double t0 = now();
+
+		for (uint32_t r = 0; r < rounds; r++) {
+			fwimage_parse(&w, img, size);
+		}
+		if (now() - t0 < parse) {
+			parse = now() - t0;
+		}
+	}
+	printf("%-20s %7.2f MiB %6u blocks, parse %8.1f us\n", name, size / 1048576.0, w.nblock, parse / rounds * 1e6);
+
+	for (uint32_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+		double best = 1e9;
+
+		for (int run = 0; run < 5; run++) {
+			double t0 = now();
+
+			for (uint32_t r = 0; r < rounds; r++) {
+				fwimage_verify(&w, threads[t]);
+			}
+			if (now() - t0 < best) {
+				best = now() - t0;
+			}
+		}
+		if (t == 0) {
+			one = best;
+		}
+		printf("  verify %-6s %3u threads %8.1f us %8.0f MiB/s %5.2fx\n",
+			threads[t] ? "" : "(auto)", w.threads, best / rounds * 1e6,
+			(double)size * rounds / best / 1048576, one / best);
+	}
+	fwimage_close(&w);
+}
+
+static int bench(const char *dir, uint32_t mib)
+{
+	static const char *images[] = { "sd8787_uapsta.bin", "sd8797_uapsta.bin", "sd8897_uapsta.bin", "pcie8897_uapsta.bin" };
+	static struct gen_t g;
+	uint8_t *big = malloc((size_t)mib << 20);
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	uint32_t size;
+
+	printf("%ld cpus, crc %s\n", cpus, fwcrc_name(fwcrc_impl()));
+	for (uint32_t i = 0; i < sizeof(images) / sizeof(images[0]); i++) {
+		char file[640];
+		uint8_t *img;
+
+		snprintf(file, sizeof(file), "%s/%s", dir, images[i]);
+		img = load(file, &size);
+		if (img == NULL) {
+			fprintf(stderr, "%s: not readable\n", file);
+			continue;
+		}
+		bench_one(images[i], img, size, 200);
+		free(img);
+	}
+
+	// blocks of up to 64 KiB, room for them all in the 8192 gen keeps
+	size = gen(big, ((size_t)mib << 20) / 33000 - 1, 65536, &g);
+	bench_one("generated", big, size, 4);
+	free(big);
+
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-b] [-m MiB] [-s seed] [-d dir]\n", name);
+	fprintf(stderr, "  -b  parse and verify times per thread count instead of the checks\n");
+	fprintf(stderr, "  -m  size of the generated image for -b (256, at most 256)\n");
+	fprintf(stderr, "  -d  where the images are (doc/marvell)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	char dir[512];
+	const char *src = __FILE__, *slash = strrchr(src, '/');
+	uint32_t mib = 256;
+	int opt, fail = 0, do_bench = 0;
+
+	snprintf(dir, sizeof(dir), "%.*s../../doc/marvell", slash ? (int)(slash - src + 1) : 0, src);
+
+	while ((opt = getopt(argc, argv, "bm:s:d:h")) != -1) {
+		switch (opt) {
+		case 'b': do_bench = 1; break;
+		case 'm': mib = strtoul(optarg, NULL, 0); break;
+		case 's': rng_state = strtoul(optarg, NULL, 0) | 1; break;
+		case 'd': snprintf(dir, sizeof(dir), "%s", optarg); break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	if (do_bench) {
+		return bench(dir, (mib < 1) ? 1 : (mib > 256) ? 256 : mib);
+	}
+
+	fail |= check_marvell(dir);
+	fail |= check_generated();
+
+	printf("%s\n", fail ? "FAIL" : "ok");
+
+	return fail ? 2 : 0;
+}
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fwimage.h"
+
+// what is in firmware download images: the blocks, where they go in
+// memory and which of them are damaged, every problem is listed rather
+// than stopping at the first
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-v] [-j threads] image ...\n", name);
+	fprintf(stderr, "  -v  list every block\n");
+	fprintf(stderr, "  -j  threads to check the crcs with, all cpus when not given\n");
+}
+
+static int info(const char *path, int verbose, int threads)
+{
+	struct fwimage_t w;
+	uint32_t data = 0, other = 0;
+	int ret;
+
+	fwimage_init(&w);
+	ret = fwimage_open(&w, path);
+	if (ret == -2) {
+		fprintf(stderr, "%s: cannot read\n", path);
+		return 1;
+	}
+	if (ret != -1) {
+		ret = fwimage_verify(&w, threads);
+	}
+
+	for (uint32_t i = 0; i < w.nblock; i++) {
+		if (w.block[i].cmd == FWIMAGE_CMD_DATA) {
+			data++;
+		} else if (w.block[i].cmd != FWIMAGE_CMD_LAST && w.block[i].cmd != ~0u) {
+			other++;
+		}
+	}
+
+	printf("%s: %u bytes, %u blocks, %u data, %u other commands", path, w.size, w.nblock, data, other);
+	if (w.last) {
+		printf(", entry %08x", w.entry);
+	}
+	if (w.trailing) {
+		printf(", %u bytes after the last block", w.trailing);
+	}
+	printf("\n");
+
+	printf("  %-8s %-8s %-8s %8s %8s\n", "region", "from", "to", "blocks", "bytes");
+	for (uint32_t i = 0; i < w.nregion; i++) {
+		const struct fwimage_region_t *r = &w.region[i];
+
+		printf("  %08x %08x %08x %8u %8u\n", r->base, r->lo, r->hi, r->blocks, r->bytes);
+	}
+
+	for (uint32_t i = 0; i < w.nblock; i++) {
+		const struct fwimage_block_t *b = &w.block[i];
+
+		if (!verbose && b->error == FWIMAGE_OK) {
+			continue;
+		}
+		printf("  %5u @%-8x cmd %-2d %08x %5u %s\n", i, b->off, (int)b->cmd, b->addr, b->datalength,
+			fwimage_error(b->error));
+	}
+	if (ret == -1) {
+		printf("  more than %u regions at block %u\n", FWIMAGE_REGIONS_MAX, w.failed);
+	} else if (w.errors) {
+		printf("  %u blocks damaged, the first is %u\n", w.errors, w.failed);
+	}
+
+	fwimage_close(&w);
+
+	return ret < 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, verbose = 0, threads = FWIMAGE_THREADS_AUTO, fail = 0;
+
+	while ((opt = getopt(argc, argv, "vj:h")) != -1) {
+		switch (opt) {
+		case 'v': verbose = 1; break;
+		case 'j': threads = strtoul(optarg, NULL, 0); break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	if (optind == argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (int i = optind; i < argc; i++) {
+		fail |= info(argv[i], verbose, threads);
+	}
+
+	return fail;
+}
@@ -0,0 +1,515 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <vitasdkkern.h>
+
+#include "kwifimon_export.h"
+#include "wlan_kernel.h"
+#include "sigs.h"
+#include "fwpatch.h"
+#include "kcap.h"
+
+#include "shim.h"
+#include "test.h"
+
+// patch sets applied to and undone from simulated firmware memory through
+// the patch ioctl of the hook, with reads failing, writes failing, not
+// sticking or landing wrong at every word of a transaction, and memory
+// changing between the check and the write
+// after every call firmware has to hold either all of the change or none
+// of it, no word may be written outside the wlan lock
+
+int module_start(SceSize argc, const void *args);
+int module_stop(SceSize argc, const void *args);
+
+// code ram, where the patches go
+#define SIM_BASE 0x00000000
+#define SIM_SIZE 0x00060000
+
+static uint32_t sim_mem[SIM_SIZE / 4];
+
+enum {
+	FAIL_NONE,
+	FAIL_ERROR,          // write returns an error, memory untouched
+	FAIL_DROP,           // write claims success, memory untouched
+	FAIL_WRONG,          // write claims success, something else lands
+};
+
+static struct {
+	int kind;
+	int32_t write_at;    // writes until the failure, < 0 never
+	int sticky;          // every write after it fails as well
+	int32_t read_at;     // reads until a failure, < 0 never
+	uint32_t read_pct;   // per read, in 1/10000
+} sim;
+
+static uint32_t sim_writes;
+static uint32_t sim_unlocked_writes;
+static int sim_locked;
+static int sim_lock_wrote;
+static uint32_t sim_write_locks;     // lock holds with writes in them
+
+static void sim_reset(void)
+{
+	sim.kind = FAIL_NONE;
+	sim.write_at = -1;
+	sim.sticky = 0;
+	sim.read_at = -1;
+	sim.read_pct = 0;
+	sim_writes = 0;
+	sim_unlocked_writes = 0;
+	sim_write_locks = 0;
+}
+
+static int sim_mem_read(struct wlan_dev_t *dev, uint32_t addr, uint32_t *value)
+{
+	if (sim.read_at == 0 || (sim.read_pct && rng() % 10000 < sim.read_pct)) {
+		return -1;
+	}
+	if (sim.read_at > 0) {
+		sim.read_at--;
+	}
+
+	if ((addr & 3) || addr - SIM_BASE >= SIM_SIZE) {
+		return -1;
+	}
+	*value = sim_mem[(addr - SIM_BASE) / 4];
+
+	return 0;
+}
+
+static int sim_mem_write(struct wlan_dev_t *dev, uint32_t addr, uint32_t value)
+{
+	int kind = FAIL_NONE;
+
+	if (!sim_locked) {
+		sim_unlocked_writes++;
+	}
+	sim_lock_wrote = 1;
+
+	if (sim.write_at == 0) {
+		kind = sim.kind;
+		if (!sim.sticky) {
+			sim.write_at = -1;
+		}
+	} else if (sim.write_at > 0) {
+		sim.write_at--;
+	}
+
+	if ((addr & 3) || addr - SIM_BASE >= SIM_SIZE) {
+		return -1;
+	}
+
+	switch (kind) {
+	case FAIL_ERROR:
+		return -1;
+	case FAIL_DROP:
+		return 0;
+	case FAIL_WRONG:
+		value ^= 1u << (rng() % 32);
+		break;
+	}
+	sim_mem[(addr - SIM_BASE) / 4] = value;
+	sim_writes++;
+
+	return 0;
+}
+
+static int test_wlan_lock(struct wlan_lock_t *ptr)
+{
+	sim_locked = 1;
+	sim_lock_wrote = 0;
+	return 0;
+}
+
+static void test_wlan_unlock(struct wlan_lock_t *ptr)
+{
+	sim_locked = 0;
+	if (sim_lock_wrote) {
+		sim_write_locks++;
+	}
+}
+
+// the app side: bulk read and patch ioctl into the hook
+
+static struct netdev_t netdev;
+static uint8_t dev[sizeof(struct wlan_dev_t)];
+static ioctl_hook_t hook_ioctl;
+
+// firmware storing to patched memory between check and transaction
+static int32_t race_addr = -1;
+
+static int test_read(void *ctx, uint32_t addr, uint32_t *buf, uint32_t words)
+{
+	uint8_t req[sizeof(struct wifimon_mem_bulk_t) + 4 * WIFIMON_MEM_BULK_MAX];
+	struct wifimon_mem_bulk_t b = { addr, words };
+	int ret;
+
+	memcpy(req, &b, sizeof(b));
+	ret = hook_ioctl(&netdev, WLAN_IOCTL_MEM_BULK, req, sizeof(b) + 4 * words);
+	if (ret > 0) {
+		memcpy(buf, req + sizeof(b), 4 * ret);
+	}
+
+	return ret;
+}
+
+static int test_patch(void *ctx, struct wifimon_mem_patch_t *req, uint32_t len)
+{
+	if (race_addr >= 0) {
+		sim_mem[race_addr / 4] ^= 0x10000;
+		race_addr = -1;
+	}
+	// reads inside the transaction are covered by the write failures,
+	// where a failed read back is one more write that did not stick
+	sim.read_pct = 0;
+
+	return hook_ioctl(&netdev, WLAN_IOCTL_MEM_PATCH, (uint8_t *)req, len);
+}
+
+static const struct fwpatch_ops_t test_ops = {
+	.read = test_read,
+	.patch = test_patch,
+};
+
+// the set the app puts in, the code at 0x5fedc and the bl to it at 0xbaa4,
+// next to a few more to exercise dependencies
+
+static const uint8_t p_hook[] = {
+	0xb1, 0x68, 0x31, 0x44, 0x70, 0x69, 0x00, 0x28, 0x00, 0xD1, 0x05, 0x48, 0xA0, 0xF7, 0x75, 0xFD, 0x00, 0x25, 0x02, 0xAA,
+	0x03, 0xA9, 0x04, 0xA8, 0xAB, 0xF7, 0xB6, 0xFD, 0xAB, 0xF7, 0xDA, 0xFD, 0x00, 0xFF, 0x05, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+static const uint8_t o_call[] = { 0x00, 0x25, 0x02, 0xaa };
+static const uint8_t p_call[] = { 0x54, 0xf0, 0x1a, 0xfa };
+static const uint8_t o_a[] = { 0x20, 0x20, 0x20, 0x81 };
+static const uint8_t p_a[] = { 0x20, 0x20, 0x20, 0x20 };
+static const uint8_t o_b[] = { 0x00, 0x19, 0xC1, 0x78, 0x01, 0x02, 0x03, 0x04 };
+static const uint8_t p_b[] = { 0x00, 0xf0, 0x12, 0xf8, 0x01, 0x02, 0x03, 0x05 };
+static uint8_t p_big[4 * 200];
+
+enum { P_HOOK, P_CALL, P_A, P_B, P_BIG, P_N };
+
+static struct fwpatch_t set[P_N];
+static uint32_t orig_mem[SIM_SIZE / 4];
+
+static void set_build(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < sizeof(p_big); i++) {
+		p_big[i] = rng();
+	}
+
+	set[P_HOOK] = (struct fwpatch_t){ "hook", 0x0005fedc, sizeof(p_hook), p_hook, 0, FWPATCH_ANY_ORIG, 0 };
+	set[P_CALL] = (struct fwpatch_t){ "call", 0x0000baa4, sizeof(p_call), p_call, kcap_sum(1, o_call, 4), 0, 1 << P_HOOK };
+	set[P_A] = (struct fwpatch_t){ "a", 0x00000a3c, sizeof(p_a), p_a, kcap_sum(1, o_a, 4), 0, 0 };
+	set[P_B] = (struct fwpatch_t){ "b", 0x000001f0, sizeof(p_b), p_b, kcap_sum(1, o_b, 8), 0, 1 << P_A | 1 << P_CALL };
+	set[P_BIG] = (struct fwpatch_t){ "big", 0x00020000, sizeof(p_big), p_big, 0, FWPATCH_ANY_ORIG, 0 };
+
+	for (i = 0; i < SIM_SIZE / 4; i++) {
+		sim_mem[i] = rng();
+	}
+	memcpy(&sim_mem[0xbaa4 / 4], o_call, 4);
+	memcpy(&sim_mem[0xa3c / 4], o_a, 4);
+	memcpy(&sim_mem[0x1f0 / 4], o_b, 8);
+	memcpy(orig_mem, sim_mem, sizeof(sim_mem));
+}
+
+// memory as it should be with the patches of mask in
+static int mem_is(uint32_t mask)
+{
+	static uint32_t want[SIM_SIZE / 4];
+	uint32_t i;
+
+	memcpy(want, orig_mem, sizeof(want));
+	for (i = 0; i < P_N; i++) {
+		if ((mask >> i) & 1) {
+			memcpy((uint8_t *)want + set[i].addr, set[i].data, set[i].len);
+		}
+	}
+
+	return memcmp(want, sim_mem, sizeof(want)) == 0;
+}
+
+static int check_init(void)
+{
+	static struct fwpatch_set_t s;
+	struct fwpatch_t bad[3];
+	int fail = 0;
+
+	fail |= check("set ok", fwpatch_init(&s, set, P_N) == 0);
+	fail |= check("order", s.order[0] == P_HOOK && s.order[1] == P_CALL && s.order[2] == P_A && s.order[3] == P_B);
+
+	memcpy(bad, set, sizeof(bad));
+	bad[1].addr = 0xbaa6;
+	fail |= check("misaligned", fwpatch_init(&s, bad, 2) == -1 && s.failed == 1);
+
+	memcpy(bad, set, sizeof(bad));
+	bad[1].addr = set[0].addr + 8;
+	fail |= check("overlap", fwpatch_init(&s, bad, 2) == -1 && s.failed == 1);
+
+	memcpy(bad, set, sizeof(bad));
+	bad[0].deps = 1 << 0;
+	fail |= check("self dep", fwpatch_init(&s, bad, 2) == -1 && s.failed == 0);
+
+	memcpy(bad, set, sizeof(bad));
+	bad[2].deps = 1 << 3;
+	fail |= check("dep outside", fwpatch_init(&s, bad, 3) == -1 && s.failed == 2);
+
+	memcpy(bad, set, sizeof(bad));
+	bad[0].deps = 1 << 2;
+	bad[2].deps = 1 << 1;
+	fail |= check("cycle", fwpatch_init(&s, bad, 3) == -1);
+
+	memcpy(bad, set, sizeof(bad));
+	bad[1].len = 4 * (FWPATCH_WORDS_MAX - 13 + 1);
+	fail |= check("too big", fwpatch_init(&s, bad, 2) == -1 && s.failed == 1);
+
+	printf("init:     %s\n", fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+static int check_basic(void)
+{
+	static struct fwpatch_set_t s;
+	uint32_t in, orig;
+	int fail = 0, ret;
+
+	memcpy(sim_mem, orig_mem, sizeof(sim_mem));
+	sim_reset();
+	fwpatch_init(&s, set, P_N);
+	s.ops = &test_ops;
+
+	fail |= check("scan", fwpatch_scan(&s, &in, &orig) == 0 && in == 0
+		&& orig == (1 << P_CALL | 1 << P_A | 1 << P_B));
+
+	// the call pulls in the code it jumps to
+	ret = fwpatch_apply(&s, 1 << P_CALL);
+	fail |= check("apply", ret == 14 && mem_is(1 << P_HOOK | 1 << P_CALL));
+	fail |= check("one lock", sim_write_locks == 1 && sim_unlocked_writes == 0);
+	fail |= check("applied", s.applied == (1 << P_HOOK | 1 << P_CALL) && s.saved == s.applied);
+
+	fail |= check("again", fwpatch_apply(&s, 1 << P_CALL) == 0 && mem_is(1 << P_HOOK | 1 << P_CALL));
+
+	ret = fwpatch_apply(&s, 1 << P_B);
+	fail |= check("apply deps", ret == 3 && mem_is(1 << P_HOOK | 1 << P_CALL | 1 << P_A | 1 << P_B));
+
+	// taking out the hook takes out everything calling it, the first patch
+	// of the set and one without a known original included
+	ret = fwpatch_undo(&s, 1 << P_HOOK);
+	fail |= check("undo users", ret == 16 && mem_is(1 << P_A) && s.applied == (1 << P_A));
+
+	ret = fwpatch_undo(&s, (1 << P_N) - 1);
+	fail |= check("undo all", ret == 1 && mem_is(0) && s.applied == 0);
+
+	fail |= check("undo none", fwpatch_undo(&s, (1 << P_N) - 1) == 0 && mem_is(0));
+	fail |= check("bad mask", fwpatch_apply(&s, 1 << P_N) == -1 && mem_is(0));
+
+	ret = fwpatch_apply(&s, 1 << P_BIG);
+	fail |= check("apply big", ret == 200 && mem_is(1 << P_BIG));
+	fail |= check("undo big", fwpatch_undo(&s, 1 << P_BIG) == 200 && mem_is(0));
+
+	// not the firmware the call was made for
+	sim_mem[0xbaa4 / 4] ^= 1;
+	orig_mem[0xbaa4 / 4] ^= 1;
+	sim_writes = 0;
+	ret = fwpatch_apply(&s, 1 << P_CALL);
+	fail |= check("mismatch", ret == -3 && s.failed == P_CALL && sim_writes == 0 && mem_is(0));
+	sim_mem[0xbaa4 / 4] ^= 1;
+	orig_mem[0xbaa4 / 4] ^= 1;
+
+	// patched before a restart: found in place, but what it replaced is gone
+	fwpatch_apply(&s, 1 << P_A);
+	fwpatch_init(&s, set, P_N);
+	s.ops = &test_ops;
+	fail |= check("rescan", fwpatch_scan(&s, &in, &orig) == 0 && in == (1 << P_A) && s.applied == in);
+	sim_writes = 0;
+	fail |= check("no original", fwpatch_undo(&s, 1 << P_A) == -1 && s.failed == P_A && sim_writes == 0);
+
+	// the same without the scan, undo finds it in place and cannot either
+	fwpatch_init(&s, set, P_N);
+	s.ops = &test_ops;
+	fail |= check("fresh undo", fwpatch_undo(&s, (1 << P_N) - 1) == -1 && s.failed == P_A && sim_writes == 0 &&
+		s.applied == (1 << P_A) && mem_is(1 << P_A));
+	memcpy(sim_mem, orig_mem, sizeof(sim_mem));
+
+	printf("basic:    %s\n", fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+// every kind of write failure at every word of the transaction
+static int check_failures(void)
+{
+	static struct fwpatch_set_t s;
+	static const char *kinds[] = { "", "error", "drop", "wrong" };
+	uint32_t all = (1 << P_N) - 1, words = 0, n = 0;
+	int fail = 0, ret;
+
+	memcpy(sim_mem, orig_mem, sizeof(sim_mem));
+	sim_reset();
+	fwpatch_init(&s, set, P_N);
+	s.ops = &test_ops;
+	words = fwpatch_apply(&s, all);
+	fwpatch_undo(&s, all);
+
+	for (int kind = FAIL_ERROR; kind <= FAIL_WRONG; kind++) {
+		for (uint32_t at = 0; at < words; at++) {
+			char what[64];
+
+			sim_reset();
+			sim.kind = kind;
+			sim.write_at = at;
+			ret = fwpatch_apply(&s, all);
+			snprintf(what, sizeof(what), "apply %s at %u", kinds[kind], at);
+			fail |= check(what, ret == -4 && s.restored == at + 1 && mem_is(0) && s.applied == 0);
+			n++;
+
+			// the next attempt goes through, and so does taking it out
+			sim_reset();
+			if (fwpatch_apply(&s, all) != (int)words || !mem_is(all)) {
+				fail |= check("apply after", 0);
+				break;
+			}
+
+			sim.kind = kind;
+			sim.write_at = at;
+			ret = fwpatch_undo(&s, all);
+			snprintf(what, sizeof(what), "undo %s at %u", kinds[kind], at);
+			fail |= check(what, ret == -4 && mem_is(all) && s.applied == all);
+			sim_reset();
+			fail |= check("undo after", fwpatch_undo(&s, all) == (int)words && mem_is(0));
+			n++;
+		}
+	}
+
+	// the card stops taking writes altogether, nothing can be put back
+	sim_reset();
+	sim.kind = FAIL_ERROR;
+	sim.write_at = 5;
+	sim.sticky = 1;
+	ret = fwpatch_apply(&s, all);
+	fail |= check("stuck", ret == -5 && s.restored == 0 && s.applied == 0);
+	memcpy(sim_mem, orig_mem, sizeof(sim_mem));
+
+	// reads failing: retried, nothing written when they keep failing
+	sim_reset();
+	sim.read_pct = 2000;
+	ret = fwpatch_apply(&s, all);
+	fail |= check("flaky reads", (ret == (int)words && mem_is(all)) || (ret < 0 && mem_is(0)));
+	sim_reset();
+	if (s.applied) {
+		fwpatch_undo(&s, all);
+	}
+	sim.read_at = 0;
+	ret = fwpatch_apply(&s, all);
+	fail |= check("dead reads", ret == -2 && sim_writes == 0 && mem_is(0));
+
+	// firmware stores to a patched word after the bulk check
+	sim_reset();
+	race_addr = set[P_BIG].addr + 400;
+	ret = fwpatch_apply(&s, all);
+	orig_mem[(set[P_BIG].addr + 400) / 4] ^= 0x10000;
+	fail |= check("race", ret == -3 && sim_writes == 0 && mem_is(0) && s.applied == 0);
+	orig_mem[(set[P_BIG].addr + 400) / 4] ^= 0x10000;
+	memcpy(sim_mem, orig_mem, sizeof(sim_mem));
+
+	printf("failures: %s, %u transactions of %u words\n", fail ? "FAIL" : "ok", n, words);
+
+	return fail;
+}
+
+// random apply and undo with a write failing now and then, each call
+// leaves memory exactly as before it or exactly as asked
+static int check_random(uint32_t rounds)
+{
+	static struct fwpatch_set_t s;
+	uint32_t r, good = 0, bad = 0;
+	int fail = 0;
+
+	memcpy(sim_mem, orig_mem, sizeof(sim_mem));
+	sim_reset();
+	fwpatch_init(&s, set, P_N);
+	s.ops = &test_ops;
+
+	for (r = 0; r < rounds && !fail; r++) {
+		uint32_t mask = rng() & ((1 << P_N) - 1);
+		uint32_t before = s.applied;
+		int undo = rng() % 2, ret;
+
+		sim_reset();
+		if (rng() % 3 == 0) {
+			sim.kind = FAIL_ERROR + rng() % 3;
+			sim.write_at = rng() % 256;
+		}
+		ret = undo ? fwpatch_undo(&s, mask) : fwpatch_apply(&s, mask);
+
+		if (ret < 0) {
+			fail |= check("random kept", ret == -4 && mem_is(before) && s.applied == before);
+			bad++;
+		} else {
+			fail |= check("random done", mem_is(s.applied) && sim_unlocked_writes == 0 && sim_write_locks <= 1);
+			good++;
+		}
+	}
+
+	printf("random:   %s, %u done, %u rolled back\n", fail ? "FAIL" : "ok", good, bad);
+
+	return fail;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-n rounds] [-s seed] [-o dir]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *dir = "/tmp/fwpatchtest";
+	uint32_t rounds = 2000;
+	int opt, fail = 0;
+
+	while ((opt = getopt(argc, argv, "n:s:o:h")) != -1) {
+		switch (opt) {
+		case 'n': rounds = strtoul(optarg, NULL, 0); break;
+		case 's': rng_state = strtoul(optarg, NULL, 0) | 1; break;
+		case 'o': dir = optarg; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	mkdir(dir, 0755);
+	shim_init(dir);
+	shim_wlan_init();
+	shim_set_offset(sigs[SIG_MEM_READ].fixed, sim_mem_read);
+	shim_set_offset(sigs[SIG_MEM_WRITE].fixed, sim_mem_write);
+	shim_set_offset(sigs[SIG_LOCK].fixed, test_wlan_lock);
+	shim_set_offset(sigs[SIG_UNLOCK].fixed, test_wlan_unlock);
+
+	module_start(0, NULL);
+	if (kwifimon_mod_state() & 0x80000000) {
+		fprintf(stderr, "module_start failed, state %x\n", kwifimon_mod_state());
+		return 1;
+	}
+	netdev.priv = (struct wlan_dev_t *)dev;
+	hook_ioctl = (ioctl_hook_t)shim_hook(sigs[SIG_IOCTL].fixed);
+
+	set_build();
+
+	fail |= check_init();
+	fail |= check_basic();
+	fail |= check_failures();
+	fail |= check_random(rounds);
+
+	module_stop(0, NULL);
+
+	printf("%s\n", fail ? "FAIL" : "ok");
+
+	return fail ? 2 : 0;
+}
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fwsnapio.h"
+
+// .fws incremental firmware snapshots: a timeline of what changed between
+// snapshots, and full images of any snapshot rebuilt from its base and deltas
+
+struct range_ctx_t {
+	uint32_t shown;
+	uint32_t max;
+	uint32_t bytes;
+};
+
+static void range_print(void *ctx, uint32_t addr, uint32_t len)
+{
+	struct range_ctx_t *c = ctx;
+
+	c->bytes += len;
+	if (c->shown++ < c->max) {
+		printf("    %08x-%08x  %u\n", addr, addr + len, len);
+	}
+}
+
+static void range_count(void *ctx, uint32_t addr, uint32_t len)
+{
+	struct range_ctx_t *c = ctx;
+
+	c->bytes += len;
+}
+
+static int extract(const struct fwsnap_img_t *img, const char *dir)
+{
+	char name[512];
+	FILE *f;
+
+	snprintf(name, sizeof(name), "%s/snap-%u-%08x-%08x.bin", dir, img->seq, img->base, img->size);
+	if ((f = fopen(name, "wb")) == NULL || fwrite(img->cur, 1, img->size, f) != img->size || fclose(f) != 0) {
+		fprintf(stderr, "%s: write failed\n", name);
+		return -1;
+	}
+	printf("%s\n", name);
+
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-g gap] [-r ranges] [-b base] [-x seq | -a] [-o dir] in.fws\n", name);
+	fprintf(stderr, "  -g  merge changed ranges closer than this, bytes (16)\n");
+	fprintf(stderr, "  -r  ranges listed per snapshot (8), 0 for a summary line only\n");
+	fprintf(stderr, "  -b  only the segment at this base\n");
+	fprintf(stderr, "  -x  write the full image of snapshot seq, -a of every snapshot\n");
+	fprintf(stderr, "  -o  directory the images go to (.)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	static struct fwsnap_reader_t r;
+	struct fwsnap_img_t *img;
+	const char *dir = ".";
+	uint32_t gap = 16, max = 8, base = 0, seq = 0;
+	int has_base = 0, has_seq = 0, all = 0, fail = 0;
+	uint32_t t0 = 0, first = 1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "g:r:b:x:ao:h")) != -1) {
+		switch (opt) {
+		case 'g': gap = strtoul(optarg, NULL, 0); break;
+		case 'r': max = strtoul(optarg, NULL, 0); break;
+		case 'b': base = strtoul(optarg, NULL, 16); has_base = 1; break;
+		case 'x': seq = strtoul(optarg, NULL, 0); has_seq = 1; break;
+		case 'a': all = 1; break;
+		case 'o': dir = optarg; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	if (argc - optind != 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (fwsnap_reader_open(&r, argv[optind]) < 0) {
+		fprintf(stderr, "%s: cannot open\n", argv[optind]);
+		return 1;
+	}
+
+	while ((img = fwsnap_reader_next(&r)) != NULL) {
+		struct range_ctx_t c = { 0, max, 0 };
+		uint32_t n;
+
+		if (has_base && img->base != base) {
+			continue;
+		}
+
+		if (has_seq || all) {
+			if (all || img->seq == seq) {
+				fail |= (extract(img, dir) < 0);
+			}
+			continue;
+		}
+
+		if (first) {
+			t0 = img->time_ms;
+			first = 0;
+		}
+
+		n = fwsnap_ranges(img, gap, range_count, &c);
+		printf("%-10u %10.3f s  %08x  %-5s %5u pages of %-5u %6u ranges %8u bytes\n", img->seq,
+			(img->time_ms - t0) / 1e3, img->base, img->full ? "full" : "delta", img->pages, img->page, n, c.bytes);
+		if (max) {
+			c.bytes = 0;
+			fwsnap_ranges(img, gap, range_print, &c);
+			if (c.shown > c.max) {
+				printf("    ... %u more\n", c.shown - c.max);
+			}
+		}
+	}
+
+	if (r.dropped || r.bad) {
+		fprintf(stderr, "%u snapshots, %u dropped, %u damaged records, %llu bytes skipped\n",
+			r.snaps, r.dropped, r.bad, (unsigned long long)r.skipped);
+	}
+
+	fwsnap_reader_close(&r);
+
+	return fail ? 1 : (r.dropped || r.bad) ? 2 : 0;
+}
@@ -0,0 +1,276 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "kcap.h"
+
+#include "fwsnapio.h"
+
+int fwsnap_reader_open(struct fwsnap_reader_t *r, const char *file)
+{
+	memset(r, 0, sizeof(*r));
+
+	r->f = fopen(file, "rb");
+	if (r->f == NULL) {
+		return -1;
+	}
+
+	return 0;
+}
+
+void fwsnap_reader_close(struct fwsnap_reader_t *r)
+{
+	uint32_t i;
+
+	for (i = 0; i < r->nimg; i++) {
+		free(r->img[i].cur);
+		free(r->img[i].prev);
+		free(r->img[i].next);
+	}
+	r->nimg = 0;
+
+	if (r->f) {
+		fclose(r->f);
+		r->f = NULL;
+	}
+}
+
+// read at r->off, returns bytes read
+static size_t fwsnap_read(struct fwsnap_reader_t *r, void *buf, size_t len)
+{
+	if (fseeko(r->f, r->off, SEEK_SET) < 0) {
+		return 0;
+	}
+
+	return fread(buf, 1, len, r->f);
+}
+
+static struct fwsnap_img_t *fwsnap_img(struct fwsnap_reader_t *r, uint32_t base, uint32_t size)
+{
+	struct fwsnap_img_t *img;
+	uint32_t i;
+
+	for (i = 0; i < r->nimg; i++) {
+		if (r->img[i].base == base && r->img[i].size == size) {
+			return &r->img[i];
+		}
+	}
+
+	if (r->nimg == FWSNAP_SEGS_MAX || size > 0x10000000) {
+		return NULL;
+	}
+
+	img = &r->img[r->nimg];
+	memset(img, 0, sizeof(*img));
+	img->base = base;
+	img->size = size;
+	img->cur = calloc(1, size);
+	img->prev = calloc(1, size);
+	img->next = calloc(1, size);
+	if (img->cur == NULL || img->prev == NULL || img->next == NULL) {
+		free(img->cur);
+		free(img->prev);
+		free(img->next);
+		return NULL;
+	}
+	r->nimg++;
+
+	return img;
+}
+
+// the open snapshot a page or end record belongs to
+static struct fwsnap_img_t *fwsnap_open_img(struct fwsnap_reader_t *r, const struct fwsnap_rec_t *h)
+{
+	uint32_t i;
+
+	for (i = 0; i < r->nimg; i++) {
+		struct fwsnap_img_t *img = &r->img[i];
+
+		if (img->open && img->open_seq == h->seq && h->addr - img->base < img->size) {
+			return img;
+		}
+	}
+
+	return NULL;
+}
+
+static void fwsnap_begin(struct fwsnap_reader_t *r, const struct fwsnap_rec_t *h)
+{
+	struct fwsnap_img_t *img = fwsnap_img(r, h->addr, h->size);
+
+	if (img == NULL) {
+		r->dropped++;
+		return;
+	}
+
+	// the one before never ended
+	if (img->open) {
+		img->valid = 0;
+		r->dropped++;
+	}
+
+	img->open = 1;
+	img->open_seq = h->seq;
+	img->open_pages = 0;
+	img->open_rec = *h;
+	// a delta needs the snapshot right before it
+	img->open_ok = (h->flags & FWSNAP_FULL) || (img->valid && h->seq == img->seq + 1);
+
+	if (h->flags & FWSNAP_FULL) {
+		memset(img->next, 0, img->size);
+	} else {
+		memcpy(img->next, img->cur, img->size);
+	}
+}
+
+static void fwsnap_page(struct fwsnap_reader_t *r, const struct fwsnap_rec_t *h, int len)
+{
+	struct fwsnap_img_t *img = fwsnap_open_img(r, h);
+
+	if (img == NULL) {
+		return;
+	}
+
+	if (len != (int)h->size || h->addr - img->base > img->size - h->size) {
+		img->open_ok = 0;
+		return;
+	}
+
+	memcpy(img->next + (h->addr - img->base), r->raw, len);
+	img->open_pages++;
+}
+
+static struct fwsnap_img_t *fwsnap_end(struct fwsnap_reader_t *r, const struct fwsnap_rec_t *h)
+{
+	struct fwsnap_img_t *img = fwsnap_open_img(r, h);
+	uint8_t *t;
+
+	if (img == NULL) {
+		return NULL;
+	}
+
+	img->open = 0;
+	if (!img->open_ok || h->addr != img->base || h->size != img->open_pages) {
+		// what follows builds on this one
+		img->valid = 0;
+		r->dropped++;
+		return NULL;
+	}
+
+	t = img->prev;
+	img->prev = img->cur;
+	img->cur = img->next;
+	img->next = t;
+	img->valid = 1;
+	img->seq = h->seq;
+	img->time_ms = img->open_rec.time_ms;
+	img->page = img->open_rec.page;
+	img->pages = img->open_pages;
+	img->full = img->open_rec.flags & FWSNAP_FULL;
+	r->snaps++;
+
+	return img;
+}
+
+struct fwsnap_img_t *fwsnap_reader_next(struct fwsnap_reader_t *r)
+{
+	struct fwsnap_rec_t h;
+	uint64_t resync = 0;
+
+	while (1) {
+		size_t n = fwsnap_read(r, &h, sizeof(h));
+
+		if (n < sizeof(h)) {
+			r->skipped += resync;
+			return NULL;
+		}
+
+		if (fwsnap_rec_check(&h) < 0) {
+			// look for the next record one byte further
+			r->off++;
+			resync++;
+			continue;
+		}
+
+		if (resync) {
+			r->skipped += resync;
+			r->bad++;
+			resync = 0;
+		}
+
+		uint64_t at = r->off;
+
+		r->off += sizeof(h);
+		if (h.magic == FWSNAP_BEGIN_MAGIC) {
+			fwsnap_begin(r, &h);
+			continue;
+		}
+
+		if (h.magic == FWSNAP_END_MAGIC) {
+			struct fwsnap_img_t *img = fwsnap_end(r, &h);
+			if (img) {
+				return img;
+			}
+			continue;
+		}
+
+		int len = -1;
+
+		n = fwsnap_read(r, r->zbuf, h.len);
+		if (n == h.len) {
+			if (h.flags & FWSNAP_STORED) {
+				memcpy(r->raw, r->zbuf, h.len);
+				len = h.len;
+			} else {
+				len = lz4blk_decompress(r->zbuf, h.len, r->raw, h.size);
+			}
+		}
+
+		if (len != (int)h.size || kcap_sum(1, r->raw, len) != h.sum) {
+			// a write cut short leaves a good header and then the records
+			// appended after it, look for those right behind the header
+			fwsnap_page(r, &h, -1);
+			r->off = at + 1;
+			resync = 1;
+			continue;
+		}
+		r->off += h.len;
+
+		fwsnap_page(r, &h, len);
+	}
+}
+
+uint32_t fwsnap_ranges(const struct fwsnap_img_t *img, uint32_t gap,
+	void (*cb)(void *ctx, uint32_t addr, uint32_t len), void *ctx)
+{
+	uint32_t i = 0, start = 0, end = 0, n = 0;
+	int in = 0;
+
+	while (i < img->size) {
+		// eight bytes at a time while nothing differs, most of memory stays put
+		if ((i & 7) == 0 && i + 8 <= img->size && memcmp(&img->cur[i], &img->prev[i], 8) == 0) {
+			i += 8;
+			continue;
+		}
+		if (img->cur[i] != img->prev[i]) {
+			if (in && i - end <= gap) {
+				end = i + 1;
+			} else {
+				if (in) {
+					cb(ctx, img->base + start, end - start);
+					n++;
+				}
+				start = i;
+				end = i + 1;
+				in = 1;
+			}
+		}
+		i++;
+	}
+
+	if (in) {
+		cb(ctx, img->base + start, end - start);
+		n++;
+	}
+
+	return n;
+}
@@ -0,0 +1,60 @@
+#ifndef FWSNAPIO_h_
+#define FWSNAPIO_h_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "fwsnap.h"
+
+// sequential .fws reader, keeps an image per segment and applies each
+// snapshot to it once the end record is in, a full snapshot or a delta
+// following the one applied last, anything else is dropped and the
+// segment waits for its next full snapshot
+// damaged records are skipped by scanning for the next valid one
+
+#define FWSNAP_SEGS_MAX 16
+
+struct fwsnap_img_t {
+	uint32_t base;
+	uint32_t size;
+	uint8_t *cur;            // as of the snapshot applied last
+	uint8_t *prev;           // before it, zero before the first
+	int valid;               // cur holds a snapshot
+	uint32_t seq;            // of cur
+	uint32_t time_ms;
+	uint32_t page;
+	uint32_t pages;          // pages cur got from its snapshot
+	int full;
+	// snapshot being read
+	uint8_t *next;
+	int open;
+	uint32_t open_seq;
+	uint32_t open_pages;
+	int open_ok;             // nothing lost yet
+	struct fwsnap_rec_t open_rec;
+};
+
+struct fwsnap_reader_t {
+	FILE *f;
+	uint64_t off;
+	uint32_t nimg;
+	struct fwsnap_img_t img[FWSNAP_SEGS_MAX];
+	uint32_t snaps;          // applied
+	uint32_t dropped;        // incomplete or without a base
+	uint32_t bad;            // records failing the checksum or not decoding
+	uint64_t skipped;        // bytes skipped while resyncing
+	uint8_t zbuf[LZ4BLK_BOUND(FWSNAP_PAGE_MAX)];
+	uint8_t raw[FWSNAP_PAGE_MAX];
+};
+
+int fwsnap_reader_open(struct fwsnap_reader_t *r, const char *file);
+void fwsnap_reader_close(struct fwsnap_reader_t *r);
+// segment image a snapshot was just applied to, NULL at the end
+struct fwsnap_img_t *fwsnap_reader_next(struct fwsnap_reader_t *r);
+
+// byte ranges differing between prev and cur, ranges closer than gap are
+// merged, returns how many there were
+uint32_t fwsnap_ranges(const struct fwsnap_img_t *img, uint32_t gap,
+	void (*cb)(void *ctx, uint32_t addr, uint32_t len), void *ctx);
+
+#endif
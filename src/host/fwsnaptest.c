@@ -0,0 +1,524 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <vitasdkkern.h>
+
+#include "kwifimon_export.h"
+#include "wlan_kernel.h"
+#include "sigs.h"
+#include "fwsnap.h"
+#include "fwdump.h"
+
+#include "shim.h"
+#include "fwsnapio.h"
+#include "test.h"
+
+// incremental snapshots of simulated firmware memory through the delta
+// ioctl of the hook while the memory changes between them, with reads
+// failing, writes cut off and files damaged afterwards
+// every snapshot read back has to be the memory as it was taken, deltas
+// have to hold exactly the pages that changed
+// with -b it measures instead what a snapshot costs per page size: ioctls,
+// bytes across the ioctl and into the file, next to a full dump
+
+int module_start(SceSize argc, const void *args);
+int module_stop(SceSize argc, const void *args);
+
+struct sim_seg_t {
+	uint32_t base;
+	uint32_t size;
+	uint32_t *mem;
+};
+
+// ram and tcm, what the snapshots are for
+static struct sim_seg_t sim_segs[] = {
+	{ 0xc0000000, 0x00040000 },
+	{ 0x04000000, 0x00010000 },
+};
+
+#define SIM_SEGS (sizeof(sim_segs) / sizeof(sim_segs[0]))
+
+static uint32_t sim_fail_pct;        // per word, in 1/10000
+static uint64_t sim_reads;
+
+static int sim_mem_read(struct wlan_dev_t *dev, uint32_t addr, uint32_t *value)
+{
+	uint32_t i;
+
+	if (sim_fail_pct && rng() % 10000 < sim_fail_pct) {
+		return -1;
+	}
+
+	for (i = 0; i < SIM_SEGS; i++) {
+		if (addr - sim_segs[i].base < sim_segs[i].size) {
+			*value = sim_segs[i].mem[(addr - sim_segs[i].base) / 4];
+			sim_reads++;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+static int sim_mem_write(struct wlan_dev_t *dev, uint32_t addr, uint32_t value)
+{
+	return -1;
+}
+
+static void sim_fill(struct sim_seg_t *s)
+{
+	uint32_t i, w = 0;
+
+	s->mem = malloc(s->size);
+	for (i = 0; i < s->size / 4; i++) {
+		if (i % 1024 == 0) {
+			w = rng() % 4;
+		}
+		switch (w) {
+		case 0: s->mem[i] = 0; break;
+		case 1: s->mem[i] = 0x4b000000 | ((i * 7) & 0xffff); break;
+		case 2: s->mem[i] = (i & 15) ? s->mem[i - 1] + 4 : rng(); break;
+		default: s->mem[i] = rng(); break;
+		}
+	}
+}
+
+// what firmware does between snapshots: counters ticking, scattered
+// stores, a buffer refilled now and then, rarely a large block
+static void sim_mutate(struct sim_seg_t *s)
+{
+	uint32_t words = s->size / 4;
+	uint32_t i, n, at;
+
+	for (i = 0; i < 32; i++) {
+		s->mem[(i * 2654435761u) % words]++;
+	}
+
+	n = rng() % 20;
+	for (i = 0; i < n; i++) {
+		s->mem[rng() % words] = rng();
+	}
+
+	if (rng() % 2) {
+		n = 16 + rng() % 512;
+		at = rng() % (words - n);
+		for (i = 0; i < n; i++) {
+			s->mem[at + i] = rng();
+		}
+	}
+
+	if (rng() % 10 == 0) {
+		n = 4096;
+		at = rng() % (words - n);
+		memset(&s->mem[at], rng(), 4 * n);
+	}
+}
+
+// the app side: delta ioctl into the hook, appending file that can fail
+
+struct test_ctx_t {
+	int fd;
+	ioctl_hook_t ioctl;
+	int32_t writes_left;     // < 0 no limit
+};
+
+static struct netdev_t netdev;
+static uint8_t dev[sizeof(struct wlan_dev_t)];
+
+static int test_delta(void *ctx, struct wifimon_mem_delta_t *req, uint32_t len)
+{
+	struct test_ctx_t *t = ctx;
+
+	return t->ioctl(&netdev, WLAN_IOCTL_MEM_DELTA, (uint8_t *)req, len);
+}
+
+// power loss: the last write makes it part way
+static int test_write(void *ctx, const void *buf, uint32_t len)
+{
+	struct test_ctx_t *t = ctx;
+
+	if (t->writes_left == 0) {
+		if (write(t->fd, buf, rng() % len) < 0) {
+			return -1;
+		}
+		t->writes_left = -1;
+		return -1;
+	}
+	if (t->writes_left > 0) {
+		t->writes_left--;
+	}
+
+	return write(t->fd, buf, len);
+}
+
+static const struct fwsnap_ops_t test_ops = {
+	.delta = test_delta,
+	.write = test_write,
+};
+
+// full dumps for comparison
+static uint32_t bulk_ioctls;
+
+static int bulk_read(void *ctx, uint32_t addr, uint32_t *buf, uint32_t words)
+{
+	static uint8_t request[sizeof(struct wifimon_mem_bulk_t) + 4 * WIFIMON_MEM_BULK_MAX];
+	struct test_ctx_t *t = ctx;
+	struct wifimon_mem_bulk_t b = { addr, words };
+
+	memcpy(request, &b, sizeof(b));
+	bulk_ioctls++;
+
+	int ret = t->ioctl(&netdev, WLAN_IOCTL_MEM_BULK, request, sizeof(b) + 4 * words);
+	if (ret > 0) {
+		memcpy(buf, &request[sizeof(b)], 4 * ret);
+	}
+
+	return ret;
+}
+
+static int bulk_pread(void *ctx, void *buf, uint32_t len, uint32_t off)
+{
+	return pread(((struct test_ctx_t *)ctx)->fd, buf, len, off);
+}
+
+static int bulk_pwrite(void *ctx, const void *buf, uint32_t len, uint32_t off)
+{
+	return pwrite(((struct test_ctx_t *)ctx)->fd, buf, len, off);
+}
+
+static const struct fwdump_ops_t dump_ops = {
+	.read = bulk_read,
+	.pread = bulk_pread,
+	.pwrite = bulk_pwrite,
+};
+
+// memory as each snapshot took it
+struct expect_t {
+	uint32_t base;
+	uint32_t seq;
+	uint8_t *mem;
+};
+
+static struct expect_t *expect;
+static uint32_t nexpect;
+
+static const struct expect_t *expect_find(uint32_t base, uint32_t seq)
+{
+	uint32_t i;
+
+	for (i = 0; i < nexpect; i++) {
+		if (expect[i].base == base && expect[i].seq == seq) {
+			return &expect[i];
+		}
+	}
+
+	return NULL;
+}
+
+static uint32_t pages_differing(const uint8_t *a, const uint8_t *b, uint32_t size, uint32_t page)
+{
+	uint32_t i, n = 0;
+
+	for (i = 0; i < size; i += page) {
+		n += memcmp(a + i, b + i, page) != 0;
+	}
+
+	return n;
+}
+
+static void range_sum(void *ctx, uint32_t addr, uint32_t len)
+{
+	*(uint32_t *)ctx += len;
+}
+
+static uint32_t bytes_differing(const uint8_t *a, const uint8_t *b, uint32_t size)
+{
+	uint32_t i, n = 0;
+
+	for (i = 0; i < size; i++) {
+		n += a[i] != b[i];
+	}
+
+	return n;
+}
+
+// every snapshot read back is exact, returns how many there were or < 0
+static int verify(const char *file)
+{
+	static struct fwsnap_reader_t r;
+	struct fwsnap_img_t *img;
+	int n = 0, fail = 0;
+
+	if (fwsnap_reader_open(&r, file) < 0) {
+		return -1;
+	}
+
+	while ((img = fwsnap_reader_next(&r)) != NULL) {
+		const struct expect_t *e = expect_find(img->base, img->seq);
+		const struct expect_t *p = expect_find(img->base, img->seq - 1);
+
+		if (e == NULL || memcmp(e->mem, img->cur, img->size) != 0) {
+			fprintf(stderr, "%s: snapshot %u of %08x %s\n", file, img->seq, img->base, e ? "differs" : "was never taken");
+			fail = 1;
+			continue;
+		}
+
+		// changed ranges against the snapshot before, when that was applied
+		if (p && memcmp(p->mem, img->prev, img->size) == 0) {
+			uint32_t sum = 0;
+
+			fwsnap_ranges(img, 0, range_sum, &sum);
+			if (sum != bytes_differing(p->mem, e->mem, img->size)) {
+				fprintf(stderr, "%s: snapshot %u of %08x ranges cover %u bytes\n", file, img->seq, img->base, sum);
+				fail = 1;
+			}
+		}
+		n++;
+	}
+
+	fwsnap_reader_close(&r);
+
+	return fail ? -1 : n;
+}
+
+static int check_snapshots(const char *dir, uint32_t rounds)
+{
+	static struct fwsnap_t snap[SIM_SEGS];
+	struct test_ctx_t t;
+	uint8_t *last[SIM_SEGS];
+	char file[256];
+	uint32_t r, i, taken = 0, failed = 0, deltas = 0;
+	int fail = 0, n;
+
+	snprintf(file, sizeof(file), "%s/snap.fws", dir);
+	t.fd = open(file, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	t.ioctl = (ioctl_hook_t)shim_hook(sigs[SIG_IOCTL].fixed);
+	t.writes_left = -1;
+
+	expect = calloc(rounds * SIM_SEGS, sizeof(*expect));
+	nexpect = 0;
+
+	for (i = 0; i < SIM_SEGS; i++) {
+		fwsnap_init(&snap[i], sim_segs[i].base, sim_segs[i].size, 256, 1000);
+		snap[i].ops = &test_ops;
+		snap[i].ctx = &t;
+		snap[i].full_every = 8;
+		last[i] = malloc(sim_segs[i].size);
+	}
+
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < SIM_SEGS; i++) {
+			struct sim_seg_t *s = &sim_segs[i];
+			uint32_t seq = snap[i].seq;
+			int delta = !snap[i].full && snap[i].since_full + 1 < snap[i].full_every;
+			int ret;
+
+			sim_mutate(s);
+			sim_fail_pct = (rng() % 8 == 0) ? 20 : 0;
+			if (rng() % 10 == 0) {
+				t.writes_left = rng() % 16;
+			}
+
+			ret = fwsnap_take(&snap[i], r * 100);
+			sim_fail_pct = 0;
+			t.writes_left = -1;
+
+			if (ret < 0) {
+				failed++;
+				continue;
+			}
+
+			// a delta holds exactly the pages that changed since the last one
+			if (delta && (uint32_t)ret != pages_differing(last[i], (uint8_t *)s->mem, s->size, 256)) {
+				fprintf(stderr, "snapshot %u of %08x: %d pages, %u changed\n", seq, s->base, ret,
+					pages_differing(last[i], (uint8_t *)s->mem, s->size, 256));
+				fail = 1;
+			}
+			deltas += delta;
+
+			expect[nexpect].base = s->base;
+			expect[nexpect].seq = seq;
+			expect[nexpect].mem = malloc(s->size);
+			memcpy(expect[nexpect].mem, s->mem, s->size);
+			memcpy(last[i], s->mem, s->size);
+			nexpect++;
+			taken++;
+		}
+	}
+	close(t.fd);
+
+	n = verify(file);
+	if (n != (int)taken) {
+		fprintf(stderr, "%s: %d snapshots read back of %u taken\n", file, n, taken);
+		fail = 1;
+	}
+	printf("snap:    %u taken (%u deltas), %u failed part way\n", taken, deltas, failed);
+
+	// damage never gives a wrong image, at most fewer of them
+	for (r = 0; r < 10 && !fail; r++) {
+		struct stat st;
+		char bad[300];
+		FILE *f, *g;
+		int c;
+
+		snprintf(bad, sizeof(bad), "%s/damaged.fws", dir);
+		f = fopen(file, "rb");
+		g = fopen(bad, "wb");
+		while ((c = fgetc(f)) != EOF) {
+			fputc(c, g);
+		}
+		fclose(f);
+		fclose(g);
+
+		stat(bad, &st);
+		int fd = open(bad, O_RDWR);
+		for (i = 0; i < 1 + r; i++) {
+			uint8_t b;
+			off_t off = rng() % st.st_size;
+
+			pread(fd, &b, 1, off);
+			b ^= 1 << (rng() % 8);
+			pwrite(fd, &b, 1, off);
+		}
+		close(fd);
+
+		n = verify(bad);
+		if (n < 0 || n > (int)taken) {
+			fprintf(stderr, "%s: %d snapshots with %u flipped bits\n", bad, n, r + 1);
+			fail = 1;
+		}
+	}
+	printf("damage:  %s\n", fail ? "FAIL" : "ok");
+
+	for (i = 0; i < nexpect; i++) {
+		free(expect[i].mem);
+	}
+	free(expect);
+	for (i = 0; i < SIM_SEGS; i++) {
+		free(last[i]);
+	}
+
+	return fail;
+}
+
+// cost of a delta snapshot of the ram per page size, against a full dump
+static int bench(const char *dir, uint32_t rounds)
+{
+	static struct fwsnap_t snap;
+	static struct fwdump_t dumpst;
+	struct sim_seg_t *s = &sim_segs[0];
+	struct test_ctx_t t;
+	char file[256];
+	uint32_t page, r, seed = rng_state;
+	uint32_t *orig = malloc(s->size);
+	uint64_t reads;
+
+	memcpy(orig, s->mem, s->size);
+	snprintf(file, sizeof(file), "%s/bench.fws", dir);
+	t.ioctl = (ioctl_hook_t)shim_hook(sigs[SIG_IOCTL].fixed);
+	t.writes_left = -1;
+
+	printf("%u deltas of %08x/%x, per snapshot\n", rounds, s->base, s->size);
+	printf("page   pages  ioctls  ioctl KiB  file KiB  words read\n");
+
+	for (page = FWSNAP_PAGE_MIN; page <= FWSNAP_PAGE_MAX; page *= 2) {
+		uint64_t pages = 0, ioctls = 0, bytes = 0, out = 0;
+
+		memcpy(s->mem, orig, s->size);
+		rng_state = seed;
+		t.fd = open(file, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+		fwsnap_init(&snap, s->base, s->size, page, 0);
+		snap.ops = &test_ops;
+		snap.ctx = &t;
+		fwsnap_take(&snap, 0);
+
+		reads = sim_reads;
+		for (r = 0; r < rounds; r++) {
+			sim_mutate(s);
+			fwsnap_take(&snap, r);
+			pages += snap.changed;
+			ioctls += snap.ioctls;
+			bytes += snap.ioctl_bytes;
+			out += snap.out;
+		}
+		reads = sim_reads - reads;
+		close(t.fd);
+
+		printf("%-6u %-6.1f %-7.1f %-10.1f %-9.1f %.0f\n", page, (double)pages / rounds, (double)ioctls / rounds,
+			bytes / 1024.0 / rounds, out / 1024.0 / rounds, (double)reads / rounds);
+	}
+
+	// the same memory dumped whole, one bulk ioctl per chunk
+	snprintf(file, sizeof(file), "%s/bench.fwd", dir);
+	t.fd = open(file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	dumpst.ops = &dump_ops;
+	dumpst.ctx = &t;
+	reads = sim_reads;
+	bulk_ioctls = 0;
+	fwdump_segment(&dumpst, s->base, s->size, 1);
+	close(t.fd);
+	printf("dump   -      %-7u %-10.1f %-9.1f %llu\n", bulk_ioctls,
+		(bulk_ioctls * sizeof(struct wifimon_mem_bulk_t) + s->size) / 1024.0, dumpst.out / 1024.0,
+		(unsigned long long)(sim_reads - reads));
+
+	free(orig);
+
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-b] [-n rounds] [-s seed] [-o dir]\n", name);
+	fprintf(stderr, "  -b  page size against snapshot cost instead of the checks\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *dir = "/tmp/fwsnaptest";
+	uint32_t rounds = 100, i;
+	int opt, fail = 0, do_bench = 0;
+
+	while ((opt = getopt(argc, argv, "bn:s:o:h")) != -1) {
+		switch (opt) {
+		case 'b': do_bench = 1; break;
+		case 'n': rounds = strtoul(optarg, NULL, 0); break;
+		case 's': rng_state = strtoul(optarg, NULL, 0) | 1; break;
+		case 'o': dir = optarg; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	mkdir(dir, 0755);
+	shim_init(dir);
+	shim_wlan_init();
+	shim_set_offset(sigs[SIG_MEM_READ].fixed, sim_mem_read);
+	shim_set_offset(sigs[SIG_MEM_WRITE].fixed, sim_mem_write);
+
+	module_start(0, NULL);
+	if (kwifimon_mod_state() & 0x80000000) {
+		fprintf(stderr, "module_start failed, state %x\n", kwifimon_mod_state());
+		return 1;
+	}
+	netdev.priv = (struct wlan_dev_t *)dev;
+
+	for (i = 0; i < SIM_SEGS; i++) {
+		sim_fill(&sim_segs[i]);
+	}
+
+	if (do_bench) {
+		return bench(dir, rounds);
+	}
+
+	fail |= check_snapshots(dir, rounds);
+
+	module_stop(0, NULL);
+
+	printf("%s\n", fail ? "FAIL" : "ok");
+
+	return fail ? 2 : 0;
+}
@@ -0,0 +1,1356 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fwsym.h"
+
+// marks of a halfword of an executable segment
+#define M_INSN     0x0001   // a thumb instruction starts here
+#define M_DATA     0x0002   // literal pool or jump table
+#define M_TABLE    0x0004
+#define M_PUSH     0x0008
+#define M_BL       0x0010   // thumb bl target
+#define M_BLX      0x0020   // arm function start
+#define M_PTR      0x0040
+#define M_AFTER    0x0080
+#define M_CALLERS  0x0100
+#define M_START    0x0200
+#define M_ARM      0x0400   // inside an arm function
+#define M_STMFD    0x0800
+
+#define FWSYM_ARM_MAX  0x10000   // longest arm function
+
+// a bl, blx or arm bl
+enum {
+	BL_THUMB,
+	BL_THUMB_BLX,
+	BL_ARM,
+	BL_ARM_BLX,
+	BL_DROPPED,              // thumb decoded out of arm code
+};
+
+struct fwsym_bl_t {
+	uint32_t site;
+	uint32_t target;
+	uint32_t kind;
+};
+
+// a case of a switch
+struct fwsym_obs_t {
+	uint32_t func;
+	uint32_t reg;
+	uint32_t value;
+	uint32_t target;
+	uint32_t site;
+};
+
+struct fwsym_pair_t {
+	uint32_t target;
+	uint32_t from;
+};
+
+struct fwsym_work_t {
+	const struct fwsym_t *f;
+	struct fwsym_region_t *r;
+	const struct fwsym_seg_t *seg[FWSYM_SEGS_MAX];
+	uint16_t *mark[FWSYM_SEGS_MAX];      // NULL where not executable
+	struct fwsym_bl_t *bl;
+	uint32_t nbl, nbl_alloc;
+	struct fwsym_obs_t *obs;
+	uint32_t nobs, nobs_alloc;
+	uint32_t *ptr;
+	uint32_t nptr, nptr_alloc;
+	uint32_t nfunc_alloc, ncall_alloc, ndata_alloc;
+};
+
+static uint16_t le16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t le32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static int fwsym_grow(void **p, uint32_t n, uint32_t *alloc, size_t size)
+{
+	if (n == *alloc) {
+		uint32_t k = *alloc ? *alloc * 2 : 256;
+		void *q = realloc(*p, size * k);
+
+		if (q == NULL) {
+			return -1;
+		}
+		*p = q;
+		*alloc = k;
+	}
+
+	return 0;
+}
+
+void fwsym_init(struct fwsym_t *f)
+{
+	memset(f, 0, sizeof(*f));
+	f->fd = -1;
+	f->dispatch = -1;
+}
+
+static void fwsym_clear(struct fwsym_t *f)
+{
+	for (uint32_t i = 0; i < f->nregion; i++) {
+		struct fwsym_region_t *r = &f->region[i];
+
+		free(r->func);
+		free(r->call);
+		free(r->data);
+		r->func = NULL;
+		r->call = NULL;
+		r->data = NULL;
+		r->nfunc = r->ncall = r->ndata = 0;
+		r->long_branches = r->stray = 0;
+		r->dispatch = -1;
+		r->reg = r->matched = r->ncase = 0;
+		r->ms = 0;
+		r->error = 0;
+	}
+	f->dispatch = -1;
+}
+
+void fwsym_free(struct fwsym_t *f)
+{
+	fwsym_clear(f);
+	if (f->fd >= 0) {
+		if (f->map) {
+			munmap((void *)f->map, f->size);
+		}
+		close(f->fd);
+	}
+	fwsym_init(f);
+}
+
+static int fwsym_cmd_cmp(const void *a, const void *b)
+{
+	const struct fwsym_cmd_t *x = a, *y = b;
+
+	return (x->id > y->id) - (x->id < y->id);
+}
+
+int fwsym_cmds(struct fwsym_t *f, const char *path)
+{
+	char line[256], name[FWSYM_NAME];
+	uint32_t n = 0, id, i;
+	FILE *fp = fopen(path, "r");
+
+	if (fp == NULL) {
+		return -2;
+	}
+	while (fgets(line, sizeof(line), fp) && n < FWSYM_CMDS_MAX) {
+		if (sscanf(line, " #define HostCmd_CMD_%39s %x", name, &id) != 2 || strcmp(name, "ID_MASK") == 0) {
+			continue;
+		}
+		f->cmd[n].id = id;
+		snprintf(f->cmd[n].name, sizeof(f->cmd[n].name), "%s", name);
+		n++;
+	}
+	fclose(fp);
+
+	// sorted for fwsym_cmd_name, the first of an id kept
+	qsort(f->cmd, n, sizeof(f->cmd[0]), fwsym_cmd_cmp);
+	for (f->ncmd = 0, i = 0; i < n; i++) {
+		if (f->ncmd == 0 || f->cmd[f->ncmd - 1].id != f->cmd[i].id) {
+			f->cmd[f->ncmd++] = f->cmd[i];
+		}
+	}
+
+	return f->ncmd;
+}
+
+const char *fwsym_cmd_name(const struct fwsym_t *f, uint32_t id)
+{
+	struct fwsym_cmd_t key = { .id = id };
+	const struct fwsym_cmd_t *c = bsearch(&key, f->cmd, f->ncmd, sizeof(key), fwsym_cmd_cmp);
+
+	return c ? c->name : NULL;
+}
+
+int fwsym_add(struct fwsym_t *f, uint32_t vaddr, const void *data, uint32_t size, uint32_t pf)
+{
+	uint32_t base = vaddr & FWSYM_REGION_MASK, i, k;
+	struct fwsym_region_t *r = NULL;
+
+	// nothing may run over into the next region
+	if (size == 0 || f->nseg == FWSYM_SEGS_MAX || ((vaddr + size - 1) & FWSYM_REGION_MASK) != base) {
+		return -1;
+	}
+	for (i = 0; i < f->nregion; i++) {
+		if (f->region[i].base == base) {
+			r = &f->region[i];
+		}
+	}
+	if (r == NULL) {
+		if (f->nregion == FWSYM_REGIONS_MAX) {
+			return -1;
+		}
+		// regions in address order
+		for (i = f->nregion; i > 0 && f->region[i - 1].base > base; i--) {
+			f->region[i] = f->region[i - 1];
+		}
+		r = &f->region[i];
+		memset(r, 0, sizeof(*r));
+		r->base = base;
+		r->dispatch = -1;
+		f->nregion++;
+		if (f->dispatch >= (int32_t)i) {
+			f->dispatch++;
+		}
+	}
+
+	f->seg[f->nseg].vaddr = vaddr;
+	f->seg[f->nseg].size = size;
+	f->seg[f->nseg].data = data;
+	f->seg[f->nseg].pf = pf;
+
+	// segments of the region in address order
+	for (k = r->nseg; k > 0 && f->seg[r->seg[k - 1]].vaddr > vaddr; k--) {
+		r->seg[k] = r->seg[k - 1];
+	}
+	r->seg[k] = f->nseg;
+	r->nseg++;
+
+	return f->nseg++;
+}
+
+int fwsym_open(struct fwsym_t *f, const char *path)
+{
+	const Elf32_Ehdr *eh;
+	const Elf32_Phdr *ph;
+	struct stat st;
+	void *map;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0) {
+		return -2;
+	}
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return -2;
+	}
+	if (st.st_size < (off_t)sizeof(*eh)) {
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		close(fd);
+		return -2;
+	}
+	f->fd = fd;
+	f->map = map;
+	f->size = st.st_size;
+
+	eh = map;
+	if (memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 || eh->e_ident[EI_CLASS] != ELFCLASS32 ||
+		eh->e_ident[EI_DATA] != ELFDATA2LSB || eh->e_machine != EM_ARM ||
+		eh->e_phentsize != sizeof(*ph) || eh->e_phoff + (uint64_t)eh->e_phnum * sizeof(*ph) > f->size) {
+		return -1;
+	}
+
+	ph = (const Elf32_Phdr *)(f->map + eh->e_phoff);
+	for (uint32_t i = 0; i < eh->e_phnum; i++) {
+		if (ph[i].p_type != PT_LOAD || ph[i].p_filesz == 0) {
+			continue;
+		}
+		if (ph[i].p_offset + (uint64_t)ph[i].p_filesz > f->size ||
+			fwsym_add(f, ph[i].p_vaddr, f->map + ph[i].p_offset, ph[i].p_filesz, ph[i].p_flags) < 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int fwsym_seg_of(const struct fwsym_work_t *w, uint32_t addr)
+{
+	for (uint32_t i = 0; i < w->r->nseg; i++) {
+		if (addr - w->seg[i]->vaddr < w->seg[i]->size) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+// mark of the halfword at addr, NULL where it is no code
+static uint16_t *fwsym_mark(const struct fwsym_work_t *w, uint32_t addr)
+{
+	int s = fwsym_seg_of(w, addr);
+
+	if (s < 0 || w->mark[s] == NULL) {
+		return NULL;
+	}
+
+	return &w->mark[s][(addr - w->seg[s]->vaddr) / 2];
+}
+
+static int fwsym_bl_add(struct fwsym_work_t *w, uint32_t site, uint32_t target, uint32_t kind)
+{
+	if (fwsym_grow((void **)&w->bl, w->nbl, &w->nbl_alloc, sizeof(*w->bl)) < 0) {
+		return -1;
+	}
+	w->bl[w->nbl].site = site;
+	w->bl[w->nbl].target = target;
+	w->bl[w->nbl].kind = kind;
+	w->nbl++;
+
+	return 0;
+}
+
+static int fwsym_obs_add(struct fwsym_work_t *w, uint32_t site, uint32_t reg, uint32_t value, uint32_t target)
+{
+	if (fwsym_grow((void **)&w->obs, w->nobs, &w->nobs_alloc, sizeof(*w->obs)) < 0) {
+		return -1;
+	}
+	w->obs[w->nobs].func = 0;
+	w->obs[w->nobs].reg = reg;
+	w->obs[w->nobs].value = value;
+	w->obs[w->nobs].target = target;
+	w->obs[w->nobs].site = site;
+	w->nobs++;
+
+	return 0;
+}
+
+static int fwsym_ptr_add(struct fwsym_work_t *w, uint32_t v)
+{
+	if (fwsym_grow((void **)&w->ptr, w->nptr, &w->nptr_alloc, sizeof(*w->ptr)) < 0) {
+		return -1;
+	}
+	w->ptr[w->nptr++] = v;
+
+	return 0;
+}
+
+// cmp then beq goes to the case, cmp then bne falls through to it
+static int fwsym_cmp(struct fwsym_work_t *w, uint32_t a, uint16_t hw2, uint32_t reg, uint32_t value)
+{
+	if ((hw2 & 0xff00) == 0xd000) {
+		return fwsym_obs_add(w, a, reg, value, a + 6 + (int8_t)(hw2 & 0xff) * 2);
+	}
+	if ((hw2 & 0xff00) == 0xd100) {
+		return fwsym_obs_add(w, a, reg, value, a + 4);
+	}
+
+	return 0;
+}
+
+// the halfword table of an rvct switch, i is its lsls
+//   subs rn, #k         optional, the first case
+//   cmp rn, #n
+//   bhs default         or bhi, n + 1 cases
+//   lsls rn, rn, #1
+//   add rn, pc
+//   ldrh rn, [rn, #imm]
+//   lsls rn, rn, #1
+//   add pc, rn
+// the table is imm past the pc of add rn, pc, a case is at twice its entry
+// past the pc of add pc, rn
+static int fwsym_table(struct fwsym_work_t *w, uint32_t s, uint32_t i)
+{
+	const struct fwsym_seg_t *g = w->seg[s];
+	uint16_t *m = w->mark[s];
+	uint32_t n = g->size / 2, a = g->vaddr + i * 2, reg, cnt, k = 0, t, j;
+	uint16_t hw = le16(g->data + i * 2), br, cmp, ld;
+
+	reg = hw & 7;
+	if (i < 2 || i + 5 > n || ((hw >> 3) & 7) != reg || !(m[i - 1] & M_INSN) || !(m[i - 2] & M_INSN)) {
+		return 0;
+	}
+	ld = le16(g->data + i * 2 + 4);
+	if (le16(g->data + i * 2 + 2) != (0x4478 | reg) || (ld & 0xf83f) != (0x8800 | reg << 3 | reg) ||
+		le16(g->data + i * 2 + 6) != hw || le16(g->data + i * 2 + 8) != (0x4487 | reg << 3)) {
+		return 0;
+	}
+	br = le16(g->data + i * 2 - 2) & 0xff00;
+	cmp = le16(g->data + i * 2 - 4);
+	if ((cmp & 0xff00) != (0x2800 | reg << 8) || (br != 0xd200 && br != 0xd800)) {
+		return 0;
+	}
+	cnt = (cmp & 0xff) + (br == 0xd800);
+	if (i >= 3 && (m[i - 3] & M_INSN) && (le16(g->data + i * 2 - 6) & 0xff00) == (0x3800 | reg << 8)) {
+		k = le16(g->data + i * 2 - 6) & 0xff;
+	}
+
+	t = a + 6 + ((ld >> 6) & 0x1f) * 2;
+	if (t < a + 10 || t - g->vaddr + cnt * 2 > g->size) {
+		return 0;
+	}
+	for (j = 0; j < cnt; j++) {
+		uint32_t e = (t - g->vaddr) / 2 + j;
+
+		m[e] |= M_DATA | M_TABLE;
+		if (fwsym_obs_add(w, a, reg, k + j, a + 12 + le16(g->data + e * 2) * 2) < 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+// thumb from the start of the segment to its end, where pools and tables
+// are marked before the sweep gets there
+static int fwsym_sweep(struct fwsym_work_t *w, uint32_t s)
+{
+	const struct fwsym_seg_t *g = w->seg[s];
+	const uint8_t *d = g->data;
+	uint16_t *m = w->mark[s];
+	uint32_t n = g->size / 2, i = 0, lit[8], lit_at[8];
+	int ret = 0;
+
+	// the last pc relative load of r0-r7, for cmp rn, rm
+	memset(lit_at, 0xff, sizeof(lit_at));
+
+	while (i < n && ret == 0) {
+		uint32_t a = g->vaddr + i * 2;
+		uint16_t hw = le16(d + i * 2), hw2 = (i + 1 < n) ? le16(d + i * 2 + 2) : 0;
+
+		if (m[i] & M_DATA) {
+			i++;
+			continue;
+		}
+		m[i] |= M_INSN;
+
+		if ((hw >> 11) == 0x1e && i + 1 < n && ((hw2 >> 11) == 0x1f || (hw2 >> 11) == 0x1d)) {
+			int32_t off = ((hw & 0x7ff) << 12) | ((hw2 & 0x7ff) << 1);
+			uint32_t target = a + 4 + ((int32_t)((uint32_t)off << 9) >> 9);
+
+			if ((hw2 >> 11) == 0x1f) {
+				ret = fwsym_bl_add(w, a, target, BL_THUMB);
+			} else {
+				ret = fwsym_bl_add(w, a, target & ~3, BL_THUMB_BLX);
+			}
+			i += 2;
+			continue;
+		}
+
+		if ((hw & 0xf800) == 0x4800) {
+			uint32_t p = ((a + 4) & ~3) + (hw & 0xff) * 4 - g->vaddr, v;
+
+			if (p + 4 <= g->size) {
+				m[p / 2] |= M_DATA;
+				m[p / 2 + 1] |= M_DATA;
+				v = le32(d + p);
+				lit[(hw >> 8) & 7] = v;
+				lit_at[(hw >> 8) & 7] = a;
+				if (v & 1) {
+					ret = fwsym_ptr_add(w, v & ~1);
+				}
+			}
+		} else if ((hw & 0xff00) == 0xb500) {
+			m[i] |= M_PUSH;
+		} else if ((hw & 0xf800) == 0x2800) {
+			ret = fwsym_cmp(w, a, hw2, (hw >> 8) & 7, hw & 0xff);
+		} else if ((hw & 0xffc0) == 0x4280) {
+			uint32_t rm = (hw >> 3) & 7;
+
+			if (lit_at[rm] != UINT32_MAX && a - lit_at[rm] <= 16) {
+				ret = fwsym_cmp(w, a, hw2, hw & 7, lit[rm]);
+			}
+		} else if ((hw & 0xffc0) == 0x0040) {
+			ret = fwsym_table(w, s, i);
+		}
+		i++;
+	}
+
+	return ret;
+}
+
+// an arm function, up to the return no branch goes past and its pools
+static int fwsym_arm(struct fwsym_work_t *w, uint32_t addr)
+{
+	int s = fwsym_seg_of(w, addr);
+	const struct fwsym_seg_t *g;
+	uint16_t *m;
+	uint32_t a, end, past;
+
+	if (s < 0 || w->mark[s] == NULL || (addr & 3)) {
+		return 0;
+	}
+	g = w->seg[s];
+	m = w->mark[s];
+	// a start even where an arm function before it was thought to go on
+	m[(addr - g->vaddr) / 2] |= M_BLX;
+	if (m[(addr - g->vaddr) / 2] & M_ARM) {
+		return 0;
+	}
+	end = g->vaddr + (g->size & ~3);
+	if (end - addr > FWSYM_ARM_MAX) {
+		end = addr + FWSYM_ARM_MAX;
+	}
+	if ((le32(g->data + addr - g->vaddr) & 0xffff4000) == 0xe92d4000) {
+		m[(addr - g->vaddr) / 2] |= M_STMFD;
+	}
+
+	for (a = addr, past = addr; a < end; a += 4) {
+		uint32_t k = (a - g->vaddr) / 2, v = le32(g->data + a - g->vaddr);
+		uint32_t target = a + 8 + ((int32_t)(v << 8) >> 6);
+
+		m[k] |= M_ARM;
+		m[k + 1] |= M_ARM;
+		if (m[k] & M_DATA) {
+			continue;
+		}
+		if ((v & 0xfe000000) == 0xfa000000) {
+			if (fwsym_bl_add(w, a, target + ((v >> 23) & 2), BL_ARM_BLX) < 0) {
+				return -1;
+			}
+		} else if ((v & 0x0f000000) == 0x0b000000) {
+			if (fwsym_bl_add(w, a, target, BL_ARM) < 0) {
+				return -1;
+			}
+		} else if ((v & 0x0f7f0000) == 0x051f0000) {
+			uint32_t p = a + 8 + ((v & 0x00800000) ? (v & 0xfff) : -(v & 0xfff));
+
+			if (p > a && !(p & 3) && p + 4 <= end) {
+				m[(p - g->vaddr) / 2] |= M_DATA;
+				m[(p - g->vaddr) / 2 + 1] |= M_DATA;
+			}
+			// ldr pc, [pc, #-4] and the like, veneers to the rom
+			if ((v >> 28) == 0xe && (v & 0xf000) == 0xf000 && a >= past) {
+				break;
+			}
+		} else if ((v & 0x0e000000) == 0x0a000000) {
+			if (target > past) {
+				past = target;
+			}
+			if ((v >> 28) == 0xe && target <= a && a >= past) {
+				break;
+			}
+		} else if (((v & 0xfffffff0) == 0xe12fff10 || (v & 0xffff8000) == 0xe8bd8000 || (v & 0xfffffff0) == 0xe1a0f000) && a >= past) {
+			break;
+		}
+	}
+	// the pools right after it
+	for (a += 4; a < end && (m[(a - g->vaddr) / 2] & M_DATA); a += 4) {
+		m[(a - g->vaddr) / 2] |= M_ARM;
+		m[(a - g->vaddr) / 2 + 1] |= M_ARM;
+	}
+
+	return 0;
+}
+
+// a function can start after a return, padding or data, an odd constant
+// in a pool is too often right after padding to go by that
+static int fwsym_after(const struct fwsym_seg_t *g, const uint16_t *m, uint32_t i, int padding)
+{
+	uint16_t hw;
+
+	if (i == 0 || (m[i - 1] & M_DATA)) {
+		return 1;
+	}
+	if (!(m[i - 1] & M_INSN)) {
+		return 0;
+	}
+	hw = le16(g->data + i * 2 - 2);
+
+	return (hw & 0xff87) == 0x4700 || (hw & 0xff00) == 0xbd00 || (padding && (hw == 0x46c0 || hw == 0x0000));
+}
+
+static int fwsym_find(const struct fwsym_region_t *r, uint32_t addr)
+{
+	int lo = 0, hi = (int)r->nfunc - 1;
+
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		const struct fwsym_func_t *fn = &r->func[mid];
+
+		if (addr < fn->addr) {
+			hi = mid - 1;
+		} else if (addr - fn->addr >= fn->size) {
+			lo = mid + 1;
+		} else {
+			return mid;
+		}
+	}
+
+	return -1;
+}
+
+static int fwsym_funcs(struct fwsym_work_t *w)
+{
+	struct fwsym_region_t *r = w->r;
+
+	r->nfunc = 0;
+	for (uint32_t s = 0; s < r->nseg; s++) {
+		const struct fwsym_seg_t *g = w->seg[s];
+		const uint16_t *m = w->mark[s];
+		uint32_t first = r->nfunc;
+
+		if (m == NULL) {
+			continue;
+		}
+		for (uint32_t i = 0; i < g->size / 2; i++) {
+			struct fwsym_func_t *fn;
+
+			if (!(m[i] & M_START)) {
+				continue;
+			}
+			if (fwsym_grow((void **)&r->func, r->nfunc, &w->nfunc_alloc, sizeof(*r->func)) < 0) {
+				return -1;
+			}
+			fn = &r->func[r->nfunc++];
+			memset(fn, 0, sizeof(*fn));
+			fn->addr = g->vaddr + i * 2;
+			fn->flags = (m[i] & M_BLX) ? FWSYM_ARM | FWSYM_BLX : FWSYM_THUMB;
+			fn->flags |= (m[i] & (M_PUSH | M_STMFD)) ? FWSYM_PROLOGUE : 0;
+			fn->flags |= (m[i] & M_AFTER) ? FWSYM_AFTER : 0;
+			fn->flags |= (m[i] & M_CALLERS) ? FWSYM_CALLERS : 0;
+			fn->flags |= (m[i] & M_PTR) ? FWSYM_POINTER : 0;
+		}
+		for (uint32_t k = first; k < r->nfunc; k++) {
+			uint32_t end = (k + 1 < r->nfunc) ? r->func[k + 1].addr : g->vaddr + g->size;
+
+			r->func[k].size = end - r->func[k].addr;
+		}
+	}
+
+	return 0;
+}
+
+static int fwsym_pair_cmp(const void *a, const void *b)
+{
+	const struct fwsym_pair_t *x = a, *y = b;
+
+	if (x->target != y->target) {
+		return (x->target > y->target) - (x->target < y->target);
+	}
+	return (x->from > y->from) - (x->from < y->from);
+}
+
+// bl targets in the middle of a function called from two others are
+// functions, the first guess ran into them
+static int fwsym_callers(struct fwsym_work_t *w)
+{
+	struct fwsym_region_t *r = w->r;
+	struct fwsym_pair_t *pair = malloc(sizeof(*pair) * (w->nbl ? w->nbl : 1));
+	uint32_t n = 0, i, j;
+
+	if (pair == NULL) {
+		return -1;
+	}
+	for (i = 0; i < w->nbl; i++) {
+		const struct fwsym_bl_t *b = &w->bl[i];
+		uint16_t *m;
+		int from, in;
+
+		if (b->kind != BL_THUMB && b->kind != BL_ARM_BLX) {
+			continue;
+		}
+		m = fwsym_mark(w, b->target);
+		from = fwsym_find(r, b->site);
+		in = fwsym_find(r, b->target);
+		if (m == NULL || (*m & (M_START | M_ARM | M_DATA)) || !(*m & M_INSN) || from < 0 || from == in) {
+			continue;
+		}
+		pair[n].target = b->target;
+		pair[n].from = from;
+		n++;
+	}
+	qsort(pair, n, sizeof(*pair), fwsym_pair_cmp);
+
+	for (i = 0; i < n; i = j) {
+		uint32_t froms = 1;
+
+		for (j = i + 1; j < n && pair[j].target == pair[i].target; j++) {
+			froms += (pair[j].from != pair[j - 1].from);
+		}
+		if (froms >= 2) {
+			*fwsym_mark(w, pair[i].target) |= M_CALLERS | M_START;
+		}
+	}
+	free(pair);
+
+	return 0;
+}
+
+static int fwsym_starts(struct fwsym_work_t *w)
+{
+	uint32_t i;
+
+	// arm functions first, the thumb sweep went through them too
+	for (i = 0; i < w->nbl; i++) {
+		uint32_t kind = w->bl[i].kind;
+		uint16_t *m = fwsym_mark(w, w->bl[i].site);
+
+		if ((kind == BL_THUMB_BLX && m && !(*m & M_ARM)) || kind == BL_ARM) {
+			if (fwsym_arm(w, w->bl[i].target) < 0) {
+				return -1;
+			}
+		}
+	}
+	for (i = 0; i < w->nbl; i++) {
+		struct fwsym_bl_t *b = &w->bl[i];
+		uint16_t *m = fwsym_mark(w, b->site);
+
+		if ((b->kind == BL_THUMB || b->kind == BL_THUMB_BLX) && m && (*m & M_ARM)) {
+			b->kind = BL_DROPPED;
+			continue;
+		}
+		m = fwsym_mark(w, b->target);
+		if (m && (b->kind == BL_THUMB || b->kind == BL_ARM_BLX)) {
+			*m |= M_BL;
+		}
+	}
+	for (i = 0; i < w->nptr; i++) {
+		uint16_t *m = fwsym_mark(w, w->ptr[i]);
+
+		if (m) {
+			*m |= M_PTR;
+		}
+	}
+
+	for (uint32_t s = 0; s < w->r->nseg; s++) {
+		const struct fwsym_seg_t *g = w->seg[s];
+		uint16_t *m = w->mark[s];
+
+		if (m == NULL) {
+			continue;
+		}
+		for (i = 0; i < g->size / 2; i++) {
+			if (m[i] & M_ARM) {
+				if (m[i] & M_BLX) {
+					m[i] |= M_START;
+				}
+				continue;
+			}
+			if (!(m[i] & M_INSN) || (m[i] & M_DATA)) {
+				continue;
+			}
+			if (((m[i] & M_BL) && fwsym_after(g, m, i, 1)) || ((m[i] & M_PTR) && fwsym_after(g, m, i, 0))) {
+				m[i] |= M_AFTER | M_START;
+			}
+			if (m[i] & M_PUSH) {
+				m[i] |= M_START;
+			}
+		}
+	}
+
+	if (fwsym_funcs(w) < 0 || fwsym_callers(w) < 0) {
+		return -1;
+	}
+
+	return fwsym_funcs(w);
+}
+
+static int fwsym_call_cmp(const void *a, const void *b)
+{
+	const struct fwsym_call_t *x = a, *y = b;
+
+	return (x->site > y->site) - (x->site < y->site);
+}
+
+static int fwsym_calls(struct fwsym_work_t *w)
+{
+	struct fwsym_region_t *r = w->r;
+
+	for (uint32_t i = 0; i < w->nbl; i++) {
+		const struct fwsym_bl_t *b = &w->bl[i];
+		int from, to;
+
+		if (b->kind == BL_DROPPED) {
+			continue;
+		}
+		from = fwsym_find(r, b->site);
+		to = fwsym_find(r, b->target);
+		if (from >= 0 && to >= 0 && r->func[to].addr == b->target) {
+			if (fwsym_grow((void **)&r->call, r->ncall, &w->ncall_alloc, sizeof(*r->call)) < 0) {
+				return -1;
+			}
+			r->call[r->ncall].site = b->site;
+			r->call[r->ncall].from = r->func[from].addr;
+			r->call[r->ncall].to = b->target;
+			r->ncall++;
+			r->func[from].callees++;
+			r->func[to].callers++;
+		} else if (from >= 0 && from == to) {
+			r->long_branches++;
+		} else {
+			r->stray++;
+		}
+	}
+	qsort(r->call, r->ncall, sizeof(*r->call), fwsym_call_cmp);
+
+	return 0;
+}
+
+static int fwsym_data(struct fwsym_work_t *w)
+{
+	struct fwsym_region_t *r = w->r;
+
+	for (uint32_t s = 0; s < r->nseg; s++) {
+		const struct fwsym_seg_t *g = w->seg[s];
+		const uint16_t *m = w->mark[s];
+		uint32_t n = g->size / 2, i = 0, j;
+
+		while (m && i < n) {
+			uint16_t kind = m[i] & (M_DATA | M_TABLE);
+
+			if (!(kind & M_DATA)) {
+				i++;
+				continue;
+			}
+			for (j = i + 1; j < n && (m[j] & (M_DATA | M_TABLE)) == kind; j++) {
+			}
+			if (fwsym_grow((void **)&r->data, r->ndata, &w->ndata_alloc, sizeof(*r->data)) < 0) {
+				return -1;
+			}
+			r->data[r->ndata].addr = g->vaddr + i * 2;
+			r->data[r->ndata].len = (j - i) * 2;
+			r->data[r->ndata].kind = (kind & M_TABLE) ? FWSYM_TABLE : FWSYM_POOL;
+			r->ndata++;
+			i = j;
+		}
+	}
+
+	return 0;
+}
+
+static int fwsym_obs_cmp(const void *a, const void *b)
+{
+	const struct fwsym_obs_t *x = a, *y = b;
+
+	if (x->func != y->func) {
+		return (x->func > y->func) - (x->func < y->func);
+	}
+	if (x->reg != y->reg) {
+		return (x->reg > y->reg) - (x->reg < y->reg);
+	}
+	if (x->value != y->value) {
+		return (x->value > y->value) - (x->value < y->value);
+	}
+	return (x->site > y->site) - (x->site < y->site);
+}
+
+// the switch of the region with the most command ids
+static void fwsym_switch(struct fwsym_work_t *w)
+{
+	struct fwsym_region_t *r = w->r;
+	uint32_t n = 0, i, j, k, best = 0, best_cases = 0;
+
+	for (i = 0; i < w->nobs; i++) {
+		int fn = fwsym_find(r, w->obs[i].site);
+
+		if (fn >= 0 && (r->func[fn].flags & FWSYM_THUMB)) {
+			w->obs[n] = w->obs[i];
+			w->obs[n++].func = fn;
+		}
+	}
+	qsort(w->obs, n, sizeof(*w->obs), fwsym_obs_cmp);
+
+	for (i = 0; i < n; i = j) {
+		uint32_t matched = 0, cases = 0;
+
+		for (j = i; j < n && w->obs[j].func == w->obs[i].func && w->obs[j].reg == w->obs[i].reg; j++) {
+			if (j == i || w->obs[j].value != w->obs[j - 1].value) {
+				cases++;
+				matched += fwsym_cmd_name(w->f, w->obs[j].value) != NULL;
+			}
+		}
+		if (matched > best || (matched == best && matched && cases > best_cases)) {
+			best = matched;
+			best_cases = cases;
+			r->dispatch = w->obs[i].func;
+			r->reg = w->obs[i].reg;
+			r->matched = matched;
+			r->ncase = 0;
+			// a value compared more than once goes where it was first
+			for (k = i; k < j && r->ncase < FWSYM_CASES_MAX; k++) {
+				if (k == i || w->obs[k].value != w->obs[k - 1].value) {
+					r->cases[r->ncase].value = w->obs[k].value;
+					r->cases[r->ncase].target = w->obs[k].target;
+					r->ncase++;
+				}
+			}
+		}
+	}
+}
+
+static double fwsym_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void fwsym_region(const struct fwsym_t *f, struct fwsym_region_t *r)
+{
+	struct fwsym_work_t w;
+	double start = fwsym_now();
+	uint32_t s;
+
+	memset(&w, 0, sizeof(w));
+	w.f = f;
+	w.r = r;
+	for (s = 0; s < r->nseg; s++) {
+		w.seg[s] = &f->seg[r->seg[s]];
+		if ((w.seg[s]->pf & PF_X) && (w.mark[s] = calloc(w.seg[s]->size / 2 + 2, sizeof(uint16_t))) == NULL) {
+			r->error = -1;
+		}
+	}
+
+	for (s = 0; s < r->nseg && r->error == 0; s++) {
+		if (w.mark[s] && fwsym_sweep(&w, s) < 0) {
+			r->error = -1;
+		}
+	}
+	if (r->error == 0 && (fwsym_starts(&w) < 0 || fwsym_calls(&w) < 0 || fwsym_data(&w) < 0)) {
+		r->error = -1;
+	}
+	if (r->error == 0) {
+		fwsym_switch(&w);
+	}
+
+	for (s = 0; s < r->nseg; s++) {
+		free(w.mark[s]);
+	}
+	free(w.bl);
+	free(w.obs);
+	free(w.ptr);
+	r->ms = fwsym_now() - start;
+}
+
+struct fwsym_part_t {
+	struct fwsym_t *f;
+	uint32_t first;
+	uint32_t step;
+	pthread_t thread;
+};
+
+static void *fwsym_part(void *arg)
+{
+	struct fwsym_part_t *part = arg;
+
+	for (uint32_t i = part->first; i < part->f->nregion; i += part->step) {
+		fwsym_region(part->f, &part->f->region[i]);
+	}
+
+	return NULL;
+}
+
+// every thread takes every n-th region and writes only to those
+int fwsym_run(struct fwsym_t *f, uint32_t threads)
+{
+	struct fwsym_part_t part[FWSYM_REGIONS_MAX];
+	uint32_t n = threads, i, k, best = 0;
+
+	fwsym_clear(f);
+	if (threads == FWSYM_THREADS_AUTO) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+		n = (cpus > 0) ? cpus : 1;
+	}
+	if (n > f->nregion) {
+		n = f->nregion;
+	}
+	if (n == 0) {
+		n = 1;
+	}
+
+	for (k = 0; k < n; k++) {
+		part[k].f = f;
+		part[k].first = k;
+		part[k].step = n;
+	}
+	for (k = 1; k < n; k++) {
+		if (pthread_create(&part[k].thread, NULL, fwsym_part, &part[k]) != 0) {
+			break;
+		}
+	}
+	f->threads = k;
+	fwsym_part(&part[0]);
+	// parts that did not get a thread
+	for (i = k; i < n; i++) {
+		fwsym_part(&part[i]);
+	}
+	while (--k > 0) {
+		pthread_join(part[k].thread, NULL);
+	}
+
+	for (i = 0; i < f->nregion; i++) {
+		const struct fwsym_region_t *r = &f->region[i];
+
+		if (r->error) {
+			return -1;
+		}
+		if (r->dispatch >= 0 && r->matched >= FWSYM_DISPATCH_MIN && r->matched > best) {
+			best = r->matched;
+			f->dispatch = i;
+		}
+	}
+	if (f->dispatch >= 0) {
+		struct fwsym_region_t *r = &f->region[f->dispatch];
+
+		snprintf(r->func[r->dispatch].name, FWSYM_NAME, "cmd_dispatch");
+	}
+
+	return 0;
+}
+
+const struct fwsym_func_t *fwsym_func_at(const struct fwsym_t *f, uint32_t addr)
+{
+	for (uint32_t i = 0; i < f->nregion; i++) {
+		const struct fwsym_region_t *r = &f->region[i];
+
+		if ((addr & FWSYM_REGION_MASK) == r->base) {
+			int k = fwsym_find(r, addr);
+
+			return (k >= 0) ? &r->func[k] : NULL;
+		}
+	}
+
+	return NULL;
+}
+
+const char *fwsym_name(const struct fwsym_func_t *fn, char *buf, int len)
+{
+	if (fn->name[0]) {
+		return fn->name;
+	}
+	snprintf(buf, len, "sub_%08x", fn->addr);
+
+	return buf;
+}
+
+// the symbols and their names on the way to the file
+struct fwsym_out_t {
+	Elf32_Sym *sym;
+	uint32_t nsym, nsym_alloc;
+	char *str;
+	uint32_t nstr, nstr_alloc;
+	const Elf32_Shdr *sh;
+	uint32_t nsh;
+	const uint16_t *shmap;   // old section to new, 0 if dropped
+};
+
+static int fwsym_str(struct fwsym_out_t *o, const char *s)
+{
+	uint32_t len = strlen(s) + 1, at = o->nstr;
+
+	while (o->nstr + len > o->nstr_alloc) {
+		if (fwsym_grow((void **)&o->str, o->nstr_alloc, &o->nstr_alloc, 1) < 0) {
+			return -1;
+		}
+	}
+	memcpy(o->str + o->nstr, s, len);
+	o->nstr += len;
+
+	return at;
+}
+
+static int fwsym_sym(struct fwsym_out_t *o, const char *name, uint32_t value, uint32_t size, uint32_t info)
+{
+	Elf32_Sym *sym;
+	int at = fwsym_str(o, name);
+	uint32_t addr = value & ~1, i;
+
+	if (at < 0 || fwsym_grow((void **)&o->sym, o->nsym, &o->nsym_alloc, sizeof(*o->sym)) < 0) {
+		return -1;
+	}
+	sym = &o->sym[o->nsym++];
+	memset(sym, 0, sizeof(*sym));
+	sym->st_name = at;
+	sym->st_value = value;
+	sym->st_size = size;
+	sym->st_info = info;
+	sym->st_shndx = SHN_ABS;
+	for (i = 1; i < o->nsh; i++) {
+		const Elf32_Shdr *sh = &o->sh[i];
+
+		if (o->shmap[i] && (sh->sh_flags & SHF_ALLOC) && addr - sh->sh_addr < sh->sh_size) {
+			sym->st_shndx = o->shmap[i];
+			break;
+		}
+	}
+
+	return 0;
+}
+
+static int fwsym_is_data(const struct fwsym_region_t *r, uint32_t addr)
+{
+	int lo = 0, hi = (int)r->ndata - 1;
+
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+
+		if (r->data[mid].addr == addr) {
+			return 1;
+		}
+		if (r->data[mid].addr < addr) {
+			lo = mid + 1;
+		} else {
+			hi = mid - 1;
+		}
+	}
+
+	return 0;
+}
+
+// $t $a $d where the code changes, the dispatcher cases, locals before
+// the functions
+static int fwsym_syms(const struct fwsym_t *f, struct fwsym_out_t *o)
+{
+	char name[FWSYM_NAME + 8];
+	uint32_t i, k;
+
+	if (fwsym_sym(o, "", 0, 0, 0) < 0) {
+		return -1;
+	}
+	for (i = 0; i < f->nregion; i++) {
+		const struct fwsym_region_t *r = &f->region[i];
+
+		for (k = 0; k < r->nfunc; k++) {
+			const char *map = (r->func[k].flags & FWSYM_ARM) ? "$a" : "$t";
+
+			if (fwsym_sym(o, map, r->func[k].addr, 0, ELF32_ST_INFO(STB_LOCAL, STT_NOTYPE)) < 0) {
+				return -1;
+			}
+		}
+		for (k = 0; k < r->ndata; k++) {
+			uint32_t end = r->data[k].addr + r->data[k].len;
+			int fn = fwsym_find(r, end);
+
+			if (fwsym_sym(o, "$d", r->data[k].addr, 0, ELF32_ST_INFO(STB_LOCAL, STT_NOTYPE)) < 0) {
+				return -1;
+			}
+			if (fn < 0 || r->func[fn].addr == end || fwsym_is_data(r, end)) {
+				continue;
+			}
+			if (fwsym_sym(o, (r->func[fn].flags & FWSYM_ARM) ? "$a" : "$t", end, 0, ELF32_ST_INFO(STB_LOCAL, STT_NOTYPE)) < 0) {
+				return -1;
+			}
+		}
+	}
+	if (f->dispatch >= 0) {
+		const struct fwsym_region_t *r = &f->region[f->dispatch];
+
+		for (k = 0; k < r->ncase; k++) {
+			const char *cmd = fwsym_cmd_name(f, r->cases[k].value);
+			char *c;
+
+			if (cmd) {
+				snprintf(name, sizeof(name), "cmd_%s", cmd);
+			} else {
+				snprintf(name, sizeof(name), "cmd_%04x", r->cases[k].value);
+			}
+			for (c = name; *c; c++) {
+				*c = tolower((unsigned char)*c);
+			}
+			if (fwsym_sym(o, name, r->cases[k].target, 0, ELF32_ST_INFO(STB_LOCAL, STT_NOTYPE)) < 0) {
+				return -1;
+			}
+		}
+	}
+
+	return o->nsym;
+}
+
+static int fwsym_funcsyms(const struct fwsym_t *f, struct fwsym_out_t *o)
+{
+	char buf[FWSYM_NAME];
+
+	for (uint32_t i = 0; i < f->nregion; i++) {
+		const struct fwsym_region_t *r = &f->region[i];
+
+		for (uint32_t k = 0; k < r->nfunc; k++) {
+			const struct fwsym_func_t *fn = &r->func[k];
+			uint32_t thumb = (fn->flags & FWSYM_THUMB) ? 1 : 0;
+
+			if (fwsym_sym(o, fwsym_name(fn, buf, sizeof(buf)), fn->addr | thumb, fn->size, ELF32_ST_INFO(STB_GLOBAL, STT_FUNC)) < 0) {
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int fwsym_put(int fd, const void *buf, uint64_t len)
+{
+	const uint8_t *p = buf;
+
+	while (len) {
+		ssize_t ret = write(fd, p, len);
+
+		if (ret <= 0) {
+			return -4;
+		}
+		p += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+// everything of the file up to the end of the last loaded segment or kept
+// section stays as it is, the symbols, their names, the section names and
+// the section headers go after it, so a second run replaces the first
+int fwsym_write(const struct fwsym_t *f, const char *out)
+{
+	static const uint8_t zero[4];
+	const Elf32_Ehdr *eh = (const Elf32_Ehdr *)f->map;
+	const Elf32_Phdr *ph;
+	const Elf32_Shdr *sh = NULL;
+	const char *names = NULL;
+	struct fwsym_out_t o;
+	Elf32_Ehdr neh;
+	Elf32_Shdr *nsh = NULL;
+	uint16_t *shmap = NULL;
+	char *shstr = NULL, tmp[4096];
+	uint64_t keep, off_shstr, off_sym, off_str, off_sh, nshstr = 1;
+	uint32_t nsh_old = 0, nkept = 1, locals, i;
+	int fd, ret = -1;
+
+	if (f->map == NULL) {
+		return -1;
+	}
+	memset(&o, 0, sizeof(o));
+
+	ph = (const Elf32_Phdr *)(f->map + eh->e_phoff);
+	keep = eh->e_phoff + eh->e_phnum * sizeof(*ph);
+	for (i = 0; i < eh->e_phnum; i++) {
+		if (ph[i].p_type == PT_LOAD && ph[i].p_offset + (uint64_t)ph[i].p_filesz > keep) {
+			keep = ph[i].p_offset + (uint64_t)ph[i].p_filesz;
+		}
+	}
+	if (eh->e_shentsize == sizeof(*sh) && eh->e_shoff && eh->e_shoff + (uint64_t)eh->e_shnum * sizeof(*sh) <= f->size) {
+		sh = (const Elf32_Shdr *)(f->map + eh->e_shoff);
+		nsh_old = eh->e_shnum;
+		if (eh->e_shstrndx < nsh_old && sh[eh->e_shstrndx].sh_offset + (uint64_t)sh[eh->e_shstrndx].sh_size <= f->size) {
+			names = (const char *)f->map + sh[eh->e_shstrndx].sh_offset;
+		}
+	}
+
+	shmap = calloc(nsh_old + 1, sizeof(*shmap));
+	nsh = calloc(nsh_old + 4, sizeof(*nsh));
+	shstr = malloc(nsh_old * 64 + 32);
+	if (shmap == NULL || nsh == NULL || shstr == NULL) {
+		goto out;
+	}
+
+	// old symbols and all names go, the rest is kept
+	shstr[0] = 0;
+	for (i = 1; i < nsh_old; i++) {
+		const char *name = (names && sh[i].sh_name < sh[eh->e_shstrndx].sh_size) ? names + sh[i].sh_name : "";
+
+		if (sh[i].sh_type == SHT_SYMTAB || sh[i].sh_type == SHT_STRTAB) {
+			continue;
+		}
+		if (sh[i].sh_type != SHT_NOBITS && sh[i].sh_offset + (uint64_t)sh[i].sh_size <= f->size &&
+			sh[i].sh_offset + (uint64_t)sh[i].sh_size > keep) {
+			keep = sh[i].sh_offset + (uint64_t)sh[i].sh_size;
+		}
+		shmap[i] = nkept;
+		nsh[nkept] = sh[i];
+		nsh[nkept].sh_name = nshstr;
+		nshstr += snprintf(shstr + nshstr, 63, "%s", name) + 1;
+		nkept++;
+	}
+	for (i = 1; i < nkept; i++) {
+		nsh[i].sh_link = (nsh[i].sh_link < nsh_old) ? shmap[nsh[i].sh_link] : 0;
+	}
+
+	o.sh = sh;
+	o.nsh = nsh_old;
+	o.shmap = shmap;
+	if ((ret = fwsym_syms(f, &o)) < 0 || fwsym_funcsyms(f, &o) < 0) {
+		ret = -1;
+		goto out;
+	}
+	locals = ret;
+
+	nsh[nkept].sh_name = nshstr;
+	nsh[nkept].sh_type = SHT_SYMTAB;
+	nsh[nkept].sh_link = nkept + 1;
+	nsh[nkept].sh_info = locals;
+	nsh[nkept].sh_entsize = sizeof(Elf32_Sym);
+	nsh[nkept].sh_addralign = 4;
+	nshstr += sprintf(shstr + nshstr, ".symtab") + 1;
+	nsh[nkept + 1].sh_name = nshstr;
+	nsh[nkept + 1].sh_type = SHT_STRTAB;
+	nsh[nkept + 1].sh_addralign = 1;
+	nshstr += sprintf(shstr + nshstr, ".strtab") + 1;
+	nsh[nkept + 2].sh_name = nshstr;
+	nsh[nkept + 2].sh_type = SHT_STRTAB;
+	nsh[nkept + 2].sh_addralign = 1;
+	nshstr += sprintf(shstr + nshstr, ".shstrtab") + 1;
+
+	off_sym = (keep + 3) & ~3ULL;
+	off_str = off_sym + o.nsym * sizeof(Elf32_Sym);
+	off_shstr = off_str + o.nstr;
+	off_sh = (off_shstr + nshstr + 3) & ~3ULL;
+	nsh[nkept].sh_offset = off_sym;
+	nsh[nkept].sh_size = o.nsym * sizeof(Elf32_Sym);
+	nsh[nkept + 1].sh_offset = off_str;
+	nsh[nkept + 1].sh_size = o.nstr;
+	nsh[nkept + 2].sh_offset = off_shstr;
+	nsh[nkept + 2].sh_size = nshstr;
+
+	neh = *eh;
+	neh.e_shoff = off_sh;
+	neh.e_shentsize = sizeof(Elf32_Shdr);
+	neh.e_shnum = nkept + 3;
+	neh.e_shstrndx = nkept + 2;
+
+	// out may be the file that is mapped, it is replaced only when done
+	snprintf(tmp, sizeof(tmp), "%s.tmp", out);
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		ret = -2;
+		goto out;
+	}
+	ret = fwsym_put(fd, &neh, sizeof(neh));
+	if (ret == 0) {
+		ret = fwsym_put(fd, f->map + sizeof(neh), keep - sizeof(neh));
+	}
+	if (ret == 0) {
+		ret = fwsym_put(fd, zero, off_sym - keep);
+	}
+	if (ret == 0) {
+		ret = fwsym_put(fd, o.sym, o.nsym * sizeof(Elf32_Sym));
+	}
+	if (ret == 0) {
+		ret = fwsym_put(fd, o.str, o.nstr);
+	}
+	if (ret == 0) {
+		ret = fwsym_put(fd, shstr, nshstr);
+	}
+	if (ret == 0) {
+		ret = fwsym_put(fd, zero, off_sh - off_shstr - nshstr);
+	}
+	if (ret == 0) {
+		ret = fwsym_put(fd, nsh, (nkept + 3) * sizeof(*nsh));
+	}
+	if (close(fd) < 0 || ret < 0 || rename(tmp, out) < 0) {
+		unlink(tmp);
+		ret = -4;
+	}
+
+out:
+	free(o.sym);
+	free(o.str);
+	free(shmap);
+	free(nsh);
+	free(shstr);
+
+	return ret;
+}
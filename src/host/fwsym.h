@@ -0,0 +1,144 @@
+#ifndef FWSYM_h_
+#define FWSYM_h_
+
+#include <stdint.h>
+
+// functions, calls, literal pools and the host command dispatcher out of
+// firmware memory, mostly thumb code built with rvct
+// every 4 MiB region is swept on a thread of its own, bl and blx reach no
+// further than that
+// the sweep decodes thumb from the start of every executable segment, pc
+// relative loads and switch tables point ahead of it and are data when it
+// gets there; functions start at push {.., lr}, at bl targets right after
+// a return, padding or data, at bl targets more than one function calls,
+// and blx targets are arm functions; a bl to the start of a function is a
+// call, one to inside the calling function a long branch
+// the dispatcher is the switch with the most cases that are command ids
+// of doc/mwifiex/fw.h, over compare chains and halfword jump tables
+// fwsym_write puts it all into the ELF as .symtab, functions as sub_<addr>
+// or what they are, with $t $a $d for the disassembler
+
+#define FWSYM_SEGS_MAX      64
+#define FWSYM_REGIONS_MAX   16
+#define FWSYM_CMDS_MAX      512
+#define FWSYM_CASES_MAX     512
+#define FWSYM_NAME          40
+#define FWSYM_REGION_MASK   0xffc00000
+#define FWSYM_DISPATCH_MIN  8          // cases that are command ids
+#define FWSYM_THREADS_AUTO  0
+
+// how a function was found
+#define FWSYM_THUMB         0x0001
+#define FWSYM_ARM           0x0002
+#define FWSYM_PROLOGUE      0x0004     // push {.., lr} or stmfd sp!, {.., lr}
+#define FWSYM_AFTER         0x0008     // bl target after a return, padding or data
+#define FWSYM_CALLERS       0x0010     // bl target of more than one function
+#define FWSYM_POINTER       0x0020     // thumb address in a literal pool
+#define FWSYM_BLX           0x0040     // arm, a blx or arm bl target
+
+enum {
+	FWSYM_POOL,              // pc relative load
+	FWSYM_TABLE,             // switch jump table
+};
+
+struct fwsym_seg_t {
+	uint32_t vaddr;
+	uint32_t size;
+	const uint8_t *data;
+	uint32_t pf;             // PF_X where code can be
+};
+
+struct fwsym_func_t {
+	uint32_t addr;
+	uint32_t size;           // up to the next function or the segment end
+	uint32_t flags;
+	uint32_t callers;        // calls to it
+	uint32_t callees;        // calls from it
+	char name[FWSYM_NAME];   // empty for sub_<addr>
+};
+
+struct fwsym_call_t {
+	uint32_t site;
+	uint32_t from;           // function the bl is in
+	uint32_t to;             // function called
+};
+
+struct fwsym_data_t {
+	uint32_t addr;
+	uint32_t len;
+	uint32_t kind;
+};
+
+struct fwsym_case_t {
+	uint32_t value;
+	uint32_t target;
+};
+
+struct fwsym_cmd_t {
+	uint32_t id;
+	char name[FWSYM_NAME];
+};
+
+struct fwsym_region_t {
+	uint32_t base;
+	uint32_t nseg;
+	uint32_t seg[FWSYM_SEGS_MAX];      // of fwsym_t, in address order
+	struct fwsym_func_t *func;         // in address order
+	uint32_t nfunc;
+	struct fwsym_call_t *call;         // in site order
+	uint32_t ncall;
+	struct fwsym_data_t *data;         // in address order
+	uint32_t ndata;
+	uint32_t long_branches;            // bl inside the calling function
+	uint32_t stray;                    // bl elsewhere
+	// the best switch of the region
+	int32_t dispatch;                  // function, -1 if none
+	uint32_t reg;
+	uint32_t matched;                  // cases that are command ids
+	uint32_t ncase;
+	struct fwsym_case_t cases[FWSYM_CASES_MAX];
+	double ms;
+	int error;
+};
+
+struct fwsym_t {
+	// the ELF of fwsym_open
+	int fd;
+	const uint8_t *map;
+	uint64_t size;
+	uint32_t nseg;
+	struct fwsym_seg_t seg[FWSYM_SEGS_MAX];
+	uint32_t nregion;
+	struct fwsym_region_t region[FWSYM_REGIONS_MAX];
+	uint32_t ncmd;
+	struct fwsym_cmd_t cmd[FWSYM_CMDS_MAX];
+	int32_t dispatch;                  // region of the dispatcher, -1 if none
+	uint32_t threads;
+};
+
+void fwsym_init(struct fwsym_t *f);
+void fwsym_free(struct fwsym_t *f);
+
+// HostCmd_CMD_ ids out of fw.h, returns how many or -2
+int fwsym_cmds(struct fwsym_t *f, const char *path);
+// memory to look at, the data stays the caller's, returns the segment or -1
+int fwsym_add(struct fwsym_t *f, uint32_t vaddr, const void *data, uint32_t size, uint32_t pf);
+// the loaded segments of an ARM ELF, returns 0, -1 not one, -2 cannot read
+int fwsym_open(struct fwsym_t *f, const char *path);
+
+// regions on up to threads threads, returns 0 or -1 out of memory
+int fwsym_run(struct fwsym_t *f, uint32_t threads);
+
+// the function addr is in, NULL if none
+const struct fwsym_func_t *fwsym_func_at(const struct fwsym_t *f, uint32_t addr);
+// name of a function, its own or sub_<addr>
+const char *fwsym_name(const struct fwsym_func_t *fn, char *buf, int len);
+// name of the command id, NULL if fw.h has none
+const char *fwsym_cmd_name(const struct fwsym_t *f, uint32_t id);
+
+// the ELF of fwsym_open with a .symtab of the results, an earlier one
+// replaced, out can be the file itself, returns 0, -1 no ELF open, -2
+// out cannot be created or -4 write failed
+int fwsym_write(const struct fwsym_t *f, const char *out);
+
+#endif
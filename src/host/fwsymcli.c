@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "fwsym.h"
+
+// functions, calls and the host command dispatcher of a firmware ELF from
+// bin2elf or a device dump, written back into it as a symbol table so the
+// disassembler shows them
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-o out.elf] [-j threads] [-c fw.h] [-m map] [-v] in.elf\n", name);
+	fprintf(stderr, "  -o  ELF with the symbols, can be in.elf itself\n");
+	fprintf(stderr, "  -j  threads, 0 for one per cpu (0)\n");
+	fprintf(stderr, "  -c  command ids (doc/mwifiex/fw.h)\n");
+	fprintf(stderr, "  -m  function map, - for stdout\n");
+	fprintf(stderr, "  -v  every region\n");
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// <addr> <size> <t|a> <callers> <callees> <name>, then the dispatcher
+// cases as <target> case <id> <name>
+static int write_map(const struct fwsym_t *f, const char *path)
+{
+	FILE *fp = strcmp(path, "-") ? fopen(path, "w") : stdout;
+	char buf[FWSYM_NAME];
+
+	if (fp == NULL) {
+		return -1;
+	}
+	for (uint32_t i = 0; i < f->nregion; i++) {
+		const struct fwsym_region_t *r = &f->region[i];
+
+		for (uint32_t k = 0; k < r->nfunc; k++) {
+			const struct fwsym_func_t *fn = &r->func[k];
+
+			fprintf(fp, "%08x %6x %c %4u %4u %s\n", fn->addr, fn->size, (fn->flags & FWSYM_ARM) ? 'a' : 't',
+				fn->callers, fn->callees, fwsym_name(fn, buf, sizeof(buf)));
+		}
+	}
+	if (f->dispatch >= 0) {
+		const struct fwsym_region_t *r = &f->region[f->dispatch];
+
+		for (uint32_t k = 0; k < r->ncase; k++) {
+			const char *name = fwsym_cmd_name(f, r->cases[k].value);
+
+			fprintf(fp, "%08x case %04x %s\n", r->cases[k].target, r->cases[k].value, name ? name : "-");
+		}
+	}
+
+	return (fp == stdout) ? fflush(fp) : fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+	static struct fwsym_t f;
+	char cmds[512];
+	const char *src = __FILE__, *slash = strrchr(src, '/');
+	const char *out = NULL, *map = NULL;
+	uint32_t threads = FWSYM_THREADS_AUTO, funcs = 0, calls = 0;
+	int opt, verbose = 0, ret;
+	double t0, t1;
+
+	snprintf(cmds, sizeof(cmds), "%.*s../../doc/mwifiex/fw.h", slash ? (int)(slash - src + 1) : 0, src);
+
+	while ((opt = getopt(argc, argv, "o:j:c:m:vh")) != -1) {
+		switch (opt) {
+		case 'o': out = optarg; break;
+		case 'j': threads = strtoul(optarg, NULL, 0); break;
+		case 'c': snprintf(cmds, sizeof(cmds), "%s", optarg); break;
+		case 'm': map = optarg; break;
+		case 'v': verbose = 1; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+	if (argc - optind != 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	fwsym_init(&f);
+	if (fwsym_cmds(&f, cmds) < 0) {
+		fprintf(stderr, "%s: cannot read\n", cmds);
+		return 1;
+	}
+	ret = fwsym_open(&f, argv[optind]);
+	if (ret < 0) {
+		fprintf(stderr, "%s: %s\n", argv[optind], (ret == -2) ? "cannot read" : "not an ARM ELF");
+		return 1;
+	}
+
+	t0 = now();
+	if (fwsym_run(&f, threads) < 0) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	t1 = now();
+
+	for (uint32_t i = 0; i < f.nregion; i++) {
+		const struct fwsym_region_t *r = &f.region[i];
+
+		funcs += r->nfunc;
+		calls += r->ncall;
+		if (verbose) {
+			printf("region %08x: %u segments, %u functions, %u calls, %u long branches, %u other bl, %u data, %.1f ms\n",
+				r->base, r->nseg, r->nfunc, r->ncall, r->long_branches, r->stray, r->ndata, r->ms);
+		}
+	}
+	printf("%u functions, %u calls in %u regions on %u threads, %.1f ms\n",
+		funcs, calls, f.nregion, f.threads, (t1 - t0) * 1e3);
+	if (f.dispatch >= 0) {
+		const struct fwsym_region_t *r = &f.region[f.dispatch];
+
+		printf("cmd_dispatch %08x: switch on r%u, %u cases, %u command ids\n",
+			r->func[r->dispatch].addr, r->reg, r->ncase, r->matched);
+	} else {
+		printf("no command dispatcher\n");
+	}
+
+	if (map && write_map(&f, map) < 0) {
+		fprintf(stderr, "%s: cannot write\n", map);
+		return 1;
+	}
+	if (out && (ret = fwsym_write(&f, out)) < 0) {
+		fprintf(stderr, "%s: %s\n", out, (ret == -2) ? "cannot create" : "write failed");
+		return 1;
+	}
+
+	fwsym_free(&f);
+
+	return 0;
+}
@@ -0,0 +1,779 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <elf.h>
+#include <sys/stat.h>
+
+#include "elfout.h"
+#include "fwsym.h"
+#include "test.h"
+
+// a firmware put together instruction by instruction, every function,
+// call, pool and case of it known, through fwsym and back out of the ELF
+// it writes, then the marvell images for what has to hold on real code
+// with -b it measures instead how long full 4 MiB regions take on one
+// thread and on all of them
+
+static char cmds[512];
+
+static uint8_t *load(const char *file, uint64_t *size)
+{
+	struct stat st;
+	uint8_t *buf;
+	int fd = open(file, O_RDONLY);
+
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		return NULL;
+	}
+	buf = malloc(st.st_size + 1);
+	if (buf && read(fd, buf, st.st_size) != st.st_size) {
+		free(buf);
+		buf = NULL;
+	}
+	close(fd);
+	*size = st.st_size;
+
+	return buf;
+}
+
+static int save(const char *file, const uint8_t *buf, uint64_t len)
+{
+	int fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	int ok = fd >= 0 && write(fd, buf, len) == (ssize_t)len;
+
+	close(fd);
+	return ok ? 0 : -1;
+}
+
+// a tiny assembler, forward references are patched once they are known
+struct as_t {
+	uint8_t *buf;
+	uint32_t base;
+	uint32_t pc;
+};
+
+static void h(struct as_t *s, uint16_t hw)
+{
+	s->buf[s->pc - s->base] = hw;
+	s->buf[s->pc - s->base + 1] = hw >> 8;
+	s->pc += 2;
+}
+
+static void w32(struct as_t *s, uint32_t w)
+{
+	h(s, w);
+	h(s, w >> 16);
+}
+
+static void put16(struct as_t *s, uint32_t at, uint16_t hw)
+{
+	s->buf[at - s->base] = hw;
+	s->buf[at - s->base + 1] = hw >> 8;
+}
+
+static void align4(struct as_t *s)
+{
+	if (s->pc & 2) {
+		h(s, 0x0000);
+	}
+}
+
+// bl or blx at site to target
+static void bl_at(struct as_t *s, uint32_t site, uint32_t target, int blx)
+{
+	int32_t off = (int32_t)((blx ? target & ~3 : target) - (site + 4));
+
+	put16(s, site, 0xf000 | ((off >> 12) & 0x7ff));
+	put16(s, site + 2, (blx ? 0xe800 : 0xf800) | ((off >> 1) & 0x7ff));
+}
+
+static uint32_t bl(struct as_t *s, uint32_t target, int blx)
+{
+	uint32_t site = s->pc;
+
+	s->pc += 4;
+	bl_at(s, site, target, blx);
+
+	return site;
+}
+
+static void ldr_at(struct as_t *s, uint32_t site, uint32_t rd, uint32_t pool)
+{
+	put16(s, site, 0x4800 | rd << 8 | (pool - ((site + 4) & ~3)) / 4);
+}
+
+// b<cond> at site to target
+static void bc_at(struct as_t *s, uint32_t site, uint32_t cond, uint32_t target)
+{
+	put16(s, site, 0xd000 | cond << 8 | (((target - site - 4) / 2) & 0xff));
+}
+
+// what the synthetic firmware has where
+struct syn_t {
+	uint8_t code[0x400];
+	uint8_t io[0x100];
+	uint8_t ram[0x100];
+	uint32_t f0, l, ptrf, f2, f3, q, f1, f4, armf, armg, armv, f5, g0, g1;
+	uint32_t pool0, lit107, table, armpool, vpool;
+	uint32_t h3, h6, hb, h107, h19, h1a, h1b;
+};
+
+static void build(struct syn_t *y)
+{
+	struct as_t s = { y->code, 0, 0 }, r = { y->ram, 0xc0000000, 0xc0000000 };
+	uint32_t f0_f1, f0_f2a, f0_f2b, f0_ld, f0_ldp, f0_armf, f0_l, f0_q, f0_armv, f1_ld;
+	uint32_t b3, bne6, b107, bhs, f1_q, tab, cases[3], chain[4];
+	static const uint32_t ids[4] = { 0x0b, 0x10, 0x12, 0x16 };
+
+	memset(y, 0, sizeof(*y));
+	for (uint32_t i = 0; i < sizeof(y->io); i++) {
+		y->io[i] = i * 37 + 11;
+	}
+
+	// f0 calls about everything, with a long branch inside itself
+	y->f0 = s.pc;
+	h(&s, 0xb510);                    // push {r4, lr}
+	f0_f1 = bl(&s, 0, 0);
+	f0_f2a = bl(&s, 0, 0);
+	f0_f2b = bl(&s, 0, 0);
+	f0_ld = s.pc;
+	h(&s, 0x4800);                    // ldr r0, [pc, #pool0]
+	f0_ldp = s.pc;
+	h(&s, 0x4900);                    // ldr r1, [pc, #pool0 + 4]
+	f0_armf = bl(&s, 0, 1);
+	f0_armv = bl(&s, 0, 1);
+	f0_l = bl(&s, 0, 0);
+	h(&s, 0x2200);                    // movs r2, #0
+	y->l = s.pc;
+	h(&s, 0x2001);                    // movs r0, #1
+	f0_q = bl(&s, 0, 0);
+	h(&s, 0xbd10);                    // pop {r4, pc}
+	align4(&s);
+	// a push that is data, a pointer to a function nothing calls
+	y->pool0 = s.pc;
+	w32(&s, 0xb510b510);
+	w32(&s, 0);
+
+	y->ptrf = s.pc;
+	h(&s, 0x2007);                    // movs r0, #7
+	h(&s, 0x4770);                    // bx lr
+	// a leaf right after a return
+	y->f2 = s.pc;
+	h(&s, 0x2000);
+	h(&s, 0x4770);
+	// q is in the middle of f3 and called from two other functions
+	y->f3 = s.pc;
+	h(&s, 0xb500);                    // push {lr}
+	h(&s, 0x2101);                    // movs r1, #1
+	y->q = s.pc;
+	h(&s, 0x2002);
+	h(&s, 0xbd00);                    // pop {pc}
+
+	// the dispatcher, compare chains, a literal and a jump table on r0
+	y->f1 = s.pc;
+	h(&s, 0xb510);
+	h(&s, 0x2803);                    // cmp r0, #3
+	b3 = s.pc;
+	h(&s, 0xd000);                    // beq h3
+	for (int i = 0; i < 4; i++) {
+		h(&s, 0x2800 | ids[i]);
+		chain[i] = s.pc;
+		h(&s, 0xd000);
+	}
+	h(&s, 0x2806);                    // cmp r0, #6
+	bne6 = s.pc;
+	h(&s, 0xd100);                    // bne t
+	y->h6 = s.pc;
+	h(&s, 0x2006);
+	h(&s, 0xbd10);
+	bc_at(&s, bne6, 1, s.pc);
+	f1_ld = s.pc;
+	h(&s, 0x4900);                    // ldr r1, [pc, #lit107]
+	h(&s, 0x4288);                    // cmp r0, r1
+	b107 = s.pc;
+	h(&s, 0xd000);
+	h(&s, 0x3819);                    // subs r0, #0x19
+	h(&s, 0x2803);                    // cmp r0, #3
+	bhs = s.pc;
+	h(&s, 0xd200);                    // bhs default
+	tab = s.pc;
+	h(&s, 0x0040);                    // lsls r0, r0, #1
+	h(&s, 0x4478);                    // add r0, pc
+	h(&s, 0x8880);                    // ldrh r0, [r0, #4]
+	h(&s, 0x0040);
+	h(&s, 0x4487);                    // add pc, r0
+	y->table = s.pc;
+	for (int i = 0; i < 3; i++) {
+		cases[i] = s.pc;
+		h(&s, 0);
+	}
+	y->h19 = s.pc;
+	h(&s, 0x2019);
+	h(&s, 0xbd10);
+	y->h1a = s.pc;
+	h(&s, 0x201a);
+	h(&s, 0xbd10);
+	y->h1b = s.pc;
+	h(&s, 0x201b);
+	h(&s, 0xbd10);
+	put16(&s, cases[0], (y->h19 - (tab + 12)) / 2);
+	put16(&s, cases[1], (y->h1a - (tab + 12)) / 2);
+	put16(&s, cases[2], (y->h1b - (tab + 12)) / 2);
+	bc_at(&s, bhs, 2, s.pc);
+	h(&s, 0x2000);                    // default
+	h(&s, 0xbd10);
+	y->h3 = s.pc;
+	f1_q = bl(&s, 0, 0);
+	h(&s, 0xbd10);
+	bc_at(&s, b3, 0, y->h3);
+	for (int i = 0; i < 4; i++) {
+		uint32_t at = s.pc;
+
+		if (i == 0) {
+			y->hb = at;
+		}
+		h(&s, 0x2000 | ids[i]);
+		h(&s, 0xbd10);
+		bc_at(&s, chain[i], 0, at);
+	}
+	y->h107 = s.pc;
+	h(&s, 0x2001);
+	h(&s, 0xbd10);
+	bc_at(&s, b107, 0, y->h107);
+	align4(&s);
+	y->lit107 = s.pc;
+	w32(&s, 0x107);
+
+	// a switch with a single command id in it
+	y->f4 = s.pc;
+	h(&s, 0xb500);
+	h(&s, 0x2803);
+	h(&s, 0xd001);
+	h(&s, 0x28f1);
+	h(&s, 0xd1ff);
+	h(&s, 0xbd00);
+
+	// arm, called by blx, with a pool and a call of its own, a rom veneer
+	s.pc = 0x200;
+	y->armf = s.pc;
+	w32(&s, 0xe92d4010);              // stmfd sp!, {r4, lr}
+	w32(&s, 0xe59f0004);              // ldr r0, [pc, #4]
+	w32(&s, 0xeb000001);              // bl armg
+	w32(&s, 0xe8bd8010);              // ldmfd sp!, {r4, pc}
+	y->armpool = s.pc;
+	w32(&s, 0x12345678);
+	y->armg = s.pc;
+	w32(&s, 0xe12fff1e);              // bx lr
+	y->armv = s.pc;
+	w32(&s, 0xe51ff004);              // ldr pc, [pc, #-4]
+	y->vpool = s.pc;
+	w32(&s, 0x03f00101);
+	y->f5 = s.pc;
+	h(&s, 0xb500);
+	h(&s, 0xbd00);
+
+	bl_at(&s, f0_f1, y->f1, 0);
+	bl_at(&s, f0_f2a, y->f2, 0);
+	bl_at(&s, f0_f2b, y->f2, 0);
+	ldr_at(&s, f0_ld, 0, y->pool0);
+	ldr_at(&s, f0_ldp, 1, y->pool0 + 4);
+	bl_at(&s, f0_armf, y->armf, 1);
+	bl_at(&s, f0_armv, y->armv, 1);
+	bl_at(&s, f0_l, y->l, 0);
+	bl_at(&s, f0_q, y->q, 0);
+	bl_at(&s, f1_q, y->q, 0);
+	ldr_at(&s, f1_ld, 1, y->lit107);
+	put16(&s, y->pool0 + 4, y->ptrf | 1);
+	put16(&s, y->pool0 + 6, 0);
+
+	y->g0 = r.pc;
+	h(&r, 0xb510);
+	uint32_t g = bl(&r, 0, 0);
+	h(&r, 0xbd10);
+	y->g1 = r.pc;
+	h(&r, 0x2001);
+	h(&r, 0x4770);
+	bl_at(&r, g, y->g1, 0);
+}
+
+static int same_results(const struct fwsym_t *a, const struct fwsym_t *b)
+{
+	if (a->nregion != b->nregion || a->dispatch != b->dispatch) {
+		return 0;
+	}
+	for (uint32_t i = 0; i < a->nregion; i++) {
+		const struct fwsym_region_t *x = &a->region[i], *y = &b->region[i];
+
+		if (x->nfunc != y->nfunc || x->ncall != y->ncall || x->ndata != y->ndata || x->ncase != y->ncase ||
+			x->long_branches != y->long_branches || x->stray != y->stray || x->dispatch != y->dispatch ||
+			memcmp(x->func, y->func, x->nfunc * sizeof(*x->func)) != 0 ||
+			memcmp(x->call, y->call, x->ncall * sizeof(*x->call)) != 0 ||
+			memcmp(x->data, y->data, x->ndata * sizeof(*x->data)) != 0 ||
+			memcmp(x->cases, y->cases, x->ncase * sizeof(*x->cases)) != 0) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int has_call(const struct fwsym_region_t *r, uint32_t from, uint32_t to)
+{
+	uint32_t n = 0;
+
+	for (uint32_t i = 0; i < r->ncall; i++) {
+		n += r->call[i].from == from && r->call[i].to == to;
+	}
+	return n;
+}
+
+static const struct fwsym_data_t *data_at(const struct fwsym_region_t *r, uint32_t addr)
+{
+	for (uint32_t i = 0; i < r->ndata; i++) {
+		if (r->data[i].addr == addr) {
+			return &r->data[i];
+		}
+	}
+	return NULL;
+}
+
+static uint32_t case_of(const struct fwsym_region_t *r, uint32_t value)
+{
+	for (uint32_t i = 0; i < r->ncase; i++) {
+		if (r->cases[i].value == value) {
+			return r->cases[i].target;
+		}
+	}
+	return ~0u;
+}
+
+static int check_synthetic(const struct syn_t *y, struct fwsym_t *f)
+{
+	const struct fwsym_region_t *r = &f->region[0], *io = &f->region[1], *ram = &f->region[2];
+	const uint32_t want[] = { y->f0, y->ptrf, y->f2, y->f3, y->q, y->f1, y->f4, y->armf, y->armg, y->armv, y->f5 };
+	const struct fwsym_data_t *d;
+	int fail = 0;
+
+	fail |= check("regions", f->nregion == 3 && r->base == 0 && io->base == 0x04000000 && ram->base == 0xc0000000);
+	fail |= check("functions", r->nfunc == sizeof(want) / sizeof(want[0]));
+	for (uint32_t i = 0; i < r->nfunc && i < sizeof(want) / sizeof(want[0]); i++) {
+		char what[64];
+
+		snprintf(what, sizeof(what), "function %x at %x", want[i], r->func[i].addr);
+		fail |= check(what, r->func[i].addr == want[i]);
+	}
+	if (fail) {
+		return fail;
+	}
+
+	fail |= check("f0 prologue", r->func[0].flags == (FWSYM_THUMB | FWSYM_PROLOGUE));
+	fail |= check("pointer", r->func[1].flags == (FWSYM_THUMB | FWSYM_POINTER | FWSYM_AFTER) && r->func[1].callers == 0);
+	fail |= check("leaf after return", (r->func[2].flags & FWSYM_AFTER) && r->func[2].callers == 2);
+	fail |= check("called from two", (r->func[4].flags & FWSYM_CALLERS) && r->func[3].size == 4);
+	fail |= check("arm", r->func[7].flags == (FWSYM_ARM | FWSYM_BLX | FWSYM_PROLOGUE) && (r->func[8].flags & FWSYM_ARM));
+	fail |= check("veneer", r->func[9].size == 8 && (r->func[9].flags & FWSYM_ARM));
+	fail |= check("size", r->func[0].size == y->ptrf - y->f0 && r->func[10].size == 0x400 - y->f5);
+
+	fail |= check("calls", r->ncall == 8);
+	fail |= check("f0 calls", has_call(r, y->f0, y->f1) == 1 && has_call(r, y->f0, y->f2) == 2 &&
+		has_call(r, y->f0, y->armf) == 1 && has_call(r, y->f0, y->armv) == 1 && has_call(r, y->f0, y->q) == 1);
+	fail |= check("other calls", has_call(r, y->f1, y->q) == 1 && has_call(r, y->armf, y->armg) == 1);
+	fail |= check("call counts", r->func[0].callees == 6 && r->func[4].callers == 2 && r->func[5].callers == 1);
+	fail |= check("long branch", r->long_branches == 1 && r->stray == 0);
+	fail |= check("in f0", fwsym_func_at(f, y->l) == &r->func[0] && fwsym_func_at(f, 0x04000010) == NULL);
+
+	d = data_at(r, y->pool0);
+	fail |= check("pool", d && d->len == 8 && d->kind == FWSYM_POOL);
+	d = data_at(r, y->table);
+	fail |= check("table", d && d->len == 6 && d->kind == FWSYM_TABLE);
+	fail |= check("pools", data_at(r, y->lit107) && data_at(r, y->armpool) && data_at(r, y->vpool) && r->ndata == 5);
+
+	fail |= check("dispatcher", f->dispatch == 0 && r->dispatch == 5 && r->reg == 0 && r->matched == 10 && r->ncase == 10);
+	fail |= check("dispatcher name", strcmp(r->func[5].name, "cmd_dispatch") == 0 && r->func[6].name[0] == 0);
+	fail |= check("cases", case_of(r, 3) == y->h3 && case_of(r, 6) == y->h6 && case_of(r, 0xb) == y->hb &&
+		case_of(r, 0x107) == y->h107 && case_of(r, 0x19) == y->h19 && case_of(r, 0x1a) == y->h1a && case_of(r, 0x1b) == y->h1b);
+	fail |= check("no switch in ram", ram->dispatch == -1);
+
+	fail |= check("no code", io->nfunc == 0 && io->ncall == 0 && io->ndata == 0);
+	fail |= check("ram", ram->nfunc == 2 && ram->ncall == 1 && ram->func[0].addr == y->g0 && ram->func[1].addr == y->g1);
+
+	return fail;
+}
+
+static uint32_t sym_count(const uint8_t *buf, const Elf32_Shdr *symtab, const char *strs, const char *name, uint32_t value)
+{
+	const Elf32_Sym *sym = (const Elf32_Sym *)(buf + symtab->sh_offset);
+	uint32_t n = 0;
+
+	for (uint32_t i = 0; i < symtab->sh_size / sizeof(*sym); i++) {
+		n += strcmp(strs + sym[i].st_name, name) == 0 && sym[i].st_value == value;
+	}
+	return n;
+}
+
+static const Elf32_Sym *sym_find(const uint8_t *buf, const Elf32_Shdr *symtab, const char *strs, const char *name, uint32_t value, uint32_t *idx)
+{
+	const Elf32_Sym *sym = (const Elf32_Sym *)(buf + symtab->sh_offset);
+
+	for (uint32_t i = 0; i < symtab->sh_size / sizeof(*sym); i++) {
+		if (strcmp(strs + sym[i].st_name, name) == 0 && (value == ~0u || sym[i].st_value == value)) {
+			if (idx) {
+				*idx = i;
+			}
+			return &sym[i];
+		}
+	}
+	return NULL;
+}
+
+static int check_elf(const char *dir, const struct syn_t *y)
+{
+	static struct fwsym_t f, g, one, many;
+	static struct elfout_t e;
+	char file[512], elf[512], out[512];
+	const Elf32_Ehdr *eh;
+	const Elf32_Shdr *sh, *symtab = NULL, *strtab = NULL;
+	const Elf32_Sym *s;
+	uint8_t *a, *b, *src;
+	uint64_t alen, blen, srclen;
+	uint32_t idx, code = 0;
+	int fail = 0, fd;
+
+	snprintf(file, sizeof(file), "%s/code.bin", dir);
+	save(file, y->code, sizeof(y->code));
+	snprintf(file, sizeof(file), "%s/io.bin", dir);
+	save(file, y->io, sizeof(y->io));
+	snprintf(file, sizeof(file), "%s/ram.bin", dir);
+	save(file, y->ram, sizeof(y->ram));
+	snprintf(file, sizeof(file), "%s/fw.map", dir);
+	fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	dprintf(fd, "0 400 rwx code.bin .code\n4000000 100 rw- io.bin .io\nc0000000 100 rwx ram.bin .ram\n");
+	close(fd);
+
+	snprintf(elf, sizeof(elf), "%s/fw.elf", dir);
+	elfout_init(&e);
+	fail |= check("map", elfout_map(&e, file) == 0 && elfout_layout(&e) == 0);
+	fd = open(elf, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	fail |= check("elf", fd >= 0 && elfout_write(&e, fd, ELFOUT_AUTO) == 0);
+	close(fd);
+	elfout_close(&e);
+
+	fwsym_init(&f);
+	fail |= check("cmds", fwsym_cmds(&f, cmds) > 60);
+	fail |= check("open", fwsym_open(&f, elf) == 0 && f.nseg == 3);
+	fail |= check("run", fwsym_run(&f, FWSYM_THREADS_AUTO) == 0);
+	if (fail) {
+		return fail;
+	}
+	fail |= check_synthetic(y, &f);
+
+	// one thread, more than there are regions
+	fwsym_init(&one);
+	fwsym_init(&many);
+	fwsym_cmds(&one, cmds);
+	fwsym_cmds(&many, cmds);
+	fwsym_open(&one, elf);
+	fwsym_open(&many, elf);
+	fail |= check("one thread", fwsym_run(&one, 1) == 0 && one.threads == 1 && same_results(&f, &one));
+	fail |= check("threads", fwsym_run(&many, 8) == 0 && many.threads == 3 && same_results(&f, &many));
+	fail |= check("run again", fwsym_run(&many, 2) == 0 && same_results(&f, &many));
+	fwsym_free(&one);
+	fwsym_free(&many);
+
+	snprintf(out, sizeof(out), "%s/fw-sym.elf", dir);
+	fail |= check("write", fwsym_write(&f, out) == 0);
+	fail |= check("write nowhere", fwsym_write(&f, "/nonexistent/fw.elf") == -2);
+	fwsym_free(&f);
+	fail |= check("write nothing", fwsym_write(&f, out) == -1);
+
+	a = load(out, &alen);
+	src = load(elf, &srclen);
+	if (check("read back", a != NULL && src != NULL)) {
+		return 1;
+	}
+	eh = (const Elf32_Ehdr *)a;
+	sh = (const Elf32_Shdr *)(a + eh->e_shoff);
+	fail |= check("headers", eh->e_shoff + eh->e_shnum * sizeof(*sh) == alen && eh->e_shstrndx == eh->e_shnum - 1);
+	for (uint32_t i = 0; i < eh->e_shnum; i++) {
+		const char *name = (const char *)a + sh[eh->e_shstrndx].sh_offset + sh[i].sh_name;
+
+		if (sh[i].sh_type == SHT_SYMTAB) {
+			symtab = &sh[i];
+			strtab = &sh[sh[i].sh_link];
+		}
+		if (strcmp(name, ".code") == 0) {
+			code = i;
+		}
+	}
+	if (check("symtab", symtab && strtab && strtab->sh_type == SHT_STRTAB && code)) {
+		return 1;
+	}
+
+	// the loaded bytes stay where they were
+	const Elf32_Phdr *ph = (const Elf32_Phdr *)(a + eh->e_phoff);
+	for (uint32_t i = 0; i < eh->e_phnum; i++) {
+		fail |= check("segment bytes", ph[i].p_offset + ph[i].p_filesz <= srclen &&
+			memcmp(a + ph[i].p_offset, src + ph[i].p_offset, ph[i].p_filesz) == 0);
+	}
+
+	const char *strs = (const char *)a + strtab->sh_offset;
+	s = sym_find(a, symtab, strs, "cmd_dispatch", ~0u, &idx);
+	fail |= check("dispatch symbol", s && s->st_value == (y->f1 | 1) && s->st_size == y->f4 - y->f1 &&
+		ELF32_ST_TYPE(s->st_info) == STT_FUNC && ELF32_ST_BIND(s->st_info) == STB_GLOBAL &&
+		s->st_shndx == code && idx >= symtab->sh_info);
+	snprintf(file, sizeof(file), "sub_%08x", y->armf);
+	s = sym_find(a, symtab, strs, file, ~0u, NULL);
+	fail |= check("arm symbol", s && s->st_value == y->armf);
+	s = sym_find(a, symtab, strs, "$a", y->armf, &idx);
+	fail |= check("$a", s && ELF32_ST_BIND(s->st_info) == STB_LOCAL && idx < symtab->sh_info);
+	fail |= check("$d", sym_find(a, symtab, strs, "$d", y->pool0, NULL) && sym_find(a, symtab, strs, "$d", y->table, NULL));
+	fail |= check("$t after table", sym_find(a, symtab, strs, "$t", y->table + 6, NULL) != NULL);
+	fail |= check("one $a at a function", sym_count(a, symtab, strs, "$a", y->armpool + 4) == 1);
+	fail |= check("cases", sym_find(a, symtab, strs, "cmd_get_hw_spec", y->h3, NULL) &&
+		sym_find(a, symtab, strs, "cmd_802_11_scan_ext", y->h107, NULL) &&
+		sym_find(a, symtab, strs, "cmd_mac_reg_access", y->h19, NULL));
+	fail |= check("symbols", symtab->sh_size / sizeof(*s) == 1 + 13 + 5 + 1 + 10 + 13);
+
+	// again over the written one into itself, nothing changes
+	fwsym_init(&g);
+	fwsym_cmds(&g, cmds);
+	fail |= check("reopen", fwsym_open(&g, out) == 0 && fwsym_run(&g, 1) == 0 && fwsym_write(&g, out) == 0);
+	fwsym_free(&g);
+	b = load(out, &blen);
+	fail |= check("idempotent", b && blen == alen && memcmp(a, b, alen) == 0);
+
+	free(a);
+	free(b);
+	free(src);
+
+	return fail;
+}
+
+static int check_errors(const char *dir)
+{
+	static struct fwsym_t f;
+	static uint8_t mem[16];
+	char file[512];
+	int fail = 0;
+
+	fwsym_init(&f);
+	fail |= check("cmds missing", fwsym_cmds(&f, "/nonexistent/fw.h") == -2);
+	fail |= check("open missing", fwsym_open(&f, "/nonexistent/fw.elf") == -2);
+	fwsym_free(&f);
+	snprintf(file, sizeof(file), "%s/fw.map", dir);
+	fail |= check("open not elf", fwsym_open(&f, file) == -1);
+	fwsym_free(&f);
+
+	fail |= check("add empty", fwsym_add(&f, 0, mem, 0, PF_X) == -1);
+	fail |= check("add across regions", fwsym_add(&f, 0x3ffff8, mem, 16, PF_X) == -1);
+	for (uint32_t i = 0; i < FWSYM_REGIONS_MAX; i++) {
+		fwsym_add(&f, i << 24, mem, sizeof(mem), PF_X);
+	}
+	fail |= check("add regions", f.nregion == FWSYM_REGIONS_MAX && fwsym_add(&f, 0xff000000, mem, 16, PF_X) == -1);
+	fail |= check("add in region", fwsym_add(&f, 0x100, mem, 16, PF_X) == FWSYM_REGIONS_MAX);
+	fail |= check("run tiny", fwsym_run(&f, FWSYM_THREADS_AUTO) == 0 && f.dispatch == -1);
+	fwsym_free(&f);
+
+	return fail;
+}
+
+// what has to hold on real code, every call on a function start, no
+// function over another, the 8787 dispatcher where it is
+static int check_image(const char *dir, const char *image, int is8787)
+{
+	static struct fwsym_t f;
+	static struct elfout_t e;
+	char elf[512];
+	uint32_t funcs = 0, bad = 0;
+	int fail = 0, fd;
+
+	if (access(image, R_OK) != 0) {
+		printf("image:    %s not there, skipped\n", image);
+		return 0;
+	}
+	snprintf(elf, sizeof(elf), "%s/image.elf", dir);
+	elfout_init(&e);
+	fail |= check("image", elfout_image(&e, image) == 0 && elfout_layout(&e) == 0);
+	fd = open(elf, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	fail |= check("image elf", fd >= 0 && elfout_write(&e, fd, ELFOUT_AUTO) == 0);
+	close(fd);
+	elfout_close(&e);
+
+	fwsym_init(&f);
+	fwsym_cmds(&f, cmds);
+	fail |= check("image run", fwsym_open(&f, elf) == 0 && fwsym_run(&f, FWSYM_THREADS_AUTO) == 0);
+	for (uint32_t i = 0; i < f.nregion && !fail; i++) {
+		const struct fwsym_region_t *r = &f.region[i];
+
+		funcs += r->nfunc;
+		for (uint32_t k = 0; k < r->nfunc; k++) {
+			bad += r->func[k].size == 0 || (k && r->func[k - 1].addr + r->func[k - 1].size > r->func[k].addr);
+		}
+		for (uint32_t k = 0; k < r->ncall; k++) {
+			const struct fwsym_func_t *from = fwsym_func_at(&f, r->call[k].site), *to = fwsym_func_at(&f, r->call[k].to);
+
+			bad += from == NULL || to == NULL || from->addr != r->call[k].from || to->addr != r->call[k].to;
+		}
+	}
+	fail |= check("image functions", funcs > 500 && bad == 0);
+	fail |= check("image dispatcher", f.dispatch >= 0 && f.region[f.dispatch].matched >= FWSYM_DISPATCH_MIN);
+	if (is8787 && f.dispatch >= 0) {
+		const struct fwsym_region_t *r = &f.region[f.dispatch];
+		uint32_t at = r->func[r->dispatch].addr;
+
+		fail |= check("8787 dispatcher", r->base == 0 && at >= 0x19000 && at < 0x1a800 && r->matched >= 40);
+		fail |= check("8787 jump table", case_of(r, 0x16) == 0x1a3ae);
+	}
+	printf("image:    %u functions, dispatcher %08x with %u ids, %s\n", funcs,
+		(f.dispatch >= 0) ? f.region[f.dispatch].func[f.region[f.dispatch].dispatch].addr : 0,
+		(f.dispatch >= 0) ? f.region[f.dispatch].matched : 0, strrchr(image, '/') ? strrchr(image, '/') + 1 : image);
+	fwsym_free(&f);
+
+	return fail;
+}
+
+static void bench_run(struct fwsym_t *f, uint32_t rounds)
+{
+	uint64_t bytes = 0;
+	uint32_t funcs = 0;
+
+	for (uint32_t i = 0; i < f->nseg; i++) {
+		bytes += f->seg[i].size;
+	}
+	for (int auto_threads = 0; auto_threads < 2; auto_threads++) {
+		double best = 1e9;
+
+		for (uint32_t k = 0; k < rounds; k++) {
+			double t0 = now(), t;
+
+			fwsym_run(f, auto_threads ? FWSYM_THREADS_AUTO : 1);
+			t = now() - t0;
+			if (t < best) {
+				best = t;
+			}
+		}
+		funcs = 0;
+		for (uint32_t i = 0; i < f->nregion; i++) {
+			funcs += f->region[i].nfunc;
+		}
+		printf("  %u threads: %8.1f ms  %7.1f MiB/s  %u functions\n", f->threads, best * 1e3,
+			bytes / (double)(1 << 20) / best, funcs);
+	}
+	for (uint32_t i = 0; i < f->nregion; i++) {
+		printf("  region %08x: %.1f ms\n", f->region[i].base, f->region[i].ms);
+	}
+}
+
+// the code of the 8787 image over code ram, rom and ram the size app/dump.c
+// dumps them, then over whole regions
+static int bench(const char *dir, const char *image, uint32_t mib, uint32_t rounds)
+{
+	static const uint32_t dump[3][2] = { { 0x00000000, 0x60000 }, { 0x03f00000, 0x50000 }, { 0xc0000000, 0x40000 } };
+	static const uint32_t whole[3] = { 0x00000000, 0x03c00000, 0xc0000000 };
+	static struct fwsym_t f;
+	static struct elfout_t e;
+	char elf[512];
+	uint32_t size = mib << 20, code;
+	uint8_t *mem;
+	int fd;
+
+	if (size > ~FWSYM_REGION_MASK + 1) {
+		size = ~FWSYM_REGION_MASK + 1;
+	}
+	snprintf(elf, sizeof(elf), "%s/image.elf", dir);
+	elfout_init(&e);
+	fd = open(elf, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (elfout_image(&e, image) < 0 || elfout_layout(&e) < 0 || fd < 0 || elfout_write(&e, fd, ELFOUT_AUTO) < 0) {
+		printf("%s: cannot convert\n", image);
+		return 1;
+	}
+	close(fd);
+	elfout_close(&e);
+
+	fwsym_init(&f);
+	if (fwsym_open(&f, elf) < 0 || f.seg[0].vaddr != 0) {
+		printf("%s: no code at 0\n", image);
+		return 1;
+	}
+	code = f.seg[0].size & ~3;
+	mem = malloc(size);
+	for (uint32_t i = 0; i < size; i += code) {
+		memcpy(mem + i, f.seg[0].data, (size - i < code) ? size - i : code);
+	}
+	fwsym_free(&f);
+
+	printf("bench:    %ld cpus\n", sysconf(_SC_NPROCESSORS_ONLN));
+	fwsym_init(&f);
+	fwsym_cmds(&f, cmds);
+	for (uint32_t i = 0; i < 3; i++) {
+		fwsym_add(&f, dump[i][0], mem, (dump[i][1] < size) ? dump[i][1] : size, PF_R | PF_X);
+	}
+	printf("dumps:    code ram, rom and ram\n");
+	bench_run(&f, rounds);
+	fwsym_free(&f);
+
+	fwsym_init(&f);
+	fwsym_cmds(&f, cmds);
+	for (uint32_t i = 0; i < 3; i++) {
+		fwsym_add(&f, whole[i], mem, size, PF_R | PF_X);
+	}
+	printf("regions:  3 of %u KiB\n", size >> 10);
+	bench_run(&f, rounds);
+	fwsym_free(&f);
+	free(mem);
+
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-b] [-m MiB] [-n rounds] [-o dir]\n", name);
+	fprintf(stderr, "  -b  time full regions instead of the checks\n");
+	fprintf(stderr, "  -m  size of each region for -b, at most 4 (4)\n");
+	fprintf(stderr, "  -n  rounds for -b, the best counts (5)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	static struct syn_t y;
+	char image[512], image2[512];
+	const char *dir = "/tmp/fwsymtest";
+	const char *src = __FILE__, *slash = strrchr(src, '/');
+	int len = slash ? (int)(slash - src + 1) : 0;
+	uint32_t mib = 4, rounds = 5;
+	int opt, fail = 0, do_bench = 0;
+
+	snprintf(cmds, sizeof(cmds), "%.*s../../doc/mwifiex/fw.h", len, src);
+	snprintf(image, sizeof(image), "%.*s../../doc/marvell/sd8787_uapsta.bin", len, src);
+	snprintf(image2, sizeof(image2), "%.*s../../doc/marvell/sd8797_uapsta.bin", len, src);
+
+	while ((opt = getopt(argc, argv, "bm:n:o:h")) != -1) {
+		switch (opt) {
+		case 'b': do_bench = 1; break;
+		case 'm': mib = strtoul(optarg, NULL, 0); break;
+		case 'n': rounds = strtoul(optarg, NULL, 0); break;
+		case 'o': dir = optarg; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	mkdir(dir, 0755);
+
+	if (do_bench) {
+		return bench(dir, image, mib ? mib : 1, rounds ? rounds : 1);
+	}
+
+	build(&y);
+	fail |= check_elf(dir, &y);
+	fail |= check_errors(dir);
+	fail |= check_image(dir, image, 1);
+	fail |= check_image(dir, image2, 0);
+
+	printf("%s\n", fail ? "FAIL" : "ok");
+
+	return fail ? 2 : 0;
+}
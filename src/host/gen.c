@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sdiogen.h"
+
+// sdiotrace generator, synthetic scenarios or radiotap pcap conversion
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [options] [-o out.trace]\n", name);
+	fprintf(stderr, "  -p file      convert radiotap/802.11 pcap instead of generating\n");
+	fprintf(stderr, "  -n frames    number of frames (default 100000)\n");
+	fprintf(stderr, "  -s seed      random seed (default 1)\n");
+	fprintf(stderr, "  -m b,p,d,a,r frame mix weights: beacon,probe,data,amsdu,bar\n");
+	fprintf(stderr, "  -B bss       number of BSSes\n");
+	fprintf(stderr, "  -S sta       station population\n");
+	fprintf(stderr, "  -c permille  station churn per frame\n");
+	fprintf(stderr, "  -H ht,40,sgi percent of HT frames, of those 40MHz and SGI\n");
+	fprintf(stderr, "  -q mean,dev  snr distribution\n");
+	fprintf(stderr, "  -f mean,dev  noise floor distribution\n");
+	fprintf(stderr, "  -L min,max   data payload length\n");
+	fprintf(stderr, "  -a n         max A-MSDU subframes\n");
+	fprintf(stderr, "  -r fps       mean frame rate\n");
+	fprintf(stderr, "  -b len,gap   burst length and gap inside a burst (us)\n");
+}
+
+static int parse_list(const char *s, int32_t *v, int max)
+{
+	int n = 0;
+	char *end;
+
+	while (n < max) {
+		v[n++] = strtol(s, &end, 0);
+		if (*end != ',') {
+			break;
+		}
+		s = end + 1;
+	}
+
+	return n;
+}
+
+int main(int argc, char *argv[])
+{
+	struct sdiogen_cfg_t cfg;
+	const char *out = NULL, *pcap = NULL;
+	int32_t v[5];
+	int opt, ret;
+
+	sdiogen_default(&cfg);
+
+	while ((opt = getopt(argc, argv, "o:p:n:s:m:B:S:c:H:q:f:L:a:r:b:h")) != -1) {
+		switch (opt) {
+		case 'o': out = optarg; break;
+		case 'p': pcap = optarg; break;
+		case 'n': cfg.frames = strtoul(optarg, NULL, 0); break;
+		case 's': cfg.seed = strtoul(optarg, NULL, 0); break;
+		case 'm':
+			if (parse_list(optarg, v, 5) != 5) {
+				usage(argv[0]);
+				return 1;
+			}
+			cfg.w_beacon = v[0];
+			cfg.w_probe = v[1];
+			cfg.w_data = v[2];
+			cfg.w_amsdu = v[3];
+			cfg.w_bar = v[4];
+			break;
+		case 'B': cfg.bss = strtoul(optarg, NULL, 0); break;
+		case 'S': cfg.stations = strtoul(optarg, NULL, 0); break;
+		case 'c': cfg.churn_pm = strtoul(optarg, NULL, 0); break;
+		case 'H':
+			if (parse_list(optarg, v, 3) != 3) {
+				usage(argv[0]);
+				return 1;
+			}
+			cfg.ht_pct = v[0];
+			cfg.ht40_pct = v[1];
+			cfg.sgi_pct = v[2];
+			break;
+		case 'q':
+			if (parse_list(optarg, v, 2) != 2) {
+				usage(argv[0]);
+				return 1;
+			}
+			cfg.snr_mean = v[0];
+			cfg.snr_dev = v[1];
+			break;
+		case 'f':
+			if (parse_list(optarg, v, 2) != 2) {
+				usage(argv[0]);
+				return 1;
+			}
+			cfg.nf_mean = v[0];
+			cfg.nf_dev = v[1];
+			break;
+		case 'L':
+			if (parse_list(optarg, v, 2) != 2) {
+				usage(argv[0]);
+				return 1;
+			}
+			cfg.len_min = v[0];
+			cfg.len_max = v[1];
+			break;
+		case 'a': cfg.amsdu_max = strtoul(optarg, NULL, 0); break;
+		case 'r': cfg.rate = strtoul(optarg, NULL, 0); break;
+		case 'b':
+			if (parse_list(optarg, v, 2) != 2) {
+				usage(argv[0]);
+				return 1;
+			}
+			cfg.burst_len = v[0];
+			cfg.burst_gap_us = v[1];
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	FILE *f = out ? fopen(out, "wb") : stdout;
+	if (f == NULL) {
+		perror(out);
+		return 1;
+	}
+
+	if (sdiogen_trace_open(f) < 0) {
+		fprintf(stderr, "write failed\n");
+		return 1;
+	}
+
+	if (pcap) {
+		ret = sdiogen_from_pcap(pcap, sdiogen_trace_cb, f);
+	} else {
+		static struct sdiogen_t g;
+
+		ret = sdiogen_init(&g, &cfg);
+		if (ret < 0) {
+			fprintf(stderr, "bad config (%d)\n", ret);
+			return 1;
+		}
+		ret = sdiogen_run(&g, sdiogen_trace_cb, f);
+	}
+
+	if (f != stdout) {
+		fclose(f);
+	}
+
+	if (ret < 0) {
+		fprintf(stderr, "failed (%d)\n", ret);
+		return 1;
+	}
+
+	fprintf(stderr, "%d frames\n", ret);
+
+	return 0;
+}
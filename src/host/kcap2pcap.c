@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "kcapio.h"
+
+// .kcap to plain pcap, a damaged or truncated capture gives what is left intact
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-v] in.kcap out.pcap\n", name);
+	fprintf(stderr, "  -v  print block counts, compression ratio and decode speed\n");
+}
+
+int main(int argc, char *argv[])
+{
+	static struct kcap_reader_t r;
+	struct stat in, out;
+	int verbose = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "vh")) != -1) {
+		switch (opt) {
+		case 'v': verbose = 1; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	if (argc - optind != 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	uint64_t t = now_ns();
+	int64_t recs = kcap_to_pcap(argv[optind], argv[optind + 1], &r);
+	t = now_ns() - t;
+
+	if (recs < 0) {
+		fprintf(stderr, "%s: %s\n", recs == -2 || recs == -3 ? argv[optind + 1] : argv[optind],
+			recs == -1 ? "not a kcap file" : "write failed");
+		return 1;
+	}
+
+	if (r.bad || r.skipped || r.truncated) {
+		fprintf(stderr, "damaged: %u bad blocks, %llu bytes skipped, %llu bytes truncated\n",
+			r.bad, (unsigned long long)r.skipped, (unsigned long long)r.truncated);
+	}
+
+	if (verbose && stat(argv[optind], &in) == 0 && stat(argv[optind + 1], &out) == 0) {
+		printf("records:  %lld\n", (long long)recs);
+		printf("blocks:   %u (%u stored)\n", r.blocks, r.stored);
+		printf("size:     %lld -> %lld bytes, ratio %.2f\n", (long long)in.st_size, (long long)out.st_size,
+			in.st_size ? (double)out.st_size / in.st_size : 0.0);
+		printf("decode:   %.1f MB/s\n", t ? out.st_size * 1e3 / t : 0.0);
+	}
+
+	return (r.bad || r.skipped) ? 2 : 0;
+}
@@ -0,0 +1,225 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "pcap.h"
+
+#include "kcapio.h"
+
+int kcap_reader_open(struct kcap_reader_t *r, const char *file)
+{
+	memset(r, 0, sizeof(*r));
+
+	r->f = fopen(file, "rb");
+	if (r->f == NULL) {
+		return -1;
+	}
+
+	if (fread(&r->hdr, sizeof(r->hdr), 1, r->f) != 1 ||
+	    memcmp(r->hdr.magic, KCAP_MAGIC, sizeof(r->hdr.magic)) ||
+	    r->hdr.version != KCAP_VERSION || r->hdr.block_max > LZ4BLK_MAX) {
+		kcap_reader_close(r);
+		return -2;
+	}
+
+	r->off = sizeof(r->hdr);
+	r->end = r->off;
+
+	return 0;
+}
+
+void kcap_reader_close(struct kcap_reader_t *r)
+{
+	if (r->f) {
+		fclose(r->f);
+		r->f = NULL;
+	}
+}
+
+int kcap_reader_seek(struct kcap_reader_t *r, uint64_t off)
+{
+	if (fseeko(r->f, off, SEEK_SET) < 0) {
+		return -1;
+	}
+
+	r->off = off;
+
+	return 0;
+}
+
+// read at r->off, returns bytes read
+static size_t kcap_read(struct kcap_reader_t *r, void *buf, size_t len)
+{
+	if (fseeko(r->f, r->off, SEEK_SET) < 0) {
+		return 0;
+	}
+
+	return fread(buf, 1, len, r->f);
+}
+
+int kcap_reader_next(struct kcap_reader_t *r, struct kcap_blk_t *b, uint8_t *raw)
+{
+	uint64_t resync = 0;
+
+	while (1) {
+		size_t n = kcap_read(r, b, sizeof(*b));
+
+		if (n < sizeof(*b)) {
+			r->truncated += n;
+			r->skipped += resync;
+			return 0;
+		}
+
+		if (r->strict && kcap_blk_check(b, r->hdr.block_max) < 0) {
+			r->bad++;
+			return 0;
+		}
+
+		if (kcap_blk_check(b, r->hdr.block_max) < 0) {
+			// look for the next block header one byte further
+			r->off++;
+			resync++;
+			continue;
+		}
+
+		uint64_t at = r->off;
+		uint8_t *payload = r->zbuf + sizeof(*b);
+
+		r->off += sizeof(*b);
+		n = kcap_read(r, payload, b->len);
+		if (n < b->len) {
+			r->off = at;
+			r->truncated += sizeof(*b) + n;
+			r->skipped += resync;
+			return 0;
+		}
+		r->off += b->len;
+
+		int len;
+		if (b->flags & KCAP_BLK_STORED) {
+			memcpy(raw, payload, b->len);
+			len = b->len;
+		} else {
+			len = lz4blk_decompress(payload, b->len, raw, b->raw_len);
+		}
+
+		if (len != (int)b->raw_len || kcap_sum(1, raw, len) != b->sum) {
+			r->bad++;
+			if (r->strict) {
+				r->off = at;
+				return 0;
+			}
+			// header was intact, the next block starts right after it
+			continue;
+		}
+
+		r->skipped += resync;
+		resync = 0;
+		r->blocks++;
+		if (b->flags & KCAP_BLK_STORED) {
+			r->stored++;
+		}
+		r->end = r->off;
+
+		if (len > 0) {
+			return len;
+		}
+	}
+}
+
+int kcap_file_kind(const char *file, uint8_t *pcap_hdr)
+{
+	struct kcap_hdr_t h;
+	FILE *f = fopen(file, "rb");
+	int ret = -1;
+
+	if (f == NULL) {
+		return -1;
+	}
+
+	if (fread(&h, 1, sizeof(h), f) >= sizeof(pcap_hdr_t)) {
+		if (memcmp(h.magic, KCAP_MAGIC, sizeof(h.magic)) == 0) {
+			memcpy(pcap_hdr, h.pcap, sizeof(h.pcap));
+			ret = 1;
+		} else if (*(uint32_t *)&h == 0xa1b2c3d4) {
+			memcpy(pcap_hdr, &h, sizeof(pcap_hdr_t));
+			ret = 0;
+		}
+	}
+
+	fclose(f);
+
+	return ret;
+}
+
+int64_t kcap_to_pcap(const char *in, const char *out, struct kcap_reader_t *r)
+{
+	static uint8_t raw[LZ4BLK_MAX];
+	struct kcap_blk_t b;
+	int64_t recs = 0;
+	FILE *f;
+	int len;
+
+	if (kcap_reader_open(r, in) < 0) {
+		return -1;
+	}
+
+	f = fopen(out, "wb");
+	if (f == NULL) {
+		kcap_reader_close(r);
+		return -2;
+	}
+
+	if (fwrite(r->hdr.pcap, sizeof(r->hdr.pcap), 1, f) != 1) {
+		recs = -3;
+	}
+
+	while (recs >= 0 && (len = kcap_reader_next(r, &b, raw)) > 0) {
+		if (fwrite(raw, len, 1, f) != 1) {
+			recs = -3;
+			break;
+		}
+		recs += b.nrec;
+	}
+
+	if (fclose(f) != 0 && recs >= 0) {
+		recs = -3;
+	}
+	kcap_reader_close(r);
+
+	return recs;
+}
+
+struct kidx_ent_t *kidx_load(const char *file, struct kidx_hdr_t *hdr, uint32_t *n)
+{
+	struct kidx_ent_t *ents = NULL;
+	uint32_t max = 0;
+	FILE *f;
+
+	*n = 0;
+
+	f = fopen(file, "rb");
+	if (f == NULL) {
+		return NULL;
+	}
+
+	if (fread(hdr, sizeof(*hdr), 1, f) != 1 || kidx_hdr_check(hdr) < 0) {
+		fclose(f);
+		return NULL;
+	}
+
+	while (1) {
+		if (*n == max) {
+			max = max ? max * 2 : 1024;
+			ents = realloc(ents, max * sizeof(*ents));
+		}
+
+		if (fread(&ents[*n], sizeof(*ents), 1, f) != 1 || kidx_ent_check(&ents[*n]) < 0) {
+			break;
+		}
+		(*n)++;
+	}
+
+	fclose(f);
+
+	return ents;
+}
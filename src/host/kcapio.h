@@ -0,0 +1,44 @@
+#ifndef KCAPIO_h_
+#define KCAPIO_h_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "kcap.h"
+#include "lz4blk.h"
+#include "kidx.h"
+
+// sequential .kcap reader, damaged blocks are skipped by scanning for
+// the next valid block header, a truncated tail ends the file
+// in strict mode the first damaged block ends the file instead
+
+struct kcap_reader_t {
+	FILE *f;
+	struct kcap_hdr_t hdr;
+	uint64_t off;            // file offset of the next block
+	uint64_t end;            // offset after the last good block
+	int strict;
+	uint32_t blocks;
+	uint32_t stored;
+	uint32_t bad;            // blocks failing the checksum or not decoding
+	uint64_t skipped;        // bytes skipped while resyncing
+	uint64_t truncated;      // bytes of an incomplete last block
+	uint8_t zbuf[sizeof(struct kcap_blk_t) + LZ4BLK_BOUND(LZ4BLK_MAX)];
+};
+
+int kcap_reader_open(struct kcap_reader_t *r, const char *file);
+void kcap_reader_close(struct kcap_reader_t *r);
+// raw holds LZ4BLK_MAX bytes, returns raw length, 0 at the end
+int kcap_reader_next(struct kcap_reader_t *r, struct kcap_blk_t *b, uint8_t *raw);
+int kcap_reader_seek(struct kcap_reader_t *r, uint64_t off);
+
+// 1 kcap, 0 pcap, -1 neither, pcap_hdr gets the 24 byte pcap header
+int kcap_file_kind(const char *file, uint8_t *pcap_hdr);
+
+// whole file to plain pcap, returns records written or < 0
+int64_t kcap_to_pcap(const char *in, const char *out, struct kcap_reader_t *r);
+
+// index entries up to the first damaged one, *n is set to their count
+struct kidx_ent_t *kidx_load(const char *file, struct kidx_hdr_t *hdr, uint32_t *n);
+
+#endif
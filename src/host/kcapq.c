@@ -0,0 +1,451 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "pcap.h"
+#include "dot11.h"
+#include "kcapio.h"
+
+// extracts frames by time range and transmitter/bssid address from a
+// .cap or .kcap capture, using the .idx sidecar to read only the batches
+// that can contain matches
+
+#define MAX_ADDR 16
+
+struct query_t {
+	uint64_t ts_min;
+	uint64_t ts_max;
+	uint8_t addr[MAX_ADDR][6];
+	uint32_t naddr;
+	FILE *out;
+
+	// results
+	uint64_t matched;
+	uint64_t scanned;        // records looked at
+	uint64_t bytes_read;     // from the capture file
+	uint32_t batches;        // index entries read
+	uint32_t batches_hit;    // of those, with at least one match
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int parse_mac(const char *s, uint8_t *a)
+{
+	unsigned int v[6];
+	int i;
+
+	if (sscanf(s, "%x:%x:%x:%x:%x:%x", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5]) != 6) {
+		return -1;
+	}
+
+	for (i = 0; i < 6; i++) {
+		if (v[i] > 0xff) {
+			return -1;
+		}
+		a[i] = v[i];
+	}
+
+	return 0;
+}
+
+// epoch seconds with optional fraction, or HH:MM[:SS] utc on the day of day_us
+static int parse_time(const char *s, uint64_t day_us, uint64_t *us)
+{
+	unsigned int h, m, sec = 0;
+	char *end;
+
+	if (strchr(s, ':')) {
+		if (sscanf(s, "%u:%u:%u", &h, &m, &sec) < 2 || h > 23 || m > 59 || sec > 60) {
+			return -1;
+		}
+		uint64_t day = day_us / 1000000 / 86400 * 86400;
+		*us = (day + h * 3600 + m * 60 + sec) * 1000000;
+		return 0;
+	}
+
+	double t = strtod(s, &end);
+	if (*end || t < 0) {
+		return -1;
+	}
+	*us = (uint64_t)(t * 1e6);
+
+	return 0;
+}
+
+static int addr_match(struct query_t *q, const uint8_t *a)
+{
+	uint32_t i;
+
+	if (a == NULL) {
+		return 0;
+	}
+
+	for (i = 0; i < q->naddr; i++) {
+		if (memcmp(q->addr[i], a, 6) == 0) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int rec_match(struct query_t *q, const pcaprec_hdr_t *rec, const uint8_t *data)
+{
+	uint64_t ts = (uint64_t)rec->ts_sec * 1000000 + rec->ts_usec;
+	struct dot11_hdr_t h;
+
+	q->scanned++;
+
+	if (ts < q->ts_min || ts > q->ts_max) {
+		return 0;
+	}
+
+	if (q->naddr == 0) {
+		return 1;
+	}
+
+	if (rec->incl_len < 4) {
+		return 0;
+	}
+
+	uint32_t rt_len = data[2] | (data[3] << 8);
+	if (rt_len > rec->incl_len) {
+		return 0;
+	}
+
+	if (dot11_hdr_parse(data + rt_len, rec->incl_len - rt_len, &h) < 0) {
+		return 0;
+	}
+
+	return addr_match(q, h.ta) || addr_match(q, h.bssid);
+}
+
+static int emit(struct query_t *q, const pcaprec_hdr_t *rec, const uint8_t *data)
+{
+	q->matched++;
+
+	if (q->out && (fwrite(rec, sizeof(*rec), 1, q->out) != 1 || fwrite(data, rec->incl_len, 1, q->out) != 1)) {
+		return -1;
+	}
+
+	return 0;
+}
+
+// records of one batch in memory, returns matches or -1
+static int query_batch(struct query_t *q, const uint8_t *buf, uint32_t len)
+{
+	uint32_t pos = 0;
+	int n = 0;
+
+	while (pos + sizeof(pcaprec_hdr_t) <= len) {
+		pcaprec_hdr_t rec;
+
+		memcpy(&rec, buf + pos, sizeof(rec));
+		pos += sizeof(rec);
+		if (rec.incl_len > len - pos) {
+			break;
+		}
+
+		if (rec_match(q, &rec, buf + pos)) {
+			if (emit(q, &rec, buf + pos) < 0) {
+				return -1;
+			}
+			n++;
+		}
+		pos += rec.incl_len;
+	}
+
+	return n;
+}
+
+static int entry_match(struct query_t *q, const struct kidx_ent_t *e)
+{
+	uint32_t i;
+
+	if (e->nrec == 0 || e->ts_max < q->ts_min || e->ts_min > q->ts_max) {
+		return 0;
+	}
+
+	for (i = 0; i < q->naddr; i++) {
+		if (kidx_bloom_test(e->bloom, q->addr[i])) {
+			return 1;
+		}
+	}
+
+	return q->naddr == 0;
+}
+
+static int query_indexed(struct query_t *q, const char *file, int kcap, struct kidx_ent_t *ents, uint32_t n)
+{
+	static struct kcap_reader_t r;
+	static uint8_t buf[LZ4BLK_MAX];
+	struct kcap_blk_t b;
+	FILE *f = NULL;
+	uint32_t i;
+	int ret = 0;
+
+	if (kcap) {
+		if (kcap_reader_open(&r, file) < 0) {
+			return -1;
+		}
+	} else if ((f = fopen(file, "rb")) == NULL) {
+		return -1;
+	}
+
+	for (i = 0; i < n && ret >= 0; i++) {
+		struct kidx_ent_t *e = &ents[i];
+		int len;
+
+		if (!entry_match(q, e)) {
+			continue;
+		}
+
+		q->batches++;
+		q->bytes_read += e->len;
+
+		if (kcap) {
+			if (kcap_reader_seek(&r, e->off) < 0) {
+				ret = -1;
+				break;
+			}
+			len = kcap_reader_next(&r, &b, buf);
+			// a damaged block makes the reader move on, ignore what it found instead
+			if (len <= 0 || r.off != e->off + e->len) {
+				fprintf(stderr, "block at %llu unreadable\n", (unsigned long long)e->off);
+				continue;
+			}
+		} else {
+			if (e->len > sizeof(buf) || fseeko(f, e->off, SEEK_SET) < 0 || fread(buf, e->len, 1, f) != 1) {
+				fprintf(stderr, "batch at %llu unreadable\n", (unsigned long long)e->off);
+				continue;
+			}
+			len = e->len;
+		}
+
+		ret = query_batch(q, buf, len);
+		if (ret > 0) {
+			q->batches_hit++;
+		}
+	}
+
+	if (kcap) {
+		kcap_reader_close(&r);
+	} else {
+		fclose(f);
+	}
+
+	return ret < 0 ? -1 : 0;
+}
+
+static int query_scan(struct query_t *q, const char *file, int kcap)
+{
+	static struct kcap_reader_t r;
+	static uint8_t buf[65536];
+	struct kcap_blk_t b;
+	int len;
+
+	if (kcap) {
+		if (kcap_reader_open(&r, file) < 0) {
+			return -1;
+		}
+		while ((len = kcap_reader_next(&r, &b, buf)) > 0) {
+			if (query_batch(q, buf, len) < 0) {
+				kcap_reader_close(&r);
+				return -1;
+			}
+		}
+		q->bytes_read = r.off;
+		kcap_reader_close(&r);
+		return 0;
+	}
+
+	FILE *f = fopen(file, "rb");
+	pcaprec_hdr_t rec;
+
+	if (f == NULL) {
+		return -1;
+	}
+
+	setvbuf(f, NULL, _IOFBF, 1 << 20);
+	fseeko(f, sizeof(pcap_hdr_t), SEEK_SET);
+	q->bytes_read = sizeof(pcap_hdr_t);
+
+	while (fread(&rec, sizeof(rec), 1, f) == 1) {
+		if (rec.incl_len > sizeof(buf) || fread(buf, rec.incl_len, 1, f) != 1) {
+			break;
+		}
+		q->bytes_read += sizeof(rec) + rec.incl_len;
+
+		if (rec_match(q, &rec, buf) && emit(q, &rec, buf) < 0) {
+			fclose(f);
+			return -1;
+		}
+	}
+
+	fclose(f);
+
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-x index] [-a mac ...] [-s start] [-e end] [-o out.pcap] [-F | -B] [-v] capture\n", name);
+	fprintf(stderr, "  -x  index file (default capture.idx)\n");
+	fprintf(stderr, "  -a  transmitter or bssid address, repeatable, any of them matches\n");
+	fprintf(stderr, "  -s  start time, epoch seconds or HH:MM[:SS] utc on the capture day\n");
+	fprintf(stderr, "  -e  end time, same format\n");
+	fprintf(stderr, "  -o  write matching frames to a pcap file\n");
+	fprintf(stderr, "  -F  full scan, ignore the index\n");
+	fprintf(stderr, "  -B  run indexed and full scan, compare time and bytes read\n");
+	fprintf(stderr, "  -v  print statistics\n");
+}
+
+static void print_result(const char *what, struct query_t *q, uint64_t ns)
+{
+	printf("%-8s matched:%llu scanned:%llu batches:%u/%u read:%llu bytes time:%.2f ms\n", what,
+		(unsigned long long)q->matched, (unsigned long long)q->scanned, q->batches_hit, q->batches,
+		(unsigned long long)q->bytes_read, ns / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *idx = NULL, *out = NULL, *start = NULL, *end = NULL;
+	struct query_t q;
+	uint8_t pcap_hdr[sizeof(pcap_hdr_t)];
+	int full = 0, bench = 0, verbose = 0;
+	int opt;
+
+	memset(&q, 0, sizeof(q));
+
+	while ((opt = getopt(argc, argv, "x:a:s:e:o:FBvh")) != -1) {
+		switch (opt) {
+		case 'x': idx = optarg; break;
+		case 'a':
+			if (q.naddr == MAX_ADDR || parse_mac(optarg, q.addr[q.naddr]) < 0) {
+				fprintf(stderr, "bad address %s\n", optarg);
+				return 1;
+			}
+			q.naddr++;
+			break;
+		case 's': start = optarg; break;
+		case 'e': end = optarg; break;
+		case 'o': out = optarg; break;
+		case 'F': full = 1; break;
+		case 'B': bench = 1; break;
+		case 'v': verbose = 1; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	if (argc - optind != 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	const char *file = argv[optind];
+	int kcap = kcap_file_kind(file, pcap_hdr);
+	if (kcap < 0) {
+		fprintf(stderr, "%s: not a pcap or kcap file\n", file);
+		return 1;
+	}
+
+	char idx_file[4096];
+	if (idx == NULL) {
+		snprintf(idx_file, sizeof(idx_file), "%s.idx", file);
+		idx = idx_file;
+	}
+
+	struct kidx_hdr_t ih;
+	struct kidx_ent_t *ents = NULL;
+	uint32_t n = 0;
+
+	if (!full) {
+		ents = kidx_load(idx, &ih, &n);
+		if (ents == NULL) {
+			fprintf(stderr, "%s: no usable index\n", idx);
+			return 1;
+		}
+		if (!!(ih.flags & KIDX_KCAP) != kcap) {
+			fprintf(stderr, "%s: index is for a %s capture\n", idx, kcap ? "pcap" : "kcap");
+			return 1;
+		}
+	}
+
+	// HH:MM is taken on the day the capture starts
+	uint64_t day = (n && ents[0].nrec) ? ents[0].ts_min : (uint64_t)time(NULL) * 1000000;
+	q.ts_max = UINT64_MAX;
+	if ((start && parse_time(start, day, &q.ts_min) < 0) || (end && parse_time(end, day, &q.ts_max) < 0)) {
+		fprintf(stderr, "bad time\n");
+		return 1;
+	}
+
+	if (out) {
+		q.out = fopen(out, "wb");
+		if (q.out == NULL || fwrite(pcap_hdr, sizeof(pcap_hdr), 1, q.out) != 1) {
+			fprintf(stderr, "%s: cannot write\n", out);
+			return 1;
+		}
+	}
+
+	uint64_t t = now_ns();
+	int ret = full ? query_scan(&q, file, kcap) : query_indexed(&q, file, kcap, ents, n);
+	t = now_ns() - t;
+
+	if (q.out && fclose(q.out) != 0) {
+		ret = -1;
+	}
+
+	if (ret < 0) {
+		fprintf(stderr, "query failed\n");
+		return 1;
+	}
+
+	if (verbose || bench) {
+		print_result(full ? "scan" : "indexed", &q, t);
+	}
+
+	if (bench && !full) {
+		struct query_t s = q;
+		struct stat cs, is;
+
+		s.out = NULL;
+		s.matched = s.scanned = s.bytes_read = 0;
+		s.batches = s.batches_hit = 0;
+
+		uint64_t ts = now_ns();
+		if (query_scan(&s, file, kcap) < 0) {
+			fprintf(stderr, "scan failed\n");
+			return 1;
+		}
+		ts = now_ns() - ts;
+
+		print_result("scan", &s, ts);
+
+		if (stat(file, &cs) == 0 && stat(idx, &is) == 0) {
+			printf("index:   %u entries, %lld bytes, %.3f%% of capture\n", n, (long long)is.st_size,
+				cs.st_size ? is.st_size * 100.0 / cs.st_size : 0.0);
+		}
+		printf("speedup: %.1fx time, %.1fx bytes read\n", t ? (double)ts / t : 0.0,
+			q.bytes_read ? (double)s.bytes_read / q.bytes_read : 0.0);
+
+		if (s.matched != q.matched) {
+			printf("mismatch: indexed %llu, scan %llu\n", (unsigned long long)q.matched, (unsigned long long)s.matched);
+			return 2;
+		}
+	}
+
+	free(ents);
+
+	return 0;
+}
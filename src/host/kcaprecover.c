@@ -0,0 +1,338 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "pcap.h"
+#include "kcapio.h"
+
+// repairs a .cap or .kcap left behind by a crash: the file is cut after
+// the last consistent record and the index is rebuilt, only the part after
+// the last index checkpoint is read
+
+#define SNAPLEN 65535
+
+struct recover_t {
+	int kcap;
+	uint64_t size;           // file size before repair
+	uint64_t start;          // last checkpoint, everything before is trusted
+	uint64_t end;            // after the last consistent record
+	uint64_t records;
+	uint64_t ts_min;
+	uint64_t ts_max;
+
+	struct kidx_ent_t *ents; // rebuilt index
+	uint32_t n;
+	uint32_t max;
+	uint32_t kept;           // entries taken over from the old index
+};
+
+static struct kidx_ent_t *recover_ent(struct recover_t *r)
+{
+	if (r->n == r->max) {
+		r->max = r->max ? r->max * 2 : 1024;
+		r->ents = realloc(r->ents, r->max * sizeof(*r->ents));
+	}
+
+	return &r->ents[r->n++];
+}
+
+static void recover_close_ent(struct recover_t *r, struct kidx_ent_t *e, uint64_t off, uint64_t len)
+{
+	r->records += e->nrec;
+
+	e->off = off;
+	e->len = len;
+	e->rec_total = r->records;
+
+	if (e->ts_min < r->ts_min) {
+		r->ts_min = e->ts_min;
+	}
+	if (e->ts_max > r->ts_max) {
+		r->ts_max = e->ts_max;
+	}
+
+	kidx_ent_seal(e);
+}
+
+// one pcap record as the writer makes them: radiotap header and frame, complete
+static int rec_sane(const pcaprec_hdr_t *rec)
+{
+	return rec->incl_len >= sizeof(struct ieee80211_radiotap_header) && rec->incl_len <= SNAPLEN &&
+		rec->orig_len >= rec->incl_len && rec->ts_usec < 1000000;
+}
+
+static void ent_add_rec(struct kidx_ent_t *e, const pcaprec_hdr_t *rec, const uint8_t *data)
+{
+	const struct ieee80211_radiotap_header *rt = (const void *)data;
+
+	if (rt->it_len <= rec->incl_len) {
+		kidx_ent_add(e, rec->ts_sec, rec->ts_usec, data + rt->it_len, rec->incl_len - rt->it_len);
+	} else {
+		kidx_ent_add(e, rec->ts_sec, rec->ts_usec, NULL, 0);
+	}
+}
+
+// records after the checkpoint, batched like the writer does
+static int scan_pcap(struct recover_t *r, const char *file)
+{
+	static uint8_t buf[SNAPLEN];
+	struct kidx_ent_t *e = NULL;
+	uint64_t pos = r->start, batch = r->start;
+	pcaprec_hdr_t rec;
+	FILE *f;
+
+	f = fopen(file, "rb");
+	if (f == NULL || fseeko(f, pos, SEEK_SET) < 0) {
+		return -1;
+	}
+	setvbuf(f, NULL, _IOFBF, 1 << 20);
+
+	while (fread(&rec, sizeof(rec), 1, f) == 1) {
+		const struct ieee80211_radiotap_header *rt = (const void *)buf;
+
+		if (!rec_sane(&rec) || fread(buf, rec.incl_len, 1, f) != 1) {
+			break;
+		}
+
+		if (rt->it_version != 0 || rt->it_len < sizeof(*rt) || rt->it_len > rec.incl_len) {
+			break;
+		}
+
+		uint32_t len = sizeof(rec) + rec.incl_len;
+
+		if (e && pos + len - batch > PCAP_BUF_SIZE) {
+			recover_close_ent(r, e, batch, pos - batch);
+			e = NULL;
+		}
+
+		if (e == NULL) {
+			e = recover_ent(r);
+			kidx_ent_reset(e);
+			batch = pos;
+		}
+
+		ent_add_rec(e, &rec, buf);
+		pos += len;
+	}
+
+	if (e) {
+		recover_close_ent(r, e, batch, pos - batch);
+	}
+
+	fclose(f);
+	r->end = pos;
+
+	return 0;
+}
+
+// blocks after the checkpoint up to the first damaged one
+static int scan_kcap(struct recover_t *r, const char *file)
+{
+	static struct kcap_reader_t rd;
+	static uint8_t raw[LZ4BLK_MAX];
+	struct kcap_blk_t b;
+	int len;
+
+	if (kcap_reader_open(&rd, file) < 0) {
+		return -1;
+	}
+
+	rd.strict = 1;
+	kcap_reader_seek(&rd, r->start);
+
+	uint64_t at = r->start;
+
+	while ((len = kcap_reader_next(&rd, &b, raw)) > 0) {
+		struct kidx_ent_t *e = recover_ent(r);
+		uint32_t pos = 0;
+
+		kidx_ent_reset(e);
+
+		while (pos + sizeof(pcaprec_hdr_t) <= (uint32_t)len) {
+			pcaprec_hdr_t rec;
+
+			memcpy(&rec, raw + pos, sizeof(rec));
+			pos += sizeof(rec);
+			if (rec.incl_len > len - pos) {
+				break;
+			}
+			ent_add_rec(e, &rec, raw + pos);
+			pos += rec.incl_len;
+		}
+
+		recover_close_ent(r, e, at, rd.off - at);
+		at = rd.off;
+	}
+
+	r->end = at;
+	kcap_reader_close(&rd);
+
+	return 0;
+}
+
+// old index entries up to its last checkpoint that is still inside the file
+static void take_index(struct recover_t *r, const char *idx)
+{
+	struct kidx_hdr_t h;
+	struct kidx_ent_t *old;
+	uint32_t n, i, last = UINT32_MAX;
+
+	old = kidx_load(idx, &h, &n);
+	if (old == NULL || !!(h.flags & KIDX_KCAP) != r->kcap) {
+		free(old);
+		return;
+	}
+
+	for (i = 0; i < n; i++) {
+		if ((old[i].flags & KIDX_ENT_CHECKPOINT) && old[i].off <= r->size) {
+			last = i;
+		}
+	}
+
+	if (last == UINT32_MAX) {
+		free(old);
+		return;
+	}
+
+	for (i = 0; i <= last; i++) {
+		*recover_ent(r) = old[i];
+	}
+
+	r->kept = r->n;
+	r->start = old[last].off;
+	r->records = old[last].rec_total;
+	if (old[last].rec_total) {
+		r->ts_min = old[last].ts_min;
+		r->ts_max = old[last].ts_max;
+	}
+
+	free(old);
+}
+
+static int write_index(struct recover_t *r, const char *idx)
+{
+	char tmp[4096 + 8];
+	struct kidx_hdr_t h;
+	struct kidx_ent_t *e = recover_ent(r);
+	FILE *f;
+
+	// closing checkpoint for the repaired file
+	memset(e, 0, sizeof(*e));
+	e->off = r->end;
+	e->rec_total = r->records;
+	e->ts_min = r->records ? r->ts_min : 0;
+	e->ts_max = r->ts_max;
+	e->flags = KIDX_ENT_CHECKPOINT;
+	kidx_ent_seal(e);
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", idx);
+	f = fopen(tmp, "wb");
+	if (f == NULL) {
+		return -1;
+	}
+
+	kidx_hdr_init(&h, r->kcap ? KIDX_KCAP : 0);
+	if (fwrite(&h, sizeof(h), 1, f) != 1 || fwrite(r->ents, sizeof(*r->ents), r->n, f) != r->n) {
+		fclose(f);
+		return -1;
+	}
+
+	if (fflush(f) != 0 || fsync(fileno(f)) < 0 || fclose(f) != 0) {
+		return -1;
+	}
+
+	return rename(tmp, idx);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-x index] [-n] [-v] capture\n", name);
+	fprintf(stderr, "  -x  index file (default capture.idx), rebuilt when missing\n");
+	fprintf(stderr, "  -n  only report, change nothing\n");
+	fprintf(stderr, "  -v  print statistics\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *idx = NULL;
+	struct recover_t r;
+	uint8_t pcap_hdr[sizeof(pcap_hdr_t)];
+	int dry = 0, verbose = 0;
+	struct stat st;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "x:nvh")) != -1) {
+		switch (opt) {
+		case 'x': idx = optarg; break;
+		case 'n': dry = 1; break;
+		case 'v': verbose = 1; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	if (argc - optind != 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	const char *file = argv[optind];
+	char idx_file[4096];
+
+	if (idx == NULL) {
+		snprintf(idx_file, sizeof(idx_file), "%s.idx", file);
+		idx = idx_file;
+	}
+
+	memset(&r, 0, sizeof(r));
+	r.kcap = kcap_file_kind(file, pcap_hdr);
+	if (r.kcap < 0 || stat(file, &st) < 0) {
+		fprintf(stderr, "%s: not a pcap or kcap file\n", file);
+		return 1;
+	}
+
+	r.size = st.st_size;
+	r.start = r.kcap ? sizeof(struct kcap_hdr_t) : sizeof(pcap_hdr_t);
+	r.ts_min = UINT64_MAX;
+
+	take_index(&r, idx);
+
+	if ((r.kcap ? scan_kcap(&r, file) : scan_pcap(&r, file)) < 0) {
+		fprintf(stderr, "%s: read failed\n", file);
+		return 1;
+	}
+
+	if (verbose || dry) {
+		printf("file:       %llu bytes, %s\n", (unsigned long long)r.size, r.kcap ? "kcap" : "pcap");
+		printf("trusted:    %llu bytes up to the last checkpoint (%u index entries kept)\n",
+			(unsigned long long)r.start, r.kept);
+		printf("scanned:    %llu bytes after it\n", (unsigned long long)(r.end - r.start));
+		printf("dropped:    %llu bytes of torn tail\n", (unsigned long long)(r.size - r.end));
+		printf("records:    %llu\n", (unsigned long long)r.records);
+		if (r.records) {
+			printf("time:       %llu.%06llu - %llu.%06llu\n",
+				(unsigned long long)(r.ts_min / 1000000), (unsigned long long)(r.ts_min % 1000000),
+				(unsigned long long)(r.ts_max / 1000000), (unsigned long long)(r.ts_max % 1000000));
+		}
+	}
+
+	if (dry) {
+		return 0;
+	}
+
+	if (r.end < r.size && truncate(file, r.end) < 0) {
+		fprintf(stderr, "%s: truncate failed\n", file);
+		return 1;
+	}
+
+	if (write_index(&r, idx) < 0) {
+		fprintf(stderr, "%s: index write failed\n", idx);
+		return 1;
+	}
+
+	free(r.ents);
+
+	return 0;
+}
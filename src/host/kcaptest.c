@@ -0,0 +1,592 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <vitasdkkern.h>
+
+#include "kwifimon_export.h"
+#include "wlan_kernel.h"
+#include "kwifimon.h"
+#include "radiotap.h"
+#include "pcap.h"
+#include "lz4blk.h"
+#include "kcap.h"
+#include "kcapio.h"
+
+#include "shim.h"
+#include "sdiogen.h"
+#include "test.h"
+
+// the compressed capture path end to end: the block codec on its own,
+// then captures written through pcap.c both ways, where the .kcap read back
+// by kcap2pcap's reader has to give the plain pcap byte for byte, and the
+// same capture truncated and damaged, where every block outside the damage
+// has to come back and nothing else
+// buffers handed to the codec are heap allocations of exactly their length
+
+#define MAX_RECS 4096
+
+struct rec_t {
+	uint32_t ts_sec, ts_usec;
+	struct rx_radiotap_hdr rt;
+	uint8_t *f;
+	uint32_t len;
+};
+
+static struct rec_t recs[MAX_RECS];
+static uint32_t nrecs;
+
+// a block as laid out in the file and where its records sit in the pcap
+struct blk_t {
+	uint64_t off;
+	uint32_t len;            // header included
+	uint32_t nrec;
+	uint64_t raw_off;        // after the pcap header
+	uint32_t raw_len;
+};
+
+static struct blk_t blks[1024];
+static uint32_t nblks;
+
+static uint8_t *kcap, *pcap;
+static uint64_t kcap_len, pcap_len;
+
+static char path_kcap[512], path_pcap[512], path_cut[512], path_out[512];
+
+static int recs_add(void *ctx, const uint8_t *pkt, uint32_t len, uint32_t delta_us)
+{
+	struct rxpd pd;
+	struct rec_t *r = &recs[nrecs];
+	static uint64_t ts;
+
+	memcpy(&pd, pkt + sizeof(struct sdio_rx_t), sizeof(pd));
+	if (sizeof(struct sdio_rx_t) + pd.rx_pkt_offset + pd.rx_pkt_length > len) {
+		return 0;
+	}
+
+	ts += delta_us;
+	r->ts_sec = 1000 + ts / 1000000;
+	r->ts_usec = ts % 1000000;
+	kwifimon_rtap_fill(&r->rt, &pd);
+	r->len = pd.rx_pkt_length;
+	r->f = malloc(r->len ? r->len : 1);
+	memcpy(r->f, pkt + sizeof(struct sdio_rx_t) + pd.rx_pkt_offset, r->len);
+
+	return ++nrecs == MAX_RECS;
+}
+
+static void recs_free(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < nrecs; i++) {
+		free(recs[i].f);
+	}
+	nrecs = 0;
+}
+
+// beacons and probes repeat from frame to frame, data payloads are noise
+static void recs_init(uint32_t seed, int mgmt)
+{
+	static struct sdiogen_t g;
+	struct sdiogen_cfg_t cfg;
+
+	recs_free();
+
+	sdiogen_default(&cfg);
+	cfg.seed = seed;
+	cfg.frames = MAX_RECS;
+	if (mgmt) {
+		cfg.w_beacon = 60;
+		cfg.w_probe = 25;
+		cfg.w_data = 10;
+		cfg.w_amsdu = 0;
+		cfg.len_max = 256;
+	}
+	sdiogen_init(&g, &cfg);
+	sdiogen_run(&g, recs_add, NULL);
+}
+
+static uint8_t *load(const char *file, uint64_t *len)
+{
+	struct stat st;
+	uint8_t *p;
+	FILE *f;
+
+	*len = 0;
+	if (stat(file, &st) < 0 || (f = fopen(file, "rb")) == NULL) {
+		return NULL;
+	}
+
+	p = malloc(st.st_size ? st.st_size : 1);
+	if (fread(p, 1, st.st_size, f) != (size_t)st.st_size) {
+		free(p);
+		p = NULL;
+	} else {
+		*len = st.st_size;
+	}
+	fclose(f);
+
+	return p;
+}
+
+static int store(const char *file, const uint8_t *p, uint64_t len)
+{
+	FILE *f = fopen(file, "wb");
+	int ret = 0;
+
+	if (f == NULL) {
+		return -1;
+	}
+	if (len && fwrite(p, len, 1, f) != 1) {
+		ret = -1;
+	}
+	if (fclose(f) != 0) {
+		ret = -1;
+	}
+
+	return ret;
+}
+
+static void lz4_one(const uint8_t *src, uint32_t len)
+{
+	static uint16_t tab[LZ4BLK_HASH_SIZE];
+	uint32_t bound = LZ4BLK_BOUND(len);
+	uint8_t *z = malloc(bound);
+	uint8_t *out = malloc(len ? len : 1);
+	int zlen, ret;
+
+	zlen = lz4blk_compress(src, len, z, bound, tab);
+	if (zlen < 0 || (uint32_t)zlen > bound) {
+		fail("compress", src, len);
+		goto out;
+	}
+
+	ret = lz4blk_decompress(z, zlen, out, len);
+	if (ret != (int)len || memcmp(out, src, len)) {
+		fail("round trip", src, len);
+		goto out;
+	}
+
+	if (len && lz4blk_decompress(z, zlen, out, len - 1) != -1) {
+		fail("output past cap", src, len);
+	}
+
+	// a cut stream never decodes to all of it
+	if (len && zlen > 1) {
+		uint32_t n = rng() % zlen;
+		uint8_t *t = malloc(n ? n : 1);
+
+		memcpy(t, z, n);
+		if (lz4blk_decompress(t, n, out, len) >= (int)len) {
+			fail("truncated stream decoded", z, n);
+		}
+		free(t);
+	}
+
+	// damage may decode to anything within cap, the sanitizers catch the rest
+	if (zlen) {
+		z[rng() % zlen] ^= 1 << (rng() & 7);
+		if (lz4blk_decompress(z, zlen, out, len) > (int)len) {
+			fail("damaged stream past cap", z, zlen);
+		}
+	}
+
+out:
+	free(z);
+	free(out);
+}
+
+static int check_lz4(uint32_t rounds)
+{
+	static const uint32_t edge[] = { 0, 1, 4, 5, 12, 13, 14, 15, 16, 255, 256, 270, PCAP_BUF_SIZE, LZ4BLK_MAX - 1, LZ4BLK_MAX };
+	static uint16_t tab[LZ4BLK_HASH_SIZE];
+	static uint8_t big[LZ4BLK_MAX + 1], zbig[LZ4BLK_BOUND(LZ4BLK_MAX + 1)];
+	uint64_t fails0 = fails;
+	uint32_t i, j, n = 0;
+	int fail = 0;
+
+	for (i = 0; i < rounds; i++) {
+		uint32_t len = (i < sizeof(edge) / sizeof(edge[0])) ? edge[i] :
+			(rng() & 1) ? rng() % 512 : rng() % (LZ4BLK_MAX + 1);
+		uint8_t *src = malloc(len ? len : 1);
+		uint32_t period = 1 + rng() % 64;
+
+		switch (i % 4) {
+		case 0:
+			memset(src, 0, len);
+			break;
+		case 1:
+			for (j = 0; j < len; j++) {
+				src[j] = rng();
+			}
+			break;
+		case 2:
+			// short repeats with a few stray bytes, long matches and overlaps
+			for (j = 0; j < len; j++) {
+				src[j] = (j < period) ? rng() : src[j - period];
+				if ((rng() & 255) == 0) {
+					src[j] = rng();
+				}
+			}
+			break;
+		default:
+			// capture records, what the writer compresses
+			if (pcap_len > 24) {
+				uint64_t at = rng() % (pcap_len - 24);
+				for (j = 0; j < len; j++) {
+					src[j] = pcap[24 + (at + j) % (pcap_len - 24)];
+				}
+			} else {
+				memset(src, 0x5a, len);
+			}
+			break;
+		}
+
+		lz4_one(src, len);
+		free(src);
+		n++;
+	}
+
+	if (lz4blk_compress(big, LZ4BLK_MAX + 1, zbig, sizeof(zbig), tab) != -1) {
+		fail |= check("block over LZ4BLK_MAX refused", 0);
+	}
+	memset(big, 0, 4096);
+	if (lz4blk_compress(big, 4096, zbig, 8, tab) != -1) {
+		fail |= check("small dst refused", 0);
+	}
+
+	fail |= fails != fails0;
+
+	printf("lz4:      %u inputs, %s\n", n, fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+// the same records as plain pcap and as kcap, busy set for a stretch so
+// some blocks are stored whatever the data
+static int write_caps(void)
+{
+	struct wifimon_cap_cfg_t cfg = { KWIFIMON_CAP_COMPRESS, 0 };
+	uint32_t i, busy_at = rng() % nrecs, busy_len = rng() % (nrecs / 4);
+	int pass;
+
+	for (pass = 0; pass < 2; pass++) {
+		if (pcap_open(pass ? "ux0:data/kcaptest.kcap" : "ux0:data/kcaptest.cap", NULL, pass ? &cfg : NULL) < 0) {
+			return -1;
+		}
+
+		for (i = 0; i < nrecs; i++) {
+			struct rec_t *r = &recs[i];
+
+			pcap_pressure((i >= busy_at && i < busy_at + busy_len) ? PCAP_BUSY_ON : 0);
+			if (pcap_write_rt(r->ts_sec, r->ts_usec, (struct ieee80211_radiotap_header *)&r->rt, r->f, r->len) < 0) {
+				pcap_close();
+				return -1;
+			}
+		}
+		pcap_pressure(0);
+		pcap_close();
+	}
+
+	return 0;
+}
+
+// walks the block headers of an intact file
+static int map_blocks(void)
+{
+	uint64_t off = sizeof(struct kcap_hdr_t), raw = 0;
+
+	nblks = 0;
+	while (off < kcap_len) {
+		struct kcap_blk_t b;
+
+		if (off + sizeof(b) > kcap_len || nblks == sizeof(blks) / sizeof(blks[0])) {
+			return -1;
+		}
+		memcpy(&b, kcap + off, sizeof(b));
+		if (kcap_blk_check(&b, PCAP_BUF_SIZE) < 0 || off + sizeof(b) + b.len > kcap_len) {
+			return -1;
+		}
+
+		blks[nblks].off = off;
+		blks[nblks].len = sizeof(b) + b.len;
+		blks[nblks].nrec = b.nrec;
+		blks[nblks].raw_off = raw;
+		blks[nblks].raw_len = b.raw_len;
+		nblks++;
+
+		off += sizeof(b) + b.len;
+		raw += b.raw_len;
+	}
+
+	return 0;
+}
+
+// the pcap the reader has to give when only the blocks in keep survive
+static int expect(const uint8_t *keep, const uint8_t *out, uint64_t out_len, int64_t n)
+{
+	uint64_t at = 24;
+	int64_t recs_want = 0;
+	uint32_t i;
+
+	if (out_len < 24 || memcmp(out, pcap, 24)) {
+		return 0;
+	}
+
+	for (i = 0; i < nblks; i++) {
+		if (!keep[i]) {
+			continue;
+		}
+		if (at + blks[i].raw_len > out_len || memcmp(out + at, pcap + 24 + blks[i].raw_off, blks[i].raw_len)) {
+			return 0;
+		}
+		at += blks[i].raw_len;
+		recs_want += blks[i].nrec;
+	}
+
+	return at == out_len && n == recs_want;
+}
+
+static int check_trip(int mgmt)
+{
+	static struct kcap_reader_t r;
+	uint8_t keep[sizeof(blks) / sizeof(blks[0])];
+	uint8_t hdr[24];
+	uint64_t out_len;
+	uint8_t *out;
+	uint32_t i;
+	int fail = 0;
+
+	free(kcap);
+	free(pcap);
+
+	fail |= check("write", write_caps() == 0);
+	kcap = load(path_kcap, &kcap_len);
+	pcap = load(path_pcap, &pcap_len);
+	fail |= check("read back", kcap != NULL && pcap != NULL);
+	if (fail) {
+		return fail;
+	}
+	fail |= check("block map", map_blocks() == 0);
+
+	int64_t n = kcap_to_pcap(path_kcap, path_out, &r);
+	out = load(path_out, &out_len);
+	memset(keep, 1, nblks);
+	fail |= check("records", n == nrecs);
+	fail |= check("same as plain pcap", out != NULL && out_len == pcap_len && memcmp(out, pcap, pcap_len) == 0);
+	fail |= check("block map covers the pcap", out != NULL && expect(keep, out, out_len, n));
+	fail |= check("nothing damaged", r.bad == 0 && r.skipped == 0 && r.truncated == 0);
+	fail |= check("blocks", r.blocks == nblks && r.blocks > 1);
+	fail |= check("stored and compressed blocks", r.stored > 0 && r.stored < r.blocks);
+	free(out);
+
+	fail |= check("kind kcap", kcap_file_kind(path_kcap, hdr) == 1 && memcmp(hdr, pcap, 24) == 0);
+	fail |= check("kind pcap", kcap_file_kind(path_pcap, hdr) == 0 && memcmp(hdr, pcap, 24) == 0);
+
+	// beacons repeat, the ratio bench_setup_blk measures on
+	uint64_t comp = 0, raw = 0;
+	for (i = 0; i < nblks; i++) {
+		struct kcap_blk_t *b = (void *)(kcap + blks[i].off);
+		if (!(b->flags & KCAP_BLK_STORED)) {
+			comp += b->len;
+			raw += b->raw_len;
+		}
+	}
+
+	printf("trip %s: %u records, %u blocks (%u stored), compressed blocks %.2fx, %s\n",
+		mgmt ? "mgmt" : "mix ", nrecs, r.blocks, r.stored, comp ? (double)raw / comp : 0.0, fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+// every cut ends the file at the last whole block before it
+static int check_cut(uint32_t rounds)
+{
+	static struct kcap_reader_t r;
+	uint8_t keep[sizeof(blks) / sizeof(blks[0])];
+	uint64_t out_len;
+	uint32_t i, k;
+	int fail = 0;
+
+	for (i = 0; i < rounds && !fail; i++) {
+		uint64_t cut;
+		uint8_t *out;
+
+		switch (i % 3) {
+		case 0: cut = rng() % kcap_len; break;
+		// right at a block boundary, and just past one
+		case 1: cut = blks[rng() % nblks].off; break;
+		default: cut = blks[rng() % nblks].off + 1 + rng() % sizeof(struct kcap_blk_t); break;
+		}
+
+		store(path_cut, kcap, cut);
+		int64_t n = kcap_to_pcap(path_cut, path_out, &r);
+
+		if (cut < sizeof(struct kcap_hdr_t)) {
+			fail |= check("header cut refused", n == -1);
+			continue;
+		}
+
+		uint64_t end = sizeof(struct kcap_hdr_t);
+		for (k = 0; k < nblks; k++) {
+			keep[k] = blks[k].off + blks[k].len <= cut;
+			if (keep[k]) {
+				end = blks[k].off + blks[k].len;
+			}
+		}
+
+		out = load(path_out, &out_len);
+		if (out == NULL || !expect(keep, out, out_len, n) || r.truncated != cut - end || r.bad || r.skipped ||
+			r.end != end) {
+			printf("  cut at %llu: %lld records, truncated %llu, end %llu\n", (unsigned long long)cut,
+				(long long)n, (unsigned long long)r.truncated, (unsigned long long)r.end);
+			fail = 1;
+		}
+		free(out);
+	}
+
+	printf("cut:      %u rounds, %s\n", i, fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+// a flipped bit in a block header is skipped over, one in a payload fails
+// the checksum, either way that block alone is lost and strict mode stops there
+// a burst of noise over a few blocks loses only those
+static int check_damage(uint32_t rounds)
+{
+	static struct kcap_reader_t r;
+	static uint8_t raw[LZ4BLK_MAX];
+	uint8_t keep[sizeof(blks) / sizeof(blks[0])];
+	uint8_t *bad = malloc(kcap_len);
+	uint64_t out_len;
+	uint32_t i, k;
+	int fail = 0;
+
+	for (i = 0; i < rounds && !fail; i++) {
+		uint64_t from, to;
+		uint8_t *out;
+		int flip = i & 1;
+
+		memcpy(bad, kcap, kcap_len);
+
+		if (flip) {
+			k = rng() % nblks;
+			from = blks[k].off + rng() % blks[k].len;
+			to = from + 1;
+			bad[from] ^= 1 << (rng() & 7);
+		} else {
+			from = sizeof(struct kcap_hdr_t) + rng() % (kcap_len - sizeof(struct kcap_hdr_t));
+			to = from + 1 + rng() % (3 * PCAP_BUF_SIZE);
+			if (to > kcap_len) {
+				to = kcap_len;
+			}
+			for (k = from; k < to; k++) {
+				bad[k] = rng();
+			}
+		}
+
+		for (k = 0; k < nblks; k++) {
+			keep[k] = blks[k].off + blks[k].len <= from || blks[k].off >= to;
+		}
+
+		store(path_cut, bad, kcap_len);
+		int64_t n = kcap_to_pcap(path_cut, path_out, &r);
+		out = load(path_out, &out_len);
+		if (out == NULL || !expect(keep, out, out_len, n)) {
+			printf("  %s %llu..%llu: %lld records, %u bad, %llu skipped\n", flip ? "flip" : "noise",
+				(unsigned long long)from, (unsigned long long)to, (long long)n, r.bad, (unsigned long long)r.skipped);
+			fail = 1;
+		}
+		free(out);
+
+		if (flip && !fail) {
+			struct kcap_blk_t b;
+			uint32_t got = 0;
+			int len;
+
+			for (k = 0; keep[k]; k++);
+			int in_hdr = from < blks[k].off + sizeof(struct kcap_blk_t);
+			fail |= check("flip counted", in_hdr ? (r.bad == 0 && r.skipped == blks[k].len) :
+				(r.bad == 1 && r.skipped == 0));
+
+			// strict stops at the damaged block
+			if (kcap_reader_open(&r, path_cut) < 0) {
+				fail |= check("strict open", 0);
+				continue;
+			}
+			r.strict = 1;
+			while ((len = kcap_reader_next(&r, &b, raw)) > 0) {
+				if (got >= k || memcmp(raw, pcap + 24 + blks[got].raw_off, len)) {
+					break;
+				}
+				got++;
+			}
+			fail |= check("strict stops", len == 0 && got == k && r.bad == 1 && r.end == blks[k].off);
+			kcap_reader_close(&r);
+		}
+	}
+
+	free(bad);
+
+	printf("damage:   %u rounds, %s\n", i, fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-n rounds] [-s seed] [-o dir]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *dir = "/tmp/kcaptest";
+	uint32_t rounds = 200;
+	uint32_t seed = 1;
+	int opt, fail = 0;
+
+	while ((opt = getopt(argc, argv, "n:s:o:h")) != -1) {
+		switch (opt) {
+		case 'n': rounds = strtoul(optarg, NULL, 0); break;
+		case 's': seed = strtoul(optarg, NULL, 0); break;
+		case 'o': dir = optarg; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	rng_state = seed | 1;
+	mkdir(dir, 0755);
+	shim_init(dir);
+	shim_root_path(path_kcap, sizeof(path_kcap), "ux0:data/kcaptest.kcap");
+	shim_root_path(path_pcap, sizeof(path_pcap), "ux0:data/kcaptest.cap");
+	shim_root_path(path_cut, sizeof(path_cut), "ux0:data/kcaptest-cut.kcap");
+	shim_root_path(path_out, sizeof(path_out), "ux0:data/kcaptest-out.pcap");
+
+	recs_init(seed, 1);
+	fail |= check_trip(1);
+	fail |= check_lz4(rounds * 10);
+	if (!fail) {
+		fail |= check_cut(rounds);
+		fail |= check_damage(rounds);
+	}
+
+	recs_init(seed, 0);
+	fail |= check_trip(0);
+	if (!fail) {
+		fail |= check_cut(rounds / 4);
+		fail |= check_damage(rounds / 4);
+	}
+
+	recs_free();
+	free(kcap);
+	free(pcap);
+
+	printf("%s\n", fail ? "FAIL" : "ok");
+
+	return fail ? 2 : 0;
+}
@@ -0,0 +1,749 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <vitasdkkern.h>
+
+#include "kwifimon_export.h"
+#include "wlan_kernel.h"
+#include "kwifimon.h"
+#include "radiotap.h"
+#include "pcap.h"
+#include "kidx.h"
+#include "dot11.h"
+#include "kcapio.h"
+
+#include "shim.h"
+#include "sdiogen.h"
+#include "test.h"
+
+// the index sidecar written along a capture, plain and compressed: every
+// entry has to describe exactly the batch it points at, its bloom filter
+// has to be the one the batch's addresses give and not much fuller than
+// that, and kcapq has to give the same frames with the index as with a
+// full scan, both the same as a naive filter over the capture
+// then the capture is cut and torn after a checkpoint, with the index cut
+// as well, and kcaprecover has to give back the intact prefix with an
+// index as good as the writer's
+
+#define MAX_RECS 8192
+#define MAX_POOL 64
+
+struct rec_t {
+	uint32_t ts_sec, ts_usec;
+	struct rx_radiotap_hdr rt;
+	uint8_t *f;
+	uint32_t len;
+};
+
+static struct rec_t recs[MAX_RECS];
+static uint32_t nrecs;
+
+// addresses queried for, seen ones first
+static uint8_t pool[MAX_POOL][6];
+static uint32_t npool, npool_seen;
+
+struct cap_t {
+	const char *name;
+	int kcap;
+	char file[512];
+	char idx[512];
+	struct kidx_hdr_t ih;
+	struct kidx_ent_t *ents;
+	uint32_t n;
+};
+
+static struct cap_t caps[2] = {
+	{ "pcap", 0 },
+	{ "kcap", 1 },
+};
+
+// the plain capture in memory, reference for both
+static uint8_t *pcap;
+static uint64_t pcap_len;
+
+static const char *kcapq, *kcaprecover;
+static char path_a[512], path_b[512];
+
+static int recs_add(void *ctx, const uint8_t *pkt, uint32_t len, uint32_t delta_us)
+{
+	struct rxpd pd;
+	struct rec_t *r = &recs[nrecs];
+	static uint64_t ts;
+
+	memcpy(&pd, pkt + sizeof(struct sdio_rx_t), sizeof(pd));
+	if (sizeof(struct sdio_rx_t) + pd.rx_pkt_offset + pd.rx_pkt_length > len) {
+		return 0;
+	}
+
+	ts += delta_us;
+	r->ts_sec = 1000 + ts / 1000000;
+	r->ts_usec = ts % 1000000;
+	kwifimon_rtap_fill(&r->rt, &pd);
+	r->len = pd.rx_pkt_length;
+	r->f = malloc(r->len ? r->len : 1);
+	memcpy(r->f, pkt + sizeof(struct sdio_rx_t) + pd.rx_pkt_offset, r->len);
+
+	return ++nrecs == MAX_RECS;
+}
+
+static void pool_add(const uint8_t *a)
+{
+	uint32_t i;
+
+	for (i = 0; i < npool; i++) {
+		if (memcmp(pool[i], a, 6) == 0) {
+			return;
+		}
+	}
+	if (npool < MAX_POOL) {
+		memcpy(pool[npool++], a, 6);
+	}
+}
+
+// many stations so each shows up in a few batches only
+static void recs_init(uint32_t seed)
+{
+	static struct sdiogen_t g;
+	struct sdiogen_cfg_t cfg;
+	struct dot11_hdr_t h;
+	uint32_t i;
+
+	sdiogen_default(&cfg);
+	cfg.seed = seed;
+	cfg.frames = MAX_RECS;
+	cfg.bss = 32;
+	cfg.stations = 2048;
+	cfg.churn_pm = 20;
+	sdiogen_init(&g, &cfg);
+	sdiogen_run(&g, recs_add, NULL);
+
+	for (i = 0; i < 4 * MAX_POOL && npool < MAX_POOL / 2; i++) {
+		struct rec_t *r = &recs[rng() % nrecs];
+
+		if (dot11_hdr_parse(r->f, r->len, &h) >= 0) {
+			if (h.ta) {
+				pool_add(h.ta);
+			}
+			if (h.bssid) {
+				pool_add(h.bssid);
+			}
+		}
+	}
+	npool_seen = npool;
+
+	while (npool < MAX_POOL) {
+		uint8_t a[6] = { 0x06, 0x10, rng(), rng(), rng(), rng() };
+		pool_add(a);
+	}
+}
+
+static uint8_t *load(const char *file, uint64_t *len)
+{
+	struct stat st;
+	uint8_t *p;
+	FILE *f;
+
+	*len = 0;
+	if (stat(file, &st) < 0 || (f = fopen(file, "rb")) == NULL) {
+		return NULL;
+	}
+
+	p = malloc(st.st_size ? st.st_size : 1);
+	if (fread(p, 1, st.st_size, f) != (size_t)st.st_size) {
+		free(p);
+		p = NULL;
+	} else {
+		*len = st.st_size;
+	}
+	fclose(f);
+
+	return p;
+}
+
+static int write_cap(struct cap_t *c)
+{
+	struct wifimon_cap_cfg_t cfg = { KWIFIMON_CAP_COMPRESS | KWIFIMON_CAP_INDEX, 0 };
+	char file[64], idx[80];
+	uint32_t i;
+
+	snprintf(file, sizeof(file), "ux0:data/kidxtest.%s", c->kcap ? "kcap" : "cap");
+	snprintf(idx, sizeof(idx), "%s.idx", file);
+	shim_root_path(c->file, sizeof(c->file), file);
+	shim_root_path(c->idx, sizeof(c->idx), idx);
+
+	if (pcap_open(file, idx, c->kcap ? &cfg : NULL) < 0) {
+		return -1;
+	}
+
+	for (i = 0; i < nrecs; i++) {
+		struct rec_t *r = &recs[i];
+
+		if (pcap_write_rt(r->ts_sec, r->ts_usec, (struct ieee80211_radiotap_header *)&r->rt, r->f, r->len) < 0) {
+			pcap_close();
+			return -1;
+		}
+		// checkpoints along the way for kcaprecover to start from
+		if (i % 1000 == 999 && pcap_sync() < 0) {
+			pcap_close();
+			return -1;
+		}
+	}
+	pcap_close();
+
+	c->ents = kidx_load(c->idx, &c->ih, &c->n);
+
+	return c->ents ? 0 : -1;
+}
+
+// transmitter and bssid from the 802.11 parser, past the record's radiotap header
+static void rec_addrs(const uint8_t *rec, const uint8_t **ta, const uint8_t **bssid)
+{
+	const pcaprec_hdr_t *h = (const void *)rec;
+	const uint8_t *d = rec + sizeof(*h);
+	uint32_t rt_len = d[2] | (d[3] << 8);
+	struct dot11_hdr_t hdr;
+
+	*ta = NULL;
+	*bssid = NULL;
+	if (dot11_hdr_parse(d + rt_len, h->incl_len - rt_len, &hdr) >= 0) {
+		*ta = hdr.ta;
+		*bssid = hdr.bssid;
+	}
+}
+
+static uint64_t rec_ts(const uint8_t *rec)
+{
+	const pcaprec_hdr_t *h = (const void *)rec;
+
+	return (uint64_t)h->ts_sec * 1000000 + h->ts_usec;
+}
+
+// every entry against the records it covers, ranges back to back,
+// checkpoints right after what they cover and one closing the file
+static int check_index(struct cap_t *c, uint64_t nrec, uint64_t *fp, uint64_t *fp_tests, double *fp_want)
+{
+	static struct kcap_reader_t r;
+	static uint8_t raw[LZ4BLK_MAX];
+	uint64_t file_len, off, total = 0, ts_min = UINT64_MAX, ts_max = 0;
+	uint8_t *file = load(c->file, &file_len);
+	uint32_t i, j;
+	int fail = 0;
+
+	fail |= check("index header", kidx_hdr_check(&c->ih) == 0 && !!(c->ih.flags & KIDX_KCAP) == c->kcap);
+	fail |= check("capture", file != NULL);
+	if (fail) {
+		free(file);
+		return fail;
+	}
+	if (c->kcap && kcap_reader_open(&r, c->file) < 0) {
+		free(file);
+		return check("kcap open", 0);
+	}
+
+	off = c->kcap ? sizeof(struct kcap_hdr_t) : sizeof(pcap_hdr_t);
+
+	for (i = 0; i < c->n && !fail; i++) {
+		struct kidx_ent_t *e = &c->ents[i];
+		struct kidx_ent_t want;
+		const uint8_t *buf;
+		uint32_t len, pos, bits = 0;
+
+		if (e->flags & KIDX_ENT_CHECKPOINT) {
+			fail |= check("checkpoint after its records", e->off == off && e->rec_total == total);
+			fail |= check("checkpoint span", total == 0 || (e->ts_min == ts_min && e->ts_max == ts_max));
+			continue;
+		}
+
+		fail |= check("entries back to back", e->off == off && e->off + e->len <= file_len);
+		if (fail) {
+			break;
+		}
+
+		if (c->kcap) {
+			struct kcap_blk_t b;
+			int n;
+
+			kcap_reader_seek(&r, e->off);
+			n = kcap_reader_next(&r, &b, raw);
+			fail |= check("entry is one block", n > 0 && r.off == e->off + e->len);
+			buf = raw;
+			len = n;
+		} else {
+			buf = file + e->off;
+			len = e->len;
+		}
+
+		// rebuilt from the records, independent of what the writer kept
+		kidx_ent_reset(&want);
+		for (pos = 0; !fail && pos + sizeof(pcaprec_hdr_t) <= len; ) {
+			const pcaprec_hdr_t *h = (const void *)(buf + pos);
+			const uint8_t *ta, *bssid;
+			uint64_t ts = rec_ts(buf + pos);
+
+			rec_addrs(buf + pos, &ta, &bssid);
+			if (ts < want.ts_min) {
+				want.ts_min = ts;
+			}
+			if (ts > want.ts_max) {
+				want.ts_max = ts;
+			}
+			want.nrec++;
+			if (ta) {
+				kidx_bloom_add(want.bloom, ta);
+			}
+			if (bssid) {
+				kidx_bloom_add(want.bloom, bssid);
+			}
+			pos += sizeof(*h) + h->incl_len;
+		}
+
+		fail |= check("entry covers whole records", pos == len);
+		fail |= check("entry records and span", e->nrec == want.nrec && e->ts_min == want.ts_min &&
+			e->ts_max == want.ts_max);
+		fail |= check("entry bloom", memcmp(e->bloom, want.bloom, sizeof(want.bloom)) == 0);
+
+		total += e->nrec;
+		fail |= check("entry record total", e->rec_total == total);
+		if (e->ts_min < ts_min) {
+			ts_min = e->ts_min;
+		}
+		if (e->ts_max > ts_max) {
+			ts_max = e->ts_max;
+		}
+		off = e->off + e->len;
+
+		// addresses never added, what passes is a false positive
+		for (j = 0; j < KIDX_BLOOM_BITS / 8; j++) {
+			bits += __builtin_popcount(e->bloom[j]);
+		}
+		*fp_want += 256 * __builtin_powi((double)bits / KIDX_BLOOM_BITS, KIDX_BLOOM_K);
+		for (j = 0; j < 256; j++) {
+			uint8_t a[6] = { 0x0a, 0x20, rng(), rng(), rng(), rng() };
+			*fp += kidx_bloom_test(e->bloom, a);
+		}
+		*fp_tests += 256;
+	}
+
+	fail |= check("every record indexed", total == nrec && c->n > 0 &&
+		(c->ents[c->n - 1].flags & KIDX_ENT_CHECKPOINT) && c->ents[c->n - 1].off == file_len);
+
+	if (c->kcap) {
+		kcap_reader_close(&r);
+	}
+	free(file);
+
+	return fail;
+}
+
+static int run(char *const argv[])
+{
+	int status;
+	pid_t pid = fork();
+
+	if (pid < 0) {
+		return -1;
+	}
+	if (pid == 0) {
+		execv(argv[0], argv);
+		_exit(127);
+	}
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)) {
+		return -1;
+	}
+
+	return WEXITSTATUS(status);
+}
+
+// on 1/64 s steps, those go through kcapq's seconds parsing exactly
+static void fmt_ts(char *s, uint64_t us)
+{
+	sprintf(s, "%llu.%06llu", (unsigned long long)(us / 1000000), (unsigned long long)(us % 1000000));
+}
+
+static int check_query(uint32_t rounds)
+{
+	uint64_t first = rec_ts(pcap + sizeof(pcap_hdr_t)), last = first;
+	uint64_t matched = 0, pos;
+	uint32_t i, k, skipped = 0, entries = 0;
+	int fail = 0;
+
+	for (pos = sizeof(pcap_hdr_t); pos < pcap_len; pos += sizeof(pcaprec_hdr_t) + ((pcaprec_hdr_t *)(pcap + pos))->incl_len) {
+		last = rec_ts(pcap + pos);
+	}
+
+	for (i = 0; i < rounds && !fail; i++) {
+		char *argv[32], s[32], e[32], addr[4][18];
+		uint64_t ts_min = 0, ts_max = UINT64_MAX;
+		uint32_t naddr = 0, a[4];
+		uint8_t *want = malloc(pcap_len);
+		uint64_t want_len = sizeof(pcap_hdr_t);
+		uint64_t out_len;
+		uint8_t *out;
+		int argc;
+
+		if (i & 1) {
+			uint64_t span = (last - first) / 15625 + 1;
+			ts_min = first / 15625 * 15625 + rng() % span * 15625;
+			ts_max = ts_min + rng() % (span / 4 + 1) * 15625;
+		}
+		if (i & 2) {
+			naddr = 1 + rng() % 3;
+			for (k = 0; k < naddr; k++) {
+				// mostly seen addresses, now and then one never sent
+				a[k] = (rng() % 8) ? rng() % npool_seen : npool_seen + rng() % (npool - npool_seen);
+			}
+		}
+
+		// naive filter over the plain capture
+		memcpy(want, pcap, sizeof(pcap_hdr_t));
+		for (pos = sizeof(pcap_hdr_t); pos < pcap_len; ) {
+			uint32_t n = sizeof(pcaprec_hdr_t) + ((pcaprec_hdr_t *)(pcap + pos))->incl_len;
+			uint64_t ts = rec_ts(pcap + pos);
+			const uint8_t *ta, *bssid;
+			int hit = ts >= ts_min && ts <= ts_max;
+
+			if (hit && naddr) {
+				rec_addrs(pcap + pos, &ta, &bssid);
+				hit = 0;
+				for (k = 0; k < naddr; k++) {
+					hit |= (ta && memcmp(ta, pool[a[k]], 6) == 0) || (bssid && memcmp(bssid, pool[a[k]], 6) == 0);
+				}
+			}
+			if (hit) {
+				memcpy(want + want_len, pcap + pos, n);
+				want_len += n;
+				matched++;
+			}
+			pos += n;
+		}
+
+		for (k = 0; k < 2 && !fail; k++) {
+			struct cap_t *c = &caps[k];
+			int full;
+
+			for (full = 0; full < 2 && !fail; full++) {
+				argc = 0;
+				argv[argc++] = (char *)kcapq;
+				if (full) {
+					argv[argc++] = "-F";
+				}
+				if (ts_min) {
+					fmt_ts(s, ts_min);
+					argv[argc++] = "-s";
+					argv[argc++] = s;
+				}
+				if (ts_max != UINT64_MAX) {
+					fmt_ts(e, ts_max);
+					argv[argc++] = "-e";
+					argv[argc++] = e;
+				}
+				for (uint32_t j = 0; j < naddr; j++) {
+					const uint8_t *p = pool[a[j]];
+					sprintf(addr[j], "%02x:%02x:%02x:%02x:%02x:%02x", p[0], p[1], p[2], p[3], p[4], p[5]);
+					argv[argc++] = "-a";
+					argv[argc++] = addr[j];
+				}
+				argv[argc++] = "-o";
+				argv[argc++] = full ? path_b : path_a;
+				argv[argc++] = c->file;
+				argv[argc] = NULL;
+
+				if (run(argv) != 0) {
+					printf("  %s query %u%s: kcapq failed\n", c->name, i, full ? " full" : "");
+					fail = 1;
+					break;
+				}
+			}
+			if (fail) {
+				break;
+			}
+
+			out = load(path_a, &out_len);
+			fail |= check("indexed query", out != NULL && out_len == want_len && memcmp(out, want, want_len) == 0);
+			free(out);
+			out = load(path_b, &out_len);
+			fail |= check("full scan", out != NULL && out_len == want_len && memcmp(out, want, want_len) == 0);
+			free(out);
+			if (fail) {
+				printf("  %s query %u: %u addresses, %llu..%llu\n", c->name, i, naddr,
+					(unsigned long long)ts_min, (unsigned long long)ts_max);
+			}
+		}
+
+		// beacons put each bssid in most batches, still a fair share has
+		// to be skipped for a single seen address
+		if (!(i & 1) && naddr == 1 && a[0] < npool_seen) {
+			struct cap_t *c = &caps[1];
+			for (k = 0; k < c->n; k++) {
+				if (!(c->ents[k].flags & KIDX_ENT_CHECKPOINT)) {
+					entries++;
+					skipped += !kidx_bloom_test(c->ents[k].bloom, pool[a[0]]);
+				}
+			}
+		}
+
+		free(want);
+	}
+
+	fail |= check("index skips batches", entries == 0 || skipped * 4 > entries);
+
+	printf("query:    %u queries, %llu frames matched, %u/%u batches skipped by address, %s\n", i,
+		(unsigned long long)matched, skipped, entries, fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+static int store(const char *file, const uint8_t *p, uint64_t len, const uint8_t *tail, uint64_t tail_len)
+{
+	FILE *f = fopen(file, "wb");
+	int ret = 0;
+
+	if (f == NULL) {
+		return -1;
+	}
+	if ((len && fwrite(p, len, 1, f) != 1) || (tail_len && fwrite(tail, tail_len, 1, f) != 1)) {
+		ret = -1;
+	}
+	if (fclose(f) != 0) {
+		ret = -1;
+	}
+
+	return ret;
+}
+
+// last record or block boundary at or before cut, *n gets the records before it
+static uint64_t cap_end(const struct cap_t *c, const uint8_t *p, uint64_t len, uint64_t cut, uint64_t *n)
+{
+	uint64_t off = c->kcap ? sizeof(struct kcap_hdr_t) : sizeof(pcap_hdr_t);
+
+	*n = 0;
+	while (off < len) {
+		uint64_t next;
+		uint32_t nrec;
+
+		if (c->kcap) {
+			const struct kcap_blk_t *b = (const void *)(p + off);
+			next = off + sizeof(*b) + b->len;
+			nrec = b->nrec;
+		} else {
+			next = off + sizeof(pcaprec_hdr_t) + ((const pcaprec_hdr_t *)(p + off))->incl_len;
+			nrec = 1;
+		}
+		if (next > cut) {
+			break;
+		}
+		off = next;
+		*n += nrec;
+	}
+
+	return off;
+}
+
+// a crash leaves the capture durable up to the last checkpoint that made it
+// into the index, anything after may be cut short and, where the file grew
+// ahead of its data, followed by zeros or leftovers
+// plain pcap has no checksums to tell such a tail from records, it is only cut
+static int check_recover(struct cap_t *c, uint32_t rounds)
+{
+	static uint8_t tail[2 * PCAP_BUF_SIZE];
+	uint64_t full_len, idx_len, hdr = c->kcap ? sizeof(struct kcap_hdr_t) : sizeof(pcap_hdr_t);
+	uint8_t *full = load(c->file, &full_len);
+	uint8_t *idx = load(c->idx, &idx_len);
+	uint64_t dropped = 0, kept = 0;
+	char file[64], idx_name[80], path[512], path_idx[512];
+	uint32_t i, j;
+	int fail = 0;
+
+	snprintf(file, sizeof(file), "ux0:data/kidxtest-rec.%s", c->kcap ? "kcap" : "cap");
+	snprintf(idx_name, sizeof(idx_name), "%s.idx", file);
+	shim_root_path(path, sizeof(path), file);
+	shim_root_path(path_idx, sizeof(path_idx), idx_name);
+
+	fail |= check("recover input", full != NULL && idx != NULL);
+
+	for (i = 0; i < rounds && !fail; i++) {
+		char *argv[] = { (char *)kcaprecover, path, NULL };
+		struct cap_t rc = { c->name, c->kcap };
+		uint64_t from = hdr, cut, end, nrec, out_len, tail_len = 0;
+		int32_t last = -1;
+		uint32_t keep = 0;
+		uint8_t *out;
+
+		// index cut after some checkpoint, a few entries past it and maybe
+		// half of the next one, now and then no index at all
+		if (rng() % 8) {
+			uint32_t k;
+			do {
+				k = rng() % c->n;
+			} while (!(c->ents[k].flags & KIDX_ENT_CHECKPOINT));
+			keep = k + 1 + rng() % 4;
+			if (keep > c->n) {
+				keep = c->n;
+			}
+		}
+		for (j = 0; j < keep; j++) {
+			if (c->ents[j].flags & KIDX_ENT_CHECKPOINT) {
+				from = c->ents[j].off;
+				last = j;
+			}
+		}
+
+		cut = from + rng() % (full_len - from + 1);
+		end = cap_end(c, full, full_len, cut, &nrec);
+		if (c->kcap && (i % 3)) {
+			tail_len = rng() % sizeof(tail);
+			for (j = 0; j < tail_len; j++) {
+				tail[j] = (i % 3 == 1) ? 0 : rng();
+			}
+		}
+
+		uint64_t idx_cut = sizeof(struct kidx_hdr_t) + keep * sizeof(struct kidx_ent_t);
+		if (keep < c->n) {
+			idx_cut += rng() % sizeof(struct kidx_ent_t);
+		}
+
+		unlink(path_idx);
+		if (store(path, full, cut, tail, tail_len) < 0 || (keep && store(path_idx, idx, idx_cut, NULL, 0) < 0)) {
+			fail |= check("store", 0);
+			break;
+		}
+
+		if (run(argv) != 0) {
+			printf("  %s recover %u: kcaprecover failed\n", c->name, i);
+			fail = 1;
+			break;
+		}
+
+		out = load(path, &out_len);
+		fail |= check("recovered capture", out != NULL && out_len == end && memcmp(out, full, end) == 0);
+		free(out);
+
+		rc.ents = kidx_load(path_idx, &rc.ih, &rc.n);
+		snprintf(rc.file, sizeof(rc.file), "%s", path);
+		if (rc.ents == NULL) {
+			fail |= check("recovered index", 0);
+		} else {
+			uint64_t fp = 0, fp_tests = 0;
+			double fp_want = 0;
+
+			fail |= check_index(&rc, nrec, &fp, &fp_tests, &fp_want);
+			fail |= check("entries up to the checkpoint kept", last < 0 ||
+				((int32_t)rc.n > last && memcmp(rc.ents, c->ents, (last + 1) * sizeof(struct kidx_ent_t)) == 0));
+		}
+		free(rc.ents);
+
+		if (fail) {
+			printf("  %s recover %u: checkpoint at %llu, cut at %llu + %llu, end %llu\n", c->name, i,
+				(unsigned long long)from, (unsigned long long)cut, (unsigned long long)tail_len,
+				(unsigned long long)end);
+		}
+		dropped += cut + tail_len - end;
+		kept += end;
+	}
+
+	free(full);
+	free(idx);
+
+	printf("recover %s: %u rounds, %llu bytes kept, %llu dropped, %s\n", c->name, i,
+		(unsigned long long)kept, (unsigned long long)dropped, fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-n queries] [-s seed] [-o dir] [-q kcapq] [-r kcaprecover]\n", name);
+}
+
+// next to this program unless given
+static const char *tool_path(const char *arg0, const char *name, char *buf, int len)
+{
+	const char *slash = strrchr(arg0, '/');
+
+	snprintf(buf, len, "%.*s%s", slash ? (int)(slash - arg0 + 1) : 0, arg0, name);
+
+	return buf;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *dir = "/tmp/kidxtest";
+	static char tool[2][512];
+	uint32_t rounds = 64;
+	uint32_t seed = 1;
+	int opt, fail = 0;
+	uint32_t i;
+
+	while ((opt = getopt(argc, argv, "n:s:o:q:r:h")) != -1) {
+		switch (opt) {
+		case 'n': rounds = strtoul(optarg, NULL, 0); break;
+		case 's': seed = strtoul(optarg, NULL, 0); break;
+		case 'o': dir = optarg; break;
+		case 'q': kcapq = optarg; break;
+		case 'r': kcaprecover = optarg; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	if (kcapq == NULL) {
+		kcapq = tool_path(argv[0], "kcapq", tool[0], sizeof(tool[0]));
+	}
+	if (kcaprecover == NULL) {
+		kcaprecover = tool_path(argv[0], "kcaprecover", tool[1], sizeof(tool[1]));
+	}
+	if (access(kcapq, X_OK) < 0 || access(kcaprecover, X_OK) < 0) {
+		fprintf(stderr, "%s: not found\n", access(kcapq, X_OK) < 0 ? kcapq : kcaprecover);
+		return 1;
+	}
+
+	rng_state = seed | 1;
+	mkdir(dir, 0755);
+	shim_init(dir);
+	shim_root_path(path_a, sizeof(path_a), "ux0:data/kidxtest-a.pcap");
+	shim_root_path(path_b, sizeof(path_b), "ux0:data/kidxtest-b.pcap");
+
+	recs_init(seed);
+
+	for (i = 0; i < 2; i++) {
+		struct cap_t *c = &caps[i];
+		uint64_t fp = 0, fp_tests = 0;
+		double fp_want = 0;
+		int f;
+
+		f = check("write", write_cap(c) == 0);
+		if (f == 0) {
+			f |= check_index(c, nrecs, &fp, &fp_tests, &fp_want);
+		}
+		// about what the fill of each filter predicts
+		f |= check("bloom false positives", fp <= 2 * fp_want + fp_tests / 200);
+
+		printf("index %s: %u entries, false positives %llu/%llu, %.0f expected, %s\n", c->name, c->n,
+			(unsigned long long)fp, (unsigned long long)fp_tests, fp_want, f ? "FAIL" : "ok");
+		fail |= f;
+	}
+
+	pcap = load(caps[0].file, &pcap_len);
+	if (!fail && pcap) {
+		fail |= check_query(rounds);
+	}
+	for (i = 0; i < 2 && !fail; i++) {
+		fail |= check_recover(&caps[i], rounds);
+	}
+
+	for (i = 0; i < 2; i++) {
+		free(caps[i].ents);
+	}
+	for (i = 0; i < nrecs; i++) {
+		free(recs[i].f);
+	}
+	free(pcap);
+
+	printf("%s\n", fail ? "FAIL" : "ok");
+
+	return fail ? 2 : 0;
+}
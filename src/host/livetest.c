@@ -0,0 +1,475 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vitasdkkern.h>
+
+#include "kwifimon_export.h"
+#include "wlan_kernel.h"
+#include "sigs.h"
+#include "kwifimon.h"
+#include "live.h"
+#include "airtime.h"
+
+#include "shim.h"
+#include "sdiogen.h"
+#include "test.h"
+
+// feeds generated traffic with station churn through the rx hook and checks
+// the live tables against a plain reference model: same entries, same
+// counters, airtime included, and the same lru order
+
+int module_start(SceSize argc, const void *args);
+int module_stop(SceSize argc, const void *args);
+
+// reference: linear arrays, lru by a use counter
+struct ref_bss_t {
+	struct wifimon_bss_t b;
+	uint64_t used;
+};
+
+struct ref_sta_t {
+	struct wifimon_sta_t s;
+	uint64_t used;
+};
+
+static struct ref_bss_t ref_bss[KWIFIMON_LIVE_BSS_MAX];
+static struct ref_sta_t ref_sta[KWIFIMON_LIVE_STA_MAX];
+static uint32_t ref_nbss, ref_nsta;
+static uint32_t ref_bss_evicted, ref_sta_evicted;
+static uint64_t ref_clock;
+
+static const uint8_t bcast[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+// a-mpdu as one psdu growing by padded subframes, each one charged the difference
+static uint32_t ref_air_rate, ref_air_len, ref_air_us, ref_air_seq;
+static uint8_t ref_air_ta[6];
+static uint64_t ref_air_total;
+
+static uint32_t ref_fnv(const uint8_t *p, uint32_t len)
+{
+	uint32_t h = 0x811c9dc5;
+
+	while (len--) {
+		h = (h ^ *p++) * 0x01000193;
+	}
+
+	return h;
+}
+
+static struct wifimon_bss_t *ref_bss_get(const uint8_t *bssid)
+{
+	uint32_t i, old = 0;
+
+	for (i = 0; i < ref_nbss; i++) {
+		if (memcmp(ref_bss[i].b.bssid, bssid, 6) == 0) {
+			ref_bss[i].used = ++ref_clock;
+			return &ref_bss[i].b;
+		}
+		if (ref_bss[i].used < ref_bss[old].used) {
+			old = i;
+		}
+	}
+
+	if (ref_nbss < KWIFIMON_LIVE_BSS_MAX) {
+		i = ref_nbss++;
+	} else {
+		i = old;
+		ref_bss_evicted++;
+	}
+
+	memset(&ref_bss[i], 0, sizeof(ref_bss[i]));
+	memcpy(ref_bss[i].b.bssid, bssid, 6);
+	ref_bss[i].used = ++ref_clock;
+
+	return &ref_bss[i].b;
+}
+
+static struct wifimon_sta_t *ref_sta_get(const uint8_t *addr, int *created)
+{
+	uint32_t i, old = 0;
+
+	for (i = 0; i < ref_nsta; i++) {
+		if (memcmp(ref_sta[i].s.addr, addr, 6) == 0) {
+			ref_sta[i].used = ++ref_clock;
+			*created = 0;
+			return &ref_sta[i].s;
+		}
+		if (ref_sta[i].used < ref_sta[old].used) {
+			old = i;
+		}
+	}
+
+	if (ref_nsta < KWIFIMON_LIVE_STA_MAX) {
+		i = ref_nsta++;
+	} else {
+		i = old;
+		ref_sta_evicted++;
+	}
+
+	memset(&ref_sta[i], 0, sizeof(ref_sta[i]));
+	memcpy(ref_sta[i].s.addr, addr, 6);
+	ref_sta[i].used = ++ref_clock;
+	*created = 1;
+
+	return &ref_sta[i].s;
+}
+
+static uint32_t ref_airtime(const struct rxpd *rx_pd, const uint8_t *f, uint32_t len)
+{
+	uint16_t fc = f[0] | (f[1] << 8);
+	uint32_t rate = airtime_rxpd(rx_pd->rx_rate, rx_pd->ht_info);
+	uint32_t flags = (kwifimon_channel_band == WLAN_RADIO_TYPE_A) ? 0 : AIRTIME_F_2GHZ;
+	uint32_t air, us;
+
+	if (rate == AIRTIME_NONE) {
+		ref_air_rate = AIRTIME_NONE;
+		return 0;
+	}
+
+	// qos data, with the addresses and sequence control in their usual place
+	if ((fc & 0x8c) == 0x88 && (rx_pd->ht_info & 1)) {
+		uint32_t seq = (f[22] | (f[23] << 8)) >> 4;
+
+		if (ref_air_rate == rate && seq == ((ref_air_seq + 1) & 0xfff) && memcmp(ref_air_ta, f + 10, 6) == 0) {
+			ref_air_len = ((ref_air_len + 3) & ~3u) + 4 + len + 4;
+		} else {
+			ref_air_len = 4 + len + 4;
+			ref_air_us = 0;
+		}
+		ref_air_rate = rate;
+		ref_air_seq = seq;
+		memcpy(ref_air_ta, f + 10, 6);
+		us = airtime_us(rate, ref_air_len, flags);
+		air = us - ref_air_us;
+		ref_air_us = us;
+	} else {
+		ref_air_rate = AIRTIME_NONE;
+		air = airtime_us(rate, len + 4, flags);
+	}
+
+	ref_air_total += air;
+
+	return air;
+}
+
+// what sdiogen makes: beacons and probe responses from aps, probe requests,
+// data both ways, a-msdu from the ap and bar from stations
+static void ref_update(const struct rxpd *rx_pd, const uint8_t *f, uint32_t len)
+{
+	uint16_t fc = f[0] | (f[1] << 8);
+	uint32_t type = (fc >> 2) & 3, sub = (fc >> 4) & 0xf, i;
+	const uint8_t *ta = NULL, *bssid = NULL, *air_bssid = NULL;
+	uint32_t air = ref_airtime(rx_pd, f, len);
+
+	if (type == 0 && (sub == 8 || sub == 5)) {
+		struct wifimon_bss_t *b = ref_bss_get(f + 16);
+		int rssi = rx_pd->snr + rx_pd->nf;
+		uint32_t pos = 36;
+
+		b->beacons++;
+		b->air_us += air;
+		b->rssi = rssi < -128 ? -128 : rssi > 127 ? 127 : rssi;
+		b->beacon_int = f[32] | (f[33] << 8);
+		while (pos + 2 <= len && pos + 2 + f[pos + 1] <= len) {
+			if (f[pos] == 0) {
+				b->ssid_len = f[pos + 1];
+				b->ssid_hash = ref_fnv(f + pos + 2, f[pos + 1]);
+			} else if (f[pos] == 3) {
+				b->channel = f[pos + 2];
+			}
+			pos += 2 + f[pos + 1];
+		}
+		return;
+	}
+
+	if (type == 0) {
+		ta = f + 10;
+		bssid = f + 16;
+	} else if (type == 1) {
+		ta = f + 10;
+	} else if (type == 2) {
+		if ((fc & 0x300) == 0x100) {
+			ta = f + 10;
+			bssid = f + 4;
+		} else if ((fc & 0x300) == 0x200) {
+			ta = f + 10;
+			bssid = f + 10;
+		}
+	}
+
+	// any frame with a bssid counts for a bss already known
+	if (type == 0 || (type == 2 && (fc & 0x300) == 0)) {
+		air_bssid = f + 16;
+	} else if (type == 2 && (fc & 0x300) != 0x300) {
+		air_bssid = bssid;
+	}
+	for (i = 0; air_bssid && !(air_bssid[0] & 1) && i < ref_nbss; i++) {
+		if (memcmp(ref_bss[i].b.bssid, air_bssid, 6) == 0) {
+			ref_bss[i].b.air_us += air;
+			break;
+		}
+	}
+
+	if (ta == NULL || (ta[0] & 1) || (bssid && memcmp(ta, bssid, 6) == 0)) {
+		return;
+	}
+
+	int created;
+	struct wifimon_sta_t *s = ref_sta_get(ta, &created);
+
+	if (created) {
+		s->snr_avg = rx_pd->snr * 16;
+		s->nf_avg = rx_pd->nf * 16;
+	} else {
+		s->snr_avg += (rx_pd->snr * 16 - s->snr_avg) >> LIVE_EWMA_SHIFT;
+		s->nf_avg += (rx_pd->nf * 16 - s->nf_avg) >> LIVE_EWMA_SHIFT;
+	}
+	s->frames++;
+	s->bytes += len;
+	s->air_us += air;
+	if (bssid && memcmp(bssid, bcast, 6) != 0) {
+		memcpy(s->bssid, bssid, 6);
+	}
+}
+
+static int cmp_bss_used(const void *a, const void *b)
+{
+	const struct ref_bss_t *x = a, *y = b;
+
+	return (x->used < y->used) - (x->used > y->used);
+}
+
+static int cmp_sta_used(const void *a, const void *b)
+{
+	const struct ref_sta_t *x = a, *y = b;
+
+	return (x->used < y->used) - (x->used > y->used);
+}
+
+static int check_live(const struct wifimon_live_t *l, const struct sdiogen_t *g)
+{
+	uint32_t i, j, bad = 0;
+
+	if (l->nbss != ref_nbss || l->nsta != ref_nsta ||
+		l->bss_evicted != ref_bss_evicted || l->sta_evicted != ref_sta_evicted) {
+		printf("  counts: live %u/%u bss %u/%u sta evicted, reference %u/%u %u/%u\n",
+			l->nbss, l->bss_evicted, l->nsta, l->sta_evicted,
+			ref_nbss, ref_bss_evicted, ref_nsta, ref_sta_evicted);
+		return 1;
+	}
+
+	// the first snapshot since the reset, its window has all of it
+	if (l->air_us != ref_air_total || l->busy_us != l->air_us || l->air_unknown != 0) {
+		printf("  airtime: live %llu us, %u in the window, %u unknown, reference %llu us\n",
+			(unsigned long long)l->air_us, l->busy_us, l->air_unknown, (unsigned long long)ref_air_total);
+		bad++;
+	}
+
+	// snapshot is most recent first
+	qsort(ref_bss, ref_nbss, sizeof(ref_bss[0]), cmp_bss_used);
+	qsort(ref_sta, ref_nsta, sizeof(ref_sta[0]), cmp_sta_used);
+
+	for (i = 0; i < l->nbss; i++) {
+		const struct wifimon_bss_t *a = &l->bss[i], *b = &ref_bss[i].b;
+
+		if (memcmp(a->bssid, b->bssid, 6) || a->beacons != b->beacons || a->channel != b->channel ||
+			a->ssid_len != b->ssid_len || a->ssid_hash != b->ssid_hash ||
+			a->beacon_int != b->beacon_int || a->rssi != b->rssi || a->air_us != b->air_us) {
+			if (bad++ < 4) {
+				printf("  bss %u differs\n", i);
+			}
+		}
+
+		// and against what the generator put on air
+		for (j = 0; j < g->cfg.bss; j++) {
+			const struct sdiogen_bss_t *s = &g->bss[j];
+
+			if (memcmp(s->bssid, a->bssid, 6) == 0) {
+				if (s->channel != a->channel || s->beacon_int != a->beacon_int ||
+					s->ssid_len != a->ssid_len ||
+					ref_fnv((const uint8_t *)s->ssid, s->ssid_len) != a->ssid_hash) {
+					if (bad++ < 4) {
+						printf("  bss %u does not match the generator\n", i);
+					}
+				}
+				break;
+			}
+		}
+		if (j == g->cfg.bss && bad++ < 4) {
+			printf("  bss %u is unknown to the generator\n", i);
+		}
+
+		if (i && (int32_t)(l->bss[i - 1].last_seen - a->last_seen) < 0 && bad++ < 4) {
+			printf("  bss %u seen after its predecessor\n", i);
+		}
+	}
+
+	for (i = 0; i < l->nsta; i++) {
+		const struct wifimon_sta_t *a = &l->sta[i], *b = &ref_sta[i].s;
+
+		if (memcmp(a->addr, b->addr, 6) || memcmp(a->bssid, b->bssid, 6) || a->frames != b->frames ||
+			a->bytes != b->bytes || a->snr_avg != b->snr_avg || a->nf_avg != b->nf_avg || a->air_us != b->air_us) {
+			if (bad++ < 4) {
+				printf("  sta %u differs: frames %u/%u bytes %llu/%llu snr %d/%d nf %d/%d air %u/%u\n", i,
+					a->frames, b->frames, (unsigned long long)a->bytes, (unsigned long long)b->bytes,
+					a->snr_avg, b->snr_avg, a->nf_avg, b->nf_avg, a->air_us, b->air_us);
+			}
+		}
+
+		if ((int32_t)(l->now - a->last_seen) < 0 && bad++ < 4) {
+			printf("  sta %u seen in the future\n", i);
+		}
+	}
+
+	return bad != 0;
+}
+
+static int run(const char *name, uint32_t frames, uint32_t bss, uint32_t stations, uint32_t churn_pm)
+{
+	static struct sdiogen_t g;
+	static struct wifimon_live_t l;
+	static uint8_t buf[SDIOGEN_MAX_PKT] __attribute__ ((aligned(4)));
+	static uint8_t dev[sizeof(struct wlan_dev_t)];
+	rx_hook_t hook = (rx_hook_t)shim_hook(sigs[SIG_RX_HANDLER].fixed);
+	struct sdiogen_cfg_t cfg;
+	uint32_t somenumber, i;
+	int fail;
+
+	sdiogen_default(&cfg);
+	cfg.frames = 0;
+	cfg.bss = bss;
+	cfg.stations = stations;
+	cfg.churn_pm = churn_pm;
+	sdiogen_init(&g, &cfg);
+
+	// start both sides empty
+	kwifimon_live_snapshot(&l, 1);
+	ref_nbss = ref_nsta = 0;
+	ref_bss_evicted = ref_sta_evicted = 0;
+	ref_air_rate = AIRTIME_NONE;
+	ref_air_total = 0;
+
+	for (i = 0; i < frames; i++) {
+		int len = sdiogen_next(&g, buf, sizeof(buf), NULL);
+		if (len < 0) {
+			break;
+		}
+
+		struct rxpd *rx_pd = (void *)buf + sizeof(struct sdio_rx_t);
+
+		hook((struct wlan_dev_t *)dev, buf, len, &somenumber);
+		ref_update(rx_pd, (uint8_t *)rx_pd + rx_pd->rx_pkt_offset, rx_pd->rx_pkt_length);
+	}
+
+	if (kwifimon_live_snapshot(&l, 0) < 0) {
+		printf("%-10s FAIL snapshot\n", name);
+		return 1;
+	}
+
+	fail = check_live(&l, &g);
+	printf("%-10s %s  %u frames, %u bss (%u evicted), %u stations (%u evicted)\n", name, fail ? "FAIL" : "ok  ",
+		frames, l.nbss, l.bss_evicted, l.nsta, l.sta_evicted);
+
+	// reset leaves nothing behind
+	kwifimon_live_snapshot(&l, 1);
+	kwifimon_live_snapshot(&l, 0);
+	if (l.nbss || l.nsta || l.bss_evicted || l.sta_evicted || l.air_us || l.busy_us) {
+		printf("%-10s FAIL reset left %u bss %u stations\n", name, l.nbss, l.nsta);
+		fail = 1;
+	}
+
+	return fail;
+}
+
+// every cut of a frame short of its full length, each in a heap buffer of
+// exactly that size, leaves the tables as they were, the whole frame not
+static int run_short(const char *name)
+{
+	static struct sdiogen_t g;
+	static struct wifimon_live_t l;
+	static uint8_t buf[SDIOGEN_MAX_PKT] __attribute__ ((aligned(4)));
+	static uint8_t dev[sizeof(struct wlan_dev_t)];
+	rx_hook_t hook = (rx_hook_t)shim_hook(sigs[SIG_RX_HANDLER].fixed);
+	struct sdiogen_cfg_t cfg;
+	uint32_t somenumber;
+	int len, cut, fail = 0;
+
+	sdiogen_default(&cfg);
+	cfg.frames = 0;
+	sdiogen_init(&g, &cfg);
+	len = sdiogen_next(&g, buf, sizeof(buf), NULL);
+	if (len < 0) {
+		printf("%-10s FAIL no frame\n", name);
+		return 1;
+	}
+
+	kwifimon_live_snapshot(&l, 1);
+	for (cut = sizeof(struct sdio_rx_t); cut < len; cut++) {
+		uint8_t *p = malloc(cut);
+
+		memcpy(p, buf, cut);
+		hook((struct wlan_dev_t *)dev, p, cut, &somenumber);
+		free(p);
+	}
+	kwifimon_live_snapshot(&l, 0);
+	if (l.nbss || l.nsta) {
+		printf("%-10s FAIL cut frames left %u bss %u stations\n", name, l.nbss, l.nsta);
+		fail = 1;
+	}
+
+	hook((struct wlan_dev_t *)dev, buf, len, &somenumber);
+	kwifimon_live_snapshot(&l, 0);
+	if (l.nbss + l.nsta == 0) {
+		printf("%-10s FAIL whole frame not seen\n", name);
+		fail = 1;
+	}
+	printf("%-10s %s  %d cuts\n", name, fail ? "FAIL" : "ok  ", len - (int)sizeof(struct sdio_rx_t));
+
+	kwifimon_live_snapshot(&l, 1);
+
+	return fail;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-n frames] [-o dir]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *root = "/tmp/livetest";
+	uint32_t frames = 200000;
+	int opt, fail = 0;
+
+	while ((opt = getopt(argc, argv, "n:o:h")) != -1) {
+		switch (opt) {
+		case 'n': frames = strtoul(optarg, NULL, 0); break;
+		case 'o': root = optarg; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	shim_init(root);
+	shim_wlan_init();
+
+	module_start(0, NULL);
+	if (kwifimon_mod_state() & 0x80000000) {
+		fprintf(stderr, "module_start failed, state %x\n", kwifimon_mod_state());
+		return 1;
+	}
+
+	// fits, lru order only; overflowing without churn; heavy churn
+	fail |= run("fits", frames, 16, 256, 0);
+	fail |= run("overflow", frames, 200, 2048, 0);
+	fail |= run("churn", frames, 200, 4096, 200);
+	fail |= run_short("short");
+
+	module_stop(0, NULL);
+
+	printf("%s\n", fail ? "FAIL" : "ok");
+
+	return fail ? 2 : 0;
+}
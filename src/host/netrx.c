@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "radiotap.h"
+#include "netrx.h"
+
+struct netrx_t {
+	int fd;
+	pthread_t th;
+	struct netrx_cnt_t cnt;
+};
+
+static struct netrx_t netrx[KWIFIMON_NET_DEST_MAX];
+static uint32_t netrx_num;
+static volatile int netrx_run;
+
+// addr[:port[:rate[:burst[:ttl]]]], rate and burst in bytes
+int netrx_parse(struct wifimon_net_cfg_t *cfg, const char *spec)
+{
+	struct wifimon_net_dest_t *d;
+	char addr[64];
+	unsigned port = 0, rate = 0, burst = 0, ttl = 0;
+	struct in_addr in;
+
+	if (cfg->num >= KWIFIMON_NET_DEST_MAX) {
+		return -1;
+	}
+
+	if (sscanf(spec, "%63[^:]:%u:%u:%u:%u", addr, &port, &rate, &burst, &ttl) < 1 || inet_aton(addr, &in) == 0) {
+		return -1;
+	}
+
+	d = &cfg->dest[cfg->num++];
+	memset(d, 0, sizeof(*d));
+	d->addr = in.s_addr;
+	d->port = port;
+	d->rate = rate;
+	d->burst = burst;
+	d->ttl = ttl;
+
+	return 0;
+}
+
+static void *netrx_thread(void *arg)
+{
+	struct netrx_t *r = arg;
+	static __thread uint8_t buf[4096];
+	struct pollfd pfd = { r->fd, POLLIN, 0 };
+
+	while (netrx_run) {
+		if (poll(&pfd, 1, 50) <= 0) {
+			continue;
+		}
+
+		ssize_t len = recv(r->fd, buf, sizeof(buf), 0);
+		if (len <= 0) {
+			continue;
+		}
+
+		r->cnt.pkts++;
+		r->cnt.bytes += len;
+
+		struct ieee80211_radiotap_header *rt = (void *)buf;
+		if (len > rt->it_len && (buf[rt->it_len] & 0x0c) == 0) {
+			r->cnt.mgmt++;
+		}
+	}
+
+	return NULL;
+}
+
+static int netrx_open(const struct wifimon_net_dest_t *d)
+{
+	struct sockaddr_in sin;
+	int fd, one = 1, rcvbuf = 4 << 20;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		return -1;
+	}
+
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(d->port ? d->port : KWIFIMON_NET_PORT);
+	sin.sin_addr.s_addr = d->addr;
+
+	if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	if ((ntohl(d->addr) >> 28) == 0xe) {
+		struct ip_mreq mreq;
+
+		mreq.imr_multiaddr.s_addr = d->addr;
+		mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+		if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+			close(fd);
+			return -1;
+		}
+	}
+
+	return fd;
+}
+
+int netrx_start(const struct wifimon_net_cfg_t *cfg)
+{
+	struct wifimon_net_dest_t def;
+	uint32_t i;
+
+	memset(netrx, 0, sizeof(netrx));
+
+	memset(&def, 0, sizeof(def));
+	def.addr = htonl(INADDR_LOOPBACK);
+
+	netrx_num = cfg->num ? cfg->num : 1;
+	netrx_run = 1;
+
+	for (i = 0; i < netrx_num; i++) {
+		netrx[i].fd = netrx_open(cfg->num ? &cfg->dest[i] : &def);
+		if (netrx[i].fd < 0) {
+			fprintf(stderr, "receiver %u: bind failed\n", i);
+			netrx_num = i;
+			netrx_stop(NULL);
+			return -1;
+		}
+		pthread_create(&netrx[i].th, NULL, netrx_thread, &netrx[i]);
+	}
+
+	return 0;
+}
+
+// let in flight datagrams arrive, then collect counters
+void netrx_stop(struct netrx_cnt_t *cnt)
+{
+	uint32_t i;
+
+	usleep(100000);
+	netrx_run = 0;
+
+	for (i = 0; i < netrx_num; i++) {
+		pthread_join(netrx[i].th, NULL);
+		close(netrx[i].fd);
+		if (cnt) {
+			cnt[i] = netrx[i].cnt;
+		}
+	}
+}
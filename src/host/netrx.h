@@ -0,0 +1,20 @@
+#ifndef NETRX_h_
+#define NETRX_h_
+
+#include <stdint.h>
+
+#include "kwifimon_export.h"
+
+// local udp receivers standing in for remote knet consumers, one thread each
+
+struct netrx_cnt_t {
+	uint32_t pkts;
+	uint32_t bytes;
+	uint32_t mgmt;
+};
+
+int netrx_parse(struct wifimon_net_cfg_t *cfg, const char *spec);
+int netrx_start(const struct wifimon_net_cfg_t *cfg);
+void netrx_stop(struct netrx_cnt_t *cnt);
+
+#endif
@@ -0,0 +1,546 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <poll.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <vitasdkkern.h>
+
+#include "kwifimon_export.h"
+#include "wlan_kernel.h"
+#include "sigs.h"
+#include "kwifimon.h"
+#include "rpcap.h"
+
+#include "shim.h"
+#include "sdiogen.h"
+#include "test.h"
+
+// rpcap client doing the same handshake as libpcap, against the in-process
+// server fed by generated traffic, or against a running server with -c
+
+int module_start(SceSize argc, const void *args);
+int module_stop(SceSize argc, const void *args);
+
+static volatile int gen_run;
+static uint32_t gen_rate = 20000;
+static uint32_t gen_frames;
+static uint32_t slow_us;
+
+// feed generated frames into the rx hook at the given rate
+static void *gen_thread(void *arg)
+{
+	static struct sdiogen_t g;
+	static uint8_t buf[SDIOGEN_MAX_PKT] __attribute__ ((aligned(4)));
+	static uint8_t dev[sizeof(struct wlan_dev_t)];
+	rx_hook_t hook = (rx_hook_t)shim_hook(sigs[SIG_RX_HANDLER].fixed);
+	struct sdiogen_cfg_t cfg;
+	uint32_t somenumber, delta;
+	uint64_t t0 = now_ns();
+
+	sdiogen_default(&cfg);
+	cfg.frames = 0;
+	sdiogen_init(&g, &cfg);
+
+	while (gen_run) {
+		int len = sdiogen_next(&g, buf, sizeof(buf), &delta);
+		if (len < 0) {
+			break;
+		}
+
+		hook((struct wlan_dev_t *)dev, buf, len, &somenumber);
+		gen_frames++;
+
+		// sleep whenever a millisecond ahead of schedule, make up for at
+		// most ten lost to the scheduler: catching up on more is a burst
+		// no radio sends, it overruns the capture ring on a loaded host
+		uint64_t due = t0 + (uint64_t)gen_frames * 1000000000ull / gen_rate;
+		uint64_t now = now_ns();
+		if (now > due + 10000000) {
+			t0 += now - due - 10000000;
+		} else if (due > now + 1000000) {
+			struct timespec ts = { due / 1000000000ull, due % 1000000000ull };
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+		}
+	}
+
+	return NULL;
+}
+
+static int recv_all(int fd, void *buf, uint32_t len)
+{
+	uint8_t *p = buf;
+
+	while (len) {
+		ssize_t ret = recv(fd, p, len, 0);
+		if (ret <= 0) {
+			return -1;
+		}
+		p += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+static int send_msg(int fd, uint8_t type, uint16_t value, const void *payload, uint32_t len)
+{
+	struct rpcap_header_t h;
+
+	h.ver = RPCAP_VERSION;
+	h.type = type;
+	h.value = htons(value);
+	h.plen = htonl(len);
+
+	if (send(fd, &h, sizeof(h), 0) != sizeof(h)) {
+		return -1;
+	}
+
+	return (len == 0 || send(fd, payload, len, 0) == (ssize_t)len) ? 0 : -1;
+}
+
+// wait for reply to given request, payload goes to buf, returns payload length
+static int recv_reply(int fd, uint8_t type, struct rpcap_header_t *h, void *buf, uint32_t max)
+{
+	uint32_t plen;
+
+	if (recv_all(fd, h, sizeof(*h)) < 0) {
+		return -1;
+	}
+
+	plen = ntohl(h->plen);
+	if (plen > max || recv_all(fd, buf, plen) < 0) {
+		return -1;
+	}
+
+	if (h->type == RPCAP_MSG_ERROR) {
+		fprintf(stderr, "server error %u: %.*s\n", ntohs(h->value), (int)plen, (char *)buf);
+		return -1;
+	}
+
+	if (h->type != (type | RPCAP_MSG_REPLY)) {
+		fprintf(stderr, "unexpected reply type %u\n", h->type);
+		return -1;
+	}
+
+	return plen;
+}
+
+static int tcp_connect(const char *host, int port)
+{
+	struct addrinfo hints, *res;
+	char ps[16];
+	int fd, one = 1, rcvbuf = 4 << 20;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	snprintf(ps, sizeof(ps), "%d", port);
+
+	if (getaddrinfo(host, ps, &hints, &res) != 0) {
+		return -1;
+	}
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	if (fd < 0 || connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		freeaddrinfo(res);
+		return -1;
+	}
+
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	freeaddrinfo(res);
+
+	return fd;
+}
+
+// management frames only: x = radiotap length (little endian), then frame control type
+static const struct bpf_insn_t mgmt_filter[] = {
+	BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 3),
+	BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 8),
+	BPF_STMT(BPF_MISC | BPF_TAX, 0),
+	BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 2),
+	BPF_STMT(BPF_ALU | BPF_OR | BPF_X, 0),
+	BPF_STMT(BPF_MISC | BPF_TAX, 0),
+	BPF_STMT(BPF_LD | BPF_B | BPF_IND, 0),
+	BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0x0c),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 1),
+	BPF_STMT(BPF_RET | BPF_K, 0xffff),
+	BPF_STMT(BPF_RET | BPF_K, 0),
+};
+
+struct rx_cnt_t {
+	uint32_t pkts;
+	uint64_t bytes;
+	uint32_t mgmt;
+	uint32_t gaps;       // missing npkt numbers, server side drops
+	uint32_t bad;
+	uint32_t last_npkt;
+};
+
+// read packet messages until the deadline, or with drain until the stream goes quiet
+static void read_data(int dfd, struct rx_cnt_t *c, uint64_t until, int drain)
+{
+	static uint8_t buf[65536 + sizeof(struct rpcap_pkthdr_t)];
+	struct pollfd pfd = { dfd, POLLIN, 0 };
+
+	for (;;) {
+		struct rpcap_header_t h;
+		struct rpcap_pkthdr_t *ph = (void *)buf;
+		uint64_t now = now_ns();
+
+		if (!drain && now >= until) {
+			break;
+		}
+
+		if (poll(&pfd, 1, drain ? 200 : (int)((until - now) / 1000000) + 1) <= 0) {
+			if (drain) {
+				break;
+			}
+			continue;
+		}
+
+		if (recv_all(dfd, &h, sizeof(h)) < 0) {
+			break;
+		}
+
+		uint32_t plen = ntohl(h.plen);
+		if (h.type != RPCAP_MSG_PACKET || plen < sizeof(*ph) || plen > sizeof(buf) || recv_all(dfd, buf, plen) < 0) {
+			c->bad++;
+			break;
+		}
+
+		uint32_t caplen = ntohl(ph->caplen);
+		uint32_t npkt = ntohl(ph->npkt);
+		uint8_t *data = buf + sizeof(*ph);
+
+		if (caplen != plen - sizeof(*ph)) {
+			c->bad++;
+			continue;
+		}
+
+		if (npkt != c->last_npkt + 1) {
+			c->gaps += npkt - c->last_npkt - 1;
+		}
+		c->last_npkt = npkt;
+
+		c->pkts++;
+		c->bytes += caplen;
+
+		if (slow_us) {
+			usleep(slow_us);
+		}
+
+		uint32_t rtlen = data[2] | (data[3] << 8);
+		if (caplen > rtlen && (data[rtlen] & 0x0c) == 0) {
+			c->mgmt++;
+		}
+	}
+}
+
+// frames of the file capture, and how many of them are management frames
+static int read_cap(const char *file, uint32_t *pkts, uint32_t *mgmt)
+{
+	static uint8_t buf[65536];
+	uint8_t rh[16];
+	FILE *f = fopen(file, "rb");
+
+	*pkts = *mgmt = 0;
+	if (f == NULL || fread(buf, 1, 24, f) != 24) {
+		if (f) {
+			fclose(f);
+		}
+		return -1;
+	}
+
+	while (fread(rh, 1, sizeof(rh), f) == sizeof(rh)) {
+		uint32_t incl = rh[8] | (rh[9] << 8) | (rh[10] << 16) | ((uint32_t)rh[11] << 24);
+		uint32_t rtlen;
+
+		if (incl > sizeof(buf) || fread(buf, 1, incl, f) != incl) {
+			break;
+		}
+		(*pkts)++;
+		rtlen = buf[2] | (buf[3] << 8);
+		if (incl > rtlen && (buf[rtlen] & 0x0c) == 0) {
+			(*mgmt)++;
+		}
+	}
+	fclose(f);
+
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-c host] [-p port] [-r frames/s] [-t secs] [-f] [-w] [-S n] [-d us] [-m percent] [-o dir]\n", name);
+	fprintf(stderr, "  -c  test a running server instead of the built in one\n");
+	fprintf(stderr, "  -p  control port (default %d)\n", KWIFIMON_RPCAP_PORT);
+	fprintf(stderr, "  -r  generated frames/s (default 20000)\n");
+	fprintf(stderr, "  -t  seconds of capture (default 3)\n");
+	fprintf(stderr, "  -f  push a management frames only filter\n");
+	fprintf(stderr, "  -w  write a file capture alongside, checks it gets every frame\n");
+	fprintf(stderr, "  -S  ask the server to sample 1 in n\n");
+	fprintf(stderr, "  -d  slow client, sleep after each frame, checks the server thins instead of stalling\n");
+	fprintf(stderr, "  -m  minimum percent of captured frames that must arrive (default 95)\n");
+	fprintf(stderr, "  -o  directory standing in for ux0: (default /tmp/rpcaptest)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *host = NULL, *root = "/tmp/rpcaptest";
+	int port = KWIFIMON_RPCAP_PORT;
+	uint32_t secs = 3, sample = 0, min_pct = 95;
+	int filter = 0, file = 0, opt;
+	static uint8_t msg[8192];
+	struct rpcap_header_t h;
+	pthread_t th;
+	int fd, dfd, len;
+
+	while ((opt = getopt(argc, argv, "c:p:r:t:fwS:d:m:o:h")) != -1) {
+		switch (opt) {
+		case 'c': host = optarg; break;
+		case 'p': port = strtoul(optarg, NULL, 0); break;
+		case 'r': gen_rate = strtoul(optarg, NULL, 0); break;
+		case 't': secs = strtoul(optarg, NULL, 0); break;
+		case 'f': filter = 1; break;
+		case 'w': file = 1; break;
+		case 'S': sample = strtoul(optarg, NULL, 0); break;
+		case 'd': slow_us = strtoul(optarg, NULL, 0); min_pct = 0; break;
+		case 'm': min_pct = strtoul(optarg, NULL, 0); break;
+		case 'o': root = optarg; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	if (gen_rate == 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (host == NULL) {
+		shim_init(root);
+		shim_wlan_init();
+
+		module_start(0, NULL);
+		if (kwifimon_mod_state() & 0x80000000) {
+			fprintf(stderr, "module_start failed, state %x\n", kwifimon_mod_state());
+			return 1;
+		}
+
+		if (file && kwifimon_cap_start(NULL) < 0) {
+			fprintf(stderr, "file capture start failed\n");
+			return 1;
+		}
+
+		if (kwifimon_rpcap_start(port) < 0) {
+			fprintf(stderr, "rpcap server start failed\n");
+			return 1;
+		}
+	}
+
+	fd = tcp_connect(host ? host : "127.0.0.1", port);
+	if (fd < 0) {
+		fprintf(stderr, "connect failed\n");
+		return 1;
+	}
+
+	// auth
+	struct rpcap_auth_t auth;
+	memset(&auth, 0, sizeof(auth));
+	auth.type = htons(RPCAP_RMTAUTH_NULL);
+	send_msg(fd, RPCAP_MSG_AUTH_REQ, 0, &auth, sizeof(auth));
+	len = recv_reply(fd, RPCAP_MSG_AUTH_REQ, &h, msg, sizeof(msg));
+	if (len < 0) {
+		printf("handshake:  FAIL auth\n");
+		return 2;
+	}
+
+	// interface list
+	send_msg(fd, RPCAP_MSG_FINDALLIF_REQ, 0, NULL, 0);
+	len = recv_reply(fd, RPCAP_MSG_FINDALLIF_REQ, &h, msg, sizeof(msg));
+	struct rpcap_findalldevs_if_t *d = (void *)msg;
+	if (len < (int)sizeof(*d) || ntohs(h.value) != 1) {
+		printf("handshake:  FAIL findalldevs\n");
+		return 2;
+	}
+	char ifname[64];
+	snprintf(ifname, sizeof(ifname), "%.*s", ntohs(d->namelen), (char *)(d + 1));
+
+	// open
+	send_msg(fd, RPCAP_MSG_OPEN_REQ, 0, ifname, strlen(ifname));
+	len = recv_reply(fd, RPCAP_MSG_OPEN_REQ, &h, msg, sizeof(msg));
+	struct rpcap_openreply_t *o = (void *)msg;
+	if (len < (int)sizeof(*o) || ntohl(o->linktype) != RPCAP_LINKTYPE) {
+		printf("handshake:  FAIL open\n");
+		return 2;
+	}
+
+	if (sample > 1) {
+		struct rpcap_sampling_t s;
+		memset(&s, 0, sizeof(s));
+		s.method = RPCAP_SAMP_1_EVERY_N;
+		s.value = htonl(sample);
+		send_msg(fd, RPCAP_MSG_SETSAMPLING_REQ, 0, &s, sizeof(s));
+		if (recv_reply(fd, RPCAP_MSG_SETSAMPLING_REQ, &h, msg, sizeof(msg)) < 0) {
+			printf("handshake:  FAIL setsampling\n");
+			return 2;
+		}
+	}
+
+	// start capture, passive mode tcp, filter in network order
+	uint32_t n = filter ? sizeof(mgmt_filter) / sizeof(mgmt_filter[0]) : 0;
+	struct rpcap_startcapreq_t *req = (void *)msg;
+	struct rpcap_filter_t *f = (void *)(req + 1);
+	struct rpcap_filterbpf_insn_t *in = (void *)(f + 1);
+	uint32_t i;
+
+	memset(req, 0, sizeof(*req) + sizeof(*f));
+	req->snaplen = htonl(65535);
+	req->read_timeout = htonl(1000);
+	f->filtertype = htons(RPCAP_UPDATEFILTER_BPF);
+	f->nitems = htonl(n);
+	for (i = 0; i < n; i++) {
+		in[i].code = htons(mgmt_filter[i].code);
+		in[i].jt = mgmt_filter[i].jt;
+		in[i].jf = mgmt_filter[i].jf;
+		in[i].k = htonl(mgmt_filter[i].k);
+	}
+
+	send_msg(fd, RPCAP_MSG_STARTCAP_REQ, 0, msg, sizeof(*req) + sizeof(*f) + n * sizeof(*in));
+	len = recv_reply(fd, RPCAP_MSG_STARTCAP_REQ, &h, msg, sizeof(msg));
+	struct rpcap_startcapreply_t *sr = (void *)msg;
+	if (len < (int)sizeof(*sr)) {
+		printf("handshake:  FAIL startcap\n");
+		return 2;
+	}
+
+	dfd = tcp_connect(host ? host : "127.0.0.1", ntohs(sr->portdata));
+	if (dfd < 0) {
+		printf("handshake:  FAIL data connection to port %u\n", ntohs(sr->portdata));
+		return 2;
+	}
+
+	printf("handshake:  OK (if %s, bufsize %d, data port %u)\n", ifname, ntohl(sr->bufsize), ntohs(sr->portdata));
+
+	if (host == NULL) {
+		// server finishes its side of startcap after the client connected
+		while (!(kwifimon_mod_state() & STATE_REC_RPCAP)) {
+			usleep(1000);
+		}
+		gen_run = 1;
+		pthread_create(&th, NULL, gen_thread, NULL);
+	}
+
+	struct rx_cnt_t c;
+	memset(&c, 0, sizeof(c));
+
+	uint64_t t0 = now_ns();
+	uint64_t until = t0 + (uint64_t)secs * 1000000000ull;
+
+	read_data(dfd, &c, until, 0);
+
+	// stop feeding, then take what is still queued
+	if (host == NULL) {
+		gen_run = 0;
+		pthread_join(th, NULL);
+		read_data(dfd, &c, 0, 1);
+	}
+
+	double elapsed = (now_ns() - t0) / 1e9;
+
+	send_msg(fd, RPCAP_MSG_STATS_REQ, 0, NULL, 0);
+	len = recv_reply(fd, RPCAP_MSG_STATS_REQ, &h, msg, sizeof(msg));
+	struct rpcap_stats_t st;
+	memset(&st, 0, sizeof(st));
+	if (len >= (int)sizeof(st)) {
+		memcpy(&st, msg, sizeof(st));
+	}
+
+	send_msg(fd, RPCAP_MSG_ENDCAP_REQ, 0, NULL, 0);
+	int end_ok = recv_reply(fd, RPCAP_MSG_ENDCAP_REQ, &h, msg, sizeof(msg)) >= 0;
+	send_msg(fd, RPCAP_MSG_CLOSE, 0, NULL, 0);
+
+	close(dfd);
+	close(fd);
+
+	printf("received:   %u frames, %.1f MB in %.2fs, %.0f frames/s, %.2f MB/s\n", c.pkts, c.bytes / 1e6, elapsed,
+		c.pkts / elapsed, c.bytes / 1e6 / elapsed);
+	printf("content:    mgmt:%u gaps:%u bad:%u\n", c.mgmt, c.gaps, c.bad);
+	printf("server:     ifrecv:%u ifdrop:%u krnldrop:%u svrcapt:%u\n", ntohl(st.ifrecv), ntohl(st.ifdrop),
+		ntohl(st.krnldrop), ntohl(st.svrcapt));
+
+	int ok = end_ok && c.bad == 0 && c.pkts > 0 && c.pkts == ntohl(st.svrcapt);
+
+	if (filter && c.mgmt != c.pkts) {
+		ok = 0;
+	}
+
+	if (host == NULL) {
+		struct wifimon_stats_t s;
+		struct wifimon_rpcap_stats_t rs;
+
+		kwifimon_mod_stats(&s, 0);
+		kwifimon_rpcap_stats(&rs, 0);
+
+		// frames the hook queued for capture
+		uint32_t captured = s.pkt_cnt + s.mgmt_cnt + s.amsdu_cnt + s.bar_cnt - s.filt_cnt - s.drop_cnt;
+		// the client's filter runs in the hook, on what it queues for the client
+		uint32_t passed = captured - rs.filtered;
+		uint32_t expect = (sample > 1) ? passed / sample : passed;
+
+		printf("generated:  %u frames at %u/s, captured:%u filtered:%u ring drop:%u\n", gen_frames, gen_rate,
+			captured, s.filt_cnt, s.drop_cnt);
+		printf("flow:       offered:%u filtered:%u sampled:%u thinned:%u drop_full:%u thin:1/%u\n", rs.offered, rs.filtered,
+			rs.sampled, rs.thinned, rs.drop_full, rs.thin);
+
+		// a client's filter is not the capture filter, and the server is
+		// offered exactly what it lets through
+		if (s.filt_cnt || (filter && rs.filtered == 0) || rs.offered != passed) {
+			ok = 0;
+		}
+
+		// the file keeps getting everything, what the client filtered too
+		if (file) {
+			char path[512];
+			uint32_t fpkts, fmgmt;
+
+			kwifimon_cap_stop();
+			shim_root_path(path, sizeof(path), "ux0:/data/test.cap");
+			if (read_cap(path, &fpkts, &fmgmt) < 0) {
+				fpkts = fmgmt = 0;
+			}
+			printf("file:       frames:%u mgmt:%u\n", fpkts, fmgmt);
+			if (fpkts != captured || (filter && fpkts == fmgmt)) {
+				ok = 0;
+			}
+		}
+
+		if ((uint64_t)c.pkts * 100 < (uint64_t)expect * min_pct) {
+			ok = 0;
+		}
+
+		// a slow client must never back up into the capture ring
+		if (s.drop_cnt) {
+			ok = 0;
+		}
+
+		kwifimon_rpcap_stop();
+		module_stop(0, NULL);
+	}
+
+	printf("result:     %s\n", ok ? "OK" : "FAIL");
+
+	return ok ? 0 : 2;
+}
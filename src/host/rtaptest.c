@@ -0,0 +1,636 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "radiotap.h"
+#include "rtap.h"
+#include "test.h"
+
+// conformance check for the radiotap layouts: the field table against the
+// one on radiotap.org, known headers with hand computed offsets, malformed
+// headers, and random headers against a naive field by field walk, rtap_add
+// results included
+
+#define MAX_HDR   512
+#define MAX_ITEMS 300
+
+#define B(x) (1u << IEEE80211_RADIOTAP_##x)
+
+// radiotap.org defined fields, bit: alignment, size
+static const uint8_t spec[32][2] = {
+	{ 8, 8 },   // tsft
+	{ 1, 1 },   // flags
+	{ 1, 1 },   // rate
+	{ 2, 4 },   // channel
+	{ 1, 2 },   // fhss
+	{ 1, 1 },   // dbm antenna signal
+	{ 1, 1 },   // dbm antenna noise
+	{ 2, 2 },   // lock quality
+	{ 2, 2 },   // tx attenuation
+	{ 2, 2 },   // db tx attenuation
+	{ 1, 1 },   // dbm tx power
+	{ 1, 1 },   // antenna
+	{ 1, 1 },   // db antenna signal
+	{ 1, 1 },   // db antenna noise
+	{ 2, 2 },   // rx flags
+	{ 2, 2 },   // tx flags
+	{ 1, 1 },   // rts retries
+	{ 1, 1 },   // data retries
+	{ 4, 8 },   // xchannel
+	{ 1, 3 },   // mcs
+	{ 4, 8 },   // a-mpdu status
+	{ 2, 12 },  // vht
+	{ 8, 12 },  // timestamp
+	{ 2, 12 },  // he
+	{ 2, 12 },  // he-mu
+	{ 2, 6 },   // he-mu-other-user
+	{ 1, 1 },   // 0 length psdu
+	{ 2, 4 },   // l-sig
+};
+
+struct ref_item_t {
+	uint8_t ns;
+	uint8_t vendor;
+	uint16_t field;
+	uint16_t off;
+	uint16_t size;
+};
+
+static struct rtap_cache_t cache;
+static uint64_t n_ok, n_bad, n_partial, n_vendor, n_add;
+
+static uint32_t rd16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t rd32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// every field in order as the spec describes the walk, -1 for a malformed
+// header, partial set when a field of unknown size stopped it
+static int ref_walk(const uint8_t *h, uint32_t len, struct ref_item_t *it, uint32_t *n, int *partial, uint32_t *end)
+{
+	uint32_t present[64], nw = 0, it_len, pos, w, b;
+	uint32_t ns = RTAP_NS_RADIOTAP, seg = 0, skip = 0;
+
+	*n = 0;
+	*partial = 0;
+
+	if (len < 8 || h[0] != 0) {
+		return -1;
+	}
+	it_len = rd16(h + 2);
+	if (it_len > len || it_len < 8) {
+		return -1;
+	}
+
+	pos = 4;
+	for (;;) {
+		if (pos + 4 > it_len) {
+			return -1;
+		}
+		present[nw] = rd32(h + pos);
+		pos += 4;
+		if (!(present[nw++] & B(EXT))) {
+			break;
+		}
+		if (nw == RTAP_MAX_WORDS) {
+			return -1;
+		}
+	}
+
+	for (w = 0; w < nw; w++) {
+		if ((present[w] & B(RADIOTAP_NAMESPACE)) && (present[w] & B(VENDOR_NAMESPACE))) {
+			return -1;
+		}
+
+		if (ns == RTAP_NS_VENDOR) {
+			if (seg == 0 && !*partial) {
+				it[*n] = (struct ref_item_t){ ns, 1, 0, pos, skip };
+				(*n)++;
+				pos += skip;
+			}
+		} else {
+			for (b = 0; b < 29 && !*partial; b++) {
+				if (!(present[w] & (1u << b))) {
+					continue;
+				}
+				if (seg || b == 28 || spec[b][1] == 0) {
+					*partial = 1;
+					break;
+				}
+				pos = (pos + spec[b][0] - 1) / spec[b][0] * spec[b][0];
+				it[*n] = (struct ref_item_t){ ns, 0, seg * 32 + b, pos, spec[b][1] };
+				(*n)++;
+				pos += spec[b][1];
+				if (pos > it_len) {
+					return -1;
+				}
+			}
+		}
+
+		if (present[w] & B(VENDOR_NAMESPACE)) {
+			if (!*partial) {
+				pos = (pos + 1) & ~1u;
+				if (pos + 6 > it_len) {
+					return -1;
+				}
+				it[*n] = (struct ref_item_t){ ns, 0, seg * 32 + 30, pos, 6 };
+				(*n)++;
+				skip = rd16(h + pos + 4);
+				pos += 6;
+			}
+			ns = RTAP_NS_VENDOR;
+			seg = 0;
+		} else if (present[w] & B(RADIOTAP_NAMESPACE)) {
+			ns = RTAP_NS_RADIOTAP;
+			seg = 0;
+		} else {
+			seg++;
+		}
+
+		if (pos > it_len) {
+			return -1;
+		}
+	}
+
+	*end = pos;
+
+	return 0;
+}
+
+// the layout iterator has to give the same list as the walk
+static int same_items(const struct rtap_layout_t *l, const uint8_t *h, const struct ref_item_t *ref, uint32_t n)
+{
+	struct rtap_iter_t it;
+	struct rtap_item_t item;
+	uint32_t i = 0;
+
+	rtap_iter_init(&it, l, h);
+	while (rtap_iter_next(&it, &item)) {
+		if (i == n) {
+			return 0;
+		}
+		if (item.ns != ref[i].ns || item.vendor != ref[i].vendor || item.off != ref[i].off ||
+		    item.size != ref[i].size || item.p != h + ref[i].off || (!item.vendor && item.field != ref[i].field)) {
+			return 0;
+		}
+		i++;
+	}
+
+	return i == n;
+}
+
+static void check_table(void)
+{
+	uint32_t b;
+
+	for (b = 0; b < 32; b++) {
+		if (rtap_fields[b].align != spec[b][0] || rtap_fields[b].size != spec[b][1]) {
+			printf("FAIL field %u: %u/%u, spec %u/%u\n", b, rtap_fields[b].align, rtap_fields[b].size, spec[b][0], spec[b][1]);
+			fails++;
+		}
+	}
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	memcpy(p, &v, 4);
+}
+
+static void expect(const char *name, const uint8_t *h, uint32_t len, int ok, int partial, const uint16_t (*off)[2], uint32_t end)
+{
+	struct rtap_layout_t l;
+	int r = rtap_layout(&l, h, len);
+
+	if ((r == 0) != ok) {
+		printf("FAIL %s: %s\n", name, ok ? "rejected" : "accepted");
+		fails++;
+		return;
+	}
+	if (!ok) {
+		return;
+	}
+	if (!!(l.flags & RTAP_LAYOUT_PARTIAL) != partial) {
+		printf("FAIL %s: partial %u\n", name, l.flags);
+		fails++;
+	}
+	for (; off && (*off)[0] != 0xffff; off++) {
+		if (l.off[(*off)[0]] != (*off)[1]) {
+			printf("FAIL %s: field %u at %u, expected %u\n", name, (*off)[0], l.off[(*off)[0]], (*off)[1]);
+			fails++;
+		}
+	}
+	if (end && l.end != end) {
+		printf("FAIL %s: ends at %u, expected %u\n", name, l.end, end);
+		fails++;
+	}
+}
+
+static void check_known(void)
+{
+	uint8_t h[64] __attribute__ ((aligned(8)));
+	uint8_t out[128];
+	struct rx_radiotap_hdr *rx = (void *)h;
+
+	// the header capture() writes
+	memset(h, 0, sizeof(h));
+	rx->hdr.it_len = sizeof(*rx);
+	rx->hdr.it_present = RX_RADIOTAP_PRESENT;
+	{
+		const uint16_t off[][2] = {
+			{ IEEE80211_RADIOTAP_FLAGS, offsetof(struct rx_radiotap_hdr, flags) },
+			{ IEEE80211_RADIOTAP_RATE, offsetof(struct rx_radiotap_hdr, rate) },
+			{ IEEE80211_RADIOTAP_CHANNEL, offsetof(struct rx_radiotap_hdr, ch_freq) },
+			{ IEEE80211_RADIOTAP_DB_ANTSIGNAL, offsetof(struct rx_radiotap_hdr, antsignal) },
+			{ IEEE80211_RADIOTAP_DB_ANTNOISE, offsetof(struct rx_radiotap_hdr, antnoise) },
+			{ IEEE80211_RADIOTAP_MCS, offsetof(struct rx_radiotap_hdr, mcs_known) },
+			{ 0xffff, 0 },
+		};
+		expect("rx header", h, sizeof(*rx), 1, 0, off, sizeof(*rx));
+	}
+
+	// timestamp appended the way capture() does it, 8 aligned behind mcs
+	{
+		uint8_t ts[12] = { 1, 2, 3, 4, 5, 6, 7, 8, 0, 0, 0xf1, 0 };
+		int n;
+
+		rx->ch_freq = 2437;
+		rx->mcs = 7;
+		n = rtap_add(&cache, h, sizeof(*rx), out, sizeof(out), IEEE80211_RADIOTAP_TIMESTAMP, ts);
+		if (n != 36 || rd16(out + 2) != 36 || rd32(out + 4) != (RX_RADIOTAP_PRESENT | B(TIMESTAMP)) ||
+		    memcmp(out + 8, h + 8, sizeof(*rx) - 8) || memcmp(out + 24, ts, 12) || out[19] || out[23]) {
+			printf("FAIL rx header timestamp, %d bytes\n", n);
+			fails++;
+		}
+	}
+
+	// three words as mac80211 writes them for two antennas
+	memset(h, 0, sizeof(h));
+	h[2] = 38;
+	put32(h + 4, B(TSFT) | B(FLAGS) | B(RATE) | B(CHANNEL) | B(DBM_ANTSIGNAL) | B(RX_FLAGS) | B(RADIOTAP_NAMESPACE) | B(EXT));
+	put32(h + 8, B(DBM_ANTSIGNAL) | B(ANTENNA) | B(RADIOTAP_NAMESPACE) | B(EXT));
+	put32(h + 12, B(DBM_ANTSIGNAL) | B(ANTENNA));
+	{
+		const uint16_t off[][2] = {
+			{ 0, 16 }, { 1, 24 }, { 2, 25 }, { 3, 26 }, { 5, 30 }, { 14, 32 },
+			{ 32 + 5, 34 }, { 32 + 11, 35 }, { 64 + 5, 36 }, { 64 + 11, 37 },
+			{ 0xffff, 0 },
+		};
+		expect("mac80211", h, 38, 1, 0, off, 38);
+		expect("mac80211 short", h, 37, 0, 0, NULL, 0);
+	}
+
+	// a vendor namespace with 5 bytes of data between two radiotap ones
+	memset(h, 0, sizeof(h));
+	h[2] = 30;
+	put32(h + 4, B(FLAGS) | B(VENDOR_NAMESPACE) | B(EXT));
+	put32(h + 8, 0x3 | B(RADIOTAP_NAMESPACE) | B(EXT));
+	put32(h + 12, B(DBM_ANTSIGNAL));
+	h[18] = 0x00; h[19] = 0x11; h[20] = 0x22; h[21] = 1;
+	h[22] = 5;
+	{
+		const uint16_t off[][2] = {
+			{ 1, 16 }, { 30, 18 }, { 64 + 5, 29 },
+			{ 0xffff, 0 },
+		};
+		struct rtap_layout_t l;
+
+		expect("vendor", h, 30, 1, 0, off, 30);
+		rtap_layout(&l, h, 30);
+		if (!(l.flags & RTAP_LAYOUT_VENDOR) || l.voff[1] != 24 || l.vskip[1] != 5) {
+			printf("FAIL vendor data at %u, %u bytes\n", l.voff[1], l.vskip[1]);
+			fails++;
+		}
+	}
+
+	// the tlv list ends what can be located
+	memset(h, 0, sizeof(h));
+	h[2] = 16;
+	put32(h + 4, B(FLAGS) | B(DBM_ANTSIGNAL) | (1u << 28));
+	{
+		const uint16_t off[][2] = { { 1, 8 }, { 5, 9 }, { 0xffff, 0 } };
+		expect("tlv", h, 16, 1, 1, off, 10);
+		if (rtap_add(&cache, h, 16, out, sizeof(out), IEEE80211_RADIOTAP_TSFT, out) != -1) {
+			printf("FAIL rtap_add on a partial layout\n");
+			fails++;
+		}
+	}
+
+	// malformed ones
+	memset(h, 0, sizeof(h));
+	h[2] = 8;
+	expect("empty", h, 8, 1, 0, NULL, 8);
+	h[0] = 1;
+	expect("version", h, 8, 0, 0, NULL, 0);
+	h[0] = 0;
+	h[2] = 7;
+	expect("it_len small", h, 8, 0, 0, NULL, 0);
+	h[2] = 9;
+	expect("it_len past buffer", h, 8, 0, 0, NULL, 0);
+	h[2] = 12;
+	put32(h + 4, B(TSFT));
+	expect("field past it_len", h, 12, 0, 0, NULL, 0);
+	h[2] = 12;
+	put32(h + 4, B(EXT));
+	put32(h + 8, B(EXT));
+	expect("ext past it_len", h, 12, 0, 0, NULL, 0);
+	h[2] = 64;
+	{
+		uint32_t i;
+		for (i = 0; i < 9; i++) {
+			put32(h + 4 + i * 4, B(EXT));
+		}
+		put32(h + 4 + 9 * 4, 0);
+		expect("9 words", h, 64, 0, 0, NULL, 0);
+	}
+	memset(h, 0, sizeof(h));
+	h[2] = 32;
+	put32(h + 4, B(RADIOTAP_NAMESPACE) | B(VENDOR_NAMESPACE) | B(EXT));
+	expect("both namespaces", h, 32, 0, 0, NULL, 0);
+	put32(h + 4, B(VENDOR_NAMESPACE) | B(EXT));
+	h[2] = 14;
+	expect("vendor header past it_len", h, 14, 0, 0, NULL, 0);
+	h[2] = 20;
+	h[16] = 9;
+	expect("vendor data past it_len", h, 20, 0, 0, NULL, 0);
+}
+
+// random header of up to 4 words, namespaces switched at random
+static uint32_t gen(uint8_t *h)
+{
+	uint32_t present[RTAP_MAX_WORDS], nw = 1 + rng() % 4;
+	uint32_t w, pos, ns = RTAP_NS_RADIOTAP, seg = 0, skip = 0, b;
+
+	for (w = 0; w < nw; w++) {
+		uint32_t m = rng() & rng();
+
+		if (ns == RTAP_NS_RADIOTAP && seg == 0) {
+			m &= 0x0fffffff;
+			if ((rng() & 31) == 0) {
+				m |= 1u << 28;
+			}
+		} else if (ns == RTAP_NS_RADIOTAP) {
+			m = (rng() & 7) == 0 ? rng() & 0x1fffffff : 0;
+		} else {
+			m &= 0x1fffffff;
+		}
+		switch (rng() % 4) {
+		case 0: m |= B(VENDOR_NAMESPACE); ns = RTAP_NS_VENDOR; seg = 0; break;
+		case 1: m |= B(RADIOTAP_NAMESPACE); ns = RTAP_NS_RADIOTAP; seg = 0; break;
+		default: seg++; break;
+		}
+		if (w + 1 < nw) {
+			m |= B(EXT);
+		}
+		present[w] = m;
+	}
+
+	memset(h, 0, MAX_HDR);
+	for (w = 0; w < nw; w++) {
+		put32(h + 4 + w * 4, present[w]);
+	}
+
+	// lay the data out as the walk expects it, vendor lengths included
+	pos = 4 + nw * 4;
+	ns = RTAP_NS_RADIOTAP;
+	seg = 0;
+	for (w = 0; w < nw; w++) {
+		if (ns == RTAP_NS_VENDOR) {
+			if (seg == 0) {
+				for (b = 0; b < skip; b++) {
+					h[pos++] = rng();
+				}
+			}
+		} else if (seg == 0) {
+			for (b = 0; b < 28; b++) {
+				if (present[w] & (1u << b)) {
+					pos = (pos + spec[b][0] - 1) / spec[b][0] * spec[b][0];
+					for (uint32_t i = 0; i < spec[b][1]; i++) {
+						h[pos++] = rng();
+					}
+				}
+			}
+		}
+		if (present[w] & B(VENDOR_NAMESPACE)) {
+			pos = (pos + 1) & ~1u;
+			skip = rng() % 12;
+			h[pos] = rng();
+			h[pos + 1] = rng();
+			h[pos + 2] = rng();
+			h[pos + 3] = rng();
+			h[pos + 4] = skip;
+			h[pos + 5] = 0;
+			pos += 6;
+			ns = RTAP_NS_VENDOR;
+			seg = 0;
+		} else if (present[w] & B(RADIOTAP_NAMESPACE)) {
+			ns = RTAP_NS_RADIOTAP;
+			seg = 0;
+		} else {
+			seg++;
+		}
+	}
+
+	// sometimes trailing padding
+	pos += (rng() & 7) == 0 ? rng() % 4 : 0;
+	h[2] = pos;
+	h[3] = pos >> 8;
+
+	return pos;
+}
+
+static void mutate(uint8_t *h, uint32_t *len)
+{
+	uint32_t at = rng() % *len;
+
+	switch (rng() % 4) {
+	case 0: h[at] ^= 1 << (rng() & 7); break;
+	case 1: h[at] = rng(); break;
+	case 2: *len = rng() % (*len + 1); break;
+	default: h[2 + (rng() & 1)] = rng(); break;
+	}
+}
+
+// the copy has every field of the source with the same bytes and the new one
+static void check_add(const uint8_t *h, uint32_t len, const struct ref_item_t *ref, uint32_t n)
+{
+	static const uint32_t add[] = { IEEE80211_RADIOTAP_TSFT, IEEE80211_RADIOTAP_VHT, IEEE80211_RADIOTAP_TIMESTAMP, IEEE80211_RADIOTAP_MCS };
+	static struct ref_item_t out_ref[MAX_ITEMS];
+	uint8_t out[MAX_HDR + 64], val[12];
+	struct rtap_layout_t ol;
+	uint32_t field = add[rng() % 4], i, j, out_n, end;
+	int r, partial, had = 0;
+
+	for (i = 0; i < sizeof(val); i++) {
+		val[i] = rng();
+	}
+
+	r = rtap_add(&cache, h, len, out, sizeof(out), field, val);
+	if (r < 0) {
+		fail("rtap_add rejected", h, len);
+		return;
+	}
+	n_add++;
+
+	had = (rd32(h + 4) >> field) & 1;
+
+	// a field already there is set in a plain copy, padding and all
+	if (ref_walk(out, r, out_ref, &out_n, &partial, &end) < 0 || partial || (had ? r != (int)len : end != (uint32_t)r)) {
+		fail("rtap_add result", out, r);
+		return;
+	}
+	if (out_n != n + !had) {
+		fail("rtap_add field count", out, r);
+		return;
+	}
+
+	// same order, the new field slots in by bit number in the first word
+	rtap_layout(&ol, out, r);
+	for (i = 0, j = 0; j < out_n; j++) {
+		const struct ref_item_t *o = &out_ref[j];
+
+		if (!o->vendor && o->off == ol.off[field]) {
+			if (memcmp(out + o->off, val, o->size)) {
+				fail("rtap_add value", out, r);
+				return;
+			}
+			if (had) {
+				i++;
+			}
+			continue;
+		}
+		if (i >= n || o->vendor != ref[i].vendor || o->size != ref[i].size || (!o->vendor && o->field != ref[i].field) ||
+		    memcmp(out + o->off, h + ref[i].off, o->size)) {
+			fail("rtap_add moved field", out, r);
+			return;
+		}
+		i++;
+	}
+}
+
+static void run(uint64_t iters)
+{
+	static uint8_t buf[MAX_HDR];
+	static struct ref_item_t ref[MAX_ITEMS];
+	uint64_t k;
+
+	for (k = 0; k < iters; k++) {
+		uint32_t len = gen(buf), n, end;
+		int partial, r, mutated = 0;
+		struct rtap_layout_t l;
+		const struct rtap_layout_t *pl;
+		uint8_t *h;
+
+		if ((rng() & 3) == 0) {
+			mutate(buf, &len);
+			mutated = 1;
+		}
+
+		// exact size so an overread is seen by the sanitizers
+		h = malloc(len ? len : 1);
+		memcpy(h, buf, len);
+
+		r = ref_walk(h, len, ref, &n, &partial, &end);
+		if ((rtap_layout(&l, h, len) == 0) != (r == 0)) {
+			fail(r == 0 ? "valid header rejected" : "malformed header accepted", h, len);
+			free(h);
+			continue;
+		}
+		if (r < 0) {
+			n_bad++;
+			if (rtap_parse(&cache, h, len) != NULL) {
+				fail("parse accepted a malformed header", h, len);
+			}
+			free(h);
+			continue;
+		}
+
+		n_ok++;
+		n_partial += partial;
+		n_vendor += (l.flags & RTAP_LAYOUT_VENDOR) != 0;
+
+		if (!!(l.flags & RTAP_LAYOUT_PARTIAL) != partial || l.end != end || !same_items(&l, h, ref, n)) {
+			fail("layout differs from the walk", h, len);
+		}
+
+		pl = rtap_parse(&cache, h, len);
+		if (pl == NULL || memcmp(pl, &l, sizeof(l))) {
+			fail("cached layout differs", h, len);
+		}
+
+		if (!partial && !mutated) {
+			check_add(h, len, ref, n);
+		}
+
+		free(h);
+	}
+}
+
+static void check_cache(void)
+{
+	struct rx_radiotap_hdr rx;
+	uint32_t hits, misses;
+
+	memset(&rx, 0, sizeof(rx));
+	rx.hdr.it_len = sizeof(rx);
+	rx.hdr.it_present = RX_RADIOTAP_PRESENT;
+
+	rtap_cache_init(&cache);
+	rtap_parse(&cache, (uint8_t *)&rx, sizeof(rx));
+	hits = cache.hits;
+	misses = cache.misses;
+	rtap_parse(&cache, (uint8_t *)&rx, sizeof(rx));
+	rtap_parse(&cache, (uint8_t *)&rx, sizeof(rx));
+	if (misses != 1 || hits != 0 || cache.hits != 2 || cache.misses != 1) {
+		printf("FAIL cache: %u hits %u misses\n", cache.hits, cache.misses);
+		fails++;
+	}
+
+	// a shorter buffer than the cached shape needs is still caught
+	rx.hdr.it_len = sizeof(rx) - 1;
+	if (rtap_parse(&cache, (uint8_t *)&rx, sizeof(rx)) != NULL) {
+		printf("FAIL cache hit on a short header\n");
+		fails++;
+	}
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-n iterations] [-s seed]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t iters = 200000;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:s:")) != -1) {
+		switch (c) {
+		case 'n': iters = strtoull(optarg, NULL, 0); break;
+		case 's': rng_state = strtoul(optarg, NULL, 0) | 1; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	rtap_cache_init(&cache);
+
+	check_table();
+	check_known();
+	check_cache();
+	run(iters);
+
+	printf("%llu headers: %llu valid (%llu partial, %llu vendor), %llu malformed, %llu rewritten\n",
+		(unsigned long long)iters, (unsigned long long)n_ok, (unsigned long long)n_partial,
+		(unsigned long long)n_vendor, (unsigned long long)n_bad, (unsigned long long)n_add);
+	printf("cache %u hits %u misses\n", cache.hits, cache.misses);
+	printf("%s\n", fails ? "FAIL" : "ok");
+
+	return fails ? 2 : 0;
+}
@@ -0,0 +1,673 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "kwifimon.h"
+#include "radiotap.h"
+#include "rtap.h"
+#include "pcap.h"
+
+#include "sdiotrace.h"
+#include "sdiogen.h"
+
+#define FC_BEACON     0x0080
+#define FC_PROBE_REQ  0x0040
+#define FC_PROBE_RESP 0x0050
+#define FC_DATA       0x0008
+#define FC_QOS_DATA   0x0088
+#define FC_BAR        0x0084
+#define FC_TODS       0x0100
+#define FC_FROMDS     0x0200
+#define FC_PROTECTED  0x4000
+
+#define QOS_AMSDU     0x0080
+
+// legacy rate index as used in rxpd.rx_rate, index 4 is unused
+static const uint8_t gen_legacy_rates[] = { 0x02, 0x04, 0x0B, 0x16, 0x00, 0x0C, 0x12, 0x18, 0x24, 0x30, 0x48, 0x60, 0x6C };
+
+static const uint8_t gen_bcast[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+static uint32_t gen_rand(struct sdiogen_t *g)
+{
+	g->rnd ^= g->rnd << 13;
+	g->rnd ^= g->rnd >> 17;
+	g->rnd ^= g->rnd << 5;
+	return g->rnd;
+}
+
+static uint32_t gen_range(struct sdiogen_t *g, uint32_t lo, uint32_t hi)
+{
+	if (hi <= lo) {
+		return lo;
+	}
+	return lo + gen_rand(g) % (hi - lo + 1);
+}
+
+static int gen_pct(struct sdiogen_t *g, uint32_t pct)
+{
+	return (gen_rand(g) % 100) < pct;
+}
+
+// roughly normal, sum of four uniforms
+static int32_t gen_norm(struct sdiogen_t *g, int32_t mean, int32_t dev)
+{
+	int32_t s = 0;
+	int i;
+
+	if (dev <= 0) {
+		return mean;
+	}
+
+	for (i = 0; i < 4; i++) {
+		s += (int32_t)(gen_rand(g) % (2 * dev + 1)) - dev;
+	}
+
+	return mean + s / 2;
+}
+
+static int8_t gen_clamp8(int32_t v)
+{
+	return (v > 127) ? 127 : (v < -128) ? -128 : v;
+}
+
+void sdiogen_default(struct sdiogen_cfg_t *cfg)
+{
+	memset(cfg, 0, sizeof(struct sdiogen_cfg_t));
+
+	cfg->seed = 1;
+	cfg->frames = 100000;
+
+	cfg->w_beacon = 20;
+	cfg->w_probe = 5;
+	cfg->w_data = 60;
+	cfg->w_amsdu = 10;
+	cfg->w_bar = 5;
+
+	cfg->bss = 8;
+	cfg->stations = 64;
+	cfg->churn_pm = 2;
+
+	cfg->ht_pct = 70;
+	cfg->ht40_pct = 30;
+	cfg->sgi_pct = 50;
+	cfg->snr_mean = 30;
+	cfg->snr_dev = 8;
+	cfg->nf_mean = -92;
+	cfg->nf_dev = 3;
+
+	cfg->len_min = 40;
+	cfg->len_max = 1500;
+	cfg->amsdu_max = 4;
+
+	cfg->rate = 2000;
+	cfg->burst_len = 8;
+	cfg->burst_gap_us = 60;
+}
+
+// longest subframe body of an n subframe A-MSDU
+static uint32_t gen_sub_max(uint32_t len_max, uint32_t n)
+{
+	return (len_max / n > 64) ? len_max / n : 64;
+}
+
+// worst case A-MSDU: qos header, then every subframe at its longest and padded
+static uint32_t gen_amsdu_len(uint32_t len_max, uint32_t n)
+{
+	return 24 + 2 + n * (14 + gen_sub_max(len_max, n) + 3);
+}
+
+static void gen_new_sta(struct sdiogen_t *g, struct sdiogen_sta_t *s)
+{
+	uint32_t id = g->sta_next++;
+
+	s->addr[0] = 0x02;
+	s->addr[1] = 0x00;
+	s->addr[2] = id >> 24;
+	s->addr[3] = id >> 16;
+	s->addr[4] = id >> 8;
+	s->addr[5] = id;
+	s->bss = gen_rand(g) % g->cfg.bss;
+	s->seq = gen_rand(g) & 0xfff;
+	s->snr = gen_clamp8(gen_norm(g, g->cfg.snr_mean, g->cfg.snr_dev));
+}
+
+int sdiogen_init(struct sdiogen_t *g, const struct sdiogen_cfg_t *cfg)
+{
+	uint32_t i;
+
+	memset(g, 0, sizeof(struct sdiogen_t));
+	g->cfg = *cfg;
+
+	if (g->cfg.bss == 0 || g->cfg.bss > SDIOGEN_MAX_BSS) {
+		return -1;
+	}
+	if (g->cfg.stations == 0 || g->cfg.stations > SDIOGEN_MAX_STA) {
+		return -2;
+	}
+	if (g->cfg.len_max > SDIOGEN_MAX_PKT - 256 || g->cfg.len_min > g->cfg.len_max) {
+		return -3;
+	}
+
+	g->w_total = cfg->w_beacon + cfg->w_probe + cfg->w_data + cfg->w_amsdu + cfg->w_bar;
+	if (g->w_total == 0) {
+		return -4;
+	}
+
+	if (g->cfg.burst_len == 0) {
+		g->cfg.burst_len = 1;
+	}
+	if (g->cfg.amsdu_max < 2) {
+		g->cfg.amsdu_max = 2;
+	}
+	// the largest A-MSDU has to fit in a packet, len_max above leaves room for 2
+	if (g->cfg.amsdu_max > SDIOGEN_MAX_PKT / 64) {
+		g->cfg.amsdu_max = SDIOGEN_MAX_PKT / 64;
+	}
+	while (g->cfg.amsdu_max > 2 && gen_amsdu_len(g->cfg.len_max, g->cfg.amsdu_max) >
+		SDIOGEN_MAX_PKT - sizeof(struct sdio_rx_t) - sizeof(struct rxpd)) {
+		g->cfg.amsdu_max--;
+	}
+
+	g->rnd = cfg->seed ? cfg->seed : 1;
+
+	for (i = 0; i < g->cfg.bss; i++) {
+		struct sdiogen_bss_t *b = &g->bss[i];
+
+		b->bssid[0] = 0x02;
+		b->bssid[1] = 0xb5;
+		b->bssid[2] = 0x5b;
+		b->bssid[3] = gen_rand(g);
+		b->bssid[4] = i >> 8;
+		b->bssid[5] = i;
+		b->channel = (i % 3) * 5 + 1;
+		b->ssid_len = snprintf(b->ssid, sizeof(b->ssid), "net-%u-%04x", i, gen_rand(g) & 0xffff);
+		b->beacon_int = 100;
+		b->seq = gen_rand(g) & 0xfff;
+		b->snr = gen_clamp8(gen_norm(g, g->cfg.snr_mean, g->cfg.snr_dev));
+		b->tsf = (uint64_t)gen_rand(g) << 8;
+	}
+
+	for (i = 0; i < g->cfg.stations; i++) {
+		gen_new_sta(g, &g->sta[i]);
+	}
+
+	return 0;
+}
+
+static uint8_t *gen_hdr(uint8_t *p, uint16_t fc, const uint8_t *a1, const uint8_t *a2, const uint8_t *a3, uint16_t seq)
+{
+	uint16_t dur = 44;
+	uint16_t sc = seq << 4;
+
+	memcpy(p, &fc, 2);
+	memcpy(p + 2, &dur, 2);
+	memcpy(p + 4, a1, 6);
+	memcpy(p + 10, a2, 6);
+	memcpy(p + 16, a3, 6);
+	memcpy(p + 22, &sc, 2);
+
+	return p + 24;
+}
+
+static uint8_t *gen_ie(uint8_t *p, uint8_t id, const void *data, uint8_t len)
+{
+	p[0] = id;
+	p[1] = len;
+	memcpy(p + 2, data, len);
+	return p + 2 + len;
+}
+
+static uint8_t *gen_fill(struct sdiogen_t *g, uint8_t *p, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i < len; i++) {
+		p[i] = gen_rand(g);
+	}
+
+	return p + len;
+}
+
+// common beacon / probe response body
+static uint8_t *gen_bss_body(struct sdiogen_t *g, uint8_t *p, struct sdiogen_bss_t *b, int beacon)
+{
+	static const uint8_t rates[] = { 0x82, 0x84, 0x8b, 0x96, 0x0c, 0x12, 0x18, 0x24 };
+	static const uint8_t tim[] = { 0x00, 0x01, 0x00, 0x00 };
+	static const uint8_t rsn[] = { 0x01, 0x00, 0x00, 0x0f, 0xac, 0x04, 0x01, 0x00, 0x00, 0x0f, 0xac, 0x04,
+		0x01, 0x00, 0x00, 0x0f, 0xac, 0x02, 0x00, 0x00 };
+	uint8_t htcap[26];
+	uint16_t capab = 0x0411;
+
+	b->tsf += b->beacon_int * 1024;
+	memcpy(p, &b->tsf, 8);
+	memcpy(p + 8, &b->beacon_int, 2);
+	memcpy(p + 10, &capab, 2);
+	p += 12;
+
+	p = gen_ie(p, 0, b->ssid, b->ssid_len);
+	p = gen_ie(p, 1, rates, sizeof(rates));
+	p = gen_ie(p, 3, &b->channel, 1);
+	if (beacon) {
+		p = gen_ie(p, 5, tim, sizeof(tim));
+	}
+
+	memset(htcap, 0, sizeof(htcap));
+	htcap[0] = 0x6e;
+	htcap[1] = 0x01;
+	htcap[3] = 0xff;
+	p = gen_ie(p, 45, htcap, sizeof(htcap));
+	p = gen_ie(p, 48, rsn, sizeof(rsn));
+
+	return p;
+}
+
+static uint8_t *gen_snap(struct sdiogen_t *g, uint8_t *p, uint32_t len)
+{
+	static const uint8_t snap[] = { 0xaa, 0xaa, 0x03, 0x00, 0x00, 0x00, 0x08, 0x00 };
+
+	memcpy(p, snap, sizeof(snap));
+	return gen_fill(g, p + sizeof(snap), len);
+}
+
+static void gen_phy(struct sdiogen_t *g, struct rxpd *rx_pd, int8_t snr)
+{
+	if (gen_pct(g, g->cfg.ht_pct)) {
+		rx_pd->ht_info = 1;
+		rx_pd->ht_info |= gen_pct(g, g->cfg.ht40_pct) ? 2 : 0;
+		rx_pd->ht_info |= gen_pct(g, g->cfg.sgi_pct) ? 4 : 0;
+		// better link, higher mcs
+		int32_t mcs = (snr - 5) / 4;
+		rx_pd->rx_rate = (mcs < 0) ? 0 : (mcs > 7) ? 7 : mcs;
+	} else {
+		uint32_t i = gen_rand(g) % sizeof(gen_legacy_rates);
+		rx_pd->rx_rate = (i == 4) ? 5 : i;
+	}
+
+	rx_pd->snr = gen_clamp8(gen_norm(g, snr, 3));
+	rx_pd->nf = gen_clamp8(gen_norm(g, g->cfg.nf_mean, g->cfg.nf_dev));
+}
+
+static uint32_t gen_delay(struct sdiogen_t *g)
+{
+	uint32_t mean;
+
+	if (g->cfg.rate == 0) {
+		return 0;
+	}
+
+	if (g->burst_left) {
+		g->burst_left--;
+		return g->cfg.burst_gap_us;
+	}
+
+	g->burst_left = g->cfg.burst_len - 1;
+
+	// keep the long term rate, burst internal gaps come out of the idle time
+	mean = (uint32_t)(1000000ull * g->cfg.burst_len / g->cfg.rate);
+	if (mean > (g->cfg.burst_len - 1) * g->cfg.burst_gap_us) {
+		mean -= (g->cfg.burst_len - 1) * g->cfg.burst_gap_us;
+	} else {
+		mean = 1;
+	}
+
+	return gen_range(g, mean / 2, mean + mean / 2);
+}
+
+int sdiogen_next(struct sdiogen_t *g, uint8_t *buf, uint32_t buf_len, uint32_t *delta_us)
+{
+	struct sdio_rx_t *rxt = (struct sdio_rx_t *)buf;
+	struct rxpd *rx_pd = (struct rxpd *)(buf + sizeof(struct sdio_rx_t));
+	uint8_t *start = (uint8_t *)rx_pd + sizeof(struct rxpd);
+	uint8_t *p = start;
+	uint32_t w, len;
+
+	if (buf_len < SDIOGEN_MAX_PKT) {
+		return -1;
+	}
+
+	if (g->cfg.churn_pm && (gen_rand(g) % 1000) < g->cfg.churn_pm) {
+		gen_new_sta(g, &g->sta[gen_rand(g) % g->cfg.stations]);
+	}
+
+	memset(rx_pd, 0, sizeof(struct rxpd));
+
+	struct sdiogen_sta_t *s = &g->sta[gen_rand(g) % g->cfg.stations];
+	struct sdiogen_bss_t *b = &g->bss[s->bss];
+
+	w = gen_rand(g) % g->w_total;
+
+	if (w < g->cfg.w_beacon) {
+		b = &g->bss[gen_rand(g) % g->cfg.bss];
+		b->seq = (b->seq + 1) & 0xfff;
+		p = gen_hdr(p, FC_BEACON, gen_bcast, b->bssid, b->bssid, b->seq);
+		p = gen_bss_body(g, p, b, 1);
+		rx_pd->rx_pkt_type = PKT_TYPE_MGMT;
+		gen_phy(g, rx_pd, b->snr);
+		// beacons go out at basic rates
+		rx_pd->ht_info = 0;
+		rx_pd->rx_rate = 0;
+	} else if ((w -= g->cfg.w_beacon) < g->cfg.w_probe) {
+		s->seq = (s->seq + 1) & 0xfff;
+		if (gen_rand(g) & 1) {
+			static const uint8_t rates[] = { 0x02, 0x04, 0x0b, 0x16 };
+			p = gen_hdr(p, FC_PROBE_REQ, gen_bcast, s->addr, gen_bcast, s->seq);
+			p = gen_ie(p, 0, b->ssid, (gen_rand(g) & 1) ? b->ssid_len : 0);
+			p = gen_ie(p, 1, rates, sizeof(rates));
+			gen_phy(g, rx_pd, s->snr);
+		} else {
+			b->seq = (b->seq + 1) & 0xfff;
+			p = gen_hdr(p, FC_PROBE_RESP, s->addr, b->bssid, b->bssid, b->seq);
+			p = gen_bss_body(g, p, b, 0);
+			gen_phy(g, rx_pd, b->snr);
+		}
+		rx_pd->rx_pkt_type = PKT_TYPE_MGMT;
+	} else if ((w -= g->cfg.w_probe) < g->cfg.w_data) {
+		int up = gen_rand(g) & 1;
+		int qos = gen_pct(g, 80);
+		uint16_t fc = (qos ? FC_QOS_DATA : FC_DATA) | (up ? FC_TODS : FC_FROMDS);
+		uint8_t dst[6];
+
+		gen_fill(g, dst, 6);
+		dst[0] &= ~1;
+
+		len = gen_range(g, g->cfg.len_min, g->cfg.len_max);
+		if (gen_pct(g, 60)) {
+			fc |= FC_PROTECTED;
+		}
+
+		s->seq = (s->seq + 1) & 0xfff;
+		if (up) {
+			p = gen_hdr(p, fc, b->bssid, s->addr, dst, s->seq);
+		} else {
+			p = gen_hdr(p, fc, s->addr, b->bssid, dst, s->seq);
+		}
+
+		if (qos) {
+			uint16_t qc = gen_rand(g) & 7;
+			memcpy(p, &qc, 2);
+			p += 2;
+			rx_pd->priority = qc;
+		}
+
+		if (fc & FC_PROTECTED) {
+			// ccmp header, encrypted body, mic
+			p = gen_fill(g, p, 8 + len + 8);
+		} else {
+			p = gen_snap(g, p, len);
+		}
+
+		rx_pd->seq_num = s->seq;
+		gen_phy(g, rx_pd, up ? s->snr : b->snr);
+	} else if ((w -= g->cfg.w_data) < g->cfg.w_amsdu) {
+		uint32_t n = gen_range(g, 2, g->cfg.amsdu_max);
+		uint32_t i, sub_max = gen_sub_max(g->cfg.len_max, n);
+		uint16_t qc = (gen_rand(g) & 7) | QOS_AMSDU;
+
+		s->seq = (s->seq + 1) & 0xfff;
+		p = gen_hdr(p, FC_QOS_DATA | FC_FROMDS, s->addr, b->bssid, b->bssid, s->seq);
+		memcpy(p, &qc, 2);
+		p += 2;
+
+		for (i = 0; i < n; i++) {
+			uint32_t sub = gen_range(g, 8 + 20, sub_max);
+			uint16_t be = (sub >> 8) | ((sub & 0xff) << 8);
+
+			memcpy(p, s->addr, 6);
+			gen_fill(g, p + 6, 6);
+			memcpy(p + 12, &be, 2);
+			p = gen_snap(g, p + 14, sub - 8);
+
+			// all but the last subframe are padded to 4 bytes
+			if (i != n - 1) {
+				while ((p - start - 26) & 3) {
+					*p++ = 0;
+				}
+			}
+		}
+
+		rx_pd->rx_pkt_type = PKT_TYPE_AMSDU;
+		rx_pd->priority = qc & 7;
+		rx_pd->seq_num = s->seq;
+		gen_phy(g, rx_pd, b->snr);
+	} else {
+		uint16_t dur = 0, ctl = 0x0004 | ((gen_rand(g) & 7) << 12);
+		uint16_t ssc = s->seq << 4;
+		uint16_t fc = FC_BAR;
+
+		memcpy(p, &fc, 2);
+		memcpy(p + 2, &dur, 2);
+		memcpy(p + 4, b->bssid, 6);
+		memcpy(p + 10, s->addr, 6);
+		memcpy(p + 16, &ctl, 2);
+		memcpy(p + 18, &ssc, 2);
+		p += 20;
+
+		rx_pd->rx_pkt_type = PKT_TYPE_BAR;
+		gen_phy(g, rx_pd, s->snr);
+	}
+
+	len = p - start;
+
+	rx_pd->rx_pkt_offset = sizeof(struct rxpd);
+	rx_pd->rx_pkt_length = len;
+
+	rxt->xx = sizeof(struct sdio_rx_t) + sizeof(struct rxpd) + len;
+	rxt->pkt_type = 0;
+
+	if (delta_us) {
+		*delta_us = gen_delay(g);
+	}
+
+	g->idx++;
+
+	return rxt->xx;
+}
+
+int sdiogen_run(struct sdiogen_t *g, sdiogen_cb_t cb, void *ctx)
+{
+	static uint8_t buf[SDIOGEN_MAX_PKT] __attribute__ ((aligned(4)));
+	uint32_t delta;
+	int len;
+
+	while (g->cfg.frames == 0 || g->idx < g->cfg.frames) {
+		len = sdiogen_next(g, buf, sizeof(buf), &delta);
+		if (len < 0) {
+			return len;
+		}
+
+		if (cb(ctx, buf, len, delta)) {
+			break;
+		}
+	}
+
+	return g->idx;
+}
+
+int sdiogen_trace_open(FILE *f)
+{
+	struct sdiotrace_hdr_t hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SDIOTRACE_MAGIC, 8);
+
+	return (fwrite(&hdr, sizeof(hdr), 1, f) == 1) ? 0 : -1;
+}
+
+int sdiogen_trace_cb(void *ctx, const uint8_t *pkt, uint32_t len, uint32_t delta_us)
+{
+	struct sdiotrace_rec_t rec;
+	FILE *f = ctx;
+
+	rec.len = len;
+	rec.delta_us = delta_us;
+
+	if (fwrite(&rec, sizeof(rec), 1, f) != 1 || fwrite(pkt, len, 1, f) != 1) {
+		return -1;
+	}
+
+	return 0;
+}
+
+// fields of the first radiotap namespace, as rxpd has them
+static void rt_to_rxpd(struct rtap_cache_t *c, const uint8_t *rt, uint32_t rt_len, struct rxpd *rx_pd, int *fcs)
+{
+	const struct rtap_layout_t *l = rtap_parse(c, rt, rt_len);
+	const uint8_t *f;
+	int sig = 0, noise = -95, have_sig = 0;
+
+	if (l == NULL) {
+		return;
+	}
+
+	if ((f = rtap_get(l, rt, IEEE80211_RADIOTAP_FLAGS)) != NULL) {
+		*fcs = (f[0] & IEEE80211_RADIOTAP_F_FCS) != 0;
+	}
+
+	if ((f = rtap_get(l, rt, IEEE80211_RADIOTAP_RATE)) != NULL) {
+		uint32_t i;
+		for (i = 0; i < sizeof(gen_legacy_rates); i++) {
+			if (gen_legacy_rates[i] == f[0]) {
+				rx_pd->rx_rate = i;
+				break;
+			}
+		}
+	}
+
+	// dbm wins over db when both are there
+	if ((f = rtap_get(l, rt, IEEE80211_RADIOTAP_DBM_ANTSIGNAL)) != NULL ||
+	    (f = rtap_get(l, rt, IEEE80211_RADIOTAP_DB_ANTSIGNAL)) != NULL) {
+		sig = (int8_t)f[0];
+		have_sig = 1;
+	}
+	if ((f = rtap_get(l, rt, IEEE80211_RADIOTAP_DBM_ANTNOISE)) != NULL ||
+	    (f = rtap_get(l, rt, IEEE80211_RADIOTAP_DB_ANTNOISE)) != NULL) {
+		noise = (int8_t)f[0];
+	}
+
+	if ((f = rtap_get(l, rt, IEEE80211_RADIOTAP_MCS)) != NULL && (f[0] & IEEE80211_RADIOTAP_MCS_HAVE_MCS)) {
+		rx_pd->ht_info = 1;
+		rx_pd->rx_rate = f[2];
+		if ((f[0] & IEEE80211_RADIOTAP_MCS_HAVE_BW) && (f[1] & IEEE80211_RADIOTAP_MCS_BW_MASK) == IEEE80211_RADIOTAP_MCS_BW_40) {
+			rx_pd->ht_info |= 2;
+		}
+		if ((f[0] & IEEE80211_RADIOTAP_MCS_HAVE_GI) && (f[1] & IEEE80211_RADIOTAP_MCS_SGI)) {
+			rx_pd->ht_info |= 4;
+		}
+	}
+
+	rx_pd->nf = noise;
+	rx_pd->snr = have_sig ? sig - noise : 0;
+}
+
+static uint16_t frame_pkt_type(const uint8_t *f, uint32_t len)
+{
+	uint16_t fc;
+
+	if (len < 2) {
+		return 0;
+	}
+
+	memcpy(&fc, f, 2);
+
+	switch (fc & IEEE80211_FC_TYPE_MASK) {
+	case IEEE80211_FC_TYPE_MGT:
+		return PKT_TYPE_MGMT;
+	case IEEE80211_FC_TYPE_CTL:
+		return ((fc & IEEE80211_FC_SUBTYPE_MASK) == 0x80) ? PKT_TYPE_BAR : 0;
+	case IEEE80211_FC_TYPE_DATA: {
+		// qos data, qos control sits after the 3 or 4 address header
+		uint32_t qofs = ((fc & IEEE80211_FC_TOFROMDS_MASK) == IEEE80211_FC_DSTODS) ? 30 : 24;
+		if ((fc & 0x0080) && len >= qofs + 2 && (f[qofs] & QOS_AMSDU)) {
+			return PKT_TYPE_AMSDU;
+		}
+		return 0;
+	}
+	}
+
+	return 0;
+}
+
+int sdiogen_from_pcap(const char *file, sdiogen_cb_t cb, void *ctx)
+{
+	static uint8_t rec_buf[65536];
+	static uint8_t out[SDIOGEN_MAX_PKT + 64] __attribute__ ((aligned(4)));
+	static struct rtap_cache_t rtc;
+	pcap_hdr_t hdr;
+	pcaprec_hdr_t rec;
+	uint64_t last_us = 0;
+	int n = 0;
+	int ns;
+
+	FILE *f = fopen(file, "rb");
+	if (f == NULL) {
+		return -1;
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 || (hdr.magic_number != 0xa1b2c3d4 && hdr.magic_number != 0xa1b23c4d)) {
+		fclose(f);
+		return -2;
+	}
+
+	ns = (hdr.magic_number == 0xa1b23c4d);
+	rtap_cache_init(&rtc);
+
+	if (hdr.network != 127 && hdr.network != 105) {
+		fclose(f);
+		return -3;
+	}
+
+	while (fread(&rec, sizeof(rec), 1, f) == 1) {
+		const uint8_t *frame = rec_buf;
+		uint32_t frame_len = rec.incl_len;
+		int fcs = 0;
+
+		if (rec.incl_len > sizeof(rec_buf) || fread(rec_buf, rec.incl_len, 1, f) != 1) {
+			break;
+		}
+
+		struct sdio_rx_t *rxt = (struct sdio_rx_t *)out;
+		struct rxpd *rx_pd = (struct rxpd *)(out + sizeof(struct sdio_rx_t));
+		memset(rx_pd, 0, sizeof(struct rxpd));
+		rx_pd->nf = -95;
+
+		if (hdr.network == 127) {
+			const struct ieee80211_radiotap_header *rt = (const void *)rec_buf;
+			if (frame_len < sizeof(*rt) || rt->it_len > frame_len) {
+				continue;
+			}
+			rt_to_rxpd(&rtc, rec_buf, rt->it_len, rx_pd, &fcs);
+			frame += rt->it_len;
+			frame_len -= rt->it_len;
+		}
+
+		if (fcs && frame_len >= 4) {
+			frame_len -= 4;
+		}
+
+		if (frame_len > SDIOGEN_MAX_PKT - sizeof(struct sdio_rx_t) - sizeof(struct rxpd)) {
+			continue;
+		}
+
+		rx_pd->rx_pkt_type = frame_pkt_type(frame, frame_len);
+		rx_pd->rx_pkt_offset = sizeof(struct rxpd);
+		rx_pd->rx_pkt_length = frame_len;
+		memcpy((uint8_t *)rx_pd + sizeof(struct rxpd), frame, frame_len);
+
+		rxt->xx = sizeof(struct sdio_rx_t) + sizeof(struct rxpd) + frame_len;
+		rxt->pkt_type = 0;
+
+		uint64_t now_us = (uint64_t)rec.ts_sec * 1000000 + (ns ? rec.ts_usec / 1000 : rec.ts_usec);
+		uint32_t delta = (n && now_us > last_us) ? (uint32_t)(now_us - last_us) : 0;
+		last_us = now_us;
+
+		if (cb(ctx, out, rxt->xx, delta)) {
+			break;
+		}
+		n++;
+	}
+
+	fclose(f);
+
+	return n;
+}
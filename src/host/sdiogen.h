@@ -0,0 +1,94 @@
+#ifndef SDIOGEN_h_
+#define SDIOGEN_h_
+
+#include <stdint.h>
+#include <stdio.h>
+
+// synthetic sdio rx traffic, sdio_rx_t + rxpd + 802.11 frame per packet
+// output is fully determined by the config, seed included
+
+#define SDIOGEN_MAX_PKT   4096
+#define SDIOGEN_MAX_STA   4096
+#define SDIOGEN_MAX_BSS   256
+
+struct sdiogen_cfg_t {
+	uint32_t seed;
+	uint32_t frames;         // 0 is endless for sdiogen_run
+
+	// frame mix, relative weights
+	uint32_t w_beacon;
+	uint32_t w_probe;
+	uint32_t w_data;
+	uint32_t w_amsdu;
+	uint32_t w_bar;
+
+	// population
+	uint32_t bss;
+	uint32_t stations;
+	uint32_t churn_pm;       // per mille of frames that replace a station with a new one
+
+	// phy
+	uint32_t ht_pct;         // frames sent with HT rates
+	uint32_t ht40_pct;       // of HT frames
+	uint32_t sgi_pct;        // of HT frames
+	int32_t snr_mean;
+	int32_t snr_dev;
+	int32_t nf_mean;
+	int32_t nf_dev;
+
+	// data payload length range
+	uint32_t len_min;
+	uint32_t len_max;
+	uint32_t amsdu_max;      // subframes per A-MSDU, lowered to what fits in SDIOGEN_MAX_PKT
+
+	// timing, frames come in bursts
+	uint32_t rate;           // mean frames/s
+	uint32_t burst_len;      // frames per burst, 1 disables bursts
+	uint32_t burst_gap_us;   // gap between frames inside a burst
+};
+
+struct sdiogen_sta_t {
+	uint8_t addr[6];
+	uint16_t bss;
+	uint16_t seq;
+	int8_t snr;
+};
+
+struct sdiogen_bss_t {
+	uint8_t bssid[6];
+	uint8_t channel;
+	uint8_t ssid_len;
+	char ssid[32];
+	uint16_t seq;
+	uint16_t beacon_int;
+	int8_t snr;
+	uint64_t tsf;
+};
+
+struct sdiogen_t {
+	struct sdiogen_cfg_t cfg;
+	uint32_t rnd;
+	uint32_t idx;
+	uint32_t burst_left;
+	uint32_t w_total;
+	uint32_t sta_next;       // counter used to make unique new stations
+	struct sdiogen_sta_t sta[SDIOGEN_MAX_STA];
+	struct sdiogen_bss_t bss[SDIOGEN_MAX_BSS];
+};
+
+// return nonzero to stop
+typedef int (*sdiogen_cb_t)(void *ctx, const uint8_t *pkt, uint32_t len, uint32_t delta_us);
+
+void sdiogen_default(struct sdiogen_cfg_t *cfg);
+int sdiogen_init(struct sdiogen_t *g, const struct sdiogen_cfg_t *cfg);
+int sdiogen_next(struct sdiogen_t *g, uint8_t *buf, uint32_t buf_len, uint32_t *delta_us);
+int sdiogen_run(struct sdiogen_t *g, sdiogen_cb_t cb, void *ctx);
+
+// turn radiotap (127) or plain 802.11 (105) pcap back into rxpd framing
+int sdiogen_from_pcap(const char *file, sdiogen_cb_t cb, void *ctx);
+
+// sdiotrace file writer, usable as callback with the FILE as ctx
+int sdiogen_trace_open(FILE *f);
+int sdiogen_trace_cb(void *ctx, const uint8_t *pkt, uint32_t len, uint32_t delta_us);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef SDIOTRACE_h_
+#define SDIOTRACE_h_
+
+#include <stdint.h>
+
+// recorded sdio rx packets as the rx hook sees them
+// file header followed by records, each record is sdio_rx_t + payload
+#define SDIOTRACE_MAGIC "SDIOTRC1"
+
+struct sdiotrace_hdr_t {
+	char magic[8];
+	uint32_t count;          // 0 when unknown
+	uint32_t reserved;
+} __attribute__ ((packed));
+
+struct sdiotrace_rec_t {
+	uint32_t len;            // bytes following this header
+	uint32_t delta_us;       // time since previous packet, 0 when unknown
+} __attribute__ ((packed));
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef SHIM_NET_h_
+#define SHIM_NET_h_
+
+#include <stdint.h>
+
+#define SCE_NET_AF_INET        2
+#define SCE_NET_SOCK_STREAM    1
+#define SCE_NET_SOCK_DGRAM     2
+#define SCE_NET_INADDR_ANY     0x00000000
+#define SCE_NET_INADDR_LOOPBACK 0x0100007f
+#define SCE_NET_MSG_DONTWAIT   0x0080
+#define SCE_NET_SOL_SOCKET     0xffff
+#define SCE_NET_SO_REUSEADDR   0x0004
+#define SCE_NET_SO_SNDBUF      0x1001
+#define SCE_NET_SO_NBIO        0x1100
+#define SCE_NET_IPPROTO_IP     0
+#define SCE_NET_IP_MULTICAST_TTL 10
+
+#define SCE_NET_ERROR_EAGAIN   0x80410123
+
+typedef struct SceNetInAddr {
+	uint32_t s_addr;
+} SceNetInAddr;
+
+typedef struct SceNetSockaddr {
+	uint8_t sa_len;
+	uint8_t sa_family;
+	char sa_data[14];
+} SceNetSockaddr;
+
+typedef struct SceNetSockaddrIn {
+	uint8_t sin_len;
+	uint8_t sin_family;
+	uint16_t sin_port;
+	SceNetInAddr sin_addr;
+	uint16_t sin_vport;
+	char sin_zero[6];
+} SceNetSockaddrIn;
+
+int ksceNetSocket(const char *name, int domain, int type, int protocol);
+int ksceNetClose(int s);
+int ksceNetSocketAbort(int s, int flags);
+int ksceNetBind(int s, const SceNetSockaddr *addr, unsigned int addrlen);
+int ksceNetListen(int s, int backlog);
+int ksceNetAccept(int s, SceNetSockaddr *addr, unsigned int *addrlen);
+int ksceNetSendto(int s, const void *msg, unsigned int len, int flags, const SceNetSockaddr *to, unsigned int tolen);
+int ksceNetSend(int s, const void *msg, unsigned int len, int flags);
+int ksceNetRecvfrom(int s, void *buf, unsigned int len, int flags, SceNetSockaddr *from, unsigned int *fromlen);
+int ksceNetSetsockopt(int s, int level, int optname, const void *optval, unsigned int optlen);
+uint16_t ksceNetHtons(uint16_t host16);
+uint32_t ksceNetHtonl(uint32_t host32);
+uint16_t ksceNetNtohs(uint16_t net16);
+uint32_t ksceNetNtohl(uint32_t net32);
+
+#endif
@@ -0,0 +1,653 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "vitasdkkern.h"
+#include "taihen.h"
+#include "psp2kern/net/net.h"
+
+#include "wlan_kernel.h"
+#include "sigs.h"
+
+#include "shim.h"
+
+#define SHIM_MAX_OBJ 32
+#define SHIM_MAX_OFS 32
+
+static char shim_root[256] = ".";
+
+static struct {
+	uint32_t offset;
+	void *func;
+	void *hook;
+} shim_ofs[SHIM_MAX_OFS];
+static int shim_ofs_cnt;
+
+static const void *shim_text;
+static uint32_t shim_text_len;
+static uint32_t shim_nid;
+
+static struct {
+	int used;
+	pthread_mutex_t m;
+} shim_mutex[SHIM_MAX_OBJ];
+
+static struct {
+	int used;
+	pthread_t th;
+	SceKernelThreadEntry entry;
+	SceSize arglen;
+	void *argp;
+	int ret;
+} shim_thread[SHIM_MAX_OBJ];
+
+static struct {
+	int used;
+	void *base;
+} shim_mem[SHIM_MAX_OBJ];
+
+static pthread_mutex_t shim_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void shim_init(const char *root)
+{
+	char path[300];
+
+	snprintf(shim_root, sizeof(shim_root), "%s", root);
+
+	mkdir(shim_root, 0777);
+	snprintf(path, sizeof(path), "%s/ux0", shim_root);
+	mkdir(path, 0777);
+	snprintf(path, sizeof(path), "%s/ux0/data", shim_root);
+	mkdir(path, 0777);
+}
+
+void shim_root_path(char *out, int out_len, const char *path)
+{
+	const char *colon = strchr(path, ':');
+
+	if (colon) {
+		snprintf(out, out_len, "%s/%.*s%s%s", shim_root, (int)(colon - path), path, (colon[1] == '/') ? "" : "/", colon + 1);
+	} else {
+		snprintf(out, out_len, "%s", path);
+	}
+}
+
+void shim_set_offset(uint32_t offset, void *func)
+{
+	int i;
+
+	for (i = 0; i < shim_ofs_cnt; i++) {
+		if (shim_ofs[i].offset == (offset & ~1)) {
+			break;
+		}
+	}
+	if (i < SHIM_MAX_OFS) {
+		shim_ofs[i].offset = offset & ~1;
+		shim_ofs[i].func = func;
+		shim_ofs_cnt += (i == shim_ofs_cnt);
+	}
+}
+
+void *shim_hook(uint32_t offset)
+{
+	int i;
+
+	for (i = 0; i < shim_ofs_cnt; i++) {
+		if (shim_ofs[i].offset == (offset & ~1)) {
+			return shim_ofs[i].hook ? shim_ofs[i].hook : shim_ofs[i].func;
+		}
+	}
+
+	return NULL;
+}
+
+static int shim_wlan_rx_handler(struct wlan_dev_t *dev, uint8_t *in_pkt, int in_pkt_len, uint32_t *somenumber)
+{
+	return 0;
+}
+
+static int shim_wlan_ioctl(struct netdev_t *netdev, unsigned int req, uint8_t *buf, int buf_len)
+{
+	return -1;
+}
+
+static int shim_wlan_lock(struct wlan_lock_t *ptr)
+{
+	return 0;
+}
+
+static void shim_wlan_unlock(struct wlan_lock_t *ptr)
+{
+}
+
+void shim_wlan_init(void)
+{
+	shim_set_offset(sigs[SIG_RX_HANDLER].fixed, shim_wlan_rx_handler);
+	shim_set_offset(sigs[SIG_IOCTL].fixed, shim_wlan_ioctl);
+	shim_set_offset(sigs[SIG_LOCK].fixed, shim_wlan_lock);
+	shim_set_offset(sigs[SIG_UNLOCK].fixed, shim_wlan_unlock);
+}
+
+void shim_set_module(const void *text, uint32_t len, uint32_t nid)
+{
+	shim_text = text;
+	shim_text_len = len;
+	shim_nid = nid;
+}
+
+// taihen
+
+int module_get_offset(SceUID pid, SceUID modid, int segidx, size_t offset, uintptr_t *addr)
+{
+	int i;
+
+	for (i = 0; i < shim_ofs_cnt; i++) {
+		if (shim_ofs[i].offset == (offset & ~1)) {
+			*addr = (uintptr_t)shim_ofs[i].func;
+			return 0;
+		}
+	}
+
+	*addr = 0;
+	return -1;
+}
+
+int taiGetModuleInfoForKernel(SceUID pid, const char *module, tai_module_info_t *info)
+{
+	info->modid = 1;
+	info->module_nid = shim_nid;
+	snprintf(info->name, sizeof(info->name), "%s", module);
+	return 0;
+}
+
+SceUID taiHookFunctionOffsetForKernel(SceUID pid, tai_hook_ref_t *p_hook, SceUID modid, int segidx, uint32_t offset, int thumb, const void *hook_func)
+{
+	int i;
+
+	for (i = 0; i < shim_ofs_cnt; i++) {
+		if (shim_ofs[i].offset == (offset & ~1)) {
+			shim_ofs[i].hook = (void *)hook_func;
+			*p_hook = (tai_hook_ref_t)shim_ofs[i].func;
+			return i + 1;
+		}
+	}
+
+	return -1;
+}
+
+int taiHookReleaseForKernel(SceUID tai_uid, tai_hook_ref_t hook)
+{
+	if (tai_uid > 0 && tai_uid <= shim_ofs_cnt) {
+		shim_ofs[tai_uid - 1].hook = NULL;
+	}
+	return 0;
+}
+
+int taiInjectReleaseForKernel(SceUID tai_uid)
+{
+	return 0;
+}
+
+// modulemgr
+
+int ksceKernelGetModuleInfo(SceUID pid, SceUID modid, SceKernelModuleInfo *info)
+{
+	if (modid != 1 || shim_text == NULL) {
+		return -1;
+	}
+
+	memset(info->segments, 0, sizeof(info->segments));
+	snprintf(info->module_name, sizeof(info->module_name), "SceWlanBt");
+	info->segments[0].size = sizeof(info->segments[0]);
+	info->segments[0].perms = 5;
+	info->segments[0].vaddr = (void *)shim_text;
+	info->segments[0].memsz = shim_text_len;
+	info->segments[0].filesz = shim_text_len;
+
+	return 0;
+}
+
+// threadmgr
+
+SceUID ksceKernelCreateMutex(const char *name, SceUInt32 attr, int init_count, void *opt)
+{
+	int i;
+
+	pthread_mutex_lock(&shim_lock);
+	for (i = 0; i < SHIM_MAX_OBJ; i++) {
+		if (!shim_mutex[i].used) {
+			shim_mutex[i].used = 1;
+			pthread_mutex_init(&shim_mutex[i].m, NULL);
+			pthread_mutex_unlock(&shim_lock);
+			return i + 1;
+		}
+	}
+	pthread_mutex_unlock(&shim_lock);
+
+	return -1;
+}
+
+int ksceKernelDeleteMutex(SceUID mutexid)
+{
+	if (mutexid < 1 || mutexid > SHIM_MAX_OBJ) {
+		return -1;
+	}
+
+	pthread_mutex_destroy(&shim_mutex[mutexid - 1].m);
+	shim_mutex[mutexid - 1].used = 0;
+	return 0;
+}
+
+int ksceKernelLockMutex(SceUID mutexid, int lock_count, unsigned int *timeout)
+{
+	if (mutexid < 1 || mutexid > SHIM_MAX_OBJ) {
+		return -1;
+	}
+
+	return pthread_mutex_lock(&shim_mutex[mutexid - 1].m) ? -1 : 0;
+}
+
+int ksceKernelUnlockMutex(SceUID mutexid, int unlock_count)
+{
+	if (mutexid < 1 || mutexid > SHIM_MAX_OBJ) {
+		return -1;
+	}
+
+	return pthread_mutex_unlock(&shim_mutex[mutexid - 1].m) ? -1 : 0;
+}
+
+static void *shim_thread_main(void *arg)
+{
+	int i = (intptr_t)arg;
+
+	shim_thread[i].ret = shim_thread[i].entry(shim_thread[i].arglen, shim_thread[i].argp);
+
+	return NULL;
+}
+
+SceUID ksceKernelCreateThread(const char *name, SceKernelThreadEntry entry, int init_priority, int stack_size, SceUInt32 attr, int cpu_affinity_mask, const void *opt)
+{
+	int i;
+
+	pthread_mutex_lock(&shim_lock);
+	for (i = 0; i < SHIM_MAX_OBJ; i++) {
+		if (!shim_thread[i].used) {
+			shim_thread[i].used = 1;
+			shim_thread[i].entry = entry;
+			pthread_mutex_unlock(&shim_lock);
+			return i + 1;
+		}
+	}
+	pthread_mutex_unlock(&shim_lock);
+
+	return -1;
+}
+
+int ksceKernelStartThread(SceUID thid, SceSize arglen, void *argp)
+{
+	int i = thid - 1;
+
+	if (i < 0 || i >= SHIM_MAX_OBJ || !shim_thread[i].used) {
+		return -1;
+	}
+
+	shim_thread[i].arglen = arglen;
+	shim_thread[i].argp = argp;
+
+	return pthread_create(&shim_thread[i].th, NULL, shim_thread_main, (void *)(intptr_t)i) ? -1 : 0;
+}
+
+int ksceKernelWaitThreadEnd(SceUID thid, int *stat, SceUInt32 *timeout)
+{
+	int i = thid - 1;
+
+	if (i < 0 || i >= SHIM_MAX_OBJ || !shim_thread[i].used) {
+		return -1;
+	}
+
+	pthread_join(shim_thread[i].th, NULL);
+	if (stat) {
+		*stat = shim_thread[i].ret;
+	}
+
+	return 0;
+}
+
+int ksceKernelDeleteThread(SceUID thid)
+{
+	int i = thid - 1;
+
+	if (i < 0 || i >= SHIM_MAX_OBJ) {
+		return -1;
+	}
+
+	shim_thread[i].used = 0;
+	return 0;
+}
+
+int ksceKernelDelayThread(SceUInt32 delay)
+{
+	struct timespec ts;
+
+	ts.tv_sec = delay / 1000000;
+	ts.tv_nsec = (delay % 1000000) * 1000;
+	nanosleep(&ts, NULL);
+
+	return 0;
+}
+
+SceUInt64 ksceKernelGetSystemTimeWide(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (SceUInt64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+SceUInt32 ksceKernelGetSystemTimeLow(void)
+{
+	return (SceUInt32)ksceKernelGetSystemTimeWide();
+}
+
+int ksceKernelLibcGettimeofday(struct timeval *ptimeval, void *ptimezone)
+{
+	return gettimeofday(ptimeval, NULL);
+}
+
+// sysmem
+
+SceUID ksceKernelAllocMemBlock(const char *name, SceUInt32 type, SceSize size, void *opt)
+{
+	int i;
+
+	pthread_mutex_lock(&shim_lock);
+	for (i = 0; i < SHIM_MAX_OBJ; i++) {
+		if (!shim_mem[i].used) {
+			shim_mem[i].base = calloc(1, size);
+			if (shim_mem[i].base == NULL) {
+				break;
+			}
+			shim_mem[i].used = 1;
+			pthread_mutex_unlock(&shim_lock);
+			return i + 1;
+		}
+	}
+	pthread_mutex_unlock(&shim_lock);
+
+	return -1;
+}
+
+int ksceKernelGetMemBlockBase(SceUID uid, void **base)
+{
+	if (uid < 1 || uid > SHIM_MAX_OBJ || !shim_mem[uid - 1].used) {
+		return -1;
+	}
+
+	*base = shim_mem[uid - 1].base;
+	return 0;
+}
+
+int ksceKernelFreeMemBlock(SceUID uid)
+{
+	if (uid < 1 || uid > SHIM_MAX_OBJ || !shim_mem[uid - 1].used) {
+		return -1;
+	}
+
+	free(shim_mem[uid - 1].base);
+	shim_mem[uid - 1].used = 0;
+	return 0;
+}
+
+int ksceKernelMemcpyKernelToUser(uintptr_t dst, const void *src, size_t len)
+{
+	memcpy((void *)dst, src, len);
+	return 0;
+}
+
+int ksceKernelMemcpyUserToKernel(void *dst, uintptr_t src, size_t len)
+{
+	memcpy(dst, (const void *)src, len);
+	return 0;
+}
+
+int ksceKernelStrncpyUserToKernel(void *dst, uintptr_t src, size_t len)
+{
+	strncpy(dst, (const char *)src, len);
+	return strnlen(dst, len);
+}
+
+// iofilemgr
+
+SceUID ksceIoOpen(const char *file, int flags, SceMode mode)
+{
+	char path[512];
+	int f = 0;
+
+	shim_root_path(path, sizeof(path), file);
+
+	if ((flags & SCE_O_RDWR) == SCE_O_RDWR) {
+		f = O_RDWR;
+	} else if (flags & SCE_O_WRONLY) {
+		f = O_WRONLY;
+	} else {
+		f = O_RDONLY;
+	}
+
+	if (flags & SCE_O_CREAT) f |= O_CREAT;
+	if (flags & SCE_O_TRUNC) f |= O_TRUNC;
+	if (flags & SCE_O_APPEND) f |= O_APPEND;
+
+	int fd = open(path, f, mode);
+
+	return (fd < 0) ? (int)(0x80010000 | errno) : fd;
+}
+
+int ksceIoClose(SceUID fd)
+{
+	return close(fd);
+}
+
+int ksceIoRead(SceUID fd, void *data, SceSize size)
+{
+	return read(fd, data, size);
+}
+
+int ksceIoWrite(SceUID fd, const void *data, SceSize size)
+{
+	return write(fd, data, size);
+}
+
+int ksceIoWriteAsync(SceUID fd, const void *data, SceSize size)
+{
+	return write(fd, data, size);
+}
+
+SceOff ksceIoLseek(SceUID fd, SceOff offset, int whence)
+{
+	return lseek(fd, offset, whence);
+}
+
+int ksceIoSyncByFd(SceUID fd, int flag)
+{
+	return fsync(fd);
+}
+
+int ksceIoRemove(const char *file)
+{
+	char path[512];
+
+	shim_root_path(path, sizeof(path), file);
+
+	return unlink(path);
+}
+
+// net
+
+static int shim_net_err(void)
+{
+	if (errno == EAGAIN || errno == EWOULDBLOCK) {
+		return (int)SCE_NET_ERROR_EAGAIN;
+	}
+	return (int)(0x80410100 | errno);
+}
+
+static void shim_to_sin(struct sockaddr_in *out, const SceNetSockaddr *in)
+{
+	const SceNetSockaddrIn *sin = (const SceNetSockaddrIn *)in;
+
+	memset(out, 0, sizeof(*out));
+	out->sin_family = AF_INET;
+	out->sin_port = sin->sin_port;
+	out->sin_addr.s_addr = sin->sin_addr.s_addr;
+}
+
+static void shim_from_sin(SceNetSockaddr *out, const struct sockaddr_in *in)
+{
+	SceNetSockaddrIn *sin = (SceNetSockaddrIn *)out;
+
+	memset(sin, 0, sizeof(*sin));
+	sin->sin_len = sizeof(*sin);
+	sin->sin_family = SCE_NET_AF_INET;
+	sin->sin_port = in->sin_port;
+	sin->sin_addr.s_addr = in->sin_addr.s_addr;
+}
+
+int ksceNetSocket(const char *name, int domain, int type, int protocol)
+{
+	int s = socket(AF_INET, (type == SCE_NET_SOCK_STREAM) ? SOCK_STREAM : SOCK_DGRAM, protocol);
+
+	return (s < 0) ? shim_net_err() : s;
+}
+
+int ksceNetClose(int s)
+{
+	return close(s);
+}
+
+// wakes up threads blocked in accept or recv on the socket
+int ksceNetSocketAbort(int s, int flags)
+{
+	return shutdown(s, SHUT_RDWR);
+}
+
+int ksceNetBind(int s, const SceNetSockaddr *addr, unsigned int addrlen)
+{
+	struct sockaddr_in sin;
+
+	shim_to_sin(&sin, addr);
+
+	return bind(s, (struct sockaddr *)&sin, sizeof(sin)) ? shim_net_err() : 0;
+}
+
+int ksceNetListen(int s, int backlog)
+{
+	return listen(s, backlog) ? shim_net_err() : 0;
+}
+
+int ksceNetAccept(int s, SceNetSockaddr *addr, unsigned int *addrlen)
+{
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+
+	int ret = accept(s, (struct sockaddr *)&sin, &len);
+	if (ret < 0) {
+		return shim_net_err();
+	}
+
+	if (addr) {
+		shim_from_sin(addr, &sin);
+	}
+	if (addrlen) {
+		*addrlen = sizeof(SceNetSockaddrIn);
+	}
+
+	return ret;
+}
+
+int ksceNetSendto(int s, const void *msg, unsigned int len, int flags, const SceNetSockaddr *to, unsigned int tolen)
+{
+	struct sockaddr_in sin;
+
+	shim_to_sin(&sin, to);
+
+	int ret = sendto(s, msg, len, (flags & SCE_NET_MSG_DONTWAIT) ? MSG_DONTWAIT : 0, (struct sockaddr *)&sin, sizeof(sin));
+
+	return (ret < 0) ? shim_net_err() : ret;
+}
+
+int ksceNetSend(int s, const void *msg, unsigned int len, int flags)
+{
+	int ret = send(s, msg, len, MSG_NOSIGNAL | ((flags & SCE_NET_MSG_DONTWAIT) ? MSG_DONTWAIT : 0));
+
+	return (ret < 0) ? shim_net_err() : ret;
+}
+
+int ksceNetRecvfrom(int s, void *buf, unsigned int len, int flags, SceNetSockaddr *from, unsigned int *fromlen)
+{
+	struct sockaddr_in sin;
+	socklen_t sl = sizeof(sin);
+
+	int ret = recvfrom(s, buf, len, (flags & SCE_NET_MSG_DONTWAIT) ? MSG_DONTWAIT : 0, (struct sockaddr *)&sin, &sl);
+	if (ret < 0) {
+		return shim_net_err();
+	}
+
+	if (from) {
+		shim_from_sin(from, &sin);
+	}
+	if (fromlen) {
+		*fromlen = sizeof(SceNetSockaddrIn);
+	}
+
+	return ret;
+}
+
+int ksceNetSetsockopt(int s, int level, int optname, const void *optval, unsigned int optlen)
+{
+	int ret;
+
+	if (level == SCE_NET_SOL_SOCKET && optname == SCE_NET_SO_NBIO) {
+		int fl = fcntl(s, F_GETFL);
+		ret = fcntl(s, F_SETFL, (*(const int *)optval) ? (fl | O_NONBLOCK) : (fl & ~O_NONBLOCK));
+	} else if (level == SCE_NET_SOL_SOCKET && optname == SCE_NET_SO_REUSEADDR) {
+		ret = setsockopt(s, SOL_SOCKET, SO_REUSEADDR, optval, optlen);
+	} else if (level == SCE_NET_SOL_SOCKET && optname == SCE_NET_SO_SNDBUF) {
+		ret = setsockopt(s, SOL_SOCKET, SO_SNDBUF, optval, optlen);
+	} else if (level == SCE_NET_IPPROTO_IP && optname == SCE_NET_IP_MULTICAST_TTL) {
+		ret = setsockopt(s, IPPROTO_IP, IP_MULTICAST_TTL, optval, optlen);
+	} else {
+		return 0;
+	}
+
+	return ret ? shim_net_err() : 0;
+}
+
+uint16_t ksceNetHtons(uint16_t host16)
+{
+	return htons(host16);
+}
+
+uint32_t ksceNetHtonl(uint32_t host32)
+{
+	return htonl(host32);
+}
+
+uint16_t ksceNetNtohs(uint16_t net16)
+{
+	return ntohs(net16);
+}
+
+uint32_t ksceNetNtohl(uint32_t net32)
+{
+	return ntohl(net32);
+}
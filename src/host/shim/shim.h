@@ -0,0 +1,32 @@
+#ifndef SHIM_h_
+#define SHIM_h_
+
+#include <stdint.h>
+
+struct wlan_dev_t;
+struct netdev_t;
+
+// host side controls of the kernel shim
+
+// directory that stands in for "ux0:"
+void shim_init(const char *root);
+void shim_root_path(char *out, int out_len, const char *path);
+
+// function returned by module_get_offset / hooked by taiHookFunctionOffsetForKernel,
+// setting an offset again replaces its function
+void shim_set_offset(uint32_t offset, void *func);
+// hook installed at offset, or the plain function if nothing hooked it
+void *shim_hook(uint32_t offset);
+
+// text of the module taiGetModuleInfoForKernel reports, and its nid
+void shim_set_module(const void *text, uint32_t len, uint32_t nid);
+
+// SceWlanBt at the fixed offsets of sigs[]: the rx handler and the lock do
+// nothing, ioctl fails; a program sets its own over the ones it watches
+void shim_wlan_init(void);
+
+// the hooked SceWlanBt functions as a program calls them through shim_hook
+typedef int (*rx_hook_t)(struct wlan_dev_t *dev, uint8_t *in_pkt, int in_pkt_len, uint32_t *somenumber);
+typedef int (*ioctl_hook_t)(struct netdev_t *netdev, unsigned int req, uint8_t *buf, int buf_len);
+
+#endif
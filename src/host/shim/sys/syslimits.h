@@ -0,0 +1,6 @@
+#ifndef SHIM_SYSLIMITS_h_
+#define SHIM_SYSLIMITS_h_
+
+#include <limits.h>
+
+#endif
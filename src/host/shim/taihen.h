@@ -0,0 +1,30 @@
+#ifndef SHIM_TAIHEN_h_
+#define SHIM_TAIHEN_h_
+
+#include <stdint.h>
+#include "vitasdkkern.h"
+
+#define KERNEL_PID 0x10005
+
+typedef uintptr_t tai_hook_ref_t;
+
+typedef struct {
+	size_t size;
+	SceUID modid;
+	uint32_t module_nid;
+	char name[27];
+	uintptr_t exports_start;
+	uintptr_t exports_end;
+	uintptr_t imports_start;
+	uintptr_t imports_end;
+} tai_module_info_t;
+
+// the shim stores the original function as the hook reference
+#define TAI_CONTINUE(type, hook, ...) (((type (*)())(hook))(__VA_ARGS__))
+
+int taiGetModuleInfoForKernel(SceUID pid, const char *module, tai_module_info_t *info);
+SceUID taiHookFunctionOffsetForKernel(SceUID pid, tai_hook_ref_t *p_hook, SceUID modid, int segidx, uint32_t offset, int thumb, const void *hook_func);
+int taiHookReleaseForKernel(SceUID tai_uid, tai_hook_ref_t hook);
+int taiInjectReleaseForKernel(SceUID tai_uid);
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef SHIM_VITASDKKERN_h_
+#define SHIM_VITASDKKERN_h_
+
+// thin host stand-in for the parts of vitasdkkern.h used by the kernel plugin
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/time.h>
+
+typedef int SceUID;
+typedef unsigned int SceSize;
+typedef int SceInt32;
+typedef unsigned int SceUInt32;
+typedef uint64_t SceUInt64;
+typedef int SceMode;
+typedef long SceOff;
+typedef int (*SceKernelThreadEntry)(SceSize args, void *argp);
+
+#define SCE_KERNEL_START_SUCCESS 0
+#define SCE_KERNEL_STOP_SUCCESS  0
+
+#define SCE_O_RDONLY  0x0001
+#define SCE_O_WRONLY  0x0002
+#define SCE_O_RDWR    (SCE_O_RDONLY|SCE_O_WRONLY)
+#define SCE_O_APPEND  0x0100
+#define SCE_O_CREAT   0x0200
+#define SCE_O_TRUNC   0x0400
+
+#define SCE_SEEK_SET 0
+#define SCE_SEEK_CUR 1
+#define SCE_SEEK_END 2
+
+#define SCE_KERNEL_MEMBLOCK_TYPE_KERNEL_RW 0x1020D006
+
+#define ENTER_SYSCALL(state) do { (state) = 0; } while (0)
+#define EXIT_SYSCALL(state) do { (void)(state); } while (0)
+
+// threadmgr
+SceUID ksceKernelCreateMutex(const char *name, SceUInt32 attr, int init_count, void *opt);
+int ksceKernelDeleteMutex(SceUID mutexid);
+int ksceKernelLockMutex(SceUID mutexid, int lock_count, unsigned int *timeout);
+int ksceKernelUnlockMutex(SceUID mutexid, int unlock_count);
+
+SceUID ksceKernelCreateThread(const char *name, SceKernelThreadEntry entry, int init_priority, int stack_size, SceUInt32 attr, int cpu_affinity_mask, const void *opt);
+int ksceKernelStartThread(SceUID thid, SceSize arglen, void *argp);
+int ksceKernelWaitThreadEnd(SceUID thid, int *stat, SceUInt32 *timeout);
+int ksceKernelDeleteThread(SceUID thid);
+int ksceKernelDelayThread(SceUInt32 delay);
+
+SceUInt32 ksceKernelGetSystemTimeLow(void);
+SceUInt64 ksceKernelGetSystemTimeWide(void);
+
+// modulemgr, segment 0 is the text shim_set_module gave
+typedef struct {
+	SceSize size;
+	SceUInt32 perms;
+	void *vaddr;
+	SceSize memsz;
+	SceSize filesz;
+	SceUInt32 res;
+} SceKernelSegmentInfo;
+
+typedef struct {
+	SceSize size;
+	SceUID modid;
+	char module_name[28];
+	char path[256];
+	SceKernelSegmentInfo segments[4];
+} SceKernelModuleInfo;
+
+int ksceKernelGetModuleInfo(SceUID pid, SceUID modid, SceKernelModuleInfo *info);
+
+// sysmem
+SceUID ksceKernelAllocMemBlock(const char *name, SceUInt32 type, SceSize size, void *opt);
+int ksceKernelGetMemBlockBase(SceUID uid, void **base);
+int ksceKernelFreeMemBlock(SceUID uid);
+int ksceKernelMemcpyKernelToUser(uintptr_t dst, const void *src, size_t len);
+int ksceKernelMemcpyUserToKernel(void *dst, uintptr_t src, size_t len);
+int ksceKernelStrncpyUserToKernel(void *dst, uintptr_t src, size_t len);
+
+// iofilemgr, "ux0:" paths are mapped below the shim root
+SceUID ksceIoOpen(const char *file, int flags, SceMode mode);
+int ksceIoClose(SceUID fd);
+int ksceIoRead(SceUID fd, void *data, SceSize size);
+int ksceIoWrite(SceUID fd, const void *data, SceSize size);
+int ksceIoWriteAsync(SceUID fd, const void *data, SceSize size);
+SceOff ksceIoLseek(SceUID fd, SceOff offset, int whence);
+int ksceIoSyncByFd(SceUID fd, int flag);
+int ksceIoRemove(const char *file);
+
+#endif
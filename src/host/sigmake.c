@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sigscan.h"
+#include "sigs.h"
+
+// signatures for the sigs table of the plugin out of a text of SceWlanBt,
+// the one it saves to ux0:data where a scan fails
+// each starts at the function and grows an instruction at a time until it
+// is long enough and found once in the text, calls and address loads are
+// wildcards, they change whenever anything moves
+
+static uint16_t le16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+// returns the pattern length, 0 if it is not unique by max bytes
+static uint32_t make(const uint8_t *text, uint32_t size, uint32_t off, uint32_t min, uint32_t max, char *out)
+{
+	static struct sigscan_t s;
+	uint8_t byte[SIGSCAN_BYTES_MAX], mask[SIGSCAN_BYTES_MAX];
+	uint32_t len = 0;
+
+	while (len + 2 <= max && off + len + 2 <= size) {
+		uint16_t hw = le16(text + off + len);
+		char *o = out;
+
+		if (hw >= 0xe800) {
+			uint16_t hw2;
+
+			if (len + 4 > max || off + len + 4 > size) {
+				break;
+			}
+			hw2 = le16(text + off + len + 2);
+			// bl, blx, movw, movt
+			int wild = ((hw & 0xf800) == 0xf000 && (hw2 & 0xc000) == 0xc000) ||
+				(hw & 0xfbf0) == 0xf240 || (hw & 0xfbf0) == 0xf2c0;
+			for (int k = 0; k < 4; k++) {
+				byte[len + k] = text[off + len + k];
+				mask[len + k] = wild ? 0 : 0xff;
+			}
+			len += 4;
+		} else {
+			byte[len] = text[off + len];
+			byte[len + 1] = text[off + len + 1];
+			// ldr from the literal pool, the distance moves with it
+			mask[len] = ((hw & 0xf800) == 0x4800) ? 0 : 0xff;
+			mask[len + 1] = 0xff;
+			len += 2;
+		}
+
+		for (uint32_t i = 0; i < len; i++) {
+			o += sprintf(o, mask[i] ? "%s%02x" : "%s??", i ? " " : "", byte[i]);
+		}
+
+		sigscan_init(&s, 2);
+		if (len < min || sigscan_add(&s, out) < 0) {
+			continue;
+		}
+		sigscan_run(&s, text, size);
+		if (sigscan_found(&s, 0) == (int32_t)off) {
+			return len;
+		}
+	}
+
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-n bytes] [-l bytes] text.bin [name=offset ...]\n", name);
+	fprintf(stderr, "  -n  shortest signature (16)\n");
+	fprintf(stderr, "  -l  longest signature (%d)\n", SIGSCAN_BYTES_MAX);
+	fprintf(stderr, "  offsets are hex, the fixed ones of the plugin if none are given\n");
+}
+
+int main(int argc, char *argv[])
+{
+	char out[4 * SIGSCAN_BYTES_MAX];
+	uint32_t min = 16, max = SIGSCAN_BYTES_MAX, size;
+	uint8_t *text;
+	int opt, fail = 0;
+	FILE *f;
+
+	while ((opt = getopt(argc, argv, "n:l:h")) != -1) {
+		switch (opt) {
+		case 'n': min = strtoul(optarg, NULL, 0); break;
+		case 'l': max = strtoul(optarg, NULL, 0); break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+	if (optind >= argc || max < SIGSCAN_ANCHOR_MIN || max > SIGSCAN_BYTES_MAX || min > max) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	f = fopen(argv[optind], "rb");
+	if (f == NULL) {
+		fprintf(stderr, "%s: cannot read\n", argv[optind]);
+		return 1;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	text = malloc(size ? size : 1);
+	if (text == NULL || fread(text, 1, size, f) != size) {
+		fprintf(stderr, "%s: cannot read\n", argv[optind]);
+		return 1;
+	}
+	fclose(f);
+
+	int n = (argc - optind > 1) ? argc - optind - 1 : SIGS;
+	for (int i = 0; i < n; i++) {
+		char name[32];
+		uint32_t off;
+
+		if (argc - optind > 1) {
+			const char *arg = argv[optind + 1 + i], *eq = strchr(arg, '=');
+			char *end;
+
+			if (eq == NULL || eq - arg >= (int)sizeof(name)) {
+				fprintf(stderr, "bad function %s\n", arg);
+				return 1;
+			}
+			snprintf(name, sizeof(name), "%.*s", (int)(eq - arg), arg);
+			off = strtoul(eq + 1, &end, 16);
+			if (*end != 0) {
+				fprintf(stderr, "bad function %s\n", arg);
+				return 1;
+			}
+		} else {
+			snprintf(name, sizeof(name), "%s", sigs[i].name);
+			off = sigs[i].fixed;
+		}
+
+		if (off >= size || (off & 1)) {
+			fprintf(stderr, "%s: %x is not in the text\n", name, off);
+			fail = 1;
+		} else if (make(text, size, off, min, max, out) == 0) {
+			fprintf(stderr, "%s: %x not unique in %u bytes\n", name, off, max);
+			fail = 1;
+		} else {
+			printf("\t{ \"%s\", 0x%04x, \"%s\", 0 },\n", name, off, out);
+		}
+	}
+
+	free(text);
+
+	return fail;
+}
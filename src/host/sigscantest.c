@@ -0,0 +1,540 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include <vitasdkkern.h>
+
+#include "kwifimon_export.h"
+#include "wlan_kernel.h"
+#include "sigscan.h"
+#include "sigs.h"
+
+#include "shim.h"
+#include "test.h"
+
+// the signature matcher against a plain search of every pattern at every
+// offset, over random text and patterns cut from it, and the resolution
+// of the plugin over a made up SceWlanBt text: found where the functions
+// moved, cached for a build seen before, fixed offsets where a signature
+// is missing or ambiguous, the text saved for sigmake where one falls back
+// there is no captured text of the module, the made up one has the fixed
+// offsets of the plugin and a build that shifts most of them
+
+int module_start(SceSize argc, const void *args);
+int module_stop(SceSize argc, const void *args);
+int kwifimon_process_respose(struct wlan_dev_t *dev, uint8_t *in_pkt, int in_pkt_len, uint32_t *somenumber);
+int kwifimon_ioctl(struct netdev_t *netdev, unsigned int req, uint8_t *buf, int buf_len);
+
+extern struct wlan_cmd_t *(*wlan_cmd_alloc)(struct wlan_dev_t *dev, int cmd_len);
+extern int (*wlan_lock)(struct wlan_lock_t *ptr);
+extern int (*wlan_mem_write)(struct wlan_dev_t *dev, uint32_t addr, uint32_t value);
+
+#define TEXT_SIZE  0x10000
+#define FUNC_LEN   48
+#define SIG_LEN    32
+#define SHIFT_AT   0x1000      // the second build has SHIFT more bytes here
+#define SHIFT      0x200
+#define NID_A      0x1234abcd
+#define NID_B      0x5678ef01
+
+// hits of one parsed pattern the slow way
+static uint32_t naive(const struct sigscan_pat_t *p, const uint8_t *text, uint32_t len, uint32_t align, uint32_t *at)
+{
+	uint32_t hits = 0;
+
+	for (uint32_t i = 0; i + p->len <= len; i += align) {
+		uint32_t k;
+		for (k = 0; k < p->len; k++) {
+			if ((text[i + k] ^ p->byte[k]) & p->mask[k]) {
+				break;
+			}
+		}
+		if (k == p->len && hits++ == 0) {
+			*at = i;
+		}
+	}
+
+	return hits;
+}
+
+static void hex(char *out, const uint8_t *b, uint32_t len, uint32_t wild_lo, uint32_t wild_hi)
+{
+	for (uint32_t i = 0; i < len; i++) {
+		if (i >= wild_lo && i < wild_hi) {
+			out += sprintf(out, "%s??", i ? " " : "");
+		} else {
+			out += sprintf(out, "%s%02x", i ? " " : "", b[i]);
+		}
+	}
+	*out = 0;
+}
+
+static int check_parse(void)
+{
+	static struct sigscan_t s;
+	char many[4 * SIGSCAN_BYTES_MAX + 8];
+	int fail = 0;
+
+	sigscan_init(&s, 1);
+	fail |= check("empty", sigscan_add(&s, "") == -1);
+	fail |= check("not hex", sigscan_add(&s, "2d e9 zz 41") == -1);
+	fail |= check("half byte", sigscan_add(&s, "2d e9 f0 4") == -1);
+	fail |= check("half wildcard", sigscan_add(&s, "2d e9 f0 41 ?") == -1);
+	fail |= check("short anchor", sigscan_add(&s, "2d e9 f0 ?? 41 ?? 00 01 02") == -1);
+	fail |= check("nothing added", s.npat == 0 && s.nstate == 1);
+
+	many[0] = 0;
+	for (int i = 0; i <= SIGSCAN_BYTES_MAX; i++) {
+		strcat(many, "aa ");
+	}
+	fail |= check("too long", sigscan_add(&s, many) == -1);
+	many[3 * SIGSCAN_BYTES_MAX - 1] = 0;
+	fail |= check("longest", sigscan_add(&s, many) == 0 && s.pat[0].len == SIGSCAN_BYTES_MAX);
+
+	// the anchor is the longest exact run, cut to its last 16 bytes
+	fail |= check("spaces", sigscan_add(&s, " 2de9f041 ?? 00 01 02 03 04 ") == 1 && s.pat[1].anchor == 10);
+	fail |= check("anchor cut", s.pat[0].anchor == SIGSCAN_BYTES_MAX && s.nstate == 1 + 16 + 5);
+	fail |= check("upper case", sigscan_add(&s, "2D E9 F0 41 ??") == 2 && s.pat[2].byte[2] == 0xf0);
+
+	printf("parse:    %s\n", fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+static int check_limits(void)
+{
+	static struct sigscan_t s;
+	char pat[128];
+	uint8_t b[16];
+	int fail = 0, ret, i;
+
+	// patterns, each its own four bytes out of 60
+	sigscan_init(&s, 1);
+	for (i = 0; i < SIGSCAN_PATTERNS_MAX; i++) {
+		for (int k = 0; k < 4; k++) {
+			b[k] = (i + k) % 60;
+		}
+		hex(pat, b, 4, 0, 0);
+		fail |= check("pattern fits", sigscan_add(&s, pat) == i);
+	}
+	fail |= check("patterns full", sigscan_add(&s, "01 02 03 04") == -2);
+
+	// states, 16 new ones a pattern
+	sigscan_init(&s, 1);
+	for (i = 0, ret = 0; ret >= 0; i++) {
+		for (int k = 0; k < 16; k++) {
+			b[k] = 0x80 + ((i * 7 + k * 3) % 40);
+		}
+		hex(pat, b, 16, 0, 0);
+		ret = sigscan_add(&s, pat);
+	}
+	fail |= check("states full", ret == -2 && s.npat == (SIGSCAN_STATES_MAX - 1) / 16 && s.nstate <= SIGSCAN_STATES_MAX);
+
+	// a failed add leaves the table as it was, the classes run out only
+	// after the states do
+	fail |= check("failed add", s.nstate == 1 + 15 * 16 && s.nclass == 1 + 40);
+	sigscan_run(&s, b, 16);
+	fail |= check("add after build", sigscan_add(&s, "00 01 02 03") == -2);
+
+	printf("limits:   %s\n", fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+// text out of a few byte values so anchors overlap and share suffixes,
+// patterns cut from it with wildcards, every count against the plain search
+static int check_random(uint32_t rounds)
+{
+	static struct sigscan_t s;
+	static uint8_t text[8192];
+	char pat[4 * SIGSCAN_BYTES_MAX];
+	uint8_t b[SIGSCAN_BYTES_MAX];
+	uint64_t hits = 0;
+	int fail = 0;
+
+	for (uint32_t r = 0; r < rounds && !fail; r++) {
+		uint32_t len = 64 + rng() % (sizeof(text) - 64);
+		uint32_t values = 2 + rng() % 6, align = 1 + rng() % 2;
+		uint32_t want = 1 + rng() % SIGSCAN_PATTERNS_MAX;
+
+		for (uint32_t i = 0; i < len; i++) {
+			text[i] = (r % 5 == 0) ? rng() : 0x40 + rng() % values;
+		}
+
+		sigscan_init(&s, align);
+		for (uint32_t n = 0; n < want; n++) {
+			uint32_t plen = 4 + rng() % 36;
+			uint32_t from = rng() % (len - plen);
+			uint32_t wild_lo = rng() % plen, wild_hi = wild_lo + rng() % 4;
+
+			memcpy(b, text + from, plen);
+			if (n % 4 == 3) {
+				b[rng() % plen] ^= 1;          // one that may not be there at all
+			}
+			hex(pat, b, plen, wild_lo, wild_hi);
+			if (sigscan_add(&s, pat) == -2) {
+				break;
+			}
+		}
+
+		sigscan_run(&s, text, len);
+		for (uint32_t i = 0; i < s.npat; i++) {
+			uint32_t at = 0, n = naive(&s.pat[i], text, len, align, &at);
+
+			if (n != s.pat[i].hits || (n && at != s.pat[i].at)) {
+				printf("  round %u pattern %u: %u hits at %x, want %u at %x\n", r, i, s.pat[i].hits, s.pat[i].at, n, at);
+				fail = 1;
+			}
+			hits += n;
+		}
+	}
+
+	printf("random:   %s, %u rounds, %llu hits\n", fail ? "FAIL" : "ok", rounds, (unsigned long long)hits);
+
+	return fail;
+}
+
+// a text with the functions at the fixed offsets, or SHIFT further up
+// past SHIFT_AT, what changes between builds differs
+static void make_text(uint8_t *text, uint32_t len, int shifted, uint32_t seed)
+{
+	uint32_t save = rng_state;
+
+	rng_state = 0x9e3779b9;
+	for (uint32_t i = 0; i < len; i++) {
+		text[i] = rng();
+	}
+	for (int i = 0; i < SIGS; i++) {
+		uint32_t at = sigs[i].fixed + ((shifted && sigs[i].fixed >= SHIFT_AT) ? SHIFT : 0);
+
+		text[at] = 0x2d;
+		text[at + 1] = 0xe9;
+		text[at + 2] = 0xf0;
+		text[at + 3] = 0x4f;
+		for (int k = 4; k < FUNC_LEN; k++) {
+			text[at + k] = rng();
+		}
+	}
+
+	// the bytes of a call, different in every build
+	rng_state = seed;
+	for (int i = 0; i < SIGS; i++) {
+		uint32_t at = sigs[i].fixed + ((shifted && sigs[i].fixed >= SHIFT_AT) ? SHIFT : 0);
+		for (int k = 12; k < 16; k++) {
+			text[at + k] = rng();
+		}
+	}
+	rng_state = save;
+}
+
+// signatures out of the unshifted text, the ioctl one starts 8 bytes in
+static void make_sigs(const uint8_t *text, char pats[SIGS][4 * SIG_LEN])
+{
+	for (int i = 0; i < SIGS; i++) {
+		uint32_t skip = (i == SIG_IOCTL) ? 8 : 0;
+
+		hex(pats[i], text + sigs[i].fixed + skip, SIG_LEN, 12 - skip, 16 - skip);
+		sigs[i].pattern = pats[i];
+		sigs[i].adj = -(int32_t)skip;
+	}
+}
+
+static uint32_t moved(int i)
+{
+	return sigs[i].fixed + ((sigs[i].fixed >= SHIFT_AT) ? SHIFT : 0);
+}
+
+static int file_is(const char *path, const void *data, uint32_t len)
+{
+	char real[512];
+	struct stat st;
+	int ret = 0;
+
+	shim_root_path(real, sizeof(real), path);
+	if (stat(real, &st) < 0 || (uint32_t)st.st_size != len) {
+		return 0;
+	}
+
+	FILE *f = fopen(real, "rb");
+	uint8_t *buf = malloc(len);
+	if (f && buf && fread(buf, 1, len, f) == len) {
+		ret = memcmp(buf, data, len) == 0;
+	}
+	if (f) {
+		fclose(f);
+	}
+	free(buf);
+
+	return ret;
+}
+
+static void text_path(char *out, uint32_t nid)
+{
+	char path[64];
+
+	snprintf(path, sizeof(path), SIGS_TEXT_FILE, nid);
+	strcpy(out, path);
+}
+
+static int all(uint32_t how)
+{
+	for (int i = 0; i < SIGS; i++) {
+		if (sigs[i].how != how) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int check_module(void)
+{
+	static uint8_t base[TEXT_SIZE], text[TEXT_SIZE], copy[TEXT_SIZE];
+	static char pats[SIGS][4 * SIG_LEN];
+	static char marker[SIGS];
+	char path[512];
+	int fail = 0, ok;
+
+	make_text(base, TEXT_SIZE, 0, 1);
+	make_sigs(base, pats);
+
+	// the shifted build, the functions are where the shim has them
+	make_text(text, TEXT_SIZE, 1, 2);
+	shim_set_module(text, TEXT_SIZE, NID_A);
+	for (int i = 0; i < SIGS; i++) {
+		shim_set_offset(moved(i), &marker[i]);
+	}
+
+	module_start(0, NULL);
+	ok = 1;
+	for (int i = 0; i < SIGS; i++) {
+		ok &= sigs[i].how == SIG_FOUND && sigs[i].offset == moved(i);
+	}
+	fail |= check("found", ok);
+	fail |= check("calls", (void *)wlan_cmd_alloc == &marker[SIG_CMD_ALLOC] &&
+		(void *)wlan_lock == &marker[SIG_LOCK] && (void *)wlan_mem_write == &marker[SIG_MEM_WRITE]);
+	fail |= check("hooks", shim_hook(moved(SIG_RX_HANDLER)) == (void *)kwifimon_process_respose &&
+		shim_hook(moved(SIG_IOCTL)) == (void *)kwifimon_ioctl);
+	module_stop(0, NULL);
+	text_path(path, NID_A);
+	fail |= check("no text saved", !file_is(path, text, TEXT_SIZE));
+
+	// the same build again, signatures that would not match any more are
+	// not looked at
+	memcpy(copy, text, TEXT_SIZE);
+	memset(text, 0, TEXT_SIZE);
+	fail |= check("cached count", sigs_resolve(1, NID_A) == SIGS);
+	ok = all(SIG_CACHED);
+	for (int i = 0; i < SIGS; i++) {
+		ok &= sigs[i].offset == moved(i);
+	}
+	fail |= check("cached", ok);
+
+	// another build, none found, unresolved and the text saved
+	fail |= check("missing count", sigs_resolve(1, NID_B) == -1);
+	fail |= check("missing", all(SIG_MISSING));
+	text_path(path, NID_B);
+	fail |= check("text saved", file_is(path, text, TEXT_SIZE));
+
+	// and that is cached as well
+	fail |= check("missing cached", sigs_resolve(1, NID_B) == -1 && all(SIG_MISSING));
+
+	// a function twice
+	memcpy(text, copy, TEXT_SIZE);
+	memcpy(text + 0xf000, text + moved(SIG_CMD_WAIT), FUNC_LEN);
+	fail |= check("ambiguous count", sigs_resolve(1, NID_B + 1) == -1);
+	fail |= check("ambiguous", sigs[SIG_CMD_WAIT].how == SIG_AMBIGUOUS &&
+		sigs[SIG_CMD_SEND2].how == SIG_FOUND && sigs[SIG_CMD_SEND2].offset == moved(SIG_CMD_SEND2));
+
+	// only on halfwords
+	memcpy(text, copy, TEXT_SIZE);
+	memmove(text + moved(SIG_CMD_FREE) + 1, text + moved(SIG_CMD_FREE), FUNC_LEN);
+	fail |= check("odd", sigs_resolve(1, NID_B + 2) == -1 && sigs[SIG_CMD_FREE].how == SIG_MISSING);
+
+	// a changed table is not the one in the cache
+	memcpy(text, copy, TEXT_SIZE);
+	fail |= check("rescan", sigs_resolve(1, NID_A) == SIGS && all(SIG_FOUND));
+	fail |= check("recached", sigs_resolve(1, NID_A) == SIGS && all(SIG_CACHED));
+	sigs[SIG_LOCK].pattern = NULL;
+	// a function without a signature is where it always was, and no text
+	// is saved for it
+	text_path(path, NID_A);
+	fail |= check("table changed", sigs_resolve(1, NID_A) == SIGS - 1 && sigs[SIG_LOCK].how == SIG_OFFSET &&
+		sigs[SIG_UNLOCK].how == SIG_FOUND && !file_is(path, text, TEXT_SIZE));
+	sigs[SIG_LOCK].pattern = pats[SIG_LOCK];
+
+	// no text to scan, what has a signature is unresolved
+	shim_set_module(NULL, 0, NID_A);
+	fail |= check("no text", sigs_resolve(1, NID_A) == -1 && all(SIG_MISSING));
+	for (int i = 0; i < SIGS; i++) {
+		sigs[i].pattern = NULL;
+	}
+	fail |= check("no text, no signatures", sigs_resolve(1, NID_A) == 0 && all(SIG_OFFSET));
+	// a text but no signatures, nothing is scanned for or cached
+	shim_set_module(text, TEXT_SIZE, NID_A);
+	shim_root_path(path, sizeof(path), SIGS_CACHE_FILE);
+	unlink(path);
+	fail |= check("no signatures", sigs_resolve(1, NID_A) == 0 && all(SIG_OFFSET) && access(path, F_OK) != 0);
+
+	// a build the signatures miss, the plugin calls and hooks nothing
+	memcpy(text, copy, TEXT_SIZE);
+	memset(text + moved(SIG_RX_HANDLER), 0, FUNC_LEN);
+	for (int i = 0; i < SIGS; i++) {
+		sigs[i].pattern = pats[i];
+		shim_set_offset(sigs[i].fixed, &marker[i]);
+	}
+	shim_set_module(text, TEXT_SIZE, NID_B + 4);
+	wlan_cmd_alloc = NULL;
+	module_start(0, NULL);
+	fail |= check("not started", kwifimon_mod_state() == STATE_ERROR && wlan_cmd_alloc == NULL &&
+		shim_hook(moved(SIG_RX_HANDLER)) == &marker[SIG_RX_HANDLER] &&
+		shim_hook(sigs[SIG_RX_HANDLER].fixed) == &marker[SIG_RX_HANDLER] && shim_hook(moved(SIG_IOCTL)) == &marker[SIG_IOCTL]);
+	module_stop(0, NULL);
+
+	for (int i = 0; i < SIGS; i++) {
+		sigs[i].pattern = NULL;
+		sigs[i].adj = 0;
+	}
+
+	printf("module:   %s\n", fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+// the signatures of the module test over a bigger text, the matcher
+// against searching each of them in turn, then a load of the plugin
+// with the scan and one with the cache
+static int bench(uint32_t size)
+{
+	static struct sigscan_t s;
+	static uint8_t base[TEXT_SIZE];
+	static char pats[SIGS][4 * SIG_LEN];
+	uint8_t *text = malloc(size);
+	double best[4] = { 1e9, 1e9, 1e9, 1e9 };
+	uint32_t at[SIGS], hits = 0;
+	int bad = 0;
+
+	if (text == NULL || size < TEXT_SIZE) {
+		return 1;
+	}
+
+	make_text(base, TEXT_SIZE, 0, 1);
+	make_sigs(base, pats);
+	for (uint32_t i = 0; i < size; i += 4) {
+		uint32_t w = rng();
+		memcpy(text + i, &w, (size - i < 4) ? size - i : 4);
+	}
+	for (int i = 0; i < SIGS; i++) {
+		at[i] = (rng() % (size - FUNC_LEN)) & ~1;
+		memcpy(text + at[i], base + sigs[i].fixed, FUNC_LEN);
+	}
+
+	for (int run = 0; run < 5; run++) {
+		double t0 = now();
+
+		sigscan_init(&s, 2);
+		for (int i = 0; i < SIGS; i++) {
+			sigscan_add(&s, sigs[i].pattern);
+		}
+		sigscan_run(&s, text, size);
+		if (now() - t0 < best[0]) {
+			best[0] = now() - t0;
+		}
+
+		t0 = now();
+		hits = 0;
+		for (int i = 0; i < SIGS; i++) {
+			uint32_t first = 0;
+			hits += naive(&s.pat[i], text, size, 2, &first);
+		}
+		if (now() - t0 < best[1]) {
+			best[1] = now() - t0;
+		}
+	}
+	for (int i = 0; i < SIGS; i++) {
+		bad |= sigscan_found(&s, i) != (int32_t)at[i] + ((i == SIG_IOCTL) ? 8 : 0);
+	}
+
+	printf("%u KiB, %d signatures\n", size >> 10, SIGS);
+	printf("  one pass     %8.2f ms %8.0f MiB/s\n", best[0] * 1e3, size / best[0] / (1 << 20));
+	printf("  one by one   %8.2f ms %8.0f MiB/s  %.1fx\n", best[1] * 1e3, size / best[1] / (1 << 20), best[1] / best[0]);
+
+	// a whole resolve, the first load of a build and the ones after it
+	shim_set_module(text, size, NID_A);
+	for (int run = 0; run < 5; run++) {
+		char path[512];
+		double t0;
+
+		shim_root_path(path, sizeof(path), SIGS_CACHE_FILE);
+		unlink(path);
+		t0 = now();
+		sigs_resolve(1, NID_A);
+		if (now() - t0 < best[2]) {
+			best[2] = now() - t0;
+		}
+		t0 = now();
+		sigs_resolve(1, NID_A);
+		if (now() - t0 < best[3]) {
+			best[3] = now() - t0;
+		}
+	}
+	printf("  resolve      %8.2f ms scanned, %.3f ms cached\n", best[2] * 1e3, best[3] * 1e3);
+
+	free(text);
+
+	return bad || hits != SIGS;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-b] [-m KiB] [-n rounds] [-s seed] [-o dir]\n", name);
+	fprintf(stderr, "  -b  scan time instead of the checks\n");
+	fprintf(stderr, "  -m  text size for -b (4096)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *dir = "/tmp/sigscantest";
+	char path[512];
+	uint32_t rounds = 2000, size = 4096;
+	int opt, fail = 0, do_bench = 0;
+
+	while ((opt = getopt(argc, argv, "bm:n:s:o:h")) != -1) {
+		switch (opt) {
+		case 'b': do_bench = 1; break;
+		case 'm': size = strtoul(optarg, NULL, 0); break;
+		case 'n': rounds = strtoul(optarg, NULL, 0); break;
+		case 's': rng_state = strtoul(optarg, NULL, 0) | 1; break;
+		case 'o': dir = optarg; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	mkdir(dir, 0755);
+	shim_init(dir);
+	// results of an earlier run are not this one's
+	shim_root_path(path, sizeof(path), SIGS_CACHE_FILE);
+	unlink(path);
+	for (uint32_t nid = NID_B; nid <= NID_B + 4; nid++) {
+		char name[64];
+		text_path(name, (nid == NID_B + 3) ? NID_A : nid);
+		shim_root_path(path, sizeof(path), name);
+		unlink(path);
+	}
+
+	if (do_bench) {
+		return bench(size << 10);
+	}
+
+	fail |= check_parse();
+	fail |= check_limits();
+	fail |= check_random(rounds);
+	fail |= check_module();
+
+	printf("%s\n", fail ? "FAIL" : "ok");
+
+	return fail ? 2 : 0;
+}
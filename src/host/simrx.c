@@ -0,0 +1,456 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <vitasdkkern.h>
+
+#include "kwifimon_export.h"
+#include "wlan_kernel.h"
+#include "sigs.h"
+#include "kwifimon.h"
+#include "pcap.h"
+#include "radiotap.h"
+
+#include "shim.h"
+#include "sdiotrace.h"
+#include "sdiogen.h"
+#include "netrx.h"
+#include "kcapio.h"
+
+// replays sdio rx packets through the kernel capture path on the host
+
+#define MAX_PKT 4096
+
+int module_start(SceSize argc, const void *args);
+int module_stop(SceSize argc, const void *args);
+
+static uint32_t sim_passed;
+
+struct sim_feed_t {
+	rx_hook_t hook;
+	uint32_t rate;
+	int timed;
+	uint32_t n;
+	uint64_t t_start;
+	uint64_t t_due;
+	uint64_t hook_ns;
+};
+
+static uint32_t *exp_hash;
+static uint32_t exp_cnt;
+static uint32_t exp_max;
+
+// stand-in for the original SceWlanBt rx handler
+static int sim_rx_handler(struct wlan_dev_t *dev, uint8_t *in_pkt, int in_pkt_len, uint32_t *somenumber)
+{
+	sim_passed++;
+	return 0;
+}
+
+static uint32_t fnv1a(const uint8_t *p, uint32_t len)
+{
+	uint32_t h = 0x811c9dc5;
+
+	while (len--) {
+		h ^= *p++;
+		h *= 0x01000193;
+	}
+
+	return h;
+}
+
+static uint64_t now_ns(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// remember what the capture path should write out
+static void sim_expect(uint8_t *buf, int len)
+{
+	struct sdio_rx_t *rxt = (struct sdio_rx_t *)buf;
+	struct rxpd *rx_pd = (struct rxpd *)(buf + sizeof(struct sdio_rx_t));
+
+	if (rxt->pkt_type != 0 && rxt->pkt_type != 10) {
+		return;
+	}
+
+	if (rx_pd->rx_pkt_offset + rx_pd->rx_pkt_length > len - sizeof(struct sdio_rx_t)) {
+		return;
+	}
+
+	if (exp_cnt == exp_max) {
+		exp_max = exp_max ? exp_max * 2 : 65536;
+		exp_hash = realloc(exp_hash, exp_max * sizeof(uint32_t));
+	}
+
+	exp_hash[exp_cnt++] = fnv1a((uint8_t *)rx_pd + rx_pd->rx_pkt_offset, rx_pd->rx_pkt_length);
+}
+
+// walk written pcap and match frames against expected in order, drops may leave gaps
+// every radiotap header must have the fields in want
+static int sim_verify(const char *file, uint32_t want, uint32_t *matched, uint32_t *bad)
+{
+	FILE *f = fopen(file, "rb");
+	pcap_hdr_t hdr;
+	pcaprec_hdr_t rec;
+	static uint8_t buf[65536];
+	uint32_t e = 0;
+
+	*matched = 0;
+	*bad = 0;
+
+	if (f == NULL) {
+		return -1;
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic_number != 0xa1b2c3d4 || hdr.network != 127) {
+		fclose(f);
+		return -2;
+	}
+
+	while (fread(&rec, sizeof(rec), 1, f) == 1) {
+		struct ieee80211_radiotap_header *rt = (void *)buf;
+
+		if (rec.incl_len > sizeof(buf) || fread(buf, rec.incl_len, 1, f) != 1) {
+			(*bad)++;
+			break;
+		}
+
+		if (rec.incl_len < sizeof(*rt) || rt->it_len > rec.incl_len || (rt->it_present & want) != want) {
+			(*bad)++;
+			continue;
+		}
+
+		uint32_t h = fnv1a(buf + rt->it_len, rec.incl_len - rt->it_len);
+		while (e < exp_cnt && exp_hash[e] != h) {
+			e++;
+		}
+
+		if (e == exp_cnt) {
+			(*bad)++;
+			continue;
+		}
+
+		(*matched)++;
+		e++;
+	}
+
+	fclose(f);
+
+	return 0;
+}
+
+static void sim_pace(struct sim_feed_t *feed, uint32_t delta_us)
+{
+	if (feed->rate) {
+		feed->t_due = feed->t_start + (uint64_t)feed->n * 1000000000ull / feed->rate;
+	} else if (feed->timed) {
+		feed->t_due += (uint64_t)delta_us * 1000;
+	} else {
+		return;
+	}
+
+	if (now_ns(CLOCK_MONOTONIC) < feed->t_due) {
+		struct timespec ts = { feed->t_due / 1000000000ull, feed->t_due % 1000000000ull };
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	}
+}
+
+static int sim_feed(void *ctx, const uint8_t *pkt, uint32_t len, uint32_t delta_us)
+{
+	static uint8_t buf[MAX_PKT] __attribute__ ((aligned(4)));
+	static uint8_t dev[sizeof(struct wlan_dev_t)];
+	struct sim_feed_t *feed = ctx;
+	uint32_t somenumber = 0;
+
+	if (len > MAX_PKT) {
+		return 0;
+	}
+
+	// hook may keep pointers only for the call, but work on a private copy like the driver buffer
+	memcpy(buf, pkt, len);
+	sim_expect(buf, len);
+	sim_pace(feed, delta_us);
+
+	uint64_t t0 = now_ns(CLOCK_THREAD_CPUTIME_ID);
+	feed->hook((struct wlan_dev_t *)dev, buf, len, &somenumber);
+	feed->hook_ns += now_ns(CLOCK_THREAD_CPUTIME_ID) - t0;
+
+	feed->n++;
+
+	return 0;
+}
+
+static int sim_trace(const char *file, struct sim_feed_t *feed)
+{
+	static uint8_t buf[MAX_PKT];
+	struct sdiotrace_hdr_t th;
+	struct sdiotrace_rec_t r;
+
+	FILE *in = fopen(file, "rb");
+	if (in == NULL || fread(&th, sizeof(th), 1, in) != 1 || memcmp(th.magic, SDIOTRACE_MAGIC, 8)) {
+		if (in) {
+			fclose(in);
+		}
+		return -1;
+	}
+
+	while (fread(&r, sizeof(r), 1, in) == 1) {
+		if (r.len > MAX_PKT || fread(buf, r.len, 1, in) != 1) {
+			fprintf(stderr, "truncated trace at frame %u\n", feed->n);
+			break;
+		}
+		sim_feed(feed, buf, r.len, r.delta_us);
+	}
+
+	fclose(in);
+
+	return feed->n;
+}
+
+static void sim_print_lat(void)
+{
+	static const char *names[LAT_STAGE_NUM] = { "hook", "classify", "filter", "copy", "stats", "ioctl" };
+	struct wifimon_lat_t l;
+	int i;
+
+	kwifimon_mod_lat(&l, 0);
+
+	for (i = 0; i < LAT_STAGE_NUM; i++) {
+		struct lat_hist_t *h = &l.stage[i];
+		if (h->cnt == 0) {
+			continue;
+		}
+		printf("lat %-8s n:%u avg:%.2fus p99:<=%uus max:%uus\n", names[i], h->cnt,
+			(double)h->sum / h->cnt, h->p99, h->max);
+	}
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-i trace | -p pcap] [-n frames] [-s seed] [-r frames/s | -T] [-o dir] [-l] [-N | -D dest ...] [-R port] [-z] [-x] [-t] [-S ms] [-C]\n", name);
+	fprintf(stderr, "  -i  replay recorded sdio trace instead of generated traffic\n");
+	fprintf(stderr, "  -p  replay radiotap pcap converted to rxpd framing\n");
+	fprintf(stderr, "  -n  number of generated frames (default 100000)\n");
+	fprintf(stderr, "  -s  generator seed\n");
+	fprintf(stderr, "  -r  pace input at given rate, 0 is as fast as possible\n");
+	fprintf(stderr, "  -T  pace input with the recorded inter-frame times\n");
+	fprintf(stderr, "  -o  directory standing in for ux0: (default /tmp/simrx)\n");
+	fprintf(stderr, "  -l  enable hook latency instrumentation\n");
+	fprintf(stderr, "  -N  also stream over knet to localhost\n");
+	fprintf(stderr, "  -D  stream to addr[:port[:bytes/s[:burst[:ttl]]]] instead, repeatable,\n");
+	fprintf(stderr, "      a local receiver is bound for each\n");
+	fprintf(stderr, "  -R  run rpcap server on given port (0 is %d), e.g. with -n 0 -r 1000\n", KWIFIMON_RPCAP_PORT);
+	fprintf(stderr, "  -z  write compressed .kcap, verified after converting back to pcap\n");
+	fprintf(stderr, "  -x  write the capture index too\n");
+	fprintf(stderr, "  -t  add the radiotap timestamp field\n");
+	fprintf(stderr, "  -S  sync the capture file at this interval\n");
+	fprintf(stderr, "  -C  exit after the input without stopping the capture, like a crash\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *trace = NULL, *pcap = NULL;
+	const char *root = "/tmp/simrx";
+	struct sdiogen_cfg_t cfg;
+	struct wifimon_net_cfg_t ncfg;
+	struct wifimon_cap_cfg_t ccfg;
+	uint32_t rate = 0;
+	int lat = 0, net = 0, timed = 0, rpcap = -1, crash = 0;
+	uint32_t i;
+	int opt;
+
+	sdiogen_default(&cfg);
+	memset(&ncfg, 0, sizeof(ncfg));
+	memset(&ccfg, 0, sizeof(ccfg));
+
+	while ((opt = getopt(argc, argv, "i:p:n:r:o:s:TlND:R:zxtS:Ch")) != -1) {
+		switch (opt) {
+		case 'i': trace = optarg; break;
+		case 'p': pcap = optarg; break;
+		case 'n': cfg.frames = strtoul(optarg, NULL, 0); break;
+		case 'r': rate = strtoul(optarg, NULL, 0); break;
+		case 'o': root = optarg; break;
+		case 's': cfg.seed = strtoul(optarg, NULL, 0); break;
+		case 'T': timed = 1; break;
+		case 'l': lat = 1; break;
+		case 'N': net = 1; break;
+		case 'R': rpcap = strtoul(optarg, NULL, 0); break;
+		case 'z': ccfg.flags |= KWIFIMON_CAP_COMPRESS; break;
+		case 'x': ccfg.flags |= KWIFIMON_CAP_INDEX; break;
+		case 't': ccfg.flags |= KWIFIMON_CAP_RT_TIMESTAMP; break;
+		case 'S': ccfg.sync_ms = strtoul(optarg, NULL, 0); break;
+		case 'C': crash = 1; break;
+		case 'D':
+			if (netrx_parse(&ncfg, optarg) < 0) {
+				fprintf(stderr, "bad destination %s\n", optarg);
+				return 1;
+			}
+			net = 1;
+			break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	shim_init(root);
+	shim_wlan_init();
+	shim_set_offset(sigs[SIG_RX_HANDLER].fixed, sim_rx_handler);
+
+	module_start(0, NULL);
+	if (kwifimon_mod_state() & 0x80000000) {
+		fprintf(stderr, "module_start failed, state %x\n", kwifimon_mod_state());
+		return 1;
+	}
+
+	if (lat) {
+		kwifimon_lat_enable(1);
+	}
+
+	if (kwifimon_cap_config(&ccfg) < 0 || kwifimon_cap_start(NULL) < 0) {
+		fprintf(stderr, "cap start failed\n");
+		return 1;
+	}
+
+	if (net) {
+		if (netrx_start(&ncfg) < 0 || kwifimon_net_config(&ncfg) < 0 || kwifimon_net_start() < 0) {
+			fprintf(stderr, "net start failed\n");
+			return 1;
+		}
+	}
+
+	if (rpcap >= 0 && kwifimon_rpcap_start(rpcap) < 0) {
+		fprintf(stderr, "rpcap server start failed\n");
+		return 1;
+	}
+
+	struct sim_feed_t feed;
+	int ret;
+
+	memset(&feed, 0, sizeof(feed));
+	feed.hook = (rx_hook_t)shim_hook(sigs[SIG_RX_HANDLER].fixed);
+	feed.rate = rate;
+	feed.timed = timed;
+	feed.t_start = now_ns(CLOCK_MONOTONIC);
+	feed.t_due = feed.t_start;
+
+	uint64_t cpu_start = now_ns(CLOCK_PROCESS_CPUTIME_ID);
+
+	if (trace) {
+		ret = sim_trace(trace, &feed);
+	} else if (pcap) {
+		ret = sdiogen_from_pcap(pcap, sim_feed, &feed);
+	} else {
+		static struct sdiogen_t g;
+		ret = sdiogen_init(&g, &cfg);
+		if (ret >= 0) {
+			ret = sdiogen_run(&g, sim_feed, &feed);
+		}
+	}
+
+	uint64_t t_end = now_ns(CLOCK_MONOTONIC);
+	uint32_t n = feed.n;
+
+	if (crash) {
+		struct wifimon_cap_stats_t cs;
+
+		kwifimon_cap_stats(&cs, 0);
+		printf("frames:     %u\n", n);
+		printf("crash:      %llu bytes in the file, syncs:%u\n", (unsigned long long)cs.file_bytes, cs.syncs);
+		fflush(stdout);
+		_exit(3);
+	}
+
+	if (ret < 0) {
+		fprintf(stderr, "input failed (%d)\n", ret);
+	}
+
+	struct wifimon_stats_t s;
+	kwifimon_mod_stats(&s, 0);
+
+	if (lat) {
+		sim_print_lat();
+	}
+
+	struct wifimon_net_stats_t ns;
+	struct netrx_cnt_t rx[KWIFIMON_NET_DEST_MAX];
+
+	kwifimon_net_stop();
+	kwifimon_net_stats(&ns, 0);
+	if (net) {
+		netrx_stop(rx);
+	}
+
+	struct wifimon_cap_stats_t cs;
+
+	kwifimon_cap_stop();
+	kwifimon_cap_stats(&cs, 0);
+	kwifimon_rpcap_stop();
+	module_stop(0, NULL);
+
+	uint64_t cpu_end = now_ns(CLOCK_PROCESS_CPUTIME_ID);
+
+	char file[512];
+	uint32_t matched = 0, bad = 0;
+	int vret = 0;
+	shim_root_path(file, sizeof(file), "ux0:/data/test.cap");
+
+	if (ccfg.flags & KWIFIMON_CAP_COMPRESS) {
+		static struct kcap_reader_t r;
+		char kfile[512];
+
+		shim_root_path(kfile, sizeof(kfile), "ux0:/data/test.kcap");
+		if (kcap_to_pcap(kfile, file, &r) < 0 || r.bad || r.skipped || r.truncated) {
+			vret = -3;
+		}
+	}
+
+	if (vret == 0) {
+		uint32_t want = (ccfg.flags & KWIFIMON_CAP_RT_TIMESTAMP) ? 1u << IEEE80211_RADIOTAP_TIMESTAMP : 0;
+		vret = sim_verify(file, want, &matched, &bad);
+	}
+
+	double secs = (t_end - feed.t_start) / 1e9;
+
+	printf("frames:     %u\n", n);
+	printf("rate:       %.0f frames/s\n", n / secs);
+	printf("hook cpu:   %.1f ns/frame\n", n ? (double)feed.hook_ns / n : 0.0);
+	printf("total cpu:  %.1f ns/frame (incl. writer)\n", n ? (double)(cpu_end - cpu_start) / n : 0.0);
+	printf("stats:      pkt:%u mgmt:%u amsdu:%u bar:%u evt:%u drop:%u passed:%u\n",
+		s.pkt_cnt, s.mgmt_cnt, s.amsdu_cnt, s.bar_cnt, s.evt_cnt, s.drop_cnt, sim_passed);
+	printf("output:     expected:%u written:%u bad:%u dropped:%u\n", exp_cnt, matched, bad, s.drop_cnt);
+
+	printf("file:       blocks:%u stored_busy:%u stored_poor:%u raw:%llu written:%llu ratio:%.2f\n",
+		cs.blocks, cs.stored_busy, cs.stored_poor, (unsigned long long)cs.raw_bytes,
+		(unsigned long long)cs.file_bytes, cs.file_bytes ? (double)cs.raw_bytes / cs.file_bytes : 0.0);
+	if (ccfg.sync_ms) {
+		printf("sync:       %u every %u ms, longest %u us, errors %u\n", cs.syncs, ccfg.sync_ms,
+			cs.sync_us_max, cs.sync_err);
+	}
+	if (ccfg.flags & KWIFIMON_CAP_INDEX) {
+		printf("index:      entries:%u bytes:%llu (%.3f%% of file)\n", cs.idx_entries, (unsigned long long)cs.idx_bytes,
+			cs.file_bytes ? cs.idx_bytes * 100.0 / cs.file_bytes : 0.0);
+	}
+
+	for (i = 0; net && i < ns.num; i++) {
+		struct wifimon_net_cnt_t *c = &ns.dest[i];
+		printf("net %u:      sent:%u (%u bytes) drop_rate:%u drop_err:%u mgmt_prio:%u recv:%u (%u bytes, %u mgmt)\n",
+			i, c->sent_pkts, c->sent_bytes, c->drop_rate, c->drop_err, c->mgmt_prio,
+			rx[i].pkts, rx[i].bytes, rx[i].mgmt);
+	}
+
+	if (ret < 0 || vret < 0 || bad || matched + s.drop_cnt != exp_cnt) {
+		printf("result:     FAIL (%d)\n", vret);
+		return 2;
+	}
+
+	printf("result:     OK\n");
+
+	return 0;
+}
@@ -0,0 +1,63 @@
+#ifndef TEST_h_
+#define TEST_h_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+// what the self-checking programs share: a seedable xorshift, a clock for
+// the timed sections and reporting of what failed
+// each test sets rng_state from -s, | 1 so it never is 0
+
+static uint32_t rng_state __attribute__ ((unused)) = 1;
+static uint64_t fails __attribute__ ((unused));
+
+static inline uint32_t rng(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+static inline double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// the same clock whole, for deadlines
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// returns 1 on failure, for fail |= check(...)
+static inline int check(const char *what, int cond)
+{
+	if (!cond) {
+		printf("  %s: FAIL\n", what);
+	}
+	return !cond;
+}
+
+// an input that failed, the first few are dumped
+static inline void fail(const char *what, const uint8_t *p, uint32_t len)
+{
+	uint32_t i;
+
+	if (fails++ < 8) {
+		printf("FAIL %s, %u bytes:", what, len);
+		for (i = 0; i < len && i < 64; i++) {
+			printf(" %02x", p[i]);
+		}
+		printf("\n");
+	}
+}
+
+#endif
@@ -0,0 +1,163 @@
+#include <vitasdkkern.h>
+#include <string.h>
+
+#include "assert.h"
+#include "cmdtrace.h"
+
+#define CMDTRACE_MASK (WIFIMON_CMDTRACE_SLOTS - 1)
+
+volatile int cmdtrace_on = 0;
+
+static struct wifimon_cmdtrace_rec_t cmdtrace_ring[WIFIMON_CMDTRACE_SLOTS];
+static uint32_t cmdtrace_seq;    // last taken
+
+void cmdtrace_enable(int enable)
+{
+	STATIC_ASSERT(((WIFIMON_CMDTRACE_SLOTS & CMDTRACE_MASK) == 0), "WIFIMON_CMDTRACE_SLOTS not a power of two!")
+	STATIC_ASSERT((sizeof(struct wifimon_cmdtrace_rec_t) == 64), "Bad size of struct wifimon_cmdtrace_rec_t!")
+
+	if (enable && !cmdtrace_on) {
+		for (uint32_t i = 0; i < WIFIMON_CMDTRACE_SLOTS; i++) {
+			__atomic_store_n(&cmdtrace_ring[i].seq, 0, __ATOMIC_RELAXED);
+		}
+		__atomic_store_n(&cmdtrace_seq, 0, __ATOMIC_RELEASE);
+	}
+
+	cmdtrace_on = !!enable;
+}
+
+// a slot's seq only moves forward, so a writer lapped while it was
+// preempted can not hide the newer record from the reader: taking or
+// putting over a newer seq drops the record, the reader counts it lost
+static inline int newer(uint32_t s, uint32_t seq)
+{
+	return s != 0 && (int32_t)(s - seq) > 0;
+}
+
+// slot for the next record, marked as being written, NULL when lapped
+static inline struct wifimon_cmdtrace_rec_t *take(uint32_t *seq)
+{
+	struct wifimon_cmdtrace_rec_t *r;
+	uint32_t s;
+
+	*seq = __atomic_add_fetch(&cmdtrace_seq, 1, __ATOMIC_RELAXED);
+	r = &cmdtrace_ring[*seq & CMDTRACE_MASK];
+	s = __atomic_load_n(&r->seq, __ATOMIC_RELAXED);
+	do {
+		if (newer(s, *seq)) {
+			return NULL;
+		}
+	} while (!__atomic_compare_exchange_n(&r->seq, &s, 0, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	return r;
+}
+
+static inline void put(struct wifimon_cmdtrace_rec_t *r, uint32_t seq)
+{
+	uint32_t s = __atomic_load_n(&r->seq, __ATOMIC_RELAXED);
+
+	do {
+		if (newer(s, seq)) {
+			return;
+		}
+	} while (!__atomic_compare_exchange_n(&r->seq, &s, seq, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static void fill(struct wifimon_cmdtrace_rec_t *r, const void *data, int len)
+{
+	uint32_t n = (len > 0) ? len : 0;
+
+	r->ts = ksceKernelGetSystemTimeLow();
+	r->len = (n > 0xffff) ? 0xffff : n;
+	r->caplen = (n > WIFIMON_CMDTRACE_DATA) ? WIFIMON_CMDTRACE_DATA : n;
+	r->reserved = 0;
+	if (data) {
+		memcpy(r->data, data, r->caplen);
+	} else {
+		r->caplen = 0;
+	}
+}
+
+void cmdtrace_cmd(uint16_t id, const void *data, int len)
+{
+	uint32_t seq;
+	struct wifimon_cmdtrace_rec_t *r = take(&seq);
+
+	if (r == NULL) {
+		return;
+	}
+	r->kind = WIFIMON_CMDTRACE_CMD;
+	r->id = id;
+	r->seq_num = 0;
+	r->result = 0;
+	fill(r, data, len);
+	put(r, seq);
+}
+
+void cmdtrace_resp(const uint8_t *pkt, int len)
+{
+	uint32_t seq;
+	struct wifimon_cmdtrace_rec_t *r;
+
+	// command, size, seq_num and result, little endian
+	if (len < 8) {
+		return;
+	}
+
+	r = take(&seq);
+	if (r == NULL) {
+		return;
+	}
+	r->kind = WIFIMON_CMDTRACE_REPLY;
+	r->id = pkt[0] | (pkt[1] << 8);
+	r->seq_num = pkt[4] | (pkt[5] << 8);
+	r->result = pkt[6] | (pkt[7] << 8);
+	fill(r, pkt, len);
+	put(r, seq);
+}
+
+uint32_t cmdtrace_read(uint32_t *cursor, struct wifimon_cmdtrace_rec_t *out, uint32_t max, uint32_t *lost)
+{
+	uint32_t head = __atomic_load_n(&cmdtrace_seq, __ATOMIC_ACQUIRE);
+	uint32_t at = *cursor, n = 0;
+
+	*lost = 0;
+
+	// a cursor from before the ring was emptied
+	if ((int32_t)(head - at) < 0) {
+		at = 0;
+	}
+	if (head - at > WIFIMON_CMDTRACE_SLOTS) {
+		*lost = head - at - WIFIMON_CMDTRACE_SLOTS;
+		at = head - WIFIMON_CMDTRACE_SLOTS;
+	}
+
+	while (n < max && at != head) {
+		uint32_t want = at + 1;
+		const struct wifimon_cmdtrace_rec_t *r = &cmdtrace_ring[want & CMDTRACE_MASK];
+		uint32_t s = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+
+		if (s == want) {
+			memcpy(&out[n], r, sizeof(struct wifimon_cmdtrace_rec_t));
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) == want) {
+				out[n++].seq = want;
+			} else {
+				(*lost)++;
+			}
+		} else if (s != 0 && (int32_t)(s - want) > 0) {
+			// overwritten already
+			(*lost)++;
+		} else {
+			// still being written, or being overwritten and the next read
+			// finds out which
+			break;
+		}
+		at = want;
+	}
+
+	*cursor = at;
+
+	return n;
+}
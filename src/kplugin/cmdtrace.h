@@ -0,0 +1,28 @@
+#ifndef CMDTRACE_h_
+#define CMDTRACE_h_
+
+#include <stdint.h>
+
+#include "kwifimon_export.h"
+
+// host commands as sent and their responses as received, in a ring of
+// WIFIMON_CMDTRACE_SLOTS records that overwrites the oldest
+// any thread records without a lock: it takes the next sequence number,
+// zeroes the slot's seq, fills the record and stores seq last, a reader
+// checks seq before and after its copy and drops what was overwritten
+
+extern volatile int cmdtrace_on;
+
+// the ring is emptied and numbering starts over when turned on
+void cmdtrace_enable(int enable);
+
+// body of a command, id as given to wlan_cmd_send2
+void cmdtrace_cmd(uint16_t id, const void *data, int len);
+// response from its host command header on, after the sdio header
+void cmdtrace_resp(const uint8_t *pkt, int len);
+
+// up to max records after *cursor, which moves to the last returned,
+// *lost counts those overwritten before they were read
+uint32_t cmdtrace_read(uint32_t *cursor, struct wifimon_cmdtrace_rec_t *out, uint32_t max, uint32_t *lost);
+
+#endif
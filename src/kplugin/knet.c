@@ -5,21 +5,79 @@
 
 #include "knet.h"
 
+// token bucket in byte-microseconds, so refill needs no division and keeps fractions
+#define KNET_US          1000000ull
+#define KNET_BURST_MIN   (16*1024)
+
+struct knet_dest_t {
+	SceNetSockaddrIn tgt;
+	uint32_t rate;
+	uint64_t burst;
+	uint64_t tokens;
+	uint32_t last;
+	struct wifimon_net_cnt_t cnt;
+};
+
 int knet_fd = -1;
-SceNetSockaddrIn knet_tgt;
 uint8_t knet_pkt[2048];
 
-int knet_start(int port)
+static struct knet_dest_t knet_dest[KWIFIMON_NET_DEST_MAX];
+static uint32_t knet_num;
+
+int knet_start(const struct wifimon_net_cfg_t *cfg)
 {
+	uint32_t i, ttl = 0;
+
+	if (cfg->num > KWIFIMON_NET_DEST_MAX) {
+		return -1;
+	}
+
 	knet_fd = ksceNetSocket("kwifimon", SCE_NET_AF_INET, SCE_NET_SOCK_DGRAM, 0);
 	if (knet_fd < 0) {
 		return -1;
 	}
 
-	memset(&knet_tgt, 0, sizeof(knet_tgt));
-	knet_tgt.sin_family = SCE_NET_AF_INET;
-	knet_tgt.sin_port = ksceNetHtons(port);
-	knet_tgt.sin_addr.s_addr = SCE_NET_INADDR_LOOPBACK;
+	memset(knet_dest, 0, sizeof(knet_dest));
+
+	knet_num = cfg->num ? cfg->num : 1;
+
+	for (i = 0; i < knet_num; i++) {
+		const struct wifimon_net_dest_t *d = &cfg->dest[i];
+		struct knet_dest_t *k = &knet_dest[i];
+
+		k->tgt.sin_family = SCE_NET_AF_INET;
+		k->tgt.sin_port = ksceNetHtons(KWIFIMON_NET_PORT);
+		k->tgt.sin_addr.s_addr = SCE_NET_INADDR_LOOPBACK;
+
+		if (cfg->num == 0) {
+			continue;
+		}
+
+		if (d->port) {
+			k->tgt.sin_port = ksceNetHtons(d->port);
+		}
+		k->tgt.sin_addr.s_addr = d->addr;
+
+		// one socket for all, so the largest multicast ttl wins
+		if ((ksceNetNtohl(d->addr) >> 28) == 0xe && d->ttl > ttl) {
+			ttl = d->ttl;
+		}
+
+		k->rate = d->rate;
+		if (k->rate) {
+			k->burst = d->burst ? d->burst : k->rate / 8;
+			if (k->burst < KNET_BURST_MIN) {
+				k->burst = KNET_BURST_MIN;
+			}
+			k->burst *= KNET_US;
+			k->tokens = k->burst;
+			k->last = ksceKernelGetSystemTimeLow();
+		}
+	}
+
+	if (ttl > 1) {
+		ksceNetSetsockopt(knet_fd, SCE_NET_IPPROTO_IP, SCE_NET_IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+	}
 
 	return 0;
 }
@@ -27,20 +85,103 @@ int knet_start(int port)
 
 int knet_stop(void)
 {
+	if (knet_fd < 0) {
+		return 0;
+	}
+
 	ksceNetClose(knet_fd);
 	knet_fd = -1;
 
 	return 0;
 }
 
+// take len bytes from the bucket, data frames have to leave a quarter for management
+static int knet_bucket(struct knet_dest_t *k, uint32_t len, int mgmt, uint32_t now)
+{
+	uint64_t cost = (uint64_t)len * KNET_US;
+	uint64_t floor = mgmt ? 0 : k->burst / 4;
+	uint64_t add = (uint64_t)(now - k->last) * k->rate;
+
+	k->last = now;
+	if (add >= k->burst - k->tokens) {
+		k->tokens = k->burst;
+	} else {
+		k->tokens += add;
+	}
+
+	if (k->tokens < floor + cost) {
+		return 0;
+	}
+
+	if (mgmt && k->tokens < k->burst / 4 + cost) {
+		k->cnt.mgmt_prio++;
+	}
+
+	k->tokens -= cost;
+
+	return 1;
+}
+
 int knet_write_rt(struct ieee80211_radiotap_header *rtap, uint8_t *buf, uint32_t buf_len)
 {
+	uint32_t len, i, now = 0;
+	int mgmt, ret = 0;
+
 	if (knet_fd < 0) {
 		return -1;
 	}
 
+	len = rtap->it_len + buf_len;
+	if (len > sizeof(knet_pkt)) {
+		return -1;
+	}
+
 	memcpy(knet_pkt, rtap, rtap->it_len);
 	memcpy(knet_pkt + rtap->it_len, buf, buf_len);
 
-	return ksceNetSendto(knet_fd, knet_pkt, rtap->it_len+buf_len, SCE_NET_MSG_DONTWAIT, (SceNetSockaddr *)&knet_tgt, sizeof(knet_tgt));
+	// frame control type 0
+	mgmt = buf_len > 0 && (buf[0] & 0x0c) == 0;
+
+	for (i = 0; i < knet_num; i++) {
+		struct knet_dest_t *k = &knet_dest[i];
+
+		if (k->rate) {
+			if (now == 0) {
+				now = ksceKernelGetSystemTimeLow();
+			}
+			if (!knet_bucket(k, len, mgmt, now)) {
+				k->cnt.drop_rate++;
+				continue;
+			}
+		}
+
+		ret = ksceNetSendto(knet_fd, knet_pkt, len, SCE_NET_MSG_DONTWAIT, (SceNetSockaddr *)&k->tgt, sizeof(k->tgt));
+		if (ret < 0) {
+			k->cnt.drop_err++;
+			continue;
+		}
+
+		k->cnt.sent_pkts++;
+		k->cnt.sent_bytes += len;
+	}
+
+	return ret;
+}
+
+// writer thread updates the counters, call with writer lock held
+void knet_stats(struct wifimon_net_stats_t *s, int reset)
+{
+	uint32_t i;
+
+	memset(s, 0, sizeof(struct wifimon_net_stats_t));
+
+	// counters stay readable after stop, until the next start
+	s->num = knet_num;
+
+	for (i = 0; i < KWIFIMON_NET_DEST_MAX; i++) {
+		s->dest[i] = knet_dest[i].cnt;
+		if (reset) {
+			memset(&knet_dest[i].cnt, 0, sizeof(struct wifimon_net_cnt_t));
+		}
+	}
 }
@@ -3,9 +3,11 @@
 
 #include <stdint.h>
 #include "radiotap.h"
+#include "kwifimon_export.h"
 
-int knet_start(int port);
+int knet_start(const struct wifimon_net_cfg_t *cfg);
 int knet_stop(void);
 int knet_write_rt(struct ieee80211_radiotap_header *rtap, uint8_t * buf, uint32_t buf_len);
+void knet_stats(struct wifimon_net_stats_t *s, int reset);
 
 #endif
@@ -12,15 +12,28 @@
 #include "wlan_kernel.h"
 #include "assert.h"
 #include "radiotap.h"
+#include "rtap.h"
 
 #include "kwifimon.h"
 #include "pcap.h"
 #include "knet.h"
 #include "m.h"
+#include "ring.h"
+#include "writer.h"
+#include "rpcap.h"
+#include "live.h"
+#include "fwsnap.h"
+#include "sigs.h"
+#include "cmdtrace.h"
 
 #define MAX(x, y) ((x)>(y)?(x):(y))
 #define MIN(x, y) ((x)<(y)?(x):(y))
-#define MAX_FILELEN 200
+
+// latency instrumentation, ticks are microseconds
+// stage macros compile away when "on" is constant 0
+#define LAT_NOW() ksceKernelGetSystemTimeLow()
+#define LAT_STAMP(on) ((on) ? LAT_NOW() : 0)
+#define LAT_STAGE(on, st, t0) do { if (on) lat_add(&kwifimon_lat.stage[(st)], LAT_NOW() - (t0)); } while (0)
 
 #define HOOKS_NUMBER 5
 static int uids[HOOKS_NUMBER];
@@ -32,6 +45,22 @@ uint32_t kwifimon_channel_freq;
 uint32_t kwifimon_channel_band;
 volatile int kwifimon_state = 0;
 struct wifimon_stats_t kwifimon_stats;
+volatile int kwifimon_lat_on = 0;
+struct wifimon_lat_t kwifimon_lat;
+struct wifimon_net_cfg_t kwifimon_net_cfg;
+struct wifimon_cap_cfg_t kwifimon_cap_cfg;
+
+// capture filter, run by the hook with kwifimon_mutex held
+static struct bpf_insn_t kwifimon_filter[BPF_MAXINSNS];
+static uint32_t kwifimon_filter_len;
+// the rpcap client's filter, run by the hook after the capture filter,
+// decides only what goes to the client
+static struct bpf_insn_t kwifimon_rpcap_filter[BPF_MAXINSNS];
+static uint32_t kwifimon_rpcap_filter_len;
+static uint32_t kwifimon_rpcap_filt_cnt;
+
+// layouts of the headers capture() extends, used with kwifimon_mutex held
+static struct rtap_cache_t kwifimon_rtap_cache;
 
 // missing taihen prototype
 int module_get_offset(SceUID pid, SceUID modid, int segidx, size_t offset, uintptr_t *addr);
@@ -65,18 +94,24 @@ int kwifimon_mod_state(void)
 int kwifimon_cap_start(char *file)
 {
 	int state, ret;
-	char filename[MAX_FILELEN];
 
 	ENTER_SYSCALL(state);
 
 	ret = ksceKernelLockMutex(kwifimon_mutex, 1, NULL);
 	if (ret >= 0) {
-//	ksceKernelStrncpyUserToKernel(filename, (uintptr_t)file, MAX_FILELEN);
-		ret = pcap_open("ux0:/data/test.cap");
+		writer_lock();
+		// checkpoints need the index
+		int idx = (kwifimon_cap_cfg.flags & KWIFIMON_CAP_INDEX) || kwifimon_cap_cfg.sync_ms;
+		if (kwifimon_cap_cfg.flags & KWIFIMON_CAP_COMPRESS) {
+			ret = pcap_open("ux0:/data/test.kcap", idx ? "ux0:/data/test.kcap.idx" : NULL, &kwifimon_cap_cfg);
+		} else {
+			ret = pcap_open("ux0:/data/test.cap", idx ? "ux0:/data/test.cap.idx" : NULL, &kwifimon_cap_cfg);
+		}
+		writer_unlock();
 		if (ret == 0) {
 			kwifimon_state |= STATE_REC_FILE;
 		}
-		ret = ksceKernelUnlockMutex(kwifimon_mutex, 1);
+		ksceKernelUnlockMutex(kwifimon_mutex, 1);
 	}
 
 	EXIT_SYSCALL(state);
@@ -93,8 +128,12 @@ int kwifimon_cap_stop(void)
 
 	ret = ksceKernelLockMutex(kwifimon_mutex, 1, NULL);
 	if (ret >= 0) {
+		// hook is blocked on kwifimon_mutex, write out what it queued
+		writer_lock();
+		writer_drain();
 		pcap_close();
 		kwifimon_state &= ~STATE_REC_FILE;
+		writer_unlock();
 		ret = ksceKernelUnlockMutex(kwifimon_mutex, 1);
 	}
 
@@ -103,6 +142,47 @@ int kwifimon_cap_stop(void)
 	return ret;
 }
 
+// takes effect on the next kwifimon_cap_start
+int kwifimon_cap_config(const struct wifimon_cap_cfg_t *cfg)
+{
+	struct wifimon_cap_cfg_t c;
+	int state, ret;
+
+	ENTER_SYSCALL(state);
+
+	ret = ksceKernelMemcpyUserToKernel(&c, (uintptr_t)cfg, sizeof(struct wifimon_cap_cfg_t));
+	if (ret >= 0) {
+		ret = ksceKernelLockMutex(kwifimon_mutex, 1, NULL);
+		if (ret >= 0) {
+			kwifimon_cap_cfg = c;
+			ret = ksceKernelUnlockMutex(kwifimon_mutex, 1);
+		}
+	}
+
+	EXIT_SYSCALL(state);
+
+	return ret;
+}
+
+int kwifimon_cap_stats(struct wifimon_cap_stats_t *s, int reset)
+{
+	struct wifimon_cap_stats_t cs;
+	int state, ret;
+
+	ENTER_SYSCALL(state);
+
+	ret = writer_lock();
+	if (ret >= 0) {
+		pcap_stats_get(&cs, reset);
+		writer_unlock();
+		ksceKernelMemcpyKernelToUser((uintptr_t)s, &cs, sizeof(struct wifimon_cap_stats_t));
+	}
+
+	EXIT_SYSCALL(state);
+
+	return ret;
+}
+
 int kwifimon_mod_stats(struct wifimon_stats_t *s, int reset)
 {
 	int state, ret;
@@ -125,6 +205,123 @@ int kwifimon_mod_stats(struct wifimon_stats_t *s, int reset)
 	return ret;
 }
 
+int kwifimon_lat_enable(int enable)
+{
+	int state, ret;
+
+	ENTER_SYSCALL(state);
+
+	ret = ksceKernelLockMutex(kwifimon_mutex, 1, NULL);
+	if (ret >= 0) {
+		kwifimon_lat_on = !!enable;
+		kwifimon_lat.enabled = kwifimon_lat_on;
+		ret = ksceKernelUnlockMutex(kwifimon_mutex, 1);
+	}
+
+	EXIT_SYSCALL(state);
+
+	return ret;
+}
+
+int kwifimon_mod_lat(struct wifimon_lat_t *l, int reset)
+{
+	int state, ret, i;
+
+	ENTER_SYSCALL(state);
+
+	ret = ksceKernelLockMutex(kwifimon_mutex, 1, NULL);
+	if (ret >= 0) {
+		// histograms are updated unlocked by the hooks, an odd lost sample is fine
+		for (i = 0; i < LAT_STAGE_NUM; i++) {
+			lat_finish(&kwifimon_lat.stage[i]);
+		}
+
+		kwifimon_lat.unit_ns = 1000;
+		ksceKernelMemcpyKernelToUser((uintptr_t)l, &kwifimon_lat, sizeof(struct wifimon_lat_t));
+
+		if (reset) {
+			for (i = 0; i < LAT_STAGE_NUM; i++) {
+				lat_reset(&kwifimon_lat.stage[i]);
+			}
+		}
+
+		ret = ksceKernelUnlockMutex(kwifimon_mutex, 1);
+	}
+
+	EXIT_SYSCALL(state);
+
+	return ret;
+}
+
+int kwifimon_cmdtrace_enable(int enable)
+{
+	int state, ret;
+
+	ENTER_SYSCALL(state);
+
+	ret = ksceKernelLockMutex(kwifimon_mutex, 1, NULL);
+	if (ret >= 0) {
+		cmdtrace_enable(enable);
+		ret = ksceKernelUnlockMutex(kwifimon_mutex, 1);
+	}
+
+	EXIT_SYSCALL(state);
+
+	return ret;
+}
+
+// the hooks record unlocked, the mutex only keeps readers apart
+int kwifimon_cmdtrace_read(struct wifimon_cmdtrace_t *t)
+{
+	static struct wifimon_cmdtrace_t buf;
+	int state, ret;
+
+	ENTER_SYSCALL(state);
+
+	ret = ksceKernelLockMutex(kwifimon_mutex, 1, NULL);
+	if (ret >= 0) {
+		ret = ksceKernelMemcpyUserToKernel(&buf.cursor, (uintptr_t)&t->cursor, sizeof(buf.cursor));
+		if (ret >= 0) {
+			buf.n = cmdtrace_read(&buf.cursor, buf.rec, WIFIMON_CMDTRACE_READ, &buf.lost);
+
+			uint32_t len = offsetof(struct wifimon_cmdtrace_t, rec) + buf.n * sizeof(struct wifimon_cmdtrace_rec_t);
+			ret = ksceKernelMemcpyKernelToUser((uintptr_t)t, &buf, len);
+		}
+
+		ksceKernelUnlockMutex(kwifimon_mutex, 1);
+	}
+
+	EXIT_SYSCALL(state);
+
+	return ret;
+}
+
+// tables are snapshotted with the hook blocked, then copied out
+int kwifimon_live_snapshot(struct wifimon_live_t *l, int reset)
+{
+	static struct wifimon_live_t snap;
+	int state, ret;
+
+	ENTER_SYSCALL(state);
+
+	ret = ksceKernelLockMutex(kwifimon_mutex, 1, NULL);
+	if (ret >= 0) {
+		live_snapshot(&snap, ksceKernelGetSystemTimeLow());
+		if (reset) {
+			live_init();
+		}
+
+		uint32_t len = offsetof(struct wifimon_live_t, sta) + snap.nsta * sizeof(struct wifimon_sta_t);
+		ksceKernelMemcpyKernelToUser((uintptr_t)l, &snap, len);
+
+		ret = ksceKernelUnlockMutex(kwifimon_mutex, 1);
+	}
+
+	EXIT_SYSCALL(state);
+
+	return ret;
+}
+
 int kwifimon_net_start(void)
 {
 	int state, ret;
@@ -133,11 +330,13 @@ int kwifimon_net_start(void)
 
 	ret = ksceKernelLockMutex(kwifimon_mutex, 1, NULL);
 	if (ret >= 0) {
-		ret = knet_start(KWIFIMON_NET_PORT);
+		writer_lock();
+		ret = knet_start(&kwifimon_net_cfg);
+		writer_unlock();
 		if (ret == 0) {
 			kwifimon_state |= STATE_REC_NET;
 		}
-		ret = ksceKernelUnlockMutex(kwifimon_mutex, 1);
+		ksceKernelUnlockMutex(kwifimon_mutex, 1);
 	}
 
 	EXIT_SYSCALL(state);
@@ -153,8 +352,11 @@ int kwifimon_net_stop(void)
 
 	ret = ksceKernelLockMutex(kwifimon_mutex, 1, NULL);
 	if (ret >= 0) {
+		writer_lock();
+		writer_drain();
 		knet_stop();
 		kwifimon_state &= ~STATE_REC_NET;
+		writer_unlock();
 		ret = ksceKernelUnlockMutex(kwifimon_mutex, 1);
 	}
 
@@ -163,6 +365,193 @@ int kwifimon_net_stop(void)
 	return ret;
 }
 
+// set stream destinations, a running stream is restarted with them
+int kwifimon_net_config(const struct wifimon_net_cfg_t *cfg)
+{
+	struct wifimon_net_cfg_t c;
+	int state, ret;
+
+	ENTER_SYSCALL(state);
+
+	ret = ksceKernelMemcpyUserToKernel(&c, (uintptr_t)cfg, sizeof(struct wifimon_net_cfg_t));
+	if (ret < 0 || c.num > KWIFIMON_NET_DEST_MAX) {
+		EXIT_SYSCALL(state);
+		return -1;
+	}
+
+	ret = ksceKernelLockMutex(kwifimon_mutex, 1, NULL);
+	if (ret >= 0) {
+		kwifimon_net_cfg = c;
+
+		if (kwifimon_state & STATE_REC_NET) {
+			writer_lock();
+			writer_drain();
+			knet_stop();
+			ret = knet_start(&kwifimon_net_cfg);
+			if (ret < 0) {
+				kwifimon_state &= ~STATE_REC_NET;
+			}
+			writer_unlock();
+		}
+
+		ksceKernelUnlockMutex(kwifimon_mutex, 1);
+	}
+
+	EXIT_SYSCALL(state);
+
+	return ret;
+}
+
+int kwifimon_net_stats(struct wifimon_net_stats_t *s, int reset)
+{
+	struct wifimon_net_stats_t ns;
+	int state, ret;
+
+	ENTER_SYSCALL(state);
+
+	ret = ksceKernelLockMutex(kwifimon_mutex, 1, NULL);
+	if (ret >= 0) {
+		writer_lock();
+		knet_stats(&ns, reset);
+		writer_unlock();
+
+		ksceKernelMemcpyKernelToUser((uintptr_t)s, &ns, sizeof(struct wifimon_net_stats_t));
+
+		ret = ksceKernelUnlockMutex(kwifimon_mutex, 1);
+	}
+
+	EXIT_SYSCALL(state);
+
+	return ret;
+}
+
+// load filter from user memory, len 0 clears it, a bad program leaves no filter
+static int filter_load(const struct bpf_insn_t *prog, uint32_t len)
+{
+	int ret;
+
+	if (len > BPF_MAXINSNS) {
+		return -1;
+	}
+
+	ret = ksceKernelLockMutex(kwifimon_mutex, 1, NULL);
+	if (ret < 0) {
+		return ret;
+	}
+
+	kwifimon_filter_len = 0;
+
+	if (len) {
+		ret = ksceKernelMemcpyUserToKernel(kwifimon_filter, (uintptr_t)prog, len * sizeof(struct bpf_insn_t));
+
+		if (ret >= 0 && bpf_validate(kwifimon_filter, len) == 0) {
+			kwifimon_filter_len = len;
+		} else {
+			ret = -1;
+		}
+	}
+
+	ksceKernelUnlockMutex(kwifimon_mutex, 1);
+
+	return ret;
+}
+
+// a validated program in kernel memory, len 0 clears it
+int kwifimon_rpcap_filter_set(const struct bpf_insn_t *prog, uint32_t len)
+{
+	int ret;
+
+	if (len > BPF_MAXINSNS) {
+		return -1;
+	}
+
+	ret = ksceKernelLockMutex(kwifimon_mutex, 1, NULL);
+	if (ret >= 0) {
+		memcpy(kwifimon_rpcap_filter, prog, len * sizeof(struct bpf_insn_t));
+		kwifimon_rpcap_filter_len = len;
+		ksceKernelUnlockMutex(kwifimon_mutex, 1);
+	}
+
+	return ret;
+}
+
+void kwifimon_state_set(uint32_t bits, int on)
+{
+	if (ksceKernelLockMutex(kwifimon_mutex, 1, NULL) >= 0) {
+		if (on) {
+			kwifimon_state |= bits;
+		} else {
+			kwifimon_state &= ~bits;
+		}
+		ksceKernelUnlockMutex(kwifimon_mutex, 1);
+	}
+}
+
+// applies to every capture output, an rpcap client's filter only narrows
+// what goes to it
+int kwifimon_filter_set(const struct bpf_insn_t *prog, uint32_t len)
+{
+	int state, ret;
+
+	ENTER_SYSCALL(state);
+	ret = filter_load(prog, len);
+	EXIT_SYSCALL(state);
+
+	return ret;
+}
+
+int kwifimon_rpcap_start(int port)
+{
+	int state, ret;
+
+	ENTER_SYSCALL(state);
+	ret = rpcap_start(port);
+	EXIT_SYSCALL(state);
+
+	return ret;
+}
+
+// not under kwifimon_mutex, the server thread takes it while shutting down a session
+int kwifimon_rpcap_stop(void)
+{
+	int state;
+
+	ENTER_SYSCALL(state);
+	rpcap_stop();
+	EXIT_SYSCALL(state);
+
+	return 0;
+}
+
+int kwifimon_rpcap_stats(struct wifimon_rpcap_stats_t *s, int reset)
+{
+	struct wifimon_rpcap_stats_t rs;
+	int state, ret;
+
+	ENTER_SYSCALL(state);
+
+	ret = ksceKernelLockMutex(kwifimon_mutex, 1, NULL);
+	if (ret >= 0) {
+		ret = writer_lock();
+		if (ret >= 0) {
+			rpcap_stats(&rs, reset);
+			writer_unlock();
+			rs.filtered = kwifimon_rpcap_filt_cnt;
+			if (reset) {
+				kwifimon_rpcap_filt_cnt = 0;
+			}
+		}
+		ksceKernelUnlockMutex(kwifimon_mutex, 1);
+	}
+	if (ret >= 0) {
+		ksceKernelMemcpyKernelToUser((uintptr_t)s, &rs, sizeof(struct wifimon_rpcap_stats_t));
+	}
+
+	EXIT_SYSCALL(state);
+
+	return ret;
+}
+
 int kwifimon_mac_control(struct wlan_dev_t *dev, uint16_t mode)
 {
 	struct wlan_cmd_t *cmd = wlan_cmd_alloc(dev, sizeof(struct wlan_mac_control_t));
@@ -212,16 +601,136 @@ int kwifimon_wlan_anycmd(struct wlan_dev_t *dev, int wlancmd, uint8_t *buf, uint
 	return ret;
 }
 
-// hooked wifi command response handler
-int kwifimon_process_respose(struct wlan_dev_t *dev, uint8_t *in_pkt, int in_pkt_len, uint32_t *somenumber)
+// fill radiotap header with known information
+void kwifimon_rtap_fill(struct rx_radiotap_hdr *radiotap, struct rxpd *rx_pd)
+{
+	memset(radiotap, 0, sizeof(struct rx_radiotap_hdr));
+
+	radiotap->hdr.it_len = sizeof(struct rx_radiotap_hdr);
+	radiotap->hdr.it_present = RX_RADIOTAP_PRESENT;
+
+	radiotap->ch_freq = kwifimon_channel_freq;
+	radiotap->ch_flags = (kwifimon_channel_band == WLAN_RADIO_TYPE_A)? IEEE80211_CHAN_5GHZ : IEEE80211_CHAN_2GHZ;
+	if (rx_pd->ht_info & 1) {
+		radiotap->mcs = rx_pd->rx_rate;
+		radiotap->mcs_known =  IEEE80211_RADIOTAP_MCS_HAVE_BW | IEEE80211_RADIOTAP_MCS_HAVE_MCS | IEEE80211_RADIOTAP_MCS_HAVE_GI;
+		radiotap->mcs_flags |= (rx_pd->ht_info & 2) ? IEEE80211_RADIOTAP_MCS_BW_40 : IEEE80211_RADIOTAP_MCS_BW_20;
+		radiotap->mcs_flags |= (rx_pd->ht_info & 4) ? IEEE80211_RADIOTAP_MCS_SGI : 0;
+	}
+
+	radiotap->rate = MIN(255, mwifiex_index_to_data_rate(rx_pd->rx_rate, rx_pd->ht_info));
+
+	radiotap->antsignal = MIN(127, rx_pd->snr + rx_pd->nf);
+	radiotap->antnoise = rx_pd->nf;
+}
+
+// radiotap timestamp field
+struct rtap_timestamp_t {
+	uint64_t ts;
+	uint16_t accuracy;
+	uint8_t unit_pos;
+	uint8_t flags;
+} __attribute__ ((packed));
+
+// queue frame with radiotap header for the writer thread, called with kwifimon_mutex held
+static inline __attribute__ ((always_inline)) void capture(struct rxpd *rx_pd, uint8_t *pkt, uint32_t pkt_len, const int lat)
+{
+	struct ring_rec_t *rec;
+	struct rx_radiotap_hdr *radiotap;
+	uint8_t rt_ext[64] __attribute__ ((aligned(8)));
+	uint32_t rt_len = sizeof(struct rx_radiotap_hdr);
+	struct timeval tv;
+
+	// extra fields are rare, the plain header is still filled in place
+	if (kwifimon_cap_cfg.flags & KWIFIMON_CAP_RT_TIMESTAMP) {
+		struct rx_radiotap_hdr rt;
+		struct rtap_timestamp_t ts;
+		int n;
+
+		ts.ts = ksceKernelGetSystemTimeWide();
+		ts.accuracy = 0;
+		ts.unit_pos = 0xf1;  // us, sampling position unknown
+		ts.flags = 0;
+
+		kwifimon_rtap_fill(&rt, rx_pd);
+		n = rtap_add(&kwifimon_rtap_cache, (uint8_t *)&rt, sizeof(rt), rt_ext, sizeof(rt_ext), IEEE80211_RADIOTAP_TIMESTAMP, &ts);
+		if (n > 0) {
+			rt_len = n;
+		}
+	}
+
+	rec = ring_reserve(&writer_ring, rt_len + pkt_len);
+	if (rec == NULL) {
+		kwifimon_stats.drop_cnt++;
+		return;
+	}
+
+	ksceKernelLibcGettimeofday(&tv, NULL);
+
+	rec->type = RING_REC_RT;
+	rec->flags = 0;
+	rec->rtap_len = rt_len;
+	rec->len = rt_len + pkt_len;
+	rec->ts_sec = tv.tv_sec;
+	rec->ts_usec = tv.tv_usec;
+
+	radiotap = (struct rx_radiotap_hdr *)ring_rec_data(rec);
+	if (rt_len == sizeof(struct rx_radiotap_hdr)) {
+		kwifimon_rtap_fill(radiotap, rx_pd);
+	} else {
+		memcpy(radiotap, rt_ext, rt_len);
+	}
+
+	memcpy((uint8_t *)radiotap + rt_len, pkt, pkt_len);
+
+	// filter sees the record as it goes out, only accept or reject, no snap length
+	if (kwifimon_filter_len) {
+		uint32_t t = LAT_STAMP(lat);
+		uint32_t keep = bpf_run(kwifimon_filter, (uint8_t *)radiotap, rec->len, rec->len);
+		LAT_STAGE(lat, LAT_STAGE_FILTER, t);
+
+		if (keep == 0) {
+			ring_cancel(&writer_ring);
+			kwifimon_stats.filt_cnt++;
+			return;
+		}
+	}
+
+	// what the rpcap client does not want is not queued for it, and not
+	// queued at all when no other output takes it
+	if (kwifimon_rpcap_filter_len && (kwifimon_state & STATE_REC_RPCAP)) {
+		uint32_t t = LAT_STAMP(lat);
+		uint32_t keep = bpf_run(kwifimon_rpcap_filter, (uint8_t *)radiotap, rec->len, rec->len);
+		LAT_STAGE(lat, LAT_STAGE_FILTER, t);
+
+		if (keep == 0) {
+			kwifimon_rpcap_filt_cnt++;
+			if (!(kwifimon_state & (STATE_REC_FILE | STATE_REC_NET))) {
+				ring_cancel(&writer_ring);
+				return;
+			}
+			rec->flags |= RING_REC_NO_RPCAP;
+		}
+	}
+
+	ring_commit(&writer_ring, rec);
+}
+
+// wifi command response handler body, "lat" is constant at both call sites
+static inline __attribute__ ((always_inline)) int process_respose(struct wlan_dev_t *dev, uint8_t *in_pkt, int in_pkt_len, uint32_t *somenumber, const int lat)
 {
 	struct sdio_rx_t *rxt = (struct sdio_rx_t *)in_pkt;
-/*
-	// we dont care about cmds
+	uint32_t t_hook = LAT_STAMP(lat);
+	uint32_t t;
+
+	// command response, only looked at for the trace
 	if (rxt->pkt_type == 1) {
-		return TAI_CONTINUE(int, ref_hooks[0], dev, pkt, pkt_len, somenumber);
+		if (__builtin_expect(cmdtrace_on, 0)) {
+			cmdtrace_resp(in_pkt + sizeof(struct sdio_rx_t), in_pkt_len - (int)sizeof(struct sdio_rx_t));
+		}
+		LAT_STAGE(lat, LAT_STAGE_HOOK, t_hook);
+		return TAI_CONTINUE(int, ref_hooks[1], dev, in_pkt, in_pkt_len, somenumber);
 	}
-*/
 
 	// event
 	if (rxt->pkt_type == 3) {
@@ -232,71 +741,56 @@ int kwifimon_process_respose(struct wlan_dev_t *dev, uint8_t *in_pkt, int in_pkt
 		evt = evt & 0xfff;
 
 		if (evt == 0x123) {
+			t = LAT_STAMP(lat);
 			int ret = ksceKernelLockMutex(kwifimon_mutex, 1, NULL);
 			if (ret >= 0) {
 				kwifimon_stats.evt_cnt++;
 				ksceKernelUnlockMutex(kwifimon_mutex, 1);
 			}
+			LAT_STAGE(lat, LAT_STAGE_STATS, t);
+			LAT_STAGE(lat, LAT_STAGE_HOOK, t_hook);
 			return 0;
 		}
 	}
 
 
-	// data or amsdu
-	if (rxt->pkt_type == 0 || rxt->pkt_type == 10) {
+	// data or amsdu, nothing of the rxpd is read unless all of it is there
+	if ((rxt->pkt_type == 0 || rxt->pkt_type == 10) && in_pkt_len >= (int)(sizeof(struct sdio_rx_t) + sizeof(struct rxpd))) {
 		struct rxpd *rx_pd = (void *)in_pkt + sizeof(struct sdio_rx_t);
 
 		uint8_t *pkt = (void *)rx_pd + rx_pd->rx_pkt_offset;
 		uint32_t pkt_len = rx_pd->rx_pkt_length;
+		// both are 16 bit, no wrap in int
+		int fits = (int)rx_pd->rx_pkt_offset + (int)pkt_len <= in_pkt_len - (int)sizeof(struct sdio_rx_t);
+		uint32_t *cnt;
+
+		t = LAT_STAMP(lat);
+		if (rx_pd->rx_pkt_type == PKT_TYPE_MGMT) {
+			cnt = &kwifimon_stats.mgmt_cnt;
+		} else if (rx_pd->rx_pkt_type == PKT_TYPE_AMSDU) {
+			cnt = &kwifimon_stats.amsdu_cnt;
+		} else if (rx_pd->rx_pkt_type == PKT_TYPE_BAR) {
+			cnt = &kwifimon_stats.bar_cnt;
+		} else {
+			cnt = &kwifimon_stats.pkt_cnt;
+		}
+		LAT_STAGE(lat, LAT_STAGE_CLASSIFY, t);
 
+		t = LAT_STAMP(lat);
 		int ret = ksceKernelLockMutex(kwifimon_mutex, 1, NULL);
 		if (ret >= 0) {
-/*	
-			if (kwifimon_state & (STATE_REC_FILE | STATE_REC_NET)) {
-				struct rx_radiotap_hdr radiotap;
-
-				// fill radiotap header with known information
-				memset(&radiotap, 0, sizeof(radiotap));
-
-				radiotap.hdr.it_len = sizeof(struct rx_radiotap_hdr);
-				radiotap.hdr.it_present = RX_RADIOTAP_PRESENT;
-
-				radiotap.ch_freq = kwifimon_channel_freq;
-				radiotap.ch_flags = (kwifimon_channel_band == WLAN_RADIO_TYPE_A)? IEEE80211_CHAN_5GHZ : IEEE80211_CHAN_2GHZ;
-				if (rx_pd->ht_info & 1) {
-					radiotap.mcs = rx_pd->rx_rate;
-					radiotap.mcs_known =  IEEE80211_RADIOTAP_MCS_HAVE_BW | IEEE80211_RADIOTAP_MCS_HAVE_MCS | IEEE80211_RADIOTAP_MCS_HAVE_GI;
-					radiotap.mcs_flags |= (rx_pd->ht_info & 2) ? IEEE80211_RADIOTAP_MCS_BW_40 : IEEE80211_RADIOTAP_MCS_BW_20;
-					radiotap.mcs_flags |= (rx_pd->ht_info & 4) ? IEEE80211_RADIOTAP_MCS_SGI : 0;
-				}
-
-				radiotap.rate = MIN(255, mwifiex_index_to_data_rate(rx_pd->rx_rate, rx_pd->ht_info));
-
-				radiotap.antsignal = MIN(127, rx_pd->snr + rx_pd->nf);
-				radiotap.antnoise = rx_pd->nf;
-
-				// write to file
-				if (kwifimon_state & STATE_REC_FILE) {
-	//				pcap_write_rt(&radiotap.hdr, pkt, pkt_len);
-				}
+			(*cnt)++;
+			if (fits) {
+				live_update(rx_pd, pkt, pkt_len);
+			}
+			LAT_STAGE(lat, LAT_STAGE_STATS, t);
 
-				if (kwifimon_state & STATE_REC_NET) {
-					knet_write_rt(&radiotap.hdr, pkt, pkt_len);
+			if (kwifimon_state & (STATE_REC_FILE | STATE_REC_NET | STATE_REC_RPCAP)) {
+				t = LAT_STAMP(lat);
+				if (fits) {
+					capture(rx_pd, pkt, pkt_len, lat);
 				}
-			}
-*/
-/*			if (kwifimon_state & STATE_REC_FILE) {
-				pcap_write_raw(in_pkt, in_pkt_len);
-			}*/
-
-			if (rx_pd->rx_pkt_type == PKT_TYPE_MGMT) {
-				kwifimon_stats.mgmt_cnt++;
-			} else if (rx_pd->rx_pkt_type == PKT_TYPE_AMSDU) {
-				kwifimon_stats.amsdu_cnt++;
-			} else if (rx_pd->rx_pkt_type == PKT_TYPE_BAR) {
-				kwifimon_stats.bar_cnt++;
-			} else {
-				kwifimon_stats.pkt_cnt++;
+				LAT_STAGE(lat, LAT_STAGE_COPY, t);
 			}
 
 			ksceKernelUnlockMutex(kwifimon_mutex, 1);
@@ -304,26 +798,167 @@ int kwifimon_process_respose(struct wlan_dev_t *dev, uint8_t *in_pkt, int in_pkt
 
 		if (rx_pd->rx_pkt_type == PKT_TYPE_MGMT) {
 			// dont pass mgmt frame, driver will ignore it, but there is allocation overhead
+			LAT_STAGE(lat, LAT_STAGE_HOOK, t_hook);
 			return 0;
 		}
 	}
 
+	LAT_STAGE(lat, LAT_STAGE_HOOK, t_hook);
+
 	return TAI_CONTINUE(int, ref_hooks[1], dev, in_pkt, in_pkt_len, somenumber);
 }
 
-// hooked ioctl function
-int kwifimon_ioctl(struct netdev_t *netdev, unsigned int req, uint8_t *buf, int buf_len)
+// hooked wifi command response handler
+int kwifimon_process_respose(struct wlan_dev_t *dev, uint8_t *in_pkt, int in_pkt_len, uint32_t *somenumber)
 {
-	int ret = -1;
-/*	if (ref_hooks[2]) {
-		ret = TAI_CONTINUE(int, ref_hooks[2], netdev, req, buf, buf_len);
-	}*/
+	// only cost of disabled instrumentation is this branch
+	if (__builtin_expect(kwifimon_lat_on, 0)) {
+		return process_respose(dev, in_pkt, in_pkt_len, somenumber, 1);
+	}
 
-	ret = TAI_CONTINUE(int, ref_hooks[2], netdev, req, buf, buf_len);
-	
+	return process_respose(dev, in_pkt, in_pkt_len, somenumber, 0);
+}
+
+// hooked command send, every command the driver or kwifimon_wlan_anycmd
+// hands to the firmware goes through it
+int kwifimon_cmd_send2(struct wlan_dev_t *dev, struct wlan_cmd_t *cmd, uint16_t cmdid, int cmd_len)
+{
+	if (__builtin_expect(cmdtrace_on, 0)) {
+		cmdtrace_cmd(cmdid, cmd->out_data, cmd_len);
+	}
+
+	return TAI_CONTINUE(int, ref_hooks[3], dev, cmd, cmdid, cmd_len);
+}
+
+// WLAN_IOCTL_MEM_DELTA, each page is read into the next free data slot and
+// stays there only when its hash moved
+static int mem_delta(struct wlan_dev_t *dev, uint8_t *buf, int buf_len)
+{
+	struct wifimon_mem_delta_t d;
+	uint8_t *hash = buf + sizeof(d);
+	uint8_t *data;
+	uint32_t i, j, h, old, value;
+	int ret = 0;
+
+	memcpy(&d, buf, sizeof(d));
+	if (d.pages == 0 || d.pages > WIFIMON_MEM_DELTA_PAGES || d.page_words == 0 ||
+	    d.page_words > WIFIMON_MEM_BULK_MAX || d.pages * d.page_words > WIFIMON_MEM_BULK_MAX ||
+	    buf_len < (int)(sizeof(d) + 4 * d.pages + 4 * d.pages * d.page_words)) {
+		return -1;
+	}
+
+	memset(d.changed, 0, sizeof(d.changed));
+	data = hash + 4 * d.pages;
+
+	for (i = 0; i < d.pages; i++) {
+		h = 0;
+		for (j = 0; j < d.page_words; j++) {
+			ret = wlan_mem_read(dev, d.addr + 4 * (i * d.page_words + j), &value);
+			if (ret < 0) {
+				break;
+			}
+			memcpy(&data[4 * j], &value, 4);
+			h = fwsnap_hash(h, value);
+		}
+		if (ret < 0) {
+			break;
+		}
+		h = fwsnap_hash_end(h, d.page_words);
+		memcpy(&old, &hash[4 * i], 4);
+		if (h != old || (d.flags & WIFIMON_MEM_DELTA_FULL)) {
+			d.changed[i / 32] |= 1u << (i % 32);
+			data += 4 * d.page_words;
+		}
+		memcpy(&hash[4 * i], &h, 4);
+	}
+
+	memcpy(buf, &d, sizeof(d));
+
+	// a partial read still reports the pages that made it
+	return (i > 0) ? (int)i : ret;
+}
+
+static int mem_patch_word(struct wlan_dev_t *dev, uint32_t addr, uint32_t value)
+{
+	uint32_t in;
+
+	if (wlan_mem_write(dev, addr, value) < 0 || wlan_mem_read(dev, addr, &in) < 0) {
+		return -1;
+	}
+
+	return (in == value) ? 0 : -1;
+}
+
+// WLAN_IOCTL_MEM_PATCH, nothing else talks to the card while it runs
+static int mem_patch(struct wlan_dev_t *dev, uint8_t *buf, int buf_len)
+{
+	struct wifimon_mem_patch_t p;
+	struct wifimon_mem_patch_ent_t e;
+	uint8_t *ents = buf + sizeof(p);
+	uint32_t i, value;
+	int ret = 0;
+
+	memcpy(&p, buf, sizeof(p));
+	if (p.words > WIFIMON_MEM_PATCH_MAX || buf_len < (int)(sizeof(p) + p.words * sizeof(e))) {
+		return -1;
+	}
+
+	p.failed = p.words;
+	p.restored = 0;
+
+	for (i = 0; i < p.words; i++) {
+		memcpy(&e, ents + i * sizeof(e), sizeof(e));
+		if (wlan_mem_read(dev, e.addr, &value) < 0) {
+			ret = -2;
+			break;
+		}
+		if (value != e.expect) {
+			ret = -3;
+			break;
+		}
+	}
+
+	for (i = (ret < 0) ? i : 0; ret == 0 && i < p.words; i++) {
+		memcpy(&e, ents + i * sizeof(e), sizeof(e));
+		if (mem_patch_word(dev, e.addr, e.value) < 0) {
+			ret = -4;
+			break;
+		}
+	}
+
+	if (ret == -4) {
+		// the failed word may have changed as well, newest first
+		for (uint32_t j = i + 1; j-- > 0; ) {
+			memcpy(&e, ents + j * sizeof(e), sizeof(e));
+			if (mem_patch_word(dev, e.addr, e.expect) < 0) {
+				ret = -5;
+				continue;
+			}
+			p.restored++;
+		}
+	}
+
+	if (ret < 0) {
+		p.failed = i;
+	}
+	memcpy(buf, &p, sizeof(p));
+
+	return (ret < 0) ? ret : (int)p.words;
+}
+
+// the lock is at 0x718 in the firmware's struct, word aligned however the
+// header packs it
+static inline struct wlan_lock_t *dev_lock(struct wlan_dev_t *dev)
+{
+	return (struct wlan_lock_t *)((uint8_t *)dev + offsetof(struct wlan_dev_t, wlan_lock));
+}
+
+// our part of the ioctl hook, ret is result of the original handler
+static int ioctl_do(struct netdev_t *netdev, unsigned int req, uint8_t *buf, int buf_len, int ret)
+{
 	struct wlan_dev_t *dev = netdev->priv;
 
-	int lockret = wlan_lock(&dev->wlan_lock);
+	int lockret = wlan_lock(dev_lock(dev));
 	if (lockret >= 0) {
 		if (req == WLAN_IOCTL_GET_MAC_CONTROL) {
 			if (buf_len >= 2) {
@@ -362,26 +997,83 @@ int kwifimon_ioctl(struct netdev_t *netdev, unsigned int req, uint8_t *buf, int
 				}
 				memcpy(&buf[5], &value, 4);
 			}
+		} else if (req == WLAN_IOCTL_MEM_PATCH) {
+			if (buf_len >= (int)sizeof(struct wifimon_mem_patch_t)) {
+				ret = mem_patch(dev, buf, buf_len);
+			}
+		} else if (req == WLAN_IOCTL_MEM_DELTA) {
+			if (buf_len >= (int)sizeof(struct wifimon_mem_delta_t)) {
+				ret = mem_delta(dev, buf, buf_len);
+			}
+		} else if (req == WLAN_IOCTL_MEM_BULK) {
+			struct wifimon_mem_bulk_t b;
+			uint32_t i, value;
+			if (buf_len >= (int)sizeof(b)) {
+				memcpy(&b, buf, sizeof(b));
+				if (b.words <= WIFIMON_MEM_BULK_MAX && buf_len >= (int)(sizeof(b) + 4 * b.words)) {
+					for (i = 0; i < b.words; i++) {
+						ret = wlan_mem_read(dev, b.addr + 4 * i, &value);
+						if (ret < 0) {
+							break;
+						}
+						memcpy(&buf[sizeof(b) + 4 * i], &value, 4);
+					}
+					// a partial read still reports what made it
+					if (i > 0 || b.words == 0) {
+						ret = i;
+					}
+				}
+			}
 		}/* else if (req == WLAN_IOCTL_INIT) {
 			ret = wlan_do_init(dev);
 		}*/
 
-		wlan_unlock(&dev->wlan_lock);
+		wlan_unlock(dev_lock(dev));
 	}
 
 	return ret;
 }
 
+// hooked ioctl function
+int kwifimon_ioctl(struct netdev_t *netdev, unsigned int req, uint8_t *buf, int buf_len)
+{
+	int ret = -1;
+/*	if (ref_hooks[2]) {
+		ret = TAI_CONTINUE(int, ref_hooks[2], netdev, req, buf, buf_len);
+	}*/
+
+	ret = TAI_CONTINUE(int, ref_hooks[2], netdev, req, buf, buf_len);
+
+	if (__builtin_expect(kwifimon_lat_on, 0)) {
+		uint32_t t = LAT_NOW();
+		ret = ioctl_do(netdev, req, buf, buf_len, ret);
+		lat_add(&kwifimon_lat.stage[LAT_STAGE_IOCTL], LAT_NOW() - t);
+		return ret;
+	}
+
+	return ioctl_do(netdev, req, buf, buf_len, ret);
+}
+
 void _start() __attribute__ ((weak, alias ("module_start")));
 int module_start(SceSize argc, const void *args)
 {
 	kwifimon_mutex = ksceKernelCreateMutex("kwifimon_mutex", 0, 0, NULL);
 
+	// host build has 64bit pointers, layout only matters on target
+#ifndef KWIFIMON_HOST
 	STATIC_ASSERT((sizeof(struct netdev_t) == 0xb0), "Bad size of struct netdev_t!")
 //	STATIC_ASSERT((sizeof(struct netdev_2_t) == 0x360), "Bad size of struct netdev_2_t!")
 //	STATIC_ASSERT((sizeof(struct netdev_3_t) == 0x1f8), "Bad size of struct netdev_3_t!")
 	STATIC_ASSERT((sizeof(struct wlan_dev_t) == 0x1e30), "Bad size of struct wlan_dev_t!")
 	STATIC_ASSERT((offsetof(struct wlan_dev_t, wlan_lock) == 0x718), "Bad wlan_lock offset!")
+#endif
+
+	live_init();
+
+	if (writer_start() < 0) {
+		kwifimon_state = STATE_ERROR_1;
+		return SCE_KERNEL_START_SUCCESS;
+	}
 
 	tai_module_info_t tai_info;
 	
@@ -393,21 +1085,28 @@ int module_start(SceSize argc, const void *args)
 		return SCE_KERNEL_START_SUCCESS;
 	}
 
-	module_get_offset(KERNEL_PID, tai_info.modid, 0, 0x2954 | 1, (uintptr_t *)&wlan_cmd_alloc);
-	module_get_offset(KERNEL_PID, tai_info.modid, 0, 0x2A18 | 1, (uintptr_t *)&wlan_cmd_free);
-	module_get_offset(KERNEL_PID, tai_info.modid, 0, 0x2F44 | 1, (uintptr_t *)&wlan_cmd_send1);
-	module_get_offset(KERNEL_PID, tai_info.modid, 0, 0x2DB4 | 1, (uintptr_t *)&wlan_cmd_send2);
-	module_get_offset(KERNEL_PID, tai_info.modid, 0, 0x2E7C | 1, (uintptr_t *)&wlan_cmd_wait);
-	module_get_offset(KERNEL_PID, tai_info.modid, 0, 0x0E50 | 1, (uintptr_t *)&wlan_lock);
-	module_get_offset(KERNEL_PID, tai_info.modid, 0, 0x0E70 | 1, (uintptr_t *)&wlan_unlock);
+	// a function that moved is not called or hooked at where it was
+	if (sigs_resolve(tai_info.modid, tai_info.module_nid) < 0) {
+		kwifimon_state = STATE_ERROR;
+		return SCE_KERNEL_START_SUCCESS;
+	}
+
+	module_get_offset(KERNEL_PID, tai_info.modid, 0, sigs[SIG_CMD_ALLOC].offset | 1, (uintptr_t *)&wlan_cmd_alloc);
+	module_get_offset(KERNEL_PID, tai_info.modid, 0, sigs[SIG_CMD_FREE].offset | 1, (uintptr_t *)&wlan_cmd_free);
+	module_get_offset(KERNEL_PID, tai_info.modid, 0, sigs[SIG_CMD_SEND1].offset | 1, (uintptr_t *)&wlan_cmd_send1);
+	module_get_offset(KERNEL_PID, tai_info.modid, 0, sigs[SIG_CMD_SEND2].offset | 1, (uintptr_t *)&wlan_cmd_send2);
+	module_get_offset(KERNEL_PID, tai_info.modid, 0, sigs[SIG_CMD_WAIT].offset | 1, (uintptr_t *)&wlan_cmd_wait);
+	module_get_offset(KERNEL_PID, tai_info.modid, 0, sigs[SIG_LOCK].offset | 1, (uintptr_t *)&wlan_lock);
+	module_get_offset(KERNEL_PID, tai_info.modid, 0, sigs[SIG_UNLOCK].offset | 1, (uintptr_t *)&wlan_unlock);
 /*
 	module_get_offset(KERNEL_PID, tai_info.modid, 0, 0xADD8 | 1, (uintptr_t *)&wlan_do_init);
 */
-	module_get_offset(KERNEL_PID, tai_info.modid, 0, 0x4568 | 1, (uintptr_t *)&wlan_mem_read);
-	module_get_offset(KERNEL_PID, tai_info.modid, 0, 0x45E8 | 1, (uintptr_t *)&wlan_mem_write);
+	module_get_offset(KERNEL_PID, tai_info.modid, 0, sigs[SIG_MEM_READ].offset | 1, (uintptr_t *)&wlan_mem_read);
+	module_get_offset(KERNEL_PID, tai_info.modid, 0, sigs[SIG_MEM_WRITE].offset | 1, (uintptr_t *)&wlan_mem_write);
 
-	hooks_uid[1] = taiHookFunctionOffsetForKernel(KERNEL_PID, &ref_hooks[1], tai_info.modid, 0, 0x1cd4, 1, kwifimon_process_respose);
-	hooks_uid[2] = taiHookFunctionOffsetForKernel(KERNEL_PID, &ref_hooks[2], tai_info.modid, 0, 0x73f0, 1, kwifimon_ioctl);
+	hooks_uid[1] = taiHookFunctionOffsetForKernel(KERNEL_PID, &ref_hooks[1], tai_info.modid, 0, sigs[SIG_RX_HANDLER].offset, 1, kwifimon_process_respose);
+	hooks_uid[2] = taiHookFunctionOffsetForKernel(KERNEL_PID, &ref_hooks[2], tai_info.modid, 0, sigs[SIG_IOCTL].offset, 1, kwifimon_ioctl);
+	hooks_uid[3] = taiHookFunctionOffsetForKernel(KERNEL_PID, &ref_hooks[3], tai_info.modid, 0, sigs[SIG_CMD_SEND2].offset, 1, kwifimon_cmd_send2);
 
 	return SCE_KERNEL_START_SUCCESS;
 }
@@ -416,10 +1115,6 @@ int module_stop(SceSize argc, const void *args)
 {
 	int i;
 
-	pcap_close();
-	knet_stop();
-	kwifimon_state = 0;
-
 	i = HOOKS_NUMBER;
 	while (i--) {
 		if (uids[i]) taiInjectReleaseForKernel(uids[i]);
@@ -430,6 +1125,14 @@ int module_stop(SceSize argc, const void *args)
 		if (hooks_uid[i]) taiHookReleaseForKernel(hooks_uid[i], ref_hooks[i]);
 	}
 
+	rpcap_stop();
+
+	// hooks are gone, writer drains what is left before files close
+	writer_stop();
+	pcap_close();
+	knet_stop();
+	kwifimon_state = 0;
+
 	ksceKernelDeleteMutex(kwifimon_mutex);
 
 	return SCE_KERNEL_STOP_SUCCESS;
@@ -96,4 +96,17 @@ struct rxpd {
 	uint8_t flags;
 } PACK;
 
+extern uint32_t kwifimon_channel_freq;
+extern uint32_t kwifimon_channel_band;
+
+struct rx_radiotap_hdr;
+
+void kwifimon_rtap_fill(struct rx_radiotap_hdr *radiotap, struct rxpd *rx_pd);
+
+struct bpf_insn_t;
+
+// for kernel side users like the rpcap server, take kwifimon_mutex
+void kwifimon_state_set(uint32_t bits, int on);
+int kwifimon_rpcap_filter_set(const struct bpf_insn_t *prog, uint32_t len);
+
 #endif
@@ -0,0 +1,399 @@
+#include <vitasdkkern.h>
+#include <string.h>
+
+#include "kwifimon.h"
+#include "dot11.h"
+#include "airtime.h"
+#include "live.h"
+
+#define NIL 0xffff
+
+// slot holds pool index + 1 and the low hash bits, those give the home slot too
+struct live_slot_t {
+	uint16_t idx;
+	uint16_t tag;
+};
+
+struct live_tab_t {
+	struct live_slot_t *slot;
+	uint32_t mask;
+	uint8_t *pool;           // entries start with their 6 byte key
+	uint32_t stride;
+	uint16_t *prev;
+	uint16_t *next;
+	uint16_t head;           // most recently seen
+	uint16_t tail;
+	uint32_t used;
+	uint32_t max;
+	uint32_t evicted;
+};
+
+static struct live_slot_t live_bss_slot[LIVE_BSS_SLOTS];
+static struct wifimon_bss_t live_bss[KWIFIMON_LIVE_BSS_MAX];
+static uint16_t live_bss_prev[KWIFIMON_LIVE_BSS_MAX];
+static uint16_t live_bss_next[KWIFIMON_LIVE_BSS_MAX];
+
+static struct live_slot_t live_sta_slot[LIVE_STA_SLOTS];
+static struct wifimon_sta_t live_sta[KWIFIMON_LIVE_STA_MAX];
+static uint16_t live_sta_prev[KWIFIMON_LIVE_STA_MAX];
+static uint16_t live_sta_next[KWIFIMON_LIVE_STA_MAX];
+
+static struct live_tab_t live_bss_tab = {
+	live_bss_slot, LIVE_BSS_SLOTS - 1, (uint8_t *)live_bss, sizeof(struct wifimon_bss_t),
+	live_bss_prev, live_bss_next, NIL, NIL, 0, KWIFIMON_LIVE_BSS_MAX, 0
+};
+
+static struct live_tab_t live_sta_tab = {
+	live_sta_slot, LIVE_STA_SLOTS - 1, (uint8_t *)live_sta, sizeof(struct wifimon_sta_t),
+	live_sta_prev, live_sta_next, NIL, NIL, 0, KWIFIMON_LIVE_STA_MAX, 0
+};
+
+// channel airtime, utilization is taken between snapshots
+static uint64_t live_air_us;
+static uint64_t live_snap_air;
+static uint32_t live_snap_time;
+static uint32_t live_air_unknown;
+
+// a-mpdu being received, see live_airtime
+static struct airtime_ampdu_t live_ampdu;
+static uint8_t live_ampdu_ta[6];
+static uint16_t live_ampdu_seq;
+
+// bss of the last frame, frames come in runs, checked by its key since the
+// entry may have been reused
+static struct wifimon_bss_t *live_bss_last;
+
+static inline uint32_t live_hash(const uint8_t *a)
+{
+	uint32_t h = 0x811c9dc5;
+	int i;
+
+	for (i = 0; i < 6; i++) {
+		h = (h ^ a[i]) * 0x01000193;
+	}
+
+	return h ^ (h >> 16);
+}
+
+static inline uint8_t *live_key(struct live_tab_t *t, uint32_t idx)
+{
+	return t->pool + idx * t->stride;
+}
+
+static void live_tab_reset(struct live_tab_t *t)
+{
+	memset(t->slot, 0, (t->mask + 1) * sizeof(struct live_slot_t));
+	memset(t->pool, 0, t->max * t->stride);
+	t->head = NIL;
+	t->tail = NIL;
+	t->used = 0;
+	t->evicted = 0;
+}
+
+static inline void live_unlink(struct live_tab_t *t, uint16_t i)
+{
+	if (t->prev[i] != NIL) {
+		t->next[t->prev[i]] = t->next[i];
+	} else {
+		t->head = t->next[i];
+	}
+
+	if (t->next[i] != NIL) {
+		t->prev[t->next[i]] = t->prev[i];
+	} else {
+		t->tail = t->prev[i];
+	}
+}
+
+static inline void live_push(struct live_tab_t *t, uint16_t i)
+{
+	t->prev[i] = NIL;
+	t->next[i] = t->head;
+
+	if (t->head != NIL) {
+		t->prev[t->head] = i;
+	} else {
+		t->tail = i;
+	}
+	t->head = i;
+}
+
+// backward shift delete keeps probe sequences intact without tombstones
+static void live_slot_del(struct live_tab_t *t, uint32_t i)
+{
+	uint32_t j = i;
+
+	while (1) {
+		j = (j + 1) & t->mask;
+		if (t->slot[j].idx == 0) {
+			break;
+		}
+
+		uint32_t k = t->slot[j].tag & t->mask;
+
+		// entry at j is fine where it is if its home lies in (i, j]
+		if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j)) {
+			continue;
+		}
+
+		t->slot[i] = t->slot[j];
+		i = j;
+	}
+
+	t->slot[i].idx = 0;
+}
+
+// lookup only, the lru order stays
+static uint8_t *live_find(struct live_tab_t *t, const uint8_t *key)
+{
+	uint32_t h = live_hash(key);
+	uint16_t tag = h;
+	uint32_t i;
+
+	for (i = h & t->mask; t->slot[i].idx; i = (i + 1) & t->mask) {
+		uint16_t idx = t->slot[i].idx - 1;
+
+		if (t->slot[i].tag == tag && memcmp(live_key(t, idx), key, 6) == 0) {
+			return live_key(t, idx);
+		}
+	}
+
+	return NULL;
+}
+
+// find or add the entry for key and make it the most recent one
+static uint8_t *live_get(struct live_tab_t *t, const uint8_t *key, int *created)
+{
+	uint32_t h = live_hash(key);
+	uint16_t tag = h;
+	uint32_t i = h & t->mask;
+	uint16_t idx;
+
+	for (; t->slot[i].idx; i = (i + 1) & t->mask) {
+		idx = t->slot[i].idx - 1;
+		if (t->slot[i].tag == tag && memcmp(live_key(t, idx), key, 6) == 0) {
+			if (t->head != idx) {
+				live_unlink(t, idx);
+				live_push(t, idx);
+			}
+			*created = 0;
+			return live_key(t, idx);
+		}
+	}
+
+	if (t->used < t->max) {
+		idx = t->used++;
+	} else {
+		// reuse the least recently seen entry
+		uint8_t *old;
+		uint32_t j;
+
+		idx = t->tail;
+		old = live_key(t, idx);
+		for (j = live_hash(old) & t->mask; t->slot[j].idx != idx + 1; j = (j + 1) & t->mask);
+		live_slot_del(t, j);
+		live_unlink(t, idx);
+		t->evicted++;
+
+		// deletion may have moved entries into our probe sequence
+		for (i = h & t->mask; t->slot[i].idx; i = (i + 1) & t->mask);
+	}
+
+	t->slot[i].idx = idx + 1;
+	t->slot[i].tag = tag;
+	live_push(t, idx);
+
+	uint8_t *e = live_key(t, idx);
+	memset(e, 0, t->stride);
+	memcpy(e, key, 6);
+	*created = 1;
+
+	return e;
+}
+
+static uint32_t live_fnv(const uint8_t *p, uint32_t len)
+{
+	uint32_t h = 0x811c9dc5;
+
+	while (len--) {
+		h = (h ^ *p++) * 0x01000193;
+	}
+
+	return h;
+}
+
+enum { IE_SSID, IE_DS_PARAMS, IE_NUM };
+
+static const uint64_t live_ie_want[IE_NUM] = { DOT11_IE_SSID, DOT11_IE_DS_PARAMS };
+static struct dot11_ie_set_t live_ie_set;
+
+static void live_bss_update(struct rxpd *rx_pd, const struct dot11_hdr_t *h, uint32_t air)
+{
+	struct dot11_ie_t ie[IE_NUM];
+	struct wifimon_bss_t *b;
+	const uint8_t *ies;
+	uint32_t ies_len;
+	int created, ch;
+
+	// timestamp, beacon interval, capabilities ahead of the elements
+	if (dot11_mgmt_ies(h, &ies, &ies_len) < 0) {
+		return;
+	}
+
+	b = (void *)live_get(&live_bss_tab, h->bssid, &created);
+	b->beacons++;
+	b->air_us += air;
+	b->last_seen = ksceKernelGetSystemTimeLow();
+	int rssi = rx_pd->snr + rx_pd->nf;
+	b->rssi = (rssi < -128) ? -128 : (rssi > 127) ? 127 : rssi;
+	b->beacon_int = h->body[8] | (h->body[9] << 8);
+
+	// a truncated tail still leaves the elements before it
+	dot11_ie_parse(&live_ie_set, ies, ies_len, ie);
+	if (ie[IE_SSID].p) {
+		b->ssid_len = ie[IE_SSID].len;
+		b->ssid_hash = live_fnv(ie[IE_SSID].p, ie[IE_SSID].len);
+	}
+	if ((ch = dot11_ie_ds_channel(&ie[IE_DS_PARAMS])) >= 0) {
+		b->channel = ch;
+	}
+}
+
+static void live_sta_update(struct rxpd *rx_pd, const uint8_t *ta, const uint8_t *bssid, uint32_t len, uint32_t air)
+{
+	struct wifimon_sta_t *s;
+	int created;
+
+	s = (void *)live_get(&live_sta_tab, ta, &created);
+	if (created) {
+		s->snr_avg = rx_pd->snr * 16;
+		s->nf_avg = rx_pd->nf * 16;
+	} else {
+		s->snr_avg += (rx_pd->snr * 16 - s->snr_avg) >> LIVE_EWMA_SHIFT;
+		s->nf_avg += (rx_pd->nf * 16 - s->nf_avg) >> LIVE_EWMA_SHIFT;
+	}
+
+	s->frames++;
+	s->bytes += len;
+	s->air_us += air;
+	s->last_seen = ksceKernelGetSystemTimeLow();
+
+	// probe requests and the like carry the broadcast bssid
+	if (bssid && !(bssid[0] & 1)) {
+		memcpy(s->bssid, bssid, 6);
+	}
+}
+
+void live_init(void)
+{
+	airtime_init();
+	dot11_ie_set_init(&live_ie_set, live_ie_want, IE_NUM);
+	live_tab_reset(&live_bss_tab);
+	live_tab_reset(&live_sta_tab);
+
+	live_air_us = 0;
+	live_snap_air = 0;
+	live_snap_time = ksceKernelGetSystemTimeLow();
+	live_air_unknown = 0;
+	airtime_ampdu_end(&live_ampdu);
+	live_bss_last = NULL;
+}
+
+// on air time of a frame, the rxpd has no fcs and no a-mpdu boundaries
+// qos data from one transmitter at one ht rate with consecutive sequence
+// numbers is taken as one a-mpdu, any other frame in between, its block ack
+// usually, ends it
+static uint32_t live_airtime(struct rxpd *rx_pd, const struct dot11_hdr_t *h, uint32_t len)
+{
+	uint32_t rate = airtime_rxpd(rx_pd->rx_rate, rx_pd->ht_info);
+	uint32_t flags = (kwifimon_channel_band == WLAN_RADIO_TYPE_A) ? 0 : AIRTIME_F_2GHZ;
+	uint32_t air;
+
+	if (rate == AIRTIME_NONE) {
+		live_air_unknown++;
+		airtime_ampdu_end(&live_ampdu);
+		return 0;
+	}
+
+	if (h && (h->flags & DOT11_HDR_QOS) && (rx_pd->ht_info & 1) && DOT11_FC_TYPE(h->fc) == DOT11_TYPE_DATA) {
+		uint16_t seq = h->seq_ctl >> 4;
+
+		if (live_ampdu.rate != rate || ((live_ampdu_seq + 1) & 0xfff) != seq || memcmp(live_ampdu_ta, h->ta, 6) != 0) {
+			airtime_ampdu_end(&live_ampdu);
+			memcpy(live_ampdu_ta, h->ta, 6);
+		}
+		live_ampdu_seq = seq;
+		air = airtime_ampdu(&live_ampdu, 0, rate, len + 4, flags);
+	} else {
+		airtime_ampdu_end(&live_ampdu);
+		air = airtime_us(rate, len + 4, flags);
+	}
+
+	live_air_us += air;
+
+	return air;
+}
+
+void live_update(struct rxpd *rx_pd, const uint8_t *pkt, uint32_t len)
+{
+	struct dot11_hdr_t h;
+	uint32_t air;
+
+	if (dot11_hdr_parse(pkt, len, &h) < 0) {
+		live_airtime(rx_pd, NULL, len);
+		return;
+	}
+
+	air = live_airtime(rx_pd, &h, len);
+
+	if (DOT11_FC_TYPE(h.fc) == DOT11_TYPE_MGMT &&
+		(DOT11_FC_SUBTYPE(h.fc) == DOT11_BEACON || DOT11_FC_SUBTYPE(h.fc) == DOT11_PROBE_RESP)) {
+		live_bss_update(rx_pd, &h, air);
+		return;
+	}
+
+	// bss airtime only for ones already known from a beacon
+	if (h.bssid && !(h.bssid[0] & 1)) {
+		struct wifimon_bss_t *b = live_bss_last;
+
+		if (b == NULL || memcmp(b->bssid, h.bssid, 6) != 0) {
+			b = (void *)live_find(&live_bss_tab, h.bssid);
+		}
+		if (b) {
+			b->air_us += air;
+			live_bss_last = b;
+		}
+	}
+
+	// stations only, frames sent by an ap are left out
+	if (h.ta == NULL || (h.ta[0] & 1) || (h.bssid && memcmp(h.ta, h.bssid, 6) == 0)) {
+		return;
+	}
+
+	live_sta_update(rx_pd, h.ta, h.bssid, len, air);
+}
+
+void live_snapshot(struct wifimon_live_t *l, uint32_t now)
+{
+	uint16_t i;
+
+	l->now = now;
+	l->nbss = 0;
+	l->nsta = 0;
+	l->bss_evicted = live_bss_tab.evicted;
+	l->sta_evicted = live_sta_tab.evicted;
+	l->window_us = now - live_snap_time;
+	l->busy_us = live_air_us - live_snap_air;
+	l->air_unknown = live_air_unknown;
+	l->air_us = live_air_us;
+	live_snap_time = now;
+	live_snap_air = live_air_us;
+
+	for (i = live_bss_tab.head; i != NIL; i = live_bss_next[i]) {
+		l->bss[l->nbss++] = live_bss[i];
+	}
+
+	for (i = live_sta_tab.head; i != NIL; i = live_sta_next[i]) {
+		l->sta[l->nsta++] = live_sta[i];
+	}
+}
@@ -0,0 +1,26 @@
+#ifndef LIVE_h_
+#define LIVE_h_
+
+#include <stdint.h>
+
+#include "kwifimon_export.h"
+
+// per bss and per station tables and channel airtime, updated by the hook
+// with kwifimon_mutex held
+// entries live in fixed pools, an open addressing table of pool indices
+// finds them, a list through the pool keeps them in lru order
+
+#define LIVE_BSS_SLOTS  (2 * KWIFIMON_LIVE_BSS_MAX)
+#define LIVE_STA_SLOTS  (2 * KWIFIMON_LIVE_STA_MAX)
+
+#define LIVE_EWMA_SHIFT 3    // weight of a new sample is 1/8
+
+struct rxpd;
+
+void live_init(void);
+// the clock is only read for frames that touch a table
+void live_update(struct rxpd *rx_pd, const uint8_t *pkt, uint32_t len);
+// compacted into l, most recently seen first
+void live_snapshot(struct wifimon_live_t *l, uint32_t now);
+
+#endif
@@ -185,7 +185,7 @@ uint16_t mwifiex_index_to_data_rate(uint8_t index, uint8_t ht_info)
 		} else
 			rate = mwifiex_data_rates[0];
 	} else {
-		if (index >= sizeof(mwifiex_data_rates))
+		if (index >= sizeof(mwifiex_data_rates) / sizeof(mwifiex_data_rates[0]))
 			index = 0;
 		rate = mwifiex_data_rates[index];
 	}
@@ -1,14 +1,158 @@
 #include <vitasdkkern.h>
 #include <sys/time.h>
+#include <string.h>
 
+#include "kwifimon_export.h"
 #include "pcap.h"
+#include "kcap.h"
+#include "lz4blk.h"
+#include "kidx.h"
 
 SceUID pcap_fd = -1;
 
-int ksceKernelLibcGettimeofday(struct timeval *ptimeval, void *ptimezone);
+// records are staged here and written in whole-record batches
+static uint8_t pcap_buf[PCAP_BUF_SIZE];
+static uint32_t pcap_buf_len = 0;
 
-int pcap_open(char *file)
+// kcap output, one block per staged batch
+static uint32_t pcap_flags = 0;
+static uint32_t pcap_nrec = 0;
+static uint32_t pcap_ts_sec, pcap_ts_usec;
+static int pcap_busy = 0;
+static uint32_t pcap_poor = 0;
+static uint8_t pcap_blk[sizeof(struct kcap_blk_t) + LZ4BLK_BOUND(PCAP_BUF_SIZE)];
+static uint16_t pcap_tab[LZ4BLK_HASH_SIZE];
+static struct wifimon_cap_stats_t pcap_stats;
+static uint64_t pcap_pos = 0;      // file offset of the next batch
+static uint64_t pcap_rec_total = 0;
+
+// periodic sync, 0 writes every drained batch and leaves syncing to close
+static uint32_t pcap_sync_us = 0;
+static uint32_t pcap_sync_last;
+static uint64_t pcap_sync_pos;
+static uint64_t pcap_ts_min, pcap_ts_max;
+
+// index sidecar, entries are buffered and written a few at a time
+static SceUID pcap_idx_fd = -1;
+static struct kidx_ent_t pcap_ent;
+static struct kidx_ent_t pcap_idx_buf[PCAP_IDX_BUF];
+static uint32_t pcap_idx_len = 0;
+
+static int pcap_out(void *buf, uint32_t len)
+{
+	int ret = ksceIoWrite(pcap_fd, buf, len);
+
+	if (ret < 0) {
+		ksceIoClose(pcap_fd);
+		pcap_fd = -1;
+		return -1;
+	}
+
+	pcap_stats.file_bytes += len;
+	pcap_pos += len;
+
+	return 0;
+}
+
+// a failing index is dropped, the capture goes on without it
+static void pcap_idx_flush(void)
+{
+	if (pcap_idx_fd < 0 || pcap_idx_len == 0) {
+		return;
+	}
+
+	uint32_t len = pcap_idx_len * sizeof(struct kidx_ent_t);
+
+	if (ksceIoWrite(pcap_idx_fd, pcap_idx_buf, len) < 0) {
+		ksceIoClose(pcap_idx_fd);
+		pcap_idx_fd = -1;
+	} else {
+		pcap_stats.idx_bytes += len;
+	}
+
+	pcap_idx_len = 0;
+}
+
+static void pcap_idx_add(uint64_t off, uint32_t len)
+{
+	struct kidx_ent_t *e = &pcap_idx_buf[pcap_idx_len];
+
+	pcap_ent.off = off;
+	pcap_ent.len = len;
+	pcap_ent.rec_total = pcap_rec_total;
+	kidx_ent_seal(&pcap_ent);
+
+	if (pcap_ent.ts_min < pcap_ts_min) {
+		pcap_ts_min = pcap_ent.ts_min;
+	}
+	if (pcap_ent.ts_max > pcap_ts_max) {
+		pcap_ts_max = pcap_ent.ts_max;
+	}
+
+	memcpy(e, &pcap_ent, sizeof(*e));
+	pcap_stats.idx_entries++;
+
+	if (++pcap_idx_len == PCAP_IDX_BUF) {
+		pcap_idx_flush();
+	}
+}
+
+// capture is durable up to pcap_pos, recovery starts from the last of these
+static void pcap_checkpoint(void)
 {
+	struct kidx_ent_t *e = &pcap_idx_buf[pcap_idx_len];
+
+	if (pcap_idx_fd < 0) {
+		return;
+	}
+
+	memset(e, 0, sizeof(*e));
+	e->off = pcap_pos;
+	e->ts_min = pcap_ts_min;
+	e->ts_max = pcap_ts_max;
+	e->rec_total = pcap_rec_total;
+	e->flags = KIDX_ENT_CHECKPOINT;
+	kidx_ent_seal(e);
+
+	pcap_idx_len++;
+	pcap_idx_flush();
+
+	if (pcap_idx_fd >= 0) {
+		ksceIoSyncByFd(pcap_idx_fd, 0);
+	}
+}
+
+static int pcap_idx_open(char *idx, uint32_t flags)
+{
+	struct kidx_hdr_t h;
+
+	pcap_idx_len = 0;
+	pcap_ts_min = UINT64_MAX;
+	pcap_ts_max = 0;
+	kidx_ent_reset(&pcap_ent);
+
+	pcap_idx_fd = ksceIoOpen(idx, SCE_O_WRONLY|SCE_O_CREAT|SCE_O_TRUNC, 0777);
+	if (pcap_idx_fd < 0) {
+		return -1;
+	}
+
+	kidx_hdr_init(&h, (flags & KWIFIMON_CAP_COMPRESS) ? KIDX_KCAP : 0);
+	if (ksceIoWrite(pcap_idx_fd, &h, sizeof(h)) < 0) {
+		ksceIoClose(pcap_idx_fd);
+		pcap_idx_fd = -1;
+		return -1;
+	}
+
+	pcap_stats.idx_bytes += sizeof(h);
+
+	return 0;
+}
+
+// idx is the index sidecar, NULL for none, cfg NULL is plain pcap
+int pcap_open(char *file, char *idx, const struct wifimon_cap_cfg_t *cfg)
+{
+	uint32_t flags = cfg ? cfg->flags : 0;
+
 	if (pcap_fd > 0) {
 		pcap_close();
 	}
@@ -29,84 +173,253 @@ int pcap_open(char *file)
 	hdr.snaplen = 65535;
 	hdr.network = 127;//LINKTYPE_IEEE802_11_RADIOTAP
 
-	if (ksceIoWrite(pcap_fd, &hdr, sizeof(hdr)) < 0) {
+	pcap_buf_len = 0;
+	pcap_nrec = 0;
+	pcap_poor = 0;
+	pcap_pos = 0;
+	pcap_rec_total = 0;
+	pcap_flags = flags;
+	pcap_sync_us = cfg ? cfg->sync_ms * 1000 : 0;
+	pcap_sync_last = ksceKernelGetSystemTimeLow();
+	pcap_sync_pos = 0;
+
+	if (idx && pcap_idx_open(idx, flags) < 0) {
 		pcap_close();
 		return -1;
 	}
 
-	return 0;
+	if (flags & KWIFIMON_CAP_COMPRESS) {
+		struct kcap_hdr_t khdr;
+
+		memcpy(khdr.magic, KCAP_MAGIC, sizeof(khdr.magic));
+		khdr.version = KCAP_VERSION;
+		khdr.block_max = PCAP_BUF_SIZE;
+		memcpy(khdr.pcap, &hdr, sizeof(hdr));
+
+		return pcap_out(&khdr, sizeof(khdr));
+	}
+
+	return pcap_out(&hdr, sizeof(hdr));
 }
 
 void pcap_close(void)
 {
-	if (pcap_fd >= 0) {
+	// a failed write has closed the file already, and the last checkpoint
+	// may only cover what reached the disk
+	if (pcap_fd >= 0 && pcap_flush() == 0) {
+		if (ksceIoSyncByFd(pcap_fd, 0) < 0) {
+			pcap_stats.sync_err++;
+		} else {
+			pcap_checkpoint();
+		}
 		ksceIoClose(pcap_fd);
 		pcap_fd = -1;
 	}
+
+	if (pcap_idx_fd >= 0) {
+		pcap_idx_flush();
+		ksceIoClose(pcap_idx_fd);
+		pcap_idx_fd = -1;
+	}
 }
 
-int pcap_write_raw(uint8_t *buf, uint32_t buf_len)
+// compression is skipped while the writer is behind or the data
+// does not compress, so the writer never costs more than a memcpy
+static int pcap_flush_blk(void)
 {
-	pcaprec_hdr_t rec;
-	struct timeval tv;
-	struct timezone tz;
+	struct kcap_blk_t *b = (void *)pcap_blk;
+	uint8_t *out = pcap_blk + sizeof(*b);
+	int len = -1;
 
-	if (pcap_fd < 0) {
+	if (pcap_busy) {
+		pcap_stats.stored_busy++;
+	} else if (pcap_poor) {
+		pcap_poor--;
+		pcap_stats.stored_poor++;
+	} else {
+		len = lz4blk_compress(pcap_buf, pcap_buf_len, out, LZ4BLK_BOUND(PCAP_BUF_SIZE), pcap_tab);
+		if (len < 0 || len > pcap_buf_len - pcap_buf_len / PCAP_POOR_DIV) {
+			len = -1;
+			pcap_poor = PCAP_POOR_SKIP;
+			pcap_stats.stored_poor++;
+		}
+	}
+
+	b->magic = KCAP_BLK_MAGIC;
+	b->flags = 0;
+	b->nrec = pcap_nrec;
+	b->raw_len = pcap_buf_len;
+	b->ts_sec = pcap_ts_sec;
+	b->ts_usec = pcap_ts_usec;
+	b->sum = kcap_sum(1, pcap_buf, pcap_buf_len);
+
+	if (len < 0) {
+		b->flags |= KCAP_BLK_STORED;
+		memcpy(out, pcap_buf, pcap_buf_len);
+		len = pcap_buf_len;
+	}
+
+	b->len = len;
+	kcap_blk_seal(b);
+	pcap_stats.blocks++;
+
+	return pcap_out(pcap_blk, sizeof(*b) + len);
+}
+
+int pcap_flush(void)
+{
+	int ret;
+
+	if (pcap_fd < 0 || pcap_buf_len == 0) {
 		return 0;
 	}
 
-	ksceKernelLibcGettimeofday(&tv, &tz);
+	uint64_t at = pcap_pos;
 
-	rec.ts_sec = tv.tv_sec;
-	rec.ts_usec = tv.tv_usec;
-	rec.incl_len = buf_len;
-	rec.orig_len = buf_len;
+	pcap_rec_total += pcap_nrec;
 
-	if (ksceIoWrite(pcap_fd, &rec, sizeof(rec)) < 0) {
-		pcap_close();
+	if (pcap_flags & KWIFIMON_CAP_COMPRESS) {
+		ret = pcap_flush_blk();
+	} else {
+		ret = pcap_out(pcap_buf, pcap_buf_len);
+	}
+
+	if (ret == 0 && pcap_idx_fd >= 0) {
+		pcap_idx_add(at, pcap_pos - at);
+	}
+	kidx_ent_reset(&pcap_ent);
+
+	pcap_stats.raw_bytes += pcap_buf_len;
+	pcap_buf_len = 0;
+	pcap_nrec = 0;
+
+	return ret;
+}
+
+// staged records go out and are made durable, then the index gets a checkpoint
+int pcap_sync(void)
+{
+	if (pcap_fd < 0) {
+		return 0;
+	}
+
+	if (pcap_flush() < 0) {
 		return -1;
 	}
 
-	if (ksceIoWrite(pcap_fd, buf, buf_len) < 0) {
-		pcap_close();
+	uint32_t t0 = ksceKernelGetSystemTimeLow();
+	pcap_sync_last = t0;
+
+	if (pcap_pos == pcap_sync_pos) {
+		return 0;
+	}
+
+	if (ksceIoSyncByFd(pcap_fd, 0) < 0) {
+		pcap_stats.sync_err++;
 		return -1;
 	}
 
+	pcap_checkpoint();
+	pcap_sync_pos = pcap_pos;
+
+	uint32_t t = ksceKernelGetSystemTimeLow() - t0;
+	if (t > pcap_stats.sync_us_max) {
+		pcap_stats.sync_us_max = t;
+	}
+	pcap_stats.syncs++;
+
 	return 0;
 }
 
-int pcap_write_rt(struct ieee80211_radiotap_header *rtap, uint8_t *buf, uint32_t buf_len)
+// a sync is due, checked by the writer without the lock
+int pcap_due(void)
+{
+	return pcap_fd >= 0 && pcap_sync_us && (pcap_buf_len || pcap_pos != pcap_sync_pos) &&
+		ksceKernelGetSystemTimeLow() - pcap_sync_last >= pcap_sync_us;
+}
+
+// after each drain and while idle, with the writer lock held
+void pcap_tick(void)
+{
+	if (pcap_sync_us == 0) {
+		pcap_flush();
+	} else if (pcap_due()) {
+		pcap_sync();
+	}
+}
+
+// ring fill level in percent, with hysteresis
+void pcap_pressure(uint32_t used)
+{
+	if (used >= PCAP_BUSY_ON) {
+		pcap_busy = 1;
+	} else if (used < PCAP_BUSY_OFF) {
+		pcap_busy = 0;
+	}
+}
+
+void pcap_stats_get(struct wifimon_cap_stats_t *s, int reset)
+{
+	*s = pcap_stats;
+
+	if (reset) {
+		memset(&pcap_stats, 0, sizeof(pcap_stats));
+	}
+}
+
+static int pcap_stage(uint32_t ts_sec, uint32_t ts_usec, uint8_t *hdr, uint32_t hdr_len, uint8_t *buf, uint32_t buf_len)
 {
 	pcaprec_hdr_t rec;
-	struct timeval tv;
-	struct timezone tz;
+	uint32_t len = sizeof(rec) + hdr_len + buf_len;
 
 	if (pcap_fd < 0) {
 		return 0;
 	}
 
-	ksceKernelLibcGettimeofday(&tv, &tz);
-
-	rec.ts_sec = tv.tv_sec;
-	rec.ts_usec = tv.tv_usec;
-	rec.incl_len = buf_len;
-	rec.orig_len = buf_len;
-
-	if (ksceIoWriteAsync(pcap_fd, &rec, sizeof(rec)) < 0) {
-		pcap_close();
+	if (len > PCAP_BUF_SIZE) {
 		return -1;
 	}
 
-	if (ksceIoWriteAsync(pcap_fd, rtap, rtap->it_len) < 0) {
-		pcap_close();
-		return -1;
+	if (pcap_buf_len + len > PCAP_BUF_SIZE) {
+		if (pcap_flush() < 0) {
+			return -1;
+		}
 	}
 
-	if (ksceIoWriteAsync(pcap_fd, buf, buf_len) < 0) {
-		pcap_close();
-		return -1;
+	if (pcap_nrec++ == 0) {
+		pcap_ts_sec = ts_sec;
+		pcap_ts_usec = ts_usec;
 	}
 
+	// frame follows a radiotap header, raw records are not looked into
+	if (pcap_idx_fd >= 0) {
+		kidx_ent_add(&pcap_ent, ts_sec, ts_usec, hdr ? buf : NULL, buf_len);
+	}
+
+	rec.ts_sec = ts_sec;
+	rec.ts_usec = ts_usec;
+	rec.incl_len = hdr_len + buf_len;
+	rec.orig_len = hdr_len + buf_len;
+
+	memcpy(pcap_buf + pcap_buf_len, &rec, sizeof(rec));
+	memcpy(pcap_buf + pcap_buf_len + sizeof(rec), hdr, hdr_len);
+	memcpy(pcap_buf + pcap_buf_len + sizeof(rec) + hdr_len, buf, buf_len);
+	pcap_buf_len += len;
+
 	return 0;
 }
 
+int pcap_write_raw(uint8_t *buf, uint32_t buf_len)
+{
+	struct timeval tv;
+	struct timezone tz;
+
+	ksceKernelLibcGettimeofday(&tv, &tz);
+
+	return pcap_stage(tv.tv_sec, tv.tv_usec, NULL, 0, buf, buf_len);
+}
+
+int pcap_write_rt(uint32_t ts_sec, uint32_t ts_usec, struct ieee80211_radiotap_header *rtap, uint8_t *buf, uint32_t buf_len)
+{
+	return pcap_stage(ts_sec, ts_usec, (uint8_t *)rtap, rtap->it_len, buf, buf_len);
+}
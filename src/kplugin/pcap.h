@@ -2,8 +2,22 @@
 #define PCAP_h_
 
 #include <stdint.h>
+#include <sys/time.h>
 #include "radiotap.h"
 
+#define PCAP_BUF_SIZE (32*1024)
+
+// kcap blocks: stored while the ring is above BUSY_ON percent until it
+// drops below BUSY_OFF, a block saving less than 1/POOR_DIV is stored
+// along with the next POOR_SKIP blocks
+#define PCAP_BUSY_ON    50
+#define PCAP_BUSY_OFF   25
+#define PCAP_POOR_DIV   16
+#define PCAP_POOR_SKIP  8
+
+// index entries buffered before a write
+#define PCAP_IDX_BUF    8
+
 typedef struct pcap_hdr_s {
 	uint32_t magic_number;   /* magic number */
 	uint16_t version_major;  /* major version number */
@@ -21,9 +35,20 @@ typedef struct pcaprec_hdr_s {
 	uint32_t orig_len;       /* actual length of packet */
 } __attribute__ ((packed)) pcaprec_hdr_t;
 
-int pcap_open(char *file);
+int ksceKernelLibcGettimeofday(struct timeval *ptimeval, void *ptimezone);
+
+struct wifimon_cap_cfg_t;
+struct wifimon_cap_stats_t;
+
+int pcap_open(char *file, char *idx, const struct wifimon_cap_cfg_t *cfg);
 void pcap_close(void);
+int pcap_flush(void);
+int pcap_sync(void);
+int pcap_due(void);
+void pcap_tick(void);
+void pcap_pressure(uint32_t used);
+void pcap_stats_get(struct wifimon_cap_stats_t *s, int reset);
 int pcap_write_raw(uint8_t *buf, uint32_t buf_len);
-int pcap_write_rt(struct ieee80211_radiotap_header *rtap, uint8_t *buf, uint32_t buf_len);
+int pcap_write_rt(uint32_t ts_sec, uint32_t ts_usec, struct ieee80211_radiotap_header *rtap, uint8_t *buf, uint32_t buf_len);
 
 #endif
@@ -0,0 +1,118 @@
+#include <string.h>
+
+#include "ring.h"
+
+#define RING_ALIGN_UP(x) (((x) + RING_ALIGN - 1) & ~(RING_ALIGN - 1))
+
+int ring_init(struct ring_t *r, void *buf, uint32_t size)
+{
+	// size has to be power of two
+	if (size == 0 || (size & (size - 1))) {
+		return -1;
+	}
+
+	r->buf = buf;
+	r->size = size;
+	ring_reset(r);
+
+	return 0;
+}
+
+void ring_reset(struct ring_t *r)
+{
+	r->head = 0;
+	r->tail = 0;
+	r->pending = 0;
+}
+
+uint32_t ring_used(struct ring_t *r)
+{
+	return r->head - r->tail;
+}
+
+struct ring_rec_t *ring_reserve(struct ring_t *r, uint32_t len)
+{
+	uint32_t need = RING_ALIGN_UP(sizeof(struct ring_rec_t) + len);
+	uint32_t head = r->head;
+	uint32_t space = r->size - (head - r->tail);
+	uint32_t pos = head & (r->size - 1);
+	uint32_t contig = r->size - pos;
+
+	if (need > r->size / 2) {
+		return NULL;
+	}
+
+	if (contig >= need) {
+		if (space < need) {
+			return NULL;
+		}
+
+		r->pending = need;
+		return (struct ring_rec_t *)(r->buf + pos);
+	}
+
+	// does not fit before the end, pad and wrap
+	if (space < contig + need) {
+		return NULL;
+	}
+
+	// tails shorter than a header are skipped implicitly by the consumer
+	if (contig >= sizeof(struct ring_rec_t)) {
+		struct ring_rec_t *pad = (struct ring_rec_t *)(r->buf + pos);
+		pad->type = RING_REC_PAD;
+		pad->flags = 0;
+		pad->len = contig - sizeof(struct ring_rec_t);
+	}
+
+	r->pending = contig + need;
+	return (struct ring_rec_t *)r->buf;
+}
+
+void ring_commit(struct ring_t *r, struct ring_rec_t *rec)
+{
+	// record contents must be visible before the new head
+	__sync_synchronize();
+	r->head += r->pending;
+	r->pending = 0;
+}
+
+// give back a reserved record, a pad written for it is invisible until the next commit
+void ring_cancel(struct ring_t *r)
+{
+	r->pending = 0;
+}
+
+struct ring_rec_t *ring_peek(struct ring_t *r)
+{
+	while (r->tail != r->head) {
+		uint32_t pos, contig;
+		struct ring_rec_t *rec;
+
+		__sync_synchronize();
+
+		pos = r->tail & (r->size - 1);
+		contig = r->size - pos;
+
+		if (contig < sizeof(struct ring_rec_t)) {
+			r->tail += contig;
+			continue;
+		}
+
+		rec = (struct ring_rec_t *)(r->buf + pos);
+		if (rec->type == RING_REC_PAD) {
+			r->tail += contig;
+			continue;
+		}
+
+		return rec;
+	}
+
+	return NULL;
+}
+
+void ring_release(struct ring_t *r, struct ring_rec_t *rec)
+{
+	// done reading before the producer may reuse the space
+	__sync_synchronize();
+	r->tail += RING_ALIGN_UP(sizeof(struct ring_rec_t) + rec->len);
+}
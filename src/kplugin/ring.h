@@ -0,0 +1,48 @@
+#ifndef RING_h_
+#define RING_h_
+
+#include <stdint.h>
+
+// single producer / single consumer record ring
+// records are contiguous, a pad record fills the space before a wrap
+#define RING_ALIGN 4
+
+#define RING_REC_PAD  0
+#define RING_REC_RT   1    // radiotap header + 802.11 frame
+
+#define RING_REC_NO_RPCAP  0x01   // rejected by the rpcap client's filter
+
+struct ring_rec_t {
+	uint8_t type;
+	uint8_t flags;           // RING_REC_NO_*
+	uint16_t rtap_len;
+	uint32_t len;            // payload length, without this header
+	uint32_t ts_sec;
+	uint32_t ts_usec;
+} __attribute__ ((packed));
+
+struct ring_t {
+	uint8_t *buf;
+	uint32_t size;           // power of two
+	volatile uint32_t head;  // written by producer only
+	volatile uint32_t tail;  // written by consumer only
+	uint32_t pending;        // producer private, bytes taken by last reserve
+};
+
+int ring_init(struct ring_t *r, void *buf, uint32_t size);
+void ring_reset(struct ring_t *r);
+uint32_t ring_used(struct ring_t *r);
+
+struct ring_rec_t *ring_reserve(struct ring_t *r, uint32_t len);
+void ring_commit(struct ring_t *r, struct ring_rec_t *rec);
+void ring_cancel(struct ring_t *r);
+
+struct ring_rec_t *ring_peek(struct ring_t *r);
+void ring_release(struct ring_t *r, struct ring_rec_t *rec);
+
+static inline uint8_t *ring_rec_data(struct ring_rec_t *rec)
+{
+	return (uint8_t *)rec + sizeof(struct ring_rec_t);
+}
+
+#endif
@@ -0,0 +1,615 @@
+#include <vitasdkkern.h>
+#include <psp2kern/net/net.h>
+
+#include <string.h>
+
+#include "kwifimon_export.h"
+#include "kwifimon.h"
+#include "rpcap.h"
+#include "writer.h"
+
+#define RPCAP_MSG_MAX  (sizeof(struct rpcap_startcapreq_t) + sizeof(struct rpcap_filter_t) + BPF_MAXINSNS * sizeof(struct rpcap_filterbpf_insn_t))
+
+extern struct wifimon_stats_t kwifimon_stats;
+
+static SceUID rpcap_thid = -1;
+static volatile int rpcap_run = 0;
+static int rpcap_port;
+static volatile int rpcap_lfd = -1;      // control listen
+static volatile int rpcap_cfd = -1;      // control connection
+static volatile int rpcap_dlfd = -1;     // data listen, only during startcap
+
+// control thread only
+static uint8_t rpcap_msg[RPCAP_MSG_MAX];
+static struct bpf_insn_t rpcap_prog[BPF_MAXINSNS];
+
+// data path, owned by the writer thread, changed by the control thread under writer lock
+static int rpcap_dfd = -1;
+static int rpcap_dead;
+static uint8_t rpcap_buf[RPCAP_BUF_SIZE];
+static uint32_t rpcap_buf_len;
+static uint32_t rpcap_snaplen;
+static uint32_t rpcap_npkt;
+static uint32_t rpcap_samp_method;
+static uint32_t rpcap_samp_value;
+static uint32_t rpcap_samp_cnt;
+static uint32_t rpcap_samp_last;
+static uint32_t rpcap_thin_cnt;
+static struct wifimon_rpcap_stats_t rpcap_st;
+
+int rpcap_pending(void)
+{
+	return rpcap_buf_len != 0;
+}
+
+// hand as much as the socket takes right now to the client, never blocks
+int rpcap_flush(void)
+{
+	int ret;
+
+	if (rpcap_buf_len == 0 || rpcap_dfd < 0 || rpcap_dead) {
+		return 0;
+	}
+
+	ret = ksceNetSend(rpcap_dfd, rpcap_buf, rpcap_buf_len, SCE_NET_MSG_DONTWAIT);
+	if (ret < 0) {
+		if (ret == (int)SCE_NET_ERROR_EAGAIN) {
+			return 0;
+		}
+		// client went away, control thread cleans up
+		rpcap_dead = 1;
+		rpcap_buf_len = 0;
+		return ret;
+	}
+
+	rpcap_buf_len -= ret;
+	if (rpcap_buf_len) {
+		memmove(rpcap_buf, rpcap_buf + ret, rpcap_buf_len);
+	} else if (rpcap_st.thin > 1) {
+		// client caught up
+		rpcap_st.thin /= 2;
+	}
+
+	return ret;
+}
+
+int rpcap_write_rt(uint32_t ts_sec, uint32_t ts_usec, struct ieee80211_radiotap_header *rtap, uint8_t *buf, uint32_t buf_len)
+{
+	struct rpcap_header_t *h;
+	struct rpcap_pkthdr_t *ph;
+	uint32_t len, caplen, need;
+
+	if (rpcap_dfd < 0 || rpcap_dead) {
+		return 0;
+	}
+
+	rpcap_st.offered++;
+
+	if (rpcap_samp_method == RPCAP_SAMP_1_EVERY_N) {
+		if (++rpcap_samp_cnt < rpcap_samp_value) {
+			rpcap_st.sampled++;
+			return 0;
+		}
+		rpcap_samp_cnt = 0;
+	} else if (rpcap_samp_method == RPCAP_SAMP_FIRST_AFTER_N_MS) {
+		uint32_t now = ksceKernelGetSystemTimeLow();
+		if (now - rpcap_samp_last < rpcap_samp_value * 1000) {
+			rpcap_st.sampled++;
+			return 0;
+		}
+		rpcap_samp_last = now;
+	}
+
+	// slow client, send every n-th frame instead of stalling the writer
+	if (rpcap_st.thin > 1) {
+		if (++rpcap_thin_cnt < rpcap_st.thin) {
+			rpcap_st.thinned++;
+			return 0;
+		}
+		rpcap_thin_cnt = 0;
+	}
+
+	len = rtap->it_len + buf_len;
+	caplen = (len < rpcap_snaplen) ? len : rpcap_snaplen;
+	need = sizeof(struct rpcap_header_t) + sizeof(struct rpcap_pkthdr_t) + caplen;
+
+	if (rpcap_buf_len + need > RPCAP_BUF_SIZE) {
+		rpcap_flush();
+		if (rpcap_buf_len + need > RPCAP_BUF_SIZE) {
+			rpcap_st.drop_full++;
+			if (rpcap_st.thin < RPCAP_THIN_MAX) {
+				rpcap_st.thin *= 2;
+			}
+			return -1;
+		}
+	}
+
+	h = (struct rpcap_header_t *)(rpcap_buf + rpcap_buf_len);
+	h->ver = RPCAP_VERSION;
+	h->type = RPCAP_MSG_PACKET;
+	h->value = 0;
+	h->plen = ksceNetHtonl(sizeof(struct rpcap_pkthdr_t) + caplen);
+
+	ph = (struct rpcap_pkthdr_t *)(h + 1);
+	ph->timestamp_sec = ksceNetHtonl(ts_sec);
+	ph->timestamp_usec = ksceNetHtonl(ts_usec);
+	ph->caplen = ksceNetHtonl(caplen);
+	ph->len = ksceNetHtonl(len);
+	ph->npkt = ksceNetHtonl(++rpcap_npkt);
+
+	uint8_t *p = (uint8_t *)(ph + 1);
+	if (caplen <= rtap->it_len) {
+		memcpy(p, rtap, caplen);
+	} else {
+		memcpy(p, rtap, rtap->it_len);
+		memcpy(p + rtap->it_len, buf, caplen - rtap->it_len);
+	}
+
+	rpcap_buf_len += need;
+	rpcap_st.sent++;
+	rpcap_st.sent_bytes += caplen;
+
+	return 0;
+}
+
+void rpcap_stats(struct wifimon_rpcap_stats_t *s, int reset)
+{
+	*s = rpcap_st;
+
+	if (reset) {
+		uint32_t clients = rpcap_st.clients;
+		uint32_t capturing = rpcap_st.capturing;
+		uint32_t thin = rpcap_st.thin;
+
+		memset(&rpcap_st, 0, sizeof(rpcap_st));
+		rpcap_st.clients = clients;
+		rpcap_st.capturing = capturing;
+		rpcap_st.thin = thin;
+	}
+}
+
+static int rpcap_recv_all(int fd, void *buf, uint32_t len)
+{
+	uint8_t *p = buf;
+
+	while (len) {
+		int ret = ksceNetRecvfrom(fd, p, len, 0, NULL, NULL);
+		if (ret <= 0) {
+			return -1;
+		}
+		p += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+static int rpcap_send_all(int fd, const void *buf, uint32_t len)
+{
+	const uint8_t *p = buf;
+
+	while (len) {
+		int ret = ksceNetSend(fd, p, len, 0);
+		if (ret <= 0) {
+			return -1;
+		}
+		p += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+// read payload into rpcap_msg, anything above max is dropped
+static int rpcap_recv_msg(int fd, uint32_t plen, uint32_t max)
+{
+	uint32_t keep = (plen < max) ? plen : max;
+	uint8_t junk[64];
+
+	if (rpcap_recv_all(fd, rpcap_msg, keep) < 0) {
+		return -1;
+	}
+
+	plen -= keep;
+	while (plen) {
+		uint32_t n = (plen < sizeof(junk)) ? plen : sizeof(junk);
+		if (rpcap_recv_all(fd, junk, n) < 0) {
+			return -1;
+		}
+		plen -= n;
+	}
+
+	return keep;
+}
+
+static int rpcap_reply(int fd, uint8_t type, uint16_t value, const void *payload, uint32_t len)
+{
+	struct rpcap_header_t h;
+
+	h.ver = RPCAP_VERSION;
+	h.type = type;
+	h.value = ksceNetHtons(value);
+	h.plen = ksceNetHtonl(len);
+
+	if (rpcap_send_all(fd, &h, sizeof(h)) < 0) {
+		return -1;
+	}
+
+	return len ? rpcap_send_all(fd, payload, len) : 0;
+}
+
+static int rpcap_error(int fd, uint16_t code, const char *msg)
+{
+	return rpcap_reply(fd, RPCAP_MSG_ERROR, code, msg, strlen(msg));
+}
+
+// rpcap filter in network order to the hook, which runs it on what it
+// queues for the client, no items clears it, a bad one leaves the one before
+static int rpcap_filter(const uint8_t *p, uint32_t len)
+{
+	const struct rpcap_filter_t *f = (const void *)p;
+	const struct rpcap_filterbpf_insn_t *in = (const void *)(f + 1);
+	uint32_t n, i;
+
+	if (len < sizeof(*f) || ksceNetNtohs(f->filtertype) != RPCAP_UPDATEFILTER_BPF) {
+		return -1;
+	}
+
+	n = ksceNetNtohl(f->nitems);
+	if (n > BPF_MAXINSNS || len < sizeof(*f) + n * sizeof(*in)) {
+		return -1;
+	}
+
+	for (i = 0; i < n; i++) {
+		rpcap_prog[i].code = ksceNetNtohs(in[i].code);
+		rpcap_prog[i].jt = in[i].jt;
+		rpcap_prog[i].jf = in[i].jf;
+		rpcap_prog[i].k = ksceNetNtohl(in[i].k);
+	}
+	if (n && bpf_validate(rpcap_prog, n) != 0) {
+		return -1;
+	}
+
+	return kwifimon_rpcap_filter_set(rpcap_prog, n) < 0 ? -1 : 0;
+}
+
+static void rpcap_filter_clear(void)
+{
+	kwifimon_rpcap_filter_set(NULL, 0);
+}
+
+static void rpcap_endcap(void)
+{
+	int fd;
+
+	if (rpcap_dfd < 0) {
+		return;
+	}
+
+	kwifimon_state_set(STATE_REC_RPCAP, 0);
+	rpcap_filter_clear();
+
+	writer_lock();
+	fd = rpcap_dfd;
+	rpcap_dfd = -1;
+	rpcap_buf_len = 0;
+	rpcap_st.capturing = 0;
+	writer_unlock();
+
+	ksceNetClose(fd);
+}
+
+static int rpcap_startcap(int fd, const uint8_t *p, uint32_t len)
+{
+	const struct rpcap_startcapreq_t *req = (const void *)p;
+	struct rpcap_startcapreply_t rep;
+	SceNetSockaddrIn sin;
+	int one = 1, sndbuf = 256 * 1024;
+	int dfd;
+
+	if (len < sizeof(*req)) {
+		return rpcap_error(fd, RPCAP_ERR_STARTCAPTURE, "short request");
+	}
+
+	if (ksceNetNtohs(req->flags) & (RPCAP_STARTCAPREQ_FLAG_DGRAM | RPCAP_STARTCAPREQ_FLAG_SERVEROPEN)) {
+		return rpcap_error(fd, RPCAP_ERR_STARTCAPTURE, "only passive mode tcp data connection supported");
+	}
+
+	if (rpcap_dfd >= 0) {
+		return rpcap_error(fd, RPCAP_ERR_STARTCAPTURE, "capture already running");
+	}
+
+	if (rpcap_filter(p + sizeof(*req), len - sizeof(*req)) < 0) {
+		return rpcap_error(fd, RPCAP_ERR_UPDATEFILTER, "bad filter");
+	}
+
+	rpcap_dlfd = ksceNetSocket("kwifimon_rpcapd", SCE_NET_AF_INET, SCE_NET_SOCK_STREAM, 0);
+	if (rpcap_dlfd < 0) {
+		return rpcap_error(fd, RPCAP_ERR_STARTCAPTURE, "socket failed");
+	}
+
+	ksceNetSetsockopt(rpcap_dlfd, SCE_NET_SOL_SOCKET, SCE_NET_SO_REUSEADDR, &one, sizeof(one));
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = SCE_NET_AF_INET;
+	sin.sin_port = ksceNetHtons(rpcap_port + 1);
+	sin.sin_addr.s_addr = SCE_NET_INADDR_ANY;
+
+	if (ksceNetBind(rpcap_dlfd, (SceNetSockaddr *)&sin, sizeof(sin)) < 0 || ksceNetListen(rpcap_dlfd, 1) < 0) {
+		ksceNetClose(rpcap_dlfd);
+		rpcap_dlfd = -1;
+		rpcap_filter_clear();
+		return rpcap_error(fd, RPCAP_ERR_STARTCAPTURE, "data port busy");
+	}
+
+	rep.bufsize = ksceNetHtonl(RPCAP_BUF_SIZE);
+	rep.portdata = ksceNetHtons(rpcap_port + 1);
+	rep.dummy = 0;
+
+	if (rpcap_reply(fd, RPCAP_MSG_STARTCAP_REQ | RPCAP_MSG_REPLY, 0, &rep, sizeof(rep)) < 0) {
+		dfd = -1;
+	} else {
+		dfd = ksceNetAccept(rpcap_dlfd, NULL, NULL);
+	}
+
+	ksceNetClose(rpcap_dlfd);
+	rpcap_dlfd = -1;
+
+	if (dfd < 0) {
+		rpcap_filter_clear();
+		return -1;
+	}
+
+	ksceNetSetsockopt(dfd, SCE_NET_SOL_SOCKET, SCE_NET_SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+	writer_lock();
+	rpcap_dfd = dfd;
+	rpcap_dead = 0;
+	rpcap_buf_len = 0;
+	rpcap_npkt = 0;
+	rpcap_snaplen = ksceNetNtohl(req->snaplen);
+	if (rpcap_snaplen == 0) {
+		rpcap_snaplen = 0xffff;
+	}
+	rpcap_thin_cnt = 0;
+	rpcap_st.thin = 1;
+	rpcap_st.capturing = 1;
+	writer_unlock();
+
+	kwifimon_state_set(STATE_REC_RPCAP, 1);
+
+	return 0;
+}
+
+static int rpcap_findalldevs(int fd)
+{
+	static const char desc[] = "PS Vita wlan monitor (radiotap)";
+	uint8_t buf[sizeof(struct rpcap_findalldevs_if_t) + sizeof(RPCAP_IFNAME) + sizeof(desc)];
+	struct rpcap_findalldevs_if_t *d = (void *)buf;
+	uint32_t nlen = sizeof(RPCAP_IFNAME) - 1, dlen = sizeof(desc) - 1;
+
+	memset(d, 0, sizeof(*d));
+	d->namelen = ksceNetHtons(nlen);
+	d->desclen = ksceNetHtons(dlen);
+	memcpy(buf + sizeof(*d), RPCAP_IFNAME, nlen);
+	memcpy(buf + sizeof(*d) + nlen, desc, dlen);
+
+	return rpcap_reply(fd, RPCAP_MSG_FINDALLIF_REQ | RPCAP_MSG_REPLY, 1, buf, sizeof(*d) + nlen + dlen);
+}
+
+static void rpcap_session(int fd)
+{
+	struct rpcap_header_t h;
+	int authed = 0, ret;
+
+	while (rpcap_run && rpcap_recv_all(fd, &h, sizeof(h)) == 0) {
+		uint32_t plen = ksceNetNtohl(h.plen);
+		int len = rpcap_recv_msg(fd, plen, sizeof(rpcap_msg));
+
+		if (len < 0) {
+			break;
+		}
+
+		if (h.ver != RPCAP_VERSION) {
+			ret = rpcap_error(fd, RPCAP_ERR_WRONGVER, "only version 0 supported");
+		} else if (!authed && h.type != RPCAP_MSG_AUTH_REQ) {
+			ret = rpcap_error(fd, RPCAP_ERR_AUTH, "not authenticated");
+		} else {
+			switch (h.type) {
+			case RPCAP_MSG_AUTH_REQ: {
+				struct rpcap_auth_t *a = (void *)rpcap_msg;
+				struct rpcap_authreply_t rep;
+
+				if (len < sizeof(*a) || ksceNetNtohs(a->type) != RPCAP_RMTAUTH_NULL) {
+					ret = rpcap_error(fd, RPCAP_ERR_AUTH_TYPE_NOTSUP, "only null authentication");
+					break;
+				}
+
+				memset(&rep, 0, sizeof(rep));
+				rep.byte_order_magic = RPCAP_BYTE_ORDER_MAGIC;
+				authed = 1;
+				ret = rpcap_reply(fd, RPCAP_MSG_AUTH_REQ | RPCAP_MSG_REPLY, 0, &rep, sizeof(rep));
+				break;
+			}
+
+			case RPCAP_MSG_FINDALLIF_REQ:
+				ret = rpcap_findalldevs(fd);
+				break;
+
+			case RPCAP_MSG_OPEN_REQ: {
+				struct rpcap_openreply_t rep;
+
+				if (len != sizeof(RPCAP_IFNAME) - 1 || memcmp(rpcap_msg, RPCAP_IFNAME, len)) {
+					ret = rpcap_error(fd, RPCAP_ERR_OPEN, "no such interface");
+					break;
+				}
+
+				rep.linktype = ksceNetHtonl(RPCAP_LINKTYPE);
+				rep.tzoff = 0;
+				ret = rpcap_reply(fd, RPCAP_MSG_OPEN_REQ | RPCAP_MSG_REPLY, 0, &rep, sizeof(rep));
+				break;
+			}
+
+			case RPCAP_MSG_STARTCAP_REQ:
+				ret = rpcap_startcap(fd, rpcap_msg, len);
+				break;
+
+			case RPCAP_MSG_UPDATEFILTER_REQ:
+				if (rpcap_filter(rpcap_msg, len) < 0) {
+					ret = rpcap_error(fd, RPCAP_ERR_UPDATEFILTER, "bad filter");
+				} else {
+					ret = rpcap_reply(fd, RPCAP_MSG_UPDATEFILTER_REQ | RPCAP_MSG_REPLY, 0, NULL, 0);
+				}
+				break;
+
+			case RPCAP_MSG_SETSAMPLING_REQ: {
+				struct rpcap_sampling_t *s = (void *)rpcap_msg;
+
+				if (len < sizeof(*s) || s->method > RPCAP_SAMP_FIRST_AFTER_N_MS) {
+					ret = rpcap_error(fd, RPCAP_ERR_SETSAMPLING, "bad sampling method");
+					break;
+				}
+
+				writer_lock();
+				rpcap_samp_method = s->method;
+				rpcap_samp_value = ksceNetNtohl(s->value);
+				if (s->method == RPCAP_SAMP_FIRST_AFTER_N_MS && rpcap_samp_value > RPCAP_SAMP_MS_MAX) {
+					rpcap_samp_value = RPCAP_SAMP_MS_MAX;
+				}
+				rpcap_samp_cnt = 0;
+				rpcap_samp_last = 0;
+				writer_unlock();
+
+				ret = rpcap_reply(fd, RPCAP_MSG_SETSAMPLING_REQ | RPCAP_MSG_REPLY, 0, NULL, 0);
+				break;
+			}
+
+			case RPCAP_MSG_STATS_REQ: {
+				struct rpcap_stats_t rep;
+
+				writer_lock();
+				rep.ifrecv = ksceNetHtonl(rpcap_st.offered);
+				rep.ifdrop = ksceNetHtonl(rpcap_st.thinned + rpcap_st.drop_full);
+				rep.svrcapt = ksceNetHtonl(rpcap_st.sent);
+				writer_unlock();
+				rep.krnldrop = ksceNetHtonl(kwifimon_stats.drop_cnt);
+
+				ret = rpcap_reply(fd, RPCAP_MSG_STATS_REQ | RPCAP_MSG_REPLY, 0, &rep, sizeof(rep));
+				break;
+			}
+
+			case RPCAP_MSG_ENDCAP_REQ:
+				rpcap_endcap();
+				ret = rpcap_reply(fd, RPCAP_MSG_ENDCAP_REQ | RPCAP_MSG_REPLY, 0, NULL, 0);
+				break;
+
+			case RPCAP_MSG_CLOSE:
+				return;
+
+			default:
+				ret = rpcap_error(fd, RPCAP_ERR_WRONGMSG, "unsupported message");
+				break;
+			}
+		}
+
+		if (ret < 0) {
+			break;
+		}
+	}
+}
+
+static int rpcap_thread(SceSize args, void *argp)
+{
+	while (rpcap_run) {
+		int fd = ksceNetAccept(rpcap_lfd, NULL, NULL);
+		if (fd < 0) {
+			if (rpcap_run) {
+				ksceKernelDelayThread(100000);
+			}
+			continue;
+		}
+
+		// one client at a time, others wait in the backlog
+		rpcap_cfd = fd;
+		writer_lock();
+		rpcap_st.clients++;
+		rpcap_samp_method = RPCAP_SAMP_NOSAMP;
+		writer_unlock();
+
+		rpcap_session(fd);
+		rpcap_endcap();
+
+		rpcap_cfd = -1;
+		ksceNetClose(fd);
+	}
+
+	return 0;
+}
+
+int rpcap_start(int port)
+{
+	SceNetSockaddrIn sin;
+	int one = 1;
+
+	if (rpcap_thid >= 0) {
+		return -1;
+	}
+
+	rpcap_port = port ? port : KWIFIMON_RPCAP_PORT;
+
+	rpcap_lfd = ksceNetSocket("kwifimon_rpcap", SCE_NET_AF_INET, SCE_NET_SOCK_STREAM, 0);
+	if (rpcap_lfd < 0) {
+		return -1;
+	}
+
+	ksceNetSetsockopt(rpcap_lfd, SCE_NET_SOL_SOCKET, SCE_NET_SO_REUSEADDR, &one, sizeof(one));
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = SCE_NET_AF_INET;
+	sin.sin_port = ksceNetHtons(rpcap_port);
+	sin.sin_addr.s_addr = SCE_NET_INADDR_ANY;
+
+	if (ksceNetBind(rpcap_lfd, (SceNetSockaddr *)&sin, sizeof(sin)) < 0 || ksceNetListen(rpcap_lfd, 2) < 0) {
+		ksceNetClose(rpcap_lfd);
+		rpcap_lfd = -1;
+		return -2;
+	}
+
+	rpcap_run = 1;
+	rpcap_thid = ksceKernelCreateThread("kwifimon_rpcap", rpcap_thread, 0x40, 0x4000, 0, 0, NULL);
+	if (rpcap_thid < 0) {
+		rpcap_run = 0;
+		ksceNetClose(rpcap_lfd);
+		rpcap_lfd = -1;
+		return -3;
+	}
+
+	ksceKernelStartThread(rpcap_thid, 0, NULL);
+
+	return 0;
+}
+
+void rpcap_stop(void)
+{
+	if (rpcap_thid < 0) {
+		return;
+	}
+
+	rpcap_run = 0;
+
+	// kick the control thread out of whatever it is blocked in
+	ksceNetSocketAbort(rpcap_lfd, 0);
+	if (rpcap_cfd >= 0) {
+		ksceNetSocketAbort(rpcap_cfd, 0);
+	}
+	if (rpcap_dlfd >= 0) {
+		ksceNetSocketAbort(rpcap_dlfd, 0);
+	}
+
+	ksceKernelWaitThreadEnd(rpcap_thid, NULL, NULL);
+	ksceKernelDeleteThread(rpcap_thid);
+	rpcap_thid = -1;
+
+	ksceNetClose(rpcap_lfd);
+	rpcap_lfd = -1;
+}
@@ -0,0 +1,148 @@
+#ifndef RPCAP_h_
+#define RPCAP_h_
+
+#include <stdint.h>
+#include "radiotap.h"
+#include "kwifimon_export.h"
+
+// rpcap capture server, protocol version 0 as spoken by libpcap/wireshark
+// null auth, one interface, passive tcp data connection on port + 1
+
+#define RPCAP_BUF_SIZE     (64*1024)
+#define RPCAP_THIN_MAX     64
+
+#define RPCAP_VERSION              0
+#define RPCAP_MSG_REPLY            0x80
+
+#define RPCAP_MSG_ERROR            1
+#define RPCAP_MSG_FINDALLIF_REQ    2
+#define RPCAP_MSG_OPEN_REQ         3
+#define RPCAP_MSG_STARTCAP_REQ     4
+#define RPCAP_MSG_UPDATEFILTER_REQ 5
+#define RPCAP_MSG_CLOSE            6
+#define RPCAP_MSG_PACKET           7
+#define RPCAP_MSG_AUTH_REQ         8
+#define RPCAP_MSG_STATS_REQ        9
+#define RPCAP_MSG_ENDCAP_REQ       10
+#define RPCAP_MSG_SETSAMPLING_REQ  11
+
+#define RPCAP_ERR_AUTH             3
+#define RPCAP_ERR_NOREMOTEIF       5
+#define RPCAP_ERR_OPEN             6
+#define RPCAP_ERR_UPDATEFILTER     7
+#define RPCAP_ERR_STARTCAPTURE     12
+#define RPCAP_ERR_SETSAMPLING      15
+#define RPCAP_ERR_WRONGMSG         16
+#define RPCAP_ERR_WRONGVER         17
+#define RPCAP_ERR_AUTH_TYPE_NOTSUP 20
+
+#define RPCAP_RMTAUTH_NULL         0
+#define RPCAP_UPDATEFILTER_BPF     1
+
+#define RPCAP_STARTCAPREQ_FLAG_DGRAM      2
+#define RPCAP_STARTCAPREQ_FLAG_SERVEROPEN 4
+
+#define RPCAP_SAMP_NOSAMP          0
+#define RPCAP_SAMP_1_EVERY_N       1
+#define RPCAP_SAMP_FIRST_AFTER_N_MS 2
+// the low 32 bits of the us clock, longer waits are cut to this
+#define RPCAP_SAMP_MS_MAX          (0xffffffffu / 1000)
+
+#define RPCAP_BYTE_ORDER_MAGIC     0xa1b2c3d4
+
+#define RPCAP_IFNAME               "kwifimon"
+#define RPCAP_LINKTYPE             127       // radiotap
+
+// all fields in network byte order
+struct rpcap_header_t {
+	uint8_t ver;
+	uint8_t type;
+	uint16_t value;
+	uint32_t plen;
+} __attribute__ ((packed));
+
+struct rpcap_auth_t {
+	uint16_t type;
+	uint16_t dummy;
+	uint16_t slen1;
+	uint16_t slen2;
+} __attribute__ ((packed));
+
+struct rpcap_authreply_t {
+	uint8_t minvers;
+	uint8_t maxvers;
+	uint8_t pad[2];
+	uint32_t byte_order_magic;   // host order, lets the client detect it
+} __attribute__ ((packed));
+
+struct rpcap_findalldevs_if_t {
+	uint16_t namelen;
+	uint16_t desclen;
+	uint32_t flags;
+	uint16_t naddr;
+	uint16_t dummy;
+} __attribute__ ((packed));
+
+struct rpcap_openreply_t {
+	int32_t linktype;
+	int32_t tzoff;
+} __attribute__ ((packed));
+
+struct rpcap_startcapreq_t {
+	uint32_t snaplen;
+	uint32_t read_timeout;
+	uint16_t flags;
+	uint16_t portdata;
+} __attribute__ ((packed));
+
+struct rpcap_startcapreply_t {
+	int32_t bufsize;
+	uint16_t portdata;
+	uint16_t dummy;
+} __attribute__ ((packed));
+
+struct rpcap_filter_t {
+	uint16_t filtertype;
+	uint16_t dummy;
+	uint32_t nitems;
+} __attribute__ ((packed));
+
+struct rpcap_filterbpf_insn_t {
+	uint16_t code;
+	uint8_t jt;
+	uint8_t jf;
+	int32_t k;
+} __attribute__ ((packed));
+
+struct rpcap_pkthdr_t {
+	uint32_t timestamp_sec;
+	uint32_t timestamp_usec;
+	uint32_t caplen;
+	uint32_t len;
+	uint32_t npkt;
+} __attribute__ ((packed));
+
+struct rpcap_stats_t {
+	uint32_t ifrecv;
+	uint32_t ifdrop;
+	uint32_t krnldrop;
+	uint32_t svrcapt;
+} __attribute__ ((packed));
+
+struct rpcap_sampling_t {
+	uint8_t method;
+	uint8_t dummy1;
+	uint16_t dummy2;
+	uint32_t value;
+} __attribute__ ((packed));
+
+int rpcap_start(int port);
+void rpcap_stop(void);
+
+// writer side, call with writer lock held
+int rpcap_write_rt(uint32_t ts_sec, uint32_t ts_usec, struct ieee80211_radiotap_header *rtap, uint8_t *buf, uint32_t buf_len);
+int rpcap_flush(void);
+int rpcap_pending(void);
+void rpcap_stats(struct wifimon_rpcap_stats_t *s, int reset);
+
+#endif
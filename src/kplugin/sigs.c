@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <vitasdkkern.h>
+#include <taihen.h>
+
+#include "sigscan.h"
+#include "sigs.h"
+
+// no signatures yet, they need a text of SceWlanBt to be cut from with
+// host/sigmake, until then every function is at its fixed offset and
+// sigs_resolve neither scans nor caches
+struct sig_t sigs[SIGS] = {
+	[SIG_CMD_ALLOC]  = { "wlan_cmd_alloc", 0x2954, NULL, 0 },
+	[SIG_CMD_FREE]   = { "wlan_cmd_free", 0x2a18, NULL, 0 },
+	[SIG_CMD_SEND1]  = { "wlan_cmd_send1", 0x2f44, NULL, 0 },
+	[SIG_CMD_SEND2]  = { "wlan_cmd_send2", 0x2db4, NULL, 0 },
+	[SIG_CMD_WAIT]   = { "wlan_cmd_wait", 0x2e7c, NULL, 0 },
+	[SIG_LOCK]       = { "wlan_lock", 0x0e50, NULL, 0 },
+	[SIG_UNLOCK]     = { "wlan_unlock", 0x0e70, NULL, 0 },
+	[SIG_MEM_READ]   = { "wlan_mem_read", 0x4568, NULL, 0 },
+	[SIG_MEM_WRITE]  = { "wlan_mem_write", 0x45e8, NULL, 0 },
+	[SIG_RX_HANDLER] = { "wlan_rx_handler", 0x1cd4, NULL, 0 },
+	[SIG_IOCTL]      = { "wlan_ioctl", 0x73f0, NULL, 0 },
+};
+
+#define SIGS_SCAN_SIZE ((sizeof(struct sigscan_t) + 0xfff) & ~0xfff)
+
+static uint32_t sigs_table_hash(void)
+{
+	uint32_t h = 2166136261u;
+	int i;
+
+	for (i = 0; i < SIGS; i++) {
+		h = sigscan_hash(h, sigs[i].name);
+		h = sigscan_hash(h, sigs[i].pattern);
+		h = (h ^ sigs[i].fixed) * 16777619;
+		h = (h ^ (uint32_t)sigs[i].adj) * 16777619;
+	}
+
+	return h;
+}
+
+static int sigs_cache_load(uint32_t nid, uint32_t text_size, uint32_t table)
+{
+	struct sigs_cache_t c;
+	int fd, ret, i;
+
+	fd = ksceIoOpen(SIGS_CACHE_FILE, SCE_O_RDONLY, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	ret = ksceIoRead(fd, &c, sizeof(c));
+	ksceIoClose(fd);
+
+	if (ret != sizeof(c) || c.magic != SIGS_CACHE_MAGIC || c.nid != nid ||
+		c.text_size != text_size || c.table != table || c.n != SIGS) {
+		return -1;
+	}
+
+	for (i = 0; i < SIGS; i++) {
+		sigs[i].offset = c.offset[i];
+		sigs[i].how = (c.how[i] == SIG_FOUND) ? SIG_CACHED : c.how[i];
+	}
+
+	return 0;
+}
+
+static void sigs_cache_save(uint32_t nid, uint32_t text_size, uint32_t table)
+{
+	struct sigs_cache_t c;
+	int fd, i;
+
+	memset(&c, 0, sizeof(c));
+	c.magic = SIGS_CACHE_MAGIC;
+	c.nid = nid;
+	c.text_size = text_size;
+	c.table = table;
+	c.n = SIGS;
+	for (i = 0; i < SIGS; i++) {
+		c.offset[i] = sigs[i].offset;
+		c.how[i] = sigs[i].how;
+	}
+
+	fd = ksceIoOpen(SIGS_CACHE_FILE, SCE_O_WRONLY|SCE_O_CREAT|SCE_O_TRUNC, 0777);
+	if (fd >= 0) {
+		ksceIoWrite(fd, &c, sizeof(c));
+		ksceIoClose(fd);
+	}
+}
+
+// once per build, what sigmake needs
+static void sigs_text_save(uint32_t nid, const void *text, uint32_t text_size)
+{
+	char path[64];
+	int fd;
+
+	snprintf(path, sizeof(path), SIGS_TEXT_FILE, nid);
+
+	fd = ksceIoOpen(path, SCE_O_RDONLY, 0);
+	if (fd >= 0) {
+		ksceIoClose(fd);
+		return;
+	}
+
+	fd = ksceIoOpen(path, SCE_O_WRONLY|SCE_O_CREAT|SCE_O_TRUNC, 0777);
+	if (fd >= 0) {
+		ksceIoWrite(fd, text, text_size);
+		ksceIoClose(fd);
+	}
+}
+
+static int sigs_scan(const uint8_t *text, uint32_t text_size)
+{
+	struct sigscan_t *s;
+	int idx[SIGS];
+	void *base;
+	int i, n = 0;
+
+	SceUID mem = ksceKernelAllocMemBlock("kwifimon_sigs", SCE_KERNEL_MEMBLOCK_TYPE_KERNEL_RW, SIGS_SCAN_SIZE, NULL);
+	if (mem < 0) {
+		return -1;
+	}
+	ksceKernelGetMemBlockBase(mem, &base);
+	s = base;
+
+	// thumb, functions start on halfwords
+	sigscan_init(s, 2);
+	for (i = 0; i < SIGS; i++) {
+		idx[i] = sigs[i].pattern ? sigscan_add(s, sigs[i].pattern) : -1;
+	}
+	sigscan_run(s, text, text_size);
+
+	for (i = 0; i < SIGS; i++) {
+		int32_t at = (idx[i] >= 0) ? sigscan_found(s, idx[i]) : -1;
+
+		if (idx[i] < 0) {
+			// a pattern that did not go in counts as not found
+			sigs[i].how = sigs[i].pattern ? SIG_MISSING : SIG_OFFSET;
+		} else if (at >= 0 && at + sigs[i].adj >= 0 && at + sigs[i].adj < (int32_t)text_size) {
+			sigs[i].offset = at + sigs[i].adj;
+			sigs[i].how = SIG_FOUND;
+			n++;
+		} else {
+			sigs[i].how = (at == -2) ? SIG_AMBIGUOUS : SIG_MISSING;
+		}
+	}
+
+	ksceKernelFreeMemBlock(mem);
+
+	return n;
+}
+
+// how many are resolved as how, -1 if any is unresolved
+static int sigs_count(uint32_t how)
+{
+	int i, n = 0;
+
+	for (i = 0; i < SIGS; i++) {
+		if (sigs[i].how == SIG_MISSING || sigs[i].how == SIG_AMBIGUOUS) {
+			return -1;
+		}
+		n += (sigs[i].how == how);
+	}
+
+	return n;
+}
+
+// no text or no memory to scan it in, what has a signature is unresolved
+static int sigs_unscanned(void)
+{
+	int i;
+
+	for (i = 0; i < SIGS; i++) {
+		sigs[i].how = sigs[i].pattern ? SIG_MISSING : SIG_OFFSET;
+	}
+
+	return sigs_count(SIG_OFFSET) < 0 ? -1 : 0;
+}
+
+int sigs_resolve(int modid, uint32_t nid)
+{
+	SceKernelModuleInfo info;
+	const uint8_t *text = NULL;
+	uint32_t text_size = 0, table;
+	int i, n, patterns = 0;
+
+	for (i = 0; i < SIGS; i++) {
+		sigs[i].offset = sigs[i].fixed;
+		sigs[i].how = SIG_OFFSET;
+		patterns += (sigs[i].pattern != NULL);
+	}
+
+	// a table without signatures has nothing to scan for or cache
+	if (patterns == 0) {
+		return 0;
+	}
+	table = sigs_table_hash();
+
+	memset(&info, 0, sizeof(info));
+	info.size = sizeof(info);
+	if (ksceKernelGetModuleInfo(KERNEL_PID, modid, &info) >= 0) {
+		text = info.segments[0].vaddr;
+		text_size = info.segments[0].memsz;
+	}
+	if (text == NULL || text_size == 0) {
+		return sigs_unscanned();
+	}
+
+	if (sigs_cache_load(nid, text_size, table) == 0) {
+		return sigs_count(SIG_CACHED);
+	}
+
+	n = sigs_scan(text, text_size);
+	if (n < 0) {
+		return sigs_unscanned();
+	}
+	if (sigs_count(SIG_FOUND) < 0) {
+		sigs_text_save(nid, text, text_size);
+	}
+	sigs_cache_save(nid, text_size, table);
+
+	return sigs_count(SIG_FOUND);
+}
@@ -0,0 +1,70 @@
+#ifndef SIGS_h_
+#define SIGS_h_
+
+#include <stdint.h>
+
+// the SceWlanBt functions the plugin calls and hooks, found by byte
+// signature in the module text so a firmware that moves them still works
+// the fixed offsets are the ones the plugin was written against, only a
+// function without a signature uses its fixed offset, one whose signature
+// is not found exactly once is unresolved and the plugin hooks nothing
+// resolved offsets are cached per module build, a load of a build seen
+// before does not scan
+// where a scan fails the text is saved once to SIGS_TEXT_FILE, host/sigmake
+// makes the signatures out of it
+// while the table has no signature at all nothing is scanned or cached
+
+#define SIGS_CACHE_FILE  "ux0:data/kwifimon_sigs.bin"
+#define SIGS_CACHE_MAGIC 0x4753574b   // "KWSG"
+#define SIGS_TEXT_FILE   "ux0:data/SceWlanBt-%08x.text"
+
+enum {
+	SIG_CMD_ALLOC,
+	SIG_CMD_FREE,
+	SIG_CMD_SEND1,
+	SIG_CMD_SEND2,
+	SIG_CMD_WAIT,
+	SIG_LOCK,
+	SIG_UNLOCK,
+	SIG_MEM_READ,
+	SIG_MEM_WRITE,
+	SIG_RX_HANDLER,
+	SIG_IOCTL,
+	SIGS
+};
+
+// how an offset was had
+enum {
+	SIG_OFFSET,              // no signature, the fixed offset
+	SIG_FOUND,               // signature found once
+	SIG_CACHED,              // from the cache
+	SIG_MISSING,             // signature not found, unresolved
+	SIG_AMBIGUOUS,           // signature found more than once, unresolved
+};
+
+struct sig_t {
+	const char *name;
+	uint32_t fixed;          // offset in text segment 0
+	const char *pattern;     // see sigscan.h, NULL for none
+	int32_t adj;             // function start less pattern start
+	uint32_t offset;         // resolved
+	uint32_t how;
+};
+
+struct sigs_cache_t {
+	uint32_t magic;
+	uint32_t nid;            // module_nid, the build of the module
+	uint32_t text_size;
+	uint32_t table;          // hash of the table the offsets came from
+	uint32_t n;
+	uint32_t offset[SIGS];
+	uint32_t how[SIGS];
+} __attribute__ ((packed));
+
+extern struct sig_t sigs[SIGS];
+
+// sets offset and how of every sig, returns how many came from
+// signatures or the cache, -1 if a signature left one unresolved
+int sigs_resolve(int modid, uint32_t nid);
+
+#endif
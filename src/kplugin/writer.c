@@ -0,0 +1,142 @@
+#include <vitasdkkern.h>
+
+#include "kwifimon_export.h"
+
+#include "writer.h"
+#include "pcap.h"
+#include "knet.h"
+#include "rpcap.h"
+
+struct ring_t writer_ring;
+
+static SceUID writer_mutex = -1;
+static SceUID writer_mem = -1;
+static SceUID writer_thid = -1;
+static volatile int writer_run = 0;
+
+extern volatile int kwifimon_state;
+
+void writer_drain(void)
+{
+	struct ring_rec_t *rec;
+	int n = 0;
+
+	pcap_pressure(ring_used(&writer_ring) * 100 / writer_ring.size);
+
+	while ((rec = ring_peek(&writer_ring)) != NULL) {
+		uint8_t *data = ring_rec_data(rec);
+		struct ieee80211_radiotap_header *rtap = (void *)data;
+
+		if (rec->type == RING_REC_RT) {
+			if (kwifimon_state & STATE_REC_FILE) {
+				pcap_write_rt(rec->ts_sec, rec->ts_usec, rtap, data + rec->rtap_len, rec->len - rec->rtap_len);
+			}
+
+			if (kwifimon_state & STATE_REC_NET) {
+				knet_write_rt(rtap, data + rec->rtap_len, rec->len - rec->rtap_len);
+			}
+
+			if ((kwifimon_state & STATE_REC_RPCAP) && !(rec->flags & RING_REC_NO_RPCAP)) {
+				rpcap_write_rt(rec->ts_sec, rec->ts_usec, rtap, data + rec->rtap_len, rec->len - rec->rtap_len);
+			}
+		}
+
+		ring_release(&writer_ring, rec);
+		n++;
+	}
+
+	if (n) {
+		pcap_tick();
+		rpcap_flush();
+	}
+}
+
+static int writer_thread(SceSize args, void *argp)
+{
+	while (writer_run) {
+		if (ring_used(&writer_ring) == 0) {
+			// keep a slow rpcap client fed and the capture file synced while no new frames come in
+			if ((rpcap_pending() || pcap_due()) && ksceKernelLockMutex(writer_mutex, 1, NULL) >= 0) {
+				rpcap_flush();
+				pcap_tick();
+				ksceKernelUnlockMutex(writer_mutex, 1);
+			}
+			ksceKernelDelayThread(WRITER_IDLE_US);
+			continue;
+		}
+
+		if (ksceKernelLockMutex(writer_mutex, 1, NULL) >= 0) {
+			writer_drain();
+			ksceKernelUnlockMutex(writer_mutex, 1);
+		}
+	}
+
+	// write out whatever is left
+	if (ksceKernelLockMutex(writer_mutex, 1, NULL) >= 0) {
+		writer_drain();
+		ksceKernelUnlockMutex(writer_mutex, 1);
+	}
+
+	return 0;
+}
+
+int writer_lock(void)
+{
+	return ksceKernelLockMutex(writer_mutex, 1, NULL);
+}
+
+void writer_unlock(void)
+{
+	ksceKernelUnlockMutex(writer_mutex, 1);
+}
+
+int writer_start(void)
+{
+	void *base;
+
+	writer_mutex = ksceKernelCreateMutex("kwifimon_writer", 0, 0, NULL);
+	if (writer_mutex < 0) {
+		return -1;
+	}
+
+	writer_mem = ksceKernelAllocMemBlock("kwifimon_ring", SCE_KERNEL_MEMBLOCK_TYPE_KERNEL_RW, WRITER_RING_SIZE, NULL);
+	if (writer_mem < 0) {
+		writer_stop();
+		return -2;
+	}
+
+	ksceKernelGetMemBlockBase(writer_mem, &base);
+	ring_init(&writer_ring, base, WRITER_RING_SIZE);
+
+	writer_run = 1;
+	writer_thid = ksceKernelCreateThread("kwifimon_writer", writer_thread, 0x3C, 0x4000, 0, 0, NULL);
+	if (writer_thid < 0) {
+		writer_stop();
+		return -3;
+	}
+
+	ksceKernelStartThread(writer_thid, 0, NULL);
+
+	return 0;
+}
+
+void writer_stop(void)
+{
+	writer_run = 0;
+
+	if (writer_thid >= 0) {
+		ksceKernelWaitThreadEnd(writer_thid, NULL, NULL);
+		ksceKernelDeleteThread(writer_thid);
+		writer_thid = -1;
+	}
+
+	if (writer_mem >= 0) {
+		ksceKernelFreeMemBlock(writer_mem);
+		writer_mem = -1;
+	}
+
+	if (writer_mutex >= 0) {
+		ksceKernelDeleteMutex(writer_mutex);
+		writer_mutex = -1;
+	}
+}
@@ -0,0 +1,22 @@
+#ifndef WRITER_h_
+#define WRITER_h_
+
+#include <stdint.h>
+#include "ring.h"
+
+#define WRITER_RING_SIZE (512*1024)
+#define WRITER_IDLE_US   2000
+
+// filled by the rx hook, drained by the writer thread into pcap/knet
+extern struct ring_t writer_ring;
+
+int writer_start(void);
+void writer_stop(void);
+
+// serializes pcap/knet open and close against the writer thread
+int writer_lock(void);
+void writer_unlock(void);
+// write out queued records, called with writer_lock held
+void writer_drain(void);
+
+#endif
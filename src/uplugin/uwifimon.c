@@ -17,6 +17,16 @@ int uwifimon_cap_stop(void)
 	return kwifimon_cap_stop();
 }
 
+int uwifimon_cap_config(const struct wifimon_cap_cfg_t *cfg)
+{
+	return kwifimon_cap_config(cfg);
+}
+
+int uwifimon_cap_stats(struct wifimon_cap_stats_t *s, int reset)
+{
+	return kwifimon_cap_stats(s, reset);
+}
+
 int uwifimon_net_start(void)
 {
 	return kwifimon_net_start();
@@ -27,6 +37,36 @@ int uwifimon_net_stop(void)
 	return kwifimon_net_stop();
 }
 
+int uwifimon_net_config(const struct wifimon_net_cfg_t *cfg)
+{
+	return kwifimon_net_config(cfg);
+}
+
+int uwifimon_net_stats(struct wifimon_net_stats_t *s, int reset)
+{
+	return kwifimon_net_stats(s, reset);
+}
+
+int uwifimon_filter_set(const struct bpf_insn_t *prog, uint32_t len)
+{
+	return kwifimon_filter_set(prog, len);
+}
+
+int uwifimon_rpcap_start(int port)
+{
+	return kwifimon_rpcap_start(port);
+}
+
+int uwifimon_rpcap_stop(void)
+{
+	return kwifimon_rpcap_stop();
+}
+
+int uwifimon_rpcap_stats(struct wifimon_rpcap_stats_t *s, int reset)
+{
+	return kwifimon_rpcap_stats(s, reset);
+}
+
 int uwifimon_mod_state(void)
 {
 	return kwifimon_mod_state();
@@ -37,6 +77,31 @@ int uwifimon_mod_stats(struct wifimon_stats_t *s, int reset)
 	return kwifimon_mod_stats(s, reset);
 }
 
+int uwifimon_live_snapshot(struct wifimon_live_t *l, int reset)
+{
+	return kwifimon_live_snapshot(l, reset);
+}
+
+int uwifimon_lat_enable(int enable)
+{
+	return kwifimon_lat_enable(enable);
+}
+
+int uwifimon_mod_lat(struct wifimon_lat_t *l, int reset)
+{
+	return kwifimon_mod_lat(l, reset);
+}
+
+int uwifimon_cmdtrace_enable(int enable)
+{
+	return kwifimon_cmdtrace_enable(enable);
+}
+
+int uwifimon_cmdtrace_read(struct wifimon_cmdtrace_t *t)
+{
+	return kwifimon_cmdtrace_read(t);
+}
+
 void _start() __attribute__ ((weak, alias("module_start")));
 int module_start(SceSize args, void *argp) {
   return SCE_KERNEL_START_SUCCESS;
@@ -5,9 +5,22 @@
 
 int uwifimon_cap_start(char *file);
 int uwifimon_cap_stop(void);
+int uwifimon_cap_config(const struct wifimon_cap_cfg_t *cfg);
+int uwifimon_cap_stats(struct wifimon_cap_stats_t *s, int reset);
 int uwifimon_net_start(void);
 int uwifimon_net_stop(void);
+int uwifimon_net_config(const struct wifimon_net_cfg_t *cfg);
+int uwifimon_net_stats(struct wifimon_net_stats_t *s, int reset);
+int uwifimon_filter_set(const struct bpf_insn_t *prog, uint32_t len);
+int uwifimon_rpcap_start(int port);
+int uwifimon_rpcap_stop(void);
+int uwifimon_rpcap_stats(struct wifimon_rpcap_stats_t *s, int reset);
 int uwifimon_mod_state(void);
 int uwifimon_mod_stats(struct wifimon_stats_t *s, int reset);
+int uwifimon_live_snapshot(struct wifimon_live_t *l, int reset);
+int uwifimon_lat_enable(int enable);
+int uwifimon_mod_lat(struct wifimon_lat_t *l, int reset);
+int uwifimon_cmdtrace_enable(int enable);
+int uwifimon_cmdtrace_read(struct wifimon_cmdtrace_t *t);
 
 #endif